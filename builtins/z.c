@@ -36,7 +36,12 @@ CHAR strZHelpText[] =
         "\n"
         "Changes the current directory based on a heuristic match.\n"
         "\n"
-        "Z [-license] <directory>\n";
+        "Z [-license] [-l] <directory>\n"
+        "\n"
+        "   -l             List remembered directories\n"
+        "\n"
+        "Set YORIZFILE to a file name to remember directories across sessions and\n"
+        "share them between concurrently running shells.\n";
 
 /**
  Display usage text to the user.
@@ -53,9 +58,108 @@ ZHelp()
 }
 
 /**
- The number of recent directories to remember in memory.
+ The number of recent directories to remember.  Once this is reached, the
+ least recently used directory is discarded.
+ */
+#define Z_MAX_RECENT_DIRS (4096)
+
+/**
+ The rank added to a directory each time it is visited.
+ */
+#define Z_RANK_PER_VISIT (100)
+
+/**
+ When the sum of the rank of all directories exceeds this value, each rank
+ is reduced by a tenth, so that directories which were used heavily long
+ ago are eventually outranked by directories in use now.
+ */
+#define Z_MAX_TOTAL_RANK (Z_RANK_PER_VISIT * 9000)
+
+/**
+ When aging reduces the rank of a directory below this value, the directory
+ is discarded.
+ */
+#define Z_MIN_RANK (Z_RANK_PER_VISIT / 4)
+
+/**
+ The score given to a path which the user specification resolves to
+ directly.  A remembered directory scores at most four times its rank plus
+ a bonus for matching the final component, and no rank can be much larger
+ than Z_MAX_TOTAL_RANK, so this is always higher than any remembered
+ directory.
+ */
+#define Z_EXPLICIT_PATH_SCORE (Z_MAX_TOTAL_RANK * 8)
+
+/**
+ The number of seconds in an hour, used to weight recently visited
+ directories.
+ */
+#define Z_SECONDS_PER_HOUR (60 * 60)
+
+/**
+ The number of seconds in a day, used to weight recently visited
+ directories.
+ */
+#define Z_SECONDS_PER_DAY (Z_SECONDS_PER_HOUR * 24)
+
+/**
+ The number of seconds in a week, used to weight recently visited
+ directories.
+ */
+#define Z_SECONDS_PER_WEEK (Z_SECONDS_PER_DAY * 7)
+
+/**
+ The minimum number of lines in the database file before it is considered
+ for compaction.
+ */
+#define Z_MIN_LINES_TO_COMPACT (256)
+
+/**
+ A path component, such as "src", which is found in one or more remembered
+ directories.  Components are indexed so that a request can be matched
+ against the directories containing it without examining every directory.
+ */
+typedef struct _Z_COMPONENT {
+
+    /**
+     The entry for this component in ZRecentDirectories.ComponentHash,
+     keyed by the component name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     A list of Z_COMPONENT_LINK structures for each directory containing
+     this component.
+     */
+    YORI_LIST_ENTRY DirectoryList;
+
+    /**
+     The number of directories containing this component.
+     */
+    DWORD DirectoryCount;
+} Z_COMPONENT, *PZ_COMPONENT;
+
+/**
+ A link between a remembered directory and one of its components.  Each
+ directory has an array of these, one per component.
  */
-#define Z_MAX_RECENT_DIRS (64)
+typedef struct _Z_COMPONENT_LINK {
+
+    /**
+     The list entry for this directory within Component->DirectoryList.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     Pointer to the component.
+     */
+    PZ_COMPONENT Component;
+
+    /**
+     Pointer to the directory containing the component.
+     */
+    struct _Z_RECENT_DIRECTORY *Directory;
+} Z_COMPONENT_LINK, *PZ_COMPONENT_LINK;
 
 /**
  A linked list element corresponding to a remembered directory.
@@ -63,24 +167,49 @@ ZHelp()
 typedef struct _Z_RECENT_DIRECTORY {
 
     /**
-     List element across the set of remembered directories.  Corresponds
-     to ZRecentDirectories.RecentDirList .
+     List element across the set of remembered directories, in order of
+     most recently used.  Corresponds to ZRecentDirectories.RecentDirList .
      */
     YORI_LIST_ENTRY ListEntry;
 
+    /**
+     The entry for this directory in ZRecentDirectories.DirectoryHash,
+     keyed by the directory name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
     /**
      The fully qualified name of the remembered directory.
      */
     YORI_STRING DirectoryName;
 
     /**
-     The number of times the directory has been encountered.
+     The rank of the directory, which increases by Z_RANK_PER_VISIT each
+     time the directory is visited and decays as other directories are
+     visited.
+     */
+    DWORD Rank;
+
+    /**
+     The number of components in the directory name, and the number of
+     elements in the Components array.
+     */
+    DWORD ComponentCount;
+
+    /**
+     The time the directory was last visited, in seconds.
      */
-    DWORD HitCount;
+    LONGLONG LastVisit;
+
+    /**
+     An array of links to each component of the directory name.
+     */
+    PZ_COMPONENT_LINK Components;
 } Z_RECENT_DIRECTORY, *PZ_RECENT_DIRECTORY;
 
 /**
- The head of the list of recent directories.
+ The set of remembered directories, and the state of the database file they
+ were loaded from.
  */
 typedef struct _Z_RECENT_DIRECTORIES {
     /**
@@ -95,11 +224,53 @@ typedef struct _Z_RECENT_DIRECTORIES {
     DWORD RecentDirCount;
 
     /**
-     A monotonically increasing number corresponding to attempts to add items
-     into the recent list.  Periodically this will trigger logic to trim the
-     HitCount on all existing entries to prevent them counting to infinity.
+     The sum of the rank of all remembered directories.  When this exceeds
+     Z_MAX_TOTAL_RANK, all ranks are reduced.
+     */
+    DWORD TotalRank;
+
+    /**
+     A hash table of remembered directories by name.
+     */
+    PYORI_HASH_TABLE DirectoryHash;
+
+    /**
+     A hash table of the components of remembered directories.
+     */
+    PYORI_HASH_TABLE ComponentHash;
+
+    /**
+     The full path to the database file that has been loaded, or an empty
+     string if no database file is in use.
+     */
+    YORI_STRING FileName;
+
+    /**
+     The number of bytes of the database file which have been loaded.
+     Other processes append to the file, so the next load starts from
+     here.
      */
-    DWORD MonotonicAddAttempt;
+    LARGE_INTEGER FileOffset;
+
+    /**
+     The high part of the file index of the database file which has been
+     loaded.  If the file is compacted, this changes and the file is loaded
+     again.
+     */
+    DWORD FileIndexHigh;
+
+    /**
+     The low part of the file index of the database file which has been
+     loaded.
+     */
+    DWORD FileIndexLow;
+
+    /**
+     The number of lines in the database file which have been loaded.
+     When this is large relative to the number of remembered directories,
+     the file is compacted.
+     */
+    DWORD FileLines;
 
 } Z_RECENT_DIRECTORIES, *PZ_RECENT_DIRECTORIES;
 
@@ -111,6 +282,12 @@ typedef struct _Z_RECENT_DIRECTORIES {
  */
 typedef struct _Z_SCOREBOARD_ENTRY {
 
+    /**
+     The entry for this match in a hash table of matches, so that a
+     directory matched more than once can be found and combined.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
     /**
      The name of the directory.  Note that while the array is being
      constructed this string is not referenced, but still contains a
@@ -119,6 +296,18 @@ typedef struct _Z_SCOREBOARD_ENTRY {
      */
     YORI_STRING DirectoryName;
 
+    /**
+     If the match is a remembered directory, points to it, so that it can
+     be forgotten if it no longer exists.  NULL if the match is the
+     resolved user specification or a parent of a remembered directory.
+     */
+    PZ_RECENT_DIRECTORY Directory;
+
+    /**
+     TRUE if the match is a remembered directory which no longer exists.
+     */
+    BOOL Missing;
+
     /**
      The score for this entry.
      */
@@ -130,129 +319,881 @@ typedef struct _Z_SCOREBOARD_ENTRY {
  */
 Z_RECENT_DIRECTORIES ZRecentDirectories;
 
-/**
- Set to TRUE once the command has been invoked once to keep the module loaded.
- */
-BOOL ZCallbacksRegistered;
+/**
+ Set to TRUE once the command has been invoked once to keep the module loaded.
+ */
+BOOL ZCallbacksRegistered;
+
+/**
+ Return the current time in seconds, which is used to record when a
+ directory was visited.
+
+ @return The current time in seconds.
+ */
+LONGLONG
+ZGetCurrentTime(VOID)
+{
+    FILETIME ftNow;
+    LARGE_INTEGER liNow;
+
+    GetSystemTimeAsFileTime(&ftNow);
+    liNow.LowPart = ftNow.dwLowDateTime;
+    liNow.HighPart = ftNow.dwHighDateTime;
+
+    return liNow.QuadPart / (10 * 1000 * 1000);
+}
+
+/**
+ Calculate the frecency of a remembered directory, which is its rank
+ weighted by how recently it was visited.
+
+ @param Directory Pointer to the remembered directory.
+
+ @param Now The current time in seconds.
+
+ @return The frecency of the directory.
+ */
+DWORD
+ZGetFrecency(
+    __in PZ_RECENT_DIRECTORY Directory,
+    __in LONGLONG Now
+    )
+{
+    LONGLONG Age;
+
+    Age = Now - Directory->LastVisit;
+    if (Age < Z_SECONDS_PER_HOUR) {
+        return Directory->Rank * 4;
+    } else if (Age < Z_SECONDS_PER_DAY) {
+        return Directory->Rank * 2;
+    } else if (Age < Z_SECONDS_PER_WEEK) {
+        return Directory->Rank / 2;
+    }
+
+    return Directory->Rank / 4;
+}
+
+/**
+ Allocate the hash tables used to find remembered directories, if they have
+ not been allocated already.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+ZInitializeRecent(VOID)
+{
+    if (ZRecentDirectories.RecentDirList.Next == NULL) {
+        YoriLibInitializeListHead(&ZRecentDirectories.RecentDirList);
+    }
+
+    if (ZRecentDirectories.DirectoryHash == NULL) {
+        ZRecentDirectories.DirectoryHash = YoriLibAllocateHashTable(250);
+        if (ZRecentDirectories.DirectoryHash == NULL) {
+            return FALSE;
+        }
+    }
+
+    if (ZRecentDirectories.ComponentHash == NULL) {
+        ZRecentDirectories.ComponentHash = YoriLibAllocateHashTable(250);
+        if (ZRecentDirectories.ComponentHash == NULL) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Remove a remembered directory from the list, the hash table, and the
+ index of its components, and free it.
+
+ @param Directory Pointer to the directory to remove.
+ */
+VOID
+ZRemoveDirectory(
+    __in PZ_RECENT_DIRECTORY Directory
+    )
+{
+    DWORD Index;
+    PZ_COMPONENT Component;
+
+    for (Index = 0; Index < Directory->ComponentCount; Index++) {
+        Component = Directory->Components[Index].Component;
+        if (Component == NULL) {
+            continue;
+        }
+        YoriLibRemoveListItem(&Directory->Components[Index].ListEntry);
+        Component->DirectoryCount--;
+        if (Component->DirectoryCount == 0) {
+            YoriLibHashRemoveByEntry(&Component->HashEntry);
+            YoriLibFree(Component);
+        }
+    }
+
+    YoriLibRemoveListItem(&Directory->ListEntry);
+    YoriLibHashRemoveByEntry(&Directory->HashEntry);
+    ZRecentDirectories.RecentDirCount--;
+    ZRecentDirectories.TotalRank -= Directory->Rank;
+    YoriLibFreeStringContents(&Directory->DirectoryName);
+    YoriLibDereference(Directory);
+}
+
+/**
+ Forget all remembered directories.
+ */
+VOID
+ZClearRecent(VOID)
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PZ_RECENT_DIRECTORY FoundRecentDir;
+
+    if (ZRecentDirectories.RecentDirList.Next == NULL) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
+    while (ListEntry != NULL) {
+        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
+        ZRemoveDirectory(FoundRecentDir);
+    }
+
+    ASSERT(ZRecentDirectories.RecentDirCount == 0);
+    ASSERT(ZRecentDirectories.TotalRank == 0);
+}
+
+/**
+ Count the components in a fully qualified directory name.
+
+ @param DirectoryName Pointer to the directory name.
+
+ @return The number of components.
+ */
+DWORD
+ZCountComponents(
+    __in PYORI_STRING DirectoryName
+    )
+{
+    DWORD Index;
+    DWORD ComponentCount;
+    BOOL InComponent;
+
+    ComponentCount = 0;
+    InComponent = FALSE;
+    for (Index = 0; Index < DirectoryName->LengthInChars; Index++) {
+        if (YoriLibIsSep(DirectoryName->StartOfString[Index])) {
+            InComponent = FALSE;
+        } else if (!InComponent) {
+            InComponent = TRUE;
+            ComponentCount++;
+        }
+    }
+
+    return ComponentCount;
+}
+
+/**
+ Add each component of a newly remembered directory to the index of
+ components.  If a component cannot be added, the directory is not found
+ by that component but can still be found by a search of all directories.
+
+ @param Directory Pointer to the directory whose components should be
+        indexed.
+ */
+VOID
+ZIndexComponents(
+    __in PZ_RECENT_DIRECTORY Directory
+    )
+{
+    DWORD Index;
+    DWORD ComponentIndex;
+    DWORD EarlierIndex;
+    YORI_STRING ComponentName;
+    PYORI_HASH_ENTRY HashEntry;
+    PZ_COMPONENT Component;
+
+    YoriLibInitEmptyString(&ComponentName);
+    ComponentIndex = 0;
+
+    for (Index = 0; Index <= Directory->DirectoryName.LengthInChars; Index++) {
+        if (Index < Directory->DirectoryName.LengthInChars &&
+            !YoriLibIsSep(Directory->DirectoryName.StartOfString[Index])) {
+
+            if (ComponentName.StartOfString == NULL) {
+                ComponentName.StartOfString = &Directory->DirectoryName.StartOfString[Index];
+            }
+            ComponentName.LengthInChars++;
+            continue;
+        }
+
+        if (ComponentName.StartOfString == NULL) {
+            continue;
+        }
+
+        ASSERT(ComponentIndex < Directory->ComponentCount);
+        Directory->Components[ComponentIndex].Directory = Directory;
+        Directory->Components[ComponentIndex].Component = NULL;
+
+        HashEntry = YoriLibHashLookupByKey(ZRecentDirectories.ComponentHash, &ComponentName);
+        if (HashEntry != NULL) {
+            Component = (PZ_COMPONENT)HashEntry->Context;
+        } else {
+            Component = YoriLibMalloc(sizeof(Z_COMPONENT));
+            if (Component != NULL) {
+                YoriLibInitializeListHead(&Component->DirectoryList);
+                Component->DirectoryCount = 0;
+                ComponentName.MemoryToFree = Directory->DirectoryName.MemoryToFree;
+                YoriLibHashInsertByKey(ZRecentDirectories.ComponentHash, &ComponentName, Component, &Component->HashEntry);
+            }
+        }
+
+        //
+        //  If the directory contains the same component more than once,
+        //  such as C:\src\x\src, only link it to the component once, so
+        //  that the directory is scored once when searching by that
+        //  component.
+        //
+
+        for (EarlierIndex = 0; Component != NULL && EarlierIndex < ComponentIndex; EarlierIndex++) {
+            if (Directory->Components[EarlierIndex].Component == Component) {
+                Component = NULL;
+            }
+        }
+
+        if (Component != NULL) {
+            Directory->Components[ComponentIndex].Component = Component;
+            YoriLibInsertList(&Component->DirectoryList, &Directory->Components[ComponentIndex].ListEntry);
+            Component->DirectoryCount++;
+        }
+
+        ComponentIndex++;
+        YoriLibInitEmptyString(&ComponentName);
+    }
+}
+
+/**
+ Reduce the rank of all remembered directories once the total rank has
+ grown too large, discarding any directory whose rank becomes too small.
+ */
+VOID
+ZAgeRecent(VOID)
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PZ_RECENT_DIRECTORY FoundRecentDir;
+    DWORD Reduction;
+
+    if (ZRecentDirectories.TotalRank <= Z_MAX_TOTAL_RANK) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
+    while (ListEntry != NULL) {
+        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
+        Reduction = FoundRecentDir->Rank / 10;
+        FoundRecentDir->Rank -= Reduction;
+        ZRecentDirectories.TotalRank -= Reduction;
+        if (FoundRecentDir->Rank < Z_MIN_RANK) {
+            ZRemoveDirectory(FoundRecentDir);
+        }
+    }
+}
+
+/**
+ Record a visit to a directory.  If the directory is already remembered,
+ promote it to be the most recent entry and increase its rank.  If it is
+ not, add a new entry, potentially evicting the least recently used entry.
+
+ @param DirectoryName Pointer to the fully qualified directory name.
+
+ @param Rank The rank to add to the directory.  If zero, the directory is
+        forgotten.
+
+ @param VisitTime The time of the visit, in seconds.
+
+ @return TRUE if the visit was recorded, FALSE if it was not.
+ */
+BOOL
+ZRecordVisit(
+    __in PYORI_STRING DirectoryName,
+    __in DWORD Rank,
+    __in LONGLONG VisitTime
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_LIST_ENTRY ListEntry;
+    PZ_RECENT_DIRECTORY FoundRecentDir;
+    DWORD ComponentCount;
+
+    if (!ZInitializeRecent()) {
+        return FALSE;
+    }
+
+    //
+    //  Check if the new directory already exists in the recent directory
+    //  list, update its position to be head of the list, increase its
+    //  rank, and return.
+    //
+
+    HashEntry = YoriLibHashLookupByKey(ZRecentDirectories.DirectoryHash, DirectoryName);
+    if (HashEntry != NULL) {
+        FoundRecentDir = (PZ_RECENT_DIRECTORY)HashEntry->Context;
+        if (Rank == 0) {
+            ZRemoveDirectory(FoundRecentDir);
+            return TRUE;
+        }
+        YoriLibRemoveListItem(&FoundRecentDir->ListEntry);
+        YoriLibInsertList(&ZRecentDirectories.RecentDirList, &FoundRecentDir->ListEntry);
+        FoundRecentDir->Rank += Rank;
+        ZRecentDirectories.TotalRank += Rank;
+        if (VisitTime > FoundRecentDir->LastVisit) {
+            FoundRecentDir->LastVisit = VisitTime;
+        }
+        ZAgeRecent();
+        return TRUE;
+    }
+
+    if (Rank == 0) {
+        return TRUE;
+    }
+
+    //
+    //  Since it's not in the list, evict the oldest entry if the list has
+    //  reached its maximum size.
+    //
+
+    if (ZRecentDirectories.RecentDirCount >= Z_MAX_RECENT_DIRS) {
+        ListEntry = YoriLibGetPreviousListEntry(&ZRecentDirectories.RecentDirList, NULL);
+        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
+        ZRemoveDirectory(FoundRecentDir);
+    }
+
+    //
+    //  Attempt to insert a new entry corresponding to this directory.
+    //
+
+    ComponentCount = ZCountComponents(DirectoryName);
+    FoundRecentDir = YoriLibReferencedMalloc(sizeof(Z_RECENT_DIRECTORY) + ComponentCount * sizeof(Z_COMPONENT_LINK) + (DirectoryName->LengthInChars + 1) * sizeof(TCHAR));
+    if (FoundRecentDir == NULL) {
+        return FALSE;
+    }
+
+    FoundRecentDir->ComponentCount = ComponentCount;
+    FoundRecentDir->Components = (PZ_COMPONENT_LINK)(FoundRecentDir + 1);
+
+    YoriLibReference(FoundRecentDir);
+    FoundRecentDir->DirectoryName.MemoryToFree = FoundRecentDir;
+    FoundRecentDir->DirectoryName.StartOfString = (LPWSTR)(FoundRecentDir->Components + ComponentCount);
+    FoundRecentDir->DirectoryName.LengthAllocated = DirectoryName->LengthInChars + 1;
+    FoundRecentDir->DirectoryName.LengthInChars = DirectoryName->LengthInChars;
+
+    memcpy(FoundRecentDir->DirectoryName.StartOfString, DirectoryName->StartOfString, DirectoryName->LengthInChars * sizeof(TCHAR));
+    FoundRecentDir->DirectoryName.StartOfString[DirectoryName->LengthInChars] = '\0';
+
+    FoundRecentDir->Rank = Rank;
+    FoundRecentDir->LastVisit = VisitTime;
+
+    YoriLibInsertList(&ZRecentDirectories.RecentDirList, &FoundRecentDir->ListEntry);
+    YoriLibHashInsertByKey(ZRecentDirectories.DirectoryHash, &FoundRecentDir->DirectoryName, FoundRecentDir, &FoundRecentDir->HashEntry);
+    ZIndexComponents(FoundRecentDir);
+    ZRecentDirectories.RecentDirCount++;
+    ZRecentDirectories.TotalRank += Rank;
+
+    ASSERT(ZRecentDirectories.RecentDirCount <= Z_MAX_RECENT_DIRS);
+
+    ZAgeRecent();
+
+    return TRUE;
+}
+
+/**
+ Find the database file, if the user has requested one by setting
+ YORIZFILE.
+
+ @param FilePath On successful completion, populated with the full path to
+        the database file.  The caller should free this with
+        @ref YoriLibFreeStringContents .
+
+ @return TRUE to indicate a database file is configured and FilePath has
+         been populated, FALSE if no database file is configured or the
+         path could not be resolved.
+ */
+__success(return)
+BOOL
+ZGetDatabaseFileName(
+    __out PYORI_STRING FilePath
+    )
+{
+    YORI_STRING UserFileName;
+
+    YoriLibInitEmptyString(&UserFileName);
+    if (!YoriLibAllocateAndGetEnvironmentVariable(_T("YORIZFILE"), &UserFileName)) {
+        return FALSE;
+    }
+
+    if (UserFileName.LengthInChars == 0) {
+        YoriLibFreeStringContents(&UserFileName);
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(FilePath);
+    if (!YoriLibUserStringToSingleFilePath(&UserFileName, TRUE, FilePath)) {
+        YoriLibFreeStringContents(&UserFileName);
+        return FALSE;
+    }
+
+    YoriLibFreeStringContents(&UserFileName);
+    return TRUE;
+}
+
+/**
+ Parse a single line from the database file and record the visit it
+ describes.  Each line consists of the time of the visit in seconds, the
+ rank to add, and the directory name, seperated by spaces.
+
+ @param Line Pointer to the line, without its line ending.
+ */
+VOID
+ZParseDatabaseLine(
+    __in PYORI_STRING Line
+    )
+{
+    YORI_STRING Remaining;
+    LONGLONG VisitTime;
+    LONGLONG Rank;
+    DWORD CharsConsumed;
+
+    YoriLibInitEmptyString(&Remaining);
+    Remaining.StartOfString = Line->StartOfString;
+    Remaining.LengthInChars = Line->LengthInChars;
+
+    if (!YoriLibStringToNumber(&Remaining, FALSE, &VisitTime, &CharsConsumed) ||
+        CharsConsumed == 0 ||
+        CharsConsumed >= Remaining.LengthInChars ||
+        Remaining.StartOfString[CharsConsumed] != ' ') {
+
+        return;
+    }
+
+    Remaining.StartOfString += CharsConsumed + 1;
+    Remaining.LengthInChars -= CharsConsumed + 1;
+
+    if (!YoriLibStringToNumber(&Remaining, FALSE, &Rank, &CharsConsumed) ||
+        CharsConsumed == 0 ||
+        CharsConsumed >= Remaining.LengthInChars ||
+        Remaining.StartOfString[CharsConsumed] != ' ' ||
+        Rank < 0 ||
+        Rank > Z_MAX_TOTAL_RANK) {
+
+        return;
+    }
+
+    Remaining.StartOfString += CharsConsumed + 1;
+    Remaining.LengthInChars -= CharsConsumed + 1;
+
+    if (Remaining.LengthInChars == 0) {
+        return;
+    }
+
+    ZRecordVisit(&Remaining, (DWORD)Rank, VisitTime);
+    ZRecentDirectories.FileLines++;
+}
+
+/**
+ Load any visits which have been added to the database file since it was
+ last loaded.  The file is shared between concurrently running shells,
+ each of which appends to it, so this is performed on each invocation.  If
+ the file has been replaced by compaction, or a different file has been
+ configured, everything remembered is discarded and the file is loaded from
+ the beginning.
+
+ @param FilePath Pointer to the full path to the database file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+ZLoadDatabase(
+    __in PYORI_STRING FilePath
+    )
+{
+    HANDLE FileHandle;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    LARGE_INTEGER FileSize;
+    DWORD BytesToRead;
+    DWORD BytesRead;
+    DWORD CharsRead;
+    DWORD Index;
+    DWORD LineStart;
+    PWCHAR Buffer;
+    YORI_STRING Line;
+    LARGE_INTEGER FileOffset;
+
+    FileHandle = CreateFile(FilePath->StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+
+    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+        if (GetLastError() == ERROR_FILE_NOT_FOUND) {
+            ZClearRecent();
+            ZRecentDirectories.FileOffset.QuadPart = 0;
+            ZRecentDirectories.FileLines = 0;
+            ZRecentDirectories.FileIndexHigh = 0;
+            ZRecentDirectories.FileIndexLow = 0;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    if (!GetFileInformationByHandle(FileHandle, &FileInfo)) {
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
+
+    FileSize.HighPart = FileInfo.nFileSizeHigh;
+    FileSize.LowPart = FileInfo.nFileSizeLow;
+
+    if (FileInfo.nFileIndexHigh != ZRecentDirectories.FileIndexHigh ||
+        FileInfo.nFileIndexLow != ZRecentDirectories.FileIndexLow ||
+        FileSize.QuadPart < ZRecentDirectories.FileOffset.QuadPart) {
+
+        ZClearRecent();
+        ZRecentDirectories.FileOffset.QuadPart = 0;
+        ZRecentDirectories.FileLines = 0;
+        ZRecentDirectories.FileIndexHigh = FileInfo.nFileIndexHigh;
+        ZRecentDirectories.FileIndexLow = FileInfo.nFileIndexLow;
+    }
+
+    if (FileSize.QuadPart - ZRecentDirectories.FileOffset.QuadPart < (LONGLONG)sizeof(WCHAR) ||
+        FileSize.QuadPart - ZRecentDirectories.FileOffset.QuadPart > (DWORD)-1 / 2) {
+
+        CloseHandle(FileHandle);
+        return TRUE;
+    }
+
+    BytesToRead = (DWORD)(FileSize.QuadPart - ZRecentDirectories.FileOffset.QuadPart);
+    BytesToRead = BytesToRead & ~((DWORD)sizeof(WCHAR) - 1);
+
+    Buffer = YoriLibMalloc(BytesToRead);
+    if (Buffer == NULL) {
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
+
+    FileOffset.QuadPart = ZRecentDirectories.FileOffset.QuadPart;
+    if ((SetFilePointer(FileHandle, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+         GetLastError() != NO_ERROR) ||
+        !ReadFile(FileHandle, Buffer, BytesToRead, &BytesRead, NULL)) {
+
+        YoriLibFree(Buffer);
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
+
+    CloseHandle(FileHandle);
+
+    //
+    //  Only process complete lines.  A line which has not been terminated
+    //  is processed on a later load once it is complete.
+    //
+
+    CharsRead = BytesRead / sizeof(WCHAR);
+    LineStart = 0;
+    YoriLibInitEmptyString(&Line);
+    for (Index = 0; Index < CharsRead; Index++) {
+        if (Buffer[Index] != '\n') {
+            continue;
+        }
+
+        Line.StartOfString = &Buffer[LineStart];
+        Line.LengthInChars = Index - LineStart;
+        if (Line.LengthInChars > 0 && Line.StartOfString[Line.LengthInChars - 1] == '\r') {
+            Line.LengthInChars--;
+        }
+
+        ZParseDatabaseLine(&Line);
+        LineStart = Index + 1;
+    }
+
+    ZRecentDirectories.FileOffset.QuadPart += LineStart * sizeof(WCHAR);
+
+    YoriLibFree(Buffer);
+    return TRUE;
+}
+
+/**
+ Append one or more lines to the end of the database file.  The lines are
+ written with a single call, so lines from concurrent shells are not
+ interleaved.
+
+ @param FilePath Pointer to the full path to the database file.
+
+ @param Lines Pointer to the lines to write, including line endings.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+ZAppendToDatabase(
+    __in PYORI_STRING FilePath,
+    __in PYORI_STRING Lines
+    )
+{
+    HANDLE FileHandle;
+    DWORD BytesWritten;
+    BOOL Result;
+
+    FileHandle = CreateFile(FilePath->StartOfString,
+                            FILE_APPEND_DATA,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+
+    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    Result = WriteFile(FileHandle, Lines->StartOfString, Lines->LengthInChars * sizeof(TCHAR), &BytesWritten, NULL);
+    CloseHandle(FileHandle);
+    return Result;
+}
+
+/**
+ Rewrite the database file to contain one line for each remembered
+ directory, once it contains many more lines than there are remembered
+ directories.  The new file is written alongside the existing one and
+ renamed over it.  Other shells notice the file has been replaced and load
+ it again.  A visit appended by another shell after this shell last loaded
+ the file is lost.
+
+ @param FilePath Pointer to the full path to the database file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+ZCompactDatabase(
+    __in PYORI_STRING FilePath
+    )
+{
+    YORI_STRING TempPath;
+    YORI_STRING Lines;
+    DWORD CharsNeeded;
+    DWORD BytesWritten;
+    HANDLE FileHandle;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    PYORI_LIST_ENTRY ListEntry;
+    PZ_RECENT_DIRECTORY FoundRecentDir;
+    BOOL Result;
+
+    if (ZRecentDirectories.FileLines < Z_MIN_LINES_TO_COMPACT ||
+        ZRecentDirectories.FileLines <= ZRecentDirectories.RecentDirCount * 2) {
+
+        return TRUE;
+    }
+
+    CharsNeeded = 0;
+    ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
+    while (ListEntry != NULL) {
+        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
+        CharsNeeded += FoundRecentDir->DirectoryName.LengthInChars + 48;
+    }
+
+    if (!YoriLibAllocateString(&Lines, CharsNeeded + 1)) {
+        return FALSE;
+    }
+
+    //
+    //  Write the least recently used directory first, so that loading the
+    //  file leaves the directories in the same order.
+    //
+
+    Lines.LengthInChars = 0;
+    ListEntry = YoriLibGetPreviousListEntry(&ZRecentDirectories.RecentDirList, NULL);
+    while (ListEntry != NULL) {
+        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
+        ListEntry = YoriLibGetPreviousListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
+        Lines.LengthInChars += YoriLibSPrintf(&Lines.StartOfString[Lines.LengthInChars], _T("%lli %i %y\r\n"), FoundRecentDir->LastVisit, FoundRecentDir->Rank, &FoundRecentDir->DirectoryName);
+    }
+
+    if (!YoriLibAllocateString(&TempPath, FilePath->LengthInChars + sizeof(".new"))) {
+        YoriLibFreeStringContents(&Lines);
+        return FALSE;
+    }
+
+    TempPath.LengthInChars = YoriLibSPrintf(TempPath.StartOfString, _T("%y.new"), FilePath);
+    ZeroMemory(&FileInfo, sizeof(FileInfo));
+
+    FileHandle = CreateFile(TempPath.StartOfString,
+                            GENERIC_WRITE,
+                            0,
+                            NULL,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+
+    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+        YoriLibFreeStringContents(&TempPath);
+        YoriLibFreeStringContents(&Lines);
+        return FALSE;
+    }
+
+    Result = WriteFile(FileHandle, Lines.StartOfString, Lines.LengthInChars * sizeof(TCHAR), &BytesWritten, NULL);
+    if (Result) {
+        Result = GetFileInformationByHandle(FileHandle, &FileInfo);
+    }
+    CloseHandle(FileHandle);
+
+    if (Result) {
+        Result = MoveFileEx(TempPath.StartOfString, FilePath->StartOfString, MOVEFILE_REPLACE_EXISTING);
+    }
+
+    if (Result) {
+        ZRecentDirectories.FileIndexHigh = FileInfo.nFileIndexHigh;
+        ZRecentDirectories.FileIndexLow = FileInfo.nFileIndexLow;
+        ZRecentDirectories.FileOffset.QuadPart = Lines.LengthInChars * sizeof(TCHAR);
+        ZRecentDirectories.FileLines = ZRecentDirectories.RecentDirCount;
+    } else {
+        DeleteFile(TempPath.StartOfString);
+    }
+
+    YoriLibFreeStringContents(&TempPath);
+    YoriLibFreeStringContents(&Lines);
+    return Result;
+}
+
+/**
+ Bring the set of remembered directories up to date with the database file,
+ if the user has configured one by setting YORIZFILE.  If the file has grown
+ large, compact it.
+ */
+VOID
+ZSynchronizeDatabase(VOID)
+{
+    YORI_STRING FilePath;
+
+    if (!ZGetDatabaseFileName(&FilePath)) {
+        YoriLibFreeStringContents(&ZRecentDirectories.FileName);
+        return;
+    }
+
+    if (YoriLibCompareStringInsensitive(&FilePath, &ZRecentDirectories.FileName) != 0) {
+        YoriLibFreeStringContents(&ZRecentDirectories.FileName);
+        ZClearRecent();
+        ZRecentDirectories.FileOffset.QuadPart = 0;
+        ZRecentDirectories.FileLines = 0;
+        ZRecentDirectories.FileIndexHigh = 0;
+        ZRecentDirectories.FileIndexLow = 0;
+        YoriLibCloneString(&ZRecentDirectories.FileName, &FilePath);
+    }
+
+    if (ZLoadDatabase(&FilePath)) {
+        ZCompactDatabase(&FilePath);
+    }
+
+    YoriLibFreeStringContents(&FilePath);
+}
+
+/**
+ Record visits to the directory that was current and the directory that is
+ becoming current.  If a database file is in use, the visits are appended to
+ the file and are loaded from it on the next invocation; otherwise they are
+ recorded in memory immediately.
+
+ @param OldDirectory Pointer to the fully qualified name of the directory
+        that was current.
+
+ @param NewDirectory Pointer to the fully qualified name of the directory
+        that is becoming current.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+ZRecordDirectoryChange(
+    __in PYORI_STRING OldDirectory,
+    __in PYORI_STRING NewDirectory
+    )
+{
+    YORI_STRING Lines;
+    LONGLONG Now;
+    BOOL Result;
+
+    Now = ZGetCurrentTime();
+
+    if (ZRecentDirectories.FileName.LengthInChars == 0) {
+        ZRecordVisit(OldDirectory, Z_RANK_PER_VISIT, Now);
+        return ZRecordVisit(NewDirectory, Z_RANK_PER_VISIT, Now);
+    }
+
+    if (!YoriLibAllocateString(&Lines, OldDirectory->LengthInChars + NewDirectory->LengthInChars + 96)) {
+        return FALSE;
+    }
+
+    Lines.LengthInChars = YoriLibSPrintf(Lines.StartOfString, _T("%lli %i %y\r\n%lli %i %y\r\n"), Now, Z_RANK_PER_VISIT, OldDirectory, Now, Z_RANK_PER_VISIT, NewDirectory);
+    Result = ZAppendToDatabase(&ZRecentDirectories.FileName, &Lines);
+    YoriLibFreeStringContents(&Lines);
+    return Result;
+}
 
 /**
- Display the current known list of recent directories in order of most
- recently used to least recently used with their corresponding hit count.
+ Forget a remembered directory which no longer exists.  If a database file
+ is in use, this is recorded in the file so that other shells forget it
+ too.
 
- @return TRUE to indicate success, FALSE to indicate failure.
+ @param Directory Pointer to the directory to forget.
  */
-BOOL
-ZListStack()
+VOID
+ZForgetDirectory(
+    __in PZ_RECENT_DIRECTORY Directory
+    )
 {
-    PYORI_LIST_ENTRY ListEntry;
-    PZ_RECENT_DIRECTORY FoundRecentDir;
+    YORI_STRING Lines;
 
-    ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
-    while (ListEntry != NULL) {
-        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
-        ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y HitCount %i\n"), &FoundRecentDir->DirectoryName, FoundRecentDir->HitCount);
+    if (ZRecentDirectories.FileName.LengthInChars > 0 &&
+        YoriLibAllocateString(&Lines, Directory->DirectoryName.LengthInChars + 48)) {
+
+        Lines.LengthInChars = YoriLibSPrintf(Lines.StartOfString, _T("%lli 0 %y\r\n"), ZGetCurrentTime(), &Directory->DirectoryName);
+        ZAppendToDatabase(&ZRecentDirectories.FileName, &Lines);
+        YoriLibFreeStringContents(&Lines);
     }
-    return TRUE;
+
+    ZRemoveDirectory(Directory);
 }
 
 /**
- Check the recent directories for a match to DirectoryName.  If a match is
- found, promote it to be the most recent entry and update its HitCount.
- If no match is found, add a new match, potentially evicting the least
- recently used match.
-
- @param DirectoryName Pointer to the fully qualified directory name to add.
+ Display the current known list of recent directories in order of most
+ recently used to least recently used with their corresponding rank and
+ frecency.
 
- @return TRUE if the entry was successfully added, FALSE if it was not.
+ @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-ZAddDirectoryToRecent(
-    __in PYORI_STRING DirectoryName
-    )
+ZListStack()
 {
     PYORI_LIST_ENTRY ListEntry;
     PZ_RECENT_DIRECTORY FoundRecentDir;
+    LONGLONG Now;
 
     if (ZRecentDirectories.RecentDirList.Next == NULL) {
-        YoriLibInitializeListHead(&ZRecentDirectories.RecentDirList);
-    }
-
-    //
-    //  If this attempt to add is a multiple of 1/4th of the size of the
-    //  list, decrease each HitCount by 1/4th of its current value.
-    //  This math isn't completely perfect, but it will tend to keep
-    //  HitCounts relatively low while still maintaining a measurable
-    //  difference between entries hit a lot and entries rarely hit.
-    //
-
-    ZRecentDirectories.MonotonicAddAttempt++;
-    if ((ZRecentDirectories.MonotonicAddAttempt % (Z_MAX_RECENT_DIRS >> 2)) == 0) {
-        ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
-        while (ListEntry != NULL) {
-            FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
-            ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
-            FoundRecentDir->HitCount -= (FoundRecentDir->HitCount >> 2);
-            ASSERT(FoundRecentDir->HitCount > 0);
-        }
+        return TRUE;
     }
 
-    //
-    //  Check if the new directory already exists in the recent directory
-    //  list, update its position to be head of the list, increase its
-    //  HitCount, and return.
-    //
-
+    Now = ZGetCurrentTime();
     ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
     while (ListEntry != NULL) {
         FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
-        if (YoriLibCompareStringInsensitive(DirectoryName, &FoundRecentDir->DirectoryName) == 0) {
-            YoriLibRemoveListItem(&FoundRecentDir->ListEntry);
-            YoriLibInsertList(&ZRecentDirectories.RecentDirList, &FoundRecentDir->ListEntry);
-            FoundRecentDir->HitCount++;
-            return TRUE;
-        }
         ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y Rank %i Frecency %i\n"), &FoundRecentDir->DirectoryName, FoundRecentDir->Rank, ZGetFrecency(FoundRecentDir, Now));
     }
-
-    //
-    //  Since it's not in the list, evict the oldest entry if the list has
-    //  reached its maximum size.
-    //
-
-    if (ZRecentDirectories.RecentDirCount >= Z_MAX_RECENT_DIRS) {
-        ListEntry = YoriLibGetPreviousListEntry(&ZRecentDirectories.RecentDirList, NULL);
-        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
-        YoriLibRemoveListItem(&FoundRecentDir->ListEntry);
-        YoriLibFreeStringContents(&FoundRecentDir->DirectoryName);
-        YoriLibDereference(FoundRecentDir);
-        ZRecentDirectories.RecentDirCount--;
-    }
-
-    //
-    //  Attempt to insert a new entry corresponding to this directory.
-    //
-
-    FoundRecentDir = YoriLibReferencedMalloc(sizeof(Z_RECENT_DIRECTORY) + (DirectoryName->LengthInChars + 1) * sizeof(TCHAR));
-    if (FoundRecentDir == NULL) {
-        return FALSE;
-    }
-
-    YoriLibReference(FoundRecentDir);
-    FoundRecentDir->DirectoryName.MemoryToFree = FoundRecentDir;
-    FoundRecentDir->DirectoryName.StartOfString = (LPWSTR)(FoundRecentDir + 1);
-    FoundRecentDir->DirectoryName.LengthAllocated = DirectoryName->LengthInChars + 1;
-    FoundRecentDir->DirectoryName.LengthInChars = DirectoryName->LengthInChars;
-
-    memcpy(FoundRecentDir->DirectoryName.StartOfString, DirectoryName->StartOfString, (DirectoryName->LengthInChars + 1) * sizeof(TCHAR));
-
-    FoundRecentDir->HitCount = 1;
-
-    YoriLibInsertList(&ZRecentDirectories.RecentDirList, &FoundRecentDir->ListEntry);
-    ZRecentDirectories.RecentDirCount++;
-
-    ASSERT(ZRecentDirectories.RecentDirCount <= Z_MAX_RECENT_DIRS);
-
     return TRUE;
 }
 
@@ -263,17 +1204,19 @@ VOID
 YORI_BUILTIN_FN
 ZNotifyUnload()
 {
-    PYORI_LIST_ENTRY ListEntry;
-    PZ_RECENT_DIRECTORY FoundRecentDir;
+    ZClearRecent();
 
-    ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
-    while (ListEntry != NULL) {
-        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
-        ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
-        YoriLibRemoveListItem(&FoundRecentDir->ListEntry);
-        YoriLibFreeStringContents(&FoundRecentDir->DirectoryName);
-        YoriLibDereference(FoundRecentDir);
+    if (ZRecentDirectories.DirectoryHash != NULL) {
+        YoriLibFreeEmptyHashTable(ZRecentDirectories.DirectoryHash);
+        ZRecentDirectories.DirectoryHash = NULL;
+    }
+
+    if (ZRecentDirectories.ComponentHash != NULL) {
+        YoriLibFreeEmptyHashTable(ZRecentDirectories.ComponentHash);
+        ZRecentDirectories.ComponentHash = NULL;
     }
+
+    YoriLibFreeStringContents(&ZRecentDirectories.FileName);
 }
 
 /**
@@ -347,12 +1290,186 @@ ZResolveSpecificationToFullPath(
     return TRUE;
 }
 
+/**
+ Heuristically score a remembered directory against the user specification,
+ and if it matches, add it to the scoreboard.  If the match has already been
+ added by the fully resolved user specification or an earlier parent match,
+ it is combined with the existing entry.
+
+ @param UserSpecification Pointer to the user specification to match against.
+
+ @param FoundRecentDir Pointer to the remembered directory to score.
+
+ @param Now The current time in seconds.
+
+ @param Entries Pointer to the scoreboard.
+
+ @param EntriesPopulated On input, the number of entries in the scoreboard.
+        On output, updated to include any entry added.
+
+ @param MatchHash A hash table of the entries in the scoreboard by name.
+ */
+VOID
+ZScoreDirectory(
+    __in PYORI_STRING UserSpecification,
+    __in PZ_RECENT_DIRECTORY FoundRecentDir,
+    __in LONGLONG Now,
+    __inout PZ_SCOREBOARD_ENTRY Entries,
+    __inout PDWORD EntriesPopulated,
+    __in PYORI_HASH_TABLE MatchHash
+    )
+{
+    YORI_STRING FinalComponent;
+    YORI_STRING TrailingPortion;
+    YORI_STRING StringToAdd;
+    PYORI_HASH_ENTRY HashEntry;
+    PZ_SCOREBOARD_ENTRY Entry;
+    DWORD ScoreForThisEntry;
+    DWORD OffsetOfMatch;
+    BOOL SeperatorBefore;
+    BOOL SeperatorAfter;
+    BOOL AddThisEntry;
+    BOOL FoundAsParentOnly;
+
+    AddThisEntry = FALSE;
+    FoundAsParentOnly = FALSE;
+
+    //
+    //  Calculate a rough score for this entry.
+    //
+
+    ScoreForThisEntry = ZGetFrecency(FoundRecentDir, Now);
+
+    //
+    //  Determine if it's a match and we should add it.
+    //
+
+    YoriLibInitEmptyString(&FinalComponent);
+    YoriLibInitEmptyString(&TrailingPortion);
+    FinalComponent.StartOfString = YoriLibFindRightMostCharacter(&FoundRecentDir->DirectoryName, '\\');
+
+    if (FoundRecentDir->DirectoryName.LengthInChars >= UserSpecification->LengthInChars) {
+        TrailingPortion.StartOfString = &FoundRecentDir->DirectoryName.StartOfString[FoundRecentDir->DirectoryName.LengthInChars - UserSpecification->LengthInChars];
+        TrailingPortion.LengthInChars = UserSpecification->LengthInChars;
+    }
+    OffsetOfMatch = 0;
+
+    //
+    //  If it's a complete match of the final component, big bonus points.
+    //  If it's a match up to the end of the string, moderate bonus points.
+    //  If it's somewhere in the final component, small bonus points.
+    //
+
+    if (FinalComponent.StartOfString != NULL) {
+        FinalComponent.StartOfString++;
+        FinalComponent.LengthInChars = FoundRecentDir->DirectoryName.LengthInChars - (DWORD)(FinalComponent.StartOfString - FoundRecentDir->DirectoryName.StartOfString);
+
+        if (YoriLibCompareStringInsensitive(&FinalComponent, UserSpecification) == 0) {
+            ScoreForThisEntry += Z_RANK_PER_VISIT * 4;
+            AddThisEntry = TRUE;
+        } else if (TrailingPortion.LengthInChars > 0 &&
+                   YoriLibCompareStringInsensitive(&TrailingPortion, UserSpecification) == 0) {
+            ScoreForThisEntry += Z_RANK_PER_VISIT * 2;
+            AddThisEntry = TRUE;
+        } else if (YoriLibFindFirstMatchingSubstringInsensitive(&FinalComponent, 1, UserSpecification, NULL) != NULL) {
+
+            ScoreForThisEntry += Z_RANK_PER_VISIT;
+            AddThisEntry = TRUE;
+        }
+    }
+
+    YoriLibInitEmptyString(&StringToAdd);
+    if (AddThisEntry) {
+        StringToAdd.StartOfString = FoundRecentDir->DirectoryName.StartOfString;
+        StringToAdd.LengthInChars = FoundRecentDir->DirectoryName.LengthInChars;
+    }
+
+    //
+    //  If it's in the string but not the final component, add it, but
+    //  no bonus points.  If the user specification refers to a parent
+    //  component, add up to that component only.
+    //
+
+    if (!AddThisEntry &&
+        UserSpecification->LengthInChars > 0 &&
+        YoriLibFindFirstMatchingSubstringInsensitive(&FoundRecentDir->DirectoryName, 1, UserSpecification, &OffsetOfMatch) != NULL) {
+
+        SeperatorBefore = FALSE;
+        SeperatorAfter = FALSE;
+
+        if (OffsetOfMatch == 0 ||
+            YoriLibIsSep(UserSpecification->StartOfString[0]) ||
+            YoriLibIsSep(FoundRecentDir->DirectoryName.StartOfString[OffsetOfMatch - 1])) {
+            SeperatorBefore = TRUE;
+        }
+
+        if (OffsetOfMatch + UserSpecification->LengthInChars == FoundRecentDir->DirectoryName.LengthInChars ||
+            YoriLibIsSep(UserSpecification->StartOfString[UserSpecification->LengthInChars - 1]) ||
+            YoriLibIsSep(FoundRecentDir->DirectoryName.StartOfString[OffsetOfMatch + UserSpecification->LengthInChars])) {
+            SeperatorAfter = TRUE;
+        }
+
+        StringToAdd.StartOfString = FoundRecentDir->DirectoryName.StartOfString;
+        if (SeperatorBefore && SeperatorAfter) {
+            StringToAdd.LengthInChars = OffsetOfMatch + UserSpecification->LengthInChars;
+        } else {
+            StringToAdd.LengthInChars = FoundRecentDir->DirectoryName.LengthInChars;
+        }
+        AddThisEntry = TRUE;
+        FoundAsParentOnly = TRUE;
+    }
+
+    if (!AddThisEntry) {
+        return;
+    }
+
+    //
+    //  If the currently found directory has already been added by the
+    //  fully resolved user specification or an earlier parent match,
+    //  don't add it twice.  If it's a high quality match, such as
+    //  against a user specification or final component, add the scores
+    //  together.  Don't do this if the match was against a parent
+    //  component, because many entries may have the same ancestors but
+    //  that doesn't imply they have the quality of all children
+    //  combined.
+    //
+
+    HashEntry = YoriLibHashLookupByKey(MatchHash, &StringToAdd);
+    if (HashEntry != NULL) {
+        Entry = (PZ_SCOREBOARD_ENTRY)HashEntry->Context;
+        if (!FoundAsParentOnly) {
+            Entry->Score += ScoreForThisEntry;
+        }
+        return;
+    }
+
+    //
+    //  Add it with the calculated score.
+    //
+
+    Entry = &Entries[*EntriesPopulated];
+    memcpy(&Entry->DirectoryName, &StringToAdd, sizeof(YORI_STRING));
+    Entry->Directory = NULL;
+    if (StringToAdd.LengthInChars == FoundRecentDir->DirectoryName.LengthInChars) {
+        Entry->Directory = FoundRecentDir;
+    }
+    Entry->Missing = FALSE;
+    Entry->Score = ScoreForThisEntry;
+    YoriLibHashInsertByKey(MatchHash, &Entry->DirectoryName, Entry, &Entry->HashEntry);
+    (*EntriesPopulated)++;
+}
+
 /**
  Take any fully resolved path based on the user specification, and any
  recent directories that match the user specification, heuristically assign
  each directory with a score, and return the entry with the highest score.
  If nothing matches the user specification, returns FALSE.
 
+ When any remembered directory contains a component which is the same as the
+ final component of the user specification, only the directories containing
+ that component are scored, which are found from the index of components.
+ Otherwise, every remembered directory is scored.
+
  @param UserSpecification Pointer to the user specification to match against.
 
  @param FullMatchToUserSpec Pointer to a string that is a fully qualified
@@ -374,33 +1491,72 @@ ZBuildScoreboardAndSelectBest(
     )
 {
     PZ_SCOREBOARD_ENTRY Entries;
+    PYORI_HASH_TABLE MatchHash;
+    PYORI_HASH_ENTRY HashEntry;
     PYORI_LIST_ENTRY ListEntry;
     PZ_RECENT_DIRECTORY FoundRecentDir;
-    YORI_STRING FinalComponent;
-    YORI_STRING TrailingPortion;
-    YORI_STRING StringToAdd;
+    PZ_COMPONENT_LINK Link;
+    PZ_COMPONENT Component;
+    YORI_STRING SearchComponent;
+    DWORD CandidateCount;
     DWORD EntriesPopulated;
     DWORD Index;
-    DWORD ScoreForThisEntry;
     DWORD BestScore;
     DWORD BestIndex;
-    DWORD OffsetOfMatch;
-    BOOL SeperatorBefore;
-    BOOL SeperatorAfter;
-    BOOL AddThisEntry;
-    BOOL FoundAsParentOnly;
+    LONGLONG Now;
+    BOOL Found;
+    BOOL Result;
+
+    Now = ZGetCurrentTime();
 
     //
-    //  Allocate enough entries for everything we know about, including all
-    //  history and the currently resolved full path
+    //  Find the final component of the user specification, and check if
+    //  any remembered directory contains it.
     //
 
-    Entries = YoriLibMalloc(sizeof(Z_SCOREBOARD_ENTRY) * (Z_MAX_RECENT_DIRS + 1));
+    YoriLibInitEmptyString(&SearchComponent);
+    Index = UserSpecification->LengthInChars;
+    while (Index > 0 && YoriLibIsSep(UserSpecification->StartOfString[Index - 1])) {
+        Index--;
+    }
+    SearchComponent.LengthInChars = Index;
+    while (Index > 0 && !YoriLibIsSep(UserSpecification->StartOfString[Index - 1])) {
+        Index--;
+    }
+    SearchComponent.StartOfString = &UserSpecification->StartOfString[Index];
+    SearchComponent.LengthInChars -= Index;
+
+    Component = NULL;
+    CandidateCount = 0;
+    if (ZRecentDirectories.ComponentHash != NULL) {
+        CandidateCount = ZRecentDirectories.RecentDirCount;
+        if (SearchComponent.LengthInChars > 0) {
+            HashEntry = YoriLibHashLookupByKey(ZRecentDirectories.ComponentHash, &SearchComponent);
+            if (HashEntry != NULL) {
+                Component = (PZ_COMPONENT)HashEntry->Context;
+                CandidateCount = Component->DirectoryCount;
+            }
+        }
+    }
+
+    //
+    //  Allocate enough entries for every candidate and the currently
+    //  resolved full path
+    //
+
+    Entries = YoriLibMalloc(sizeof(Z_SCOREBOARD_ENTRY) * (CandidateCount + 1));
     if (Entries == NULL) {
         return FALSE;
     }
 
+    MatchHash = YoriLibAllocateHashTable(CandidateCount / 4 + 1);
+    if (MatchHash == NULL) {
+        YoriLibFree(Entries);
+        return FALSE;
+    }
+
     EntriesPopulated = 0;
+    Result = FALSE;
 
     //
     //  If we have a fully resolved match, add it unconditionally.  Don't
@@ -411,180 +1567,101 @@ ZBuildScoreboardAndSelectBest(
 
     if (FullMatchToUserSpec->LengthInChars > 0) {
         memcpy(&Entries[EntriesPopulated].DirectoryName, FullMatchToUserSpec, sizeof(YORI_STRING));
-        Entries[EntriesPopulated].Score = Z_MAX_RECENT_DIRS * 16;
+        Entries[EntriesPopulated].Directory = NULL;
+        Entries[EntriesPopulated].Missing = FALSE;
+        Entries[EntriesPopulated].Score = Z_EXPLICIT_PATH_SCORE;
+        YoriLibHashInsertByKey(MatchHash, &Entries[EntriesPopulated].DirectoryName, &Entries[EntriesPopulated], &Entries[EntriesPopulated].HashEntry);
         EntriesPopulated++;
     }
 
-    Index = Z_MAX_RECENT_DIRS;
-    ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
-    while (ListEntry != NULL) {
-        FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
-        ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
-        AddThisEntry = FALSE;
-        FoundAsParentOnly = FALSE;
-
-        //
-        //  Calculate a rough score for this entry.
-        //
-
-        ScoreForThisEntry = Index * (Z_MAX_RECENT_DIRS / 8);
-        ScoreForThisEntry += FoundRecentDir->HitCount * (Z_MAX_RECENT_DIRS / 8);
-
-        //
-        //  Determine if it's a match and we should add it.
-        //
-
-        YoriLibInitEmptyString(&FinalComponent);
-        YoriLibInitEmptyString(&TrailingPortion);
-        FinalComponent.StartOfString = YoriLibFindRightMostCharacter(&FoundRecentDir->DirectoryName, '\\');
-
-        if (FoundRecentDir->DirectoryName.LengthInChars >= UserSpecification->LengthInChars) {
-            TrailingPortion.StartOfString = &FoundRecentDir->DirectoryName.StartOfString[FoundRecentDir->DirectoryName.LengthInChars - UserSpecification->LengthInChars];
-            TrailingPortion.LengthInChars = UserSpecification->LengthInChars;
-        }
-        OffsetOfMatch = 0;
-
-        //
-        //  If it's a complete match of the final component, big bonus points.
-        //  If it's a match up to the end of the string, moderate bonus points.
-        //  If it's somewhere in the final component, small bonus points.
-        //
-
-        if (FinalComponent.StartOfString != NULL) {
-            FinalComponent.StartOfString++;
-            FinalComponent.LengthInChars = FoundRecentDir->DirectoryName.LengthInChars - (DWORD)(FinalComponent.StartOfString - FoundRecentDir->DirectoryName.StartOfString);
-
-            if (YoriLibCompareStringInsensitive(&FinalComponent, UserSpecification) == 0) {
-                ScoreForThisEntry += Z_MAX_RECENT_DIRS * 4;
-                AddThisEntry = TRUE;
-            } else if (TrailingPortion.LengthInChars > 0 &&
-                       YoriLibCompareStringInsensitive(&TrailingPortion, UserSpecification) == 0) {
-                ScoreForThisEntry += Z_MAX_RECENT_DIRS * 2;
-                AddThisEntry = TRUE;
-            } else if (YoriLibFindFirstMatchingSubstringInsensitive(&FinalComponent, 1, UserSpecification, NULL) != NULL) {
-
-                ScoreForThisEntry += Z_MAX_RECENT_DIRS;
-                AddThisEntry = TRUE;
-            }
+    if (Component != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&Component->DirectoryList, NULL);
+        while (ListEntry != NULL) {
+            Link = CONTAINING_RECORD(ListEntry, Z_COMPONENT_LINK, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&Component->DirectoryList, ListEntry);
+            ZScoreDirectory(UserSpecification, Link->Directory, Now, Entries, &EntriesPopulated, MatchHash);
         }
-
-        YoriLibInitEmptyString(&StringToAdd);
-        if (AddThisEntry) {
-            StringToAdd.StartOfString = FoundRecentDir->DirectoryName.StartOfString;
-            StringToAdd.LengthInChars = FoundRecentDir->DirectoryName.LengthInChars;
+    } else if (CandidateCount > 0) {
+        ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, NULL);
+        while (ListEntry != NULL) {
+            FoundRecentDir = CONTAINING_RECORD(ListEntry, Z_RECENT_DIRECTORY, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&ZRecentDirectories.RecentDirList, ListEntry);
+            ZScoreDirectory(UserSpecification, FoundRecentDir, Now, Entries, &EntriesPopulated, MatchHash);
         }
+    }
 
-        //
-        //  If it's in the string but not the final component, add it, but
-        //  no bonus points.  If the user specification refers to a parent
-        //  component, add up to that component only.
-        //
-
-        if (!AddThisEntry &&
-            UserSpecification->LengthInChars > 0 &&
-            YoriLibFindFirstMatchingSubstringInsensitive(&FoundRecentDir->DirectoryName, 1, UserSpecification, &OffsetOfMatch) != NULL) {
-
-            SeperatorBefore = FALSE;
-            SeperatorAfter = FALSE;
-
-            if (OffsetOfMatch == 0 ||
-                YoriLibIsSep(UserSpecification->StartOfString[0]) ||
-                YoriLibIsSep(FoundRecentDir->DirectoryName.StartOfString[OffsetOfMatch - 1])) {
-                SeperatorBefore = TRUE;
-            }
+    //
+    //  Find the highest score.  Remembered directories may have been
+    //  removed since they were visited, so check that the best one still
+    //  exists, and if not, forget it and find the next best.  If we have
+    //  no matches, then we can't find anything that the user would be
+    //  happy with, so do nothing.
+    //
 
-            if (OffsetOfMatch + UserSpecification->LengthInChars == FoundRecentDir->DirectoryName.LengthInChars ||
-                YoriLibIsSep(UserSpecification->StartOfString[UserSpecification->LengthInChars - 1]) ||
-                YoriLibIsSep(FoundRecentDir->DirectoryName.StartOfString[OffsetOfMatch + UserSpecification->LengthInChars])) {
-                SeperatorAfter = TRUE;
+    while (TRUE) {
+        Found = FALSE;
+        BestScore = 0;
+        BestIndex = 0;
+        for (Index = 0; Index < EntriesPopulated; Index++) {
+            if (Entries[Index].Missing) {
+                continue;
             }
-
-            StringToAdd.StartOfString = FoundRecentDir->DirectoryName.StartOfString;
-            if (SeperatorBefore && SeperatorAfter) {
-                StringToAdd.LengthInChars = OffsetOfMatch + UserSpecification->LengthInChars;
-            } else {
-                StringToAdd.LengthInChars = FoundRecentDir->DirectoryName.LengthInChars;
+            if (!Found || Entries[Index].Score > BestScore) {
+                Found = TRUE;
+                BestScore = Entries[Index].Score;
+                BestIndex = Index;
             }
-            AddThisEntry = TRUE;
-            FoundAsParentOnly = TRUE;
         }
 
-        //
-        //  If the currently found directory has already been added by the
-        //  fully resolved user specification or an earlier parent match,
-        //  don't add it twice.  If it's a high quality match, such as
-        //  against a user specification or final component, add the scores
-        //  together.  Don't do this if the match was against a parent
-        //  component, because many entries may have the same ancestors but
-        //  that doesn't imply they have the quality of all children
-        //  combined.
-        //
-
-        if (AddThisEntry) {
-            for (BestIndex = 0; BestIndex < EntriesPopulated; BestIndex++) {
-                if (YoriLibCompareStringInsensitive(&Entries[BestIndex].DirectoryName, &StringToAdd) == 0) {
-
-                    if (!FoundAsParentOnly) {
-                        Entries[BestIndex].Score += ScoreForThisEntry;
-                    }
-                    AddThisEntry = FALSE;
-                    break;
-                }
-            }
+        if (!Found) {
+            break;
         }
 
-        //
-        //  If we should add it, go add it with the calculated score.
-        //
+        if (Entries[BestIndex].Directory == NULL ||
+            GetFileAttributes(Entries[BestIndex].Directory->DirectoryName.StartOfString) != (DWORD)-1) {
 
-        if (AddThisEntry) {
-            memcpy(&Entries[EntriesPopulated].DirectoryName, &StringToAdd, sizeof(YORI_STRING));
-            Entries[EntriesPopulated].Score = ScoreForThisEntry;
-            EntriesPopulated++;
-        }
-        if (Index > 0) {
-            Index--;
+            Result = TRUE;
+            break;
         }
+
+        Entries[BestIndex].Missing = TRUE;
     }
 
     //
-    //  If we have no matches, then we can't find anything that the user
-    //  would be happy with, so do nothing.
+    //  Return the highest score match as a referenced string, and free
+    //  the scoreboard.  Perform a new allocation for this to ensure it's
+    //  NULL terminated at the correct point.
     //
 
-    if (EntriesPopulated == 0) {
-        YoriLibFree(Entries);
-        return FALSE;
+    if (Result) {
+        if (YoriLibAllocateString(BestMatch, Entries[BestIndex].DirectoryName.LengthInChars + 1)) {
+            memcpy(BestMatch->StartOfString, Entries[BestIndex].DirectoryName.StartOfString, Entries[BestIndex].DirectoryName.LengthInChars * sizeof(TCHAR));
+            BestMatch->LengthInChars = Entries[BestIndex].DirectoryName.LengthInChars;
+            BestMatch->StartOfString[BestMatch->LengthInChars] = '\0';
+        } else {
+            Result = FALSE;
+        }
     }
 
-    //
-    //  Find the highest score.
-    //
-
-    BestScore = 0;
-    BestIndex = 0;
     for (Index = 0; Index < EntriesPopulated; Index++) {
-        if (BestScore == 0 || Entries[Index].Score > BestScore) {
-            BestScore = Entries[Index].Score;
-            BestIndex = Index;
-        }
+        YoriLibHashRemoveByEntry(&Entries[Index].HashEntry);
     }
+    YoriLibFreeEmptyHashTable(MatchHash);
 
     //
-    //  Return the highest score match as a referenced string, and free
-    //  the scoreboard.  Perform a new allocation for this to ensure it's
-    //  NULL terminated at the correct point.
+    //  Forget any directories that no longer exist.  This is done once the
+    //  scoreboard is no longer needed, since entries may refer to the
+    //  names of these directories.
     //
 
-    if (!YoriLibAllocateString(BestMatch, Entries[BestIndex].DirectoryName.LengthInChars + 1)) {
-        return FALSE;
+    for (Index = 0; Index < EntriesPopulated; Index++) {
+        if (Entries[Index].Missing) {
+            ZForgetDirectory(Entries[Index].Directory);
+        }
     }
-    memcpy(BestMatch->StartOfString, Entries[BestIndex].DirectoryName.StartOfString, Entries[BestIndex].DirectoryName.LengthInChars * sizeof(TCHAR));
-    BestMatch->LengthInChars = Entries[BestIndex].DirectoryName.LengthInChars;
-    BestMatch->StartOfString[BestMatch->LengthInChars] = '\0';
 
     YoriLibFree(Entries);
-    return TRUE;
+    return Result;
 }
 
 /**
@@ -650,6 +1727,8 @@ YoriCmd_Z(
         }
     }
 
+    ZSynchronizeDatabase();
+
     if (ListStack) {
         ZListStack();
         return EXIT_SUCCESS;
@@ -708,8 +1787,7 @@ YoriCmd_Z(
 
     YoriLibFreeStringContents(&FullyResolvedUserSpecification);
 
-    ZAddDirectoryToRecent(&OldCurrentDirectory);
-    ZAddDirectoryToRecent(&BestMatch);
+    ZRecordDirectoryChange(&OldCurrentDirectory, &BestMatch);
 
     Result = SetCurrentDirectory(BestMatch.StartOfString);
     if (!Result) {
@@ -43,6 +43,26 @@
 #define FILE_FLAG_OPEN_NO_RECALL 0x100000
 #endif
 
+#ifndef COPY_FILE_NO_BUFFERING
+/**
+ If the compilation environment hasn't defined it, define the flag for
+ CopyFileEx to perform unbuffered IO.
+ */
+#define COPY_FILE_NO_BUFFERING 0x00001000
+#endif
+
+/**
+ The maximum number of threads to copy files concurrently.
+ */
+#define COPY_MAX_THREADS (8)
+
+/**
+ Files at least this large are copied with unbuffered IO, which avoids
+ displacing the cache contents with data that will not be used again.
+ Smaller files are copied through the cache.
+ */
+#define COPY_UNBUFFERED_THRESHOLD (32 * 1024 * 1024)
+
 /**
  Help text to display to the user.
  */
@@ -65,7 +85,7 @@ CHAR strCopyHelpText[] =
         "   -p             Preserve existing files, no overwriting\n"
         "   -s             Copy subdirectories as well as files\n"
         "   -t             Copy timestamps only, no data\n"
-        "   -v             Verbose output\n"
+        "   -v             Verbose output, including a summary of data copied\n"
         "   -x             Exclude files matching specified pattern\n";
 
 /**
@@ -99,6 +119,53 @@ typedef struct _COPY_EXCLUDE_ITEM {
     YORI_STRING ExcludeCriteria;
 } COPY_EXCLUDE_ITEM, *PCOPY_EXCLUDE_ITEM;
 
+/**
+ A single file whose data is copied by a worker thread.  Requests are
+ created by the enumerating thread, copied by any worker thread, and
+ completed by the enumerating thread in the order they were created.
+ */
+typedef struct _COPY_REQUEST {
+
+    /**
+     The state of this request within the work pool.
+     */
+    YORI_LIB_WORK_ITEM WorkItem;
+
+    /**
+     The full path to the source file.
+     */
+    YORI_STRING SourceFile;
+
+    /**
+     The full path to the destination file.
+     */
+    YORI_STRING DestFile;
+
+    /**
+     Information about the source file from enumeration.  This is only
+     meaningful if HaveFindData is TRUE.
+     */
+    WIN32_FIND_DATA FindData;
+
+    /**
+     If the copy failed, the error code describing why.
+     */
+    DWORD Error;
+
+    /**
+     If the copy failed in a way that has already been described, the
+     message to display when the request is completed.  This allows errors
+     from worker threads to be displayed in enumeration order.
+     */
+    YORI_STRING ErrorMessage;
+
+    /**
+     TRUE if FindData contains information about the source file.
+     */
+    BOOLEAN HaveFindData;
+
+} COPY_REQUEST, *PCOPY_REQUEST;
+
 /**
  A context passed between each source file match when copying multiple
  files.
@@ -195,6 +262,23 @@ typedef struct _COPY_CONTEXT {
      If TRUE, output is generated for each object copied.
      */
     BOOLEAN Verbose;
+
+    /**
+     The number of bytes of file data copied.
+     */
+    LONGLONG BytesCopied;
+
+    /**
+     The worker threads which copy file data, and the requests which have
+     not been completed.
+     */
+    YORI_LIB_WORK_POOL WorkPool;
+
+    /**
+     The maximum number of requests outstanding before the enumerating
+     thread waits for copies to complete.
+     */
+    DWORD MaxRequests;
 } COPY_CONTEXT, *PCOPY_CONTEXT;
 
 /**
@@ -570,12 +654,17 @@ CopyAsLink(
 
  @param DestFile Pointer to the destination file/device name.
 
+ @param ErrorMessage Optionally points to a string to populate with a
+        description of any error.  If NULL, errors are displayed
+        immediately.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 CopyAsDumbDataMove(
     __in PYORI_STRING SourceFile,
-    __in PYORI_STRING DestFile
+    __in PYORI_STRING DestFile,
+    __inout_opt PYORI_STRING ErrorMessage
     )
 {
     PVOID Buffer;
@@ -585,6 +674,13 @@ CopyAsDumbDataMove(
     HANDLE DestHandle;
     DWORD LastError;
     LPTSTR ErrText;
+    BOOL Result;
+    YORI_STRING Message;
+
+    Result = FALSE;
+    Buffer = NULL;
+    DestHandle = INVALID_HANDLE_VALUE;
+    YoriLibInitEmptyString(&Message);
 
     SourceHandle = CreateFile(SourceFile->StartOfString,
                               GENERIC_READ,
@@ -597,9 +693,9 @@ CopyAsDumbDataMove(
     if (SourceHandle == INVALID_HANDLE_VALUE) {
         LastError = GetLastError();
         ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of source failed: %y: %s"), SourceFile, ErrText);
+        YoriLibYPrintf(&Message, _T("Open of source failed: %y: %s"), SourceFile, ErrText);
         YoriLibFreeWinErrorText(ErrText);
-        return FALSE;
+        goto Exit;
     }
 
     DestHandle = CreateFile(DestFile->StartOfString,
@@ -624,18 +720,15 @@ CopyAsDumbDataMove(
 
     if (DestHandle == INVALID_HANDLE_VALUE) {
         ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of destination failed: %y: %s"), DestFile, ErrText);
+        YoriLibYPrintf(&Message, _T("Open of destination failed: %y: %s"), DestFile, ErrText);
         YoriLibFreeWinErrorText(ErrText);
-        CloseHandle(SourceHandle);
-        return FALSE;
+        goto Exit;
     }
 
-    BufferSize = 64 * 1024;
+    BufferSize = 1024 * 1024;
     Buffer = YoriLibMalloc(BufferSize);
     if (Buffer == NULL) {
-        CloseHandle(SourceHandle);
-        CloseHandle(DestHandle);
-        return FALSE;
+        goto Exit;
     }
 
     while (ReadFile(SourceHandle, Buffer, BufferSize, &BytesCopied, NULL)) {
@@ -646,19 +739,38 @@ CopyAsDumbDataMove(
         if (!WriteFile(DestHandle, Buffer, BytesCopied, &BytesCopied, NULL)) {
             LastError = GetLastError();
             ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Write to destination failed: %y: %s"), DestFile, ErrText);
+            YoriLibYPrintf(&Message, _T("Write to destination failed: %y: %s"), DestFile, ErrText);
             YoriLibFreeWinErrorText(ErrText);
-            YoriLibFree(Buffer);
-            CloseHandle(SourceHandle);
-            CloseHandle(DestHandle);
-            return FALSE;
+            goto Exit;
         }
     }
 
-    YoriLibFree(Buffer);
-    CloseHandle(SourceHandle);
-    CloseHandle(DestHandle);
-    return TRUE;
+    Result = TRUE;
+
+Exit:
+
+    if (Buffer != NULL) {
+        YoriLibFree(Buffer);
+    }
+    if (DestHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(DestHandle);
+    }
+    if (SourceHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(SourceHandle);
+    }
+
+    if (Message.LengthInChars > 0) {
+        if (ErrorMessage != NULL) {
+            YoriLibFreeStringContents(ErrorMessage);
+            memcpy(ErrorMessage, &Message, sizeof(YORI_STRING));
+            YoriLibInitEmptyString(&Message);
+        } else {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%y"), &Message);
+        }
+    }
+    YoriLibFreeStringContents(&Message);
+
+    return Result;
 }
 
 /**
@@ -704,6 +816,290 @@ CopyTimestamps(
     return TRUE;
 }
 
+/**
+ Copy the data of a single file.  This is called on a worker thread.  Large
+ files are copied with unbuffered IO if the system supports it, which allows
+ the system to issue large reads and writes with several outstanding at a
+ time and avoids polluting the cache.
+
+ @param Context Pointer to the copy context.
+
+ @param WorkItem Pointer to the work item within the request describing the
+        file to copy.  On failure, the Error field of the request is updated
+        to describe why.
+ */
+VOID
+CopyFileData(
+    __in PVOID Context,
+    __inout PYORI_LIB_WORK_ITEM WorkItem
+    )
+{
+    PCOPY_REQUEST Request = CONTAINING_RECORD(WorkItem, COPY_REQUEST, WorkItem);
+    BOOL Result;
+    DWORD LastError;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    Result = FALSE;
+    LastError = ERROR_INVALID_PARAMETER;
+
+    if (DllKernel32.pCopyFileExW != NULL &&
+        Request->HaveFindData &&
+        (Request->FindData.nFileSizeHigh != 0 || Request->FindData.nFileSizeLow >= COPY_UNBUFFERED_THRESHOLD)) {
+
+        Result = DllKernel32.pCopyFileExW(Request->SourceFile.StartOfString, Request->DestFile.StartOfString, NULL, NULL, NULL, COPY_FILE_NO_BUFFERING);
+        if (!Result) {
+            LastError = GetLastError();
+        }
+    }
+
+    //
+    //  If unbuffered copies aren't supported, fall back to a regular copy.
+    //
+
+    if (!Result && LastError == ERROR_INVALID_PARAMETER) {
+        Result = CopyFile(Request->SourceFile.StartOfString, Request->DestFile.StartOfString, FALSE);
+        if (!Result) {
+            LastError = GetLastError();
+        }
+    }
+
+    if (!Result) {
+
+        //
+        //  If it failed with an error indicating CopyFile couldn't
+        //  handle it, fall back to dumb data copy.  Note that this
+        //  function describes its own errors, which are displayed when
+        //  the request is completed.
+        //
+
+        if (LastError == ERROR_INVALID_PARAMETER) {
+            CopyAsDumbDataMove(&Request->SourceFile, &Request->DestFile, &Request->ErrorMessage);
+        } else {
+            Request->Error = LastError;
+        }
+    }
+}
+
+/**
+ Finish processing a request whose data has been copied.  This displays any
+ error, applies compression and timestamps, and frees the request.  This is
+ called on the enumerating thread.
+
+ @param CopyContext Pointer to the copy context.
+
+ @param Request Pointer to the request, which has been removed from all
+        lists.
+ */
+VOID
+CopyCompleteRequest(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PCOPY_REQUEST Request
+    )
+{
+    YORI_STRING HumanSourcePath;
+    YORI_STRING HumanDestPath;
+    PYORI_STRING SourceNameToDisplay;
+    PYORI_STRING DestNameToDisplay;
+    LARGE_INTEGER FileSize;
+
+    if (Request->ErrorMessage.LengthInChars > 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%y"), &Request->ErrorMessage);
+    } else if (Request->Error != ERROR_SUCCESS) {
+        LPTSTR ErrText = YoriLibGetWinErrorText(Request->Error);
+        YoriLibInitEmptyString(&HumanSourcePath);
+        YoriLibInitEmptyString(&HumanDestPath);
+        SourceNameToDisplay = &Request->SourceFile;
+        DestNameToDisplay = &Request->DestFile;
+        if (YoriLibUnescapePath(&Request->SourceFile, &HumanSourcePath)) {
+            SourceNameToDisplay = &HumanSourcePath;
+        }
+        if (YoriLibUnescapePath(&Request->DestFile, &HumanDestPath)) {
+            DestNameToDisplay = &HumanDestPath;
+        }
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("CopyFile failed: %y to %y: %s"), SourceNameToDisplay, DestNameToDisplay, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        YoriLibFreeStringContents(&HumanSourcePath);
+        YoriLibFreeStringContents(&HumanDestPath);
+    } else if (Request->HaveFindData) {
+        FileSize.HighPart = Request->FindData.nFileSizeHigh;
+        FileSize.LowPart = Request->FindData.nFileSizeLow;
+        CopyContext->BytesCopied += FileSize.QuadPart;
+    }
+
+    if (CopyContext->CompressDest) {
+        YoriLibCompressFileInBackground(&CopyContext->CompressContext, &Request->DestFile);
+    }
+
+    if (CopyContext->CopyTimestamps && Request->HaveFindData) {
+        CopyTimestamps(&Request->FindData, &Request->DestFile);
+    }
+
+    YoriLibFreeStringContents(&Request->SourceFile);
+    YoriLibFreeStringContents(&Request->DestFile);
+    YoriLibFreeStringContents(&Request->ErrorMessage);
+    YoriLibFree(Request);
+}
+
+/**
+ Complete requests in the order they were created.  This stops at the first
+ request which has not been copied, unless more than a specified number of
+ requests are outstanding, in which case it waits.
+
+ @param CopyContext Pointer to the copy context.
+
+ @param MaxOutstanding The number of requests which can remain outstanding
+        when this function returns.  Specify zero to wait for all requests.
+ */
+VOID
+CopyCompleteFinishedRequests(
+    __in PCOPY_CONTEXT CopyContext,
+    __in DWORD MaxOutstanding
+    )
+{
+    PYORI_LIB_WORK_ITEM WorkItem;
+
+    while (TRUE) {
+        WorkItem = YoriLibWorkPoolGetCompletedItem(&CopyContext->WorkPool, MaxOutstanding);
+        if (WorkItem == NULL) {
+            break;
+        }
+
+        CopyCompleteRequest(CopyContext, CONTAINING_RECORD(WorkItem, COPY_REQUEST, WorkItem));
+    }
+}
+
+/**
+ Check whether a request which has not yet been completed is copying to a
+ specified destination.
+
+ @param CopyContext Pointer to the copy context.
+
+ @param DestFile Pointer to the full path to the destination file.
+
+ @return TRUE if an outstanding request is copying to the destination,
+         FALSE if not.
+ */
+BOOL
+CopyIsDestinationOutstanding(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PYORI_STRING DestFile
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PCOPY_REQUEST Request;
+    BOOL Found;
+
+    Found = FALSE;
+    WaitForSingleObject(CopyContext->WorkPool.Mutex, INFINITE);
+    ListEntry = YoriLibGetNextListEntry(&CopyContext->WorkPool.OutputList, NULL);
+    while (ListEntry != NULL) {
+        Request = CONTAINING_RECORD(ListEntry, COPY_REQUEST, WorkItem.OutputList);
+        if (YoriLibCompareStringInsensitive(&Request->DestFile, DestFile) == 0) {
+            Found = TRUE;
+            break;
+        }
+        ListEntry = YoriLibGetNextListEntry(&CopyContext->WorkPool.OutputList, ListEntry);
+    }
+    ReleaseMutex(CopyContext->WorkPool.Mutex);
+
+    return Found;
+}
+
+/**
+ Queue the data of a file to be copied by a worker thread.  If no worker
+ thread can be created, the file is copied on this thread.
+
+ @param CopyContext Pointer to the copy context.
+
+ @param SourceFile Pointer to the full path to the source file.
+
+ @param DestFile Pointer to the full path to the destination file.  On
+        success, the request takes ownership of this allocation and the
+        string is reinitialized.
+
+ @param FileInfo Information about the source file.  This can be NULL if the
+        file was not found from enumeration.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyQueueRequest(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PYORI_STRING SourceFile,
+    __inout PYORI_STRING DestFile,
+    __in_opt PWIN32_FIND_DATA FileInfo
+    )
+{
+    PCOPY_REQUEST Request;
+
+    Request = YoriLibMalloc(sizeof(COPY_REQUEST));
+    if (Request == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Request, sizeof(COPY_REQUEST));
+    if (!YoriLibAllocateString(&Request->SourceFile, SourceFile->LengthInChars + 1)) {
+        YoriLibFree(Request);
+        return FALSE;
+    }
+
+    memcpy(Request->SourceFile.StartOfString, SourceFile->StartOfString, SourceFile->LengthInChars * sizeof(TCHAR));
+    Request->SourceFile.StartOfString[SourceFile->LengthInChars] = '\0';
+    Request->SourceFile.LengthInChars = SourceFile->LengthInChars;
+
+    memcpy(&Request->DestFile, DestFile, sizeof(YORI_STRING));
+    YoriLibInitEmptyString(DestFile);
+
+    if (FileInfo != NULL) {
+        memcpy(&Request->FindData, FileInfo, sizeof(WIN32_FIND_DATA));
+        Request->HaveFindData = TRUE;
+    }
+
+    //
+    //  If an earlier request is still copying to the same destination,
+    //  wait for it so the copies don't race and complete in order.
+    //
+
+    if (CopyIsDestinationOutstanding(CopyContext, &Request->DestFile)) {
+        CopyCompleteFinishedRequests(CopyContext, 0);
+    }
+
+    //
+    //  The copy context is used as the foreground worker, so if no thread
+    //  can be created the file is copied on this thread and this cannot
+    //  fail.
+    //
+
+    YoriLibWorkPoolQueueItem(&CopyContext->WorkPool, &Request->WorkItem);
+
+    CopyCompleteFinishedRequests(CopyContext, CopyContext->MaxRequests);
+    return TRUE;
+}
+
+/**
+ Prepare the copy context to copy files on worker threads.
+
+ @param CopyContext Pointer to the copy context.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyInitializeWorkers(
+    __in PCOPY_CONTEXT CopyContext
+    )
+{
+    DWORD MaxThreads;
+
+    MaxThreads = YoriLibWorkPoolGetThreadCount(1, 1);
+    if (MaxThreads > COPY_MAX_THREADS) {
+        MaxThreads = COPY_MAX_THREADS;
+    }
+    CopyContext->MaxRequests = MaxThreads * 4;
+
+    return YoriLibWorkPoolInitialize(&CopyContext->WorkPool, MaxThreads, CopyContext, NULL, NULL, CopyFileData, CopyContext);
+}
+
 /**
  A callback that is invoked when a file is found that matches a search criteria
  specified in the set of strings to enumerate.
@@ -740,9 +1136,11 @@ CopyFileFoundCallback(
     PYORI_STRING DestNameToDisplay;
     DWORD SlashesFound;
     DWORD Index;
+    BOOLEAN Queued;
 
     ASSERT(YoriLibIsStringNullTerminated(FilePath));
 
+    Queued = FALSE;
     YoriLibInitEmptyString(&FullDest);
     YoriLibInitEmptyString(&RelativePathFromSource);
     YoriLibInitEmptyString(&HumanSourcePath);
@@ -820,45 +1218,26 @@ CopyFileFoundCallback(
                 }
             }
         } else if (CopyContext->DestinationIsDevice || YoriLibIsFileNameDeviceName(FilePath)) {
-            CopyAsDumbDataMove(FilePath, &FullDest);
+            CopyAsDumbDataMove(FilePath, &FullDest, NULL);
         } else {
-            if (!CopyFile(FilePath->StartOfString, FullDest.StartOfString, FALSE)) {
-                DWORD LastError = GetLastError();
-
-                //
-                //  If it failed with an error indicating CopyFile couldn't
-                //  handle it, fall back to dumb data copy.  Note that this
-                //  function will output its own errors, so from this point,
-                //  error handling is over.
-                //
 
-                if (LastError == ERROR_INVALID_PARAMETER) {
-                    CopyAsDumbDataMove(FilePath, &FullDest);
-                } else {
-                    LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-                    if (SourceNameToDisplay != &HumanSourcePath) {
-                        if (YoriLibUnescapePath(FilePath, &HumanSourcePath)) {
-                            SourceNameToDisplay = &HumanSourcePath;
-                        }
-                    }
-                    if (DestNameToDisplay != &HumanDestPath) {
-                        if (YoriLibUnescapePath(&FullDest, &HumanDestPath)) {
-                            DestNameToDisplay = &HumanDestPath;
-                        }
-                    }
-                    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("CopyFile failed: %y to %y: %s"), SourceNameToDisplay, DestNameToDisplay, ErrText);
-                    YoriLibFreeWinErrorText(ErrText);
-                }
-            }
-
-            if (CopyContext->CompressDest) {
+            //
+            //  Regular files are copied by worker threads, which apply
+            //  compression and timestamps when the data has been copied.
+            //
 
-                YoriLibCompressFileInBackground(&CopyContext->CompressContext, &FullDest);
+            if (!CopyQueueRequest(CopyContext, FilePath, &FullDest, FileInfo)) {
+                CopyContext->FilesFoundThisArg++;
+                YoriLibFreeStringContents(&FullDest);
+                YoriLibFreeStringContents(&HumanSourcePath);
+                YoriLibFreeStringContents(&HumanDestPath);
+                return FALSE;
             }
+            Queued = TRUE;
         }
     }
 
-    if (CopyContext->CopyTimestamps && FileInfo != NULL) {
+    if (!Queued && CopyContext->CopyTimestamps && FileInfo != NULL) {
         CopyTimestamps(FileInfo, &FullDest);
     }
 
@@ -914,7 +1293,7 @@ CopyEnableSymlinkPrivilege()
 /**
  Free the structures allocated within a copy context.  The structure itself
  is on the stack and is not freed.  This will wait for any outstanding
- compression work to complete.
+ copy and compression work to complete.
 
  @param CopyContext Pointer to the context to free.
  */
@@ -923,11 +1302,76 @@ CopyFreeCopyContext(
     __in PCOPY_CONTEXT CopyContext
     )
 {
+    if (CopyContext->WorkPool.Mutex != NULL) {
+        CopyCompleteFinishedRequests(CopyContext, 0);
+    }
+
+    YoriLibWorkPoolCleanup(&CopyContext->WorkPool);
+
     YoriLibFreeCompressContext(&CopyContext->CompressContext);
     YoriLibFreeStringContents(&CopyContext->Dest);
     CopyFreeExcludes(CopyContext);
 }
 
+/**
+ Display the number of files and bytes copied, and the rate at which data
+ was copied.
+
+ @param CopyContext Pointer to the copy context, after all copies have
+        completed.
+
+ @param StartTime The performance counter value when copying began.
+ */
+VOID
+CopyDisplaySummary(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PLARGE_INTEGER StartTime
+    )
+{
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER EndTime;
+    LARGE_INTEGER BytesCopied;
+    LONGLONG ElapsedMs;
+    LONGLONG BytesPerSecond;
+    LARGE_INTEGER Rate;
+    YORI_STRING BytesString;
+    YORI_STRING RateString;
+    TCHAR BytesStringBuffer[6];
+    TCHAR RateStringBuffer[6];
+
+    if (!QueryPerformanceFrequency(&Frequency) || Frequency.QuadPart == 0) {
+        return;
+    }
+
+    QueryPerformanceCounter(&EndTime);
+    ElapsedMs = (EndTime.QuadPart - StartTime->QuadPart) * 1000 / Frequency.QuadPart;
+    if (ElapsedMs == 0) {
+        ElapsedMs = 1;
+    }
+
+    BytesCopied.QuadPart = CopyContext->BytesCopied;
+    BytesPerSecond = CopyContext->BytesCopied / ElapsedMs * 1000;
+    Rate.QuadPart = BytesPerSecond;
+
+    YoriLibInitEmptyString(&BytesString);
+    BytesString.StartOfString = BytesStringBuffer;
+    BytesString.LengthAllocated = sizeof(BytesStringBuffer)/sizeof(BytesStringBuffer[0]);
+
+    YoriLibInitEmptyString(&RateString);
+    RateString.StartOfString = RateStringBuffer;
+    RateString.LengthAllocated = sizeof(RateStringBuffer)/sizeof(RateStringBuffer[0]);
+
+    YoriLibFileSizeToString(&BytesString, &BytesCopied);
+    YoriLibFileSizeToString(&RateString, &Rate);
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                  _T("%i objects, %y copied in %lli ms, %y/s\n"),
+                  CopyContext->FilesCopied,
+                  &BytesString,
+                  ElapsedMs,
+                  &RateString);
+}
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the copy builtin command.
@@ -966,6 +1410,7 @@ ENTRYPOINT(
     BOOL Recursive;
     DWORD i;
     DWORD Result;
+    LARGE_INTEGER StartTime;
     COPY_CONTEXT CopyContext;
     YORILIB_COMPRESS_ALGORITHM CompressionAlgorithm;
     YORI_STRING Arg;
@@ -1129,12 +1574,20 @@ ENTRYPOINT(
         }
     }
 
+    if (!CopyInitializeWorkers(&CopyContext)) {
+        CopyFreeCopyContext(&CopyContext);
+        return EXIT_FAILURE;
+    }
+
+    YoriLibLoadKernel32Functions();
+
 #if YORI_BUILTIN
     YoriLibCancelEnable();
 #endif
 
     CopyContext.FilesCopied = 0;
     FilesProcessed = 0;
+    QueryPerformanceCounter(&StartTime);
 
     for (i = FirstFileArg; i <= LastFileArg; i++) {
         if (!YoriLibIsCommandLineOption(&ArgV[i], &Arg)) {
@@ -1187,6 +1640,12 @@ ENTRYPOINT(
         }
     }
 
+    CopyCompleteFinishedRequests(&CopyContext, 0);
+
+    if (CopyContext.Verbose) {
+        CopyDisplaySummary(&CopyContext, &StartTime);
+    }
+
     Result = EXIT_SUCCESS;
 
     if (CopyContext.FilesCopied == 0) {
@@ -142,7 +142,7 @@ CutFilterHandle(
     YoriLibInitEmptyString(&LineString);
 
     while (TRUE) {
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibMappedLineReadToString(&LineString, &LineContext, hSource)) {
             break;
         }
 
@@ -188,7 +188,7 @@ CutFilterHandle(
         }
     }
 
-    YoriLibLineReadClose(LineContext);
+    YoriLibMappedLineReadClose(LineContext);
     YoriLibFreeStringContents(&LineString);
 
     return TRUE;
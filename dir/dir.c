@@ -175,6 +175,12 @@ typedef struct _DIR_CONTEXT {
      */
     DWORD ReparseDataBufferLength;
 
+    /**
+     The buffer to accumulate output into before it is written to standard
+     output.
+     */
+    YORI_LIB_OUTPUT_BUFFER OutputBuffer;
+
 } DIR_CONTEXT, *PDIR_CONTEXT;
 
 /**
@@ -270,9 +276,9 @@ DirOutputBeginningOfDirectorySummary(
     }
 
     if (VtAttribute.LengthInChars > 0) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\n Directory of %y%y%c[0m\n\n"), &VtAttribute, PathToDisplay, 27);
+        YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("\n Directory of %y%y%c[0m\n\n"), &VtAttribute, PathToDisplay, 27);
     } else {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\n Directory of %y\n\n"), PathToDisplay);
+        YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("\n Directory of %y\n\n"), PathToDisplay);
     }
     YoriLibFreeStringContents(&UnescapedPath);
     return TRUE;
@@ -311,7 +317,7 @@ DirOutputEndOfDirectorySummary(
     DirRightAlignString(&CountString, DIR_COUNT_FIELD_SIZE);
     DirRightAlignString(&SizeString, DIR_SIZE_FIELD_SIZE);
 
-    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y File(s) %y bytes\n"), &CountString, &SizeString);
+    YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%y File(s) %y bytes\n"), &CountString, &SizeString);
 
 
     FreeSpace.QuadPart = 0;
@@ -323,7 +329,7 @@ DirOutputEndOfDirectorySummary(
     DirRightAlignString(&CountString, DIR_COUNT_FIELD_SIZE);
     DirRightAlignString(&SizeString, DIR_SIZE_FIELD_SIZE);
 
-    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y Dir(s)  %y bytes free\n"), &CountString, &SizeString);
+    YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%y Dir(s)  %y bytes free\n"), &CountString, &SizeString);
 
     DirContext->ObjectsFoundInThisDir = 0;
     DirContext->FilesFoundInThisDir = 0;
@@ -367,13 +373,13 @@ DirOutputEndOfRecursiveSummary(
     DirRightAlignString(&CountString, DIR_COUNT_FIELD_SIZE);
     DirRightAlignString(&SizeString, DIR_SIZE_FIELD_SIZE);
 
-    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\n     Total Files Listed:\n"));
-    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y File(s) %y bytes\n"), &CountString, &SizeString);
+    YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("\n     Total Files Listed:\n"));
+    YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%y File(s) %y bytes\n"), &CountString, &SizeString);
 
     YoriLibNumberToString(&CountString, DirContext->DirsFound, 10, 3, ',');
 
     DirRightAlignString(&CountString, DIR_COUNT_FIELD_SIZE);
-    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y Dir(s)\n"), &CountString);
+    YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%y Dir(s)\n"), &CountString);
 
     YoriLibFreeStringContents(&CountString);
     YoriLibFreeStringContents(&SizeString);
@@ -545,13 +551,13 @@ DirFileFoundCallback(
             YORI_STRING UnescapedPath;
             YoriLibInitEmptyString(&UnescapedPath);
             if (YoriLibUnescapePath(FilePath, &UnescapedPath)) {
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &UnescapedPath);
+                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%y\n"), &UnescapedPath);
                 YoriLibFreeStringContents(&UnescapedPath);
             } else {
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), FilePath);
+                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%y\n"), FilePath);
             }
         } else {
-            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%s\n"), FilePart);
+            YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%s\n"), FilePart);
         }
 
     } else {
@@ -706,15 +712,15 @@ DirFileFoundCallback(
 
         if (VtAttribute.LengthInChars > 0) {
             if (DirContext->DisplayShortNames) {
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%04i/%02i/%02i  %02i:%02i %y %y%12s %s%c[0m\n"), FileWriteTime.wYear, FileWriteTime.wMonth, FileWriteTime.wDay, FileWriteTime.wHour, FileWriteTime.wMinute, &SizeString, &VtAttribute, FileInfo->cAlternateFileName, FilePart, 27);
+                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%04i/%02i/%02i  %02i:%02i %y %y%12s %s%c[0m\n"), FileWriteTime.wYear, FileWriteTime.wMonth, FileWriteTime.wDay, FileWriteTime.wHour, FileWriteTime.wMinute, &SizeString, &VtAttribute, FileInfo->cAlternateFileName, FilePart, 27);
             } else {
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%04i/%02i/%02i  %02i:%02i %y %y%s%c[0m\n"), FileWriteTime.wYear, FileWriteTime.wMonth, FileWriteTime.wDay, FileWriteTime.wHour, FileWriteTime.wMinute, &SizeString, &VtAttribute, FilePart, 27);
+                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%04i/%02i/%02i  %02i:%02i %y %y%s%c[0m\n"), FileWriteTime.wYear, FileWriteTime.wMonth, FileWriteTime.wDay, FileWriteTime.wHour, FileWriteTime.wMinute, &SizeString, &VtAttribute, FilePart, 27);
             }
         } else {
             if (DirContext->DisplayShortNames) {
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%04i/%02i/%02i  %02i:%02i %y %12s %s\n"), FileWriteTime.wYear, FileWriteTime.wMonth, FileWriteTime.wDay, FileWriteTime.wHour, FileWriteTime.wMinute, &SizeString, FileInfo->cAlternateFileName, FilePart);
+                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%04i/%02i/%02i  %02i:%02i %y %12s %s\n"), FileWriteTime.wYear, FileWriteTime.wMonth, FileWriteTime.wDay, FileWriteTime.wHour, FileWriteTime.wMinute, &SizeString, FileInfo->cAlternateFileName, FilePart);
             } else {
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%04i/%02i/%02i  %02i:%02i %y %s\n"), FileWriteTime.wYear, FileWriteTime.wMonth, FileWriteTime.wDay, FileWriteTime.wHour, FileWriteTime.wMinute, &SizeString, FilePart);
+                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%04i/%02i/%02i  %02i:%02i %y %s\n"), FileWriteTime.wYear, FileWriteTime.wMonth, FileWriteTime.wDay, FileWriteTime.wHour, FileWriteTime.wMinute, &SizeString, FilePart);
             }
         }
 
@@ -785,15 +791,15 @@ DirFileFoundCallback(
                         }
                         if (VtAttribute.LengthInChars > 0) {
                             if (DirContext->DisplayShortNames) {
-                                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%18s%y %13s%y%s%s%c[0m\n"), _T(""), &SizeString, _T(""), &VtAttribute, FileInfo->cFileName, FindStreamData.cStreamName, 27);
+                                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%18s%y %13s%y%s%s%c[0m\n"), _T(""), &SizeString, _T(""), &VtAttribute, FileInfo->cFileName, FindStreamData.cStreamName, 27);
                             } else {
-                                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%18s%y %y%s%s%c[0m\n"), _T(""), &SizeString, &VtAttribute, FileInfo->cFileName, FindStreamData.cStreamName, 27);
+                                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%18s%y %y%s%s%c[0m\n"), _T(""), &SizeString, &VtAttribute, FileInfo->cFileName, FindStreamData.cStreamName, 27);
                             }
                         } else {
                             if (DirContext->DisplayShortNames) {
-                                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%18s%y %13s%s%s\n"), _T(""), &SizeString, _T(""), FileInfo->cFileName, FindStreamData.cStreamName);
+                                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%18s%y %13s%s%s\n"), _T(""), &SizeString, _T(""), FileInfo->cFileName, FindStreamData.cStreamName);
                             } else {
-                                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%18s%y %s%s\n"), _T(""), &SizeString, FileInfo->cFileName, FindStreamData.cStreamName);
+                                YoriLibOutputBufferWrite(&DirContext->OutputBuffer, _T("%18s%y %s%s\n"), _T(""), &SizeString, FileInfo->cFileName, FindStreamData.cStreamName);
                             }
                         }
                     }
@@ -859,6 +865,7 @@ DirFileEnumerateErrorCallback(
         } else {
             DirName.LengthInChars = UnescapedFilePath.LengthInChars;
         }
+        YoriLibOutputBufferFlush(&DirContext->OutputBuffer);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Enumerate of %y failed: %s"), &DirName, ErrText);
         YoriLibFreeWinErrorText(ErrText);
         if (DirContext->Recursive) {
@@ -987,6 +994,12 @@ ENTRYPOINT(
 
     YoriLibEnableBackupPrivilege();
 
+    if (!YoriLibOutputBufferInitialize(&DirContext.OutputBuffer, YORI_LIB_OUTPUT_STDOUT)) {
+        YoriLibFileFiltFreeFilter(&DirContext.ColorRules);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("dir: out of memory\n"));
+        return EXIT_FAILURE;
+    }
+
     //
     //  If no file name is specified, use *
     //
@@ -1035,12 +1048,15 @@ ENTRYPOINT(
     }
 
     if (DirContext.FilesFound == 0 && DirContext.DirsFound == 0) {
+        YoriLibOutputBufferCleanup(&DirContext.OutputBuffer);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("dir: no matching files found\n"));
         return EXIT_FAILURE;
     } else if (DirContext.Recursive) {
         DirOutputEndOfRecursiveSummary(&DirContext);
     }
 
+    YoriLibOutputBufferCleanup(&DirContext.OutputBuffer);
+
     return EXIT_SUCCESS;
 }
 
@@ -53,6 +53,18 @@ typedef struct _FINFO_CONTEXT {
      */
     YORI_STRING FormatString;
 
+    /**
+     The format string compiled into tokens, with each variable bound to its
+     index in the table of known variables.
+     */
+    YORI_LIB_FORMAT_TEMPLATE FormatTemplate;
+
+    /**
+     A buffer to expand the format into for each file, which is reused
+     across files.
+     */
+    YORI_STRING DisplayString;
+
     /**
      Pointer to the full file path for a matching file.
      */
@@ -68,6 +80,13 @@ typedef struct _FINFO_CONTEXT {
      */
     YORI_FILE_INFO Entry;
 
+    /**
+     State shared between the functions collecting information about the
+     current file, so that the file is opened and queried once regardless
+     of how many variables refer to it.
+     */
+    YORI_LIB_FILE_COLLECT_CONTEXT CollectContext;
+
     /**
      Records the total number of files processed.
      */
@@ -84,7 +103,7 @@ typedef struct _FINFO_CONTEXT {
  Specifies a pointer to a function which can collect file information from
  the disk or file system for some particular piece of data.
  */
-typedef BOOL (* PFINFO_COLLECT_FN)(PYORI_FILE_INFO, PWIN32_FIND_DATA, PYORI_STRING);
+typedef BOOL (* PFINFO_COLLECT_FN)(PYORI_FILE_INFO, PWIN32_FIND_DATA, PYORI_STRING, PYORI_LIB_FILE_COLLECT_CONTEXT);
 
 /**
  Specifies a pointer to a function which can output a particular piece of file
@@ -1342,6 +1361,37 @@ FInfoHelp()
     return TRUE;
 }
 
+/**
+ Find a variable in the format string in the table of known variables.  This
+ is invoked once for each variable when the format string is compiled, so
+ that expanding it for each file does not need to compare names.
+
+ @param VariableName The name of the variable.
+
+ @param Context Ignored.
+
+ @return The index of the variable in FInfoKnownVariables, or the number of
+         elements in FInfoKnownVariables if the variable is not known.
+ */
+DWORD
+FInfoResolveVariable(
+    __in PYORI_STRING VariableName,
+    __in PVOID Context
+    )
+{
+    DWORD Index;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    for (Index = 0; Index < sizeof(FInfoKnownVariables)/sizeof(FInfoKnownVariables[0]); Index++) {
+        if (YoriLibCompareStringWithLiteral(VariableName, FInfoKnownVariables[Index].VariableName) == 0) {
+            break;
+        }
+    }
+
+    return Index;
+}
+
 /**
  Expand any variables in the format string of information to display for each
  file.
@@ -1349,6 +1399,9 @@ FInfoHelp()
  @param OutputString The buffer to populate with the result of variable
         expansion.
 
+ @param VariableId The index of the variable in FInfoKnownVariables, as
+        returned by FInfoResolveVariable.
+
  @param VariableName The name of the variable to populate data from.
 
  @param Context Pointer to a FINFO_CONTEXT structure containing state about
@@ -1360,22 +1413,52 @@ FInfoHelp()
 DWORD
 FInfoExpandVariables(
     __inout PYORI_STRING OutputString,
+    __in DWORD VariableId,
     __in PYORI_STRING VariableName,
     __in PVOID Context
     )
 {
-    DWORD Index;
-    DWORD CharsNeeded = 0;
     PFINFO_CONTEXT FInfoContext = (PFINFO_CONTEXT)Context;
 
-    for (Index = 0; Index < sizeof(FInfoKnownVariables)/sizeof(FInfoKnownVariables[0]); Index++) {
-        if (YoriLibCompareStringWithLiteral(VariableName, FInfoKnownVariables[Index].VariableName) == 0) {
-            FInfoKnownVariables[Index].CollectFn(&FInfoContext->Entry, FInfoContext->FileInfo, FInfoContext->FilePath);
-            CharsNeeded = FInfoKnownVariables[Index].OutputFn(FInfoContext, OutputString);
+    UNREFERENCED_PARAMETER(VariableName);
+
+    if (VariableId >= sizeof(FInfoKnownVariables)/sizeof(FInfoKnownVariables[0])) {
+        return 0;
+    }
+
+    FInfoKnownVariables[VariableId].CollectFn(&FInfoContext->Entry, FInfoContext->FileInfo, FInfoContext->FilePath, &FInfoContext->CollectContext);
+    return FInfoKnownVariables[VariableId].OutputFn(FInfoContext, OutputString);
+}
+
+/**
+ Determine the access to each file needed to collect the variables in the
+ compiled format string, so that each file can be opened once with all of
+ the access needed.
+
+ @param Template The compiled format string.
+
+ @return The access needed to collect all of the variables.
+ */
+DWORD
+FInfoGatherCollectAccess(
+    __in PYORI_LIB_FORMAT_TEMPLATE Template
+    )
+{
+    DWORD Index;
+    DWORD VariableId;
+    DWORD CollectAccess;
+
+    CollectAccess = 0;
+    for (Index = 0; Index < Template->TokenCount; Index++) {
+        VariableId = Template->Tokens[Index].VariableId;
+        if (Template->Tokens[Index].IsVariable &&
+            VariableId < sizeof(FInfoKnownVariables)/sizeof(FInfoKnownVariables[0])) {
+
+            CollectAccess |= YoriLibGetFileCollectAccess(FInfoKnownVariables[VariableId].CollectFn);
         }
     }
 
-    return CharsNeeded;
+    return CollectAccess;
 }
 
 /**
@@ -1401,7 +1484,6 @@ FInfoFileFoundCallback(
     __in PVOID Context
     )
 {
-    YORI_STRING DisplayString;
     WIN32_FIND_DATA LocalFileInfo;
     PWIN32_FIND_DATA FileInfoToUse;
     PFINFO_CONTEXT FInfoContext;
@@ -1424,13 +1506,12 @@ FInfoFileFoundCallback(
     FInfoContext->FilesFound++;
     FInfoContext->FilesFoundThisArg++;
 
-    YoriLibInitEmptyString(&DisplayString);
-    YoriLibExpandCommandVariables(&FInfoContext->FormatString, '$', TRUE, FInfoExpandVariables, FInfoContext, &DisplayString);
-    if (DisplayString.StartOfString != NULL) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &DisplayString);
-        YoriLibFreeStringContents(&DisplayString);
+    if (YoriLibExpandFormatTemplate(&FInfoContext->FormatTemplate, FInfoExpandVariables, FInfoContext, &FInfoContext->DisplayString)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &FInfoContext->DisplayString);
     }
 
+    YoriLibResetFileCollectContext(&FInfoContext->CollectContext);
+
     return TRUE;
 }
 
@@ -1556,6 +1637,12 @@ ENTRYPOINT(
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("finfo: missing argument\n"));
         return EXIT_FAILURE;
     } else {
+        if (!YoriLibCompileFormatTemplate(&FInfoContext.FormatTemplate, &FInfoContext.FormatString, '$', TRUE, FInfoResolveVariable, NULL)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("finfo: out of memory\n"));
+            return EXIT_FAILURE;
+        }
+        YoriLibInitFileCollectContext(&FInfoContext.CollectContext, FInfoGatherCollectAccess(&FInfoContext.FormatTemplate));
+
         MatchFlags = YORILIB_FILEENUM_RETURN_FILES;
 
         if (ReturnDirectories) {
@@ -1585,6 +1672,9 @@ ENTRYPOINT(
                 }
             }
         }
+
+        YoriLibFreeFormatTemplate(&FInfoContext.FormatTemplate);
+        YoriLibFreeStringContents(&FInfoContext.DisplayString);
     }
 
     if (FInfoContext.FilesFound == 0) {
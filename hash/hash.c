@@ -46,10 +46,12 @@ CHAR strHashHelpText[] =
         "Hash a file.\n"
         "\n"
         "HASH [-license] [-a <algorithm>] [-b] [-s] [<file>]\n"
+        "HASH -bench\n"
         "\n"
         "   -a <algorithm> Specify the hash algorithm. Supported algorithms:\n"
         "                    MD4, MD5, SHA1, SHA256, SHA384, or SHA512\n"
         "   -b             Use basic search criteria for files only\n"
+        "   -bench         Measure the throughput of each hash algorithm\n"
         "   -s             Hash files in subdirectories\n";
 
 /**
@@ -66,6 +68,128 @@ HashHelp()
     return TRUE;
 }
 
+/**
+ The number of bytes in each buffer used to read a file.
+ */
+#define HASH_READ_BUFFER_LENGTH (1024 * 1024)
+
+/**
+ The maximum number of threads to hash files concurrently.
+ */
+#define HASH_MAX_THREADS (16)
+
+/**
+ The number of bytes to hash for each algorithm when measuring throughput.
+ */
+#define HASH_BENCHMARK_LENGTH (256 * 1024 * 1024)
+
+/**
+ A hash algorithm which can be specified by the user.
+ */
+typedef struct _HASH_ALGORITHM {
+
+    /**
+     The name of the algorithm as specified by the user and understood by
+     BCrypt.
+     */
+    LPCWSTR Name;
+} HASH_ALGORITHM, *PHASH_ALGORITHM;
+
+/**
+ The set of algorithms supported by this program.
+ */
+CONST HASH_ALGORITHM HashAlgorithms[] = {
+    {L"MD4"},
+    {L"MD5"},
+    {L"SHA1"},
+    {L"SHA256"},
+    {L"SHA384"},
+    {L"SHA512"}
+};
+
+struct _HASH_CONTEXT;
+
+/**
+ State used by a single thread to hash files.  Each thread needs its own
+ BCrypt scratch space and read buffers.
+ */
+typedef struct _HASH_WORKER {
+
+    /**
+     Pointer to the context shared by all threads.
+     */
+    struct _HASH_CONTEXT *HashContext;
+
+    /**
+     Pointer to an opaque blob of memory which is used by BCrypt to generate
+     the hash.
+     */
+    PVOID ScratchBuffer;
+
+    /**
+     Pointer to a blob of memory containing the result of the hash
+     calculation for each file.
+     */
+    PUCHAR HashBuffer;
+
+    /**
+     Two buffers to read data from the file into.  While one is being
+     hashed, the next read is in progress into the other.
+     */
+    PUCHAR ReadBuffer[2];
+
+    /**
+     An event signalled when a read into ReadBuffer completes.
+     */
+    HANDLE ReadEvent;
+
+} HASH_WORKER, *PHASH_WORKER;
+
+/**
+ A single file to hash.  Requests are created by the enumerating thread,
+ hashed by any worker thread, and displayed by the enumerating thread in
+ the order they were created.
+ */
+typedef struct _HASH_REQUEST {
+
+    /**
+     The state of this request within the work pool.
+     */
+    YORI_LIB_WORK_ITEM WorkItem;
+
+    /**
+     The full path to the file to hash.
+     */
+    YORI_STRING FilePath;
+
+    /**
+     The portion of FilePath to display, relative to the enumeration root.
+     This points into FilePath.
+     */
+    YORI_STRING RelativePath;
+
+    /**
+     On completion, the hex representation of the hash.
+     */
+    YORI_STRING HashString;
+
+    /**
+     If the file could not be opened, the error code describing why.
+     */
+    DWORD OpenError;
+
+    /**
+     Set to TRUE if the file was opened.
+     */
+    BOOLEAN Opened;
+
+    /**
+     Set to TRUE if the hash was generated successfully.
+     */
+    BOOLEAN Hashed;
+
+} HASH_REQUEST, *PHASH_REQUEST;
+
 /**
  Context passed to the callback which is invoked for each file found.
  */
@@ -79,16 +203,10 @@ typedef struct _HASH_CONTEXT {
 
     /**
      BCrypt handle to the algorithm provider.  If NULL, the algorithm provider
-     has not been initialized.
+     has not been initialized.  This is shared by all threads.
      */
     PVOID Algorithm;
 
-    /**
-     Pointer to an opaque blob of memory which is used by BCrypt to generate
-     the hash.
-     */
-    PVOID ScratchBuffer;
-
     /**
      The first error encountered when enumerating objects from a single arg.
      This is used to preserve file not found/path not found errors so that
@@ -98,34 +216,24 @@ typedef struct _HASH_CONTEXT {
     DWORD SavedErrorThisArg;
 
     /**
-     Specifies the number of bytes in ScratchBuffer.
+     Specifies the number of bytes in each worker's ScratchBuffer.
      */
     DWORD ScratchBufferLength;
 
     /**
-     Pointer to a blob of memory containing the result of the hash calculation
-     for each file.
-     */
-    PUCHAR HashBuffer;
-
-    /**
-     Specifies the number of bytes in HashBuffer.
+     Specifies the number of bytes in each worker's HashBuffer.
      */
     DWORD HashLength;
 
     /**
-     Pointer to a buffer to read data from the file into.
-     */
-    PVOID ReadBuffer;
-
-    /**
-     Specifies the number of bytes in ReadBuffer.
+     Specifies the number of bytes in each worker's ReadBuffer.
      */
     DWORD ReadBufferLength;
 
     /**
      A string which contains enough characters to contain the hex
-     representation of HashBuffer plus a NULL terminator.
+     representation of HashBuffer plus a NULL terminator.  Used when
+     hashing input from a pipe.
      */
     YORI_STRING HashString;
 
@@ -140,32 +248,232 @@ typedef struct _HASH_CONTEXT {
      */
     LONGLONG FilesFoundThisArg;
 
+    /**
+     Worker state for the enumerating thread, used for input from a pipe or
+     if no threads can be created.
+     */
+    HASH_WORKER ForegroundWorker;
+
+    /**
+     The worker threads which hash files, and the requests which have not
+     been displayed.
+     */
+    YORI_LIB_WORK_POOL WorkPool;
+
+    /**
+     The maximum number of requests outstanding before the enumerating
+     thread waits for results to be displayed.
+     */
+    DWORD MaxRequests;
+
 } HASH_CONTEXT, *PHASH_CONTEXT;
 
 /**
- Take a single incoming stream and break it into pieces.
+ Cleanup the allocations used by a single thread to hash files.
+
+ @param Worker Pointer to the worker state to clean up.
+ */
+VOID
+HashCleanupWorker(
+    __in PHASH_WORKER Worker
+    )
+{
+    DWORD Index;
+
+    if (Worker->ScratchBuffer != NULL) {
+        YoriLibFree(Worker->ScratchBuffer);
+        Worker->ScratchBuffer = NULL;
+    }
+
+    if (Worker->HashBuffer != NULL) {
+        YoriLibFree(Worker->HashBuffer);
+        Worker->HashBuffer = NULL;
+    }
+
+    for (Index = 0; Index < sizeof(Worker->ReadBuffer)/sizeof(Worker->ReadBuffer[0]); Index++) {
+        if (Worker->ReadBuffer[Index] != NULL) {
+            YoriLibFree(Worker->ReadBuffer[Index]);
+            Worker->ReadBuffer[Index] = NULL;
+        }
+    }
+
+    if (Worker->ReadEvent != NULL) {
+        CloseHandle(Worker->ReadEvent);
+        Worker->ReadEvent = NULL;
+    }
+}
+
+/**
+ Allocate the state used by a single thread to hash files.
+
+ @param HashContext Pointer to the hash context, which has been initialized
+        for the hash algorithm.
+
+ @param Worker Pointer to the worker state to initialize.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashInitializeWorker(
+    __in PHASH_CONTEXT HashContext,
+    __out PHASH_WORKER Worker
+    )
+{
+    DWORD Index;
+
+    ZeroMemory(Worker, sizeof(HASH_WORKER));
+    Worker->HashContext = HashContext;
+
+    Worker->HashBuffer = YoriLibMalloc(HashContext->HashLength);
+    if (Worker->HashBuffer == NULL) {
+        HashCleanupWorker(Worker);
+        return FALSE;
+    }
+
+    Worker->ScratchBuffer = YoriLibMalloc(HashContext->ScratchBufferLength);
+    if (Worker->ScratchBuffer == NULL) {
+        HashCleanupWorker(Worker);
+        return FALSE;
+    }
+
+    for (Index = 0; Index < sizeof(Worker->ReadBuffer)/sizeof(Worker->ReadBuffer[0]); Index++) {
+        Worker->ReadBuffer[Index] = YoriLibMalloc(HashContext->ReadBufferLength);
+        if (Worker->ReadBuffer[Index] == NULL) {
+            HashCleanupWorker(Worker);
+            return FALSE;
+        }
+    }
+
+    Worker->ReadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (Worker->ReadEvent == NULL) {
+        HashCleanupWorker(Worker);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Allocate the state used by a worker thread to hash files.
+
+ @param Context Pointer to the hash context.
+
+ @return Pointer to the worker state, or NULL on failure.
+ */
+PVOID
+HashCreateWorker(
+    __in PVOID Context
+    )
+{
+    PHASH_WORKER Worker;
+
+    Worker = YoriLibMalloc(sizeof(HASH_WORKER));
+    if (Worker == NULL) {
+        return NULL;
+    }
+
+    if (!HashInitializeWorker((PHASH_CONTEXT)Context, Worker)) {
+        YoriLibFree(Worker);
+        return NULL;
+    }
+
+    return Worker;
+}
+
+/**
+ Free the state used by a worker thread to hash files.
+
+ @param Worker Pointer to the worker state allocated by
+        @ref HashCreateWorker .
+ */
+VOID
+HashDeleteWorker(
+    __in PVOID Worker
+    )
+{
+    HashCleanupWorker((PHASH_WORKER)Worker);
+    YoriLibFree(Worker);
+}
+
+/**
+ Issue a read from a file opened for overlapped IO.
+
+ @param hSource A handle to the file.
+
+ @param Buffer The buffer to read into.
+
+ @param BufferLength The number of bytes to read.
+
+ @param Offset The offset within the file to read from.
+
+ @param Overlapped Pointer to an overlapped structure to describe the read.
+        This includes an event to signal on completion.
+
+ @return TRUE if the read was issued and its result should be collected with
+         GetOverlappedResult, FALSE if the end of the file was reached or
+         the read failed.
+ */
+BOOL
+HashIssueRead(
+    __in HANDLE hSource,
+    __out_ecount(BufferLength) PUCHAR Buffer,
+    __in DWORD BufferLength,
+    __in LONGLONG Offset,
+    __inout LPOVERLAPPED Overlapped
+    )
+{
+    LARGE_INTEGER ReadOffset;
+
+    ReadOffset.QuadPart = Offset;
+    Overlapped->Offset = ReadOffset.LowPart;
+    Overlapped->OffsetHigh = ReadOffset.HighPart;
+    ResetEvent(Overlapped->hEvent);
+
+    if (!ReadFile(hSource, Buffer, BufferLength, NULL, Overlapped) &&
+        GetLastError() != ERROR_IO_PENDING) {
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Hash the contents of a single stream.
 
  @param hSource A handle to the incoming stream, which may be a file or a
         pipe.
- 
- @param HashContext Pointer to a context describing the actions to perform.
+
+ @param Overlapped TRUE if hSource was opened for overlapped IO.  If so,
+        the next block is read while the previous one is hashed.  If FALSE,
+        the stream is read synchronously.
+
+ @param Worker Pointer to the state of the thread performing the hash.
+
+ @param HashString On successful completion, populated with the hex
+        representation of the hash.  This string must be allocated with
+        enough space for the result.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 HashProcessStream(
     __in HANDLE hSource,
-    __in PHASH_CONTEXT HashContext
+    __in BOOLEAN Overlapped,
+    __in PHASH_WORKER Worker,
+    __inout PYORI_STRING HashString
     )
 {
+    PHASH_CONTEXT HashContext = Worker->HashContext;
     LONG Status;
     PVOID hHash;
     DWORD BytesRead;
+    DWORD CurrentBuffer;
+    LONGLONG Offset;
+    OVERLAPPED ReadOverlapped;
+    BOOL ReadPending;
 
-    HashContext->FilesFound++;
-    HashContext->FilesFoundThisArg++;
-
-    Status = DllBCrypt.pBCryptCreateHash(HashContext->Algorithm, &hHash, HashContext->ScratchBuffer, HashContext->ScratchBufferLength, NULL, 0, 0);
+    Status = DllBCrypt.pBCryptCreateHash(HashContext->Algorithm, &hHash, Worker->ScratchBuffer, HashContext->ScratchBufferLength, NULL, 0, 0);
 
     if (Status != STATUS_SUCCESS) {
         return FALSE;
@@ -173,26 +481,63 @@ HashProcessStream(
 
     Status = STATUS_SUCCESS;
 
-    while (TRUE) {
-        if (!ReadFile(hSource, HashContext->ReadBuffer, HashContext->ReadBufferLength, &BytesRead, NULL)) {
-            break;
-        }
+    if (!Overlapped) {
+        while (TRUE) {
+            if (!ReadFile(hSource, Worker->ReadBuffer[0], HashContext->ReadBufferLength, &BytesRead, NULL)) {
+                break;
+            }
 
-        if (BytesRead == 0) {
-            break;
-        }
+            if (BytesRead == 0) {
+                break;
+            }
 
-        Status = DllBCrypt.pBCryptHashData(hHash, HashContext->ReadBuffer, BytesRead, 0);
-        if (Status != STATUS_SUCCESS) {
-            break;
+            Status = DllBCrypt.pBCryptHashData(hHash, Worker->ReadBuffer[0], BytesRead, 0);
+            if (Status != STATUS_SUCCESS) {
+                break;
+            }
         }
+    } else {
+
+        //
+        //  Keep one read outstanding at all times.  Once a read completes,
+        //  issue the next into the other buffer before hashing the data
+        //  that has arrived.
+        //
+
+        ZeroMemory(&ReadOverlapped, sizeof(ReadOverlapped));
+        ReadOverlapped.hEvent = Worker->ReadEvent;
+        CurrentBuffer = 0;
+        Offset = 0;
+        ReadPending = HashIssueRead(hSource, Worker->ReadBuffer[CurrentBuffer], HashContext->ReadBufferLength, Offset, &ReadOverlapped);
+
+        while (ReadPending) {
+            if (!GetOverlappedResult(hSource, &ReadOverlapped, &BytesRead, TRUE)) {
+                break;
+            }
+
+            if (BytesRead == 0) {
+                break;
+            }
+
+            Offset += BytesRead;
+            ReadPending = HashIssueRead(hSource, Worker->ReadBuffer[1 - CurrentBuffer], HashContext->ReadBufferLength, Offset, &ReadOverlapped);
 
+            Status = DllBCrypt.pBCryptHashData(hHash, Worker->ReadBuffer[CurrentBuffer], BytesRead, 0);
+            if (Status != STATUS_SUCCESS) {
+                if (ReadPending) {
+                    GetOverlappedResult(hSource, &ReadOverlapped, &BytesRead, TRUE);
+                }
+                break;
+            }
+
+            CurrentBuffer = 1 - CurrentBuffer;
+        }
     }
 
     if (Status == STATUS_SUCCESS) {
-        Status = DllBCrypt.pBCryptFinishHash(hHash, HashContext->HashBuffer, HashContext->HashLength, 0);
+        Status = DllBCrypt.pBCryptFinishHash(hHash, Worker->HashBuffer, HashContext->HashLength, 0);
         if (Status == STATUS_SUCCESS) {
-            if (!YoriLibHexBufferToString(HashContext->HashBuffer, HashContext->HashLength, &HashContext->HashString)) {
+            if (!YoriLibHexBufferToString(Worker->HashBuffer, HashContext->HashLength, HashString)) {
                 Status = !(STATUS_SUCCESS);
             }
         }
@@ -207,6 +552,167 @@ HashProcessStream(
     return TRUE;
 }
 
+/**
+ Open and hash the file described by a single request, recording the
+ result in the request.
+
+ @param Context Pointer to the state of the thread performing the hash.
+
+ @param WorkItem Pointer to the work item within the request.
+ */
+VOID
+HashProcessRequest(
+    __in PVOID Context,
+    __inout PYORI_LIB_WORK_ITEM WorkItem
+    )
+{
+    PHASH_WORKER Worker = (PHASH_WORKER)Context;
+    PHASH_REQUEST Request = CONTAINING_RECORD(WorkItem, HASH_REQUEST, WorkItem);
+    HANDLE FileHandle;
+
+    FileHandle = CreateFile(Request->FilePath.StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+
+    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+        Request->OpenError = GetLastError();
+        return;
+    }
+
+    Request->Opened = TRUE;
+    if (HashProcessStream(FileHandle, TRUE, Worker, &Request->HashString)) {
+        Request->Hashed = TRUE;
+    }
+
+    CloseHandle(FileHandle);
+}
+
+/**
+ Display the result of a completed request and free it.
+
+ @param HashContext Pointer to the hash context.
+
+ @param Request Pointer to the request, which has been removed from all
+        lists.
+ */
+VOID
+HashDisplayRequest(
+    __in PHASH_CONTEXT HashContext,
+    __in PHASH_REQUEST Request
+    )
+{
+    if (!Request->Opened) {
+        if (HashContext->SavedErrorThisArg == ERROR_SUCCESS) {
+            LPTSTR ErrText = YoriLibGetWinErrorText(Request->OpenError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: open of %y failed: %s"), &Request->FilePath, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+        }
+    } else {
+        HashContext->SavedErrorThisArg = ERROR_SUCCESS;
+        HashContext->FilesFound++;
+        HashContext->FilesFoundThisArg++;
+
+        if (Request->Hashed) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y %y\n"), &Request->HashString, &Request->RelativePath);
+        }
+    }
+
+    YoriLibFreeStringContents(&Request->FilePath);
+    YoriLibFreeStringContents(&Request->HashString);
+    YoriLibFree(Request);
+}
+
+/**
+ Display completed requests in the order they were created.  This stops at
+ the first request which has not completed, unless more than a specified
+ number of requests are outstanding, in which case it waits.
+
+ @param HashContext Pointer to the hash context.
+
+ @param MaxOutstanding The number of requests which can remain outstanding
+        when this function returns.  Specify zero to wait for all requests.
+ */
+VOID
+HashDisplayCompletedRequests(
+    __in PHASH_CONTEXT HashContext,
+    __in DWORD MaxOutstanding
+    )
+{
+    PYORI_LIB_WORK_ITEM WorkItem;
+
+    while (TRUE) {
+        WorkItem = YoriLibWorkPoolGetCompletedItem(&HashContext->WorkPool, MaxOutstanding);
+        if (WorkItem == NULL) {
+            break;
+        }
+
+        HashDisplayRequest(HashContext, CONTAINING_RECORD(WorkItem, HASH_REQUEST, WorkItem));
+    }
+}
+
+/**
+ Queue a file to be hashed by a worker thread.  If no worker thread can be
+ created, the file is hashed on this thread.  Results are displayed in the
+ order files are queued.
+
+ @param HashContext Pointer to the hash context.
+
+ @param FilePath Pointer to the full path to the file.
+
+ @param RelativePathOffset The offset within FilePath of the portion to
+        display.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashQueueRequest(
+    __in PHASH_CONTEXT HashContext,
+    __in PYORI_STRING FilePath,
+    __in DWORD RelativePathOffset
+    )
+{
+    PHASH_REQUEST Request;
+
+    Request = YoriLibMalloc(sizeof(HASH_REQUEST));
+    if (Request == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Request, sizeof(HASH_REQUEST));
+    if (!YoriLibAllocateString(&Request->FilePath, FilePath->LengthInChars + 1)) {
+        YoriLibFree(Request);
+        return FALSE;
+    }
+
+    if (!YoriLibAllocateString(&Request->HashString, HashContext->HashLength * 2 + 1)) {
+        YoriLibFreeStringContents(&Request->FilePath);
+        YoriLibFree(Request);
+        return FALSE;
+    }
+
+    memcpy(Request->FilePath.StartOfString, FilePath->StartOfString, FilePath->LengthInChars * sizeof(TCHAR));
+    Request->FilePath.StartOfString[FilePath->LengthInChars] = '\0';
+    Request->FilePath.LengthInChars = FilePath->LengthInChars;
+
+    YoriLibInitEmptyString(&Request->RelativePath);
+    Request->RelativePath.StartOfString = &Request->FilePath.StartOfString[RelativePathOffset];
+    Request->RelativePath.LengthInChars = FilePath->LengthInChars - RelativePathOffset;
+
+    //
+    //  The pool has a foreground worker, so if no thread can be created
+    //  the request is hashed on this thread and this cannot fail.
+    //
+
+    YoriLibWorkPoolQueueItem(&HashContext->WorkPool, &Request->WorkItem);
+
+    HashDisplayCompletedRequests(HashContext, HashContext->MaxRequests);
+    return TRUE;
+}
+
 /**
  A callback that is invoked when a file is found within the tree root whose
  hash is requested.
@@ -231,8 +737,6 @@ HashFileFoundCallback(
     )
 {
     PHASH_CONTEXT HashContext = (PHASH_CONTEXT)Context;
-    YORI_STRING RelativePathFrom;
-    HANDLE FileHandle;
     DWORD SlashesFound;
     DWORD Index;
 
@@ -240,8 +744,6 @@ HashFileFoundCallback(
 
     ASSERT(YoriLibIsStringNullTerminated(FilePath));
 
-    YoriLibInitEmptyString(&RelativePathFrom);
-
     SlashesFound = 0;
     for (Index = FilePath->LengthInChars; Index > 0; Index--) {
         if (FilePath->StartOfString[Index - 1] == '\\') {
@@ -255,41 +757,17 @@ HashFileFoundCallback(
     ASSERT(Index > 0);
     ASSERT(SlashesFound == Depth + 1);
 
-    RelativePathFrom.StartOfString = &FilePath->StartOfString[Index];
-    RelativePathFrom.LengthInChars = FilePath->LengthInChars - Index;
-
-    FileHandle = CreateFile(FilePath->StartOfString,
-                            GENERIC_READ,
-                            FILE_SHARE_READ | FILE_SHARE_DELETE,
-                            NULL,
-                            OPEN_EXISTING,
-                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
-                            NULL);
-
-    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
-        if (HashContext->SavedErrorThisArg == ERROR_SUCCESS) {
-            DWORD LastError = GetLastError();
-            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: open of %y failed: %s"), FilePath, ErrText);
-            YoriLibFreeWinErrorText(ErrText);
-        }
-        return TRUE;
-    }
-
-    HashContext->SavedErrorThisArg = ERROR_SUCCESS;
-
-    if (HashProcessStream(FileHandle, HashContext)) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y %y\n"), &HashContext->HashString, &RelativePathFrom);
+    if (!HashQueueRequest(HashContext, FilePath, Index)) {
+        return FALSE;
     }
 
-    CloseHandle(FileHandle);
     return TRUE;
 }
 
-
 /**
  Cleanup any internal allocations within the hash context.  The context
- itself is a stack allocation and is not freed.
+ itself is a stack allocation and is not freed.  Any outstanding requests
+ are displayed first.
 
  @param HashContext Pointer to the hash context to clean up.
  */
@@ -300,20 +778,13 @@ HashCleanupContext(
 {
     LONG Status;
 
-    if (HashContext->ScratchBuffer != NULL) {
-        YoriLibFree(HashContext->ScratchBuffer);
-        HashContext->ScratchBuffer = NULL;
+    if (HashContext->WorkPool.Mutex != NULL) {
+        HashDisplayCompletedRequests(HashContext, 0);
     }
 
-    if (HashContext->HashBuffer != NULL) {
-        YoriLibFree(HashContext->HashBuffer);
-        HashContext->HashBuffer = NULL;
-    }
+    YoriLibWorkPoolCleanup(&HashContext->WorkPool);
 
-    if (HashContext->ReadBuffer != NULL) {
-        YoriLibFree(HashContext->ReadBuffer);
-        HashContext->ReadBuffer = NULL;
-    }
+    HashCleanupWorker(&HashContext->ForegroundWorker);
 
     YoriLibFreeStringContents(&HashContext->HashString);
 
@@ -343,6 +814,7 @@ HashInitializeContext(
 {
     LONG Status;
     DWORD BytesReturned;
+    DWORD MaxThreads;
 
     Status = DllBCrypt.pBCryptOpenAlgorithmProvider(&HashContext->Algorithm, Algorithm, MS_PRIMITIVE_PROVIDER, 0);
     if (Status != STATUS_SUCCESS) {
@@ -358,12 +830,6 @@ HashInitializeContext(
         return FALSE;
     }
 
-    HashContext->HashBuffer = YoriLibMalloc(HashContext->HashLength);
-    if (HashContext->HashBuffer == NULL) {
-        HashCleanupContext(HashContext);
-        return FALSE;
-    }
-
     Status = DllBCrypt.pBCryptGetProperty(HashContext->Algorithm, L"ObjectLength", &HashContext->ScratchBufferLength, sizeof(HashContext->ScratchBufferLength), &BytesReturned, 0);
     if (Status != STATUS_SUCCESS) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: algorithm provider did not return required scratch space, status 0x%08x\n"), Status);
@@ -371,21 +837,31 @@ HashInitializeContext(
         return FALSE;
     }
 
-    HashContext->ScratchBuffer = YoriLibMalloc(HashContext->ScratchBufferLength);
-    if (HashContext->ScratchBuffer == NULL) {
+    if (!YoriLibAllocateString(&HashContext->HashString, HashContext->HashLength * 2 + 1)) {
         HashCleanupContext(HashContext);
         return FALSE;
     }
 
-    if (!YoriLibAllocateString(&HashContext->HashString, HashContext->HashLength * 2 + 1)) {
+    HashContext->ReadBufferLength = HASH_READ_BUFFER_LENGTH;
+
+    if (!HashInitializeWorker(HashContext, &HashContext->ForegroundWorker)) {
         HashCleanupContext(HashContext);
         return FALSE;
     }
 
-    HashContext->ReadBufferLength = 1024 * 1024;
+    //
+    //  Hash with as many threads as there are processors.  Each thread
+    //  keeps a read outstanding while hashing, so this also keeps several
+    //  reads in flight.
+    //
+
+    MaxThreads = YoriLibWorkPoolGetThreadCount(1, 1);
+    if (MaxThreads > HASH_MAX_THREADS) {
+        MaxThreads = HASH_MAX_THREADS;
+    }
+    HashContext->MaxRequests = MaxThreads * 4;
 
-    HashContext->ReadBuffer = YoriLibMalloc(HashContext->ReadBufferLength);
-    if (HashContext->ReadBuffer == NULL) {
+    if (!YoriLibWorkPoolInitialize(&HashContext->WorkPool, MaxThreads, HashContext, HashCreateWorker, HashDeleteWorker, HashProcessRequest, &HashContext->ForegroundWorker)) {
         HashCleanupContext(HashContext);
         return FALSE;
     }
@@ -393,6 +869,84 @@ HashInitializeContext(
     return TRUE;
 }
 
+/**
+ Measure the throughput of each supported hash algorithm by hashing a
+ buffer in memory repeatedly, and display the result.  This excludes the
+ cost of reading files, so it indicates the rate at which a single thread
+ can hash data.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashBenchmark(VOID)
+{
+    HASH_CONTEXT HashContext;
+    PHASH_WORKER Worker;
+    PVOID hHash;
+    LONG Status;
+    DWORD AlgIndex;
+    DWORD BytesHashed;
+    DWORD Index;
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    LONGLONG ElapsedMs;
+    LONGLONG MbPerSecond;
+
+    if (!QueryPerformanceFrequency(&Frequency) || Frequency.QuadPart == 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: high resolution timer not available\n"));
+        return FALSE;
+    }
+
+    for (AlgIndex = 0; AlgIndex < sizeof(HashAlgorithms)/sizeof(HashAlgorithms[0]); AlgIndex++) {
+
+        ZeroMemory(&HashContext, sizeof(HashContext));
+        if (!HashInitializeContext(&HashContext, HashAlgorithms[AlgIndex].Name)) {
+            return FALSE;
+        }
+
+        Worker = &HashContext.ForegroundWorker;
+        for (Index = 0; Index < HashContext.ReadBufferLength; Index++) {
+            Worker->ReadBuffer[0][Index] = (UCHAR)Index;
+        }
+
+        Status = DllBCrypt.pBCryptCreateHash(HashContext.Algorithm, &hHash, Worker->ScratchBuffer, HashContext.ScratchBufferLength, NULL, 0, 0);
+        if (Status != STATUS_SUCCESS) {
+            HashCleanupContext(&HashContext);
+            return FALSE;
+        }
+
+        QueryPerformanceCounter(&StartTime);
+        for (BytesHashed = 0; BytesHashed < HASH_BENCHMARK_LENGTH; BytesHashed += HashContext.ReadBufferLength) {
+            Status = DllBCrypt.pBCryptHashData(hHash, Worker->ReadBuffer[0], HashContext.ReadBufferLength, 0);
+            if (Status != STATUS_SUCCESS) {
+                break;
+            }
+        }
+        if (Status == STATUS_SUCCESS) {
+            Status = DllBCrypt.pBCryptFinishHash(hHash, Worker->HashBuffer, HashContext.HashLength, 0);
+        }
+        QueryPerformanceCounter(&EndTime);
+
+        DllBCrypt.pBCryptDestroyHash(hHash);
+        HashCleanupContext(&HashContext);
+
+        if (Status != STATUS_SUCCESS) {
+            return FALSE;
+        }
+
+        ElapsedMs = (EndTime.QuadPart - StartTime.QuadPart) * 1000 / Frequency.QuadPart;
+        if (ElapsedMs == 0) {
+            ElapsedMs = 1;
+        }
+        MbPerSecond = (LONGLONG)(HASH_BENCHMARK_LENGTH / (1024 * 1024)) * 1000 / ElapsedMs;
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%-8s %8lli MB/s\n"), HashAlgorithms[AlgIndex].Name, MbPerSecond);
+    }
+
+    return TRUE;
+}
+
 /**
  A callback that is invoked when a directory cannot be successfully enumerated.
 
@@ -487,9 +1041,11 @@ ENTRYPOINT(
     DWORD StartArg = 0;
     DWORD MatchFlags;
     BOOL BasicEnumeration = FALSE;
+    BOOL Benchmark = FALSE;
     HASH_CONTEXT HashContext;
     YORI_STRING Arg;
-    LPTSTR Algorithm = L"SHA1";
+    LPCTSTR Algorithm = L"SHA1";
+    DWORD AlgIndex;
 
     ZeroMemory(&HashContext, sizeof(HashContext));
 
@@ -508,35 +1064,22 @@ ENTRYPOINT(
                 return EXIT_SUCCESS;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("a")) == 0) {
                 if (i + 1 < ArgC) {
-                    if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("MD4")) == 0) {
-                        ArgumentUnderstood = TRUE;
-                        i++;
-                        Algorithm = _T("MD4");
-                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("MD5")) == 0) {
-                        ArgumentUnderstood = TRUE;
-                        i++;
-                        Algorithm = _T("MD5");
-                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("SHA1")) == 0) {
-                        ArgumentUnderstood = TRUE;
-                        i++;
-                        Algorithm = _T("SHA1");
-                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("SHA256")) == 0) {
-                        ArgumentUnderstood = TRUE;
-                        i++;
-                        Algorithm = _T("SHA256");
-                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("SHA384")) == 0) {
-                        ArgumentUnderstood = TRUE;
-                        i++;
-                        Algorithm = _T("SHA384");
-                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("SHA512")) == 0) {
-                        ArgumentUnderstood = TRUE;
-                        i++;
-                        Algorithm = _T("SHA512");
-                    } else {
+                    for (AlgIndex = 0; AlgIndex < sizeof(HashAlgorithms)/sizeof(HashAlgorithms[0]); AlgIndex++) {
+                        if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], HashAlgorithms[AlgIndex].Name) == 0) {
+                            Algorithm = HashAlgorithms[AlgIndex].Name;
+                            break;
+                        }
+                    }
+                    if (AlgIndex == sizeof(HashAlgorithms)/sizeof(HashAlgorithms[0])) {
                         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: algorithm not recognized.  Supported algorithms are MD4, MD5, SHA1, SHA256, SHA384, and SHA512\n"));
                         return EXIT_FAILURE;
                     }
+                    ArgumentUnderstood = TRUE;
+                    i++;
                 }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("bench")) == 0) {
+                Benchmark = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("b")) == 0) {
                 BasicEnumeration = TRUE;
                 ArgumentUnderstood = TRUE;
@@ -572,6 +1115,13 @@ ENTRYPOINT(
         return EXIT_FAILURE;
     }
 
+    if (Benchmark) {
+        if (!HashBenchmark()) {
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
     if (!HashInitializeContext(&HashContext, Algorithm)) {
         return EXIT_FAILURE;
     }
@@ -599,10 +1149,11 @@ ENTRYPOINT(
             return EXIT_FAILURE;
         }
 
-        if (!HashProcessStream(GetStdHandle(STD_INPUT_HANDLE), &HashContext)) {
+        if (!HashProcessStream(GetStdHandle(STD_INPUT_HANDLE), FALSE, &HashContext.ForegroundWorker, &HashContext.HashString)) {
             HashCleanupContext(&HashContext);
             return EXIT_FAILURE;
         }
+        HashContext.FilesFound++;
         YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &HashContext.HashString);
     } else {
         MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_DIRECTORY_CONTENTS;
@@ -610,7 +1161,7 @@ ENTRYPOINT(
             MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
         }
         if (HashContext.Recursive) {
-            MatchFlags |= YORILIB_FILEENUM_RECURSE_AFTER_RETURN | YORILIB_FILEENUM_RECURSE_PRESERVE_WILD;
+            MatchFlags |= YORILIB_FILEENUM_RECURSE_AFTER_RETURN | YORILIB_FILEENUM_RECURSE_PRESERVE_WILD | YORILIB_FILEENUM_PARALLEL;
         }
 
         for (i = StartArg; i < ArgC; i++) {
@@ -625,11 +1176,14 @@ ENTRYPOINT(
                                  HashFileEnumerateErrorCallback,
                                  &HashContext);
 
+            HashDisplayCompletedRequests(&HashContext, 0);
+
             if (HashContext.FilesFoundThisArg == 0) {
                 YORI_STRING FullPath;
                 YoriLibInitEmptyString(&FullPath);
                 if (YoriLibUserStringToSingleFilePath(&ArgV[i], TRUE, &FullPath)) {
                     HashFileFoundCallback(&FullPath, NULL, 0, &HashContext);
+                    HashDisplayCompletedRequests(&HashContext, 0);
                     YoriLibFreeStringContents(&FullPath);
                 }
                 if (HashContext.SavedErrorThisArg != ERROR_SUCCESS) {
@@ -642,7 +1196,7 @@ ENTRYPOINT(
     HashCleanupContext(&HashContext);
 
     if (HashContext.FilesFound == 0) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lines: no matching files found\n"));
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: no matching files found\n"));
         return EXIT_FAILURE;
     }
 
@@ -609,12 +609,13 @@ HexDumpReverseProcessStream(
     HexDumpContext->FilesFound++;
     HexDumpContext->FilesFoundThisArg++;
 
-    if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+    if (!YoriLibMappedLineReadToString(&LineString, &LineContext, hSource)) {
+        YoriLibMappedLineReadClose(LineContext);
         return TRUE;
     }
 
     if (!HexDumpDetectReverseFormatFromLine(&LineString, &ReverseContext)) {
-        YoriLibLineReadClose(LineContext);
+        YoriLibMappedLineReadClose(LineContext);
         YoriLibFreeStringContents(&LineString);
         return FALSE;
     }
@@ -629,12 +630,12 @@ HexDumpReverseProcessStream(
 
         WriteFile(OutputHandle, ReverseContext.OutputBuffer, ReverseContext.BytesThisLine, &BytesWritten, NULL);
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibMappedLineReadToString(&LineString, &LineContext, hSource)) {
             break;
         }
     }
 
-    YoriLibLineReadClose(LineContext);
+    YoriLibMappedLineReadClose(LineContext);
     YoriLibFreeStringContents(&LineString);
 
     return TRUE;
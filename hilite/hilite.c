@@ -36,10 +36,11 @@ CHAR strHiliteHelpText[] =
         "Output the contents of one or more files with highlight on lines\n"
         "matching specified criteria.\n"
         "\n"
-        "HILITE [-license] [-b] [-c <string> <color>] [-h <string> <color>]\n"
-        "       [-i] [-s] [-t <string> <color>] [<file>...]\n"
+        "HILITE [-license] [-b] [-bench] [-c <string> <color>]\n"
+        "       [-h <string> <color>] [-i] [-s] [-t <string> <color>] [<file>...]\n"
         "\n"
         "   -b             Use basic search criteria for files only\n"
+        "   -bench         Measure lines per second matched, without output\n"
         "   -c             Highlight lines containing <string> with <color>\n"
         "   -h             Highlight lines starting with <string> with <color>\n"
         "   -i             Match insensitively\n"
@@ -96,6 +97,118 @@ typedef struct _HILITE_MATCH_CRITERIA {
     YORILIB_COLOR_ATTRIBUTES Color;
 } HILITE_MATCH_CRITERIA, *PHILITE_MATCH_CRITERIA;
 
+/**
+ A value indicating that no criteria matches a line.
+ */
+#define HILITE_NO_MATCH ((DWORD)-1)
+
+/**
+ A single node within a trie used to find begins with or ends with criteria.
+ Each node corresponds to a prefix of one or more criteria strings, or for
+ ends with criteria, a prefix of the reversed string.
+ */
+typedef struct _HILITE_TRIE_NODE {
+
+    /**
+     The index of the first child of this node, or zero if the node has no
+     children.
+     */
+    DWORD FirstChild;
+
+    /**
+     The index of the next child of this node's parent, or zero if this is
+     the last child.
+     */
+    DWORD NextSibling;
+
+    /**
+     The index of the earliest criteria whose string ends at this node, or
+     HILITE_NO_MATCH if no criteria string ends here.
+     */
+    DWORD CriteriaIndex;
+
+    /**
+     The character that transitions from the parent to this node.
+     */
+    TCHAR Char;
+} HILITE_TRIE_NODE, *PHILITE_TRIE_NODE;
+
+/**
+ A trie used to find begins with or ends with criteria.
+ */
+typedef struct _HILITE_TRIE {
+
+    /**
+     The array of nodes in the trie.  The first node is the root.
+     */
+    PHILITE_TRIE_NODE Nodes;
+
+    /**
+     The number of nodes in use.  If zero, there are no criteria of this
+     type.
+     */
+    DWORD NodeCount;
+} HILITE_TRIE, *PHILITE_TRIE;
+
+/**
+ A compiled form of the match criteria.  Criteria are numbered in the order
+ they were specified, and when several criteria match a line, the earliest
+ is applied.  Begins with and ends with criteria are found by walking a trie
+ from the start or end of the line, and all contains criteria are found with
+ a single pass of a substring matcher.
+ */
+typedef struct _HILITE_PROGRAM {
+
+    /**
+     The number of criteria.
+     */
+    DWORD CriteriaCount;
+
+    /**
+     An array of pointers to each criteria, in the order they were
+     specified.
+     */
+    PHILITE_MATCH_CRITERIA *Criteria;
+
+    /**
+     A trie of the strings of begins with criteria.
+     */
+    HILITE_TRIE Prefixes;
+
+    /**
+     A trie of the reversed strings of ends with criteria.
+     */
+    HILITE_TRIE Suffixes;
+
+    /**
+     The number of contains criteria.
+     */
+    DWORD ContainsCount;
+
+    /**
+     The index of the earliest contains criteria.  If a line has already
+     matched an earlier criteria, the contains criteria are not checked.
+     */
+    DWORD FirstContainsIndex;
+
+    /**
+     An array of the strings of contains criteria, used to build the
+     substring matcher.
+     */
+    PYORI_STRING ContainsStrings;
+
+    /**
+     For each entry in ContainsStrings, the index of the criteria it came
+     from.
+     */
+    PDWORD ContainsCriteriaIndex;
+
+    /**
+     A substring matcher to find all contains criteria.
+     */
+    PYORI_SUBSTRING_MATCHER ContainsMatcher;
+} HILITE_PROGRAM, *PHILITE_PROGRAM;
+
 /**
  Context passed to the callback which is invoked for each file found.
  */
@@ -118,6 +231,22 @@ typedef struct _HILITE_CONTEXT {
      */
     BOOLEAN Recursive;
 
+    /**
+     TRUE if lines should be matched without being output, and the rate of
+     matching displayed on completion.
+     */
+    BOOLEAN Benchmark;
+
+    /**
+     Records the total number of lines processed.
+     */
+    LONGLONG LinesProcessed;
+
+    /**
+     Records the total number of lines which matched any criteria.
+     */
+    LONGLONG LinesMatched;
+
     /**
      The color to apply if none of the matches match.
      */
@@ -128,8 +257,401 @@ typedef struct _HILITE_CONTEXT {
      */
     YORI_LIST_ENTRY Matches;
 
+    /**
+     The compiled form of Matches, used to find the criteria to apply to
+     each line.
+     */
+    HILITE_PROGRAM Program;
+
 } HILITE_CONTEXT, *PHILITE_CONTEXT;
 
+/**
+ Convert a character to the form used for comparison.
+
+ @param Insensitive TRUE if comparisons are case insensitive.
+
+ @param Char The character to convert.
+
+ @return The character to compare.
+ */
+#define HiliteFoldChar(Insensitive, Char) \
+    ((Insensitive)?YoriLibUpcaseChar(Char):(Char))
+
+/**
+ Find the child of a node in a trie that is reached by a specified
+ character.
+
+ @param Trie Pointer to the trie.
+
+ @param NodeIndex The index of the parent node.
+
+ @param Char The character to transition on.
+
+ @return The index of the child node, or zero if the parent has no child
+         for this character.
+ */
+DWORD
+HiliteTrieFindChild(
+    __in PHILITE_TRIE Trie,
+    __in DWORD NodeIndex,
+    __in TCHAR Char
+    )
+{
+    DWORD ChildIndex;
+
+    ChildIndex = Trie->Nodes[NodeIndex].FirstChild;
+    while (ChildIndex != 0) {
+        if (Trie->Nodes[ChildIndex].Char == Char) {
+            return ChildIndex;
+        }
+        ChildIndex = Trie->Nodes[ChildIndex].NextSibling;
+    }
+
+    return 0;
+}
+
+/**
+ Insert a criteria string into a trie.  The trie must have been allocated
+ with enough nodes for every character of every string inserted into it.
+
+ @param Trie Pointer to the trie.
+
+ @param String Pointer to the string to insert.
+
+ @param Reverse TRUE if the string should be inserted from its final
+        character to its first, FALSE if it should be inserted from its
+        first character.
+
+ @param Insensitive TRUE if comparisons are case insensitive.
+
+ @param CriteriaIndex The index of the criteria that the string came from.
+ */
+VOID
+HiliteTrieInsert(
+    __inout PHILITE_TRIE Trie,
+    __in PYORI_STRING String,
+    __in BOOLEAN Reverse,
+    __in BOOLEAN Insensitive,
+    __in DWORD CriteriaIndex
+    )
+{
+    DWORD NodeIndex;
+    DWORD ChildIndex;
+    DWORD CharIndex;
+    TCHAR Char;
+
+    NodeIndex = 0;
+    for (CharIndex = 0; CharIndex < String->LengthInChars; CharIndex++) {
+        if (Reverse) {
+            Char = String->StartOfString[String->LengthInChars - CharIndex - 1];
+        } else {
+            Char = String->StartOfString[CharIndex];
+        }
+        Char = HiliteFoldChar(Insensitive, Char);
+
+        ChildIndex = HiliteTrieFindChild(Trie, NodeIndex, Char);
+        if (ChildIndex == 0) {
+            ChildIndex = Trie->NodeCount;
+            Trie->NodeCount++;
+            Trie->Nodes[ChildIndex].Char = Char;
+            Trie->Nodes[ChildIndex].FirstChild = 0;
+            Trie->Nodes[ChildIndex].CriteriaIndex = HILITE_NO_MATCH;
+            Trie->Nodes[ChildIndex].NextSibling = Trie->Nodes[NodeIndex].FirstChild;
+            Trie->Nodes[NodeIndex].FirstChild = ChildIndex;
+        }
+        NodeIndex = ChildIndex;
+    }
+
+    //
+    //  Criteria are inserted in order, so if the same string is specified
+    //  more than once, the first one wins.
+    //
+
+    if (Trie->Nodes[NodeIndex].CriteriaIndex == HILITE_NO_MATCH) {
+        Trie->Nodes[NodeIndex].CriteriaIndex = CriteriaIndex;
+    }
+}
+
+/**
+ Allocate the nodes for a trie.
+
+ @param Trie Pointer to the trie to initialize.
+
+ @param TotalChars The total number of characters in all strings that will
+        be inserted into the trie.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HiliteTrieInitialize(
+    __out PHILITE_TRIE Trie,
+    __in DWORD TotalChars
+    )
+{
+    Trie->Nodes = YoriLibMalloc((TotalChars + 1) * sizeof(HILITE_TRIE_NODE));
+    if (Trie->Nodes == NULL) {
+        return FALSE;
+    }
+
+    Trie->Nodes[0].FirstChild = 0;
+    Trie->Nodes[0].NextSibling = 0;
+    Trie->Nodes[0].CriteriaIndex = HILITE_NO_MATCH;
+    Trie->Nodes[0].Char = '\0';
+    Trie->NodeCount = 1;
+    return TRUE;
+}
+
+/**
+ Walk a trie along the characters of a line, returning the earliest
+ criteria whose string was found.
+
+ @param Trie Pointer to the trie.
+
+ @param Line Pointer to the line.
+
+ @param Reverse TRUE to walk from the end of the line, FALSE to walk from the
+        start.
+
+ @param Insensitive TRUE if comparisons are case insensitive.
+
+ @param BestIndex The index of the earliest criteria already known to match
+        the line, or HILITE_NO_MATCH.
+
+ @return The index of the earliest matching criteria, which is BestIndex if
+         the trie does not contain an earlier match.
+ */
+DWORD
+HiliteTrieFindMatch(
+    __in PHILITE_TRIE Trie,
+    __in PYORI_STRING Line,
+    __in BOOLEAN Reverse,
+    __in BOOLEAN Insensitive,
+    __in DWORD BestIndex
+    )
+{
+    DWORD NodeIndex;
+    DWORD CharIndex;
+    TCHAR Char;
+
+    if (Trie->NodeCount == 0) {
+        return BestIndex;
+    }
+
+    NodeIndex = 0;
+    if (Trie->Nodes[0].CriteriaIndex < BestIndex) {
+        BestIndex = Trie->Nodes[0].CriteriaIndex;
+    }
+
+    for (CharIndex = 0; CharIndex < Line->LengthInChars && BestIndex != 0; CharIndex++) {
+        if (Reverse) {
+            Char = Line->StartOfString[Line->LengthInChars - CharIndex - 1];
+        } else {
+            Char = Line->StartOfString[CharIndex];
+        }
+        NodeIndex = HiliteTrieFindChild(Trie, NodeIndex, HiliteFoldChar(Insensitive, Char));
+        if (NodeIndex == 0) {
+            break;
+        }
+        if (Trie->Nodes[NodeIndex].CriteriaIndex < BestIndex) {
+            BestIndex = Trie->Nodes[NodeIndex].CriteriaIndex;
+        }
+    }
+
+    return BestIndex;
+}
+
+/**
+ Free a compiled form of the match criteria.
+
+ @param Program Pointer to the program to free.
+ */
+VOID
+HiliteFreeProgram(
+    __inout PHILITE_PROGRAM Program
+    )
+{
+    if (Program->ContainsMatcher != NULL) {
+        YoriLibFreeSubstringMatcher(Program->ContainsMatcher);
+    }
+    if (Program->ContainsStrings != NULL) {
+        YoriLibFree(Program->ContainsStrings);
+    }
+    if (Program->ContainsCriteriaIndex != NULL) {
+        YoriLibFree(Program->ContainsCriteriaIndex);
+    }
+    if (Program->Prefixes.Nodes != NULL) {
+        YoriLibFree(Program->Prefixes.Nodes);
+    }
+    if (Program->Suffixes.Nodes != NULL) {
+        YoriLibFree(Program->Suffixes.Nodes);
+    }
+    if (Program->Criteria != NULL) {
+        YoriLibFree(Program->Criteria);
+    }
+    ZeroMemory(Program, sizeof(HILITE_PROGRAM));
+}
+
+/**
+ Compile the list of match criteria into a form that can test every
+ criteria against a line with a small number of passes over the line.
+
+ @param HiliteContext Pointer to the context containing the match criteria.
+        On successful completion, the compiled program is stored here.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HiliteCompileProgram(
+    __inout PHILITE_CONTEXT HiliteContext
+    )
+{
+    PHILITE_PROGRAM Program = &HiliteContext->Program;
+    PHILITE_MATCH_CRITERIA MatchCriteria;
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD PrefixChars;
+    DWORD SuffixChars;
+    DWORD Index;
+
+    ZeroMemory(Program, sizeof(HILITE_PROGRAM));
+    Program->FirstContainsIndex = HILITE_NO_MATCH;
+    PrefixChars = 0;
+    SuffixChars = 0;
+
+    ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, NULL);
+    while (ListEntry != NULL) {
+        MatchCriteria = CONTAINING_RECORD(ListEntry, HILITE_MATCH_CRITERIA, ListEntry);
+        Program->CriteriaCount++;
+        if (MatchCriteria->MatchType == HiliteMatchTypeBeginsWith) {
+            PrefixChars += MatchCriteria->MatchString.LengthInChars;
+        } else if (MatchCriteria->MatchType == HiliteMatchTypeEndsWith) {
+            SuffixChars += MatchCriteria->MatchString.LengthInChars;
+        } else {
+            Program->ContainsCount++;
+        }
+        ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, ListEntry);
+    }
+
+    if (Program->CriteriaCount == 0) {
+        return TRUE;
+    }
+
+    Program->Criteria = YoriLibMalloc(Program->CriteriaCount * sizeof(PHILITE_MATCH_CRITERIA));
+    if (Program->Criteria == NULL) {
+        HiliteFreeProgram(Program);
+        return FALSE;
+    }
+
+    if (Program->ContainsCount > 0) {
+        Program->ContainsStrings = YoriLibMalloc(Program->ContainsCount * sizeof(YORI_STRING));
+        if (Program->ContainsStrings == NULL) {
+            HiliteFreeProgram(Program);
+            return FALSE;
+        }
+        Program->ContainsCriteriaIndex = YoriLibMalloc(Program->ContainsCount * sizeof(DWORD));
+        if (Program->ContainsCriteriaIndex == NULL) {
+            HiliteFreeProgram(Program);
+            return FALSE;
+        }
+    }
+
+    //
+    //  Tries are only allocated if there are criteria of that type, so a
+    //  trie with no nodes indicates there is nothing to check.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, NULL);
+    while (ListEntry != NULL) {
+        MatchCriteria = CONTAINING_RECORD(ListEntry, HILITE_MATCH_CRITERIA, ListEntry);
+        if (MatchCriteria->MatchType == HiliteMatchTypeBeginsWith && Program->Prefixes.Nodes == NULL) {
+            if (!HiliteTrieInitialize(&Program->Prefixes, PrefixChars)) {
+                HiliteFreeProgram(Program);
+                return FALSE;
+            }
+        } else if (MatchCriteria->MatchType == HiliteMatchTypeEndsWith && Program->Suffixes.Nodes == NULL) {
+            if (!HiliteTrieInitialize(&Program->Suffixes, SuffixChars)) {
+                HiliteFreeProgram(Program);
+                return FALSE;
+            }
+        }
+        ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, ListEntry);
+    }
+
+    Index = 0;
+    Program->ContainsCount = 0;
+    ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, NULL);
+    while (ListEntry != NULL) {
+        MatchCriteria = CONTAINING_RECORD(ListEntry, HILITE_MATCH_CRITERIA, ListEntry);
+        Program->Criteria[Index] = MatchCriteria;
+        if (MatchCriteria->MatchType == HiliteMatchTypeBeginsWith) {
+            HiliteTrieInsert(&Program->Prefixes, &MatchCriteria->MatchString, FALSE, HiliteContext->Insensitive, Index);
+        } else if (MatchCriteria->MatchType == HiliteMatchTypeEndsWith) {
+            HiliteTrieInsert(&Program->Suffixes, &MatchCriteria->MatchString, TRUE, HiliteContext->Insensitive, Index);
+        } else {
+            if (Program->FirstContainsIndex == HILITE_NO_MATCH) {
+                Program->FirstContainsIndex = Index;
+            }
+            YoriLibInitEmptyString(&Program->ContainsStrings[Program->ContainsCount]);
+            Program->ContainsStrings[Program->ContainsCount].StartOfString = MatchCriteria->MatchString.StartOfString;
+            Program->ContainsStrings[Program->ContainsCount].LengthInChars = MatchCriteria->MatchString.LengthInChars;
+            Program->ContainsCriteriaIndex[Program->ContainsCount] = Index;
+            Program->ContainsCount++;
+        }
+        Index++;
+        ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, ListEntry);
+    }
+
+    if (Program->ContainsCount > 0) {
+        Program->ContainsMatcher = YoriLibCompileSubstringMatcher(Program->ContainsCount, Program->ContainsStrings, HiliteContext->Insensitive);
+        if (Program->ContainsMatcher == NULL) {
+            HiliteFreeProgram(Program);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Find the earliest criteria that matches a line.
+
+ @param HiliteContext Pointer to the context containing the compiled
+        program.
+
+ @param Line Pointer to the line to check.
+
+ @return Pointer to the matching criteria, or NULL if no criteria matches.
+ */
+PHILITE_MATCH_CRITERIA
+HiliteFindMatch(
+    __in PHILITE_CONTEXT HiliteContext,
+    __in PYORI_STRING Line
+    )
+{
+    PHILITE_PROGRAM Program = &HiliteContext->Program;
+    PYORI_STRING ContainsMatch;
+    DWORD BestIndex;
+    DWORD ContainsIndex;
+
+    BestIndex = HiliteTrieFindMatch(&Program->Prefixes, Line, FALSE, HiliteContext->Insensitive, HILITE_NO_MATCH);
+    BestIndex = HiliteTrieFindMatch(&Program->Suffixes, Line, TRUE, HiliteContext->Insensitive, BestIndex);
+
+    if (Program->ContainsMatcher != NULL && Program->FirstContainsIndex < BestIndex) {
+        ContainsMatch = YoriLibSubstringMatcherFindEarliestEntry(Program->ContainsMatcher, Line);
+        if (ContainsMatch != NULL) {
+            ContainsIndex = Program->ContainsCriteriaIndex[ContainsMatch - Program->ContainsStrings];
+            if (ContainsIndex < BestIndex) {
+                BestIndex = ContainsIndex;
+            }
+        }
+    }
+
+    if (BestIndex == HILITE_NO_MATCH) {
+        return NULL;
+    }
+
+    return Program->Criteria[BestIndex];
+}
+
 /**
  Process a stream and apply the hilite criteria before outputting to standard
  output.
@@ -152,7 +674,6 @@ HiliteProcessStream(
     YORI_STRING LineString;
     PHILITE_MATCH_CRITERIA MatchCriteria;
     YORILIB_COLOR_ATTRIBUTES ColorToUse;
-    PYORI_LIST_ENTRY ListEntry;
 
     YoriLibInitEmptyString(&LineString);
 
@@ -160,77 +681,23 @@ HiliteProcessStream(
 
     while (TRUE) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibMappedLineReadToString(&LineString, &LineContext, hSource)) {
             break;
         }
 
         ColorToUse.Ctrl = HiliteContext->DefaultColor.Ctrl;
         ColorToUse.Win32Attr = HiliteContext->DefaultColor.Win32Attr;
 
-        //
-        //  Enumerate through the matches and see if there is anything to
-        //  apply.
-        //
+        HiliteContext->LinesProcessed++;
+        MatchCriteria = HiliteFindMatch(HiliteContext, &LineString);
+        if (MatchCriteria != NULL) {
+            HiliteContext->LinesMatched++;
+            ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
+            ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
+        }
 
-        ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, NULL);
-        while (ListEntry != NULL) {
-            MatchCriteria = CONTAINING_RECORD(ListEntry, HILITE_MATCH_CRITERIA, ListEntry);
-            if (MatchCriteria->MatchType == HiliteMatchTypeBeginsWith) {
-                if (HiliteContext->Insensitive) {
-                    if (YoriLibCompareStringInsensitiveCount(&LineString,
-                                                             &MatchCriteria->MatchString,
-                                                             MatchCriteria->MatchString.LengthInChars) == 0) {
-                        ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
-                        ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
-                        break;
-                    }
-                } else {
-                    if (YoriLibCompareStringCount(&LineString,
-                                                  &MatchCriteria->MatchString,
-                                                  MatchCriteria->MatchString.LengthInChars) == 0) {
-                        ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
-                        ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
-                        break;
-                    }
-                }
-            } else if (MatchCriteria->MatchType == HiliteMatchTypeEndsWith) {
-                YORI_STRING TailOfLine;
-    
-                if (LineString.LengthInChars >= MatchCriteria->MatchString.LengthInChars) {
-                    YoriLibInitEmptyString(&TailOfLine);
-                    TailOfLine.LengthInChars = MatchCriteria->MatchString.LengthInChars;
-                    TailOfLine.StartOfString = &LineString.StartOfString[LineString.LengthInChars - MatchCriteria->MatchString.LengthInChars];
-    
-                    if (HiliteContext->Insensitive) {
-                        if (YoriLibCompareStringInsensitive(&TailOfLine, &MatchCriteria->MatchString) == 0) {
-                            ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
-                            ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
-                            break;
-                        }
-                    } else {
-                        if (YoriLibCompareString(&TailOfLine, &MatchCriteria->MatchString) == 0) {
-                            ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
-                            ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
-                            break;
-                        }
-                    }
-                }
-            } else if (MatchCriteria->MatchType == HiliteMatchTypeContains) {
-                if (HiliteContext->Insensitive) {
-                    if (YoriLibFindFirstMatchingSubstringInsensitive(&LineString, 1, &MatchCriteria->MatchString, NULL)) {
-                        ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
-                        ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
-                        break;
-                    }
-                } else {
-                    if (YoriLibFindFirstMatchingSubstring(&LineString, 1, &MatchCriteria->MatchString, NULL)) {
-                        ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
-                        ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
-                        break;
-                    }
-                }
-            }
-            ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, ListEntry);
+        if (HiliteContext->Benchmark) {
+            continue;
         }
 
         //
@@ -245,7 +712,7 @@ HiliteProcessStream(
         }
     }
 
-    YoriLibLineReadClose(LineContext);
+    YoriLibMappedLineReadClose(LineContext);
     YoriLibFreeStringContents(&LineString);
 
     return TRUE;
@@ -380,6 +847,8 @@ HiliteCleanupContext(
     PHILITE_MATCH_CRITERIA MatchCriteria;
     PYORI_LIST_ENTRY ListEntry;
 
+    HiliteFreeProgram(&HiliteContext->Program);
+
     ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, NULL);
     while (ListEntry != NULL) {
         MatchCriteria = CONTAINING_RECORD(ListEntry, HILITE_MATCH_CRITERIA, ListEntry);
@@ -427,6 +896,10 @@ ENTRYPOINT(
     CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
     PHILITE_MATCH_CRITERIA NewCriteria;
     YORI_STRING Arg;
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    LONGLONG ElapsedMs;
 
     ZeroMemory(&HiliteContext, sizeof(HiliteContext));
 
@@ -458,6 +931,9 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("b")) == 0) {
                 BasicEnumeration = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("bench")) == 0) {
+                HiliteContext.Benchmark = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("c")) == 0) {
                 if (i + 2 < ArgC) {
                     NewCriteria = YoriLibMalloc(sizeof(HILITE_MATCH_CRITERIA));
@@ -538,6 +1014,21 @@ ENTRYPOINT(
 
     YoriLibEnableBackupPrivilege();
 
+    if (!HiliteCompileProgram(&HiliteContext)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hilite: out of memory\n"));
+        HiliteCleanupContext(&HiliteContext);
+        return EXIT_FAILURE;
+    }
+
+    if (HiliteContext.Benchmark) {
+        if (!QueryPerformanceFrequency(&Frequency) || Frequency.QuadPart == 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hilite: high resolution timer not available\n"));
+            HiliteCleanupContext(&HiliteContext);
+            return EXIT_FAILURE;
+        }
+        QueryPerformanceCounter(&StartTime);
+    }
+
     //
     //  If no file name is specified, use stdin; otherwise open
     //  the file and use that
@@ -571,6 +1062,21 @@ ENTRYPOINT(
         }
     }
 
+    if (HiliteContext.Benchmark) {
+        QueryPerformanceCounter(&EndTime);
+        ElapsedMs = (EndTime.QuadPart - StartTime.QuadPart) * 1000 / Frequency.QuadPart;
+        if (ElapsedMs == 0) {
+            ElapsedMs = 1;
+        }
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                      _T("%lli lines, %lli matched, %lli criteria, %lli ms, %lli lines/s\n"),
+                      HiliteContext.LinesProcessed,
+                      HiliteContext.LinesMatched,
+                      (LONGLONG)HiliteContext.Program.CriteriaCount,
+                      ElapsedMs,
+                      HiliteContext.LinesProcessed * 1000 / ElapsedMs);
+    }
+
     HiliteCleanupContext(&HiliteContext);
 
     if (HiliteContext.FilesFound == 0) {
@@ -36,8 +36,10 @@ CHAR strIconvHelpText[] =
         "Convert the character encoding of one or more files.\n"
         "\n"
         "ICONV [-license] [-b] [-s] [-e <encoding>] [-i <encoding>] [<file>...]\n"
+        "ICONV -bench\n"
         "\n"
         "   -b             Use basic search criteria for files only\n"
+        "   -bench         Measure the throughput of UTF8 conversion\n"
         "   -e <encoding>  Specifies the new encoding to use\n"
         "   -i <encoding>  Specifies the input (current) encoding\n"
         "   -s             Process files from all subdirectories\n";
@@ -119,7 +121,7 @@ IconvProcessStream(
 
     while (TRUE) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibMappedLineReadToString(&LineString, &LineContext, hSource)) {
             break;
         }
 
@@ -132,7 +134,7 @@ IconvProcessStream(
     YoriLibSetMultibyteInputEncoding(OriginalInputEncoding);
     YoriLibSetMultibyteOutputEncoding(OriginalOutputEncoding);
 
-    YoriLibLineReadClose(LineContext);
+    YoriLibMappedLineReadClose(LineContext);
     YoriLibFreeStringContents(&LineString);
 
     return TRUE;
@@ -253,6 +255,218 @@ IconvFileEnumerateErrorCallback(
     return Result;
 }
 
+/**
+ The number of bytes of UTF8 text converted by each call when measuring
+ throughput.
+ */
+#define ICONV_BENCHMARK_BLOCK_SIZE (1024 * 1024)
+
+/**
+ The total number of bytes of UTF8 text converted when measuring the
+ throughput of each method.
+ */
+#define ICONV_BENCHMARK_LENGTH (256 * 1024 * 1024)
+
+/**
+ A sample of text used to measure conversion throughput.
+ */
+typedef struct _ICONV_BENCHMARK_SAMPLE {
+
+    /**
+     The name of the sample to display.
+     */
+    LPCTSTR Name;
+
+    /**
+     A UTF8 string which is repeated to fill the buffer to convert.
+     */
+    LPCSTR Pattern;
+} ICONV_BENCHMARK_SAMPLE, *PICONV_BENCHMARK_SAMPLE;
+
+/**
+ The samples of text used to measure conversion throughput.  The first is
+ entirely ASCII; the second contains sequences of each length.
+ */
+CONST ICONV_BENCHMARK_SAMPLE IconvBenchmarkSamples[] = {
+    {_T("ascii"), "The quick brown fox jumps over the lazy dog.\r\n"},
+    {_T("mixed"), "Gr\xC3\xBC\xC3\x9F" "e \xE2\x82\xAC" "5 \xE6\x97\xA5\xE6\x9C\xAC \xF0\x9F\x98\x80 text\r\n"}
+};
+
+/**
+ Buffers used to measure conversion throughput.
+ */
+typedef struct _ICONV_BENCHMARK_BUFFERS {
+
+    /**
+     The UTF8 text to convert.
+     */
+    LPSTR Utf8;
+
+    /**
+     The number of bytes in the UTF8 text.
+     */
+    DWORD Utf8Length;
+
+    /**
+     A buffer to receive the UTF16 form of the text.
+     */
+    LPWSTR Utf16;
+
+    /**
+     The number of characters in the UTF16 form of the text.
+     */
+    DWORD Utf16Length;
+
+    /**
+     A buffer to receive the result of converting the UTF16 text back into
+     UTF8.
+     */
+    LPSTR Encoded;
+
+} ICONV_BENCHMARK_BUFFERS, *PICONV_BENCHMARK_BUFFERS;
+
+/**
+ Convert the benchmark text repeatedly with one method and return the
+ elapsed time.  The library methods carry state between calls as a stream
+ reader would; the system methods size the result before converting it, as
+ this program did before the library implemented UTF8 itself.
+
+ @param Buffers Pointer to the buffers to convert between.
+
+ @param ToUtf16 If TRUE, convert UTF8 to UTF16.  If FALSE, convert UTF16 to
+        UTF8.
+
+ @param UseSystem If TRUE, use the system conversion routines.  If FALSE,
+        use the library's conversion routines.
+
+ @param Frequency The frequency of the high resolution timer.
+
+ @return The elapsed time, in milliseconds.
+ */
+LONGLONG
+IconvBenchmarkMethod(
+    __in PICONV_BENCHMARK_BUFFERS Buffers,
+    __in BOOL ToUtf16,
+    __in BOOL UseSystem,
+    __in PLARGE_INTEGER Frequency
+    )
+{
+    YORI_LIB_UTF8_DECODE_STATE DecodeState;
+    YORI_LIB_UTF8_ENCODE_STATE EncodeState;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    DWORD BytesConverted;
+    DWORD Length;
+    LONGLONG ElapsedMs;
+
+    ZeroMemory(&DecodeState, sizeof(DecodeState));
+    ZeroMemory(&EncodeState, sizeof(EncodeState));
+
+    QueryPerformanceCounter(&StartTime);
+    for (BytesConverted = 0; BytesConverted < ICONV_BENCHMARK_LENGTH; BytesConverted += Buffers->Utf8Length) {
+        if (ToUtf16) {
+            if (UseSystem) {
+                Length = MultiByteToWideChar(CP_UTF8, 0, Buffers->Utf8, Buffers->Utf8Length, NULL, 0);
+                MultiByteToWideChar(CP_UTF8, 0, Buffers->Utf8, Buffers->Utf8Length, Buffers->Utf16, Length);
+            } else {
+                YoriLibUtf8ToUtf16(&DecodeState, Buffers->Utf8, Buffers->Utf8Length, Buffers->Utf16);
+            }
+        } else {
+            if (UseSystem) {
+                Length = WideCharToMultiByte(CP_UTF8, 0, Buffers->Utf16, Buffers->Utf16Length, NULL, 0, NULL, NULL);
+                WideCharToMultiByte(CP_UTF8, 0, Buffers->Utf16, Buffers->Utf16Length, Buffers->Encoded, Length, NULL, NULL);
+            } else {
+                YoriLibUtf16ToUtf8(&EncodeState, Buffers->Utf16, Buffers->Utf16Length, Buffers->Encoded);
+            }
+        }
+    }
+    QueryPerformanceCounter(&EndTime);
+
+    ElapsedMs = (EndTime.QuadPart - StartTime.QuadPart) * 1000 / Frequency->QuadPart;
+    if (ElapsedMs == 0) {
+        ElapsedMs = 1;
+    }
+    return ElapsedMs;
+}
+
+/**
+ Measure the throughput of converting UTF8 text to UTF16 and back with the
+ library's conversion routines and with the system's, and display the
+ result.  Text is converted in memory, so this excludes the cost of reading
+ and writing files.  Rates are expressed in terms of UTF8 text.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+IconvBenchmark(VOID)
+{
+    ICONV_BENCHMARK_BUFFERS Buffers;
+    LARGE_INTEGER Frequency;
+    DWORD SampleIndex;
+    DWORD PatternLength;
+    DWORD Direction;
+    LONGLONG LibraryMs;
+    LONGLONG SystemMs;
+    LONGLONG MbConverted;
+
+    if (!QueryPerformanceFrequency(&Frequency) || Frequency.QuadPart == 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("iconv: high resolution timer not available\n"));
+        return FALSE;
+    }
+
+    ZeroMemory(&Buffers, sizeof(Buffers));
+    Buffers.Utf8 = YoriLibMalloc(ICONV_BENCHMARK_BLOCK_SIZE);
+    Buffers.Utf16 = YoriLibMalloc(YORI_LIB_UTF16_CHARS_FOR_UTF8(ICONV_BENCHMARK_BLOCK_SIZE) * sizeof(WCHAR));
+    Buffers.Encoded = YoriLibMalloc(YORI_LIB_UTF8_BYTES_FOR_UTF16(YORI_LIB_UTF16_CHARS_FOR_UTF8(ICONV_BENCHMARK_BLOCK_SIZE)));
+    if (Buffers.Utf8 == NULL || Buffers.Utf16 == NULL || Buffers.Encoded == NULL) {
+        if (Buffers.Utf8 != NULL) {
+            YoriLibFree(Buffers.Utf8);
+        }
+        if (Buffers.Utf16 != NULL) {
+            YoriLibFree(Buffers.Utf16);
+        }
+        if (Buffers.Encoded != NULL) {
+            YoriLibFree(Buffers.Encoded);
+        }
+        return FALSE;
+    }
+
+    MbConverted = ICONV_BENCHMARK_LENGTH / (1024 * 1024);
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%-8s %-12s %14s %14s\n"), _T("Sample"), _T("Conversion"), _T("Library"), _T("System"));
+    for (SampleIndex = 0; SampleIndex < sizeof(IconvBenchmarkSamples)/sizeof(IconvBenchmarkSamples[0]); SampleIndex++) {
+        //
+        //  Fill the buffer with complete copies of the pattern, so that
+        //  each pass converts a valid stream.
+        //
+
+        PatternLength = (DWORD)strlen(IconvBenchmarkSamples[SampleIndex].Pattern);
+        Buffers.Utf8Length = 0;
+        while (Buffers.Utf8Length + PatternLength <= ICONV_BENCHMARK_BLOCK_SIZE) {
+            memcpy(&Buffers.Utf8[Buffers.Utf8Length], IconvBenchmarkSamples[SampleIndex].Pattern, PatternLength);
+            Buffers.Utf8Length += PatternLength;
+        }
+        Buffers.Utf16Length = YoriLibUtf8ToUtf16(NULL, Buffers.Utf8, Buffers.Utf8Length, Buffers.Utf16);
+
+        for (Direction = 0; Direction < 2; Direction++) {
+            LibraryMs = IconvBenchmarkMethod(&Buffers, Direction == 0, FALSE, &Frequency);
+            SystemMs = IconvBenchmarkMethod(&Buffers, Direction == 0, TRUE, &Frequency);
+
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                          _T("%-8s %-12s %9lli MB/s %9lli MB/s\n"),
+                          IconvBenchmarkSamples[SampleIndex].Name,
+                          Direction == 0?_T("utf8->utf16"):_T("utf16->utf8"),
+                          MbConverted * 1000 / LibraryMs,
+                          MbConverted * 1000 / SystemMs);
+        }
+    }
+
+    YoriLibFree(Buffers.Utf8);
+    YoriLibFree(Buffers.Utf16);
+    YoriLibFree(Buffers.Encoded);
+
+    return TRUE;
+}
 
 /**
  Parse a user specified argument into an encoding identifier.
@@ -311,6 +525,7 @@ ENTRYPOINT(
     DWORD StartArg = 0;
     DWORD MatchFlags;
     BOOL BasicEnumeration = FALSE;
+    BOOL Benchmark = FALSE;
     ICONV_CONTEXT IconvContext;
     YORI_STRING Arg;
 
@@ -334,6 +549,9 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("b")) == 0) {
                 BasicEnumeration = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("bench")) == 0) {
+                Benchmark = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("e")) == 0) {
                 if (ArgC > i + 1) {
                     DWORD NewEncoding;
@@ -373,6 +591,13 @@ ENTRYPOINT(
         }
     }
 
+    if (Benchmark) {
+        if (!IconvBenchmark()) {
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
 #if YORI_BUILTIN
     YoriLibCancelEnable();
 #endif
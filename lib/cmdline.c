@@ -303,6 +303,297 @@ YoriLibExpandCommandVariables(
     return TRUE;
 }
 
+/**
+ Compile a string containing delimited variables into a template consisting
+ of an array of literal and variable tokens.  The template can then be
+ expanded any number of times with @ref YoriLibExpandFormatTemplate without
+ parsing the string again.  Escapes and delimiters are interpreted exactly
+ as @ref YoriLibExpandCommandVariables interprets them.
+
+ @param Template On successful completion, populated with the compiled
+        template.  The caller should free this with
+        @ref YoriLibFreeFormatTemplate .  The template does not refer to
+        String after this function returns.
+
+ @param String The input string, which may contain variables to expand.
+
+ @param MatchChar The character to use to delimit the variable being expanded.
+
+ @param PreserveEscapes If TRUE, escape characters (^) are preserved in the
+        output; if FALSE, they are removed from the output.
+
+ @param ResolveFn Optionally points to a callback function to invoke for each
+        variable found, returning an identifier that is supplied to the
+        expand callback so that it does not need to compare names.  If not
+        specified, every variable has an identifier of zero.
+
+ @param Context A caller provided context to pass to the resolve function.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibCompileFormatTemplate(
+    __out PYORI_LIB_FORMAT_TEMPLATE Template,
+    __in PYORI_STRING String,
+    __in TCHAR MatchChar,
+    __in BOOLEAN PreserveEscapes,
+    __in_opt PYORILIB_VARIABLE_RESOLVE_FN ResolveFn,
+    __in_opt PVOID Context
+    )
+{
+    DWORD Phase;
+    DWORD Index;
+    DWORD FinalIndex;
+    DWORD IgnoreUntil;
+    DWORD TokenCount;
+    DWORD CharCount;
+    DWORD LiteralChars;
+    DWORD VariableLength;
+    BOOLEAN InLiteral;
+    PYORI_LIB_FORMAT_TOKEN Tokens;
+    PYORI_LIB_FORMAT_TOKEN Token;
+    LPTSTR Text;
+
+    Tokens = NULL;
+    Token = NULL;
+    Text = NULL;
+    TokenCount = 0;
+    CharCount = 0;
+    LiteralChars = 0;
+
+    //
+    //  In the first phase, count the tokens and characters.  In the second,
+    //  populate them into a single allocation.
+    //
+
+    for (Phase = 0; Phase < 2; Phase++) {
+        TokenCount = 0;
+        CharCount = 0;
+        LiteralChars = 0;
+        IgnoreUntil = 0;
+        InLiteral = FALSE;
+
+        for (Index = 0; Index < String->LengthInChars; Index++) {
+
+            if (Index >= IgnoreUntil && YoriLibIsEscapeChar(String->StartOfString[Index])) {
+                IgnoreUntil = Index + 2;
+                if (!PreserveEscapes) {
+                    continue;
+                }
+            }
+
+            if (Index >= IgnoreUntil && String->StartOfString[Index] == MatchChar) {
+                FinalIndex = Index + 1;
+                while (FinalIndex < String->LengthInChars && String->StartOfString[FinalIndex] != MatchChar) {
+                    FinalIndex++;
+                }
+
+                VariableLength = FinalIndex - Index - 1;
+                if (Phase == 1) {
+                    Token = &Tokens[TokenCount];
+                    YoriLibInitEmptyString(&Token->Text);
+                    Token->Text.StartOfString = &Text[CharCount];
+                    Token->Text.LengthAllocated = 
+                    Token->Text.LengthInChars = VariableLength;
+                    if (VariableLength > 0) {
+                        memcpy(Token->Text.StartOfString, &String->StartOfString[Index + 1], VariableLength * sizeof(TCHAR));
+                    }
+                    Token->IsVariable = TRUE;
+                    Token->VariableId = 0;
+                    if (ResolveFn != NULL) {
+                        Token->VariableId = ResolveFn(&Token->Text, Context);
+                    }
+                }
+
+                CharCount += VariableLength;
+                TokenCount++;
+                InLiteral = FALSE;
+                Index = FinalIndex;
+                continue;
+            }
+
+            if (!InLiteral) {
+                if (Phase == 1) {
+                    Token = &Tokens[TokenCount];
+                    YoriLibInitEmptyString(&Token->Text);
+                    Token->Text.StartOfString = &Text[CharCount];
+                    Token->IsVariable = FALSE;
+                    Token->VariableId = 0;
+                }
+                TokenCount++;
+                InLiteral = TRUE;
+            }
+
+            if (Phase == 1) {
+                Text[CharCount] = String->StartOfString[Index];
+                Token->Text.LengthInChars++;
+                Token->Text.LengthAllocated++;
+            }
+            CharCount++;
+            LiteralChars++;
+        }
+
+        if (Phase == 0 && TokenCount > 0) {
+            Tokens = YoriLibMalloc(TokenCount * sizeof(YORI_LIB_FORMAT_TOKEN) + CharCount * sizeof(TCHAR));
+            if (Tokens == NULL) {
+                return FALSE;
+            }
+            Text = (LPTSTR)(Tokens + TokenCount);
+        }
+
+        if (TokenCount == 0) {
+            break;
+        }
+    }
+
+    Template->TokenCount = TokenCount;
+    Template->LiteralChars = LiteralChars;
+    Template->Tokens = Tokens;
+
+    return TRUE;
+}
+
+/**
+ Ensure a string being expanded into has space for a specified number of
+ additional characters plus a NULL terminator, preserving the characters
+ already expanded.
+
+ @param ExpandedString The string being expanded into.
+
+ @param DestIndex The number of characters already expanded.
+
+ @param CharsNeeded The number of additional characters required.
+
+ @return TRUE to indicate the string has sufficient space, FALSE if it could
+         not be reallocated.
+ */
+__success(return)
+BOOL
+YoriLibGrowExpandedString(
+    __inout PYORI_STRING ExpandedString,
+    __in DWORD DestIndex,
+    __in DWORD CharsNeeded
+    )
+{
+    DWORD NewLength;
+
+    if (DestIndex + CharsNeeded < ExpandedString->LengthAllocated) {
+        return TRUE;
+    }
+
+    NewLength = ExpandedString->LengthAllocated * 4;
+    if (NewLength <= DestIndex + CharsNeeded) {
+        NewLength = DestIndex + CharsNeeded + 256;
+    }
+
+    ExpandedString->LengthInChars = DestIndex;
+    if (!YoriLibReallocateString(ExpandedString, NewLength)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Expand a template previously compiled with
+ @ref YoriLibCompileFormatTemplate by copying its literal text and calling a
+ callback function for every variable, allowing the callback to populate the
+ output with the correct value.
+
+ @param Template The compiled template.
+
+ @param Function The callback function to invoke for each variable.
+
+ @param Context A caller provided context to pass to the callback function.
+
+ @param ExpandedString On input, optionally points to a buffer from a previous
+        expansion which is reused if it is large enough.  On successful
+        completion, contains the expanded result.  The caller should free
+        this when it is no longer needed with @ref YoriLibFreeStringContents .
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibExpandFormatTemplate(
+    __in PYORI_LIB_FORMAT_TEMPLATE Template,
+    __in PYORILIB_FORMAT_EXPAND_FN Function,
+    __in_opt PVOID Context,
+    __inout PYORI_STRING ExpandedString
+    )
+{
+    DWORD DestIndex;
+    DWORD Index;
+    DWORD LengthNeeded;
+    PYORI_LIB_FORMAT_TOKEN Token;
+    YORI_STRING DestString;
+
+    if (ExpandedString->LengthAllocated <= Template->LiteralChars) {
+        YoriLibFreeStringContents(ExpandedString);
+        if (!YoriLibAllocateString(ExpandedString, Template->LiteralChars + 256)) {
+            return FALSE;
+        }
+    }
+    DestIndex = 0;
+
+    for (Index = 0; Index < Template->TokenCount; Index++) {
+        Token = &Template->Tokens[Index];
+
+        if (!Token->IsVariable) {
+            if (!YoriLibGrowExpandedString(ExpandedString, DestIndex, Token->Text.LengthInChars)) {
+                YoriLibFreeStringContents(ExpandedString);
+                return FALSE;
+            }
+            memcpy(&ExpandedString->StartOfString[DestIndex], Token->Text.StartOfString, Token->Text.LengthInChars * sizeof(TCHAR));
+            DestIndex += Token->Text.LengthInChars;
+            continue;
+        }
+
+        while (TRUE) {
+            YoriLibInitEmptyString(&DestString);
+            DestString.StartOfString = &ExpandedString->StartOfString[DestIndex];
+            DestString.LengthAllocated = ExpandedString->LengthAllocated - DestIndex - 1;
+
+            LengthNeeded = Function(&DestString, Token->VariableId, &Token->Text, Context);
+
+            if (LengthNeeded <= (ExpandedString->LengthAllocated - DestIndex - 1)) {
+                DestIndex += LengthNeeded;
+                break;
+            }
+
+            if (!YoriLibGrowExpandedString(ExpandedString, DestIndex, LengthNeeded)) {
+                YoriLibFreeStringContents(ExpandedString);
+                return FALSE;
+            }
+        }
+    }
+
+    ExpandedString->LengthInChars = DestIndex;
+    ExpandedString->StartOfString[DestIndex] = '\0';
+
+    return TRUE;
+}
+
+/**
+ Free a template previously compiled with
+ @ref YoriLibCompileFormatTemplate .
+
+ @param Template The template to free.
+ */
+VOID
+YoriLibFreeFormatTemplate(
+    __inout PYORI_LIB_FORMAT_TEMPLATE Template
+    )
+{
+    if (Template->Tokens != NULL) {
+        YoriLibFree(Template->Tokens);
+    }
+    Template->Tokens = NULL;
+    Template->TokenCount = 0;
+    Template->LiteralChars = 0;
+}
+
 /**
  Parses a NULL terminated command line string into an argument count and array
  of YORI_STRINGs corresponding to arguments.
@@ -27,6 +27,94 @@
 #include "yoripch.h"
 #include "yorilib.h"
 
+/**
+ The complete set of objects returned by the system for a single search
+ path.  These are captured by read ahead threads so the enumerating thread
+ can process them without waiting for the system.
+ */
+typedef struct _YORILIB_FILEENUM_LISTING {
+
+    /**
+     The state of this listing within the read ahead work pool.  Only
+     meaningful while the listing is outstanding.
+     */
+    YORI_LIB_WORK_ITEM WorkItem;
+
+    /**
+     The entry for this listing in the hash table of outstanding listings,
+     keyed by SearchPath.  Only meaningful while the listing is
+     outstanding.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The fully qualified, NULL terminated search path to read.
+     */
+    YORI_STRING SearchPath;
+
+    /**
+     If no entries could be read, the error returned by the system.
+     */
+    DWORD Error;
+
+    /**
+     The number of entries populated in the Entries array.
+     */
+    DWORD EntryCount;
+
+    /**
+     The number of entries allocated in the Entries array.
+     */
+    DWORD EntriesAllocated;
+
+    /**
+     An array of information about each object found, in the order
+     returned by the system.
+     */
+    PWIN32_FIND_DATA Entries;
+
+} YORILIB_FILEENUM_LISTING, *PYORILIB_FILEENUM_LISTING;
+
+/**
+ State for a set of threads which read directory listings ahead of the
+ enumerating thread.  Callbacks are never invoked from these threads; they
+ only issue the system calls to read directories, so the enumerating thread
+ observes results in exactly the order of a serial enumerate.
+ */
+typedef struct _YORILIB_FILEENUM_READAHEAD {
+
+    /**
+     The number of outstanding callers using the read ahead threads.  When
+     this drops to zero the threads are terminated.
+     */
+    DWORD ReferenceCount;
+
+    /**
+     The read ahead threads, and the listings which have been queued and
+     not yet consumed by the enumerating thread.
+     */
+    YORI_LIB_WORK_POOL WorkPool;
+
+    /**
+     A hash table of every listing which has been queued and not yet
+     consumed by the enumerating thread.  This is only accessed by the
+     enumerating thread.
+     */
+    PYORI_HASH_TABLE Listings;
+
+    /**
+     The maximum number of listings which can be outstanding at once.  This
+     bounds the memory consumed by reading ahead.
+     */
+    DWORD MaxListings;
+
+} YORILIB_FILEENUM_READAHEAD, *PYORILIB_FILEENUM_READAHEAD;
+
+/**
+ The read ahead state for the process, or NULL if no enumerate is currently
+ reading ahead.  This is only used by the thread performing enumeration.
+ */
+PYORILIB_FILEENUM_READAHEAD YoriLibFileEnumReadAheadState;
 
 /**
  A dynamically allocated structure so as to avoid putting excessive load
@@ -83,6 +171,23 @@ typedef struct _YORILIB_FOREACHFILE_CONTEXT {
      */
     YORI_STRING RecurseCriteria;
 
+    /**
+     If the enumerate is reading ahead, the listing currently being
+     processed.  Otherwise NULL, and results come directly from the system.
+     */
+    PYORILIB_FILEENUM_LISTING Listing;
+
+    /**
+     The index of the next entry to return from Listing.
+     */
+    DWORD ListingIndex;
+
+    /**
+     The index of the next entry in Listing whose subdirectory should be
+     queued for reading ahead.
+     */
+    DWORD ReadAheadIndex;
+
     /**
      The result of the Win32 FindFirstFile operation for the current
      file.
@@ -91,6 +196,739 @@ typedef struct _YORILIB_FOREACHFILE_CONTEXT {
 
 } YORILIB_FOREACHFILE_CONTEXT, *PYORILIB_FOREACHFILE_CONTEXT;
 
+/**
+ Allocate a directory listing for a search path.
+
+ @param SearchPath Pointer to the fully qualified search path.  This is
+        copied into the listing.
+
+ @return Pointer to the listing, or NULL on allocation failure.
+ */
+PYORILIB_FILEENUM_LISTING
+YoriLibFileEnumAllocateListing(
+    __in PYORI_STRING SearchPath
+    )
+{
+    PYORILIB_FILEENUM_LISTING Listing;
+
+    Listing = YoriLibMalloc(sizeof(YORILIB_FILEENUM_LISTING));
+    if (Listing == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Listing, sizeof(YORILIB_FILEENUM_LISTING));
+    if (!YoriLibAllocateString(&Listing->SearchPath, SearchPath->LengthInChars + 1)) {
+        YoriLibFree(Listing);
+        return NULL;
+    }
+    memcpy(Listing->SearchPath.StartOfString, SearchPath->StartOfString, SearchPath->LengthInChars * sizeof(TCHAR));
+    Listing->SearchPath.StartOfString[SearchPath->LengthInChars] = '\0';
+    Listing->SearchPath.LengthInChars = SearchPath->LengthInChars;
+
+    return Listing;
+}
+
+/**
+ Free a directory listing.
+
+ @param Listing Pointer to the listing to free.
+ */
+VOID
+YoriLibFileEnumFreeListing(
+    __in PYORILIB_FILEENUM_LISTING Listing
+    )
+{
+    if (Listing->Entries != NULL) {
+        YoriLibFree(Listing->Entries);
+    }
+    YoriLibFreeStringContents(&Listing->SearchPath);
+    YoriLibFree(Listing);
+}
+
+/**
+ Read every object matching a search path into a listing.  This may be
+ called from a read ahead thread or the enumerating thread.
+
+ @param Listing Pointer to the listing, whose SearchPath is populated.  On
+        completion, Entries is populated, or Error indicates why it could
+        not be.
+ */
+VOID
+YoriLibFileEnumPopulateListing(
+    __inout PYORILIB_FILEENUM_LISTING Listing
+    )
+{
+    HANDLE hFind;
+    PWIN32_FIND_DATA NewEntries;
+    DWORD NewEntriesAllocated;
+
+    Listing->Error = ERROR_SUCCESS;
+    Listing->EntryCount = 0;
+    Listing->EntriesAllocated = 16;
+    Listing->Entries = YoriLibMalloc(Listing->EntriesAllocated * sizeof(WIN32_FIND_DATA));
+    if (Listing->Entries == NULL) {
+        Listing->EntriesAllocated = 0;
+        Listing->Error = ERROR_NOT_ENOUGH_MEMORY;
+        return;
+    }
+
+    hFind = FindFirstFile(Listing->SearchPath.StartOfString, &Listing->Entries[0]);
+
+    //
+    //  If we can't enumerate it because it's a volume root, cook up the
+    //  data by hand, as a serial enumerate would.
+    //
+
+    if (hFind == INVALID_HANDLE_VALUE) {
+        Listing->Error = GetLastError();
+        if ((Listing->SearchPath.LengthInChars == 3 && YoriLibIsDriveLetterWithColonAndSlash(&Listing->SearchPath)) ||
+            (Listing->SearchPath.LengthInChars == 7 && YoriLibIsPrefixedDriveLetterWithColonAndSlash(&Listing->SearchPath))) {
+
+            if (YoriLibUpdateFindDataFromFileInformation(&Listing->Entries[0], Listing->SearchPath.StartOfString, FALSE)) {
+                Listing->Entries[0].cFileName[0] = '\0';
+                Listing->Entries[0].cAlternateFileName[0] = '\0';
+                Listing->EntryCount = 1;
+            }
+        }
+        return;
+    }
+
+    do {
+        Listing->EntryCount++;
+        if (Listing->EntryCount == Listing->EntriesAllocated) {
+            NewEntriesAllocated = Listing->EntriesAllocated * 2;
+            NewEntries = YoriLibMalloc(NewEntriesAllocated * sizeof(WIN32_FIND_DATA));
+            if (NewEntries == NULL) {
+                Listing->EntryCount = 0;
+                Listing->Error = ERROR_NOT_ENOUGH_MEMORY;
+                break;
+            }
+            memcpy(NewEntries, Listing->Entries, Listing->EntryCount * sizeof(WIN32_FIND_DATA));
+            YoriLibFree(Listing->Entries);
+            Listing->Entries = NewEntries;
+            Listing->EntriesAllocated = NewEntriesAllocated;
+        }
+    } while (FindNextFile(hFind, &Listing->Entries[Listing->EntryCount]));
+
+    FindClose(hFind);
+}
+
+/**
+ Read a directory listing on a read ahead thread.
+
+ @param Context Pointer to the read ahead state.
+
+ @param WorkItem Pointer to the work item within the listing to read.
+ */
+VOID
+YoriLibFileEnumReadAheadProcessListing(
+    __in PVOID Context,
+    __inout PYORI_LIB_WORK_ITEM WorkItem
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    YoriLibFileEnumPopulateListing(CONTAINING_RECORD(WorkItem, YORILIB_FILEENUM_LISTING, WorkItem));
+}
+
+/**
+ Indicate that the caller is about to perform enumerates which should read
+ directories ahead of when they are needed.  On the first call, this
+ creates the read ahead state; threads are created as listings are queued.
+ Each successful call must be matched with a call to
+ @ref YoriLibFileEnumEndReadAhead .
+
+ @return TRUE to indicate read ahead is available, FALSE if it is not, in
+         which case enumerates proceed serially.
+ */
+__success(return)
+BOOL
+YoriLibFileEnumStartReadAhead(VOID)
+{
+    PYORILIB_FILEENUM_READAHEAD ReadAhead;
+    DWORD MaxThreads;
+
+    if (YoriLibFileEnumReadAheadState != NULL) {
+        YoriLibFileEnumReadAheadState->ReferenceCount++;
+        return TRUE;
+    }
+
+    ReadAhead = YoriLibMalloc(sizeof(YORILIB_FILEENUM_READAHEAD));
+    if (ReadAhead == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(ReadAhead, sizeof(YORILIB_FILEENUM_READAHEAD));
+
+    //
+    //  Reading a directory is mostly waiting for the system or network, so
+    //  allow more threads than processors.
+    //
+
+    MaxThreads = YoriLibWorkPoolGetThreadCount(4, 2);
+    ReadAhead->MaxListings = MaxThreads * 4;
+
+    ReadAhead->Listings = YoriLibAllocateHashTable(ReadAhead->MaxListings);
+
+    //
+    //  The pool has no foreground worker, so listings are only queued if a
+    //  thread exists to read them.
+    //
+
+    if (ReadAhead->Listings == NULL ||
+        !YoriLibWorkPoolInitialize(&ReadAhead->WorkPool, MaxThreads, ReadAhead, NULL, NULL, YoriLibFileEnumReadAheadProcessListing, NULL)) {
+
+        YoriLibFileEnumReadAheadState = ReadAhead;
+        YoriLibFileEnumEndReadAhead();
+        return FALSE;
+    }
+
+    ReadAhead->ReferenceCount = 1;
+    YoriLibFileEnumReadAheadState = ReadAhead;
+    return TRUE;
+}
+
+/**
+ Indicate that the caller has finished performing enumerates which read
+ ahead.  When the last caller finishes, any queued listings are discarded,
+ the read ahead threads are terminated, and all state is freed.
+ */
+VOID
+YoriLibFileEnumEndReadAhead(VOID)
+{
+    PYORILIB_FILEENUM_READAHEAD ReadAhead;
+    PYORILIB_FILEENUM_LISTING Listing;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_HASH_ENTRY NextHashEntry;
+
+    ReadAhead = YoriLibFileEnumReadAheadState;
+    if (ReadAhead == NULL) {
+        return;
+    }
+
+    if (ReadAhead->ReferenceCount > 1) {
+        ReadAhead->ReferenceCount--;
+        return;
+    }
+
+    //
+    //  Discard anything no thread has started, so threads can terminate
+    //  as soon as they finish the listing they are reading.  Every
+    //  outstanding listing remains in the hash table and is freed below.
+    //
+
+    YoriLibWorkPoolCleanup(&ReadAhead->WorkPool);
+
+    if (ReadAhead->Listings != NULL) {
+        HashEntry = YoriLibHashGetNextEntry(ReadAhead->Listings, NULL);
+        while (HashEntry != NULL) {
+            NextHashEntry = YoriLibHashGetNextEntry(ReadAhead->Listings, HashEntry);
+            Listing = HashEntry->Context;
+            YoriLibHashRemoveByEntry(HashEntry);
+            YoriLibFileEnumFreeListing(Listing);
+            HashEntry = NextHashEntry;
+        }
+        YoriLibFreeEmptyHashTable(ReadAhead->Listings);
+    }
+
+    YoriLibFree(ReadAhead);
+    YoriLibFileEnumReadAheadState = NULL;
+}
+
+/**
+ Queue a fully qualified search path to be read by a read ahead thread.
+
+ @param SearchPath Pointer to the search path.
+
+ @return TRUE if the search path is queued or already outstanding, FALSE if
+         it could not be queued, typically because the limit of outstanding
+         listings has been reached.
+ */
+__success(return)
+BOOL
+YoriLibFileEnumReadAheadSearchPath(
+    __in PYORI_STRING SearchPath
+    )
+{
+    PYORILIB_FILEENUM_READAHEAD ReadAhead;
+    PYORILIB_FILEENUM_LISTING Listing;
+
+    ReadAhead = YoriLibFileEnumReadAheadState;
+    if (ReadAhead == NULL ||
+        ReadAhead->WorkPool.ItemsOutstanding >= ReadAhead->MaxListings) {
+
+        return FALSE;
+    }
+
+    //
+    //  Only the enumerating thread inserts into or removes from the hash
+    //  table, so it can be searched without holding the mutex.
+    //
+
+    if (YoriLibHashLookupByKey(ReadAhead->Listings, SearchPath) != NULL) {
+        return TRUE;
+    }
+
+    Listing = YoriLibFileEnumAllocateListing(SearchPath);
+    if (Listing == NULL) {
+        return FALSE;
+    }
+
+    if (!YoriLibWorkPoolQueueItem(&ReadAhead->WorkPool, &Listing->WorkItem)) {
+        YoriLibFileEnumFreeListing(Listing);
+        return FALSE;
+    }
+
+    YoriLibHashInsertByKey(ReadAhead->Listings, &Listing->SearchPath, Listing, &Listing->HashEntry);
+    return TRUE;
+}
+
+/**
+ Obtain the listing for a fully qualified search path.  If a read ahead
+ thread has read it, it is returned immediately; if a read ahead thread is
+ reading it, this waits for it to complete; if it is queued but not yet
+ started, or was never queued, it is read on this thread.
+
+ @param SearchPath Pointer to the NULL terminated search path.
+
+ @return Pointer to the listing, which the caller should free with
+         @ref YoriLibFileEnumFreeListing , or NULL on allocation failure.
+ */
+PYORILIB_FILEENUM_LISTING
+YoriLibFileEnumGetListing(
+    __in PYORI_STRING SearchPath
+    )
+{
+    PYORILIB_FILEENUM_READAHEAD ReadAhead;
+    PYORILIB_FILEENUM_LISTING Listing;
+    PYORI_HASH_ENTRY HashEntry;
+    BOOLEAN ReadOnThisThread;
+
+    ReadAhead = YoriLibFileEnumReadAheadState;
+    Listing = NULL;
+    ReadOnThisThread = TRUE;
+
+    //
+    //  The hash table compares keys without regard to case, but
+    //  directories may be case sensitive, so only use a listing whose
+    //  search path matches exactly.
+    //
+
+    if (ReadAhead != NULL) {
+        HashEntry = YoriLibHashLookupByKey(ReadAhead->Listings, SearchPath);
+        if (HashEntry != NULL) {
+            Listing = HashEntry->Context;
+            if (YoriLibCompareString(&Listing->SearchPath, SearchPath) != 0) {
+                Listing = NULL;
+            }
+        }
+    }
+
+    if (Listing != NULL) {
+        if (YoriLibWorkPoolTakeItem(&ReadAhead->WorkPool, &Listing->WorkItem)) {
+            ReadOnThisThread = FALSE;
+        }
+        YoriLibHashRemoveByEntry(&Listing->HashEntry);
+    } else {
+        Listing = YoriLibFileEnumAllocateListing(SearchPath);
+        if (Listing == NULL) {
+            return NULL;
+        }
+    }
+
+    if (ReadOnThisThread) {
+        YoriLibFileEnumPopulateListing(Listing);
+    }
+
+    return Listing;
+}
+
+/**
+ Determine the fully qualified directory containing the objects described
+ by a file specification, and the offset of the component to match within
+ that directory.
+
+ @param FileSpec The file specification.
+
+ @param CharsToFinalSlash On successful completion, the number of characters
+        in FileSpec up to and including the final separator.  This is only
+        meaningful if FinalSlashFound is TRUE.
+
+ @param FinalSlashFound On successful completion, set to TRUE if FileSpec
+        contains a directory component.
+
+ @param ParentFullPath On successful completion, populated with a newly
+        allocated fully qualified path to the parent directory, without a
+        trailing separator.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibFileEnumResolveParent(
+    __in PYORI_STRING FileSpec,
+    __out PDWORD CharsToFinalSlash,
+    __out PBOOLEAN FinalSlashFound,
+    __out PYORI_STRING ParentFullPath
+    )
+{
+    DWORD CharIndex;
+    BOOLEAN SlashFound;
+
+    //
+    //  See if the search criteria contains a path as well as a search
+    //  specification.  If so, remember this point, since we'll need to
+    //  reassemble combined paths in response to each match.
+    //
+
+    CharIndex = FileSpec->LengthInChars;
+    SlashFound = FALSE;
+    while (CharIndex > 0) {
+        CharIndex--;
+        if (YoriLibIsSep(FileSpec->StartOfString[CharIndex])) {
+            CharIndex++;
+            SlashFound = TRUE;
+            break;
+        }
+
+        //
+        //  If it's x:foobar treat the ':' as the final slash, so any future
+        //  criteria is applied after it.  Note this is ambiguous as it could
+        //  be a stream, so this is scoped specifically to the single letter
+        //  case.
+        //
+
+        if (CharIndex == 1 &&
+            YoriLibIsDriveLetterWithColon(FileSpec)) {
+
+            CharIndex++;
+            SlashFound = TRUE;
+            break;
+        }
+    }
+
+    YoriLibInitEmptyString(ParentFullPath);
+
+    if (SlashFound) {
+        YORI_STRING DirectoryPart;
+
+        YoriLibInitEmptyString(&DirectoryPart);
+        DirectoryPart.StartOfString = FileSpec->StartOfString;
+        DirectoryPart.LengthInChars = CharIndex;
+
+        //
+        //  Trim trailing slashes, except if the string is just a slash, in
+        //  which case it's meaningful.
+        //
+        //  MSFIX This really wants to apply all the EffectiveRoot logic.
+        //
+
+        if ((DirectoryPart.LengthInChars > 3 ||
+             !YoriLibIsDriveLetterWithColonAndSlash(&DirectoryPart)) &&
+            DirectoryPart.LengthInChars > 1 &&
+            YoriLibIsSep(DirectoryPart.StartOfString[DirectoryPart.LengthInChars - 1])) {
+
+            DirectoryPart.LengthInChars--;
+        }
+
+        if (!YoriLibGetFullPathNameReturnAllocation(&DirectoryPart, TRUE, ParentFullPath, NULL)) {
+            return FALSE;
+        }
+
+    } else {
+        YORI_STRING ThisDir;
+        YoriLibConstantString(&ThisDir, _T("."));
+        if (!YoriLibGetFullPathNameReturnAllocation(&ThisDir, TRUE, ParentFullPath, NULL)) {
+            return FALSE;
+        }
+    }
+
+    //
+    //  If the result ends with a \, truncate it since all children we
+    //  report will unconditionally have a \ inserted between their name
+    //  and the parent.  This result will happen with X:\ type paths.
+    //
+
+    if (ParentFullPath->LengthInChars > 0 &&
+        YoriLibIsSep(ParentFullPath->StartOfString[ParentFullPath->LengthInChars - 1])) {
+
+        ParentFullPath->LengthInChars--;
+        ParentFullPath->StartOfString[ParentFullPath->LengthInChars] = '\0';
+    }
+
+    *CharsToFinalSlash = CharIndex;
+    *FinalSlashFound = SlashFound;
+    return TRUE;
+}
+
+/**
+ Queue a file specification to be read by a read ahead thread, so that a
+ later enumerate of the same file specification specifying
+ @ref YORILIB_FILEENUM_PARALLEL can use the result without waiting for the
+ system.  This is only meaningful between calls to
+ @ref YoriLibFileEnumStartReadAhead and @ref YoriLibFileEnumEndReadAhead ,
+ and only for file specifications which do not require expansion.
+
+ @param FileSpec The file specification which will later be enumerated.
+
+ @return TRUE if the file specification is queued or already outstanding,
+         FALSE if it could not be queued, typically because the limit of
+         outstanding listings has been reached.  The caller may try again
+         after consuming listings.
+ */
+__success(return)
+BOOL
+YoriLibFileEnumReadAhead(
+    __in PYORI_STRING FileSpec
+    )
+{
+    YORI_STRING ParentFullPath;
+    YORI_STRING SearchPath;
+    DWORD CharsToFinalSlash;
+    BOOLEAN FinalSlashFound;
+    BOOL Result;
+
+    if (YoriLibFileEnumReadAheadState == NULL ||
+        YoriLibFileEnumReadAheadState->WorkPool.ItemsOutstanding >= YoriLibFileEnumReadAheadState->MaxListings) {
+
+        return FALSE;
+    }
+
+    if (!YoriLibFileEnumResolveParent(FileSpec, &CharsToFinalSlash, &FinalSlashFound, &ParentFullPath)) {
+        return FALSE;
+    }
+
+    if (!FinalSlashFound) {
+        CharsToFinalSlash = 0;
+    }
+
+    if (!YoriLibAllocateString(&SearchPath, ParentFullPath.LengthInChars + 1 + FileSpec->LengthInChars - CharsToFinalSlash + 1)) {
+        YoriLibFreeStringContents(&ParentFullPath);
+        return FALSE;
+    }
+
+    SearchPath.LengthInChars = YoriLibSPrintfS(SearchPath.StartOfString, SearchPath.LengthAllocated, _T("%y\\%s"), &ParentFullPath, &FileSpec->StartOfString[CharsToFinalSlash]);
+
+    Result = YoriLibFileEnumReadAheadSearchPath(&SearchPath);
+    YoriLibFreeStringContents(&SearchPath);
+    YoriLibFreeStringContents(&ParentFullPath);
+    return Result;
+}
+
+/**
+ Queue subdirectories in the listing being processed to be read ahead of
+ when the enumerate recurses into them.  This continues from the last
+ subdirectory queued until the limit of outstanding listings is reached,
+ and is called each time the enumerate recurses so the read ahead threads
+ stay busy.
+
+ @param ForEachContext Pointer to the enumerate context.
+
+ @param MatchFlags The flags for the enumerate.
+
+ @param FinalSlashFound TRUE if the enumerate's file specification has a
+        directory component.
+ */
+VOID
+YoriLibFileEnumReadAheadSubdirectories(
+    __in PYORILIB_FOREACHFILE_CONTEXT ForEachContext,
+    __in DWORD MatchFlags,
+    __in BOOLEAN FinalSlashFound
+    )
+{
+    PYORILIB_FILEENUM_LISTING Listing;
+    PWIN32_FIND_DATA Entry;
+    YORI_STRING Wild;
+    YORI_STRING SearchPath;
+    YORI_STRING AllWild;
+    PYORI_STRING FirstWild;
+    PYORI_STRING SecondWild;
+
+    Listing = ForEachContext->Listing;
+    if (Listing == NULL) {
+        return;
+    }
+
+    //
+    //  A subdirectory is enumerated with the same wild if it's preserved,
+    //  or * if not.  If the subdirectory needs to be recursed, it is also
+    //  enumerated with * to find its subdirectories.  Queue whichever will
+    //  be needed first ahead of the other.
+    //
+
+    YoriLibConstantString(&AllWild, _T("*"));
+    if ((MatchFlags & YORILIB_FILEENUM_RECURSE_PRESERVE_WILD) != 0) {
+        YoriLibInitEmptyString(&Wild);
+        if (FinalSlashFound) {
+            Wild.StartOfString = &ForEachContext->EffectiveFileSpec.StartOfString[ForEachContext->CharsToFinalSlash];
+            Wild.LengthInChars = ForEachContext->EffectiveFileSpec.LengthInChars - ForEachContext->CharsToFinalSlash;
+        } else {
+            Wild.StartOfString = ForEachContext->EffectiveFileSpec.StartOfString;
+            Wild.LengthInChars = ForEachContext->EffectiveFileSpec.LengthInChars;
+        }
+    } else {
+        YoriLibConstantString(&Wild, _T("*"));
+    }
+
+    if ((MatchFlags & YORILIB_FILEENUM_RECURSE_BEFORE_RETURN) != 0) {
+        FirstWild = &AllWild;
+        SecondWild = &Wild;
+    } else {
+        FirstWild = &Wild;
+        SecondWild = &AllWild;
+    }
+
+    if (!YoriLibAllocateString(&SearchPath, ForEachContext->ParentFullPath.LengthInChars + 1 + sizeof(Entry->cFileName) / sizeof(TCHAR) + 1 + Wild.LengthInChars + AllWild.LengthInChars + 1)) {
+        return;
+    }
+
+    if (ForEachContext->ReadAheadIndex < ForEachContext->ListingIndex) {
+        ForEachContext->ReadAheadIndex = ForEachContext->ListingIndex;
+    }
+
+    for (; ForEachContext->ReadAheadIndex < Listing->EntryCount; ForEachContext->ReadAheadIndex++) {
+        Entry = &Listing->Entries[ForEachContext->ReadAheadIndex];
+
+        if ((Entry->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 ||
+            _tcscmp(Entry->cFileName, _T(".")) == 0 ||
+            _tcscmp(Entry->cFileName, _T("..")) == 0) {
+
+            continue;
+        }
+
+        if ((MatchFlags & YORILIB_FILEENUM_NO_LINK_TRAVERSE) != 0 &&
+            (Entry->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 &&
+            (Entry->dwReserved0 == IO_REPARSE_TAG_MOUNT_POINT ||
+             Entry->dwReserved0 == IO_REPARSE_TAG_SYMLINK)) {
+
+            continue;
+        }
+
+        SearchPath.LengthInChars = YoriLibSPrintfS(SearchPath.StartOfString, SearchPath.LengthAllocated, _T("%y\\%s\\%y"), &ForEachContext->ParentFullPath, Entry->cFileName, FirstWild);
+        if (!YoriLibFileEnumReadAheadSearchPath(&SearchPath)) {
+            break;
+        }
+
+        SearchPath.LengthInChars = YoriLibSPrintfS(SearchPath.StartOfString, SearchPath.LengthAllocated, _T("%y\\%s\\%y"), &ForEachContext->ParentFullPath, Entry->cFileName, SecondWild);
+        YoriLibFileEnumReadAheadSearchPath(&SearchPath);
+    }
+
+    YoriLibFreeStringContents(&SearchPath);
+}
+
+/**
+ Find the first object matching the search path in ForEachContext->FullPath.
+ If the enumerate is reading ahead, this obtains a listing; otherwise, it
+ asks the system directly.
+
+ @param ForEachContext Pointer to the enumerate context.  On success, the
+        FileInfo member is populated with the first object found.
+
+ @param MatchFlags The flags for the enumerate.
+
+ @return A find handle to continue enumerating from the system;
+         INVALID_HANDLE_VALUE if no object was found, with the error
+         available from GetLastError; or NULL if the object is not from a
+         system enumerate, such as a volume root or a listing.
+ */
+HANDLE
+YoriLibFileEnumFindFirst(
+    __in PYORILIB_FOREACHFILE_CONTEXT ForEachContext,
+    __in DWORD MatchFlags
+    )
+{
+    HANDLE hFind;
+
+    if ((MatchFlags & YORILIB_FILEENUM_PARALLEL) != 0 &&
+        YoriLibFileEnumReadAheadState != NULL) {
+
+        //
+        //  When both phases of a recursive enumerate use the same search
+        //  path, reuse the listing from the first phase.
+        //
+
+        if (ForEachContext->Listing != NULL &&
+            YoriLibCompareString(&ForEachContext->Listing->SearchPath, &ForEachContext->FullPath) != 0) {
+
+            YoriLibFileEnumFreeListing(ForEachContext->Listing);
+            ForEachContext->Listing = NULL;
+        }
+
+        if (ForEachContext->Listing == NULL) {
+            ForEachContext->Listing = YoriLibFileEnumGetListing(&ForEachContext->FullPath);
+            if (ForEachContext->Listing == NULL) {
+                SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+                return INVALID_HANDLE_VALUE;
+            }
+        }
+
+        ForEachContext->ReadAheadIndex = 0;
+        if (ForEachContext->Listing->EntryCount == 0) {
+            SetLastError(ForEachContext->Listing->Error);
+            return INVALID_HANDLE_VALUE;
+        }
+
+        memcpy(&ForEachContext->FileInfo, &ForEachContext->Listing->Entries[0], sizeof(WIN32_FIND_DATA));
+        ForEachContext->ListingIndex = 1;
+        return NULL;
+    }
+
+    hFind = FindFirstFile(ForEachContext->FullPath.StartOfString, &ForEachContext->FileInfo);
+
+    //
+    //  If we can't enumerate it because it's a volume root, cook up
+    //  the data by hand and set hFind to NULL to indicate that the
+    //  enumeration sort of worked.
+    //
+
+    if (hFind == INVALID_HANDLE_VALUE) {
+        if ((ForEachContext->FullPath.LengthInChars == 3 && YoriLibIsDriveLetterWithColonAndSlash(&ForEachContext->FullPath)) ||
+            (ForEachContext->FullPath.LengthInChars == 7 && YoriLibIsPrefixedDriveLetterWithColonAndSlash(&ForEachContext->FullPath))) {
+
+            if (YoriLibUpdateFindDataFromFileInformation(&ForEachContext->FileInfo, ForEachContext->FullPath.StartOfString, FALSE)) {
+                ForEachContext->FileInfo.cFileName[0] = '\0';
+                ForEachContext->FileInfo.cAlternateFileName[0] = '\0';
+                hFind = NULL;
+            }
+        }
+    }
+
+    return hFind;
+}
+
+/**
+ Find the next object after one returned by @ref YoriLibFileEnumFindFirst .
+
+ @param ForEachContext Pointer to the enumerate context.  On success, the
+        FileInfo member is populated with the next object found.
+
+ @param hFind The handle returned from @ref YoriLibFileEnumFindFirst .
+
+ @return TRUE if another object was found, FALSE if not.
+ */
+__success(return)
+BOOL
+YoriLibFileEnumFindNext(
+    __in PYORILIB_FOREACHFILE_CONTEXT ForEachContext,
+    __in HANDLE hFind
+    )
+{
+    if (ForEachContext->Listing != NULL) {
+        if (ForEachContext->ListingIndex >= ForEachContext->Listing->EntryCount) {
+            return FALSE;
+        }
+        memcpy(&ForEachContext->FileInfo, &ForEachContext->Listing->Entries[ForEachContext->ListingIndex], sizeof(WIN32_FIND_DATA));
+        ForEachContext->ListingIndex++;
+        return TRUE;
+    }
+
+    if (hFind == INVALID_HANDLE_VALUE || hFind == NULL) {
+        return FALSE;
+    }
+
+    return FindNextFile(hFind, &ForEachContext->FileInfo);
+}
+
 /**
  Call a callback for every file matching a specified file pattern.
 
@@ -128,6 +966,7 @@ YoriLibForEachFileEnum(
     BOOLEAN Result;
     BOOLEAN RecursePhase;
     BOOLEAN IsLink;
+    BOOLEAN ReadAheadStarted;
     PYORILIB_FOREACHFILE_CONTEXT ForEachContext = NULL;
 
     Result = TRUE;
@@ -142,6 +981,7 @@ YoriLibForEachFileEnum(
         return FALSE;
     }
     YoriLibInitEmptyString(&ForEachContext->RecurseCriteria);
+    ForEachContext->Listing = NULL;
 
     //
     //  This is currently only needed for the GetFileAttributes call.  It may
@@ -218,100 +1058,35 @@ YoriLibForEachFileEnum(
         }
     }
 
-    //
-    //  See if the search criteria contains a path as well as a search
-    //  specification.  If so, remember this point, since we'll need to
-    //  reassemble combined paths in response to each match.
-    //
-
-    ForEachContext->CharsToFinalSlash = ForEachContext->EffectiveFileSpec.LengthInChars;
-    FinalSlashFound = FALSE;
-    while (ForEachContext->CharsToFinalSlash > 0) {
-        ForEachContext->CharsToFinalSlash--;
-        if (YoriLibIsSep(ForEachContext->EffectiveFileSpec.StartOfString[ForEachContext->CharsToFinalSlash])) {
-            ForEachContext->CharsToFinalSlash++;
-            FinalSlashFound = TRUE;
-            break;
-        }
-
-        //
-        //  If it's x:foobar treat the ':' as the final slash, so any future
-        //  criteria is applied after it.  Note this is ambiguous as it could
-        //  be a stream, so this is scoped specifically to the single letter
-        //  case.
-        //
-
-        if (ForEachContext->CharsToFinalSlash == 1 &&
-            YoriLibIsDriveLetterWithColon(&ForEachContext->EffectiveFileSpec)) {
-
-            ForEachContext->CharsToFinalSlash++;
-            FinalSlashFound = TRUE;
-            break;
-        }
-    }
-
     ForEachContext->NumberPhases = 1;
     if ((MatchFlags & (YORILIB_FILEENUM_RECURSE_AFTER_RETURN | YORILIB_FILEENUM_RECURSE_BEFORE_RETURN)) != 0) {
         ForEachContext->NumberPhases++;
     }
 
-    YoriLibInitEmptyString(&ForEachContext->ParentFullPath);
-
-    if (FinalSlashFound) {
-        YORI_STRING DirectoryPart;
-
-        YoriLibInitEmptyString(&DirectoryPart);
-        DirectoryPart.StartOfString = ForEachContext->EffectiveFileSpec.StartOfString;
-        DirectoryPart.LengthInChars = ForEachContext->CharsToFinalSlash;
-
-        //
-        //  Trim trailing slashes, except if the string is just a slash, in
-        //  which case it's meaningful.
-        //
-        //  MSFIX This really wants to apply all the EffectiveRoot logic.
-        //
-
-        if ((DirectoryPart.LengthInChars > 3 ||
-             !YoriLibIsDriveLetterWithColonAndSlash(&DirectoryPart)) &&
-            DirectoryPart.LengthInChars > 1 &&
-            YoriLibIsSep(DirectoryPart.StartOfString[DirectoryPart.LengthInChars - 1])) {
-
-            DirectoryPart.LengthInChars--;
-        }
-
-        if (!YoriLibGetFullPathNameReturnAllocation(&DirectoryPart, TRUE, &ForEachContext->ParentFullPath, NULL)) {
-            YoriLibFreeStringContents(&ForEachContext->EffectiveFileSpec);
-            YoriLibFree(ForEachContext);
-            return FALSE;
-        }
+    if (!YoriLibFileEnumResolveParent(&ForEachContext->EffectiveFileSpec, &ForEachContext->CharsToFinalSlash, &FinalSlashFound, &ForEachContext->ParentFullPath)) {
+        YoriLibFreeStringContents(&ForEachContext->EffectiveFileSpec);
+        YoriLibFree(ForEachContext);
+        return FALSE;
+    }
 
-    } else {
-        YORI_STRING ThisDir;
-        YoriLibConstantString(&ThisDir, _T("."));
-        if (!YoriLibGetFullPathNameReturnAllocation(&ThisDir, TRUE, &ForEachContext->ParentFullPath, NULL)) {
-            YoriLibFreeStringContents(&ForEachContext->EffectiveFileSpec);
-            YoriLibFree(ForEachContext);
-            return FALSE;
-        }
+    if (!YoriLibAllocateString(&ForEachContext->FullPath, ForEachContext->ParentFullPath.LengthInChars + 1 + sizeof(ForEachContext->FileInfo.cFileName) / sizeof(TCHAR) + 1)) {
+        YoriLibFreeStringContents(&ForEachContext->EffectiveFileSpec);
+        YoriLibFreeStringContents(&ForEachContext->ParentFullPath);
+        YoriLibFree(ForEachContext);
+        return FALSE;
     }
 
     //
-    //  If the result ends with a \, truncate it since all children we
-    //  report will unconditionally have a \ inserted between their name
-    //  and the parent.  This result will happen with X:\ type paths.
+    //  If the caller asked for a parallel recursive enumerate, start reading
+    //  directories ahead of when they are needed.  Nested enumerates share
+    //  the same read ahead state.
     //
 
-    if (ForEachContext->ParentFullPath.LengthInChars > 0 &&
-        YoriLibIsSep(ForEachContext->ParentFullPath.StartOfString[ForEachContext->ParentFullPath.LengthInChars - 1])) {
+    ReadAheadStarted = FALSE;
+    if ((MatchFlags & YORILIB_FILEENUM_PARALLEL) != 0 &&
+        ForEachContext->NumberPhases > 1) {
 
-        ForEachContext->ParentFullPath.LengthInChars--;
-        ForEachContext->ParentFullPath.StartOfString[ForEachContext->ParentFullPath.LengthInChars] = '\0';
-    }
-
-    if (!YoriLibAllocateString(&ForEachContext->FullPath, ForEachContext->ParentFullPath.LengthInChars + 1 + sizeof(ForEachContext->FileInfo.cFileName) / sizeof(TCHAR) + 1)) {
-        YoriLibFreeStringContents(&ForEachContext->EffectiveFileSpec);
-        YoriLibFree(ForEachContext);
-        return FALSE;
+        ReadAheadStarted = (BOOLEAN)YoriLibFileEnumStartReadAhead();
     }
 
     for (ForEachContext->CurrentPhase = 0; ForEachContext->CurrentPhase < ForEachContext->NumberPhases; ForEachContext->CurrentPhase++) {
@@ -341,34 +1116,14 @@ YoriLibForEachFileEnum(
             (MatchFlags & YORILIB_FILEENUM_RECURSE_PRESERVE_WILD) != 0) {
 
             ForEachContext->FullPath.LengthInChars = YoriLibSPrintfS(ForEachContext->FullPath.StartOfString, ForEachContext->FullPath.LengthAllocated, _T("%y\\*"), &ForEachContext->ParentFullPath);
-            hFind = FindFirstFile(ForEachContext->FullPath.StartOfString, &ForEachContext->FileInfo);
+        } else if (FinalSlashFound) {
+            ForEachContext->FullPath.LengthInChars = YoriLibSPrintfS(ForEachContext->FullPath.StartOfString, ForEachContext->FullPath.LengthAllocated, _T("%y\\%s"), &ForEachContext->ParentFullPath, &ForEachContext->EffectiveFileSpec.StartOfString[ForEachContext->CharsToFinalSlash]);
         } else {
-            if (FinalSlashFound) {
-                ForEachContext->FullPath.LengthInChars = YoriLibSPrintfS(ForEachContext->FullPath.StartOfString, ForEachContext->FullPath.LengthAllocated, _T("%y\\%s"), &ForEachContext->ParentFullPath, &ForEachContext->EffectiveFileSpec.StartOfString[ForEachContext->CharsToFinalSlash]);
-            } else {
-                ForEachContext->FullPath.LengthInChars = YoriLibSPrintfS(ForEachContext->FullPath.StartOfString, ForEachContext->FullPath.LengthAllocated, _T("%y\\%y"), &ForEachContext->ParentFullPath, &ForEachContext->EffectiveFileSpec);
-            }
-            hFind = FindFirstFile(ForEachContext->FullPath.StartOfString, &ForEachContext->FileInfo);
-
-            //
-            //  If we can't enumerate it because it's a volume root, cook up
-            //  the data by hand and set hFind to NULL to indicate that the
-            //  enumeration sort of worked.
-            //
-
-            if (hFind == INVALID_HANDLE_VALUE) {
-                if ((ForEachContext->FullPath.LengthInChars == 3 && YoriLibIsDriveLetterWithColonAndSlash(&ForEachContext->FullPath)) ||
-                    (ForEachContext->FullPath.LengthInChars == 7 && YoriLibIsPrefixedDriveLetterWithColonAndSlash(&ForEachContext->FullPath))) {
-
-                    if (YoriLibUpdateFindDataFromFileInformation(&ForEachContext->FileInfo, ForEachContext->FullPath.StartOfString, FALSE)) {
-                        ForEachContext->FileInfo.cFileName[0] = '\0';
-                        ForEachContext->FileInfo.cAlternateFileName[0] = '\0';
-                        hFind = NULL;
-                    }
-                }
-            }
+            ForEachContext->FullPath.LengthInChars = YoriLibSPrintfS(ForEachContext->FullPath.StartOfString, ForEachContext->FullPath.LengthAllocated, _T("%y\\%y"), &ForEachContext->ParentFullPath, &ForEachContext->EffectiveFileSpec);
         }
 
+        hFind = YoriLibFileEnumFindFirst(ForEachContext, MatchFlags);
+
         if (hFind == INVALID_HANDLE_VALUE) {
             if (ErrorCallback != NULL) {
                 if (!ErrorCallback(&ForEachContext->FullPath, GetLastError(), Depth, Context)) {
@@ -483,6 +1238,8 @@ YoriLibForEachFileEnum(
                         ForEachContext->RecurseCriteria.StartOfString[ForEachContext->RecurseCriteria.LengthInChars] = '\0';
                     }
 
+                    YoriLibFileEnumReadAheadSubdirectories(ForEachContext, MatchFlags, FinalSlashFound);
+
                     if (!YoriLibForEachFileEnum(&ForEachContext->RecurseCriteria, MatchFlags, Depth + 1, Callback, ErrorCallback, Context)) {
                         Result = FALSE;
                         break;
@@ -516,7 +1273,7 @@ YoriLibForEachFileEnum(
                     }
                 }
 
-            } while (hFind != INVALID_HANDLE_VALUE && hFind != NULL && FindNextFile(hFind, &ForEachContext->FileInfo));
+            } while (YoriLibFileEnumFindNext(ForEachContext, hFind));
 
             YoriLibFreeStringContents(&ForEachContext->RecurseCriteria);
 
@@ -530,6 +1287,14 @@ YoriLibForEachFileEnum(
         }
     }
 
+    if (ForEachContext->Listing != NULL) {
+        YoriLibFileEnumFreeListing(ForEachContext->Listing);
+    }
+
+    if (ReadAheadStarted) {
+        YoriLibFileEnumEndReadAhead();
+    }
+
     YoriLibFreeStringContents(&ForEachContext->EffectiveFileSpec);
     YoriLibFreeStringContents(&ForEachContext->ParentFullPath);
     YoriLibFreeStringContents(&ForEachContext->FullPath);
@@ -597,6 +597,7 @@ YoriLibFileFiltParseFilterStringInternal(
     DWORD ElementCount;
     DWORD Index;
     DWORD Phase;
+    DWORD CollectAccess;
 
     ASSERT(AllocationSize >= sizeof(YORI_LIB_FILE_FILT_MATCH_CRITERIA));
 
@@ -605,6 +606,7 @@ YoriLibFileFiltParseFilterStringInternal(
     YoriLibInitEmptyString(ErrorSubstring);
 
     ElementCount = 0;
+    CollectAccess = 0;
     for (Phase = 0; Phase < 2; Phase++) {
         Remaining.StartOfString = FilterString->StartOfString;
         Remaining.LengthInChars = FilterString->LengthInChars;
@@ -647,6 +649,15 @@ YoriLibFileFiltParseFilterStringInternal(
                             }
                         }
                     }
+
+                    //
+                    //  Record the access needed to open each file so all of
+                    //  the remaining collectors can share one handle.
+                    //
+
+                    if (ThisElement->CollectFn != NULL) {
+                        CollectAccess |= YoriLibGetFileCollectAccess(ThisElement->CollectFn);
+                    }
                 }
                 ElementCount++;
             }
@@ -682,6 +693,7 @@ YoriLibFileFiltParseFilterStringInternal(
     Filter->Criteria = Criteria;
     Filter->ElementSize = AllocationSize;
     Filter->NumberCriteria = ElementCount;
+    Filter->CollectAccess = CollectAccess;
     return TRUE;
 }
 
@@ -763,7 +775,9 @@ YoriLibFileFiltCheckFilterMatch(
     )
 {
     DWORD Count;
+    BOOL Result;
     YORI_FILE_INFO CompareEntry;
+    YORI_LIB_FILE_COLLECT_CONTEXT CollectContext;
     PYORI_LIB_FILE_FILT_MATCH_CRITERIA CriteriaArray;
     PYORI_LIB_FILE_FILT_MATCH_CRITERIA Criteria;
     
@@ -772,22 +786,27 @@ YoriLibFileFiltCheckFilterMatch(
     }
 
     ZeroMemory(&CompareEntry, sizeof(CompareEntry));
+    YoriLibInitFileCollectContext(&CollectContext, Filter->CollectAccess);
 
+    Result = TRUE;
     CriteriaArray = (PYORI_LIB_FILE_FILT_MATCH_CRITERIA)Filter->Criteria;
     for (Count = 0; Count < Filter->NumberCriteria; Count++) {
         Criteria = &CriteriaArray[Count];
         if (Criteria->CollectFn != NULL &&
-            !Criteria->CollectFn(&CompareEntry, FileInfo, FilePath)) {
+            !Criteria->CollectFn(&CompareEntry, FileInfo, FilePath, &CollectContext)) {
 
-            return FALSE;
+            Result = FALSE;
+            break;
         }
 
         if (!Criteria->TruthStates[Criteria->CompareFn(&CompareEntry, &Criteria->CompareEntry)]) {
-            return FALSE;
+            Result = FALSE;
+            break;
         }
     }
 
-    return TRUE;
+    YoriLibResetFileCollectContext(&CollectContext);
+    return Result;
 }
 
 /**
@@ -823,8 +842,11 @@ YoriLibFileFiltCheckColorMatch(
     PYORI_LIB_FILE_FILT_COLOR_CRITERIA ThisApply;
     PYORI_LIB_FILE_FILT_COLOR_CRITERIA ColorsToApply;
     YORI_FILE_INFO CompareEntry;
+    YORI_LIB_FILE_COLLECT_CONTEXT CollectContext;
+    BOOL Result;
 
     ZeroMemory(&CompareEntry, sizeof(CompareEntry));
+    YoriLibInitFileCollectContext(&CollectContext, Filter->CollectAccess);
 
     ThisAttribute.Ctrl = YORILIB_ATTRCTRL_WINDOW_BG | YORILIB_ATTRCTRL_WINDOW_FG;
     ThisAttribute.Win32Attr = 0;
@@ -846,9 +868,10 @@ YoriLibFileFiltCheckColorMatch(
         ThisApply = &ColorsToApply[Index];
 
         if (ThisApply->Match.CollectFn != NULL &&
-            !ThisApply->Match.CollectFn(&CompareEntry, FileInfo, FilePath)) {
+            !ThisApply->Match.CollectFn(&CompareEntry, FileInfo, FilePath, &CollectContext)) {
 
-            return FALSE;
+            Result = FALSE;
+            goto Exit;
         }
 
         if (ThisApply->Match.TruthStates[ThisApply->Match.CompareFn(&CompareEntry, &ThisApply->Match.CompareEntry)]) {
@@ -864,7 +887,8 @@ YoriLibFileFiltCheckColorMatch(
 
                 Attribute->Ctrl = ThisAttribute.Ctrl;
                 Attribute->Win32Attr = ThisAttribute.Win32Attr;
-                return TRUE;
+                Result = TRUE;
+                goto Exit;
             }
 
             ThisAttribute.Ctrl = (UCHAR)(ThisAttribute.Ctrl & ~(YORILIB_ATTRCTRL_CONTINUE));
@@ -881,12 +905,15 @@ YoriLibFileFiltCheckColorMatch(
 
         Attribute->Ctrl = ThisAttribute.Ctrl;
         Attribute->Win32Attr = ThisAttribute.Win32Attr;
-        return TRUE;
+    } else {
+        Attribute->Ctrl = PreviousAttributes.Ctrl;
+        Attribute->Win32Attr = PreviousAttributes.Win32Attr;
     }
+    Result = TRUE;
 
-    Attribute->Ctrl = PreviousAttributes.Ctrl;
-    Attribute->Win32Attr = PreviousAttributes.Win32Attr;
-    return TRUE;
+Exit:
+    YoriLibResetFileCollectContext(&CollectContext);
+    return Result;
 }
 
 /**
@@ -906,6 +933,7 @@ YoriLibFileFiltFreeFilter(
     }
     Filter->Criteria = NULL;
     Filter->NumberCriteria = 0;
+    Filter->CollectAccess = 0;
 }
 
 // vim:sw=4:ts=4:et:
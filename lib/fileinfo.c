@@ -162,6 +162,465 @@ YoriLibCopyFileName(
     return TRUE;
 }
 
+/**
+ Prepare a collection context for use against a series of files.
+
+ @param Context Pointer to the context to initialize.
+
+ @param DesiredAccess The access to each file that the collection functions
+        using this context require.  This is obtained by combining the
+        result of YoriLibGetFileCollectAccess for each function.  Supplying
+        it allows each file to be opened once with all of the access needed.
+ */
+VOID
+YoriLibInitFileCollectContext(
+    __out PYORI_LIB_FILE_COLLECT_CONTEXT Context,
+    __in DWORD DesiredAccess
+    )
+{
+    Context->DesiredAccess = DesiredAccess;
+    Context->HandleAccess = 0;
+    Context->FailedAccess = 0;
+    Context->QueriedFlags = 0;
+    Context->ValidFlags = 0;
+    Context->FileHandle = INVALID_HANDLE_VALUE;
+    Context->VersionInfo = NULL;
+    Context->SecurityDescriptor = NULL;
+}
+
+/**
+ Release any state cached in a collection context about a file, allowing the
+ context to be used for another file.  The access supplied when the context
+ was initialized is retained.
+
+ @param Context Pointer to the context to reset.
+ */
+VOID
+YoriLibResetFileCollectContext(
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
+    )
+{
+    if (Context->FileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(Context->FileHandle);
+        Context->FileHandle = INVALID_HANDLE_VALUE;
+    }
+
+    if (Context->VersionInfo != NULL) {
+        YoriLibFree(Context->VersionInfo);
+        Context->VersionInfo = NULL;
+    }
+
+    if (Context->SecurityDescriptor != NULL &&
+        Context->SecurityDescriptor != (PSECURITY_DESCRIPTOR)Context->LocalSecurityDescriptor) {
+
+        YoriLibFree(Context->SecurityDescriptor);
+    }
+    Context->SecurityDescriptor = NULL;
+
+    Context->HandleAccess = 0;
+    Context->FailedAccess = 0;
+    Context->QueriedFlags = 0;
+    Context->ValidFlags = 0;
+}
+
+/**
+ Return a handle to the file being collected which has at least the
+ specified access.  If the file has not been opened, or was opened with
+ insufficient access, it is opened with the access the context was
+ initialized with so that later collection functions can share the handle.
+ The handle is owned by the context and must not be closed by the caller.
+
+ @param Context Pointer to the collection context.
+
+ @param FullPath Pointer to a string to the full file name.
+
+ @param Access The access that the caller requires.
+
+ @return A handle to the file, or INVALID_HANDLE_VALUE if the file could not
+         be opened with the requested access.
+ */
+HANDLE
+YoriLibGetFileCollectHandle(
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context,
+    __in PYORI_STRING FullPath,
+    __in DWORD Access
+    )
+{
+    HANDLE NewHandle;
+    DWORD NewAccess;
+
+    ASSERT(YoriLibIsStringNullTerminated(FullPath));
+
+    if (Context->FileHandle != INVALID_HANDLE_VALUE &&
+        (Context->HandleAccess & Access) == Access) {
+
+        return Context->FileHandle;
+    }
+
+    if (Context->FailedAccess != 0 &&
+        (Access & Context->FailedAccess) == Context->FailedAccess) {
+
+        return INVALID_HANDLE_VALUE;
+    }
+
+    NewAccess = Context->DesiredAccess | Context->HandleAccess | Access;
+    NewHandle = CreateFile(FullPath->StartOfString,
+                           NewAccess,
+                           FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
+                           NULL);
+
+    //
+    //  If the combined access can't be granted, try again with only the
+    //  access this caller needs.
+    //
+
+    if (NewHandle == INVALID_HANDLE_VALUE && NewAccess != Access) {
+        NewAccess = Access;
+        NewHandle = CreateFile(FullPath->StartOfString,
+                               NewAccess,
+                               FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                               NULL,
+                               OPEN_EXISTING,
+                               FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
+                               NULL);
+    }
+
+    if (NewHandle == INVALID_HANDLE_VALUE) {
+        if (Context->FailedAccess == 0 ||
+            (Context->FailedAccess & Access) == Access) {
+
+            Context->FailedAccess = Access;
+        }
+        return INVALID_HANDLE_VALUE;
+    }
+
+    if (Context->FileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(Context->FileHandle);
+    }
+
+    Context->FileHandle = NewHandle;
+    Context->HandleAccess = NewAccess;
+    return NewHandle;
+}
+
+/**
+ Return the information from GetFileInformationByHandle for the file being
+ collected, querying it if it has not been queried already.
+
+ @param Context Pointer to the collection context.
+
+ @param FullPath Pointer to a string to the full file name.
+
+ @return Pointer to the information, or NULL if it is not available.
+ */
+PBY_HANDLE_FILE_INFORMATION
+YoriLibGetFileCollectHandleInfo(
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context,
+    __in PYORI_STRING FullPath
+    )
+{
+    HANDLE hFile;
+
+    if ((Context->QueriedFlags & YORI_LIB_COLLECT_HANDLE_INFO) == 0) {
+        Context->QueriedFlags |= YORI_LIB_COLLECT_HANDLE_INFO;
+        hFile = YoriLibGetFileCollectHandle(Context, FullPath, FILE_READ_ATTRIBUTES);
+        if (hFile != INVALID_HANDLE_VALUE &&
+            GetFileInformationByHandle(hFile, &Context->HandleInfo)) {
+
+            Context->ValidFlags |= YORI_LIB_COLLECT_HANDLE_INFO;
+        }
+    }
+
+    if (Context->ValidFlags & YORI_LIB_COLLECT_HANDLE_INFO) {
+        return &Context->HandleInfo;
+    }
+    return NULL;
+}
+
+/**
+ Return the standard information for the file being collected, querying it
+ if it has not been queried already.
+
+ @param Context Pointer to the collection context.
+
+ @param FullPath Pointer to a string to the full file name.
+
+ @return Pointer to the information, or NULL if it is not available.
+ */
+PFILE_STANDARD_INFO
+YoriLibGetFileCollectStandardInfo(
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context,
+    __in PYORI_STRING FullPath
+    )
+{
+    HANDLE hFile;
+
+    if ((Context->QueriedFlags & YORI_LIB_COLLECT_STANDARD_INFO) == 0) {
+        Context->QueriedFlags |= YORI_LIB_COLLECT_STANDARD_INFO;
+        if (DllKernel32.pGetFileInformationByHandleEx != NULL) {
+            hFile = YoriLibGetFileCollectHandle(Context, FullPath, FILE_READ_ATTRIBUTES);
+            if (hFile != INVALID_HANDLE_VALUE &&
+                DllKernel32.pGetFileInformationByHandleEx(hFile, FileStandardInfo, &Context->StandardInfo, sizeof(Context->StandardInfo))) {
+
+                Context->ValidFlags |= YORI_LIB_COLLECT_STANDARD_INFO;
+            }
+        }
+    }
+
+    if (Context->ValidFlags & YORI_LIB_COLLECT_STANDARD_INFO) {
+        return &Context->StandardInfo;
+    }
+    return NULL;
+}
+
+/**
+ Load an executable's PE headers from an opened handle.
+
+ @param hFile Handle to the file, opened for read data access.
+
+ @param PeHeaders On successful completion, updated to point to the contents
+        of the executable's PE headers.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibCapturePeHeadersFromHandle (
+    __in HANDLE hFile,
+    __out PYORILIB_PE_HEADERS PeHeaders
+    )
+{
+    IMAGE_DOS_HEADER DosHeader;
+    DWORD BytesReturned;
+
+    SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
+
+    if (ReadFile(hFile, &DosHeader, sizeof(DosHeader), &BytesReturned, NULL) &&
+        BytesReturned == sizeof(DosHeader) &&
+        DosHeader.e_magic == IMAGE_DOS_SIGNATURE &&
+        DosHeader.e_lfanew != 0) {
+
+        SetFilePointer(hFile, DosHeader.e_lfanew, NULL, FILE_BEGIN);
+
+        if (ReadFile(hFile, PeHeaders, sizeof(YORILIB_PE_HEADERS), &BytesReturned, NULL) &&
+            BytesReturned == sizeof(YORILIB_PE_HEADERS) &&
+            PeHeaders->Signature == IMAGE_NT_SIGNATURE &&
+            PeHeaders->ImageHeader.SizeOfOptionalHeader >= FIELD_OFFSET(IMAGE_OPTIONAL_HEADER, Subsystem)) {
+
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ Helper function to load an executable's PE header for parsing.
+
+ @param FullPath Pointer to a string to the full file name.
+
+ @param PeHeaders On successful completion, updated to point to the contents
+        of the executable's PE headers.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibCapturePeHeaders (
+    __in PYORI_STRING FullPath,
+    __out PYORILIB_PE_HEADERS PeHeaders
+    )
+{
+    HANDLE hFileRead;
+    BOOL Result;
+
+    ASSERT(YoriLibIsStringNullTerminated(FullPath));
+
+    hFileRead = CreateFile(FullPath->StartOfString,
+                           FILE_READ_ATTRIBUTES|FILE_READ_DATA,
+                           FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_BACKUP_SEMANTICS,
+                           NULL);
+
+    if (hFileRead == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    Result = YoriLibCapturePeHeadersFromHandle(hFileRead, PeHeaders);
+    CloseHandle(hFileRead);
+    return Result;
+}
+
+/**
+ Return the PE headers of the file being collected, loading them if they
+ have not been loaded already.  This is used by multiple collection
+ functions whose data comes from a PE header.
+
+ @param Context Pointer to the collection context.
+
+ @param FindData The directory enumeration information.
+
+ @param FullPath Pointer to a string to the full file name.
+
+ @return Pointer to the PE headers, or NULL if the file is not an executable
+         or could not be read.
+ */
+PYORILIB_PE_HEADERS
+YoriLibGetFileCollectPeHeaders(
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context,
+    __in PWIN32_FIND_DATA FindData,
+    __in PYORI_STRING FullPath
+    )
+{
+    HANDLE hFile;
+
+    if ((Context->QueriedFlags & YORI_LIB_COLLECT_PE_HEADERS) == 0) {
+        Context->QueriedFlags |= YORI_LIB_COLLECT_PE_HEADERS;
+
+        //
+        //  The shared handle refers to a link rather than its target and
+        //  will not recall offline data, including cloud placeholders
+        //  whose data is recalled when read.  Executables are parsed
+        //  through links and recalled if needed, so these get their own
+        //  handle.
+        //
+
+        if (FindData->dwFileAttributes & (FILE_ATTRIBUTE_REPARSE_POINT | FILE_ATTRIBUTE_OFFLINE | FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS)) {
+            if (YoriLibCapturePeHeaders(FullPath, &Context->PeHeaders)) {
+                Context->ValidFlags |= YORI_LIB_COLLECT_PE_HEADERS;
+            }
+        } else {
+            hFile = YoriLibGetFileCollectHandle(Context, FullPath, FILE_READ_ATTRIBUTES|FILE_READ_DATA);
+            if (hFile != INVALID_HANDLE_VALUE &&
+                YoriLibCapturePeHeadersFromHandle(hFile, &Context->PeHeaders)) {
+
+                Context->ValidFlags |= YORI_LIB_COLLECT_PE_HEADERS;
+            }
+        }
+    }
+
+    if (Context->ValidFlags & YORI_LIB_COLLECT_PE_HEADERS) {
+        return &Context->PeHeaders;
+    }
+    return NULL;
+}
+
+/**
+ Return the version resource of the file being collected, loading it if it
+ has not been loaded already.
+
+ @param Context Pointer to the collection context.
+
+ @param FullPath Pointer to a string to the full file name.
+
+ @return Pointer to the version resource, or NULL if the file has no
+         version resource or it could not be loaded.  If this is not NULL,
+         version.dll functions are available to parse it.
+ */
+PVOID
+YoriLibGetFileCollectVersionInfo(
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context,
+    __in PYORI_STRING FullPath
+    )
+{
+    DWORD Junk;
+    DWORD VerSize;
+    PVOID Buffer;
+
+    if ((Context->QueriedFlags & YORI_LIB_COLLECT_VERSION_INFO) == 0) {
+        Context->QueriedFlags |= YORI_LIB_COLLECT_VERSION_INFO;
+
+        ASSERT(YoriLibIsStringNullTerminated(FullPath));
+
+        YoriLibLoadVersionFunctions();
+
+        if (DllVersion.pGetFileVersionInfoSizeW == NULL ||
+            DllVersion.pGetFileVersionInfoW == NULL ||
+            DllVersion.pVerQueryValueW == NULL) {
+
+            return NULL;
+        }
+
+        VerSize = DllVersion.pGetFileVersionInfoSizeW(FullPath->StartOfString, &Junk);
+        if (VerSize == 0) {
+            return NULL;
+        }
+
+        Buffer = YoriLibMalloc(VerSize);
+        if (Buffer == NULL) {
+            return NULL;
+        }
+
+        if (!DllVersion.pGetFileVersionInfoW(FullPath->StartOfString, 0, VerSize, Buffer)) {
+            YoriLibFree(Buffer);
+            return NULL;
+        }
+
+        Context->VersionInfo = Buffer;
+    }
+
+    return Context->VersionInfo;
+}
+
+/**
+ Return the security descriptor of the file being collected, containing its
+ owner, group and DACL, loading it if it has not been loaded already.
+
+ @param Context Pointer to the collection context.
+
+ @param FullPath Pointer to a string to the full file name.
+
+ @return Pointer to the security descriptor, or NULL if it could not be
+         loaded.
+ */
+PSECURITY_DESCRIPTOR
+YoriLibGetFileCollectSecurity(
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context,
+    __in PYORI_STRING FullPath
+    )
+{
+    PSECURITY_DESCRIPTOR SecurityDescriptor;
+    DWORD dwSdRequired;
+
+    if ((Context->QueriedFlags & YORI_LIB_COLLECT_SECURITY) == 0) {
+        Context->QueriedFlags |= YORI_LIB_COLLECT_SECURITY;
+
+        ASSERT(YoriLibIsStringNullTerminated(FullPath));
+
+        YoriLibLoadAdvApi32Functions();
+
+        if (DllAdvApi32.pGetFileSecurityW == NULL) {
+            return NULL;
+        }
+
+        SecurityDescriptor = (PSECURITY_DESCRIPTOR)Context->LocalSecurityDescriptor;
+        dwSdRequired = 0;
+
+        if (!DllAdvApi32.pGetFileSecurityW(FullPath->StartOfString, OWNER_SECURITY_INFORMATION|GROUP_SECURITY_INFORMATION|DACL_SECURITY_INFORMATION, SecurityDescriptor, sizeof(Context->LocalSecurityDescriptor), &dwSdRequired)) {
+            if (dwSdRequired == 0) {
+                return NULL;
+            }
+
+            SecurityDescriptor = YoriLibMalloc(dwSdRequired);
+            if (SecurityDescriptor == NULL) {
+                return NULL;
+            }
+
+            if (!DllAdvApi32.pGetFileSecurityW(FullPath->StartOfString, OWNER_SECURITY_INFORMATION|GROUP_SECURITY_INFORMATION|DACL_SECURITY_INFORMATION, SecurityDescriptor, dwSdRequired, &dwSdRequired)) {
+                YoriLibFree(SecurityDescriptor);
+                return NULL;
+            }
+        }
+
+        Context->SecurityDescriptor = SecurityDescriptor;
+    }
+
+    return Context->SecurityDescriptor;
+}
 
 /**
  Collect information from a directory enumerate and full file name relating
@@ -173,17 +632,22 @@ YoriLibCopyFileName(
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectAccessTime (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     FILETIME tmp;
 
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
 
     FileTimeToLocalFileTime(&FindData->ftLastAccessTime, &tmp);
@@ -201,13 +665,17 @@ YoriLibCollectAccessTime (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectAllocatedRangeCount (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     HANDLE hFile;
@@ -217,13 +685,7 @@ YoriLibCollectAllocatedRangeCount (
     Entry->AllocatedRangeCount.HighPart = 0;
     Entry->AllocatedRangeCount.LowPart = 0;
 
-    hFile = CreateFile(FullPath->StartOfString,
-                       FILE_READ_ATTRIBUTES|FILE_READ_DATA,
-                       FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                       NULL,
-                       OPEN_EXISTING,
-                       FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
-                       NULL);
+    hFile = YoriLibGetFileCollectHandle(Context, FullPath, FILE_READ_ATTRIBUTES|FILE_READ_DATA);
 
     if (hFile != INVALID_HANDLE_VALUE) {
 
@@ -280,8 +742,6 @@ YoriLibCollectAllocatedRangeCount (
                 break;
             }
         }
-
-        CloseHandle(hFile);
     }
     return TRUE;
 }
@@ -296,41 +756,28 @@ YoriLibCollectAllocatedRangeCount (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectAllocationSize (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     BOOL RealAllocSize = FALSE;
+    PFILE_STANDARD_INFO StandardInfo;
 
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
 
-    if (DllKernel32.pGetFileInformationByHandleEx) {
-
-        HANDLE hFile;
-
-        hFile = CreateFile(FullPath->StartOfString,
-                           FILE_READ_ATTRIBUTES,
-                           FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                           NULL,
-                           OPEN_EXISTING,
-                           FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
-                           NULL);
-    
-        if (hFile != INVALID_HANDLE_VALUE) {
-            FILE_STANDARD_INFO StandardInfo;
-    
-            if (DllKernel32.pGetFileInformationByHandleEx(hFile, FileStandardInfo, &StandardInfo, sizeof(StandardInfo))) {
-                Entry->AllocationSize = StandardInfo.AllocationSize;
-                RealAllocSize = TRUE;
-            }
-
-            CloseHandle(hFile);
-        }
+    StandardInfo = YoriLibGetFileCollectStandardInfo(Context, FullPath);
+    if (StandardInfo != NULL) {
+        Entry->AllocationSize = StandardInfo->AllocationSize;
+        RealAllocSize = TRUE;
     }
 
     if (!RealAllocSize) {
@@ -387,89 +834,6 @@ YoriLibCollectAllocationSize (
     return TRUE;
 }
 
-/**
- A structure containing the core fields of a PE header.
- */
-typedef struct _YORILIB_PE_HEADERS {
-    /**
-     The signature indicating a PE file.
-     */
-    DWORD Signature;
-
-    /**
-     The base PE header.
-     */
-    IMAGE_FILE_HEADER ImageHeader;
-
-    /**
-     The contents of the PE optional header.  This isn't really optional in
-     NT since it contains core fields needed for NT to run things.
-     */
-    IMAGE_OPTIONAL_HEADER OptionalHeader;
-} YORILIB_PE_HEADERS, *PYORILIB_PE_HEADERS;
-
-/**
- Helper function to load an executable's PE header for parsing.  This is used
- by multiple collection functions whose data comes from a PE header.
-
- @param FullPath Pointer to a string to the full file name.
-
- @param PeHeaders On successful completion, updated to point to the contents
-        of the executable's PE headers.
-
- @return TRUE to indicate success, FALSE to indicate failure.
- */
-__success(return)
-BOOL
-YoriLibCapturePeHeaders (
-    __in PYORI_STRING FullPath,
-    __out PYORILIB_PE_HEADERS PeHeaders
-    )
-{
-    HANDLE hFileRead;
-    IMAGE_DOS_HEADER DosHeader;
-    DWORD BytesReturned;
-
-    ASSERT(YoriLibIsStringNullTerminated(FullPath));
-
-    //
-    //  We want the earlier handle to be attribute only so we can
-    //  operate on directories, but we need data for this, so we
-    //  end up with two handles.
-    //
-
-    hFileRead = CreateFile(FullPath->StartOfString,
-                           FILE_READ_ATTRIBUTES|FILE_READ_DATA,
-                           FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                           NULL,
-                           OPEN_EXISTING,
-                           FILE_FLAG_BACKUP_SEMANTICS,
-                           NULL);
-
-    if (hFileRead != INVALID_HANDLE_VALUE) {
-
-        if (ReadFile(hFileRead, &DosHeader, sizeof(DosHeader), &BytesReturned, NULL) &&
-            BytesReturned == sizeof(DosHeader) &&
-            DosHeader.e_magic == IMAGE_DOS_SIGNATURE &&
-            DosHeader.e_lfanew != 0) {
-
-            SetFilePointer(hFileRead, DosHeader.e_lfanew, NULL, FILE_BEGIN);
-
-            if (ReadFile(hFileRead, PeHeaders, sizeof(YORILIB_PE_HEADERS), &BytesReturned, NULL) &&
-                BytesReturned == sizeof(YORILIB_PE_HEADERS) &&
-                PeHeaders->Signature == IMAGE_NT_SIGNATURE &&
-                PeHeaders->ImageHeader.SizeOfOptionalHeader >= FIELD_OFFSET(IMAGE_OPTIONAL_HEADER, Subsystem)) {
-
-                CloseHandle(hFileRead);
-                return TRUE;
-
-            }
-        }
-        CloseHandle(hFileRead);
-    }
-    return FALSE;
-}
-
 /**
  Returns TRUE if the executable is a GUI executable.  If it's not a PE, or
  any error occurs, or it's any other subsystem, it's assumed to not be 
@@ -507,27 +871,30 @@ YoriLibIsExecutableGui(
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectArch (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
-    YORILIB_PE_HEADERS PeHeaders;
+    PYORILIB_PE_HEADERS PeHeaders;
 
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
 
-    UNREFERENCED_PARAMETER(FindData);
-
     Entry->OsVersionHigh = 0;
     Entry->OsVersionLow = 0;
 
-    if (YoriLibCapturePeHeaders(FullPath, &PeHeaders)) {
+    PeHeaders = YoriLibGetFileCollectPeHeaders(Context, FindData, FullPath);
+    if (PeHeaders != NULL) {
 
-        Entry->Architecture = PeHeaders.ImageHeader.Machine;
+        Entry->Architecture = PeHeaders->ImageHeader.Machine;
     }
 
     return TRUE;
@@ -543,13 +910,17 @@ YoriLibCollectArch (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectCompressionAlgorithm (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     HANDLE hFile;
@@ -560,13 +931,7 @@ YoriLibCollectCompressionAlgorithm (
 
     Entry->CompressionAlgorithm = YoriLibCompressionNone;
 
-    hFile = CreateFile(FullPath->StartOfString,
-                       FILE_READ_ATTRIBUTES,
-                       FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                       NULL,
-                       OPEN_EXISTING,
-                       FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
-                       NULL);
+    hFile = YoriLibGetFileCollectHandle(Context, FullPath, FILE_READ_ATTRIBUTES);
 
     if (hFile != INVALID_HANDLE_VALUE) {
 
@@ -611,8 +976,6 @@ YoriLibCollectCompressionAlgorithm (
                 }
             }
         }
-
-        CloseHandle(hFile);
     }
     return TRUE;
 }
@@ -627,15 +990,20 @@ YoriLibCollectCompressionAlgorithm (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectCompressedFileSize (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
+    UNREFERENCED_PARAMETER(Context);
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
     Entry->CompressedFileSize.LowPart = FindData->nFileSizeLow;
     Entry->CompressedFileSize.HighPart = FindData->nFileSizeHigh;
@@ -662,17 +1030,22 @@ YoriLibCollectCompressedFileSize (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectCreateTime (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     FILETIME tmp;
 
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
 
     FileTimeToLocalFileTime(&FindData->ftCreationTime, &tmp);
@@ -690,18 +1063,21 @@ YoriLibCollectCreateTime (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectDescription (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     DWORD Junk;
     PVOID Buffer;
-    DWORD VerSize;
     PWORD TranslationBlock;
 
     UNREFERENCED_PARAMETER(FindData);
@@ -709,45 +1085,31 @@ YoriLibCollectDescription (
 
     Entry->Description[0] = '\0';
 
-    YoriLibLoadVersionFunctions();
-
-    if (DllVersion.pGetFileVersionInfoSizeW == NULL ||
-        DllVersion.pGetFileVersionInfoW == NULL ||
-        DllVersion.pVerQueryValueW == NULL) {
-
-        return TRUE;
-    }
-
-    VerSize = DllVersion.pGetFileVersionInfoSizeW(FullPath->StartOfString, &Junk);
-
-    Buffer = YoriLibMalloc(VerSize);
+    Buffer = YoriLibGetFileCollectVersionInfo(Context, FullPath);
     if (Buffer != NULL) {
-        if (DllVersion.pGetFileVersionInfoW(FullPath->StartOfString, 0, VerSize, Buffer)) {
-            TCHAR TranslationBlockString[sizeof("\\VarFileInfo\\Translation")];
+        TCHAR TranslationBlockString[sizeof("\\VarFileInfo\\Translation")];
 
-            //
-            //  Old versions of version.dll modify this buffer while parsing
-            //  it, so we need to give them a writable stack based copy
-            //
+        //
+        //  Old versions of version.dll modify this buffer while parsing
+        //  it, so we need to give them a writable stack based copy
+        //
 
-            YoriLibSPrintf(TranslationBlockString, _T("\\VarFileInfo\\Translation"));
-            if (DllVersion.pVerQueryValueW(Buffer, TranslationBlockString, (PVOID*)&TranslationBlock, (PUINT)&Junk) && Junk >= 2 * sizeof(WORD)) {
+        YoriLibSPrintf(TranslationBlockString, _T("\\VarFileInfo\\Translation"));
+        if (DllVersion.pVerQueryValueW(Buffer, TranslationBlockString, (PVOID*)&TranslationBlock, (PUINT)&Junk) && Junk >= 2 * sizeof(WORD)) {
 
-                TCHAR LanguageBlockToFind[sizeof("\\StringFileInfo\\01234567\\FileDescription")];
-                LPTSTR Description;
+            TCHAR LanguageBlockToFind[sizeof("\\StringFileInfo\\01234567\\FileDescription")];
+            LPTSTR Description;
 
-                YoriLibSPrintf(LanguageBlockToFind, _T("\\StringFileInfo\\%04x%04x\\FileDescription"), TranslationBlock[0], TranslationBlock[1]);
-                if (DllVersion.pVerQueryValueW(Buffer, LanguageBlockToFind, (PVOID*)&Description, (PUINT)&Junk)) {
-                    DWORD BytesToCopy = Junk * sizeof(TCHAR);
-                    if (BytesToCopy > sizeof(Entry->Description) - sizeof(TCHAR)) {
-                        BytesToCopy = sizeof(Entry->Description) - sizeof(TCHAR);
-                    }
-                    memcpy(Entry->Description, Description, BytesToCopy);
-                    Entry->Description[BytesToCopy / sizeof(TCHAR)] = '\0';
+            YoriLibSPrintf(LanguageBlockToFind, _T("\\StringFileInfo\\%04x%04x\\FileDescription"), TranslationBlock[0], TranslationBlock[1]);
+            if (DllVersion.pVerQueryValueW(Buffer, LanguageBlockToFind, (PVOID*)&Description, (PUINT)&Junk)) {
+                DWORD BytesToCopy = Junk * sizeof(TCHAR);
+                if (BytesToCopy > sizeof(Entry->Description) - sizeof(TCHAR)) {
+                    BytesToCopy = sizeof(Entry->Description) - sizeof(TCHAR);
                 }
+                memcpy(Entry->Description, Description, BytesToCopy);
+                Entry->Description[BytesToCopy / sizeof(TCHAR)] = '\0';
             }
         }
-        YoriLibFree(Buffer);
     }
     return TRUE;
 }
@@ -762,25 +1124,20 @@ YoriLibCollectDescription (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectEffectivePermissions (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
-
-    //
-    //  Allocate some buffers on the stack to hold the user SID,
-    //  and one for the security descriptor which we can reallocate
-    //  as needed.
-    //
-
-    UCHAR LocalSecurityDescriptor[512];
-    PUCHAR SecurityDescriptor = NULL;
-    DWORD dwSdRequired = 0;
+    PSECURITY_DESCRIPTOR SecurityDescriptor;
     HANDLE TokenHandle = NULL;
     BOOL AccessGranted;
     GENERIC_MAPPING Mapping;
@@ -808,21 +1165,9 @@ YoriLibCollectEffectivePermissions (
 
     Entry->EffectivePermissions = 0;
 
-    SecurityDescriptor = LocalSecurityDescriptor;
-
-    if (!DllAdvApi32.pGetFileSecurityW(FullPath->StartOfString, OWNER_SECURITY_INFORMATION|GROUP_SECURITY_INFORMATION|DACL_SECURITY_INFORMATION, (PSECURITY_DESCRIPTOR)SecurityDescriptor, sizeof(LocalSecurityDescriptor), &dwSdRequired)) {
-        if (dwSdRequired != 0) {
-            SecurityDescriptor = YoriLibMalloc(dwSdRequired);
-            if (SecurityDescriptor == NULL) {
-                goto Exit;
-            }
-
-            if (!DllAdvApi32.pGetFileSecurityW(FullPath->StartOfString, OWNER_SECURITY_INFORMATION|GROUP_SECURITY_INFORMATION|DACL_SECURITY_INFORMATION, (PSECURITY_DESCRIPTOR)SecurityDescriptor, dwSdRequired, &dwSdRequired)) {
-                goto Exit;
-            }
-        } else {
-            goto Exit;
-        }
+    SecurityDescriptor = YoriLibGetFileCollectSecurity(Context, FullPath);
+    if (SecurityDescriptor == NULL) {
+        goto Exit;
     }
 
     if (!DllAdvApi32.pImpersonateSelf(SecurityIdentification)) {
@@ -834,16 +1179,13 @@ YoriLibCollectEffectivePermissions (
     }
 
     memset(&Mapping, 0, sizeof(Mapping));
-    DllAdvApi32.pAccessCheck((PSECURITY_DESCRIPTOR)SecurityDescriptor, TokenHandle, MAXIMUM_ALLOWED, &Mapping, &Privilege, &PrivilegeLength, &Entry->EffectivePermissions, &AccessGranted);
+    DllAdvApi32.pAccessCheck(SecurityDescriptor, TokenHandle, MAXIMUM_ALLOWED, &Mapping, &Privilege, &PrivilegeLength, &Entry->EffectivePermissions, &AccessGranted);
 
 Exit:
     if (TokenHandle != NULL) {
         CloseHandle(TokenHandle);
         DllAdvApi32.pRevertToSelf();
     }
-    if (SecurityDescriptor != NULL && SecurityDescriptor != LocalSecurityDescriptor) {
-        YoriLibFree(SecurityDescriptor);
-    }
 
     YoriLibGetFilePermissionPairs(&PairCount, &Pairs);
 
@@ -870,13 +1212,17 @@ Exit:
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectFileAttributes (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     DWORD i;
@@ -884,6 +1230,7 @@ YoriLibCollectFileAttributes (
     PCYORI_LIB_CHAR_TO_DWORD_FLAG Pairs;
     DWORD PairCount;
 
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
 
     Entry->FileAttributes = FindData->dwFileAttributes;
@@ -915,15 +1262,20 @@ YoriLibCollectFileAttributes (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectFileExtension (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
     UNREFERENCED_PARAMETER(FindData);
     UNREFERENCED_PARAMETER(Entry);
@@ -941,39 +1293,30 @@ YoriLibCollectFileExtension (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectFileId (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
-    HANDLE hFile;
+    PBY_HANDLE_FILE_INFORMATION FileInfo;
 
     UNREFERENCED_PARAMETER(FindData);
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
 
     Entry->FileId.QuadPart = 0;
 
-    hFile = CreateFile(FullPath->StartOfString,
-                       FILE_READ_ATTRIBUTES,
-                       FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                       NULL,
-                       OPEN_EXISTING,
-                       FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
-                       NULL);
-
-    if (hFile != INVALID_HANDLE_VALUE) {
-        BY_HANDLE_FILE_INFORMATION FileInfo;
-
-        if (GetFileInformationByHandle(hFile, &FileInfo)) {
-            Entry->FileId.LowPart = FileInfo.nFileIndexLow;
-            Entry->FileId.HighPart = FileInfo.nFileIndexHigh;
-        }
-
-        CloseHandle(hFile);
+    FileInfo = YoriLibGetFileCollectHandleInfo(Context, FullPath);
+    if (FileInfo != NULL) {
+        Entry->FileId.LowPart = FileInfo->nFileIndexLow;
+        Entry->FileId.HighPart = FileInfo->nFileIndexHigh;
     }
     return TRUE;
 }
@@ -988,15 +1331,20 @@ YoriLibCollectFileId (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectFileName (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
 
     YoriLibCopyFileName(Entry->FileName, FindData->cFileName, MAX_PATH - 1, &Entry->FileNameLengthInChars);
@@ -1027,15 +1375,20 @@ YoriLibCollectFileName (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectFileSize (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
 
     Entry->FileSize.LowPart = FindData->nFileSizeLow;
@@ -1053,18 +1406,21 @@ YoriLibCollectFileSize (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectFileVersionString (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     DWORD Junk;
     PVOID Buffer;
-    DWORD VerSize;
     PWORD TranslationBlock;
 
     UNREFERENCED_PARAMETER(FindData);
@@ -1072,45 +1428,31 @@ YoriLibCollectFileVersionString (
 
     Entry->FileVersionString[0] = '\0';
 
-    YoriLibLoadVersionFunctions();
-
-    if (DllVersion.pGetFileVersionInfoSizeW == NULL ||
-        DllVersion.pGetFileVersionInfoW == NULL ||
-        DllVersion.pVerQueryValueW == NULL) {
-
-        return TRUE;
-    }
-
-    VerSize = DllVersion.pGetFileVersionInfoSizeW(FullPath->StartOfString, &Junk);
-
-    Buffer = YoriLibMalloc(VerSize);
+    Buffer = YoriLibGetFileCollectVersionInfo(Context, FullPath);
     if (Buffer != NULL) {
-        if (DllVersion.pGetFileVersionInfoW(FullPath->StartOfString, 0, VerSize, Buffer)) {
-            TCHAR TranslationBlockString[sizeof("\\VarFileInfo\\Translation")];
+        TCHAR TranslationBlockString[sizeof("\\VarFileInfo\\Translation")];
 
-            //
-            //  Old versions of version.dll modify this buffer while parsing
-            //  it, so we need to give them a writable stack based copy
-            //
+        //
+        //  Old versions of version.dll modify this buffer while parsing
+        //  it, so we need to give them a writable stack based copy
+        //
 
-            YoriLibSPrintf(TranslationBlockString, _T("\\VarFileInfo\\Translation"));
-            if (DllVersion.pVerQueryValueW(Buffer, TranslationBlockString, (PVOID*)&TranslationBlock, (PUINT)&Junk) && Junk >= 2 * sizeof(WORD)) {
+        YoriLibSPrintf(TranslationBlockString, _T("\\VarFileInfo\\Translation"));
+        if (DllVersion.pVerQueryValueW(Buffer, TranslationBlockString, (PVOID*)&TranslationBlock, (PUINT)&Junk) && Junk >= 2 * sizeof(WORD)) {
 
-                TCHAR LanguageBlockToFind[sizeof("\\StringFileInfo\\01234567\\FileVersion")];
-                LPTSTR FileVersionString;
+            TCHAR LanguageBlockToFind[sizeof("\\StringFileInfo\\01234567\\FileVersion")];
+            LPTSTR FileVersionString;
 
-                YoriLibSPrintf(LanguageBlockToFind, _T("\\StringFileInfo\\%04x%04x\\FileVersion"), TranslationBlock[0], TranslationBlock[1]);
-                if (DllVersion.pVerQueryValueW(Buffer, LanguageBlockToFind, (PVOID*)&FileVersionString, (PUINT)&Junk)) {
-                    DWORD BytesToCopy = Junk * sizeof(TCHAR);
-                    if (BytesToCopy > sizeof(Entry->FileVersionString) - sizeof(TCHAR)) {
-                        BytesToCopy = sizeof(Entry->FileVersionString) - sizeof(TCHAR);
-                    }
-                    memcpy(Entry->FileVersionString, FileVersionString, BytesToCopy);
-                    Entry->FileVersionString[BytesToCopy / sizeof(TCHAR)] = '\0';
+            YoriLibSPrintf(LanguageBlockToFind, _T("\\StringFileInfo\\%04x%04x\\FileVersion"), TranslationBlock[0], TranslationBlock[1]);
+            if (DllVersion.pVerQueryValueW(Buffer, LanguageBlockToFind, (PVOID*)&FileVersionString, (PUINT)&Junk)) {
+                DWORD BytesToCopy = Junk * sizeof(TCHAR);
+                if (BytesToCopy > sizeof(Entry->FileVersionString) - sizeof(TCHAR)) {
+                    BytesToCopy = sizeof(Entry->FileVersionString) - sizeof(TCHAR);
                 }
+                memcpy(Entry->FileVersionString, FileVersionString, BytesToCopy);
+                Entry->FileVersionString[BytesToCopy / sizeof(TCHAR)] = '\0';
             }
         }
-        YoriLibFree(Buffer);
     }
     return TRUE;
 }
@@ -1125,13 +1467,17 @@ YoriLibCollectFileVersionString (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectFragmentCount (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     HANDLE hFile;
@@ -1143,13 +1489,7 @@ YoriLibCollectFragmentCount (
     Entry->FragmentCount.HighPart = 0;
     Entry->FragmentCount.LowPart = 0;
 
-    hFile = CreateFile(FullPath->StartOfString,
-                       FILE_READ_ATTRIBUTES,
-                       FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                       NULL,
-                       OPEN_EXISTING,
-                       FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
-                       NULL);
+    hFile = YoriLibGetFileCollectHandle(Context, FullPath, FILE_READ_ATTRIBUTES);
 
     if (hFile != INVALID_HANDLE_VALUE) {
 
@@ -1197,8 +1537,6 @@ YoriLibCollectFragmentCount (
 
             StartBuffer.StartingVcn.QuadPart = u.Extents.Extents[u.Extents.ExtentCount - 1].NextVcn.QuadPart;
         }
-
-        CloseHandle(hFile);
     }
     return TRUE;
 }
@@ -1213,38 +1551,38 @@ YoriLibCollectFragmentCount (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectLinkCount (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
-    HANDLE hFile;
+    PBY_HANDLE_FILE_INFORMATION FileInfo;
 
     UNREFERENCED_PARAMETER(FindData);
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
 
     Entry->LinkCount = 0;
 
-    hFile = CreateFile(FullPath->StartOfString,
-                       FILE_READ_ATTRIBUTES,
-                       FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                       NULL,
-                       OPEN_EXISTING,
-                       FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
-                       NULL);
-
-    if (hFile != INVALID_HANDLE_VALUE) {
-        BY_HANDLE_FILE_INFORMATION FileInfo;
+    //
+    //  The link count is returned by both information classes, so use
+    //  whichever has already been queried for this file.
+    //
 
-        if (GetFileInformationByHandle(hFile, &FileInfo)) {
-            Entry->LinkCount = FileInfo.nNumberOfLinks;
+    if (Context->ValidFlags & YORI_LIB_COLLECT_STANDARD_INFO) {
+        Entry->LinkCount = Context->StandardInfo.NumberOfLinks;
+    } else {
+        FileInfo = YoriLibGetFileCollectHandleInfo(Context, FullPath);
+        if (FileInfo != NULL) {
+            Entry->LinkCount = FileInfo->nNumberOfLinks;
         }
-
-        CloseHandle(hFile);
     }
     return TRUE;
 }
@@ -1259,13 +1597,17 @@ YoriLibCollectLinkCount (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectObjectId (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     HANDLE hFile;
@@ -1277,19 +1619,12 @@ YoriLibCollectObjectId (
 
     ZeroMemory(&Entry->ObjectId, sizeof(Entry->ObjectId));
 
-    hFile = CreateFile(FullPath->StartOfString,
-                       FILE_READ_ATTRIBUTES,
-                       FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                       NULL,
-                       OPEN_EXISTING,
-                       FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
-                       NULL);
+    hFile = YoriLibGetFileCollectHandle(Context, FullPath, FILE_READ_ATTRIBUTES);
 
     if (hFile != INVALID_HANDLE_VALUE) {
         if (DeviceIoControl(hFile, FSCTL_GET_OBJECT_ID, NULL, 0, &Buffer, sizeof(Buffer), &BytesReturned, NULL)) {
             memcpy(&Entry->ObjectId, &Buffer.ObjectId, sizeof(Buffer.ObjectId));
         }
-        CloseHandle(hFile);
     }
     return TRUE;
 }
@@ -1304,27 +1639,31 @@ YoriLibCollectObjectId (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectOsVersion (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
-    YORILIB_PE_HEADERS PeHeaders;
+    PYORILIB_PE_HEADERS PeHeaders;
 
-    UNREFERENCED_PARAMETER(FindData);
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
 
     Entry->OsVersionHigh = 0;
     Entry->OsVersionLow = 0;
 
-    if (YoriLibCapturePeHeaders(FullPath, &PeHeaders)) {
+    PeHeaders = YoriLibGetFileCollectPeHeaders(Context, FindData, FullPath);
+    if (PeHeaders != NULL) {
 
-        Entry->OsVersionHigh = PeHeaders.OptionalHeader.MajorSubsystemVersion;
-        Entry->OsVersionLow = PeHeaders.OptionalHeader.MinorSubsystemVersion;
+        Entry->OsVersionHigh = PeHeaders->OptionalHeader.MajorSubsystemVersion;
+        Entry->OsVersionLow = PeHeaders->OptionalHeader.MinorSubsystemVersion;
     }
 
     return TRUE;
@@ -1340,31 +1679,32 @@ YoriLibCollectOsVersion (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectOwner (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
 
     //
-    //  Allocate some buffers on the stack to hold the user name, domain name
-    //  and owner portion of the security descriptor.  In the first case, this
-    //  is to help ensure we have space to store the whole thing; in the
-    //  second case, this function crashes without a buffer even if we discard
-    //  the result; and the descriptor here doesn't contain the ACL and only
-    //  needs to be big enough to hold one variable sized owner SID.
+    //  Allocate some buffers on the stack to hold the user name and domain
+    //  name.  In the first case, this is to help ensure we have space to
+    //  store the whole thing; in the second case, this function crashes
+    //  without a buffer even if we discard the result.
     //
 
     TCHAR UserName[128];
     DWORD NameLength = sizeof(UserName)/sizeof(UserName[0]);
     TCHAR DomainName[128];
     DWORD DomainLength = sizeof(DomainName)/sizeof(DomainName[0]);
-    UCHAR SecurityDescriptor[256];
-    DWORD dwSdRequired = 0;
+    PSECURITY_DESCRIPTOR SecurityDescriptor;
     BOOL OwnerDefaulted;
     PSID pOwnerSid;
     SID_NAME_USE eUse;
@@ -1384,8 +1724,9 @@ YoriLibCollectOwner (
     UserName[0] = '\0';
     Entry->Owner[0] = '\0';
 
-    if (DllAdvApi32.pGetFileSecurityW(FullPath->StartOfString, OWNER_SECURITY_INFORMATION, (PSECURITY_DESCRIPTOR)SecurityDescriptor, sizeof(SecurityDescriptor), &dwSdRequired)) {
-        if (DllAdvApi32.pGetSecurityDescriptorOwner((PSECURITY_DESCRIPTOR)SecurityDescriptor, &pOwnerSid, &OwnerDefaulted)) {
+    SecurityDescriptor = YoriLibGetFileCollectSecurity(Context, FullPath);
+    if (SecurityDescriptor != NULL) {
+        if (DllAdvApi32.pGetSecurityDescriptorOwner(SecurityDescriptor, &pOwnerSid, &OwnerDefaulted)) {
             if (DllAdvApi32.pLookupAccountSidW(NULL, pOwnerSid, UserName, &NameLength, DomainName, &DomainLength, &eUse)) {
                 UserName[(sizeof(Entry->Owner)/sizeof(Entry->Owner[0])) - 1] = '\0';
                 memcpy(Entry->Owner, UserName, sizeof(Entry->Owner));
@@ -1406,15 +1747,20 @@ YoriLibCollectOwner (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectReparseTag (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
 
     if (FindData->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
@@ -1435,15 +1781,20 @@ YoriLibCollectReparseTag (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectShortName (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
 
     if (FindData->cAlternateFileName[0] == '\0') {
@@ -1470,25 +1821,29 @@ YoriLibCollectShortName (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectSubsystem (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
-    YORILIB_PE_HEADERS PeHeaders;
+    PYORILIB_PE_HEADERS PeHeaders;
 
-    UNREFERENCED_PARAMETER(FindData);
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
 
     Entry->Subsystem = 0;
 
-    if (YoriLibCapturePeHeaders(FullPath, &PeHeaders)) {
+    PeHeaders = YoriLibGetFileCollectPeHeaders(Context, FindData, FullPath);
+    if (PeHeaders != NULL) {
 
-        Entry->Subsystem = PeHeaders.OptionalHeader.Subsystem;
+        Entry->Subsystem = PeHeaders->OptionalHeader.Subsystem;
     }
 
     return TRUE;
@@ -1504,18 +1859,23 @@ YoriLibCollectSubsystem (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectStreamCount (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     HANDLE hFind;
     WIN32_FIND_STREAM_DATA FindStreamData;
 
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FindData);
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
 
@@ -1550,13 +1910,17 @@ YoriLibCollectStreamCount (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectUsn (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     HANDLE hFile;
@@ -1565,13 +1929,7 @@ YoriLibCollectUsn (
     ASSERT(YoriLibIsStringNullTerminated(FullPath));
 
     Entry->Usn.QuadPart = 0;
-    hFile = CreateFile(FullPath->StartOfString,
-                       FILE_READ_ATTRIBUTES,
-                       FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                       NULL,
-                       OPEN_EXISTING,
-                       FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL,
-                       NULL);
+    hFile = YoriLibGetFileCollectHandle(Context, FullPath, FILE_READ_ATTRIBUTES);
 
     if (hFile != INVALID_HANDLE_VALUE) {
 
@@ -1584,8 +1942,6 @@ YoriLibCollectUsn (
         if (DeviceIoControl(hFile, FSCTL_READ_FILE_USN_DATA, NULL, 0, &s1, sizeof(s1), &BytesReturned, NULL)) {
             Entry->Usn.QuadPart = s1.UsnRecord.Usn;
         }
-
-        CloseHandle(hFile);
     }
     return TRUE;
 }
@@ -1600,18 +1956,21 @@ YoriLibCollectUsn (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectVersion (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     DWORD Junk;
     PVOID Buffer;
-    DWORD VerSize;
     VS_FIXEDFILEINFO * RootBlock;
 
     UNREFERENCED_PARAMETER(FindData);
@@ -1620,35 +1979,21 @@ YoriLibCollectVersion (
     Entry->FileVersion.QuadPart = 0;
     Entry->FileVersionFlags = 0;
 
-    YoriLibLoadVersionFunctions();
-
-    if (DllVersion.pGetFileVersionInfoSizeW == NULL ||
-        DllVersion.pGetFileVersionInfoW == NULL ||
-        DllVersion.pVerQueryValueW == NULL) {
-
-        return TRUE;
-    }
-
-    VerSize = DllVersion.pGetFileVersionInfoSizeW(FullPath->StartOfString, &Junk);
-
-    Buffer = YoriLibMalloc(VerSize);
+    Buffer = YoriLibGetFileCollectVersionInfo(Context, FullPath);
     if (Buffer != NULL) {
-        if (DllVersion.pGetFileVersionInfoW(FullPath->StartOfString, 0, VerSize, Buffer)) {
-            TCHAR BlockString[sizeof("\\")];
-
-            //
-            //  Old versions of version.dll modify this buffer while parsing
-            //  it, so we need to give them a writable stack based copy
-            //
-
-            YoriLibSPrintf(BlockString, _T("\\"));
-            if (DllVersion.pVerQueryValueW(Buffer, BlockString, (PVOID*)&RootBlock, (PUINT)&Junk)) {
-                Entry->FileVersion.HighPart = RootBlock->dwFileVersionMS;
-                Entry->FileVersion.LowPart = RootBlock->dwFileVersionLS;
-                Entry->FileVersionFlags = RootBlock->dwFileFlags & RootBlock->dwFileFlagsMask;
-            }
+        TCHAR BlockString[sizeof("\\")];
+
+        //
+        //  Old versions of version.dll modify this buffer while parsing
+        //  it, so we need to give them a writable stack based copy
+        //
+
+        YoriLibSPrintf(BlockString, _T("\\"));
+        if (DllVersion.pVerQueryValueW(Buffer, BlockString, (PVOID*)&RootBlock, (PUINT)&Junk)) {
+            Entry->FileVersion.HighPart = RootBlock->dwFileVersionMS;
+            Entry->FileVersion.LowPart = RootBlock->dwFileVersionLS;
+            Entry->FileVersionFlags = RootBlock->dwFileFlags & RootBlock->dwFileFlagsMask;
         }
-        YoriLibFree(Buffer);
     }
     return TRUE;
 }
@@ -1663,17 +2008,22 @@ YoriLibCollectVersion (
 
  @param FullPath Pointer to a string to the full file name.
 
+ @param Context Pointer to state shared between the collection functions
+        operating on this file.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 YoriLibCollectWriteTime(
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     )
 {
     FILETIME tmp;
 
+    UNREFERENCED_PARAMETER(Context);
     UNREFERENCED_PARAMETER(FullPath);
 
     FileTimeToLocalFileTime(&FindData->ftLastWriteTime, &tmp);
@@ -1681,6 +2031,70 @@ YoriLibCollectWriteTime(
     return TRUE;
 }
 
+/**
+ A structure mapping a collection function to the access to the file it
+ needs when operating through a collection context.
+ */
+typedef struct _YORI_LIB_FILE_COLLECT_ACCESS {
+
+    /**
+     Pointer to the collection function.
+     */
+    YORI_LIB_FILE_FILT_COLLECT_FN CollectFn;
+
+    /**
+     The access that the collection function requires.
+     */
+    DWORD Access;
+} YORI_LIB_FILE_COLLECT_ACCESS;
+
+/**
+ A table of collection functions which open the file being collected and the
+ access they require.  Functions not listed here only use information from
+ directory enumeration or query the system by path.
+ */
+const YORI_LIB_FILE_COLLECT_ACCESS
+YoriLibFileCollectAccess[] = {
+    {YoriLibCollectAllocatedRangeCount,  FILE_READ_ATTRIBUTES|FILE_READ_DATA},
+    {YoriLibCollectAllocationSize,       FILE_READ_ATTRIBUTES},
+    {YoriLibCollectArch,                 FILE_READ_ATTRIBUTES|FILE_READ_DATA},
+    {YoriLibCollectCompressionAlgorithm, FILE_READ_ATTRIBUTES},
+    {YoriLibCollectFileId,               FILE_READ_ATTRIBUTES},
+    {YoriLibCollectFragmentCount,        FILE_READ_ATTRIBUTES},
+    {YoriLibCollectLinkCount,            FILE_READ_ATTRIBUTES},
+    {YoriLibCollectObjectId,             FILE_READ_ATTRIBUTES},
+    {YoriLibCollectOsVersion,            FILE_READ_ATTRIBUTES|FILE_READ_DATA},
+    {YoriLibCollectSubsystem,            FILE_READ_ATTRIBUTES|FILE_READ_DATA},
+    {YoriLibCollectUsn,                  FILE_READ_ATTRIBUTES},
+    };
+
+/**
+ Return the access to the file that a collection function requires.  Callers
+ that know which collection functions will run against each file can combine
+ these and supply the result to YoriLibInitFileCollectContext so that each
+ file is opened once.
+
+ @param CollectFn Pointer to the collection function.
+
+ @return The access that the function requires, or zero if it does not open
+         the file.
+ */
+DWORD
+YoriLibGetFileCollectAccess(
+    __in YORI_LIB_FILE_FILT_COLLECT_FN CollectFn
+    )
+{
+    DWORD Index;
+
+    for (Index = 0; Index < sizeof(YoriLibFileCollectAccess)/sizeof(YoriLibFileCollectAccess[0]); Index++) {
+        if (YoriLibFileCollectAccess[Index].CollectFn == CollectFn) {
+            return YoriLibFileCollectAccess[Index].Access;
+        }
+    }
+
+    return 0;
+}
+
 //
 //  Sorting support
 //
@@ -27,9 +27,16 @@
 #include "yoripch.h"
 #include "yorilib.h"
 
+/**
+ The average number of entries per bucket which, when exceeded, causes the
+ hash table to allocate more buckets.
+ */
+#define YORI_HASH_TABLE_MAX_LOAD (2)
 
 /**
- Allocate an empty hash table.
+ Allocate an empty hash table.  The table will allocate more buckets as
+ entries are inserted, so the number specified here is only the initial
+ size.
 
  @param NumberBuckets The number of buckets to allocate into the hash table.
 
@@ -41,16 +48,22 @@ YoriLibAllocateHashTable(
     __in DWORD NumberBuckets
     )
 {
-    DWORD SizeNeeded = sizeof(YORI_HASH_TABLE) + NumberBuckets * sizeof(YORI_HASH_BUCKET);
+    DWORD SizeNeeded;
     PYORI_HASH_TABLE HashTable;
     DWORD BucketIndex;
 
+    if (NumberBuckets == 0) {
+        NumberBuckets = 1;
+    }
+
+    SizeNeeded = sizeof(YORI_HASH_TABLE) + NumberBuckets * sizeof(YORI_HASH_BUCKET);
     HashTable = YoriLibReferencedMalloc(SizeNeeded);
     if (HashTable == NULL) {
         return NULL;
     }
 
     HashTable->NumberBuckets = NumberBuckets;
+    HashTable->EntryCount = 0;
     HashTable->Buckets = (PYORI_HASH_BUCKET)(HashTable + 1);
 
     for (BucketIndex = 0; BucketIndex < NumberBuckets; BucketIndex++) {
@@ -78,18 +91,24 @@ YoriLibFreeEmptyHashTable(
         ASSERT(YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, NULL) == NULL);
     }
 #endif
+    ASSERT(HashTable->EntryCount == 0);
+
+    if (HashTable->Buckets != (PYORI_HASH_BUCKET)(HashTable + 1)) {
+        YoriLibFree(HashTable->Buckets);
+    }
 
     YoriLibDereference(HashTable);
 }
 
 /**
- Hash a yori string into a 16 bit hash value.
+ Hash a yori string into a 32 bit hash value.  The hash is case insensitive,
+ so strings which differ only by case generate the same value.
 
  @param String The string to generate a hash for.
 
- @return A 16 bit hash value for the string.
+ @return A 32 bit hash value for the string.
  */
-WORD
+DWORD
 YoriLibHashString(
     __in PYORI_STRING String
     )
@@ -98,27 +117,88 @@ YoriLibHashString(
     DWORD Index;
 
     //
-    //  Simple string xor hash
+    //  FNV-1a over each upcased UTF-16 code unit
     //
 
-    Hash = 0;
+    Hash = 2166136261;
     for (Index = 0; Index < String->LengthInChars; Index++) {
-        Hash = (Hash << 3) ^ YoriLibUpcaseChar(String->StartOfString[Index]) ^ (Hash >> 29);
+        Hash = (Hash ^ YoriLibUpcaseChar(String->StartOfString[Index])) * 16777619;
     }
 
     //
-    //  Move some high bits into the low bits since the low bits
-    //  will likely be used as a bucket index.  Note we're moving
-    //  bits 16 here and 3 above (ie., not divisible and won't
-    //  cancel out.)
+    //  FNV leaves the low bits, which are used as a bucket index, poorly
+    //  mixed for short keys, so finish with a final avalanche step to
+    //  spread every input bit across the result.
     //
 
     Hash = Hash ^ (Hash >> 16);
-    return (WORD)Hash;
+    Hash = Hash * 0x85ebca6b;
+    Hash = Hash ^ (Hash >> 13);
+    Hash = Hash * 0xc2b2ae35;
+    Hash = Hash ^ (Hash >> 16);
+    return Hash;
+}
+
+/**
+ Attempt to allocate more buckets for a hash table and move all of the
+ existing entries into them.  If memory cannot be allocated, the table
+ continues to use its existing buckets.
+
+ @param HashTable Pointer to the hash table to grow.
+ */
+VOID
+YoriLibHashGrowTable(
+    __in PYORI_HASH_TABLE HashTable
+    )
+{
+    PYORI_HASH_BUCKET NewBuckets;
+    PYORI_HASH_ENTRY HashEntry;
+    DWORD NewNumberBuckets;
+    DWORD BucketIndex;
+    DWORD NewBucketIndex;
+
+    //
+    //  Keep the bucket count odd so that the modulus uses all of the
+    //  hash bits.
+    //
+
+    NewNumberBuckets = HashTable->NumberBuckets * 2 + 1;
+    if (NewNumberBuckets <= HashTable->NumberBuckets ||
+        NewNumberBuckets > (DWORD)-1 / sizeof(YORI_HASH_BUCKET)) {
+        return;
+    }
+
+    NewBuckets = YoriLibMalloc(NewNumberBuckets * sizeof(YORI_HASH_BUCKET));
+    if (NewBuckets == NULL) {
+        return;
+    }
+
+    for (NewBucketIndex = 0; NewBucketIndex < NewNumberBuckets; NewBucketIndex++) {
+        YoriLibInitializeListHead(&NewBuckets[NewBucketIndex].ListHead);
+    }
+
+    for (BucketIndex = 0; BucketIndex < HashTable->NumberBuckets; BucketIndex++) {
+        while (!YoriLibIsListEmpty(&HashTable->Buckets[BucketIndex].ListHead)) {
+            HashEntry = CONTAINING_RECORD(HashTable->Buckets[BucketIndex].ListHead.Next, YORI_HASH_ENTRY, ListEntry);
+            YoriLibRemoveListItem(&HashEntry->ListEntry);
+            NewBucketIndex = HashEntry->HashValue % NewNumberBuckets;
+            YoriLibAppendList(&NewBuckets[NewBucketIndex].ListHead, &HashEntry->ListEntry);
+        }
+    }
+
+    if (HashTable->Buckets != (PYORI_HASH_BUCKET)(HashTable + 1)) {
+        YoriLibFree(HashTable->Buckets);
+    }
+
+    HashTable->Buckets = NewBuckets;
+    HashTable->NumberBuckets = NewNumberBuckets;
 }
 
 /**
- Insert an object with a string based key into the hash table.
+ Insert an object with a string based key into the hash table.  Note that
+ inserting may cause the table to grow, which changes the order that
+ @ref YoriLibHashGetNextEntry returns entries, so callers should not insert
+ while enumerating.
 
  @param HashTable The hash table to insert the object into.
 
@@ -138,11 +218,20 @@ YoriLibHashInsertByKey(
     __out PYORI_HASH_ENTRY HashEntry
     )
 {
-    DWORD BucketIndex = YoriLibHashString(KeyString) % HashTable->NumberBuckets;
+    DWORD BucketIndex;
+
+    if (HashTable->EntryCount >= HashTable->NumberBuckets * YORI_HASH_TABLE_MAX_LOAD) {
+        YoriLibHashGrowTable(HashTable);
+    }
+
+    HashEntry->HashValue = YoriLibHashString(KeyString);
+    HashEntry->HashTable = HashTable;
+    BucketIndex = HashEntry->HashValue % HashTable->NumberBuckets;
 
     YoriLibCloneString(&HashEntry->Key, KeyString);
     HashEntry->Context = Context;
     YoriLibInsertList(&HashTable->Buckets[BucketIndex].ListHead, &HashEntry->ListEntry);
+    HashTable->EntryCount++;
 }
 
 /**
@@ -161,7 +250,47 @@ YoriLibHashLookupByKey(
     __in PYORI_STRING KeyString
     )
 {
-    DWORD BucketIndex = YoriLibHashString(KeyString) % HashTable->NumberBuckets;
+    DWORD HashValue = YoriLibHashString(KeyString);
+    DWORD BucketIndex = HashValue % HashTable->NumberBuckets;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_HASH_ENTRY HashEntry;
+
+    HashEntry = NULL;
+    ListEntry = YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, NULL);
+    while (ListEntry != NULL) {
+        HashEntry = CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
+        if (HashEntry->HashValue == HashValue &&
+            YoriLibCompareStringInsensitive(KeyString, &HashEntry->Key) == 0) {
+            break;
+        }
+        HashEntry = NULL;
+        ListEntry = YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, ListEntry);
+    }
+
+    return HashEntry;
+}
+
+/**
+ Locate an object within the hash table by a specified key, requiring the
+ case of the key to match exactly.  The table remains case insensitive, so
+ it can contain several entries whose keys differ only by case, and this
+ returns the one whose case matches.
+
+ @param HashTable Pointer to the hash table to search for the object.
+
+ @param KeyString Pointer to the key to identify the object.
+
+ @return Pointer to the entry within the hash table if a match is found.
+         If no match is found, returns NULL.
+ */
+PYORI_HASH_ENTRY
+YoriLibHashLookupByKeyCaseSensitive(
+    __in PYORI_HASH_TABLE HashTable,
+    __in PYORI_STRING KeyString
+    )
+{
+    DWORD HashValue = YoriLibHashString(KeyString);
+    DWORD BucketIndex = HashValue % HashTable->NumberBuckets;
     PYORI_LIST_ENTRY ListEntry;
     PYORI_HASH_ENTRY HashEntry;
 
@@ -169,7 +298,8 @@ YoriLibHashLookupByKey(
     ListEntry = YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, NULL);
     while (ListEntry != NULL) {
         HashEntry = CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
-        if (YoriLibCompareStringInsensitive(KeyString, &HashEntry->Key) == 0) {
+        if (HashEntry->HashValue == HashValue &&
+            YoriLibCompareString(KeyString, &HashEntry->Key) == 0) {
             break;
         }
         HashEntry = NULL;
@@ -179,6 +309,50 @@ YoriLibHashLookupByKey(
     return HashEntry;
 }
 
+/**
+ Enumerate the entries in a hash table.  Entries are returned in no
+ particular order.  The caller may remove the previously returned entry
+ after obtaining the next one, but should not insert entries while
+ enumerating.
+
+ @param HashTable Pointer to the hash table to enumerate.
+
+ @param PreviousEntry If specified, the previously returned entry, where the
+        next entry should be returned from.  Can be NULL to indicate that no
+        entries have previously been returned and enumeration should commence
+        from the beginning.
+
+ @return Pointer to the next entry, or NULL if all entries have been
+         returned.
+ */
+PYORI_HASH_ENTRY
+YoriLibHashGetNextEntry(
+    __in PYORI_HASH_TABLE HashTable,
+    __in_opt PYORI_HASH_ENTRY PreviousEntry
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD BucketIndex;
+
+    if (PreviousEntry == NULL) {
+        BucketIndex = 0;
+        ListEntry = NULL;
+    } else {
+        ASSERT(PreviousEntry->HashTable == HashTable);
+        BucketIndex = PreviousEntry->HashValue % HashTable->NumberBuckets;
+        ListEntry = &PreviousEntry->ListEntry;
+    }
+
+    for (; BucketIndex < HashTable->NumberBuckets; BucketIndex++) {
+        ListEntry = YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, ListEntry);
+        if (ListEntry != NULL) {
+            return CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
+        }
+    }
+
+    return NULL;
+}
+
 /**
  Remove an entry from a hash table.  This routine assumes the entry must
  already be inserted into a hash table.
@@ -190,6 +364,9 @@ YoriLibHashRemoveByEntry(
     __in PYORI_HASH_ENTRY HashEntry
     )
 {
+    ASSERT(HashEntry->HashTable->EntryCount > 0);
+    HashEntry->HashTable->EntryCount--;
+    HashEntry->HashTable = NULL;
     YoriLibRemoveListItem(&HashEntry->ListEntry);
     YoriLibFreeStringContents(&HashEntry->Key);
 }
@@ -450,6 +450,7 @@ YoriLibHexDump(
     LARGE_INTEGER DisplayBufferOffset;
     YORI_STRING LineBuffer;
     YORI_STRING Subset;
+    YORI_LIB_OUTPUT_BUFFER OutputBuffer;
 
     if (BytesPerWord != 1 && BytesPerWord != 2 && BytesPerWord != 4 && BytesPerWord != 8) {
         return FALSE;
@@ -459,6 +460,11 @@ YoriLibHexDump(
         return FALSE;
     }
 
+    if (!YoriLibOutputBufferInitialize(&OutputBuffer, YORI_LIB_OUTPUT_STDOUT)) {
+        YoriLibFreeStringContents(&LineBuffer);
+        return FALSE;
+    }
+
     Subset.StartOfString = LineBuffer.StartOfString;
     Subset.LengthInChars = LineBuffer.LengthInChars;
     Subset.LengthAllocated = LineBuffer.LengthAllocated;
@@ -555,13 +561,14 @@ YoriLibHexDump(
             Subset.StartOfString++;
             LineBuffer.LengthInChars++;
         }
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &LineBuffer);
+        YoriLibOutputBufferWriteString(&OutputBuffer, &LineBuffer);
         LineBuffer.LengthInChars = 0;
         Subset.StartOfString = LineBuffer.StartOfString;
         Subset.LengthInChars = LineBuffer.LengthInChars;
         Subset.LengthAllocated = LineBuffer.LengthAllocated;
     }
 
+    YoriLibOutputBufferCleanup(&OutputBuffer);
     YoriLibFreeStringContents(&LineBuffer);
     return TRUE;
 }
@@ -613,6 +620,7 @@ YoriLibHexDiff(
     DWORD BufferLengths[2];
     YORI_STRING LineBuffer;
     YORI_STRING Subset;
+    YORI_LIB_OUTPUT_BUFFER OutputBuffer;
 
     if (BytesPerWord != 1 && BytesPerWord != 2 && BytesPerWord != 4 && BytesPerWord != 8) {
         return FALSE;
@@ -622,6 +630,11 @@ YoriLibHexDiff(
         return FALSE;
     }
 
+    if (!YoriLibOutputBufferInitialize(&OutputBuffer, YORI_LIB_OUTPUT_STDOUT)) {
+        YoriLibFreeStringContents(&LineBuffer);
+        return FALSE;
+    }
+
     Subset.StartOfString = LineBuffer.StartOfString;
     Subset.LengthInChars = LineBuffer.LengthInChars;
     Subset.LengthAllocated = LineBuffer.LengthAllocated;
@@ -775,13 +788,14 @@ YoriLibHexDiff(
             Subset.StartOfString++;
             LineBuffer.LengthInChars++;
         }
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &LineBuffer);
+        YoriLibOutputBufferWriteString(&OutputBuffer, &LineBuffer);
         LineBuffer.LengthInChars = 0;
         Subset.StartOfString = LineBuffer.StartOfString;
         Subset.LengthInChars = LineBuffer.LengthInChars;
         Subset.LengthAllocated = LineBuffer.LengthAllocated;
     }
 
+    YoriLibOutputBufferCleanup(&OutputBuffer);
     YoriLibFreeStringContents(&LineBuffer);
     return TRUE;
 }
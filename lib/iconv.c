@@ -127,6 +127,323 @@ YoriLibSetMultibyteInputEncoding(
     YoriLibActiveInputEncodingInitialized = TRUE;
 }
 
+/**
+ The number of bytes in a UTF8 sequence, indexed by the first byte of the
+ sequence.  Zero indicates a byte which cannot begin a sequence, which
+ includes continuation bytes, the overlong leads 0xC0 and 0xC1, and leads
+ which would describe a value beyond 0x10FFFF.
+ */
+CONST UCHAR YoriLibUtf8SequenceLength[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/**
+ The bits of the first byte of a UTF8 sequence which contribute to the
+ value, indexed by the number of bytes in the sequence.
+ */
+CONST UCHAR YoriLibUtf8LeadMask[5] = { 0x00, 0x7F, 0x1F, 0x0F, 0x07 };
+
+/**
+ The smallest value which can be described by a UTF8 sequence, indexed by
+ the number of bytes in the sequence.  Anything smaller is an overlong
+ encoding and is rejected.
+ */
+CONST DWORD YoriLibUtf8MinimumValue[5] = { 0x00, 0x00, 0x80, 0x800, 0x10000 };
+
+/**
+ The character which is substituted for any input which cannot be converted.
+ */
+#define YORI_LIB_REPLACEMENT_CHAR 0xFFFD
+
+/**
+ Convert a UTF8 string into UTF16 in a single pass.  Runs of ASCII are
+ converted a machine word at a time, and other sequences are decoded with
+ the aid of a table indexed by the first byte.  Invalid input is converted
+ to U+FFFD.
+
+ @param State Optionally points to state which is carried between calls, so
+        that a sequence which is split between two buffers can be decoded.
+        If NULL, the input is assumed to be complete, and any incomplete
+        sequence at the end is converted to U+FFFD.
+
+ @param InputStringBuffer Pointer to the UTF8 string.
+
+ @param InputBufferLength The length of InputStringBuffer, in bytes.
+
+ @param OutputStringBuffer Pointer to a buffer to be populated with the
+        string in UTF16 form.  This must be able to hold
+        YORI_LIB_UTF16_CHARS_FOR_UTF8(InputBufferLength) characters.
+
+ @return The number of characters written to OutputStringBuffer.
+ */
+DWORD
+YoriLibUtf8ToUtf16(
+    __inout_opt PYORI_LIB_UTF8_DECODE_STATE State,
+    __in_ecount(InputBufferLength) LPCSTR InputStringBuffer,
+    __in DWORD InputBufferLength,
+    __out LPWSTR OutputStringBuffer
+    )
+{
+    PUCHAR Input;
+    DWORD Index;
+    DWORD OutIndex;
+    DWORD Value;
+    DWORD SequenceLength;
+    DWORD BytesRemaining;
+    DWORD_PTR Word;
+    DWORD_PTR HighBits;
+    DWORD ByteIndex;
+    UCHAR Char;
+
+    Input = (PUCHAR)InputStringBuffer;
+    HighBits = (((DWORD_PTR)-1) / 0xFF) * 0x80;
+    Index = 0;
+    OutIndex = 0;
+
+    Value = 0;
+    SequenceLength = 0;
+    BytesRemaining = 0;
+    if (State != NULL) {
+        Value = State->Value;
+        SequenceLength = State->SequenceLength;
+        BytesRemaining = State->BytesRemaining;
+    }
+
+    while (Index < InputBufferLength) {
+        Char = Input[Index];
+
+        if (BytesRemaining == 0) {
+            if (Char < 0x80) {
+                OutputStringBuffer[OutIndex] = Char;
+                OutIndex++;
+                Index++;
+
+                //
+                //  Once the input is word aligned, convert a word at a time
+                //  for as long as no byte has its high bit set.
+                //
+
+                if ((((DWORD_PTR)&Input[Index]) & (sizeof(DWORD_PTR) - 1)) == 0) {
+                    while (Index + sizeof(DWORD_PTR) <= InputBufferLength) {
+                        Word = *(DWORD_PTR *)&Input[Index];
+                        if ((Word & HighBits) != 0) {
+                            break;
+                        }
+                        for (ByteIndex = 0; ByteIndex < sizeof(DWORD_PTR); ByteIndex++) {
+                            OutputStringBuffer[OutIndex + ByteIndex] = (WCHAR)(UCHAR)(Word >> (ByteIndex * 8));
+                        }
+                        OutIndex += sizeof(DWORD_PTR);
+                        Index += sizeof(DWORD_PTR);
+                    }
+                }
+                continue;
+            }
+
+            SequenceLength = YoriLibUtf8SequenceLength[Char];
+            Index++;
+            if (SequenceLength == 0) {
+                OutputStringBuffer[OutIndex] = YORI_LIB_REPLACEMENT_CHAR;
+                OutIndex++;
+                continue;
+            }
+            Value = Char & YoriLibUtf8LeadMask[SequenceLength];
+            BytesRemaining = SequenceLength - 1;
+            continue;
+        }
+
+        //
+        //  A sequence is in progress, so this byte should continue it.  If
+        //  it doesn't, the sequence is truncated, and this byte is
+        //  processed again as the start of a new sequence.
+        //
+
+        if ((Char & 0xC0) != 0x80) {
+            OutputStringBuffer[OutIndex] = YORI_LIB_REPLACEMENT_CHAR;
+            OutIndex++;
+            BytesRemaining = 0;
+            continue;
+        }
+
+        Value = (Value << 6) | (Char & 0x3F);
+        Index++;
+        BytesRemaining--;
+        if (BytesRemaining > 0) {
+            continue;
+        }
+
+        if (Value < YoriLibUtf8MinimumValue[SequenceLength] ||
+            Value > 0x10FFFF ||
+            (Value >= 0xD800 && Value <= 0xDFFF)) {
+
+            OutputStringBuffer[OutIndex] = YORI_LIB_REPLACEMENT_CHAR;
+            OutIndex++;
+        } else if (Value >= 0x10000) {
+            Value -= 0x10000;
+            OutputStringBuffer[OutIndex] = (WCHAR)(0xD800 + (Value >> 10));
+            OutputStringBuffer[OutIndex + 1] = (WCHAR)(0xDC00 + (Value & 0x3FF));
+            OutIndex += 2;
+        } else {
+            OutputStringBuffer[OutIndex] = (WCHAR)Value;
+            OutIndex++;
+        }
+    }
+
+    if (State != NULL) {
+        State->Value = Value;
+        State->SequenceLength = SequenceLength;
+        State->BytesRemaining = BytesRemaining;
+    } else if (BytesRemaining > 0) {
+        OutputStringBuffer[OutIndex] = YORI_LIB_REPLACEMENT_CHAR;
+        OutIndex++;
+    }
+
+    return OutIndex;
+}
+
+/**
+ Convert a UTF16 string into UTF8 in a single pass.  Runs of ASCII are
+ converted a machine word at a time.  Unpaired surrogates are converted to
+ U+FFFD.
+
+ @param State Optionally points to state which is carried between calls, so
+        that a surrogate pair which is split between two buffers can be
+        encoded.  If NULL, the input is assumed to be complete, and an
+        unpaired surrogate at the end is converted to U+FFFD.
+
+ @param InputStringBuffer Pointer to the UTF16 string.
+
+ @param InputBufferLength The length of InputStringBuffer, in characters.
+
+ @param OutputStringBuffer Pointer to a buffer to be populated with the
+        string in UTF8 form.  This must be able to hold
+        YORI_LIB_UTF8_BYTES_FOR_UTF16(InputBufferLength) bytes.
+
+ @return The number of bytes written to OutputStringBuffer.
+ */
+DWORD
+YoriLibUtf16ToUtf8(
+    __inout_opt PYORI_LIB_UTF8_ENCODE_STATE State,
+    __in_ecount(InputBufferLength) LPCWSTR InputStringBuffer,
+    __in DWORD InputBufferLength,
+    __out LPSTR OutputStringBuffer
+    )
+{
+    PUCHAR Output;
+    DWORD Index;
+    DWORD OutIndex;
+    DWORD Value;
+    DWORD HighSurrogate;
+    DWORD_PTR Word;
+    DWORD_PTR HighBits;
+    DWORD CharIndex;
+    WCHAR Char;
+
+    Output = (PUCHAR)OutputStringBuffer;
+    HighBits = (((DWORD_PTR)-1) / 0xFFFF) * 0xFF80;
+    Index = 0;
+    OutIndex = 0;
+
+    HighSurrogate = 0;
+    if (State != NULL) {
+        HighSurrogate = State->HighSurrogate;
+    }
+
+    while (Index < InputBufferLength) {
+        Char = InputStringBuffer[Index];
+
+        if (HighSurrogate != 0) {
+            if (Char >= 0xDC00 && Char <= 0xDFFF) {
+                Value = 0x10000 + ((HighSurrogate - 0xD800) << 10) + (Char - 0xDC00);
+                Output[OutIndex] = (UCHAR)(0xF0 | (Value >> 18));
+                Output[OutIndex + 1] = (UCHAR)(0x80 | ((Value >> 12) & 0x3F));
+                Output[OutIndex + 2] = (UCHAR)(0x80 | ((Value >> 6) & 0x3F));
+                Output[OutIndex + 3] = (UCHAR)(0x80 | (Value & 0x3F));
+                OutIndex += 4;
+                HighSurrogate = 0;
+                Index++;
+                continue;
+            }
+
+            //
+            //  The high surrogate is unpaired.  Process this character
+            //  again as the start of a new sequence.
+            //
+
+            Output[OutIndex] = 0xEF;
+            Output[OutIndex + 1] = 0xBF;
+            Output[OutIndex + 2] = 0xBD;
+            OutIndex += 3;
+            HighSurrogate = 0;
+            continue;
+        }
+
+        Index++;
+        if (Char < 0x80) {
+            Output[OutIndex] = (UCHAR)Char;
+            OutIndex++;
+
+            //
+            //  Once the input is word aligned, convert a word at a time
+            //  for as long as every character is ASCII.
+            //
+
+            if ((((DWORD_PTR)&InputStringBuffer[Index]) & (sizeof(DWORD_PTR) - 1)) == 0) {
+                while (Index + sizeof(DWORD_PTR) / sizeof(WCHAR) <= InputBufferLength) {
+                    Word = *(DWORD_PTR *)&InputStringBuffer[Index];
+                    if ((Word & HighBits) != 0) {
+                        break;
+                    }
+                    for (CharIndex = 0; CharIndex < sizeof(DWORD_PTR) / sizeof(WCHAR); CharIndex++) {
+                        Output[OutIndex + CharIndex] = (UCHAR)(Word >> (CharIndex * 16));
+                    }
+                    OutIndex += sizeof(DWORD_PTR) / sizeof(WCHAR);
+                    Index += sizeof(DWORD_PTR) / sizeof(WCHAR);
+                }
+            }
+        } else if (Char < 0x800) {
+            Output[OutIndex] = (UCHAR)(0xC0 | (Char >> 6));
+            Output[OutIndex + 1] = (UCHAR)(0x80 | (Char & 0x3F));
+            OutIndex += 2;
+        } else if (Char >= 0xD800 && Char <= 0xDBFF) {
+            HighSurrogate = Char;
+        } else {
+            if (Char >= 0xDC00 && Char <= 0xDFFF) {
+                Char = YORI_LIB_REPLACEMENT_CHAR;
+            }
+            Output[OutIndex] = (UCHAR)(0xE0 | (Char >> 12));
+            Output[OutIndex + 1] = (UCHAR)(0x80 | ((Char >> 6) & 0x3F));
+            Output[OutIndex + 2] = (UCHAR)(0x80 | (Char & 0x3F));
+            OutIndex += 3;
+        }
+    }
+
+    if (State != NULL) {
+        State->HighSurrogate = (WCHAR)HighSurrogate;
+    } else if (HighSurrogate != 0) {
+        Output[OutIndex] = 0xEF;
+        Output[OutIndex + 1] = 0xBF;
+        Output[OutIndex + 2] = 0xBD;
+        OutIndex += 3;
+    }
+
+    return OutIndex;
+}
+
 /**
  Returns the number of bytes needed to store a specified UTF16 string in
  the current output encoding.
@@ -266,4 +583,136 @@ YoriLibMultibyteInput(
     ASSERT(Return != 0);
 }
 
+/**
+ Convert a string from the input encoding into UTF16 and store the result in
+ a Yori string, reallocating the string if it is not large enough.  UTF8
+ input is converted by this library in a single pass, because the number of
+ characters in the result cannot exceed the number of bytes in the input.
+ Other encodings are sized and then converted by the system.
+
+ @param InputStringBuffer Pointer to a string in input encoding form.
+
+ @param InputBufferLength The size of InputStringBuffer, in bytes.
+
+ @param OutputString Pointer to a string to be populated with the string in
+        UTF16 format.  Any existing contents are discarded.  On success the
+        result is NULL terminated.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibMultibyteInputToString(
+    __in_ecount(InputBufferLength) LPCSTR InputStringBuffer,
+    __in DWORD InputBufferLength,
+    __inout PYORI_STRING OutputString
+    )
+{
+    DWORD CharsNeeded;
+    DWORD Encoding = YoriLibGetMultibyteInputEncoding();
+
+    if (Encoding == CP_UTF8 || Encoding == CP_UTF16) {
+        CharsNeeded = InputBufferLength;
+    } else if (InputBufferLength > 0) {
+        CharsNeeded = YoriLibGetMultibyteInputSizeNeeded(InputStringBuffer, InputBufferLength);
+    } else {
+        CharsNeeded = 0;
+    }
+
+    if (CharsNeeded >= OutputString->LengthAllocated) {
+        if (CharsNeeded >= (DWORD)-1 - 64) {
+            return FALSE;
+        }
+        OutputString->LengthInChars = 0;
+        if (!YoriLibReallocateString(OutputString, CharsNeeded + 64)) {
+            return FALSE;
+        }
+    }
+
+    if (Encoding == CP_UTF8) {
+        OutputString->LengthInChars = YoriLibUtf8ToUtf16(NULL, InputStringBuffer, InputBufferLength, OutputString->StartOfString);
+    } else {
+        if (InputBufferLength > 0) {
+            YoriLibMultibyteInput(InputStringBuffer,
+                                  InputBufferLength,
+                                  OutputString->StartOfString,
+                                  OutputString->LengthAllocated);
+        }
+        OutputString->LengthInChars = CharsNeeded;
+    }
+
+    OutputString->StartOfString[OutputString->LengthInChars] = '\0';
+    return TRUE;
+}
+
+/**
+ Convert a UTF16 string into the output encoding, allocating a larger output
+ buffer if the supplied one is not large enough.  UTF8 output is generated by
+ this library in a single pass into a buffer large enough for the worst case.
+ Other encodings are sized and then converted by the system.
+
+ @param InputStringBuffer Pointer to a UTF16 string.
+
+ @param InputBufferLength The size of InputStringBuffer, in characters.
+
+ @param OutputStringBuffer On input, points to a buffer to populate with the
+        string in the current output encoding.  If this buffer is not large
+        enough, it is updated to point to a new buffer allocated with
+        YoriLibMalloc, which the caller should free with YoriLibFree.  The
+        buffer supplied by the caller is never freed by this function.
+
+ @param OutputBufferLength On input, the length of OutputStringBuffer, in
+        bytes.  Updated to the length of any new buffer that is allocated.
+
+ @param BytesWritten On successful completion, updated to contain the number
+        of bytes of output.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibMultibyteOutputToBuffer(
+    __in_ecount(InputBufferLength) LPCTSTR InputStringBuffer,
+    __in DWORD InputBufferLength,
+    __inout LPSTR * OutputStringBuffer,
+    __inout PDWORD OutputBufferLength,
+    __out PDWORD BytesWritten
+    )
+{
+    DWORD BytesNeeded;
+    LPSTR NewBuffer;
+    DWORD Encoding = YoriLibGetMultibyteOutputEncoding();
+
+    if (Encoding == CP_UTF8) {
+        if (InputBufferLength > ((DWORD)-1 - 3) / 3) {
+            return FALSE;
+        }
+        BytesNeeded = YORI_LIB_UTF8_BYTES_FOR_UTF16(InputBufferLength);
+    } else if (InputBufferLength > 0) {
+        BytesNeeded = YoriLibGetMultibyteOutputSizeNeeded(InputStringBuffer, InputBufferLength);
+    } else {
+        BytesNeeded = 0;
+    }
+
+    if (BytesNeeded > *OutputBufferLength) {
+        NewBuffer = YoriLibMalloc(BytesNeeded);
+        if (NewBuffer == NULL) {
+            return FALSE;
+        }
+        *OutputStringBuffer = NewBuffer;
+        *OutputBufferLength = BytesNeeded;
+    }
+
+    if (Encoding == CP_UTF8) {
+        *BytesWritten = YoriLibUtf16ToUtf8(NULL, InputStringBuffer, InputBufferLength, *OutputStringBuffer);
+    } else {
+        if (BytesNeeded > 0) {
+            YoriLibMultibyteOutput(InputStringBuffer, InputBufferLength, *OutputStringBuffer, BytesNeeded);
+        }
+        *BytesWritten = BytesNeeded;
+    }
+
+    return TRUE;
+}
+
 // vim:sw=4:ts=4:et:
@@ -84,6 +84,7 @@ typedef struct _YORI_LIB_LINE_READ_CONTEXT {
  Copy the contents of a line into a user specified buffer.  If the buffer
  is not large enough, it is reallocated.  This function performs encoding
  conversions to ensure the resulting string is in host (UTF16) encoding.
+ UTF8 lines are converted in a single pass rather than being sized first.
 
  @param UserString The user provided string to populate with a line.
 
@@ -102,31 +103,7 @@ YoriLibCopyLineToUserBufferW(
     __in DWORD CharsToCopy
     )
 {
-    DWORD CharsNeeded;
-
-    if (CharsToCopy == 0) {
-        CharsNeeded = 1;
-    } else {
-        CharsNeeded = YoriLibGetMultibyteInputSizeNeeded(SourceBuffer, CharsToCopy) + 1;
-    }
-
-    if (CharsNeeded > UserString->LengthAllocated) {
-        UserString->LengthInChars = 0;
-        if (!YoriLibReallocateString(UserString, CharsNeeded + 64)) {
-            return FALSE;
-        }
-    }
-
-    if (CharsToCopy > 0) {
-        YoriLibMultibyteInput(SourceBuffer,
-                              CharsToCopy,
-                              UserString->StartOfString,
-                              UserString->LengthAllocated);
-    }
-
-    UserString->LengthInChars = CharsNeeded - 1;
-    UserString->StartOfString[UserString->LengthInChars] = '\0';
-    return TRUE;
+    return YoriLibMultibyteInputToString(SourceBuffer, CharsToCopy, UserString);
 }
 
 /**
@@ -175,17 +152,146 @@ YoriLibBytesInBom(
 
 
 /**
- Read a line from an input stream.
+ Search a buffer of 8 bit characters for the first carriage return or line
+ feed character.  This examines a machine word at a time, so that the common
+ case of a buffer containing long lines without line ends can be processed
+ without examining each byte individually.
 
- @param UserString Pointer to a string to be updated to contain data for a
-        line.  This must be initialized by the caller and the caller's buffer
-        will be used if it is large enough.  If not, this function may
-        reallocate the string to point to a new buffer.
+ @param Buffer Pointer to the buffer to search.
+
+ @param CharCount The number of characters in the buffer.
+
+ @return The offset of the first line end character, or CharCount if the
+         buffer contains no line end characters.
+ */
+DWORD
+YoriLibFindLineEndA(
+    __in PUCHAR Buffer,
+    __in DWORD CharCount
+    )
+{
+    DWORD Index;
+    DWORD_PTR Word;
+    DWORD_PTR CrBits;
+    DWORD_PTR LfBits;
+    DWORD_PTR Ones;
+    DWORD_PTR HighBits;
+
+    Index = 0;
+
+    //
+    //  Process characters until the buffer is word aligned.
+    //
+
+    while (Index < CharCount && (((DWORD_PTR)&Buffer[Index]) & (sizeof(DWORD_PTR) - 1)) != 0) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            return Index;
+        }
+        Index++;
+    }
+
+    //
+    //  Check a word at a time.  XORing with a repeated pattern turns
+    //  matching bytes into zero, and the subtraction only borrows into the
+    //  high bit of a byte that was zero.
+    //
+
+    Ones = ((DWORD_PTR)-1) / 0xFF;
+    HighBits = Ones * 0x80;
+
+    while (Index + sizeof(DWORD_PTR) <= CharCount) {
+        Word = *(DWORD_PTR *)&Buffer[Index];
+        CrBits = Word ^ (Ones * 0xD);
+        LfBits = Word ^ (Ones * 0xA);
+        CrBits = (CrBits - Ones) & ~CrBits;
+        LfBits = (LfBits - Ones) & ~LfBits;
+        if (((CrBits | LfBits) & HighBits) != 0) {
+            break;
+        }
+        Index += sizeof(DWORD_PTR);
+    }
+
+    while (Index < CharCount) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            return Index;
+        }
+        Index++;
+    }
+
+    return CharCount;
+}
+
+/**
+ Search a buffer of 16 bit characters for the first carriage return or line
+ feed character.  This examines a machine word at a time, so that the common
+ case of a buffer containing long lines without line ends can be processed
+ without examining each character individually.
+
+ @param Buffer Pointer to the buffer to search.
+
+ @param CharCount The number of characters in the buffer.
+
+ @return The offset of the first line end character, or CharCount if the
+         buffer contains no line end characters.
+ */
+DWORD
+YoriLibFindLineEndW(
+    __in PWCHAR Buffer,
+    __in DWORD CharCount
+    )
+{
+    DWORD Index;
+    DWORD_PTR Word;
+    DWORD_PTR CrBits;
+    DWORD_PTR LfBits;
+    DWORD_PTR Ones;
+    DWORD_PTR HighBits;
+
+    Index = 0;
+
+    while (Index < CharCount && (((DWORD_PTR)&Buffer[Index]) & (sizeof(DWORD_PTR) - 1)) != 0) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            return Index;
+        }
+        Index++;
+    }
+
+    Ones = ((DWORD_PTR)-1) / 0xFFFF;
+    HighBits = Ones * 0x8000;
+
+    while (Index + sizeof(DWORD_PTR) / sizeof(WCHAR) <= CharCount) {
+        Word = *(DWORD_PTR *)&Buffer[Index];
+        CrBits = Word ^ (Ones * 0xD);
+        LfBits = Word ^ (Ones * 0xA);
+        CrBits = (CrBits - Ones) & ~CrBits;
+        LfBits = (LfBits - Ones) & ~LfBits;
+        if (((CrBits | LfBits) & HighBits) != 0) {
+            break;
+        }
+        Index += sizeof(DWORD_PTR) / sizeof(WCHAR);
+    }
+
+    while (Index < CharCount) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            return Index;
+        }
+        Index++;
+    }
+
+    return CharCount;
+}
+
+/**
+ Read a line from an input stream and return a pointer to it within the
+ line read context's buffer, without performing any encoding conversion.
 
  @param Context Pointer to a PVOID sized block of memory that should be
         initialized to NULL for the first line read, and will be updated by
         this function.
 
+ @param InitialBufferSize The minimum size of the buffer to allocate if the
+        context does not have a buffer yet.
+
  @param ReturnFinalNonTerminatedLine If TRUE, treat any line at the end of the
         stream without a line ending character to be a line to return.  If
         FALSE, assume new input could arrive that means we just haven't
@@ -198,25 +304,29 @@ YoriLibBytesInBom(
 
  @param FileHandle Specifies the handle to the file to read the line from.
 
+ @param CharsInLine On successful completion, set to the number of
+        characters in the line, excluding any line end.  Characters are 16
+        bit if the context is reading wide characters, and 8 bit otherwise.
+
  @param LineTerminated On successful completion, set to TRUE to indicate
         a complete line with line end was found.  Set to FALSE to indicate
-        no line end was found.  This can happen if
-        ReturnFinalNonTerminatedLine is TRUE or MaximumDelay is less than
-        infinite and a partial line was found.
+        no line end was found.
 
  @param TimeoutReached On successful completion, set to TRUE to indicate that
-        the timeout value in MaximumDelay was reached.  If MaximumDelay is
-        INFINITE, this cannot happen.
+        the timeout value in MaximumDelay was reached.
 
- @return Pointer to the Line buffer for success, NULL on failure.
+ @return Pointer to the start of the line within the context's buffer for
+         success, NULL on failure.  The buffer remains valid until the next
+         call using this context.
  */
 PVOID
-YoriLibReadLineToStringEx(
-    __in PYORI_STRING UserString,
+YoriLibReadLineInternal(
     __inout PVOID * Context,
+    __in DWORD InitialBufferSize,
     __in BOOL ReturnFinalNonTerminatedLine,
     __in DWORD MaximumDelay,
     __in HANDLE FileHandle,
+    __out PDWORD CharsInLine,
     __out PBOOL LineTerminated,
     __out PBOOL TimeoutReached
     )
@@ -237,6 +347,7 @@ YoriLibReadLineToStringEx(
     DWORD CumulativeDelay;
 
     *TimeoutReached = FALSE;
+    *CharsInLine = 0;
     FileType = GetFileType(FileHandle);
 
     //
@@ -246,7 +357,6 @@ YoriLibReadLineToStringEx(
     if (*Context == NULL) {
         ReadContext = YoriLibMalloc(sizeof(YORI_LIB_LINE_READ_CONTEXT));
         if (ReadContext == NULL) {
-            UserString->LengthInChars = 0;
             *LineTerminated = FALSE;
             return NULL;
         }
@@ -274,13 +384,12 @@ YoriLibReadLineToStringEx(
     //
 
     if (ReadContext->PreviousBuffer == NULL) {
-        ReadContext->LengthOfBuffer = UserString->LengthAllocated;
+        ReadContext->LengthOfBuffer = InitialBufferSize;
         if (ReadContext->LengthOfBuffer < 256 * 1024) {
             ReadContext->LengthOfBuffer = 256 * 1024;
         }
         ReadContext->PreviousBuffer = YoriLibMalloc(ReadContext->LengthOfBuffer);
         if (ReadContext->PreviousBuffer == NULL) {
-            UserString->LengthInChars = 0;
             *LineTerminated = FALSE;
             ReadContext->Terminated = TRUE;
             return NULL;
@@ -294,103 +403,86 @@ YoriLibReadLineToStringEx(
 
         //
         //  Scan through the buffer looking for newlines.  If we find one,
-        //  copy the data back into the caller's buffer.  Copy any remaining
-        //  buffer back to the beginning of the holdover buffer, and
-        //  decrement chars there accordingly.
+        //  return the line to the caller.  Copy any remaining buffer back
+        //  to the beginning of the holdover buffer, and decrement chars
+        //  there accordingly.
         //
 
         if (ReadContext->ReadWChars) {
             PWCHAR WideBuffer = (PWCHAR)YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
             CharsRemaining = (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset) / sizeof(WCHAR);
-            for (Count = 0; Count < CharsRemaining; Count++) {
-                if (WideBuffer[Count] == 0xD ||
-                    WideBuffer[Count] == 0xA) {
-
-                    ProcessThisLine = TRUE;
-
-                    CharsToCopy = Count;
-                    if (WideBuffer[Count] == 0xD) {
-                        if ((Count + 1) * sizeof(WCHAR) < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
-                            if (WideBuffer[Count + 1] == 0xA) {
-                                Count++;
-                            }
-                        } else if (ReadContext->CurrentBufferOffset > 0) {
-                            ProcessThisLine = FALSE;
+            Count = YoriLibFindLineEndW(WideBuffer, CharsRemaining);
+            if (Count < CharsRemaining) {
+
+                ProcessThisLine = TRUE;
+
+                CharsToCopy = Count;
+                if (WideBuffer[Count] == 0xD) {
+                    if ((Count + 1) * sizeof(WCHAR) < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
+                        if (WideBuffer[Count + 1] == 0xA) {
+                            Count++;
                         }
+                    } else if (ReadContext->CurrentBufferOffset > 0) {
+                        ProcessThisLine = FALSE;
                     }
+                }
 
-                    Count++;
+                Count++;
 
-                    if (ProcessThisLine) {
+                if (ProcessThisLine) {
 
-                        CharsToSkip = 0;
-                        if (!BomFound && ReadContext->LinesRead == 0) {
-                            CharsToSkip = YoriLibBytesInBom(ReadContext->PreviousBuffer, CharsToCopy * sizeof(WCHAR));
-                            if (CharsToSkip > 0) {
-                                BomFound = TRUE;
-                                CharsToSkip = CharsToSkip / sizeof(WCHAR);
-                                CharsToCopy -= CharsToSkip;
-                            }
-                        }
-                        if (YoriLibCopyLineToUserBufferW(UserString, (LPSTR)&WideBuffer[CharsToSkip], CharsToCopy)) {
-                            ReadContext->CurrentBufferOffset += Count * sizeof(WCHAR);
-                            ReadContext->LinesRead++;
-                            *LineTerminated = TRUE;
-                            return UserString->StartOfString;
-                        } else {
-                            UserString->LengthInChars = 0;
-                            *LineTerminated = FALSE;
-                            ReadContext->Terminated = TRUE;
-                            return NULL;
+                    CharsToSkip = 0;
+                    if (!BomFound && ReadContext->LinesRead == 0) {
+                        CharsToSkip = YoriLibBytesInBom(ReadContext->PreviousBuffer, CharsToCopy * sizeof(WCHAR));
+                        if (CharsToSkip > 0) {
+                            BomFound = TRUE;
+                            CharsToSkip = CharsToSkip / sizeof(WCHAR);
+                            CharsToCopy -= CharsToSkip;
                         }
                     }
+                    ReadContext->CurrentBufferOffset += Count * sizeof(WCHAR);
+                    ReadContext->LinesRead++;
+                    *CharsInLine = CharsToCopy;
+                    *LineTerminated = TRUE;
+                    return &WideBuffer[CharsToSkip];
                 }
             }
         } else {
             PUCHAR Buffer = YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
             CharsRemaining = ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset;
-            for (Count = 0; Count < CharsRemaining; Count++) {
+            Count = YoriLibFindLineEndA(Buffer, CharsRemaining);
+            if (Count < CharsRemaining) {
 
-                if (Buffer[Count] == 0xD ||
-                    Buffer[Count] == 0xA) {
+                ProcessThisLine = TRUE;
 
-                    ProcessThisLine = TRUE;
-
-                    CharsToCopy = Count;
-                    if (Buffer[Count] == 0xD) {
-                        if (Count + 1 < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
-                            if (Buffer[Count + 1] == 0xA) {
-                                Count++;
-                            }
-                        } else if (ReadContext->CurrentBufferOffset > 0) {
-                            ProcessThisLine = FALSE;
+                CharsToCopy = Count;
+                if (Buffer[Count] == 0xD) {
+                    if (Count + 1 < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
+                        if (Buffer[Count + 1] == 0xA) {
+                            Count++;
                         }
+                    } else if (ReadContext->CurrentBufferOffset > 0) {
+                        ProcessThisLine = FALSE;
                     }
+                }
 
-                    Count++;
+                Count++;
 
-                    if (ProcessThisLine) {
+                if (ProcessThisLine) {
 
-                        CharsToSkip = 0;
-                        if (!BomFound && ReadContext->LinesRead == 0) {
-                            CharsToSkip = YoriLibBytesInBom(ReadContext->PreviousBuffer, CharsToCopy);
-                            if (CharsToSkip > 0) {
-                                BomFound = TRUE;
-                                CharsToCopy -= CharsToSkip;
-                            }
-                        }
-                        if (YoriLibCopyLineToUserBufferW(UserString, (LPSTR)&Buffer[CharsToSkip], CharsToCopy)) {
-                            ReadContext->CurrentBufferOffset += Count;
-                            ReadContext->LinesRead++;
-                            *LineTerminated = TRUE;
-                            return UserString->StartOfString;
-                        } else {
-                            UserString->LengthInChars = 0;
-                            *LineTerminated = FALSE;
-                            ReadContext->Terminated = TRUE;
-                            return NULL;
+                    CharsToSkip = 0;
+                    if (!BomFound && ReadContext->LinesRead == 0) {
+                        CharsToSkip = YoriLibBytesInBom(ReadContext->PreviousBuffer, CharsToCopy);
+                        if (CharsToSkip > 0) {
+                            BomFound = TRUE;
+                            CharsToCopy -= CharsToSkip;
                         }
                     }
+                    ReadContext->CurrentBufferOffset += Count;
+                    ReadContext->LinesRead++;
+                    *CharsInLine = CharsToCopy;
+                    *LineTerminated = TRUE;
+                    return &Buffer[CharsToSkip];
                 }
             }
         }
@@ -414,12 +506,10 @@ YoriLibReadLineToStringEx(
         //
 
         if (ReadContext->LengthOfBuffer == ReadContext->BytesInBuffer) {
-            UserString->LengthInChars = 0;
             *LineTerminated = FALSE;
             ReadContext->Terminated = TRUE;
             return NULL;
         }
-
         //
         //  Wait for more data, or for cancellation if it's enabled.
         //
@@ -542,7 +632,8 @@ YoriLibReadLineToStringEx(
 
                     //
                     //  We're at the end of the file.  Return what we have, even if
-                    //  there's not a newline character.
+                    //  there's not a newline character.  The buffer contents
+                    //  remain valid since the context is now terminated.
                     //
 
                     CharsToSkip = 0;
@@ -557,14 +648,12 @@ YoriLibReadLineToStringEx(
                     if (ReadContext->ReadWChars) {
                         CharsToCopy = CharsToCopy / sizeof(WCHAR);
                     }
-                    if (YoriLibCopyLineToUserBufferW(UserString, &ReadContext->PreviousBuffer[CharsToSkip], CharsToCopy)) {
-                        ReadContext->BytesInBuffer = 0;
-                        *LineTerminated = FALSE;
-                        return UserString->StartOfString;
-                    }
+                    ReadContext->BytesInBuffer = 0;
+                    *CharsInLine = CharsToCopy;
+                    *LineTerminated = FALSE;
+                    return &ReadContext->PreviousBuffer[CharsToSkip];
                 }
             }
-            UserString->LengthInChars = 0;
             *LineTerminated = FALSE;
             return NULL;
         }
@@ -574,6 +663,194 @@ YoriLibReadLineToStringEx(
     } while(TRUE);
 }
 
+/**
+ Read a line from an input stream.
+
+ @param UserString Pointer to a string to be updated to contain data for a
+        line.  This must be initialized by the caller and the caller's buffer
+        will be used if it is large enough.  If not, this function may
+        reallocate the string to point to a new buffer.
+
+ @param Context Pointer to a PVOID sized block of memory that should be
+        initialized to NULL for the first line read, and will be updated by
+        this function.
+
+ @param ReturnFinalNonTerminatedLine If TRUE, treat any line at the end of the
+        stream without a line ending character to be a line to return.  If
+        FALSE, assume new input could arrive that means we just haven't
+        observed the line break yet.
+
+ @param MaximumDelay Specifies the maximum amount of time to wait for a
+        complete line.  This value can be INFINITE or a specified number of
+        milliseconds.  If the timeout value is reached, TimeoutReached will
+        be set to true and the function will return NULL.
+
+ @param FileHandle Specifies the handle to the file to read the line from.
+
+ @param LineTerminated On successful completion, set to TRUE to indicate
+        a complete line with line end was found.  Set to FALSE to indicate
+        no line end was found.  This can happen if
+        ReturnFinalNonTerminatedLine is TRUE or MaximumDelay is less than
+        infinite and a partial line was found.
+
+ @param TimeoutReached On successful completion, set to TRUE to indicate that
+        the timeout value in MaximumDelay was reached.  If MaximumDelay is
+        INFINITE, this cannot happen.
+
+ @return Pointer to the Line buffer for success, NULL on failure.
+ */
+PVOID
+YoriLibReadLineToStringEx(
+    __in PYORI_STRING UserString,
+    __inout PVOID * Context,
+    __in BOOL ReturnFinalNonTerminatedLine,
+    __in DWORD MaximumDelay,
+    __in HANDLE FileHandle,
+    __out PBOOL LineTerminated,
+    __out PBOOL TimeoutReached
+    )
+{
+    PVOID Line;
+    DWORD CharsInLine;
+
+    Line = YoriLibReadLineInternal(Context,
+                                   UserString->LengthAllocated,
+                                   ReturnFinalNonTerminatedLine,
+                                   MaximumDelay,
+                                   FileHandle,
+                                   &CharsInLine,
+                                   LineTerminated,
+                                   TimeoutReached);
+
+    if (Line == NULL) {
+        UserString->LengthInChars = 0;
+        return NULL;
+    }
+
+    if (!YoriLibCopyLineToUserBufferW(UserString, Line, CharsInLine)) {
+        UserString->LengthInChars = 0;
+        *LineTerminated = FALSE;
+        ((PYORI_LIB_LINE_READ_CONTEXT)*Context)->Terminated = TRUE;
+        return NULL;
+    }
+
+    return UserString->StartOfString;
+}
+
+/**
+ Read a line from an input stream without copying it or converting its
+ encoding.  The returned view refers to the line reader's internal buffer
+ and is only valid until the next call using the same context.  Callers
+ which only need to count or forward lines can use this directly, and
+ callers that need the line in host encoding can call
+ @ref YoriLibLineViewToString .
+
+ @param Context Pointer to a PVOID sized block of memory that should be
+        initialized to NULL for the first line read, and will be updated by
+        this function.
+
+ @param ReturnFinalNonTerminatedLine If TRUE, treat any line at the end of the
+        stream without a line ending character to be a line to return.  If
+        FALSE, assume new input could arrive that means we just haven't
+        observed the line break yet.
+
+ @param MaximumDelay Specifies the maximum amount of time to wait for a
+        complete line.  This value can be INFINITE or a specified number of
+        milliseconds.
+
+ @param FileHandle Specifies the handle to the file to read the line from.
+
+ @param LineView On successful completion, updated to describe the line.
+
+ @param LineTerminated On successful completion, set to TRUE to indicate
+        a complete line with line end was found.  Set to FALSE to indicate
+        no line end was found.
+
+ @param TimeoutReached On successful completion, set to TRUE to indicate that
+        the timeout value in MaximumDelay was reached.
+
+ @return TRUE to indicate a line was returned, FALSE on failure or at the
+         end of the stream.
+ */
+BOOL
+YoriLibReadLineToViewEx(
+    __inout PVOID * Context,
+    __in BOOL ReturnFinalNonTerminatedLine,
+    __in DWORD MaximumDelay,
+    __in HANDLE FileHandle,
+    __out PYORI_LIB_LINE_VIEW LineView,
+    __out PBOOL LineTerminated,
+    __out PBOOL TimeoutReached
+    )
+{
+    LineView->Line = YoriLibReadLineInternal(Context,
+                                             0,
+                                             ReturnFinalNonTerminatedLine,
+                                             MaximumDelay,
+                                             FileHandle,
+                                             &LineView->CharsInLine,
+                                             LineTerminated,
+                                             TimeoutReached);
+
+    if (LineView->Line == NULL) {
+        LineView->CharsInLine = 0;
+        LineView->WideChars = FALSE;
+        return FALSE;
+    }
+
+    LineView->WideChars = ((PYORI_LIB_LINE_READ_CONTEXT)*Context)->ReadWChars;
+    return TRUE;
+}
+
+/**
+ Read a line from an input stream without copying it or converting its
+ encoding.  Any line at the end of the stream without a line ending is
+ returned as a line.
+
+ @param Context Pointer to a PVOID sized block of memory that should be
+        initialized to NULL for the first line read, and will be updated by
+        this function.
+
+ @param FileHandle Specifies the handle to the file to read the line from.
+
+ @param LineView On successful completion, updated to describe the line.
+        This is only valid until the next call using the same context.
+
+ @return TRUE to indicate a line was returned, FALSE on failure or at the
+         end of the stream.
+ */
+BOOL
+YoriLibReadLineToView(
+    __inout PVOID * Context,
+    __in HANDLE FileHandle,
+    __out PYORI_LIB_LINE_VIEW LineView
+    )
+{
+    BOOL LineTerminated;
+    BOOL TimeoutReached;
+
+    return YoriLibReadLineToViewEx(Context, TRUE, INFINITE, FileHandle, LineView, &LineTerminated, &TimeoutReached);
+}
+
+/**
+ Convert a line view into a string in host (UTF16) encoding.  If the string
+ is not large enough, it is reallocated.
+
+ @param LineView Pointer to the line view to convert.
+
+ @param UserString The user provided string to populate with the line.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibLineViewToString(
+    __in PYORI_LIB_LINE_VIEW LineView,
+    __inout PYORI_STRING UserString
+    )
+{
+    return YoriLibCopyLineToUserBufferW(UserString, LineView->Line, LineView->CharsInLine);
+}
+
 /**
  Read a line from an input stream.
 
@@ -622,4 +899,427 @@ YoriLibLineReadClose(
     }
 }
 
+/**
+ The maximum number of bytes to map at a time when reading lines from a file
+ through a memory mapping.  Files larger than this are mapped in a sliding
+ window.  Lines which do not fit in a single window are not returned, in the
+ same way that lines which do not fit in the line reader's buffer are not
+ returned.
+ */
+#ifdef _WIN64
+#define YORI_LIB_LINE_MAP_VIEW_SIZE (1024 * 1024 * 1024)
+#else
+#define YORI_LIB_LINE_MAP_VIEW_SIZE (64 * 1024 * 1024)
+#endif
+
+/**
+ Context to be passed between repeated mapped line read calls.  If the file
+ can be mapped, lines are returned from the mapping.  If not, lines are
+ returned from the regular line reader.
+ */
+typedef struct _YORI_LIB_MAPPED_LINE_READ_CONTEXT {
+
+    /**
+     A handle to the file mapping, or NULL if lines are being read through
+     the regular line reader.
+     */
+    HANDLE hMapping;
+
+    /**
+     The context of the regular line reader, used if the file cannot be
+     mapped.
+     */
+    PVOID StreamContext;
+
+    /**
+     Pointer to the currently mapped range of the file.
+     */
+    PUCHAR View;
+
+    /**
+     The offset within the file of the start of View.
+     */
+    DWORDLONG ViewOffset;
+
+    /**
+     The number of bytes in View.
+     */
+    DWORD ViewLength;
+
+    /**
+     The offset within View of the data that has not yet been returned.
+     */
+    DWORD CurrentViewOffset;
+
+    /**
+     The size of the file when the mapping was created.  Data written to the
+     file after this point is not returned.
+     */
+    DWORDLONG FileSize;
+
+    /**
+     The granularity that views must be aligned to.
+     */
+    DWORD AllocationGranularity;
+
+    /**
+     The number of lines successfully read.
+     */
+    LONGLONG LinesRead;
+
+    /**
+     If TRUE, the file contains 16 bit characters.  If FALSE, it contains
+     8 bit characters.
+     */
+    BOOLEAN ReadWChars;
+
+    /**
+     If TRUE, the end of the file has been reached or an error has occurred,
+     and future operations should fail.
+     */
+    BOOLEAN Terminated;
+
+} YORI_LIB_MAPPED_LINE_READ_CONTEXT, *PYORI_LIB_MAPPED_LINE_READ_CONTEXT;
+
+/**
+ Map a range of a file, starting from the specified offset, into a mapped
+ line read context.  Any previous view is unmapped.
+
+ @param ReadContext Pointer to the mapped line read context.
+
+ @param Offset The offset within the file of the data that should be
+        mapped.  The view starts at or before this offset so that it is
+        suitably aligned.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibMappedLineReadMapView(
+    __inout PYORI_LIB_MAPPED_LINE_READ_CONTEXT ReadContext,
+    __in DWORDLONG Offset
+    )
+{
+    DWORDLONG ViewOffset;
+    DWORDLONG ViewLength;
+    LARGE_INTEGER MapOffset;
+
+    if (ReadContext->View != NULL) {
+        UnmapViewOfFile(ReadContext->View);
+        ReadContext->View = NULL;
+    }
+
+    ViewOffset = Offset - (Offset % ReadContext->AllocationGranularity);
+    ViewLength = ReadContext->FileSize - ViewOffset;
+    if (ViewLength > YORI_LIB_LINE_MAP_VIEW_SIZE) {
+        ViewLength = YORI_LIB_LINE_MAP_VIEW_SIZE;
+    }
+
+    MapOffset.QuadPart = ViewOffset;
+    ReadContext->View = MapViewOfFile(ReadContext->hMapping, FILE_MAP_READ, MapOffset.HighPart, MapOffset.LowPart, (SIZE_T)ViewLength);
+    if (ReadContext->View == NULL) {
+        return FALSE;
+    }
+
+    ReadContext->ViewOffset = ViewOffset;
+    ReadContext->ViewLength = (DWORD)ViewLength;
+    ReadContext->CurrentViewOffset = (DWORD)(Offset - ViewOffset);
+    return TRUE;
+}
+
+/**
+ Allocate a mapped line read context for a file.  If the file is a regular
+ file on disk that can be mapped, the context refers to the mapping.  If
+ not, the context refers to the regular line reader.
+
+ @param FileHandle Specifies the handle to the file to read lines from.
+
+ @return Pointer to the allocated context, or NULL on failure.
+ */
+PYORI_LIB_MAPPED_LINE_READ_CONTEXT
+YoriLibMappedLineReadAllocateContext(
+    __in HANDLE FileHandle
+    )
+{
+    PYORI_LIB_MAPPED_LINE_READ_CONTEXT ReadContext;
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER CurrentOffset;
+    SYSTEM_INFO SystemInfo;
+
+    ReadContext = YoriLibMalloc(sizeof(YORI_LIB_MAPPED_LINE_READ_CONTEXT));
+    if (ReadContext == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(ReadContext, sizeof(YORI_LIB_MAPPED_LINE_READ_CONTEXT));
+    if (YoriLibGetMultibyteInputEncoding() == CP_UTF16) {
+        ReadContext->ReadWChars = TRUE;
+    }
+
+    if ((GetFileType(FileHandle) & ~(FILE_TYPE_REMOTE)) != FILE_TYPE_DISK) {
+        return ReadContext;
+    }
+
+    FileSize.LowPart = GetFileSize(FileHandle, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        return ReadContext;
+    }
+
+    //
+    //  Lines are returned from the current file position, so that a caller
+    //  which has already consumed part of the file sees the same result as
+    //  it would from the line reader.  Empty files cannot be mapped, and
+    //  have no lines anyway.
+    //
+
+    CurrentOffset.HighPart = 0;
+    CurrentOffset.LowPart = SetFilePointer(FileHandle, 0, &CurrentOffset.HighPart, FILE_CURRENT);
+    if (CurrentOffset.LowPart == INVALID_SET_FILE_POINTER && GetLastError() != NO_ERROR) {
+        return ReadContext;
+    }
+
+    if (FileSize.QuadPart == 0 || CurrentOffset.QuadPart >= FileSize.QuadPart) {
+        return ReadContext;
+    }
+
+    ReadContext->hMapping = CreateFileMapping(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (ReadContext->hMapping == NULL) {
+        return ReadContext;
+    }
+
+    GetSystemInfo(&SystemInfo);
+    ReadContext->AllocationGranularity = SystemInfo.dwAllocationGranularity;
+    ReadContext->FileSize = FileSize.QuadPart;
+
+    if (!YoriLibMappedLineReadMapView(ReadContext, CurrentOffset.QuadPart)) {
+        CloseHandle(ReadContext->hMapping);
+        ReadContext->hMapping = NULL;
+        return ReadContext;
+    }
+
+    //
+    //  Move the file position to the end of the data that will be returned
+    //  from the mapping.
+    //
+
+    SetFilePointer(FileHandle, FileSize.LowPart, &FileSize.HighPart, FILE_BEGIN);
+
+    return ReadContext;
+}
+
+/**
+ Read a line from a file, using a memory mapping if the file can be mapped,
+ and return a view of the line without copying it or converting its
+ encoding.  If the file is mapped, the view refers directly to the mapping,
+ so no data is copied from the kernel or moved within a buffer.  If the file
+ cannot be mapped, such as when it is a pipe, this behaves like
+ @ref YoriLibReadLineToView .  Any line at the end of the file without a
+ line ending is returned as a line.
+
+ @param Context Pointer to a PVOID sized block of memory that should be
+        initialized to NULL for the first line read, and will be updated by
+        this function.
+
+ @param FileHandle Specifies the handle to the file to read the line from.
+
+ @param LineView On successful completion, updated to describe the line.
+        This is only valid until the next call using the same context.
+
+ @return TRUE to indicate a line was returned, FALSE on failure or at the
+         end of the file.
+ */
+BOOL
+YoriLibMappedLineReadToView(
+    __inout PVOID * Context,
+    __in HANDLE FileHandle,
+    __out PYORI_LIB_LINE_VIEW LineView
+    )
+{
+    PYORI_LIB_MAPPED_LINE_READ_CONTEXT ReadContext;
+    PUCHAR Buffer;
+    DWORD CharSize;
+    DWORD CharsRemaining;
+    DWORD Count;
+    DWORD CharsInLine;
+    DWORD CharsToSkip;
+    DWORD LineEndChar;
+    DWORDLONG FileOffset;
+    BOOLEAN EndOfFileMapped;
+
+    LineView->Line = NULL;
+    LineView->CharsInLine = 0;
+    LineView->WideChars = FALSE;
+
+    if (*Context == NULL) {
+        *Context = YoriLibMappedLineReadAllocateContext(FileHandle);
+        if (*Context == NULL) {
+            return FALSE;
+        }
+    }
+
+    ReadContext = *Context;
+    if (ReadContext->hMapping == NULL) {
+        return YoriLibReadLineToView(&ReadContext->StreamContext, FileHandle, LineView);
+    }
+
+    if (ReadContext->Terminated) {
+        return FALSE;
+    }
+
+    CharSize = 1;
+    if (ReadContext->ReadWChars) {
+        CharSize = sizeof(WCHAR);
+    }
+
+    while (TRUE) {
+        Buffer = &ReadContext->View[ReadContext->CurrentViewOffset];
+        CharsRemaining = (ReadContext->ViewLength - ReadContext->CurrentViewOffset) / CharSize;
+        EndOfFileMapped = (BOOLEAN)(ReadContext->ViewOffset + ReadContext->ViewLength == ReadContext->FileSize);
+
+        if (ReadContext->ReadWChars) {
+            Count = YoriLibFindLineEndW((PWCHAR)Buffer, CharsRemaining);
+        } else {
+            Count = YoriLibFindLineEndA(Buffer, CharsRemaining);
+        }
+
+        if (Count < CharsRemaining) {
+            CharsInLine = Count;
+            if (ReadContext->ReadWChars) {
+                LineEndChar = ((PWCHAR)Buffer)[Count];
+            } else {
+                LineEndChar = Buffer[Count];
+            }
+
+            //
+            //  A carriage return may be followed by a line feed in the next
+            //  view, so if the carriage return is the final character in the
+            //  view, map the next range before deciding.
+            //
+
+            if (LineEndChar == 0xD && Count + 1 == CharsRemaining && !EndOfFileMapped) {
+                Count = CharsRemaining;
+            } else {
+                if (LineEndChar == 0xD && Count + 1 < CharsRemaining) {
+                    if (ReadContext->ReadWChars) {
+                        LineEndChar = ((PWCHAR)Buffer)[Count + 1];
+                    } else {
+                        LineEndChar = Buffer[Count + 1];
+                    }
+                    if (LineEndChar == 0xA) {
+                        Count++;
+                    }
+                }
+                Count++;
+                break;
+            }
+        }
+
+        //
+        //  No line end was found in the view.  If the view extends to the
+        //  end of the file, the remainder is the final line.
+        //
+
+        if (EndOfFileMapped) {
+            ReadContext->Terminated = TRUE;
+            if (CharsRemaining == 0) {
+                return FALSE;
+            }
+            CharsInLine = CharsRemaining;
+            Count = CharsRemaining;
+            break;
+        }
+
+        //
+        //  If the line started at the beginning of the view, it cannot fit
+        //  in any view.  Otherwise, map a view starting at the line.
+        //
+
+        FileOffset = ReadContext->ViewOffset + ReadContext->CurrentViewOffset;
+        if (FileOffset - (FileOffset % ReadContext->AllocationGranularity) == ReadContext->ViewOffset ||
+            !YoriLibMappedLineReadMapView(ReadContext, FileOffset)) {
+
+            ReadContext->Terminated = TRUE;
+            return FALSE;
+        }
+    }
+
+    CharsToSkip = 0;
+    if (ReadContext->LinesRead == 0) {
+        CharsToSkip = YoriLibBytesInBom((PCHAR)Buffer, CharsInLine * CharSize) / CharSize;
+        CharsInLine -= CharsToSkip;
+    }
+
+    ReadContext->CurrentViewOffset += Count * CharSize;
+    ReadContext->LinesRead++;
+
+    LineView->Line = &Buffer[CharsToSkip * CharSize];
+    LineView->CharsInLine = CharsInLine;
+    LineView->WideChars = ReadContext->ReadWChars;
+    return TRUE;
+}
+
+/**
+ Read a line from a file, using a memory mapping if the file can be mapped,
+ and convert it into host (UTF16) encoding.  This avoids the intermediate
+ buffer used by @ref YoriLibReadLineToString when the file is on disk.
+
+ @param UserString Pointer to a string to be updated to contain data for a
+        line.  This must be initialized by the caller and the caller's buffer
+        will be used if it is large enough.  If not, this function may
+        reallocate the string to point to a new buffer.
+
+ @param Context Pointer to a PVOID sized block of memory that should be
+        initialized to NULL for the first line read, and will be updated by
+        this function.
+
+ @param FileHandle Specifies the handle to the file to read the line from.
+
+ @return Pointer to the Line buffer for success, NULL on failure.
+ */
+PVOID
+YoriLibMappedLineReadToString(
+    __in PYORI_STRING UserString,
+    __inout PVOID * Context,
+    __in HANDLE FileHandle
+    )
+{
+    YORI_LIB_LINE_VIEW LineView;
+
+    if (!YoriLibMappedLineReadToView(Context, FileHandle, &LineView)) {
+        UserString->LengthInChars = 0;
+        return NULL;
+    }
+
+    if (!YoriLibLineViewToString(&LineView, UserString)) {
+        UserString->LengthInChars = 0;
+        return NULL;
+    }
+
+    return UserString->StartOfString;
+}
+
+/**
+ Free any context allocated by @ref YoriLibMappedLineReadToView or
+ @ref YoriLibMappedLineReadToString .
+
+ @param Context Pointer to the context to free.
+ */
+VOID
+YoriLibMappedLineReadClose(
+    __in_opt PVOID Context
+    )
+{
+    PYORI_LIB_MAPPED_LINE_READ_CONTEXT ReadContext = (PYORI_LIB_MAPPED_LINE_READ_CONTEXT)Context;
+    if (ReadContext != NULL) {
+        if (ReadContext->View != NULL) {
+            UnmapViewOfFile(ReadContext->View);
+        }
+        if (ReadContext->hMapping != NULL) {
+            CloseHandle(ReadContext->hMapping);
+        }
+        YoriLibLineReadClose(ReadContext->StreamContext);
+        YoriLibFree(ReadContext);
+    }
+}
+
 // vim:sw=4:ts=4:et:
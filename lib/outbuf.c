@@ -0,0 +1,478 @@
+/**
+ * @file lib/outbuf.c
+ *
+ * Buffered output to a standard handle, for tools that generate output
+ * one line at a time.
+ *
+ * Copyright (c) 2019 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yoripch.h"
+#include "yorilib.h"
+
+/**
+ The number of characters to accumulate before writing to a file or pipe.
+ */
+#define YORI_LIB_OUTPUT_BUFFER_CHARS (16 * 1024)
+
+/**
+ Prepare an output buffer for use.  If the target is a console, text is
+ processed for escapes and written as each call is made, because the user
+ is watching.  If the target is a file or pipe, text is accumulated and
+ written in large blocks.
+
+ @param Buffer Pointer to the output buffer to initialize.
+
+ @param Flags Flags, indicating the output stream and its behavior, as
+        supplied to YoriLibOutput.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  On failure
+         nothing remains allocated, so the buffer should not be passed to
+         @ref YoriLibOutputBufferCleanup .
+ */
+__success(return)
+BOOL
+YoriLibOutputBufferInitialize(
+    __out PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in DWORD Flags
+    )
+{
+    DWORD CurrentMode;
+
+    ZeroMemory(Buffer, sizeof(YORI_LIB_OUTPUT_BUFFER));
+
+    if ((Flags & YORI_LIB_OUTPUT_STDERR) != 0) {
+        Buffer->hOutput = GetStdHandle(STD_ERROR_HANDLE);
+    } else {
+        Buffer->hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    }
+    Buffer->Flags = Flags;
+
+    if (GetConsoleMode(Buffer->hOutput, &CurrentMode)) {
+        Buffer->OutputIsConsole = TRUE;
+        if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
+            YoriLibConsoleNoEscapeSetFunctions(&Buffer->Callbacks);
+        } else if ((Flags & YORI_LIB_OUTPUT_PASSTHROUGH_VT) != 0) {
+            YoriLibConsoleIncludeEscapeSetFunctions(&Buffer->Callbacks);
+        } else {
+            YoriLibConsoleSetFunctions(&Buffer->Callbacks);
+        }
+    } else if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
+        YoriLibUtf8TextNoEscapesSetFunctions(&Buffer->Callbacks);
+    } else {
+        YoriLibUtf8TextWithEscapesSetFunctions(&Buffer->Callbacks);
+    }
+
+    if (!YoriLibAllocateString(&Buffer->Text, YORI_LIB_OUTPUT_BUFFER_CHARS)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Convert a block of text into the active output encoding and write it to
+ the output device with a single call.  The text is expected to have any
+ escapes and line endings already processed.
+
+ @param Buffer Pointer to the output buffer, which supplies the device and
+        a scratch buffer for encoding.
+
+ @param StringBuffer Pointer to the text to write.
+
+ @param BufferLength The number of characters in StringBuffer.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibOutputBufferWriteText(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in LPCTSTR StringBuffer,
+    __in DWORD BufferLength
+    )
+{
+    DWORD BytesTransferred;
+
+#ifdef UNICODE
+    DWORD BytesNeeded;
+    DWORD EncodedLength;
+    LPSTR Encoded;
+
+    Encoded = Buffer->Encoded;
+    EncodedLength = Buffer->EncodedLength;
+    if (!YoriLibMultibyteOutputToBuffer(StringBuffer, BufferLength, &Encoded, &EncodedLength, &BytesNeeded)) {
+        return FALSE;
+    }
+
+    if (Encoded != Buffer->Encoded) {
+        if (Buffer->Encoded != NULL) {
+            YoriLibFree(Buffer->Encoded);
+        }
+        Buffer->Encoded = Encoded;
+        Buffer->EncodedLength = EncodedLength;
+    }
+
+    return WriteFile(Buffer->hOutput, Buffer->Encoded, BytesNeeded, &BytesTransferred, NULL);
+#else
+    return WriteFile(Buffer->hOutput, StringBuffer, BufferLength * sizeof(TCHAR), &BytesTransferred, NULL);
+#endif
+}
+
+/**
+ Write any text accumulated in an output buffer to its device.
+
+ @param Buffer Pointer to the output buffer.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibOutputBufferFlush(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer
+    )
+{
+    BOOL Result;
+
+    if (Buffer->Text.LengthInChars == 0) {
+        return TRUE;
+    }
+
+    Result = YoriLibOutputBufferWriteText(Buffer, Buffer->Text.StartOfString, Buffer->Text.LengthInChars);
+    Buffer->Text.LengthInChars = 0;
+    return Result;
+}
+
+/**
+ Remove any VT100 escapes from a range of characters, compacting the
+ remaining text in place.
+
+ @param String Pointer to the characters to process.
+
+ @param StringLength The number of characters in String.
+
+ @return The number of characters remaining after escapes are removed.
+ */
+DWORD
+YoriLibOutputBufferStripEscapes(
+    __inout LPTSTR String,
+    __in DWORD StringLength
+    )
+{
+    DWORD CharIndex;
+    DWORD DestIndex;
+    DWORD EndOfEscape;
+    YORI_STRING EscapeSubset;
+
+    DestIndex = 0;
+    for (CharIndex = 0; CharIndex < StringLength; CharIndex++) {
+        if (StringLength > CharIndex + 2 &&
+            String[CharIndex] == 27 &&
+            String[CharIndex + 1] == '[') {
+
+            YoriLibInitEmptyString(&EscapeSubset);
+            EscapeSubset.StartOfString = &String[CharIndex + 2];
+            EscapeSubset.LengthInChars = StringLength - CharIndex - 2;
+            EndOfEscape = YoriLibCountStringContainingChars(&EscapeSubset, _T("0123456789;"));
+            if (StringLength > CharIndex + 2 + EndOfEscape) {
+                CharIndex += 2 + EndOfEscape;
+                continue;
+            }
+        }
+        String[DestIndex] = String[CharIndex];
+        DestIndex++;
+    }
+
+    return DestIndex;
+}
+
+/**
+ Process text which has just been placed after the end of the accumulated
+ text in an output buffer.  For a console, the text is displayed
+ immediately.  For other devices, escapes are removed if requested, and
+ line endings are converted to CRLF in place, so that the text is ready
+ to be written as part of a later flush.
+
+ @param Buffer Pointer to the output buffer.
+
+ @param NewChars The number of characters following the accumulated text
+        which should be processed.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibOutputBufferCommit(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in DWORD NewChars
+    )
+{
+    LPTSTR NewText;
+    DWORD LineEndsToExpand;
+    DWORD SrcIndex;
+    DWORD DestIndex;
+
+    NewText = &Buffer->Text.StartOfString[Buffer->Text.LengthInChars];
+
+    if (Buffer->OutputIsConsole) {
+        return YoriLibProcessVtEscapesOnNewStream(NewText, NewChars, Buffer->hOutput, &Buffer->Callbacks);
+    }
+
+    if ((Buffer->Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
+        NewChars = YoriLibOutputBufferStripEscapes(NewText, NewChars);
+    }
+
+    //
+    //  Count the number of lone CR or LF characters, each of which needs
+    //  to become a CRLF pair.  This matches the processing performed by
+    //  YoriLibOutputTextToMultibyteCRLF for each call to YoriLibOutput.
+    //
+
+    LineEndsToExpand = 0;
+    for (SrcIndex = 0; SrcIndex < NewChars; SrcIndex++) {
+        if (NewText[SrcIndex] == '\r') {
+            if (SrcIndex + 1 < NewChars && NewText[SrcIndex + 1] == '\n') {
+                SrcIndex++;
+            } else {
+                LineEndsToExpand++;
+            }
+        } else if (NewText[SrcIndex] == '\n') {
+            LineEndsToExpand++;
+        }
+    }
+
+    if (LineEndsToExpand > 0) {
+
+        //
+        //  If there's no room to expand the new text, write out the
+        //  previously accumulated text and move the new text to the
+        //  beginning of the buffer.  If the text still doesn't fit, it's
+        //  enormous, so write it through the unbuffered path.
+        //
+
+        if (Buffer->Text.LengthInChars + NewChars + LineEndsToExpand > Buffer->Text.LengthAllocated) {
+            if (!YoriLibOutputBufferFlush(Buffer)) {
+                return FALSE;
+            }
+            memmove(Buffer->Text.StartOfString, NewText, NewChars * sizeof(TCHAR));
+            NewText = Buffer->Text.StartOfString;
+
+            if (NewChars + LineEndsToExpand > Buffer->Text.LengthAllocated) {
+                return YoriLibOutputTextToMultibyteCRLF(Buffer->hOutput, NewText, NewChars);
+            }
+        }
+
+        //
+        //  Expand from the end so that no text is overwritten before it
+        //  has been moved.
+        //
+
+        SrcIndex = NewChars;
+        DestIndex = NewChars + LineEndsToExpand;
+        while (SrcIndex > 0) {
+            SrcIndex--;
+            if (NewText[SrcIndex] == '\n' &&
+                SrcIndex > 0 &&
+                NewText[SrcIndex - 1] == '\r') {
+
+                DestIndex -= 2;
+                NewText[DestIndex + 1] = '\n';
+                NewText[DestIndex] = '\r';
+                SrcIndex--;
+            } else if (NewText[SrcIndex] == '\r' || NewText[SrcIndex] == '\n') {
+                DestIndex -= 2;
+                NewText[DestIndex + 1] = '\n';
+                NewText[DestIndex] = '\r';
+            } else {
+                DestIndex--;
+                NewText[DestIndex] = NewText[SrcIndex];
+            }
+        }
+        ASSERT(DestIndex == 0);
+        NewChars += LineEndsToExpand;
+    }
+
+    Buffer->Text.LengthInChars += NewChars;
+    return TRUE;
+}
+
+/**
+ Output a string through an output buffer.  This will perform ANSI escape
+ processing but has no mechanism for expanding extra tokens in the stream.
+
+ @param Buffer Pointer to the output buffer.
+
+ @param String The string to output.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibOutputBufferWriteString(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in PYORI_STRING String
+    )
+{
+    if (Buffer->OutputIsConsole) {
+        return YoriLibProcessVtEscapesOnNewStream(String->StartOfString, String->LengthInChars, Buffer->hOutput, &Buffer->Callbacks);
+    }
+
+    if (Buffer->Text.LengthInChars + String->LengthInChars > Buffer->Text.LengthAllocated) {
+        if (!YoriLibOutputBufferFlush(Buffer)) {
+            return FALSE;
+        }
+        if (String->LengthInChars > Buffer->Text.LengthAllocated) {
+            return YoriLibProcessVtEscapesOnNewStream(String->StartOfString, String->LengthInChars, Buffer->hOutput, &Buffer->Callbacks);
+        }
+    }
+
+    memcpy(&Buffer->Text.StartOfString[Buffer->Text.LengthInChars], String->StartOfString, String->LengthInChars * sizeof(TCHAR));
+    return YoriLibOutputBufferCommit(Buffer, String->LengthInChars);
+}
+
+/**
+ Output a printf-style formatted string through an output buffer.  The
+ string is formatted directly into the buffer where possible, so in the
+ common case the format string is only processed once.
+
+ @param Buffer Pointer to the output buffer.
+
+ @param szFmt The format string.
+
+ @param marker The arguments that correspond to the format string.
+
+ @return TRUE for success, FALSE for failure.
+ */
+BOOL
+YoriLibOutputBufferWriteInternal(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in LPCTSTR szFmt,
+    __in va_list marker
+    )
+{
+    va_list savedmarker = marker;
+    int len;
+    DWORD Remaining;
+    YORI_STRING LargeString;
+    BOOL Result;
+
+    //
+    //  Try to format into the space following any accumulated text.  If
+    //  that's not enough, write out the accumulated text and try again
+    //  with the whole buffer.  YoriLibVSPrintf can truncate an argument
+    //  to fit without failing, so a result that fills the space is treated
+    //  as not fitting.
+    //
+
+    len = -1;
+    Remaining = Buffer->Text.LengthAllocated - Buffer->Text.LengthInChars;
+    if (Remaining > 1) {
+        len = YoriLibVSPrintf(&Buffer->Text.StartOfString[Buffer->Text.LengthInChars], Remaining, szFmt, marker);
+        if (len >= (int)(Remaining - 1)) {
+            len = -1;
+        }
+    }
+
+    if (len < 0 && Buffer->Text.LengthInChars > 0) {
+        if (!YoriLibOutputBufferFlush(Buffer)) {
+            return FALSE;
+        }
+        marker = savedmarker;
+        len = YoriLibVSPrintf(Buffer->Text.StartOfString, Buffer->Text.LengthAllocated, szFmt, marker);
+        if (len >= (int)(Buffer->Text.LengthAllocated - 1)) {
+            len = -1;
+        }
+    }
+
+    if (len >= 0) {
+        return YoriLibOutputBufferCommit(Buffer, len);
+    }
+
+    //
+    //  The result is larger than the buffer, so allocate a string to hold
+    //  it and write it through the unbuffered path.
+    //
+
+    marker = savedmarker;
+    len = YoriLibVSPrintfSize(szFmt, marker);
+    if (len < 0 || !YoriLibAllocateString(&LargeString, len)) {
+        return FALSE;
+    }
+
+    marker = savedmarker;
+    len = YoriLibVSPrintf(LargeString.StartOfString, LargeString.LengthAllocated, szFmt, marker);
+
+    Result = FALSE;
+    if (len >= 0) {
+        Result = YoriLibProcessVtEscapesOnNewStream(LargeString.StartOfString, len, Buffer->hOutput, &Buffer->Callbacks);
+    }
+    YoriLibFreeStringContents(&LargeString);
+    return Result;
+}
+
+/**
+ Output a printf-style formatted string through an output buffer.
+
+ @param Buffer Pointer to the output buffer.
+
+ @param szFmt The format string, followed by appropriate arguments.
+
+ @return TRUE for success, FALSE for failure.
+ */
+BOOL
+YoriLibOutputBufferWrite(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in LPCTSTR szFmt,
+    ...
+    )
+{
+    va_list marker;
+    BOOL Result;
+
+    va_start(marker, szFmt);
+    Result = YoriLibOutputBufferWriteInternal(Buffer, szFmt, marker);
+    va_end(marker);
+    return Result;
+}
+
+/**
+ Write any accumulated text in an output buffer to its device and free the
+ resources associated with the buffer.
+
+ @param Buffer Pointer to the output buffer.
+
+ @return TRUE to indicate that all text was written successfully, FALSE to
+         indicate failure.
+ */
+BOOL
+YoriLibOutputBufferCleanup(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer
+    )
+{
+    BOOL Result;
+
+    Result = YoriLibOutputBufferFlush(Buffer);
+    YoriLibFreeStringContents(&Buffer->Text);
+    if (Buffer->Encoded != NULL) {
+        YoriLibFree(Buffer->Encoded);
+        Buffer->Encoded = NULL;
+        Buffer->EncodedLength = 0;
+    }
+    return Result;
+}
+
+// vim:sw=4:ts=4:et:
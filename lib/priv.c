@@ -68,4 +68,103 @@ YoriLibEnableBackupPrivilege()
     return TRUE;
 }
 
+/**
+ Attempt to enable debug privilege to allow Administrators to open more
+ processes and inspect their handles.  If this fails the application may
+ encounter more processes it cannot examine, but it is not fatal, or
+ unexpected.
+
+ @param WasEnabled Optionally points to a boolean which is set to TRUE if
+        the privilege was already enabled or could not be changed, or FALSE
+        if this call enabled it.  A caller running within a long lived
+        process, such as the shell, can use this to decide whether to call
+        @ref YoriLibDisableDebugPrivilege when it is finished.
+
+ @return TRUE to indicate that the privilege enablement was attempted
+         successfully.
+ */
+BOOL
+YoriLibEnableDebugPrivilege(
+    __out_opt PBOOL WasEnabled
+    )
+{
+    HANDLE ProcessToken;
+    YoriLibLoadAdvApi32Functions();
+
+    if (WasEnabled != NULL) {
+        *WasEnabled = TRUE;
+    }
+
+    if (DllAdvApi32.pOpenProcessToken != NULL &&
+        DllAdvApi32.pLookupPrivilegeValueW != NULL &&
+        DllAdvApi32.pAdjustTokenPrivileges != NULL &&
+        DllAdvApi32.pOpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &ProcessToken)) {
+        struct {
+            TOKEN_PRIVILEGES TokenPrivileges;
+            LUID_AND_ATTRIBUTES DebugPrivilege;
+        } PrivilegesToChange, PreviousState;
+        DWORD PreviousStateLength;
+
+        DllAdvApi32.pLookupPrivilegeValueW(NULL, SE_DEBUG_NAME, &PrivilegesToChange.TokenPrivileges.Privileges[0].Luid);
+
+        PrivilegesToChange.TokenPrivileges.PrivilegeCount = 1;
+        PrivilegesToChange.TokenPrivileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+        //
+        //  The previous state only describes privileges which were changed,
+        //  so if it contains the privilege, it was not enabled before.
+        //
+
+        PreviousState.TokenPrivileges.PrivilegeCount = 0;
+        if (DllAdvApi32.pAdjustTokenPrivileges(ProcessToken, FALSE, (PTOKEN_PRIVILEGES)&PrivilegesToChange, sizeof(PreviousState), (PTOKEN_PRIVILEGES)&PreviousState, &PreviousStateLength) &&
+            GetLastError() == ERROR_SUCCESS &&
+            PreviousState.TokenPrivileges.PrivilegeCount > 0 &&
+            (PreviousState.TokenPrivileges.Privileges[0].Attributes & SE_PRIVILEGE_ENABLED) == 0) {
+
+            if (WasEnabled != NULL) {
+                *WasEnabled = FALSE;
+            }
+        }
+        CloseHandle(ProcessToken);
+    }
+
+    return TRUE;
+}
+
+/**
+ Disable debug privilege, restoring the state of a process before
+ @ref YoriLibEnableDebugPrivilege enabled it.
+
+ @return TRUE to indicate that the privilege was disabled, FALSE if it
+         could not be.
+ */
+BOOL
+YoriLibDisableDebugPrivilege()
+{
+    HANDLE ProcessToken;
+    BOOL Result;
+    YoriLibLoadAdvApi32Functions();
+
+    Result = FALSE;
+    if (DllAdvApi32.pOpenProcessToken != NULL &&
+        DllAdvApi32.pLookupPrivilegeValueW != NULL &&
+        DllAdvApi32.pAdjustTokenPrivileges != NULL &&
+        DllAdvApi32.pOpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES, &ProcessToken)) {
+        struct {
+            TOKEN_PRIVILEGES TokenPrivileges;
+            LUID_AND_ATTRIBUTES DebugPrivilege;
+        } PrivilegesToChange;
+
+        DllAdvApi32.pLookupPrivilegeValueW(NULL, SE_DEBUG_NAME, &PrivilegesToChange.TokenPrivileges.Privileges[0].Luid);
+
+        PrivilegesToChange.TokenPrivileges.PrivilegeCount = 1;
+        PrivilegesToChange.TokenPrivileges.Privileges[0].Attributes = 0;
+
+        Result = DllAdvApi32.pAdjustTokenPrivileges(ProcessToken, FALSE, (PTOKEN_PRIVILEGES)&PrivilegesToChange, sizeof(PrivilegesToChange), NULL, NULL);
+        CloseHandle(ProcessToken);
+    }
+
+    return Result;
+}
+
 // vim:sw=4:ts=4:et:
@@ -1032,114 +1032,6 @@ YoriLibCountStringNotContainingChars(
     return len;
 }
 
-/**
- Search through a string looking to see if any substrings can be located.
- Returns the first match in offet from the beginning of the string order.
- This routine looks for matches case sensitively.
-
- @param String The string to search through.
-
- @param NumberMatches The number of substrings to look for.
-
- @param MatchArray An array of strings corresponding to the matches to
-        look for.
-
- @param StringOffsetOfMatch On successful completion, returns the offset
-        within the string of the match.
-
- @return If a match is found, returns a pointer to the entry in MatchArray
-         corresponding to the substring that was matched.  If no match is
-         found, returns NULL.
- */
-PYORI_STRING
-YoriLibFindFirstMatchingSubstring(
-    __in PYORI_STRING String,
-    __in DWORD NumberMatches,
-    __in PYORI_STRING MatchArray,
-    __out_opt PDWORD StringOffsetOfMatch
-    )
-{
-    YORI_STRING RemainingString;
-    DWORD CheckCount;
-
-    YoriLibInitEmptyString(&RemainingString);
-    RemainingString.StartOfString = String->StartOfString;
-    RemainingString.LengthInChars = String->LengthInChars;
-
-    while (RemainingString.LengthInChars > 0) {
-        for (CheckCount = 0; CheckCount < NumberMatches; CheckCount++) {
-            if (YoriLibCompareStringCount(&RemainingString, &MatchArray[CheckCount], MatchArray[CheckCount].LengthInChars) == 0) {
-                if (StringOffsetOfMatch != NULL) {
-                    *StringOffsetOfMatch = String->LengthInChars - RemainingString.LengthInChars;
-                }
-                return &MatchArray[CheckCount];
-            }
-        }
-
-        RemainingString.LengthInChars--;
-        RemainingString.StartOfString++;
-    }
-
-    if (StringOffsetOfMatch != NULL) {
-        *StringOffsetOfMatch = 0;
-    }
-    return NULL;
-}
-
-/**
- Search through a string looking to see if any substrings can be located.
- Returns the first match in offet from the beginning of the string order.
- This routine looks for matches insensitively.
-
- @param String The string to search through.
-
- @param NumberMatches The number of substrings to look for.
-
- @param MatchArray An array of strings corresponding to the matches to
-        look for.
-
- @param StringOffsetOfMatch On successful completion, returns the offset
-        within the string of the match.
-
- @return If a match is found, returns a pointer to the entry in MatchArray
-         corresponding to the substring that was matched.  If no match is
-         found, returns NULL.
- */
-PYORI_STRING
-YoriLibFindFirstMatchingSubstringInsensitive(
-    __in PYORI_STRING String,
-    __in DWORD NumberMatches,
-    __in PYORI_STRING MatchArray,
-    __out_opt PDWORD StringOffsetOfMatch
-    )
-{
-    YORI_STRING RemainingString;
-    DWORD CheckCount;
-
-    YoriLibInitEmptyString(&RemainingString);
-    RemainingString.StartOfString = String->StartOfString;
-    RemainingString.LengthInChars = String->LengthInChars;
-
-    while (RemainingString.LengthInChars > 0) {
-        for (CheckCount = 0; CheckCount < NumberMatches; CheckCount++) {
-            if (YoriLibCompareStringInsensitiveCount(&RemainingString, &MatchArray[CheckCount], MatchArray[CheckCount].LengthInChars) == 0) {
-                if (StringOffsetOfMatch != NULL) {
-                    *StringOffsetOfMatch = String->LengthInChars - RemainingString.LengthInChars;
-                }
-                return &MatchArray[CheckCount];
-            }
-        }
-
-        RemainingString.LengthInChars--;
-        RemainingString.StartOfString++;
-    }
-
-    if (StringOffsetOfMatch != NULL) {
-        *StringOffsetOfMatch = 0;
-    }
-    return NULL;
-}
-
 /**
  Search through a string finding the leftmost instance of a character.  If
  no match is found, return NULL.
@@ -0,0 +1,1015 @@
+/**
+ * @file lib/substr.c
+ *
+ * Yori routines to search for one or more substrings within a string
+ *
+ * Copyright (c) 2020 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yoripch.h"
+#include "yorilib.h"
+
+/**
+ If the number of characters to search multiplied by the number of
+ substrings to search for is below this value, the one-shot search
+ functions compare directly rather than building an automaton, since
+ building the automaton would cost more than the search.
+ */
+#define YORI_SUBSTRING_DIRECT_SEARCH_LIMIT (1024)
+
+/**
+ Convert a character to the form used for comparison by a matcher.
+
+ @param Insensitive TRUE if the comparison is case insensitive, FALSE if it
+        is case sensitive.
+
+ @param Char The character to convert.
+
+ @return The character to compare.
+ */
+#define YoriLibSubstringFoldChar(Insensitive, Char) \
+    (((Insensitive) && (Char) >= 'a' && (Char) <= 'z')?(TCHAR)((Char) - 'a' + 'A'):(Char))
+
+/**
+ Compare a specified number of characters from two buffers, optionally
+ without regard to case.
+
+ @param Str1 Pointer to the first buffer.
+
+ @param Str2 Pointer to the second buffer.
+
+ @param Count The number of characters to compare.
+
+ @param Insensitive TRUE if the comparison should be case insensitive.
+
+ @return TRUE if the buffers contain equal characters, FALSE if they do not.
+ */
+BOOL
+YoriLibSubstringCompareChars(
+    __in LPCTSTR Str1,
+    __in LPCTSTR Str2,
+    __in DWORD Count,
+    __in BOOLEAN Insensitive
+    )
+{
+    DWORD Index;
+
+    if (!Insensitive) {
+        if (memcmp(Str1, Str2, Count * sizeof(TCHAR)) == 0) {
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    for (Index = 0; Index < Count; Index++) {
+        if (YoriLibSubstringFoldChar(TRUE, Str1[Index]) != YoriLibSubstringFoldChar(TRUE, Str2[Index])) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Search through a string for a set of substrings by testing each substring
+ at each offset.  This is used for small searches where the cost of building
+ an automaton would exceed the cost of the search.
+
+ @param String The string to search through.
+
+ @param NumberMatches The number of substrings to look for.
+
+ @param MatchArray An array of strings corresponding to the matches to
+        look for.
+
+ @param Insensitive TRUE if the search should be case insensitive.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return If a match is found, returns a pointer to the entry in MatchArray
+         corresponding to the substring that was matched.  If no match is
+         found, returns NULL.
+ */
+PYORI_STRING
+YoriLibFindFirstMatchingSubstringDirect(
+    __in PYORI_STRING String,
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive,
+    __out_opt PDWORD StringOffsetOfMatch
+    )
+{
+    DWORD Offset;
+    DWORD CheckCount;
+
+    for (Offset = 0; Offset < String->LengthInChars; Offset++) {
+        for (CheckCount = 0; CheckCount < NumberMatches; CheckCount++) {
+            if (MatchArray[CheckCount].LengthInChars <= String->LengthInChars - Offset &&
+                YoriLibSubstringCompareChars(&String->StartOfString[Offset],
+                                             MatchArray[CheckCount].StartOfString,
+                                             MatchArray[CheckCount].LengthInChars,
+                                             Insensitive)) {
+
+                if (StringOffsetOfMatch != NULL) {
+                    *StringOffsetOfMatch = Offset;
+                }
+                return &MatchArray[CheckCount];
+            }
+        }
+    }
+
+    if (StringOffsetOfMatch != NULL) {
+        *StringOffsetOfMatch = 0;
+    }
+    return NULL;
+}
+
+/**
+ Search through a string for a single substring by scanning for the first
+ character of the substring and only comparing the remainder where the first
+ and last characters match.  This requires no state to be built before the
+ search commences.
+
+ @param String The string to search through.
+
+ @param MatchString The substring to look for.
+
+ @param Insensitive TRUE if the search should be case insensitive.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return TRUE if a match was found, FALSE if it was not.
+ */
+BOOL
+YoriLibFindSingleSubstringByFirstChar(
+    __in PYORI_STRING String,
+    __in PYORI_STRING MatchString,
+    __in BOOLEAN Insensitive,
+    __out PDWORD StringOffsetOfMatch
+    )
+{
+    DWORD Offset;
+    DWORD LastOffset;
+    DWORD MatchLength;
+    TCHAR FirstChar;
+    TCHAR LastChar;
+    LPTSTR Text;
+
+    MatchLength = MatchString->LengthInChars;
+    if (MatchLength == 0) {
+        if (String->LengthInChars > 0) {
+            *StringOffsetOfMatch = 0;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    if (MatchLength > String->LengthInChars) {
+        return FALSE;
+    }
+
+    Text = String->StartOfString;
+    FirstChar = YoriLibSubstringFoldChar(Insensitive, MatchString->StartOfString[0]);
+    LastChar = YoriLibSubstringFoldChar(Insensitive, MatchString->StartOfString[MatchLength - 1]);
+    LastOffset = String->LengthInChars - MatchLength;
+
+    for (Offset = 0; Offset <= LastOffset; Offset++) {
+        if (YoriLibSubstringFoldChar(Insensitive, Text[Offset]) == FirstChar &&
+            YoriLibSubstringFoldChar(Insensitive, Text[Offset + MatchLength - 1]) == LastChar &&
+            YoriLibSubstringCompareChars(&Text[Offset], MatchString->StartOfString, MatchLength, Insensitive)) {
+
+            *StringOffsetOfMatch = Offset;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ Find the child of a node in a substring matcher automaton that is reached
+ by a specified character.
+
+ @param Matcher Pointer to the matcher.
+
+ @param NodeIndex The index of the parent node.
+
+ @param Char The character to transition on.  This should already have been
+        converted to the form used for comparison.
+
+ @return The index of the child node, or zero if the parent has no child
+         for this character.
+ */
+DWORD
+YoriLibSubstringMatcherFindChild(
+    __in PYORI_SUBSTRING_MATCHER Matcher,
+    __in DWORD NodeIndex,
+    __in TCHAR Char
+    )
+{
+    DWORD ChildIndex;
+
+    if (NodeIndex == 0 && Char < YORI_SUBSTRING_MATCHER_ROOT_TRANSITIONS) {
+        return Matcher->RootTransition[Char];
+    }
+
+    ChildIndex = Matcher->Nodes[NodeIndex].FirstChild;
+    while (ChildIndex != 0) {
+        if (Matcher->Nodes[ChildIndex].Char == Char) {
+            return ChildIndex;
+        }
+        ChildIndex = Matcher->Nodes[ChildIndex].NextSibling;
+    }
+
+    return 0;
+}
+
+/**
+ Build the trie and failure links for a substring matcher that is searching
+ for multiple substrings.  The node array is expected to have been allocated
+ by the caller with enough entries for every character in every substring
+ plus the root.
+
+ @param Matcher Pointer to the matcher whose automaton should be built.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibSubstringMatcherBuildAutomaton(
+    __inout PYORI_SUBSTRING_MATCHER Matcher
+    )
+{
+    PYORI_SUBSTRING_MATCHER_NODE Node;
+    PYORI_SUBSTRING_MATCHER_NODE Child;
+    PYORI_STRING MatchString;
+    PDWORD Queue;
+    DWORD QueueHead;
+    DWORD QueueTail;
+    DWORD MatchIndex;
+    DWORD CharIndex;
+    DWORD NodeIndex;
+    DWORD ChildIndex;
+    DWORD FailIndex;
+    TCHAR Char;
+
+    ZeroMemory(Matcher->Nodes, sizeof(YORI_SUBSTRING_MATCHER_NODE));
+    Matcher->Nodes[0].MatchIndex = YORI_SUBSTRING_MATCHER_NO_MATCH;
+    Matcher->NodeCount = 1;
+
+    //
+    //  Insert each substring into the trie.  If the same substring is
+    //  present more than once, the earliest entry in the array wins.
+    //
+
+    for (MatchIndex = 0; MatchIndex < Matcher->NumberMatches; MatchIndex++) {
+        MatchString = &Matcher->MatchArray[MatchIndex];
+        if (MatchString->LengthInChars == 0) {
+            continue;
+        }
+
+        NodeIndex = 0;
+        for (CharIndex = 0; CharIndex < MatchString->LengthInChars; CharIndex++) {
+            Char = YoriLibSubstringFoldChar(Matcher->Insensitive, MatchString->StartOfString[CharIndex]);
+            ChildIndex = YoriLibSubstringMatcherFindChild(Matcher, NodeIndex, Char);
+            if (ChildIndex == 0) {
+                ChildIndex = Matcher->NodeCount;
+                Matcher->NodeCount++;
+                Child = &Matcher->Nodes[ChildIndex];
+                Node = &Matcher->Nodes[NodeIndex];
+                Child->Char = Char;
+                Child->Depth = CharIndex + 1;
+                Child->FirstChild = 0;
+                Child->Failure = 0;
+                Child->OutputLink = 0;
+                Child->MatchIndex = YORI_SUBSTRING_MATCHER_NO_MATCH;
+                Child->NextSibling = Node->FirstChild;
+                Node->FirstChild = ChildIndex;
+                if (NodeIndex == 0 && Char < YORI_SUBSTRING_MATCHER_ROOT_TRANSITIONS) {
+                    Matcher->RootTransition[Char] = ChildIndex;
+                }
+            }
+            NodeIndex = ChildIndex;
+        }
+
+        if (Matcher->Nodes[NodeIndex].MatchIndex == YORI_SUBSTRING_MATCHER_NO_MATCH) {
+            Matcher->Nodes[NodeIndex].MatchIndex = MatchIndex;
+        }
+    }
+
+    //
+    //  Walk the trie breadth first, so that the failure link for each node
+    //  refers to a shallower node whose links are already final.
+    //
+
+    Queue = YoriLibMalloc(Matcher->NodeCount * sizeof(DWORD));
+    if (Queue == NULL) {
+        return FALSE;
+    }
+
+    QueueHead = 0;
+    QueueTail = 0;
+    ChildIndex = Matcher->Nodes[0].FirstChild;
+    while (ChildIndex != 0) {
+        Queue[QueueTail] = ChildIndex;
+        QueueTail++;
+        ChildIndex = Matcher->Nodes[ChildIndex].NextSibling;
+    }
+
+    while (QueueHead < QueueTail) {
+        NodeIndex = Queue[QueueHead];
+        QueueHead++;
+        Node = &Matcher->Nodes[NodeIndex];
+
+        ChildIndex = Node->FirstChild;
+        while (ChildIndex != 0) {
+            Child = &Matcher->Nodes[ChildIndex];
+
+            //
+            //  The failure link of the child is the longest proper suffix
+            //  of the child's string that is also a prefix in the trie.
+            //
+
+            FailIndex = Node->Failure;
+            while (TRUE) {
+                Child->Failure = YoriLibSubstringMatcherFindChild(Matcher, FailIndex, Child->Char);
+                if (Child->Failure != 0 || FailIndex == 0) {
+                    break;
+                }
+                FailIndex = Matcher->Nodes[FailIndex].Failure;
+            }
+
+            if (Matcher->Nodes[Child->Failure].MatchIndex != YORI_SUBSTRING_MATCHER_NO_MATCH) {
+                Child->OutputLink = Child->Failure;
+            } else {
+                Child->OutputLink = Matcher->Nodes[Child->Failure].OutputLink;
+            }
+
+            Queue[QueueTail] = ChildIndex;
+            QueueTail++;
+            ChildIndex = Child->NextSibling;
+        }
+    }
+
+    YoriLibFree(Queue);
+    return TRUE;
+}
+
+/**
+ Initialize a matcher to search for a single substring.  This does not
+ allocate memory so the matcher can be on the stack.
+
+ @param Matcher Pointer to the matcher to initialize.
+
+ @param MatchString Pointer to the substring to search for.  This string
+        must remain valid for the lifetime of the matcher.
+
+ @param Insensitive TRUE if the search should be case insensitive.
+ */
+VOID
+YoriLibInitializeSingleSubstringMatcher(
+    __out PYORI_SUBSTRING_MATCHER Matcher,
+    __in PYORI_STRING MatchString,
+    __in BOOLEAN Insensitive
+    )
+{
+    DWORD Index;
+    DWORD MatchLength;
+    TCHAR Char;
+
+    ZeroMemory(Matcher, FIELD_OFFSET(YORI_SUBSTRING_MATCHER, SkipTable));
+    Matcher->NumberMatches = 1;
+    Matcher->MatchArray = MatchString;
+    Matcher->Insensitive = Insensitive;
+    Matcher->EmptyMatchIndex = YORI_SUBSTRING_MATCHER_NO_MATCH;
+    MatchLength = MatchString->LengthInChars;
+    Matcher->MaximumLength = MatchLength;
+
+    if (MatchLength == 0) {
+        Matcher->EmptyMatchIndex = 0;
+        return;
+    }
+
+    //
+    //  Build a Horspool bad character table.  Since the table is indexed
+    //  by the low byte of each character, characters that share a low
+    //  byte share an entry, which must hold the smallest shift of any of
+    //  them.  Later characters in the pattern always have smaller shifts,
+    //  so overwriting the entry gives the correct result.
+    //
+
+    for (Index = 0; Index < sizeof(Matcher->SkipTable)/sizeof(Matcher->SkipTable[0]); Index++) {
+        Matcher->SkipTable[Index] = MatchLength;
+    }
+
+    for (Index = 0; Index < MatchLength - 1; Index++) {
+        Char = YoriLibSubstringFoldChar(Insensitive, MatchString->StartOfString[Index]);
+        Matcher->SkipTable[Char & 0xFF] = MatchLength - 1 - Index;
+    }
+}
+
+/**
+ Compile a set of substrings into a matcher which can efficiently search
+ strings for any of them.  The matcher is built once and can then be used to
+ search any number of strings.
+
+ @param NumberMatches The number of substrings to look for.
+
+ @param MatchArray An array of strings corresponding to the matches to
+        look for.  This array must remain valid for the lifetime of the
+        matcher, since successful searches return pointers to its entries.
+
+ @param Insensitive TRUE if searches should be case insensitive, FALSE if
+        they should be case sensitive.
+
+ @return Pointer to the matcher, or NULL on failure.  The caller should free
+         this with @ref YoriLibFreeSubstringMatcher .
+ */
+PYORI_SUBSTRING_MATCHER
+YoriLibCompileSubstringMatcher(
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive
+    )
+{
+    PYORI_SUBSTRING_MATCHER Matcher;
+    DWORD MatchIndex;
+    DWORD TotalChars;
+    DWORD NodesNeeded;
+    DWORD SizeNeeded;
+
+    if (NumberMatches <= 1) {
+        Matcher = YoriLibReferencedMalloc(sizeof(YORI_SUBSTRING_MATCHER));
+        if (Matcher == NULL) {
+            return NULL;
+        }
+
+        if (NumberMatches == 1) {
+            YoriLibInitializeSingleSubstringMatcher(Matcher, MatchArray, Insensitive);
+        } else {
+            ZeroMemory(Matcher, sizeof(YORI_SUBSTRING_MATCHER));
+            Matcher->MatchArray = MatchArray;
+            Matcher->Insensitive = Insensitive;
+            Matcher->EmptyMatchIndex = YORI_SUBSTRING_MATCHER_NO_MATCH;
+        }
+        return Matcher;
+    }
+
+    TotalChars = 0;
+    for (MatchIndex = 0; MatchIndex < NumberMatches; MatchIndex++) {
+        if (TotalChars + MatchArray[MatchIndex].LengthInChars < TotalChars) {
+            return NULL;
+        }
+        TotalChars = TotalChars + MatchArray[MatchIndex].LengthInChars;
+    }
+
+    NodesNeeded = TotalChars + 1;
+    if (NodesNeeded == 0 ||
+        NodesNeeded > ((DWORD)-1 - sizeof(YORI_SUBSTRING_MATCHER)) / sizeof(YORI_SUBSTRING_MATCHER_NODE)) {
+        return NULL;
+    }
+
+    SizeNeeded = sizeof(YORI_SUBSTRING_MATCHER) + NodesNeeded * sizeof(YORI_SUBSTRING_MATCHER_NODE);
+    Matcher = YoriLibReferencedMalloc(SizeNeeded);
+    if (Matcher == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Matcher, sizeof(YORI_SUBSTRING_MATCHER));
+    Matcher->NumberMatches = NumberMatches;
+    Matcher->MatchArray = MatchArray;
+    Matcher->Insensitive = Insensitive;
+    Matcher->UseAutomaton = TRUE;
+    Matcher->EmptyMatchIndex = YORI_SUBSTRING_MATCHER_NO_MATCH;
+    Matcher->Nodes = (PYORI_SUBSTRING_MATCHER_NODE)(Matcher + 1);
+
+    for (MatchIndex = 0; MatchIndex < NumberMatches; MatchIndex++) {
+        if (MatchArray[MatchIndex].LengthInChars == 0) {
+            if (Matcher->EmptyMatchIndex == YORI_SUBSTRING_MATCHER_NO_MATCH) {
+                Matcher->EmptyMatchIndex = MatchIndex;
+            }
+        } else if (MatchArray[MatchIndex].LengthInChars > Matcher->MaximumLength) {
+            Matcher->MaximumLength = MatchArray[MatchIndex].LengthInChars;
+        }
+    }
+
+    if (!YoriLibSubstringMatcherBuildAutomaton(Matcher)) {
+        YoriLibDereference(Matcher);
+        return NULL;
+    }
+
+    return Matcher;
+}
+
+/**
+ Free a matcher previously returned from
+ @ref YoriLibCompileSubstringMatcher .
+
+ @param Matcher Pointer to the matcher to free.
+ */
+VOID
+YoriLibFreeSubstringMatcher(
+    __in PYORI_SUBSTRING_MATCHER Matcher
+    )
+{
+    YoriLibDereference(Matcher);
+}
+
+/**
+ Search a string for a single substring using a matcher that has been
+ initialized with a Horspool skip table.
+
+ @param Matcher Pointer to the matcher.
+
+ @param String The string to search through.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return TRUE if a match was found, FALSE if it was not.
+ */
+BOOL
+YoriLibSubstringMatcherFindSingle(
+    __in PYORI_SUBSTRING_MATCHER Matcher,
+    __in PYORI_STRING String,
+    __out PDWORD StringOffsetOfMatch
+    )
+{
+    PYORI_STRING MatchString;
+    LPTSTR Text;
+    LPTSTR Pattern;
+    DWORD MatchLength;
+    DWORD Offset;
+    DWORD LastOffset;
+    DWORD Index;
+    BOOLEAN Insensitive;
+    TCHAR LastChar;
+    TCHAR Char;
+
+    MatchString = Matcher->MatchArray;
+    MatchLength = MatchString->LengthInChars;
+    if (MatchLength > String->LengthInChars) {
+        return FALSE;
+    }
+
+    //
+    //  For very short substrings the skip table can't skip far enough to
+    //  be worthwhile, so just scan for the first character.
+    //
+
+    if (MatchLength <= 2) {
+        return YoriLibFindSingleSubstringByFirstChar(String, MatchString, Matcher->Insensitive, StringOffsetOfMatch);
+    }
+
+    Insensitive = Matcher->Insensitive;
+    Text = String->StartOfString;
+    Pattern = MatchString->StartOfString;
+    LastChar = YoriLibSubstringFoldChar(Insensitive, Pattern[MatchLength - 1]);
+    LastOffset = String->LengthInChars - MatchLength;
+    Offset = 0;
+
+    while (Offset <= LastOffset) {
+        Char = YoriLibSubstringFoldChar(Insensitive, Text[Offset + MatchLength - 1]);
+        if (Char == LastChar) {
+            Index = MatchLength - 1;
+            while (Index > 0 &&
+                   YoriLibSubstringFoldChar(Insensitive, Text[Offset + Index - 1]) == YoriLibSubstringFoldChar(Insensitive, Pattern[Index - 1])) {
+                Index--;
+            }
+            if (Index == 0) {
+                *StringOffsetOfMatch = Offset;
+                return TRUE;
+            }
+        }
+
+        if (LastOffset - Offset < Matcher->SkipTable[Char & 0xFF]) {
+            break;
+        }
+        Offset = Offset + Matcher->SkipTable[Char & 0xFF];
+    }
+
+    return FALSE;
+}
+
+/**
+ Search a string for any of a set of substrings using a matcher that has
+ built an automaton.  This returns the match that starts earliest in the
+ string, and if multiple substrings match at that offset, the one that is
+ earliest in the match array.
+
+ @param Matcher Pointer to the matcher.
+
+ @param String The string to search through.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return The index within the match array of the substring that matched,
+         or YORI_SUBSTRING_MATCHER_NO_MATCH if no match was found.
+ */
+DWORD
+YoriLibSubstringMatcherFindMultiple(
+    __in PYORI_SUBSTRING_MATCHER Matcher,
+    __in PYORI_STRING String,
+    __out PDWORD StringOffsetOfMatch
+    )
+{
+    PYORI_SUBSTRING_MATCHER_NODE Nodes;
+    LPTSTR Text;
+    DWORD Offset;
+    DWORD State;
+    DWORD Next;
+    DWORD Output;
+    DWORD MatchStart;
+    DWORD BestStart;
+    DWORD BestIndex;
+    DWORD Index;
+    BOOLEAN Insensitive;
+    TCHAR Char;
+
+    Nodes = Matcher->Nodes;
+    Text = String->StartOfString;
+    Insensitive = Matcher->Insensitive;
+    BestStart = 0;
+    BestIndex = YORI_SUBSTRING_MATCHER_NO_MATCH;
+
+    //
+    //  An empty substring matches at the start of any nonempty string, so
+    //  the only question is whether an earlier entry in the array also
+    //  matches there.
+    //
+
+    if (Matcher->EmptyMatchIndex != YORI_SUBSTRING_MATCHER_NO_MATCH) {
+        if (String->LengthInChars == 0) {
+            return YORI_SUBSTRING_MATCHER_NO_MATCH;
+        }
+
+        *StringOffsetOfMatch = 0;
+        for (Index = 0; Index < Matcher->EmptyMatchIndex; Index++) {
+            if (Matcher->MatchArray[Index].LengthInChars <= String->LengthInChars &&
+                YoriLibSubstringCompareChars(Text, Matcher->MatchArray[Index].StartOfString, Matcher->MatchArray[Index].LengthInChars, Insensitive)) {
+                return Index;
+            }
+        }
+        return Matcher->EmptyMatchIndex;
+    }
+
+    State = 0;
+    for (Offset = 0; Offset < String->LengthInChars; Offset++) {
+        Char = YoriLibSubstringFoldChar(Insensitive, Text[Offset]);
+
+        while (TRUE) {
+            if (State == 0 && Char < YORI_SUBSTRING_MATCHER_ROOT_TRANSITIONS) {
+                Next = Matcher->RootTransition[Char];
+            } else {
+                Next = Nodes[State].FirstChild;
+                while (Next != 0 && Nodes[Next].Char != Char) {
+                    Next = Nodes[Next].NextSibling;
+                }
+            }
+
+            if (Next != 0 || State == 0) {
+                State = Next;
+                break;
+            }
+
+            State = Nodes[State].Failure;
+        }
+
+        //
+        //  The first output reachable from this state is the longest
+        //  substring ending here, which is the one starting earliest.
+        //
+
+        if (Nodes[State].MatchIndex != YORI_SUBSTRING_MATCHER_NO_MATCH) {
+            Output = State;
+        } else {
+            Output = Nodes[State].OutputLink;
+        }
+
+        if (Output != 0) {
+            MatchStart = Offset + 1 - Nodes[Output].Depth;
+            if (BestIndex == YORI_SUBSTRING_MATCHER_NO_MATCH ||
+                MatchStart < BestStart ||
+                (MatchStart == BestStart && Nodes[Output].MatchIndex < BestIndex)) {
+
+                BestStart = MatchStart;
+                BestIndex = Nodes[Output].MatchIndex;
+            }
+        }
+
+        //
+        //  Once no remaining substring could start at or before the best
+        //  match found so far, the search is complete.
+        //
+
+        if (BestIndex != YORI_SUBSTRING_MATCHER_NO_MATCH &&
+            Offset + 1 >= BestStart + Matcher->MaximumLength) {
+
+            break;
+        }
+    }
+
+    if (BestIndex != YORI_SUBSTRING_MATCHER_NO_MATCH) {
+        *StringOffsetOfMatch = BestStart;
+    }
+    return BestIndex;
+}
+
+/**
+ Search through a string using a previously compiled matcher to see if any
+ of its substrings can be located.  Returns the first match in offset from
+ the beginning of the string order.  If more than one substring matches at
+ that offset, the one earliest in the match array is returned.
+
+ @param Matcher Pointer to the matcher.
+
+ @param String The string to search through.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return If a match is found, returns a pointer to the entry in the match
+         array corresponding to the substring that was matched.  If no match
+         is found, returns NULL.
+ */
+PYORI_STRING
+YoriLibSubstringMatcherFindFirst(
+    __in PYORI_SUBSTRING_MATCHER Matcher,
+    __in PYORI_STRING String,
+    __out_opt PDWORD StringOffsetOfMatch
+    )
+{
+    DWORD MatchIndex;
+    DWORD MatchOffset;
+
+    MatchIndex = YORI_SUBSTRING_MATCHER_NO_MATCH;
+    MatchOffset = 0;
+
+    if (Matcher->UseAutomaton) {
+        MatchIndex = YoriLibSubstringMatcherFindMultiple(Matcher, String, &MatchOffset);
+    } else if (Matcher->NumberMatches == 1) {
+        if (Matcher->EmptyMatchIndex != YORI_SUBSTRING_MATCHER_NO_MATCH) {
+            if (String->LengthInChars > 0) {
+                MatchIndex = 0;
+            }
+        } else if (YoriLibSubstringMatcherFindSingle(Matcher, String, &MatchOffset)) {
+            MatchIndex = 0;
+        }
+    }
+
+    if (MatchIndex == YORI_SUBSTRING_MATCHER_NO_MATCH) {
+        if (StringOffsetOfMatch != NULL) {
+            *StringOffsetOfMatch = 0;
+        }
+        return NULL;
+    }
+
+    if (StringOffsetOfMatch != NULL) {
+        *StringOffsetOfMatch = MatchOffset;
+    }
+    return &Matcher->MatchArray[MatchIndex];
+}
+
+/**
+ Search through a string using a previously compiled matcher and return the
+ substring that is earliest in the match array among all of the substrings
+ found anywhere in the string.  This is used where substrings describe rules
+ in priority order, so the position of the match does not matter.  The
+ string is examined in a single pass, and the search ends early if the first
+ entry in the match array is found.
+
+ @param Matcher Pointer to the matcher.
+
+ @param String The string to search through.
+
+ @return If a match is found, returns a pointer to the entry in the match
+         array corresponding to the substring that was matched.  If no match
+         is found, returns NULL.
+ */
+PYORI_STRING
+YoriLibSubstringMatcherFindEarliestEntry(
+    __in PYORI_SUBSTRING_MATCHER Matcher,
+    __in PYORI_STRING String
+    )
+{
+    PYORI_SUBSTRING_MATCHER_NODE Nodes;
+    LPTSTR Text;
+    DWORD Offset;
+    DWORD State;
+    DWORD Next;
+    DWORD Output;
+    DWORD BestIndex;
+    BOOLEAN Insensitive;
+    TCHAR Char;
+
+    if (!Matcher->UseAutomaton) {
+        return YoriLibSubstringMatcherFindFirst(Matcher, String, NULL);
+    }
+
+    Nodes = Matcher->Nodes;
+    Text = String->StartOfString;
+    Insensitive = Matcher->Insensitive;
+    BestIndex = YORI_SUBSTRING_MATCHER_NO_MATCH;
+
+    if (Matcher->EmptyMatchIndex != YORI_SUBSTRING_MATCHER_NO_MATCH &&
+        String->LengthInChars > 0) {
+
+        BestIndex = Matcher->EmptyMatchIndex;
+    }
+
+    State = 0;
+    for (Offset = 0; Offset < String->LengthInChars && BestIndex != 0; Offset++) {
+        Char = YoriLibSubstringFoldChar(Insensitive, Text[Offset]);
+
+        while (TRUE) {
+            if (State == 0 && Char < YORI_SUBSTRING_MATCHER_ROOT_TRANSITIONS) {
+                Next = Matcher->RootTransition[Char];
+            } else {
+                Next = Nodes[State].FirstChild;
+                while (Next != 0 && Nodes[Next].Char != Char) {
+                    Next = Nodes[Next].NextSibling;
+                }
+            }
+
+            if (Next != 0 || State == 0) {
+                State = Next;
+                break;
+            }
+
+            State = Nodes[State].Failure;
+        }
+
+        //
+        //  Every substring ending here is found by following the output
+        //  links from this state.
+        //
+
+        if (Nodes[State].MatchIndex != YORI_SUBSTRING_MATCHER_NO_MATCH) {
+            Output = State;
+        } else {
+            Output = Nodes[State].OutputLink;
+        }
+
+        while (Output != 0) {
+            if (Nodes[Output].MatchIndex < BestIndex) {
+                BestIndex = Nodes[Output].MatchIndex;
+            }
+            Output = Nodes[Output].OutputLink;
+        }
+    }
+
+    if (BestIndex == YORI_SUBSTRING_MATCHER_NO_MATCH) {
+        return NULL;
+    }
+
+    return &Matcher->MatchArray[BestIndex];
+}
+
+/**
+ Search through a string looking to see if any substrings can be located,
+ without a previously compiled matcher.  Small searches compare directly;
+ single substrings are located by scanning for their first character; and
+ larger searches for multiple substrings build a temporary automaton.
+
+ @param String The string to search through.
+
+ @param NumberMatches The number of substrings to look for.
+
+ @param MatchArray An array of strings corresponding to the matches to
+        look for.
+
+ @param Insensitive TRUE if the search should be case insensitive.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return If a match is found, returns a pointer to the entry in MatchArray
+         corresponding to the substring that was matched.  If no match is
+         found, returns NULL.
+ */
+PYORI_STRING
+YoriLibFindFirstMatchingSubstringInternal(
+    __in PYORI_STRING String,
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive,
+    __out_opt PDWORD StringOffsetOfMatch
+    )
+{
+    PYORI_SUBSTRING_MATCHER Matcher;
+    PYORI_STRING Match;
+    DWORD MatchOffset;
+
+    if (NumberMatches == 1) {
+        if (YoriLibFindSingleSubstringByFirstChar(String, MatchArray, Insensitive, &MatchOffset)) {
+            if (StringOffsetOfMatch != NULL) {
+                *StringOffsetOfMatch = MatchOffset;
+            }
+            return MatchArray;
+        }
+
+        if (StringOffsetOfMatch != NULL) {
+            *StringOffsetOfMatch = 0;
+        }
+        return NULL;
+    }
+
+    if (String->LengthInChars < YORI_SUBSTRING_DIRECT_SEARCH_LIMIT / NumberMatches) {
+        return YoriLibFindFirstMatchingSubstringDirect(String, NumberMatches, MatchArray, Insensitive, StringOffsetOfMatch);
+    }
+
+    Matcher = YoriLibCompileSubstringMatcher(NumberMatches, MatchArray, Insensitive);
+    if (Matcher == NULL) {
+        return YoriLibFindFirstMatchingSubstringDirect(String, NumberMatches, MatchArray, Insensitive, StringOffsetOfMatch);
+    }
+
+    Match = YoriLibSubstringMatcherFindFirst(Matcher, String, StringOffsetOfMatch);
+    YoriLibFreeSubstringMatcher(Matcher);
+    return Match;
+}
+
+/**
+ Search through a string looking to see if any substrings can be located.
+ Returns the first match in offet from the beginning of the string order.
+ This routine looks for matches case sensitively.  Callers that search
+ many strings for the same substrings should use
+ @ref YoriLibCompileSubstringMatcher instead.
+
+ @param String The string to search through.
+
+ @param NumberMatches The number of substrings to look for.
+
+ @param MatchArray An array of strings corresponding to the matches to
+        look for.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return If a match is found, returns a pointer to the entry in MatchArray
+         corresponding to the substring that was matched.  If no match is
+         found, returns NULL.
+ */
+PYORI_STRING
+YoriLibFindFirstMatchingSubstring(
+    __in PYORI_STRING String,
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __out_opt PDWORD StringOffsetOfMatch
+    )
+{
+    return YoriLibFindFirstMatchingSubstringInternal(String, NumberMatches, MatchArray, FALSE, StringOffsetOfMatch);
+}
+
+/**
+ Search through a string looking to see if any substrings can be located.
+ Returns the first match in offet from the beginning of the string order.
+ This routine looks for matches insensitively.  Callers that search many
+ strings for the same substrings should use
+ @ref YoriLibCompileSubstringMatcher instead.
+
+ @param String The string to search through.
+
+ @param NumberMatches The number of substrings to look for.
+
+ @param MatchArray An array of strings corresponding to the matches to
+        look for.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return If a match is found, returns a pointer to the entry in MatchArray
+         corresponding to the substring that was matched.  If no match is
+         found, returns NULL.
+ */
+PYORI_STRING
+YoriLibFindFirstMatchingSubstringInsensitive(
+    __in PYORI_STRING String,
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __out_opt PDWORD StringOffsetOfMatch
+    )
+{
+    return YoriLibFindFirstMatchingSubstringInternal(String, NumberMatches, MatchArray, TRUE, StringOffsetOfMatch);
+}
+
+// vim:sw=4:ts=4:et:
@@ -108,23 +108,19 @@ YoriLibOutputTextToMultibyteDevice(
 
 #ifdef UNICODE
     {
-        CHAR ansi_stack_buf[64 + 1];
+        CHAR ansi_stack_buf[YORI_LIB_UTF8_BYTES_FOR_UTF16(64)];
         DWORD AnsiBytesNeeded;
+        DWORD ansi_buf_length;
         LPSTR ansi_buf;
 
-        AnsiBytesNeeded = YoriLibGetMultibyteOutputSizeNeeded(StringBuffer, BufferLength);
-    
-        if (AnsiBytesNeeded > (int)sizeof(ansi_stack_buf)) {
-            ansi_buf = YoriLibMalloc(AnsiBytesNeeded);
-        } else {
-            ansi_buf = ansi_stack_buf;
-        }
+        ansi_buf = ansi_stack_buf;
+        ansi_buf_length = sizeof(ansi_stack_buf);
 
-        if (ansi_buf != NULL) {
-            YoriLibMultibyteOutput(StringBuffer,
-                                   BufferLength,
-                                   ansi_buf,
-                                   AnsiBytesNeeded);
+        if (YoriLibMultibyteOutputToBuffer(StringBuffer,
+                                           BufferLength,
+                                           &ansi_buf,
+                                           &ansi_buf_length,
+                                           &AnsiBytesNeeded)) {
 
             Result = WriteFile(hOutput, ansi_buf, AnsiBytesNeeded, &BytesTransferred, NULL);
 
@@ -133,7 +129,6 @@ YoriLibOutputTextToMultibyteDevice(
             }
         } else {
             Result = FALSE;
-            BufferLength = 0;
         }
     }
 #else
@@ -827,7 +822,7 @@ YoriLibOutputInternal(
 {
     va_list savedmarker = marker;
     int len;
-    TCHAR stack_buf[64];
+    TCHAR stack_buf[256];
     TCHAR * buf;
     YORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks;
     DWORD CurrentMode;
@@ -852,19 +847,28 @@ YoriLibOutputInternal(
         YoriLibUtf8TextWithEscapesSetFunctions(&Callbacks);
     }
 
-    len = YoriLibVSPrintfSize(szFmt, marker);
+    //
+    //  Most output fits on the stack, so try formatting there first and
+    //  only calculate the required size if it doesn't.  YoriLibVSPrintf can
+    //  truncate an argument to fit without failing, so a result that fills
+    //  the buffer is treated as not fitting.
+    //
+
+    buf = stack_buf;
+    len = YoriLibVSPrintf(buf, sizeof(stack_buf)/sizeof(stack_buf[0]), szFmt, marker);
+
+    if (len < 0 || len >= (int)(sizeof(stack_buf)/sizeof(stack_buf[0]) - 1)) {
+        marker = savedmarker;
+        len = YoriLibVSPrintfSize(szFmt, marker);
 
-    if (len>(int)(sizeof(stack_buf)/sizeof(stack_buf[0]))) {
         buf = YoriLibMalloc(len * sizeof(TCHAR));
         if (buf == NULL) {
             return 0;
         }
-    } else {
-        buf = stack_buf;
-    }
 
-    marker = savedmarker;
-    len = YoriLibVSPrintf(buf, len, szFmt, marker);
+        marker = savedmarker;
+        len = YoriLibVSPrintf(buf, len, szFmt, marker);
+    }
 
     Result = YoriLibProcessVtEscapesOnNewStream(buf, len, hOut, &Callbacks);
 
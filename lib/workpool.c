@@ -0,0 +1,449 @@
+/**
+ * @file lib/workpool.c
+ *
+ * A set of worker threads which process items queued by a single thread,
+ * allowing results to be collected in the order the items were queued.
+ *
+ * Copyright (c) 2019 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yoripch.h"
+#include "yorilib.h"
+
+/**
+ Return the number of threads a work pool should use for work which is
+ bounded by processor time.
+
+ @param Minimum The smallest number of threads to return.
+
+ @param Multiplier The number of threads to use per processor.
+
+ @return The number of threads to use, which is at least Minimum and at most
+         YORI_LIB_WORK_POOL_MAX_THREADS.
+ */
+DWORD
+YoriLibWorkPoolGetThreadCount(
+    __in DWORD Minimum,
+    __in DWORD Multiplier
+    )
+{
+    SYSTEM_INFO SystemInfo;
+    DWORD ThreadCount;
+
+    GetSystemInfo(&SystemInfo);
+    ThreadCount = SystemInfo.dwNumberOfProcessors * Multiplier;
+    if (ThreadCount < Minimum) {
+        ThreadCount = Minimum;
+    }
+    if (ThreadCount < 1) {
+        ThreadCount = 1;
+    }
+    if (ThreadCount > YORI_LIB_WORK_POOL_MAX_THREADS) {
+        ThreadCount = YORI_LIB_WORK_POOL_MAX_THREADS;
+    }
+    return ThreadCount;
+}
+
+/**
+ A background thread which processes any items that it finds on the list of
+ pending items.
+
+ @param Context Pointer to the state for this thread.
+
+ @return TRUE to indicate success.
+ */
+DWORD WINAPI
+YoriLibWorkPoolWorkerThread(
+    __in LPVOID Context
+    )
+{
+    PYORI_LIB_WORK_POOL_THREAD Thread = (PYORI_LIB_WORK_POOL_THREAD)Context;
+    PYORI_LIB_WORK_POOL Pool = Thread->Pool;
+    PYORI_LIB_WORK_ITEM Item;
+    DWORD FoundEvent;
+
+    while (TRUE) {
+
+        //
+        //  Wait for an indication of more work or shutdown.
+        //
+
+        FoundEvent = WaitForMultipleObjects(2, &Pool->WorkerWaitEvent, FALSE, INFINITE);
+
+        //
+        //  Process any queued work.  If more work remains after taking an
+        //  item, wake another thread to help with it.
+        //
+
+        while (TRUE) {
+            WaitForSingleObject(Pool->Mutex, INFINITE);
+            if (YoriLibIsListEmpty(&Pool->PendingList)) {
+                ASSERT(Pool->ItemsQueued == 0);
+                ReleaseMutex(Pool->Mutex);
+                break;
+            }
+
+            Item = CONTAINING_RECORD(Pool->PendingList.Next, YORI_LIB_WORK_ITEM, PendingList);
+            ASSERT(Pool->ItemsQueued > 0);
+            Pool->ItemsQueued--;
+            YoriLibRemoveListItem(&Item->PendingList);
+            Item->State = YORI_LIB_WORK_ITEM_ACTIVE;
+            if (Pool->ItemsQueued > 0) {
+                SetEvent(Pool->WorkerWaitEvent);
+            }
+            ReleaseMutex(Pool->Mutex);
+
+            Pool->ProcessItem(Thread->Worker, Item);
+
+            WaitForSingleObject(Pool->Mutex, INFINITE);
+            Item->State = YORI_LIB_WORK_ITEM_COMPLETE;
+            ReleaseMutex(Pool->Mutex);
+            SetEvent(Pool->ItemCompleteEvent);
+        }
+
+        //
+        //  If shutdown was requested, terminate the thread.
+        //
+
+        if (FoundEvent == (WAIT_OBJECT_0 + 1)) {
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Prepare a work pool for use.  Threads are not created until items are
+ queued.
+
+ @param Pool Pointer to the work pool to initialize.
+
+ @param MaxThreads The maximum number of worker threads to create.  This is
+        capped at YORI_LIB_WORK_POOL_MAX_THREADS.
+
+ @param Context A context to pass to CreateWorker, or to ProcessItem if
+        CreateWorker is NULL.
+
+ @param CreateWorker Optionally points to a function to allocate the state
+        for each worker thread.  If NULL, each thread processes items with
+        Context.
+
+ @param DeleteWorker Optionally points to a function to free state allocated
+        by CreateWorker.
+
+ @param ProcessItem Pointer to a function to process a single item.
+
+ @param ForegroundWorker Optionally points to worker state to process items
+        on the queueing thread if no worker thread can be created.  If NULL,
+        items are not queued unless a worker thread exists.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibWorkPoolInitialize(
+    __out PYORI_LIB_WORK_POOL Pool,
+    __in DWORD MaxThreads,
+    __in_opt PVOID Context,
+    __in_opt PYORI_LIB_WORK_POOL_CREATE_WORKER_FN CreateWorker,
+    __in_opt PYORI_LIB_WORK_POOL_DELETE_WORKER_FN DeleteWorker,
+    __in PYORI_LIB_WORK_POOL_PROCESS_FN ProcessItem,
+    __in_opt PVOID ForegroundWorker
+    )
+{
+    ZeroMemory(Pool, sizeof(YORI_LIB_WORK_POOL));
+
+    Pool->Context = Context;
+    Pool->CreateWorker = CreateWorker;
+    Pool->DeleteWorker = DeleteWorker;
+    Pool->ProcessItem = ProcessItem;
+    Pool->ForegroundWorker = ForegroundWorker;
+    Pool->MaxThreads = MaxThreads;
+    if (Pool->MaxThreads > YORI_LIB_WORK_POOL_MAX_THREADS) {
+        Pool->MaxThreads = YORI_LIB_WORK_POOL_MAX_THREADS;
+    }
+
+    YoriLibInitializeListHead(&Pool->PendingList);
+    YoriLibInitializeListHead(&Pool->OutputList);
+
+    Pool->Mutex = CreateMutex(NULL, FALSE, NULL);
+    Pool->WorkerWaitEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Pool->WorkerShutdownEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    Pool->ItemCompleteEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    if (Pool->Mutex == NULL ||
+        Pool->WorkerWaitEvent == NULL ||
+        Pool->WorkerShutdownEvent == NULL ||
+        Pool->ItemCompleteEvent == NULL) {
+
+        YoriLibWorkPoolCleanup(Pool);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Terminate the worker threads in a work pool and free its resources.  Items
+ which no thread has started are discarded, and any item which has not been
+ returned to the caller remains owned by the caller.  This can be called on
+ a pool which was zeroed or only partially initialized.
+
+ @param Pool Pointer to the work pool to clean up.
+ */
+VOID
+YoriLibWorkPoolCleanup(
+    __inout PYORI_LIB_WORK_POOL Pool
+    )
+{
+    DWORD Index;
+
+    if (Pool->Mutex != NULL) {
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        while (!YoriLibIsListEmpty(&Pool->PendingList)) {
+            YoriLibRemoveListItem(Pool->PendingList.Next);
+        }
+        Pool->ItemsQueued = 0;
+        ReleaseMutex(Pool->Mutex);
+    }
+
+    if (Pool->ThreadsAllocated > 0) {
+        SetEvent(Pool->WorkerShutdownEvent);
+        WaitForMultipleObjects(Pool->ThreadsAllocated, Pool->Threads, TRUE, INFINITE);
+        for (Index = 0; Index < Pool->ThreadsAllocated; Index++) {
+            CloseHandle(Pool->Threads[Index]);
+            Pool->Threads[Index] = NULL;
+            if (Pool->CreateWorker != NULL && Pool->DeleteWorker != NULL) {
+                Pool->DeleteWorker(Pool->Workers[Index].Worker);
+            }
+            Pool->Workers[Index].Worker = NULL;
+        }
+        Pool->ThreadsAllocated = 0;
+    }
+
+    if (Pool->Mutex != NULL) {
+        CloseHandle(Pool->Mutex);
+        Pool->Mutex = NULL;
+    }
+
+    if (Pool->WorkerWaitEvent != NULL) {
+        CloseHandle(Pool->WorkerWaitEvent);
+        Pool->WorkerWaitEvent = NULL;
+    }
+
+    if (Pool->WorkerShutdownEvent != NULL) {
+        CloseHandle(Pool->WorkerShutdownEvent);
+        Pool->WorkerShutdownEvent = NULL;
+    }
+
+    if (Pool->ItemCompleteEvent != NULL) {
+        CloseHandle(Pool->ItemCompleteEvent);
+        Pool->ItemCompleteEvent = NULL;
+    }
+}
+
+/**
+ Create another worker thread if there is more queued work than threads to
+ process it.  This is called with the pool mutex held.
+
+ @param Pool Pointer to the work pool.
+ */
+VOID
+YoriLibWorkPoolAddThreadIfNeeded(
+    __inout PYORI_LIB_WORK_POOL Pool
+    )
+{
+    PYORI_LIB_WORK_POOL_THREAD Thread;
+    DWORD ThreadId;
+
+    if (Pool->ThreadsAllocated >= Pool->MaxThreads ||
+        (Pool->ThreadsAllocated > 0 && Pool->ItemsQueued <= Pool->ThreadsAllocated)) {
+
+        return;
+    }
+
+    Thread = &Pool->Workers[Pool->ThreadsAllocated];
+    Thread->Pool = Pool;
+    if (Pool->CreateWorker != NULL) {
+        Thread->Worker = Pool->CreateWorker(Pool->Context);
+        if (Thread->Worker == NULL) {
+            return;
+        }
+    } else {
+        Thread->Worker = Pool->Context;
+    }
+
+    Pool->Threads[Pool->ThreadsAllocated] = CreateThread(NULL, 0, YoriLibWorkPoolWorkerThread, Thread, 0, &ThreadId);
+    if (Pool->Threads[Pool->ThreadsAllocated] == NULL) {
+        if (Pool->CreateWorker != NULL && Pool->DeleteWorker != NULL) {
+            Pool->DeleteWorker(Thread->Worker);
+        }
+        Thread->Worker = NULL;
+        return;
+    }
+
+    Pool->ThreadsAllocated++;
+}
+
+/**
+ Queue an item to be processed by a worker thread.  Items are returned from
+ @ref YoriLibWorkPoolGetCompletedItem in the order they are queued.  If no
+ worker thread can be created and the pool has foreground worker state, the
+ item is processed on this thread before returning.
+
+ @param Pool Pointer to the work pool.
+
+ @param Item Pointer to the item to queue.
+
+ @return TRUE if the item was queued, FALSE if no worker thread exists and
+         the pool has no foreground worker state, in which case the item is
+         not queued.
+ */
+__success(return)
+BOOL
+YoriLibWorkPoolQueueItem(
+    __inout PYORI_LIB_WORK_POOL Pool,
+    __inout PYORI_LIB_WORK_ITEM Item
+    )
+{
+    WaitForSingleObject(Pool->Mutex, INFINITE);
+    YoriLibWorkPoolAddThreadIfNeeded(Pool);
+
+    if (Pool->ThreadsAllocated == 0) {
+        ReleaseMutex(Pool->Mutex);
+        if (Pool->ForegroundWorker == NULL) {
+            return FALSE;
+        }
+
+        Item->State = YORI_LIB_WORK_ITEM_ACTIVE;
+        Pool->ProcessItem(Pool->ForegroundWorker, Item);
+
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        Item->State = YORI_LIB_WORK_ITEM_COMPLETE;
+        YoriLibAppendList(&Pool->OutputList, &Item->OutputList);
+        Pool->ItemsOutstanding++;
+        ReleaseMutex(Pool->Mutex);
+        return TRUE;
+    }
+
+    Item->State = YORI_LIB_WORK_ITEM_QUEUED;
+    YoriLibAppendList(&Pool->OutputList, &Item->OutputList);
+    YoriLibAppendList(&Pool->PendingList, &Item->PendingList);
+    Pool->ItemsOutstanding++;
+    Pool->ItemsQueued++;
+    ReleaseMutex(Pool->Mutex);
+
+    SetEvent(Pool->WorkerWaitEvent);
+    return TRUE;
+}
+
+/**
+ Return the oldest queued item if it has completed.  If it has not, this
+ waits for it when more than a specified number of items are outstanding.
+
+ @param Pool Pointer to the work pool.
+
+ @param MaxOutstanding The number of items which can remain outstanding
+        without waiting.  Specify zero to wait for each item in turn.
+
+ @return Pointer to a completed item, which has been removed from the pool
+         and is owned by the caller, or NULL if no completed item is
+         available.
+ */
+PYORI_LIB_WORK_ITEM
+YoriLibWorkPoolGetCompletedItem(
+    __inout PYORI_LIB_WORK_POOL Pool,
+    __in DWORD MaxOutstanding
+    )
+{
+    PYORI_LIB_WORK_ITEM Item;
+
+    while (TRUE) {
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        if (YoriLibIsListEmpty(&Pool->OutputList)) {
+            ReleaseMutex(Pool->Mutex);
+            return NULL;
+        }
+
+        Item = CONTAINING_RECORD(Pool->OutputList.Next, YORI_LIB_WORK_ITEM, OutputList);
+        if (Item->State != YORI_LIB_WORK_ITEM_COMPLETE) {
+            ReleaseMutex(Pool->Mutex);
+            if (Pool->ItemsOutstanding <= MaxOutstanding) {
+                return NULL;
+            }
+            WaitForSingleObject(Pool->ItemCompleteEvent, INFINITE);
+            continue;
+        }
+
+        YoriLibRemoveListItem(&Item->OutputList);
+        Pool->ItemsOutstanding--;
+        ReleaseMutex(Pool->Mutex);
+        return Item;
+    }
+}
+
+/**
+ Remove a specific item from the pool, regardless of the order it was
+ queued.  If a worker thread is processing it, this waits for it to
+ complete.  If no worker thread has started it, it is removed without being
+ processed.
+
+ @param Pool Pointer to the work pool.
+
+ @param Item Pointer to the item, which has been queued to the pool.  On
+        return, it is owned by the caller.
+
+ @return TRUE if the item was processed by a worker thread, FALSE if it was
+         not started and the caller should process it.
+ */
+BOOL
+YoriLibWorkPoolTakeItem(
+    __inout PYORI_LIB_WORK_POOL Pool,
+    __inout PYORI_LIB_WORK_ITEM Item
+    )
+{
+    BOOL Processed;
+
+    while (TRUE) {
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        if (Item->State == YORI_LIB_WORK_ITEM_QUEUED) {
+            YoriLibRemoveListItem(&Item->PendingList);
+            Pool->ItemsQueued--;
+            Processed = FALSE;
+            break;
+        }
+        if (Item->State == YORI_LIB_WORK_ITEM_COMPLETE) {
+            Processed = TRUE;
+            break;
+        }
+        ReleaseMutex(Pool->Mutex);
+        WaitForSingleObject(Pool->ItemCompleteEvent, INFINITE);
+    }
+
+    YoriLibRemoveListItem(&Item->OutputList);
+    Pool->ItemsOutstanding--;
+    ReleaseMutex(Pool->Mutex);
+
+    return Processed;
+}
+
+// vim:sw=4:ts=4:et:
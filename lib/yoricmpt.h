@@ -61,6 +61,14 @@
 #define COMMON_LVB_UNDERSCORE      0x8000
 #endif
 
+#ifndef INVALID_SET_FILE_POINTER
+/**
+ The value returned from SetFilePointer on failure, for compilers that don't
+ define it.
+ */
+#define INVALID_SET_FILE_POINTER ((DWORD)-1)
+#endif
+
 
 #ifndef DWORD_PTR
 #ifndef _WIN64
@@ -748,6 +756,82 @@ typedef struct _YORI_SYSTEM_PROCESS_INFORMATION {
 
 } YORI_SYSTEM_PROCESS_INFORMATION, *PYORI_SYSTEM_PROCESS_INFORMATION;
 
+/**
+ Definition of the system extended handle information enumeration class for
+ NtQuerySystemInformation .
+ */
+#define SystemExtendedHandleInformation (64)
+
+/**
+ Information returned about every handle in the system.
+ */
+typedef struct _YORI_SYSTEM_HANDLE_ENTRY_EX {
+
+    /**
+     Pointer to the object in kernel address space.
+     */
+    PVOID Object;
+
+    /**
+     The process identifier of the process which has the handle open.
+     */
+    DWORD_PTR ProcessId;
+
+    /**
+     The value of the handle within the process.
+     */
+    DWORD_PTR HandleValue;
+
+    /**
+     The access granted to the handle.
+     */
+    ULONG GrantedAccess;
+
+    /**
+     Ignored in this application.
+     */
+    USHORT CreatorBackTraceIndex;
+
+    /**
+     An index describing the type of the object.  Note this value is not
+     constant across systems.
+     */
+    USHORT ObjectTypeIndex;
+
+    /**
+     Attributes of the handle.
+     */
+    ULONG HandleAttributes;
+
+    /**
+     Ignored in this application.
+     */
+    ULONG Reserved;
+
+} YORI_SYSTEM_HANDLE_ENTRY_EX, *PYORI_SYSTEM_HANDLE_ENTRY_EX;
+
+/**
+ Information returned about all handles in the system.
+ */
+typedef struct _YORI_SYSTEM_HANDLE_INFORMATION_EX {
+
+    /**
+     The number of entries in the Handles array.
+     */
+    DWORD_PTR NumberOfHandles;
+
+    /**
+     Ignored in this application.
+     */
+    DWORD_PTR Reserved;
+
+    /**
+     An array of handle entries.
+     */
+    YORI_SYSTEM_HANDLE_ENTRY_EX Handles[1];
+
+} YORI_SYSTEM_HANDLE_INFORMATION_EX, *PYORI_SYSTEM_HANDLE_INFORMATION_EX;
+
 
 /**
  If not defined by the compilation environment, the product identifier for
@@ -1619,6 +1703,14 @@ typedef struct _YORI_REPARSE_DATA_BUFFER {
 #define FILE_ATTRIBUTE_INTEGRITY_STREAM  (0x8000)
 #endif
 
+#ifndef FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS
+/**
+ Specifies the value for a file whose data is recalled from remote storage
+ when it is read if the compilation environment doesn't provide it.
+ */
+#define FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS (0x400000)
+#endif
+
 #ifndef FILE_FLAG_OPEN_NO_RECALL
 /**
  Specifies the value for opening a file without recalling from slow storage
@@ -2348,6 +2440,20 @@ typedef struct _FILE_STORAGE_INFO {
 
 #endif
 
+#ifndef VOLUME_NAME_DOS
+/**
+ If the compilation environment doesn't provide it, a flag to return a path
+ with a drive letter from GetFinalPathNameByHandle.
+ */
+#define VOLUME_NAME_DOS            0x0
+
+/**
+ If the compilation environment doesn't provide it, a flag to return a
+ normalized path from GetFinalPathNameByHandle.
+ */
+#define FILE_NAME_NORMALIZED       0x0
+#endif
+
 #ifndef IMAGE_FILE_MACHINE_AMD64
 /**
  If the compilation environment doesn't provide it, the value for an
@@ -4728,6 +4834,32 @@ ASSIGN_PROCESS_TO_JOB_OBJECT(HANDLE, HANDLE);
  */
 typedef ASSIGN_PROCESS_TO_JOB_OBJECT *PASSIGN_PROCESS_TO_JOB_OBJECT;
 
+/**
+ A prototype for the CancelSynchronousIo function.
+ */
+typedef
+BOOL WINAPI
+CANCEL_SYNCHRONOUS_IO(HANDLE);
+
+/**
+ A prototype for a pointer to the CancelSynchronousIo function.
+ */
+typedef CANCEL_SYNCHRONOUS_IO *PCANCEL_SYNCHRONOUS_IO;
+
+/**
+ A prototype for the CopyFileExW function.  The progress routine is not
+ used by Yori so is described as an opaque pointer.
+ */
+typedef
+BOOL
+WINAPI
+COPY_FILE_EXW(LPCWSTR, LPCWSTR, PVOID, LPVOID, LPBOOL, DWORD);
+
+/**
+ A prototype for a pointer to the CopyFileExW function.
+ */
+typedef COPY_FILE_EXW *PCOPY_FILE_EXW;
+
 /**
  A prototype for the CreateHardLinkW function.
  */
@@ -4969,6 +5101,18 @@ GET_FILE_INFORMATION_BY_HANDLE_EX(HANDLE, DWORD, PVOID, DWORD);
  */
 typedef GET_FILE_INFORMATION_BY_HANDLE_EX *PGET_FILE_INFORMATION_BY_HANDLE_EX;
 
+/**
+ A prototype for the GetFinalPathNameByHandleW function.
+ */
+typedef
+DWORD WINAPI
+GET_FINAL_PATH_NAME_BY_HANDLEW(HANDLE, LPWSTR, DWORD, DWORD);
+
+/**
+ A prototype for a pointer to the GetFinalPathNameByHandleW function.
+ */
+typedef GET_FINAL_PATH_NAME_BY_HANDLEW *PGET_FINAL_PATH_NAME_BY_HANDLEW;
+
 /**
  A prototype for the GetLogicalProcessorInformation function.
  */
@@ -5254,6 +5398,16 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PASSIGN_PROCESS_TO_JOB_OBJECT pAssignProcessToJobObject;
 
+    /**
+     If it's available on the current system, a pointer to CancelSynchronousIo.
+     */
+    PCANCEL_SYNCHRONOUS_IO pCancelSynchronousIo;
+
+    /**
+     If it's available on the current system, a pointer to CopyFileExW.
+     */
+    PCOPY_FILE_EXW pCopyFileExW;
+
     /**
      If it's available on the current system, a pointer to CreateHardLinkW.
      */
@@ -5354,6 +5508,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PGET_FILE_INFORMATION_BY_HANDLE_EX pGetFileInformationByHandleEx;
 
+    /**
+     If it's available on the current system, a pointer to GetFinalPathNameByHandleW.
+     */
+    PGET_FINAL_PATH_NAME_BY_HANDLEW pGetFinalPathNameByHandleW;
+
     /**
      If it's available on the current system, a pointer to GetLogicalProcessorInformation.
      */
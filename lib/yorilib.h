@@ -80,6 +80,18 @@ typedef struct _YORI_HASH_ENTRY {
      */
     YORI_LIST_ENTRY ListEntry;
 
+    /**
+     The hash table that this entry is inserted into.
+     */
+    struct _YORI_HASH_TABLE *HashTable;
+
+    /**
+     The hash of the key, retained so the key does not need to be hashed
+     again when the table is resized, and so that most mismatches can be
+     detected without comparing strings.
+     */
+    DWORD HashValue;
+
     /**
      A string that represents the key for the object within the table.
      */
@@ -109,16 +121,148 @@ typedef struct _YORI_HASH_BUCKET {
 typedef struct _YORI_HASH_TABLE {
 
     /**
-     The number of buckets in the hash table.
+     The number of buckets in the hash table.  This grows as entries are
+     inserted.
      */
     DWORD NumberBuckets;
 
     /**
-     An array of hash buckets.
+     The number of entries currently inserted into the hash table.
+     */
+    DWORD EntryCount;
+
+    /**
+     An array of hash buckets.  Initially this immediately follows the
+     table structure in memory; if the table has grown, it is a separate
+     allocation.
      */
     PYORI_HASH_BUCKET Buckets;
 } YORI_HASH_TABLE, *PYORI_HASH_TABLE;
 
+/**
+ A value indicating that no substring matches within a substring matcher.
+ */
+#define YORI_SUBSTRING_MATCHER_NO_MATCH ((DWORD)-1)
+
+/**
+ The number of characters whose transitions from the root of a substring
+ matcher automaton are looked up from a table rather than by walking the
+ root's children.
+ */
+#define YORI_SUBSTRING_MATCHER_ROOT_TRANSITIONS (128)
+
+/**
+ A single node within the automaton used to search for multiple substrings.
+ Each node corresponds to a prefix of one or more of the substrings.
+ */
+typedef struct _YORI_SUBSTRING_MATCHER_NODE {
+
+    /**
+     The index of the first child of this node, or zero if the node has no
+     children.
+     */
+    DWORD FirstChild;
+
+    /**
+     The index of the next child of this node's parent, or zero if this is
+     the last child.
+     */
+    DWORD NextSibling;
+
+    /**
+     The index of the node corresponding to the longest proper suffix of
+     this node's prefix that is also a prefix in the automaton.
+     */
+    DWORD Failure;
+
+    /**
+     The index of the nearest node along the failure chain which completes
+     a substring, or zero if there is none.
+     */
+    DWORD OutputLink;
+
+    /**
+     The index within the match array of the substring that ends at this
+     node, or YORI_SUBSTRING_MATCHER_NO_MATCH if no substring ends here.
+     */
+    DWORD MatchIndex;
+
+    /**
+     The number of characters in the prefix described by this node.
+     */
+    DWORD Depth;
+
+    /**
+     The character that transitions from the parent to this node.
+     */
+    TCHAR Char;
+} YORI_SUBSTRING_MATCHER_NODE, *PYORI_SUBSTRING_MATCHER_NODE;
+
+/**
+ A compiled form of a set of substrings which can be used to search many
+ strings.  A single substring is searched with a Horspool skip table; multiple
+ substrings are searched with an Aho-Corasick automaton so that each
+ character of the string being searched is examined once.  For case
+ insensitive matchers, the tables are built on upcased characters.
+ */
+typedef struct _YORI_SUBSTRING_MATCHER {
+
+    /**
+     The number of substrings in the match array.
+     */
+    DWORD NumberMatches;
+
+    /**
+     The array of substrings to search for.  This is owned by the caller.
+     */
+    PYORI_STRING MatchArray;
+
+    /**
+     TRUE if the matcher is case insensitive, FALSE if it is case sensitive.
+     */
+    BOOLEAN Insensitive;
+
+    /**
+     TRUE if the matcher searches using the automaton, FALSE if it uses the
+     skip table.
+     */
+    BOOLEAN UseAutomaton;
+
+    /**
+     The index of the earliest empty substring in the match array, or
+     YORI_SUBSTRING_MATCHER_NO_MATCH if no substrings are empty.
+     */
+    DWORD EmptyMatchIndex;
+
+    /**
+     The length of the longest substring in the match array.
+     */
+    DWORD MaximumLength;
+
+    /**
+     The number of nodes in the automaton.
+     */
+    DWORD NodeCount;
+
+    /**
+     The array of nodes in the automaton.  The first node is the root.
+     */
+    PYORI_SUBSTRING_MATCHER_NODE Nodes;
+
+    /**
+     The distance to advance when a character is found at the end of the
+     search window, indexed by the low byte of the character.  Only used
+     when searching for a single substring.
+     */
+    DWORD SkipTable[256];
+
+    /**
+     The child of the root node for each low character value, or zero if
+     no substring starts with the character.  Only used by the automaton.
+     */
+    DWORD RootTransition[YORI_SUBSTRING_MATCHER_ROOT_TRANSITIONS];
+} YORI_SUBSTRING_MATCHER, *PYORI_SUBSTRING_MATCHER;
+
 #pragma pack(push, 1)
 
 /**
@@ -343,6 +487,134 @@ typedef struct _YORI_FILE_INFO {
     TCHAR *       Extension;
 } YORI_FILE_INFO, *PYORI_FILE_INFO;
 
+/**
+ A structure containing the core fields of a PE header.
+ */
+typedef struct _YORILIB_PE_HEADERS {
+    /**
+     The signature indicating a PE file.
+     */
+    DWORD Signature;
+
+    /**
+     The base PE header.
+     */
+    IMAGE_FILE_HEADER ImageHeader;
+
+    /**
+     The contents of the PE optional header.  This isn't really optional in
+     NT since it contains core fields needed for NT to run things.
+     */
+    IMAGE_OPTIONAL_HEADER OptionalHeader;
+} YORILIB_PE_HEADERS, *PYORILIB_PE_HEADERS;
+
+/**
+ Indicates that handle based information about the file has been queried.
+ */
+#define YORI_LIB_COLLECT_HANDLE_INFO        0x0001
+
+/**
+ Indicates that standard information about the file has been queried.
+ */
+#define YORI_LIB_COLLECT_STANDARD_INFO      0x0002
+
+/**
+ Indicates that the PE headers of the file have been queried.
+ */
+#define YORI_LIB_COLLECT_PE_HEADERS         0x0004
+
+/**
+ Indicates that the version resource of the file has been queried.
+ */
+#define YORI_LIB_COLLECT_VERSION_INFO       0x0008
+
+/**
+ Indicates that the security descriptor of the file has been queried.
+ */
+#define YORI_LIB_COLLECT_SECURITY           0x0010
+
+/**
+ State shared between the functions that collect information about a single
+ file.  Many pieces of information require opening the file or asking the
+ system about it, and several pieces of information come from the same
+ query.  This structure allows the file to be opened once and each query to
+ be issued once, regardless of how many pieces of information are wanted.
+ */
+typedef struct _YORI_LIB_FILE_COLLECT_CONTEXT {
+
+    /**
+     The access that collection functions expected to run against this file
+     require.  This is requested when the file is first opened so that the
+     handle can be used by all of them.
+     */
+    DWORD DesiredAccess;
+
+    /**
+     The access that FileHandle was opened with.
+     */
+    DWORD HandleAccess;
+
+    /**
+     If nonzero, the smallest access which could not be obtained when
+     opening the file.  Any request for a superset of this access is not
+     attempted again.
+     */
+    DWORD FailedAccess;
+
+    /**
+     A set of YORI_LIB_COLLECT_* flags indicating which queries have been
+     issued against the file.
+     */
+    DWORD QueriedFlags;
+
+    /**
+     A set of YORI_LIB_COLLECT_* flags indicating which queries have
+     succeeded and whose results are available in this structure.
+     */
+    DWORD ValidFlags;
+
+    /**
+     A handle to the file, or INVALID_HANDLE_VALUE if it has not been
+     opened.
+     */
+    HANDLE FileHandle;
+
+    /**
+     Pointer to the version resource of the file, or NULL if it is not
+     available.
+     */
+    PVOID VersionInfo;
+
+    /**
+     Pointer to the security descriptor of the file, or NULL if it is not
+     available.  This may point to LocalSecurityDescriptor or to a heap
+     allocation.
+     */
+    PSECURITY_DESCRIPTOR SecurityDescriptor;
+
+    /**
+     Information returned from GetFileInformationByHandle.
+     */
+    BY_HANDLE_FILE_INFORMATION HandleInfo;
+
+    /**
+     Information returned from GetFileInformationByHandleEx's
+     FileStandardInfo class.
+     */
+    FILE_STANDARD_INFO StandardInfo;
+
+    /**
+     The PE headers of the file, if it is an executable.
+     */
+    YORILIB_PE_HEADERS PeHeaders;
+
+    /**
+     A buffer to hold the security descriptor of the file without requiring
+     a heap allocation in the common case.
+     */
+    UCHAR LocalSecurityDescriptor[512];
+} YORI_LIB_FILE_COLLECT_CONTEXT, *PYORI_LIB_FILE_COLLECT_CONTEXT;
+
 /**
  Adds a specified number of bytes to a pointer value and returns the
  added value.
@@ -574,6 +846,102 @@ YoriLibExpandCommandVariables(
     __inout PYORI_STRING ExpandedString
     );
 
+/**
+ A single element of a compiled format template, describing either a run of
+ literal text or a variable to expand.
+ */
+typedef struct _YORI_LIB_FORMAT_TOKEN {
+
+    /**
+     For a literal, the text to copy to the output.  For a variable, the
+     name of the variable, without delimiters.
+     */
+    YORI_STRING Text;
+
+    /**
+     The identifier returned by the resolve function for a variable.  Zero
+     for literals or if no resolve function was supplied.
+     */
+    DWORD VariableId;
+
+    /**
+     TRUE if this token is a variable, FALSE if it is literal text.
+     */
+    BOOL IsVariable;
+} YORI_LIB_FORMAT_TOKEN, *PYORI_LIB_FORMAT_TOKEN;
+
+/**
+ A format string compiled into an array of tokens so that it can be expanded
+ repeatedly without parsing it again.
+ */
+typedef struct _YORI_LIB_FORMAT_TEMPLATE {
+
+    /**
+     The number of elements in the Tokens array.
+     */
+    DWORD TokenCount;
+
+    /**
+     The total number of literal characters across all tokens, used to size
+     the output buffer.
+     */
+    DWORD LiteralChars;
+
+    /**
+     An array of tokens.  The text for each token is contained in the same
+     allocation.
+     */
+    PYORI_LIB_FORMAT_TOKEN Tokens;
+} YORI_LIB_FORMAT_TEMPLATE, *PYORI_LIB_FORMAT_TEMPLATE;
+
+/**
+ A prototype for a callback function to map a variable name to an identifier
+ when a format template is compiled.
+ */
+typedef DWORD YORILIB_VARIABLE_RESOLVE_FN(PYORI_STRING VariableName, PVOID Context);
+
+/**
+ A pointer to a callback function to map a variable name to an identifier.
+ */
+typedef YORILIB_VARIABLE_RESOLVE_FN *PYORILIB_VARIABLE_RESOLVE_FN;
+
+/**
+ A prototype for a callback function to invoke for variable expansion when
+ expanding a compiled format template.
+ */
+typedef DWORD YORILIB_FORMAT_EXPAND_FN(PYORI_STRING OutputBuffer, DWORD VariableId, PYORI_STRING VariableName, PVOID Context);
+
+/**
+ A pointer to a callback function to invoke for variable expansion when
+ expanding a compiled format template.
+ */
+typedef YORILIB_FORMAT_EXPAND_FN *PYORILIB_FORMAT_EXPAND_FN;
+
+__success(return)
+BOOL
+YoriLibCompileFormatTemplate(
+    __out PYORI_LIB_FORMAT_TEMPLATE Template,
+    __in PYORI_STRING String,
+    __in TCHAR MatchChar,
+    __in BOOLEAN PreserveEscapes,
+    __in_opt PYORILIB_VARIABLE_RESOLVE_FN ResolveFn,
+    __in_opt PVOID Context
+    );
+
+__success(return)
+BOOL
+YoriLibExpandFormatTemplate(
+    __in PYORI_LIB_FORMAT_TEMPLATE Template,
+    __in PYORILIB_FORMAT_EXPAND_FN Function,
+    __in_opt PVOID Context,
+    __inout PYORI_STRING ExpandedString
+    );
+
+VOID
+YoriLibFreeFormatTemplate(
+    __inout PYORI_LIB_FORMAT_TEMPLATE Template
+    );
+
 // *** COLOR.C ***
 
 
@@ -1081,6 +1449,15 @@ typedef YORILIB_FILE_ENUM_FN *PYORILIB_FILE_ENUM_FN;
  */
 #define YORILIB_FILEENUM_DIRECTORY_CONTENTS      0x00000100
 
+/**
+ Read directories on background threads ahead of when they are needed.
+ Recursive enumerates read subdirectories ahead of recursing into them;
+ other enumerates use anything queued with @ref YoriLibFileEnumReadAhead .
+ Callbacks are still invoked on the calling thread, one at a time, in the
+ same order as an enumerate without this flag.
+ */
+#define YORILIB_FILEENUM_PARALLEL                0x00000200
+
 __success(return)
 BOOL
 YoriLibForEachFile(
@@ -1099,6 +1476,19 @@ YoriLibDoesFileMatchExpression (
     __in PYORI_STRING Wildcard
     );
 
+__success(return)
+BOOL
+YoriLibFileEnumStartReadAhead(VOID);
+
+VOID
+YoriLibFileEnumEndReadAhead(VOID);
+
+__success(return)
+BOOL
+YoriLibFileEnumReadAhead(
+    __in PYORI_STRING FileSpec
+    );
+
 // *** FILEFILT.C ***
 
 /**
@@ -1117,6 +1507,12 @@ typedef struct _YORI_LIB_FILE_FILTER {
      */
     DWORD ElementSize;
 
+    /**
+     The access to the file that the criteria require in order to collect
+     information to compare against.
+     */
+    DWORD CollectAccess;
+
     /**
      An array of criteria to apply.
      */
@@ -1133,7 +1529,7 @@ typedef DWORD (* YORI_LIB_FILE_FILT_COMPARE_FN)(PYORI_FILE_INFO, PYORI_FILE_INFO
  Specifies a pointer to a function which can collect file information from
  the disk or file system for some particular piece of data.
  */
-typedef BOOL (* YORI_LIB_FILE_FILT_COLLECT_FN)(PYORI_FILE_INFO, PWIN32_FIND_DATA, PYORI_STRING);
+typedef BOOL (* YORI_LIB_FILE_FILT_COLLECT_FN)(PYORI_FILE_INFO, PWIN32_FIND_DATA, PYORI_STRING, PYORI_LIB_FILE_COLLECT_CONTEXT);
 
 /**
  Specifies a pointer to a function which can generate in memory file
@@ -1311,193 +1707,236 @@ YoriLibIsExecutableGui(
     __in PYORI_STRING FullPath
     );
 
+VOID
+YoriLibInitFileCollectContext(
+    __out PYORI_LIB_FILE_COLLECT_CONTEXT Context,
+    __in DWORD DesiredAccess
+    );
+
+VOID
+YoriLibResetFileCollectContext(
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
+    );
+
+DWORD
+YoriLibGetFileCollectAccess(
+    __in YORI_LIB_FILE_FILT_COLLECT_FN CollectFn
+    );
+
 BOOL
 YoriLibCollectAccessTime (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectAllocatedRangeCount (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectAllocationSize (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectArch (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectCompressionAlgorithm (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectCompressedFileSize (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectCreateTime (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectDescription (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectEffectivePermissions (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectFileAttributes (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectFileExtension (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectFileId (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectFileName (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectFileSize (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectFileVersionString (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectFragmentCount (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectLinkCount (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectObjectId (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectOsVersion (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectOwner (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectReparseTag (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectShortName (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectSubsystem (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectStreamCount (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectUsn (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectVersion (
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 BOOL
 YoriLibCollectWriteTime(
     __inout PYORI_FILE_INFO Entry,
     __in PWIN32_FIND_DATA FindData,
-    __in PYORI_STRING FullPath
+    __in PYORI_STRING FullPath,
+    __inout PYORI_LIB_FILE_COLLECT_CONTEXT Context
     );
 
 DWORD
@@ -2072,6 +2511,17 @@ YoriLibFreeEmptyHashTable(
     __in PYORI_HASH_TABLE HashTable
     );
 
+DWORD
+YoriLibHashString(
+    __in PYORI_STRING String
+    );
+
+PYORI_HASH_ENTRY
+YoriLibHashGetNextEntry(
+    __in PYORI_HASH_TABLE HashTable,
+    __in_opt PYORI_HASH_ENTRY PreviousEntry
+    );
+
 VOID
 YoriLibHashInsertByKey(
     __in PYORI_HASH_TABLE HashTable,
@@ -2086,6 +2536,12 @@ YoriLibHashLookupByKey(
     __in PYORI_STRING KeyString
     );
 
+PYORI_HASH_ENTRY
+YoriLibHashLookupByKeyCaseSensitive(
+    __in PYORI_HASH_TABLE HashTable,
+    __in PYORI_STRING KeyString
+    );
+
 VOID
 YoriLibHashRemoveByEntry(
     __in PYORI_HASH_ENTRY HashEntry
@@ -2158,6 +2614,59 @@ YoriLibHexDiff(
 #define CP_UTF8 65001
 #endif
 
+/**
+ State carried between calls which convert UTF8 to UTF16, so that a sequence
+ which is split between two buffers can be decoded.  This should be zeroed
+ before the first call.
+ */
+typedef struct _YORI_LIB_UTF8_DECODE_STATE {
+
+    /**
+     The bits of the value which have been decoded so far.
+     */
+    DWORD Value;
+
+    /**
+     The number of bytes in the sequence being decoded.
+     */
+    DWORD SequenceLength;
+
+    /**
+     The number of bytes needed to complete the sequence being decoded.
+     */
+    DWORD BytesRemaining;
+
+} YORI_LIB_UTF8_DECODE_STATE, *PYORI_LIB_UTF8_DECODE_STATE;
+
+/**
+ State carried between calls which convert UTF16 to UTF8, so that a
+ surrogate pair which is split between two buffers can be encoded.  This
+ should be zeroed before the first call.
+ */
+typedef struct _YORI_LIB_UTF8_ENCODE_STATE {
+
+    /**
+     A high surrogate which has been seen but not yet encoded, or zero if
+     there is none.
+     */
+    WCHAR HighSurrogate;
+
+} YORI_LIB_UTF8_ENCODE_STATE, *PYORI_LIB_UTF8_ENCODE_STATE;
+
+/**
+ The number of characters needed to hold the result of converting a
+ specified number of bytes of UTF8 to UTF16, including any sequence
+ completed from a previous buffer.
+ */
+#define YORI_LIB_UTF16_CHARS_FOR_UTF8(Bytes) ((Bytes) + 2)
+
+/**
+ The number of bytes needed to hold the result of converting a specified
+ number of UTF16 characters to UTF8, including any surrogate pair completed
+ from a previous buffer.
+ */
+#define YORI_LIB_UTF8_BYTES_FOR_UTF16(Chars) ((Chars) * 3 + 3)
+
 DWORD
 YoriLibGetMultibyteOutputEncoding();
 
@@ -2202,6 +2711,40 @@ YoriLibMultibyteInput(
     __in DWORD OutputBufferLength
     );
 
+DWORD
+YoriLibUtf8ToUtf16(
+    __inout_opt PYORI_LIB_UTF8_DECODE_STATE State,
+    __in_ecount(InputBufferLength) LPCSTR InputStringBuffer,
+    __in DWORD InputBufferLength,
+    __out LPWSTR OutputStringBuffer
+    );
+
+DWORD
+YoriLibUtf16ToUtf8(
+    __inout_opt PYORI_LIB_UTF8_ENCODE_STATE State,
+    __in_ecount(InputBufferLength) LPCWSTR InputStringBuffer,
+    __in DWORD InputBufferLength,
+    __out LPSTR OutputStringBuffer
+    );
+
+__success(return)
+BOOL
+YoriLibMultibyteInputToString(
+    __in_ecount(InputBufferLength) LPCSTR InputStringBuffer,
+    __in DWORD InputBufferLength,
+    __inout PYORI_STRING OutputString
+    );
+
+__success(return)
+BOOL
+YoriLibMultibyteOutputToBuffer(
+    __in_ecount(InputBufferLength) LPCTSTR InputStringBuffer,
+    __in DWORD InputBufferLength,
+    __inout LPSTR * OutputStringBuffer,
+    __inout PDWORD OutputBufferLength,
+    __out PDWORD BytesWritten
+    );
+
 // *** JOBOBJ.C ***
 
 HANDLE
@@ -2235,6 +2778,43 @@ YoriLibDisplayMitLicense(
 
 // *** LINEREAD.C ***
 
+/**
+ A view of a line returned from the line reader.  This refers to the line
+ reader's buffer and has not been converted into host encoding.
+ */
+typedef struct _YORI_LIB_LINE_VIEW {
+
+    /**
+     Pointer to the start of the line within the line reader's buffer.
+     */
+    PVOID Line;
+
+    /**
+     The number of characters in the line, excluding any line end.  These
+     are 16 bit characters if WideChars is TRUE, or 8 bit characters in the
+     input encoding if it is FALSE.
+     */
+    DWORD CharsInLine;
+
+    /**
+     TRUE if the line consists of 16 bit characters, FALSE if it consists of
+     8 bit characters.
+     */
+    BOOLEAN WideChars;
+} YORI_LIB_LINE_VIEW, *PYORI_LIB_LINE_VIEW;
+
+DWORD
+YoriLibFindLineEndA(
+    __in PUCHAR Buffer,
+    __in DWORD CharCount
+    );
+
+DWORD
+YoriLibFindLineEndW(
+    __in PWCHAR Buffer,
+    __in DWORD CharCount
+    );
+
 PVOID
 YoriLibReadLineToString(
     __in PYORI_STRING UserString,
@@ -2253,11 +2833,54 @@ YoriLibReadLineToStringEx(
     __out PBOOL TimeoutReached
     );
 
+BOOL
+YoriLibReadLineToView(
+    __inout PVOID * Context,
+    __in HANDLE FileHandle,
+    __out PYORI_LIB_LINE_VIEW LineView
+    );
+
+BOOL
+YoriLibReadLineToViewEx(
+    __inout PVOID * Context,
+    __in BOOL ReturnFinalNonTerminatedLine,
+    __in DWORD MaximumDelay,
+    __in HANDLE FileHandle,
+    __out PYORI_LIB_LINE_VIEW LineView,
+    __out PBOOL LineTerminated,
+    __out PBOOL TimeoutReached
+    );
+
+BOOL
+YoriLibLineViewToString(
+    __in PYORI_LIB_LINE_VIEW LineView,
+    __inout PYORI_STRING UserString
+    );
+
 VOID
 YoriLibLineReadClose(
     __in_opt PVOID Context
     );
 
+BOOL
+YoriLibMappedLineReadToView(
+    __inout PVOID * Context,
+    __in HANDLE FileHandle,
+    __out PYORI_LIB_LINE_VIEW LineView
+    );
+
+PVOID
+YoriLibMappedLineReadToString(
+    __in PYORI_STRING UserString,
+    __inout PVOID * Context,
+    __in HANDLE FileHandle
+    );
+
+VOID
+YoriLibMappedLineReadClose(
+    __in_opt PVOID Context
+    );
+
 // *** LIST.C ***
 
 VOID
@@ -2399,6 +3022,14 @@ YoriLibDoesProcessHave32BitPeb(
 BOOL
 YoriLibEnableBackupPrivilege();
 
+BOOL
+YoriLibEnableDebugPrivilege(
+    __out_opt PBOOL WasEnabled
+    );
+
+BOOL
+YoriLibDisableDebugPrivilege();
+
 // *** RECYCLE.C ***
 
 BOOL
@@ -2459,6 +3090,13 @@ YoriLibOutputTextToMultibyteDevice(
     __in DWORD BufferLength
     );
 
+BOOL
+YoriLibOutputTextToMultibyteCRLF(
+    __in HANDLE hOutput,
+    __in LPCTSTR StringBuffer,
+    __in DWORD BufferLength
+    );
+
 /**
  Output the string to the standard output device.
  */
@@ -2539,6 +3177,11 @@ YoriLibConsoleNoEscapeSetFunctions(
     __out PYORI_LIB_VT_CALLBACK_FUNCTIONS CallbackFunctions
     );
 
+BOOL
+YoriLibConsoleIncludeEscapeSetFunctions(
+    __out PYORI_LIB_VT_CALLBACK_FUNCTIONS CallbackFunctions
+    );
+
 BOOL
 YoriLibUtf8TextWithEscapesSetFunctions(
     __out PYORI_LIB_VT_CALLBACK_FUNCTIONS CallbackFunctions
@@ -2557,6 +3200,14 @@ YoriLibProcessVtEscapesOnOpenStream(
     __in PYORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks
     );
 
+BOOL
+YoriLibProcessVtEscapesOnNewStream(
+    __in LPTSTR String,
+    __in DWORD StringLength,
+    __in HANDLE hOutput,
+    __in PYORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks
+    );
+
 BOOL
 YoriLibOutput(
     __in DWORD Flags,
@@ -2637,6 +3288,87 @@ YoriLibQueryConsoleCapabilities(
     __out_opt PBOOL SupportsAutoLineWrap
     );
 
+// *** OUTBUF.C ***
+
+/**
+ A buffer which accumulates output destined for a standard handle.  Output
+ to a console is displayed as it is generated; output to a file or pipe is
+ written in large blocks.
+ */
+typedef struct _YORI_LIB_OUTPUT_BUFFER {
+
+    /**
+     The device to write output to.
+     */
+    HANDLE hOutput;
+
+    /**
+     Flags, as supplied to YoriLibOutput, indicating the output stream and
+     its behavior.
+     */
+    DWORD Flags;
+
+    /**
+     TRUE if the output device is a console, in which case output is
+     written immediately.
+     */
+    BOOL OutputIsConsole;
+
+    /**
+     The callback functions used for text that is written without
+     buffering, which is all text sent to a console and any single write
+     which is larger than the buffer.
+     */
+    YORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks;
+
+    /**
+     Text which has been processed for escapes and line endings but not yet
+     written to the device.
+     */
+    YORI_STRING Text;
+
+    /**
+     A scratch buffer used to convert Text into the output encoding.
+     */
+    LPSTR Encoded;
+
+    /**
+     The size of the Encoded buffer, in bytes.
+     */
+    DWORD EncodedLength;
+
+} YORI_LIB_OUTPUT_BUFFER, *PYORI_LIB_OUTPUT_BUFFER;
+
+__success(return)
+BOOL
+YoriLibOutputBufferInitialize(
+    __out PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in DWORD Flags
+    );
+
+BOOL
+YoriLibOutputBufferFlush(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer
+    );
+
+BOOL
+YoriLibOutputBufferWriteString(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in PYORI_STRING String
+    );
+
+BOOL
+YoriLibOutputBufferWrite(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in LPCTSTR szFmt,
+    ...
+    );
+
+BOOL
+YoriLibOutputBufferCleanup(
+    __inout PYORI_LIB_OUTPUT_BUFFER Buffer
+    );
+
 // *** PATH.C ***
 
 /**
@@ -3252,22 +3984,6 @@ YoriLibCountStringNotContainingChars(
     __in LPCTSTR match
     );
 
-PYORI_STRING
-YoriLibFindFirstMatchingSubstring(
-    __in PYORI_STRING String,
-    __in DWORD NumberMatches,
-    __in PYORI_STRING MatchArray,
-    __out_opt PDWORD StringOffsetOfMatch
-    );
-
-PYORI_STRING
-YoriLibFindFirstMatchingSubstringInsensitive(
-    __in PYORI_STRING String,
-    __in DWORD NumberMatches,
-    __in PYORI_STRING MatchArray,
-    __out_opt PDWORD StringOffsetOfMatch
-    );
-
 LPTSTR
 YoriLibFindLeftMostCharacter(
     __in PYORI_STRING String,
@@ -3348,6 +4064,49 @@ YoriLibStringToDateTime(
  */
 #define wcscpy(a,b)  YoriLibSPrintf(a, L"%s", b)
 
+// *** SUBSTR.C ***
+
+PYORI_SUBSTRING_MATCHER
+YoriLibCompileSubstringMatcher(
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive
+    );
+
+VOID
+YoriLibFreeSubstringMatcher(
+    __in PYORI_SUBSTRING_MATCHER Matcher
+    );
+
+PYORI_STRING
+YoriLibSubstringMatcherFindFirst(
+    __in PYORI_SUBSTRING_MATCHER Matcher,
+    __in PYORI_STRING String,
+    __out_opt PDWORD StringOffsetOfMatch
+    );
+
+PYORI_STRING
+YoriLibSubstringMatcherFindEarliestEntry(
+    __in PYORI_SUBSTRING_MATCHER Matcher,
+    __in PYORI_STRING String
+    );
+
+PYORI_STRING
+YoriLibFindFirstMatchingSubstring(
+    __in PYORI_STRING String,
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __out_opt PDWORD StringOffsetOfMatch
+    );
+
+PYORI_STRING
+YoriLibFindFirstMatchingSubstringInsensitive(
+    __in PYORI_STRING String,
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __out_opt PDWORD StringOffsetOfMatch
+    );
+
 // *** UPDATE.C ***
 
 /**
@@ -3432,4 +4191,245 @@ YoriLibIsPathUrl(
 
 BOOL YoriLibIsStdInConsole();
 
+// *** WORKPOOL.C ***
+
+/**
+ The maximum number of threads in a work pool.
+ */
+#define YORI_LIB_WORK_POOL_MAX_THREADS (32)
+
+/**
+ Indicates a work item is waiting for a worker thread.
+ */
+#define YORI_LIB_WORK_ITEM_QUEUED   (0)
+
+/**
+ Indicates a work item is being processed.
+ */
+#define YORI_LIB_WORK_ITEM_ACTIVE   (1)
+
+/**
+ Indicates a work item has been processed and is waiting to be collected.
+ */
+#define YORI_LIB_WORK_ITEM_COMPLETE (2)
+
+/**
+ The header of a single item queued to a work pool.  Callers embed this in
+ a larger structure describing the work.
+ */
+typedef struct _YORI_LIB_WORK_ITEM {
+
+    /**
+     The links of this item in the list of items waiting for a worker
+     thread.  Only meaningful while the item is queued.
+     */
+    YORI_LIST_ENTRY PendingList;
+
+    /**
+     The links of this item in the list of items which have not been
+     collected, in the order they were queued.
+     */
+    YORI_LIST_ENTRY OutputList;
+
+    /**
+     One of the YORI_LIB_WORK_ITEM_ values indicating the progress of
+     processing this item.
+     */
+    DWORD State;
+
+} YORI_LIB_WORK_ITEM, *PYORI_LIB_WORK_ITEM;
+
+/**
+ A prototype for a function to allocate the state used by a single worker
+ thread.  Returns NULL on failure.
+ */
+typedef PVOID YORI_LIB_WORK_POOL_CREATE_WORKER_FN(PVOID Context);
+
+/**
+ A pointer to a function to allocate the state used by a single worker
+ thread.
+ */
+typedef YORI_LIB_WORK_POOL_CREATE_WORKER_FN *PYORI_LIB_WORK_POOL_CREATE_WORKER_FN;
+
+/**
+ A prototype for a function to free the state used by a single worker
+ thread.
+ */
+typedef VOID YORI_LIB_WORK_POOL_DELETE_WORKER_FN(PVOID Worker);
+
+/**
+ A pointer to a function to free the state used by a single worker thread.
+ */
+typedef YORI_LIB_WORK_POOL_DELETE_WORKER_FN *PYORI_LIB_WORK_POOL_DELETE_WORKER_FN;
+
+/**
+ A prototype for a function to process a single work item.
+ */
+typedef VOID YORI_LIB_WORK_POOL_PROCESS_FN(PVOID Worker, PYORI_LIB_WORK_ITEM Item);
+
+/**
+ A pointer to a function to process a single work item.
+ */
+typedef YORI_LIB_WORK_POOL_PROCESS_FN *PYORI_LIB_WORK_POOL_PROCESS_FN;
+
+struct _YORI_LIB_WORK_POOL;
+
+/**
+ The state passed to a single worker thread.
+ */
+typedef struct _YORI_LIB_WORK_POOL_THREAD {
+
+    /**
+     Pointer to the pool that the thread belongs to.
+     */
+    struct _YORI_LIB_WORK_POOL *Pool;
+
+    /**
+     The state used by this thread to process items.
+     */
+    PVOID Worker;
+
+} YORI_LIB_WORK_POOL_THREAD, *PYORI_LIB_WORK_POOL_THREAD;
+
+/**
+ A set of worker threads which process items queued by a single thread.
+ Threads are created as work is queued.
+ */
+typedef struct _YORI_LIB_WORK_POOL {
+
+    /**
+     The context passed to CreateWorker, or to ProcessItem if CreateWorker
+     is NULL.
+     */
+    PVOID Context;
+
+    /**
+     Optionally points to a function to allocate the state for each
+     worker thread.
+     */
+    PYORI_LIB_WORK_POOL_CREATE_WORKER_FN CreateWorker;
+
+    /**
+     Optionally points to a function to free the state for each worker
+     thread.
+     */
+    PYORI_LIB_WORK_POOL_DELETE_WORKER_FN DeleteWorker;
+
+    /**
+     Pointer to a function to process a single item.
+     */
+    PYORI_LIB_WORK_POOL_PROCESS_FN ProcessItem;
+
+    /**
+     Optionally points to worker state used to process items on the
+     queueing thread if no worker thread can be created.
+     */
+    PVOID ForegroundWorker;
+
+    /**
+     A mutex to synchronize the item lists and item state.
+     */
+    HANDLE Mutex;
+
+    /**
+     An event signalled when an item is queued.  This must immediately
+     precede WorkerShutdownEvent so that workers can wait on both.
+     */
+    HANDLE WorkerWaitEvent;
+
+    /**
+     An event signalled when worker threads should terminate.
+     */
+    HANDLE WorkerShutdownEvent;
+
+    /**
+     An event signalled when a worker completes an item.
+     */
+    HANDLE ItemCompleteEvent;
+
+    /**
+     The list of items waiting for a worker thread.
+     */
+    YORI_LIST_ENTRY PendingList;
+
+    /**
+     The list of items which have not been collected, in the order they
+     were queued.
+     */
+    YORI_LIST_ENTRY OutputList;
+
+    /**
+     The number of items on PendingList.
+     */
+    DWORD ItemsQueued;
+
+    /**
+     The number of items on OutputList.
+     */
+    DWORD ItemsOutstanding;
+
+    /**
+     The number of worker threads created.
+     */
+    DWORD ThreadsAllocated;
+
+    /**
+     The maximum number of worker threads to create.
+     */
+    DWORD MaxThreads;
+
+    /**
+     The state passed to each worker thread.
+     */
+    YORI_LIB_WORK_POOL_THREAD Workers[YORI_LIB_WORK_POOL_MAX_THREADS];
+
+    /**
+     Handles to each worker thread.
+     */
+    HANDLE Threads[YORI_LIB_WORK_POOL_MAX_THREADS];
+
+} YORI_LIB_WORK_POOL, *PYORI_LIB_WORK_POOL;
+
+DWORD
+YoriLibWorkPoolGetThreadCount(
+    __in DWORD Minimum,
+    __in DWORD Multiplier
+    );
+
+__success(return)
+BOOL
+YoriLibWorkPoolInitialize(
+    __out PYORI_LIB_WORK_POOL Pool,
+    __in DWORD MaxThreads,
+    __in_opt PVOID Context,
+    __in_opt PYORI_LIB_WORK_POOL_CREATE_WORKER_FN CreateWorker,
+    __in_opt PYORI_LIB_WORK_POOL_DELETE_WORKER_FN DeleteWorker,
+    __in PYORI_LIB_WORK_POOL_PROCESS_FN ProcessItem,
+    __in_opt PVOID ForegroundWorker
+    );
+
+VOID
+YoriLibWorkPoolCleanup(
+    __inout PYORI_LIB_WORK_POOL Pool
+    );
+
+__success(return)
+BOOL
+YoriLibWorkPoolQueueItem(
+    __inout PYORI_LIB_WORK_POOL Pool,
+    __inout PYORI_LIB_WORK_ITEM Item
+    );
+
+PYORI_LIB_WORK_ITEM
+YoriLibWorkPoolGetCompletedItem(
+    __inout PYORI_LIB_WORK_POOL Pool,
+    __in DWORD MaxOutstanding
+    );
+
+BOOL
+YoriLibWorkPoolTakeItem(
+    __inout PYORI_LIB_WORK_POOL Pool,
+    __inout PYORI_LIB_WORK_ITEM Item
+    );
+
 // vim:sw=4:ts=4:et:
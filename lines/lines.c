@@ -35,9 +35,11 @@ CHAR strLinesHelpText[] =
         "\n"
         "Count the number of lines in one or more files.\n"
         "\n"
-        "LINES [-license] [-b] [-s] [-t] [<file>...]\n"
+        "LINES [-license] [-b] [-l] [-r] [-s] [-t] [<file>...]\n"
         "\n"
         "   -b             Use basic search criteria for files only\n"
+        "   -l             Display the number of bytes and longest line, implies -r\n"
+        "   -r             Count line feeds in raw data, processing files in parallel\n"
         "   -s             Process files from all subdirectories\n"
         "   -t             Display total line count of all files\n";
 
@@ -55,6 +57,145 @@ LinesHelp()
     return TRUE;
 }
 
+/**
+ The number of bytes in each buffer used to read a file when counting raw
+ data.
+ */
+#define LINES_READ_BUFFER_LENGTH (1024 * 1024)
+
+/**
+ The maximum number of threads to count files concurrently.
+ */
+#define LINES_MAX_THREADS (16)
+
+/**
+ The result of counting a single stream in raw mode.
+ */
+typedef struct _LINES_COUNT {
+
+    /**
+     The number of lines in the stream.
+     */
+    LONGLONG Lines;
+
+    /**
+     The number of bytes in the stream.
+     */
+    LONGLONG Bytes;
+
+    /**
+     The number of characters in the longest line, excluding any line end.
+     */
+    LONGLONG LongestLine;
+} LINES_COUNT, *PLINES_COUNT;
+
+/**
+ State carried between buffers when counting a single stream in raw mode.
+ */
+typedef struct _LINES_COUNT_STATE {
+
+    /**
+     The number of bytes in each character, which is 1 for 8 bit encodings
+     or 2 for UTF-16.
+     */
+    DWORD CharSize;
+
+    /**
+     The value of a line feed character, as it appears when loaded from the
+     buffer.  For big endian UTF-16 the bytes are swapped.
+     */
+    WORD LineFeed;
+
+    /**
+     The value of a carriage return character, as it appears when loaded
+     from the buffer.
+     */
+    WORD CarriageReturn;
+
+    /**
+     The most recent character processed.
+     */
+    WORD LastChar;
+
+    /**
+     TRUE if the length of each line needs to be calculated.  If FALSE,
+     only line feeds are counted, which allows a machine word to be counted
+     at a time.
+     */
+    BOOLEAN TrackLongest;
+
+    /**
+     TRUE if the stream is UTF-8, so UTF-8 continuation bytes are not
+     counted towards the length of a line.
+     */
+    BOOLEAN Utf8;
+
+    /**
+     TRUE if any characters have been processed.
+     */
+    BOOLEAN CharsFound;
+
+    /**
+     The number of characters found since the previous line feed.  This is
+     only maintained if TrackLongest is TRUE.
+     */
+    LONGLONG CurrentLineLength;
+
+} LINES_COUNT_STATE, *PLINES_COUNT_STATE;
+
+struct _LINES_CONTEXT;
+
+/**
+ State used by a single thread to count files in raw mode.
+ */
+typedef struct _LINES_WORKER {
+
+    /**
+     Pointer to the context shared by all threads.
+     */
+    struct _LINES_CONTEXT *LinesContext;
+
+    /**
+     A buffer to read data from the file into.
+     */
+    PUCHAR ReadBuffer;
+
+} LINES_WORKER, *PLINES_WORKER;
+
+/**
+ A single file to count in raw mode.  Requests are created by the
+ enumerating thread, counted by any worker thread, and displayed by the
+ enumerating thread in the order they were created.
+ */
+typedef struct _LINES_REQUEST {
+
+    /**
+     The state of this request within the work pool.
+     */
+    YORI_LIB_WORK_ITEM WorkItem;
+
+    /**
+     The full path to the file to count.
+     */
+    YORI_STRING FilePath;
+
+    /**
+     On completion, the counts found in the file.
+     */
+    LINES_COUNT Count;
+
+    /**
+     If the file could not be opened, the error code describing why.
+     */
+    DWORD OpenError;
+
+    /**
+     Set to TRUE if the file was opened.
+     */
+    BOOLEAN Opened;
+
+} LINES_REQUEST, *PLINES_REQUEST;
+
 /**
  Context passed to the callback which is invoked for each file found.
  */
@@ -71,6 +212,18 @@ typedef struct _LINES_CONTEXT {
      */
     BOOLEAN Recursive;
 
+    /**
+     TRUE to indicate that line feeds should be counted from raw data
+     rather than parsing each line.  Files are counted in parallel.
+     */
+    BOOLEAN RawCount;
+
+    /**
+     TRUE to indicate that the number of bytes and the length of the longest
+     line should be displayed.  This requires RawCount.
+     */
+    BOOLEAN DisplayLongest;
+
     /**
      The first error encountered when enumerating objects from a single arg.
      This is used to preserve file not found/path not found errors so that
@@ -99,6 +252,41 @@ typedef struct _LINES_CONTEXT {
      Records the total number of lines processed for all files.
      */
     LONGLONG TotalLinesFound;
+
+    /**
+     Records the total number of bytes processed for all files in raw mode.
+     */
+    LONGLONG TotalBytesFound;
+
+    /**
+     Records the longest line in any file processed in raw mode.
+     */
+    LONGLONG LongestLineFound;
+
+    /**
+     The buffer to accumulate output into before it is written to standard
+     output.
+     */
+    YORI_LIB_OUTPUT_BUFFER OutputBuffer;
+
+    /**
+     Worker state for the enumerating thread, used for input from a pipe or
+     if no threads can be created.
+     */
+    LINES_WORKER ForegroundWorker;
+
+    /**
+     The worker threads which count files, and the requests which have not
+     been displayed.
+     */
+    YORI_LIB_WORK_POOL WorkPool;
+
+    /**
+     The maximum number of requests outstanding before the enumerating
+     thread waits for results to be displayed.
+     */
+    DWORD MaxRequests;
+
 } LINES_CONTEXT, *PLINES_CONTEXT;
 
 /**
@@ -117,17 +305,20 @@ LinesProcessStream(
     )
 {
     PVOID LineContext = NULL;
-    YORI_STRING LineString;
-
-    YoriLibInitEmptyString(&LineString);
+    YORI_LIB_LINE_VIEW LineView;
 
     LinesContext->FilesFound++;
     LinesContext->FilesFoundThisArg++;
     LinesContext->FileLinesFound = 0;
 
+    //
+    //  Lines are only counted, so there's no need to convert them into
+    //  strings.
+    //
+
     while (TRUE) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibReadLineToView(&LineContext, hSource, &LineView)) {
             break;
         }
 
@@ -135,12 +326,645 @@ LinesProcessStream(
     }
 
     YoriLibLineReadClose(LineContext);
-    YoriLibFreeStringContents(&LineString);
 
     LinesContext->TotalLinesFound += LinesContext->FileLinesFound;
     return TRUE;
 }
 
+/**
+ Return a single character from a buffer being counted.
+
+ @param Buffer Pointer to the buffer.
+
+ @param CharSize The number of bytes in each character.
+
+ @param Index The index of the character to return.
+
+ @return The character, as it appears in memory.
+ */
+WORD
+LinesGetChar(
+    __in PUCHAR Buffer,
+    __in DWORD CharSize,
+    __in DWORD Index
+    )
+{
+    if (CharSize == sizeof(WCHAR)) {
+        return ((PWORD)Buffer)[Index];
+    }
+    return Buffer[Index];
+}
+
+/**
+ Count the line feeds in a buffer of raw data.  This examines a machine word
+ at a time.  Each character in the word is compared against a line feed by
+ XORing it, so matching characters become zero, and zero characters are
+ then isolated without carries between characters so that the number of
+ matches can be counted.  If the longest line is being tracked, words which
+ contain a line feed are processed a character at a time.
+
+ @param State Pointer to the state of the stream being counted, which is
+        updated with the contents of this buffer.
+
+ @param Count Pointer to the counts for the stream, which is updated with
+        the lines found in this buffer.
+
+ @param Buffer Pointer to the buffer to count.
+
+ @param CharCount The number of characters in the buffer.
+ */
+VOID
+LinesCountBuffer(
+    __inout PLINES_COUNT_STATE State,
+    __inout PLINES_COUNT Count,
+    __in PUCHAR Buffer,
+    __in DWORD CharCount
+    )
+{
+    DWORD Index;
+    DWORD WordEnd;
+    DWORD CharsPerWord;
+    DWORD BitsPerChar;
+    DWORD_PTR LaneOnes;
+    DWORD_PTR LowBits;
+    DWORD_PTR Pattern;
+    DWORD_PTR Word;
+    DWORD_PTR Matches;
+    DWORD_PTR Continuations;
+    DWORD_PTR HighBits;
+    WORD Char;
+    LONGLONG LineLength;
+
+    if (CharCount == 0) {
+        return;
+    }
+
+    State->CharsFound = TRUE;
+    CharsPerWord = sizeof(DWORD_PTR) / State->CharSize;
+    BitsPerChar = State->CharSize * 8;
+    if (State->CharSize == sizeof(WCHAR)) {
+        LaneOnes = ((DWORD_PTR)-1) / 0xFFFF;
+        LowBits = LaneOnes * 0x7FFF;
+    } else {
+        LaneOnes = ((DWORD_PTR)-1) / 0xFF;
+        LowBits = LaneOnes * 0x7F;
+    }
+    Pattern = LaneOnes * State->LineFeed;
+
+    Index = 0;
+    while (Index < CharCount) {
+
+        if (Index + CharsPerWord <= CharCount &&
+            (((DWORD_PTR)&Buffer[Index * State->CharSize]) & (sizeof(DWORD_PTR) - 1)) == 0) {
+
+            //
+            //  After the XOR, a character is zero if it was a line feed.
+            //  Adding the low bits of a character sets its high bit unless
+            //  the character was zero, and since the high bit is masked off
+            //  first, this never carries into the next character.
+            //
+
+            Word = *(DWORD_PTR *)&Buffer[Index * State->CharSize];
+            Matches = Word ^ Pattern;
+            Matches = ~(((Matches & LowBits) + LowBits) | Matches | LowBits);
+
+            if (Matches == 0) {
+
+                //
+                //  A UTF-8 continuation byte has its high bit set and the
+                //  next bit clear.  Shifting left moves the next bit into
+                //  the high bit of the same byte, so these can be isolated
+                //  and summed in the same way as line feeds.
+                //
+
+                if (State->TrackLongest) {
+                    State->CurrentLineLength += CharsPerWord;
+                    if (State->Utf8) {
+                        HighBits = LaneOnes * 0x80;
+                        Continuations = (Word & HighBits) & ~((Word << 1) & HighBits);
+                        Continuations = Continuations >> 7;
+                        State->CurrentLineLength -= (Continuations * LaneOnes) >> (sizeof(DWORD_PTR) * 8 - 8);
+                    }
+                }
+                Index += CharsPerWord;
+                State->LastChar = LinesGetChar(Buffer, State->CharSize, Index - 1);
+                continue;
+            }
+
+            if (!State->TrackLongest) {
+
+                //
+                //  Move each match to the low bit of its character, and
+                //  multiply to sum all characters into the highest one.
+                //
+
+                Matches = Matches >> (BitsPerChar - 1);
+                Count->Lines += (Matches * LaneOnes) >> (sizeof(DWORD_PTR) * 8 - BitsPerChar);
+                Index += CharsPerWord;
+                State->LastChar = LinesGetChar(Buffer, State->CharSize, Index - 1);
+                continue;
+            }
+
+            WordEnd = Index + CharsPerWord;
+        } else {
+            WordEnd = Index + 1;
+        }
+
+        for (; Index < WordEnd; Index++) {
+            Char = LinesGetChar(Buffer, State->CharSize, Index);
+            if (Char == State->LineFeed) {
+                Count->Lines++;
+                LineLength = State->CurrentLineLength;
+                if (LineLength > 0 && State->LastChar == State->CarriageReturn) {
+                    LineLength--;
+                }
+                if (LineLength > Count->LongestLine) {
+                    Count->LongestLine = LineLength;
+                }
+                State->CurrentLineLength = 0;
+            } else if (!State->Utf8 || (Char & 0xC0) != 0x80) {
+                State->CurrentLineLength++;
+            }
+            State->LastChar = Char;
+        }
+    }
+}
+
+/**
+ Count the lines in an opened stream by reading it in large blocks and
+ counting line feeds.  Unlike LinesProcessStream, a carriage return without
+ a line feed does not end a line.
+
+ @param hSource Handle to the source.
+
+ @param Worker Pointer to the state of the thread performing the count.
+
+ @param TrackLongest TRUE if the length of the longest line should be
+        calculated, FALSE if only lines and bytes are required.
+
+ @param Count On successful completion, populated with the counts found in
+        the stream.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+LinesCountStream(
+    __in HANDLE hSource,
+    __in PLINES_WORKER Worker,
+    __in BOOLEAN TrackLongest,
+    __out PLINES_COUNT Count
+    )
+{
+    LINES_COUNT_STATE State;
+    PUCHAR Buffer;
+    DWORD BytesRead;
+    DWORD BytesCarried;
+    DWORD BytesAvailable;
+    DWORD BytesToSkip;
+    DWORD CharCount;
+    BOOLEAN FirstRead;
+
+    ZeroMemory(Count, sizeof(LINES_COUNT));
+    ZeroMemory(&State, sizeof(State));
+    State.TrackLongest = TrackLongest;
+    State.LineFeed = '\n';
+    State.CarriageReturn = '\r';
+    State.CharSize = 1;
+    if (YoriLibGetMultibyteInputEncoding() == CP_UTF16) {
+        State.CharSize = sizeof(WCHAR);
+    } else if (YoriLibGetMultibyteInputEncoding() == CP_UTF8) {
+        State.Utf8 = TRUE;
+    }
+
+    Buffer = Worker->ReadBuffer;
+    BytesCarried = 0;
+    FirstRead = TRUE;
+
+    while (TRUE) {
+        if (!ReadFile(hSource, &Buffer[BytesCarried], LINES_READ_BUFFER_LENGTH - BytesCarried, &BytesRead, NULL)) {
+            break;
+        }
+
+        if (BytesRead == 0) {
+            break;
+        }
+
+        Count->Bytes += BytesRead;
+        BytesAvailable = BytesCarried + BytesRead;
+        BytesToSkip = 0;
+
+        //
+        //  A byte order mark indicates the encoding of the stream, and is
+        //  not part of the first line.
+        //
+
+        if (FirstRead) {
+            FirstRead = FALSE;
+            if (BytesAvailable >= 3 && Buffer[0] == 0xEF && Buffer[1] == 0xBB && Buffer[2] == 0xBF) {
+                State.CharSize = 1;
+                State.Utf8 = TRUE;
+                BytesToSkip = 3;
+            } else if (BytesAvailable >= 2 && Buffer[0] == 0xFF && Buffer[1] == 0xFE) {
+                State.CharSize = sizeof(WCHAR);
+                State.Utf8 = FALSE;
+                BytesToSkip = 2;
+            } else if (BytesAvailable >= 2 && Buffer[0] == 0xFE && Buffer[1] == 0xFF) {
+                State.CharSize = sizeof(WCHAR);
+                State.Utf8 = FALSE;
+                State.LineFeed = 0x0A00;
+                State.CarriageReturn = 0x0D00;
+                BytesToSkip = 2;
+            }
+        }
+
+        CharCount = (BytesAvailable - BytesToSkip) / State.CharSize;
+        LinesCountBuffer(&State, Count, &Buffer[BytesToSkip], CharCount);
+
+        //
+        //  If a read ended in the middle of a character, keep the partial
+        //  character for the next read.
+        //
+
+        BytesCarried = BytesAvailable - BytesToSkip - CharCount * State.CharSize;
+        if (BytesCarried > 0) {
+            Buffer[0] = Buffer[BytesAvailable - 1];
+        }
+    }
+
+    //
+    //  A final line without a line feed is still a line.
+    //
+
+    if (State.CharsFound && State.LastChar != State.LineFeed) {
+        Count->Lines++;
+        if (State.CurrentLineLength > Count->LongestLine) {
+            Count->LongestLine = State.CurrentLineLength;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Cleanup the allocations used by a single thread to count files.
+
+ @param Worker Pointer to the worker state to clean up.
+ */
+VOID
+LinesCleanupWorker(
+    __in PLINES_WORKER Worker
+    )
+{
+    if (Worker->ReadBuffer != NULL) {
+        YoriLibFree(Worker->ReadBuffer);
+        Worker->ReadBuffer = NULL;
+    }
+}
+
+/**
+ Allocate the state used by a single thread to count files.
+
+ @param LinesContext Pointer to the lines context.
+
+ @param Worker Pointer to the worker state to initialize.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+LinesInitializeWorker(
+    __in PLINES_CONTEXT LinesContext,
+    __out PLINES_WORKER Worker
+    )
+{
+    ZeroMemory(Worker, sizeof(LINES_WORKER));
+    Worker->LinesContext = LinesContext;
+
+    Worker->ReadBuffer = YoriLibMalloc(LINES_READ_BUFFER_LENGTH);
+    if (Worker->ReadBuffer == NULL) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Allocate the state used by a worker thread to count files.
+
+ @param Context Pointer to the lines context.
+
+ @return Pointer to the worker state, or NULL on failure.
+ */
+PVOID
+LinesCreateWorker(
+    __in PVOID Context
+    )
+{
+    PLINES_WORKER Worker;
+
+    Worker = YoriLibMalloc(sizeof(LINES_WORKER));
+    if (Worker == NULL) {
+        return NULL;
+    }
+
+    if (!LinesInitializeWorker((PLINES_CONTEXT)Context, Worker)) {
+        LinesCleanupWorker(Worker);
+        YoriLibFree(Worker);
+        return NULL;
+    }
+
+    return Worker;
+}
+
+/**
+ Free the state used by a worker thread to count files.
+
+ @param Worker Pointer to the worker state allocated by
+        @ref LinesCreateWorker .
+ */
+VOID
+LinesDeleteWorker(
+    __in PVOID Worker
+    )
+{
+    LinesCleanupWorker((PLINES_WORKER)Worker);
+    YoriLibFree(Worker);
+}
+
+/**
+ Open and count the file described by a single request, recording the
+ result in the request.
+
+ @param Context Pointer to the state of the thread performing the count.
+
+ @param WorkItem Pointer to the work item within the request.
+ */
+VOID
+LinesProcessRequest(
+    __in PVOID Context,
+    __inout PYORI_LIB_WORK_ITEM WorkItem
+    )
+{
+    PLINES_WORKER Worker = (PLINES_WORKER)Context;
+    PLINES_REQUEST Request = CONTAINING_RECORD(WorkItem, LINES_REQUEST, WorkItem);
+    HANDLE FileHandle;
+
+    FileHandle = CreateFile(Request->FilePath.StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+
+    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+        Request->OpenError = GetLastError();
+        return;
+    }
+
+    Request->Opened = TRUE;
+    LinesCountStream(FileHandle, Worker, Worker->LinesContext->DisplayLongest, &Request->Count);
+
+    CloseHandle(FileHandle);
+}
+
+/**
+ Display the count for a single file.
+
+ @param LinesContext Pointer to the lines context.
+
+ @param FilePath Pointer to the full path to the file.
+
+ @param Count Pointer to the counts found in the file.  Bytes and the
+        longest line are only displayed if requested.
+ */
+VOID
+LinesDisplayFileCount(
+    __in PLINES_CONTEXT LinesContext,
+    __in PYORI_STRING FilePath,
+    __in PLINES_COUNT Count
+    )
+{
+    YORI_STRING StringFormOfLineCount;
+    YORI_STRING StringFormOfByteCount;
+    YORI_STRING StringFormOfLongestLine;
+    YORI_STRING UnescapedFilePath;
+    TCHAR LineStackBuffer[32];
+    TCHAR ByteStackBuffer[32];
+    TCHAR LongestStackBuffer[32];
+
+    YoriLibInitEmptyString(&StringFormOfLineCount);
+    StringFormOfLineCount.StartOfString = LineStackBuffer;
+    StringFormOfLineCount.LengthAllocated = sizeof(LineStackBuffer)/sizeof(LineStackBuffer[0]);
+    YoriLibNumberToString(&StringFormOfLineCount, Count->Lines, 10, 3, ',');
+    YoriLibInitEmptyString(&UnescapedFilePath);
+    YoriLibUnescapePath(FilePath, &UnescapedFilePath);
+
+    if (LinesContext->DisplayLongest) {
+        YoriLibInitEmptyString(&StringFormOfByteCount);
+        StringFormOfByteCount.StartOfString = ByteStackBuffer;
+        StringFormOfByteCount.LengthAllocated = sizeof(ByteStackBuffer)/sizeof(ByteStackBuffer[0]);
+        YoriLibNumberToString(&StringFormOfByteCount, Count->Bytes, 10, 3, ',');
+        YoriLibInitEmptyString(&StringFormOfLongestLine);
+        StringFormOfLongestLine.StartOfString = LongestStackBuffer;
+        StringFormOfLongestLine.LengthAllocated = sizeof(LongestStackBuffer)/sizeof(LongestStackBuffer[0]);
+        YoriLibNumberToString(&StringFormOfLongestLine, Count->LongestLine, 10, 3, ',');
+        YoriLibOutputBufferWrite(&LinesContext->OutputBuffer, _T("%16y %20y %12y %y\n"), &StringFormOfLineCount, &StringFormOfByteCount, &StringFormOfLongestLine, &UnescapedFilePath);
+        YoriLibFreeStringContents(&StringFormOfByteCount);
+        YoriLibFreeStringContents(&StringFormOfLongestLine);
+    } else {
+        YoriLibOutputBufferWrite(&LinesContext->OutputBuffer, _T("%16y %y\n"), &StringFormOfLineCount, &UnescapedFilePath);
+    }
+    YoriLibFreeStringContents(&StringFormOfLineCount);
+    YoriLibFreeStringContents(&UnescapedFilePath);
+}
+
+/**
+ Add the counts from a single stream to the totals for all streams.
+
+ @param LinesContext Pointer to the lines context.
+
+ @param Count Pointer to the counts from the stream.
+ */
+VOID
+LinesAccumulateCount(
+    __in PLINES_CONTEXT LinesContext,
+    __in PLINES_COUNT Count
+    )
+{
+    LinesContext->FilesFound++;
+    LinesContext->FilesFoundThisArg++;
+    LinesContext->FileLinesFound = Count->Lines;
+    LinesContext->TotalLinesFound += Count->Lines;
+    LinesContext->TotalBytesFound += Count->Bytes;
+    if (Count->LongestLine > LinesContext->LongestLineFound) {
+        LinesContext->LongestLineFound = Count->LongestLine;
+    }
+}
+
+/**
+ Display the result of a completed request and free it.
+
+ @param LinesContext Pointer to the lines context.
+
+ @param Request Pointer to the request, which has been removed from all
+        lists.
+ */
+VOID
+LinesDisplayRequest(
+    __in PLINES_CONTEXT LinesContext,
+    __in PLINES_REQUEST Request
+    )
+{
+    if (!Request->Opened) {
+        if (LinesContext->SavedErrorThisArg == ERROR_SUCCESS) {
+            LPTSTR ErrText = YoriLibGetWinErrorText(Request->OpenError);
+            YoriLibOutputBufferFlush(&LinesContext->OutputBuffer);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lines: open of %y failed: %s"), &Request->FilePath, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+        }
+    } else {
+        LinesContext->SavedErrorThisArg = ERROR_SUCCESS;
+        LinesAccumulateCount(LinesContext, &Request->Count);
+        if (!LinesContext->SummaryOnly) {
+            LinesDisplayFileCount(LinesContext, &Request->FilePath, &Request->Count);
+        }
+    }
+
+    YoriLibFreeStringContents(&Request->FilePath);
+    YoriLibFree(Request);
+}
+
+/**
+ Display completed requests in the order they were created.  This stops at
+ the first request which has not completed, unless more than a specified
+ number of requests are outstanding, in which case it waits.
+
+ @param LinesContext Pointer to the lines context.
+
+ @param MaxOutstanding The number of requests which can remain outstanding
+        when this function returns.  Specify zero to wait for all requests.
+ */
+VOID
+LinesDisplayCompletedRequests(
+    __in PLINES_CONTEXT LinesContext,
+    __in DWORD MaxOutstanding
+    )
+{
+    PYORI_LIB_WORK_ITEM WorkItem;
+
+    while (TRUE) {
+        WorkItem = YoriLibWorkPoolGetCompletedItem(&LinesContext->WorkPool, MaxOutstanding);
+        if (WorkItem == NULL) {
+            break;
+        }
+
+        LinesDisplayRequest(LinesContext, CONTAINING_RECORD(WorkItem, LINES_REQUEST, WorkItem));
+    }
+}
+
+/**
+ Queue a file to be counted by a worker thread.  If no worker thread can be
+ created, the file is counted on this thread.  Results are displayed in the
+ order files are queued.
+
+ @param LinesContext Pointer to the lines context.
+
+ @param FilePath Pointer to the full path to the file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+LinesQueueRequest(
+    __in PLINES_CONTEXT LinesContext,
+    __in PYORI_STRING FilePath
+    )
+{
+    PLINES_REQUEST Request;
+
+    Request = YoriLibMalloc(sizeof(LINES_REQUEST));
+    if (Request == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Request, sizeof(LINES_REQUEST));
+    if (!YoriLibAllocateString(&Request->FilePath, FilePath->LengthInChars + 1)) {
+        YoriLibFree(Request);
+        return FALSE;
+    }
+
+    memcpy(Request->FilePath.StartOfString, FilePath->StartOfString, FilePath->LengthInChars * sizeof(TCHAR));
+    Request->FilePath.StartOfString[FilePath->LengthInChars] = '\0';
+    Request->FilePath.LengthInChars = FilePath->LengthInChars;
+
+    //
+    //  The pool has a foreground worker, so if no thread can be created
+    //  the request is counted on this thread and this cannot fail.
+    //
+
+    YoriLibWorkPoolQueueItem(&LinesContext->WorkPool, &Request->WorkItem);
+
+    LinesDisplayCompletedRequests(LinesContext, LinesContext->MaxRequests);
+    return TRUE;
+}
+
+/**
+ Cleanup the state used to count files in raw mode.  Any outstanding
+ requests are displayed first.
+
+ @param LinesContext Pointer to the lines context to clean up.
+ */
+VOID
+LinesCleanupRawCount(
+    __in PLINES_CONTEXT LinesContext
+    )
+{
+    if (LinesContext->WorkPool.Mutex != NULL) {
+        LinesDisplayCompletedRequests(LinesContext, 0);
+    }
+
+    YoriLibWorkPoolCleanup(&LinesContext->WorkPool);
+
+    LinesCleanupWorker(&LinesContext->ForegroundWorker);
+}
+
+/**
+ Allocate the state used to count files in raw mode.
+
+ @param LinesContext Pointer to the lines context to initialize.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+LinesInitializeRawCount(
+    __in PLINES_CONTEXT LinesContext
+    )
+{
+    DWORD MaxThreads;
+
+    if (!LinesInitializeWorker(LinesContext, &LinesContext->ForegroundWorker)) {
+        LinesCleanupRawCount(LinesContext);
+        return FALSE;
+    }
+
+    //
+    //  Count with as many threads as there are processors.  Files are
+    //  read synchronously, so this also keeps several reads in flight.
+    //
+
+    MaxThreads = YoriLibWorkPoolGetThreadCount(1, 1);
+    if (MaxThreads > LINES_MAX_THREADS) {
+        MaxThreads = LINES_MAX_THREADS;
+    }
+    LinesContext->MaxRequests = MaxThreads * 4;
+
+    if (!YoriLibWorkPoolInitialize(&LinesContext->WorkPool, MaxThreads, LinesContext, LinesCreateWorker, LinesDeleteWorker, LinesProcessRequest, &LinesContext->ForegroundWorker)) {
+        LinesCleanupRawCount(LinesContext);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  A callback that is invoked when a file is found that matches a search criteria
  specified in the set of strings to enumerate.
@@ -175,6 +999,13 @@ LinesFileFoundCallback(
     if (FileInfo == NULL ||
         (FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
 
+        if (LinesContext->RawCount) {
+            if (!LinesQueueRequest(LinesContext, FilePath)) {
+                return FALSE;
+            }
+            return TRUE;
+        }
+
         FileHandle = CreateFile(FilePath->StartOfString,
                                 GENERIC_READ,
                                 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
@@ -187,6 +1018,7 @@ LinesFileFoundCallback(
             if (LinesContext->SavedErrorThisArg == ERROR_SUCCESS) {
                 DWORD LastError = GetLastError();
                 LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+                YoriLibOutputBufferFlush(&LinesContext->OutputBuffer);
                 YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lines: open of %y failed: %s"), FilePath, ErrText);
                 YoriLibFreeWinErrorText(ErrText);
             }
@@ -197,19 +1029,11 @@ LinesFileFoundCallback(
         LinesProcessStream(FileHandle, LinesContext);
 
         if (!LinesContext->SummaryOnly) {
-            YORI_STRING StringFormOfLineCount;
-            YORI_STRING UnescapedFilePath;
-            TCHAR StackBuffer[16];
-
-            YoriLibInitEmptyString(&StringFormOfLineCount);
-            StringFormOfLineCount.StartOfString = StackBuffer;
-            StringFormOfLineCount.LengthAllocated = sizeof(StackBuffer)/sizeof(StackBuffer[0]);
-            YoriLibNumberToString(&StringFormOfLineCount, LinesContext->FileLinesFound, 10, 3, ',');
-            YoriLibInitEmptyString(&UnescapedFilePath);
-            YoriLibUnescapePath(FilePath, &UnescapedFilePath);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%16y %y\n"), &StringFormOfLineCount, &UnescapedFilePath);
-            YoriLibFreeStringContents(&StringFormOfLineCount);
-            YoriLibFreeStringContents(&UnescapedFilePath);
+            LINES_COUNT Count;
+
+            ZeroMemory(&Count, sizeof(Count));
+            Count.Lines = LinesContext->FileLinesFound;
+            LinesDisplayFileCount(LinesContext, FilePath, &Count);
         }
 
         CloseHandle(FileHandle);
@@ -271,6 +1095,7 @@ LinesFileEnumerateErrorCallback(
         } else {
             DirName.LengthInChars = UnescapedFilePath.LengthInChars;
         }
+        YoriLibOutputBufferFlush(&LinesContext->OutputBuffer);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Enumerate of %y failed: %s"), &DirName, ErrText);
         YoriLibFreeWinErrorText(ErrText);
     }
@@ -333,6 +1158,13 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("b")) == 0) {
                 BasicEnumeration = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("l")) == 0) {
+                LinesContext.DisplayLongest = TRUE;
+                LinesContext.RawCount = TRUE;
+                ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("r")) == 0) {
+                LinesContext.RawCount = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("s")) == 0) {
                 LinesContext.Recursive = TRUE;
                 ArgumentUnderstood = TRUE;
@@ -366,6 +1198,17 @@ ENTRYPOINT(
 
     YoriLibEnableBackupPrivilege();
 
+    if (!YoriLibOutputBufferInitialize(&LinesContext.OutputBuffer, YORI_LIB_OUTPUT_STDOUT)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lines: out of memory\n"));
+        return EXIT_FAILURE;
+    }
+
+    if (LinesContext.RawCount && !LinesInitializeRawCount(&LinesContext)) {
+        YoriLibOutputBufferCleanup(&LinesContext.OutputBuffer);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lines: out of memory\n"));
+        return EXIT_FAILURE;
+    }
+
     //
     //  If no file name is specified, use stdin; otherwise open
     //  the file and use that
@@ -373,13 +1216,24 @@ ENTRYPOINT(
 
     if (StartArg == 0 || StartArg == ArgC) {
         if (YoriLibIsStdInConsole()) {
+            if (LinesContext.RawCount) {
+                LinesCleanupRawCount(&LinesContext);
+            }
+            YoriLibOutputBufferCleanup(&LinesContext.OutputBuffer);
             YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("No file or pipe for input\n"));
             return EXIT_FAILURE;
         }
 
         LinesContext.SummaryOnly = TRUE;
 
-        LinesProcessStream(GetStdHandle(STD_INPUT_HANDLE), &LinesContext);
+        if (LinesContext.RawCount) {
+            LINES_COUNT Count;
+
+            LinesCountStream(GetStdHandle(STD_INPUT_HANDLE), &LinesContext.ForegroundWorker, LinesContext.DisplayLongest, &Count);
+            LinesAccumulateCount(&LinesContext, &Count);
+        } else {
+            LinesProcessStream(GetStdHandle(STD_INPUT_HANDLE), &LinesContext);
+        }
     } else {
         MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_DIRECTORY_CONTENTS;
         if (LinesContext.Recursive) {
@@ -401,32 +1255,59 @@ ENTRYPOINT(
                                  LinesFileEnumerateErrorCallback,
                                  &LinesContext);
 
+            if (LinesContext.RawCount) {
+                LinesDisplayCompletedRequests(&LinesContext, 0);
+            }
+
             if (LinesContext.FilesFoundThisArg == 0) {
                 YORI_STRING FullPath;
                 YoriLibInitEmptyString(&FullPath);
                 if (YoriLibUserStringToSingleFilePath(&ArgV[i], TRUE, &FullPath)) {
                     LinesFileFoundCallback(&FullPath, NULL, 0, &LinesContext);
+                    if (LinesContext.RawCount) {
+                        LinesDisplayCompletedRequests(&LinesContext, 0);
+                    }
                     YoriLibFreeStringContents(&FullPath);
                 }
                 if (LinesContext.SavedErrorThisArg != ERROR_SUCCESS) {
+                    YoriLibOutputBufferFlush(&LinesContext.OutputBuffer);
                     YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("File or directory not found: %y\n"), &ArgV[i]);
                 }
             }
         }
     }
 
+    if (LinesContext.RawCount) {
+        LinesCleanupRawCount(&LinesContext);
+    }
+
     if (LinesContext.FilesFound == 0) {
+        YoriLibOutputBufferCleanup(&LinesContext.OutputBuffer);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lines: no matching files found\n"));
         return EXIT_FAILURE;
     } else if (LinesContext.FilesFound > 1 || LinesContext.SummaryOnly) {
         YORI_STRING StringFormOfLineCount;
+        YORI_STRING StringFormOfByteCount;
+        YORI_STRING StringFormOfLongestLine;
 
         YoriLibInitEmptyString(&StringFormOfLineCount);
         YoriLibNumberToString(&StringFormOfLineCount, LinesContext.TotalLinesFound, 10, 3, ',');
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &StringFormOfLineCount);
+        if (LinesContext.DisplayLongest) {
+            YoriLibInitEmptyString(&StringFormOfByteCount);
+            YoriLibNumberToString(&StringFormOfByteCount, LinesContext.TotalBytesFound, 10, 3, ',');
+            YoriLibInitEmptyString(&StringFormOfLongestLine);
+            YoriLibNumberToString(&StringFormOfLongestLine, LinesContext.LongestLineFound, 10, 3, ',');
+            YoriLibOutputBufferWrite(&LinesContext.OutputBuffer, _T("%y lines, %y bytes, longest line %y\n"), &StringFormOfLineCount, &StringFormOfByteCount, &StringFormOfLongestLine);
+            YoriLibFreeStringContents(&StringFormOfByteCount);
+            YoriLibFreeStringContents(&StringFormOfLongestLine);
+        } else {
+            YoriLibOutputBufferWrite(&LinesContext.OutputBuffer, _T("%y\n"), &StringFormOfLineCount);
+        }
         YoriLibFreeStringContents(&StringFormOfLineCount);
     }
 
+    YoriLibOutputBufferCleanup(&LinesContext.OutputBuffer);
+
     return EXIT_SUCCESS;
 }
 
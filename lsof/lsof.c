@@ -35,10 +35,20 @@ CHAR strLsofHelpText[] =
         "\n"
         "Determine which processes are keeping files open.\n"
         "\n"
-        "LSOF [-license] [-b] [-s] <file>...\n"
+        "LSOF [-license] [-b] [-h] [-s] [-t] <file>...\n"
         "\n"
         "   -b             Use basic search criteria for files only\n"
-        "   -s             Process files from all subdirectories\n";
+        "   -h             Search a single snapshot of all open handles rather than\n"
+        "                    opening each file\n"
+        "   -s             Process files from all subdirectories\n"
+        "   -t             Compare the time taken to open each file against the time\n"
+        "                    taken to search a snapshot of all open handles\n"
+        "\n"
+        "A snapshot of open handles only finds files opened through a handle.  It does\n"
+        "not find files which are mapped into memory or loaded as an executable image\n"
+        "and are no longer open through a handle.  It ignores -b, because it compares\n"
+        "names rather than enumerating files.  A handle whose name cannot be found\n"
+        "within half a second, such as one with IO pending, is skipped.\n";
 
 /**
  Display usage text to the user.
@@ -54,6 +64,49 @@ LsofHelp()
     return TRUE;
 }
 
+/**
+ A single file specification to search for in a snapshot of open handles.
+ Specifications are indexed by their parent directory so that the name of
+ each open file can be checked against them with a handful of lookups.
+ */
+typedef struct _LSOF_SEARCH_CRITERIA {
+
+    /**
+     Links between all search criteria, used to free them.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     Hash link to find criteria by parent directory.  Only the first
+     criteria for any parent directory is inserted into the hash table.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     Pointer to the next criteria with the same parent directory.
+     */
+    struct _LSOF_SEARCH_CRITERIA *NextInDirectory;
+
+    /**
+     The full path to the file specification.  This owns the memory that
+     the Directory and FilePattern members refer to.
+     */
+    YORI_STRING FullPath;
+
+    /**
+     The parent directory of the file specification, without a trailing
+     separator.
+     */
+    YORI_STRING Directory;
+
+    /**
+     The final component of the file specification, which may contain
+     wildcards.
+     */
+    YORI_STRING FilePattern;
+
+} LSOF_SEARCH_CRITERIA, *PLSOF_SEARCH_CRITERIA;
+
 /**
  Context passed to the callback which is invoked for each file found.
  */
@@ -76,6 +129,52 @@ typedef struct _LSOF_CONTEXT {
      */
     PFILE_PROCESS_IDS_USING_FILE_INFORMATION Buffer;
 
+    /**
+     TRUE if files in subdirectories should be matched when searching a
+     snapshot of open handles.
+     */
+    BOOLEAN Recursive;
+
+    /**
+     TRUE if results should be displayed.  This is FALSE when timing the
+     different search methods.
+     */
+    BOOLEAN DisplayResults;
+
+    /**
+     The number of files or handles examined by the most recent search.
+     */
+    DWORD ObjectsExamined;
+
+    /**
+     The number of times a process was found using a matching file by the
+     most recent search.
+     */
+    DWORD ResultsFound;
+
+    /**
+     The number of processes whose handles could not be examined by the most
+     recent search of open handles.
+     */
+    DWORD ProcessesSkipped;
+
+    /**
+     The number of handles skipped by the most recent search of open handles
+     because their names could not be found in time.
+     */
+    DWORD HandlesTimedOut;
+
+    /**
+     A list of all search criteria to match against open handles.
+     */
+    YORI_LIST_ENTRY SearchCriteriaList;
+
+    /**
+     A hash table of search criteria to match against open handles, indexed
+     by parent directory.
+     */
+    PYORI_HASH_TABLE SearchCriteriaHash;
+
 } LSOF_CONTEXT, *PLSOF_CONTEXT;
 
 /**
@@ -114,6 +213,7 @@ LsofFileFoundCallback(
     ASSERT(YoriLibIsStringNullTerminated(FilePath));
 
     LsofContext->FilesFoundThisArg++;
+    LsofContext->ObjectsExamined++;
 
     FileHandle = CreateFile(FilePath->StartOfString,
                             FILE_READ_ATTRIBUTES,
@@ -139,7 +239,8 @@ LsofFileFoundCallback(
 
     Status = DllNtDll.pNtQueryInformationFile(FileHandle, &IoStatus, LsofContext->Buffer, LsofContext->BufferLength, FileProcessIdsUsingFileInformation);
     if (Status == 0) {
-        for (Index = 0; Index < LsofContext->Buffer->NumberOfProcesses; Index++) {
+        LsofContext->ResultsFound += LsofContext->Buffer->NumberOfProcesses;
+        for (Index = 0; LsofContext->DisplayResults && Index < LsofContext->Buffer->NumberOfProcesses; Index++) {
             HANDLE ProcessHandle;
             TCHAR ProcessName[300];
             DWORD ProcessNameSize;
@@ -149,6 +250,7 @@ LsofFileFoundCallback(
             ProcessHandle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)LsofContext->Buffer->ProcessIds[Index]);
             if (ProcessHandle != NULL) {
                 DllKernel32.pQueryFullProcessImageNameW(ProcessHandle, 0, ProcessName, &ProcessNameSize);
+                CloseHandle(ProcessHandle);
             }
             YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%10i %s\n"), LsofContext->Buffer->ProcessIds[Index], ProcessName);
         }
@@ -160,6 +262,793 @@ LsofFileFoundCallback(
     return TRUE;
 }
 
+/**
+ Find the processes using a set of files by opening each file found and
+ asking the system which processes are using it.
+
+ @param LsofContext Pointer to the lsof context.
+
+ @param ArgC The number of file specifications.
+
+ @param ArgV An array of file specifications.
+
+ @param MatchFlags Flags indicating how to enumerate the file specifications.
+ */
+VOID
+LsofQueryByFile(
+    __in PLSOF_CONTEXT LsofContext,
+    __in DWORD ArgC,
+    __in YORI_STRING ArgV[],
+    __in DWORD MatchFlags
+    )
+{
+    DWORD i;
+    YORI_STRING FullPath;
+
+    LsofContext->ObjectsExamined = 0;
+    LsofContext->ResultsFound = 0;
+
+    for (i = 0; i < ArgC; i++) {
+
+        LsofContext->FilesFoundThisArg = 0;
+        YoriLibForEachStream(&ArgV[i], MatchFlags, 0, LsofFileFoundCallback, NULL, LsofContext);
+        if (LsofContext->FilesFoundThisArg == 0) {
+            YoriLibInitEmptyString(&FullPath);
+            if (YoriLibUserStringToSingleFilePath(&ArgV[i], TRUE, &FullPath)) {
+                LsofFileFoundCallback(&FullPath, NULL, 0, LsofContext);
+                YoriLibFreeStringContents(&FullPath);
+            }
+        }
+    }
+}
+
+/**
+ Add a file specification to the set of criteria to match against a
+ snapshot of open handles.
+
+ @param LsofContext Pointer to the lsof context.
+
+ @param FileSpec The file specification, as entered by the user.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+LsofAddSearchCriteria(
+    __in PLSOF_CONTEXT LsofContext,
+    __in PYORI_STRING FileSpec
+    )
+{
+    PLSOF_SEARCH_CRITERIA Criteria;
+    PLSOF_SEARCH_CRITERIA ExistingCriteria;
+    PYORI_HASH_ENTRY HashEntry;
+    LPTSTR FinalSeperator;
+
+    Criteria = YoriLibMalloc(sizeof(LSOF_SEARCH_CRITERIA));
+    if (Criteria == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Criteria, sizeof(LSOF_SEARCH_CRITERIA));
+    if (!YoriLibUserStringToSingleFilePath(FileSpec, TRUE, &Criteria->FullPath)) {
+        YoriLibFree(Criteria);
+        return FALSE;
+    }
+
+    FinalSeperator = YoriLibFindRightMostCharacter(&Criteria->FullPath, '\\');
+    if (FinalSeperator == NULL) {
+        YoriLibFreeStringContents(&Criteria->FullPath);
+        YoriLibFree(Criteria);
+        return FALSE;
+    }
+
+    //
+    //  Split the path into its parent directory and final component.  If
+    //  the path refers to a root, such as C:\, match everything within it.
+    //
+
+    YoriLibInitEmptyString(&Criteria->Directory);
+    Criteria->Directory.StartOfString = Criteria->FullPath.StartOfString;
+    Criteria->Directory.LengthInChars = (DWORD)(FinalSeperator - Criteria->FullPath.StartOfString);
+
+    YoriLibInitEmptyString(&Criteria->FilePattern);
+    Criteria->FilePattern.StartOfString = FinalSeperator + 1;
+    Criteria->FilePattern.LengthInChars = Criteria->FullPath.LengthInChars - Criteria->Directory.LengthInChars - 1;
+    if (Criteria->FilePattern.LengthInChars == 0) {
+        YoriLibConstantString(&Criteria->FilePattern, _T("*"));
+    }
+
+    YoriLibAppendList(&LsofContext->SearchCriteriaList, &Criteria->ListEntry);
+
+    HashEntry = YoriLibHashLookupByKey(LsofContext->SearchCriteriaHash, &Criteria->Directory);
+    if (HashEntry != NULL) {
+        ExistingCriteria = HashEntry->Context;
+        Criteria->NextInDirectory = ExistingCriteria->NextInDirectory;
+        ExistingCriteria->NextInDirectory = Criteria;
+    } else {
+        YoriLibHashInsertByKey(LsofContext->SearchCriteriaHash, &Criteria->Directory, Criteria, &Criteria->HashEntry);
+    }
+
+    return TRUE;
+}
+
+/**
+ Free all criteria used to match against a snapshot of open handles.
+
+ @param LsofContext Pointer to the lsof context.
+ */
+VOID
+LsofFreeSearchCriteria(
+    __in PLSOF_CONTEXT LsofContext
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_HASH_ENTRY NextHashEntry;
+    PLSOF_SEARCH_CRITERIA Criteria;
+
+    if (LsofContext->SearchCriteriaHash == NULL) {
+        return;
+    }
+
+    HashEntry = YoriLibHashGetNextEntry(LsofContext->SearchCriteriaHash, NULL);
+    while (HashEntry != NULL) {
+        NextHashEntry = YoriLibHashGetNextEntry(LsofContext->SearchCriteriaHash, HashEntry);
+        YoriLibHashRemoveByEntry(HashEntry);
+        HashEntry = NextHashEntry;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&LsofContext->SearchCriteriaList, NULL);
+    while (ListEntry != NULL) {
+        Criteria = CONTAINING_RECORD(ListEntry, LSOF_SEARCH_CRITERIA, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&LsofContext->SearchCriteriaList, ListEntry);
+        YoriLibRemoveListItem(&Criteria->ListEntry);
+        YoriLibFreeStringContents(&Criteria->FullPath);
+        YoriLibFree(Criteria);
+    }
+
+    YoriLibFreeEmptyHashTable(LsofContext->SearchCriteriaHash);
+    LsofContext->SearchCriteriaHash = NULL;
+}
+
+/**
+ Check whether the name of an open file matches any of the search criteria.
+ The parent directory of the file is looked up in the criteria hash table,
+ followed by each of its ancestors if subdirectories are being searched.
+
+ @param LsofContext Pointer to the lsof context.
+
+ @param FilePath The full path to the open file.
+
+ @return TRUE if the file matches a search criteria, FALSE if it does not.
+ */
+BOOL
+LsofDoesFileMatchSearchCriteria(
+    __in PLSOF_CONTEXT LsofContext,
+    __in PYORI_STRING FilePath
+    )
+{
+    YORI_STRING Directory;
+    YORI_STRING FileName;
+    LPTSTR Seperator;
+    PYORI_HASH_ENTRY HashEntry;
+    PLSOF_SEARCH_CRITERIA Criteria;
+
+    Seperator = YoriLibFindRightMostCharacter(FilePath, '\\');
+    if (Seperator == NULL) {
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&Directory);
+    Directory.StartOfString = FilePath->StartOfString;
+    Directory.LengthInChars = (DWORD)(Seperator - FilePath->StartOfString);
+
+    YoriLibInitEmptyString(&FileName);
+    FileName.StartOfString = Seperator + 1;
+    FileName.LengthInChars = FilePath->LengthInChars - Directory.LengthInChars - 1;
+
+    while (TRUE) {
+        HashEntry = YoriLibHashLookupByKey(LsofContext->SearchCriteriaHash, &Directory);
+        if (HashEntry != NULL) {
+            Criteria = HashEntry->Context;
+            while (Criteria != NULL) {
+                if (YoriLibDoesFileMatchExpression(&FileName, &Criteria->FilePattern)) {
+                    return TRUE;
+                }
+                Criteria = Criteria->NextInDirectory;
+            }
+        }
+
+        if (!LsofContext->Recursive) {
+            break;
+        }
+
+        Seperator = YoriLibFindRightMostCharacter(&Directory, '\\');
+        if (Seperator == NULL) {
+            break;
+        }
+        Directory.LengthInChars = (DWORD)(Seperator - Directory.StartOfString);
+    }
+
+    return FALSE;
+}
+
+/**
+ Capture a snapshot of every handle open in the system.
+
+ @param HandleInfo On successful completion, updated to point to the handle
+        snapshot.  The caller should free this with @ref YoriLibFree .
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+LsofGetSystemHandleSnapshot(
+    __out PYORI_SYSTEM_HANDLE_INFORMATION_EX *HandleInfo
+    )
+{
+    PYORI_SYSTEM_HANDLE_INFORMATION_EX LocalHandleInfo = NULL;
+    DWORD BytesReturned;
+    DWORD BytesAllocated;
+    LONG Status;
+
+    BytesAllocated = 0;
+    BytesReturned = 0;
+
+    do {
+
+        if (LocalHandleInfo != NULL) {
+            YoriLibFree(LocalHandleInfo);
+        }
+
+        //
+        //  Handles can be opened between the query that returns the size
+        //  and the one that fills the buffer, so leave some room to spare.
+        //
+
+        if (BytesAllocated == 0) {
+            BytesAllocated = 1024 * 1024;
+        } else if (BytesAllocated <= 256 * 1024 * 1024) {
+            if (BytesReturned > BytesAllocated) {
+                BytesAllocated = BytesReturned + BytesReturned / 4;
+            } else {
+                BytesAllocated = BytesAllocated * 4;
+            }
+        } else {
+            return FALSE;
+        }
+
+        LocalHandleInfo = YoriLibMalloc(BytesAllocated);
+        if (LocalHandleInfo == NULL) {
+            return FALSE;
+        }
+
+        Status = DllNtDll.pNtQuerySystemInformation(SystemExtendedHandleInformation, LocalHandleInfo, BytesAllocated, &BytesReturned);
+    } while (Status == (LONG)0xc0000004);
+
+    if (Status != 0) {
+        YoriLibFree(LocalHandleInfo);
+        return FALSE;
+    }
+
+    *HandleInfo = LocalHandleInfo;
+    return TRUE;
+}
+
+/**
+ The number of milliseconds to wait for the name of an open file to be
+ found before skipping the handle.
+ */
+#define LSOF_NAME_TIMEOUT (500)
+
+/**
+ A name resolver is finding the name of a file.
+ */
+#define LSOF_RESOLVER_BUSY (0)
+
+/**
+ A name resolver has found the name of a file, or failed to.
+ */
+#define LSOF_RESOLVER_COMPLETE (1)
+
+/**
+ A name resolver took too long to find the name of a file and has been
+ abandoned.  Its thread cleans up once the name is found.
+ */
+#define LSOF_RESOLVER_ABANDONED (2)
+
+/**
+ State for a thread which finds the names of open files.  Finding the name
+ of a file opened for synchronous IO waits for any IO which is pending on
+ it, which may never complete, so this is done on a separate thread which
+ is abandoned if it takes too long.
+ */
+typedef struct _LSOF_NAME_RESOLVER {
+
+    /**
+     A handle to the thread which finds names.
+     */
+    HANDLE Thread;
+
+    /**
+     An event signalled to request that the thread find the name of
+     FileHandle, or exit if Shutdown is set.
+     */
+    HANDLE RequestEvent;
+
+    /**
+     An event signalled by the thread once the name has been found.
+     */
+    HANDLE CompleteEvent;
+
+    /**
+     The file whose name should be found.
+     */
+    HANDLE FileHandle;
+
+    /**
+     On completion, the name of the file.  This is an empty string if the
+     name could not be found.
+     */
+    YORI_STRING FileName;
+
+    /**
+     Set to TRUE to request that the thread exit.
+     */
+    BOOLEAN Shutdown;
+
+    /**
+     One of the LSOF_RESOLVER_ values.  Once a request times out, the main
+     thread and the resolver thread race to change this, which determines
+     whether the main thread uses the result or the resolver thread cleans
+     up.
+     */
+    LONG State;
+
+} LSOF_NAME_RESOLVER, *PLSOF_NAME_RESOLVER;
+
+/**
+ Free a name resolver once its thread is no longer using it.
+
+ @param Resolver Pointer to the name resolver to free.
+ */
+VOID
+LsofFreeNameResolver(
+    __in PLSOF_NAME_RESOLVER Resolver
+    )
+{
+    if (Resolver->RequestEvent != NULL) {
+        CloseHandle(Resolver->RequestEvent);
+    }
+    if (Resolver->CompleteEvent != NULL) {
+        CloseHandle(Resolver->CompleteEvent);
+    }
+    YoriLibFreeStringContents(&Resolver->FileName);
+    YoriLibFree(Resolver);
+}
+
+/**
+ A thread which finds the name of each file it is given.
+
+ @param Context Pointer to the name resolver.
+
+ @return Zero.
+ */
+DWORD WINAPI
+LsofNameResolverThread(
+    __in LPVOID Context
+    )
+{
+    PLSOF_NAME_RESOLVER Resolver;
+    DWORD CharsNeeded;
+
+    Resolver = (PLSOF_NAME_RESOLVER)Context;
+
+    while (TRUE) {
+        WaitForSingleObject(Resolver->RequestEvent, INFINITE);
+        if (Resolver->Shutdown) {
+            break;
+        }
+
+        Resolver->FileName.LengthInChars = 0;
+        CharsNeeded = DllKernel32.pGetFinalPathNameByHandleW(Resolver->FileHandle, Resolver->FileName.StartOfString, Resolver->FileName.LengthAllocated, FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+        if (CharsNeeded >= Resolver->FileName.LengthAllocated) {
+            YoriLibFreeStringContents(&Resolver->FileName);
+            if (YoriLibAllocateString(&Resolver->FileName, CharsNeeded + 1)) {
+                CharsNeeded = DllKernel32.pGetFinalPathNameByHandleW(Resolver->FileHandle, Resolver->FileName.StartOfString, Resolver->FileName.LengthAllocated, FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+            } else {
+                CharsNeeded = 0;
+            }
+        }
+
+        if (CharsNeeded > 0 && CharsNeeded < Resolver->FileName.LengthAllocated) {
+            Resolver->FileName.LengthInChars = CharsNeeded;
+        }
+
+        //
+        //  If the main thread gave up waiting, nothing else refers to the
+        //  resolver, so clean it up here.
+        //
+
+        if (InterlockedCompareExchange(&Resolver->State, LSOF_RESOLVER_COMPLETE, LSOF_RESOLVER_BUSY) == LSOF_RESOLVER_ABANDONED) {
+            CloseHandle(Resolver->FileHandle);
+            LsofFreeNameResolver(Resolver);
+            return 0;
+        }
+
+        SetEvent(Resolver->CompleteEvent);
+    }
+
+    return 0;
+}
+
+/**
+ Create a name resolver and start its thread.
+
+ @return Pointer to the name resolver, or NULL on failure.
+ */
+PLSOF_NAME_RESOLVER
+LsofCreateNameResolver(VOID)
+{
+    PLSOF_NAME_RESOLVER Resolver;
+    DWORD ThreadId;
+
+    Resolver = YoriLibMalloc(sizeof(LSOF_NAME_RESOLVER));
+    if (Resolver == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Resolver, sizeof(LSOF_NAME_RESOLVER));
+    Resolver->RequestEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Resolver->CompleteEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (Resolver->RequestEvent == NULL ||
+        Resolver->CompleteEvent == NULL ||
+        !YoriLibAllocateString(&Resolver->FileName, 1024)) {
+
+        LsofFreeNameResolver(Resolver);
+        return NULL;
+    }
+
+    Resolver->Thread = CreateThread(NULL, 0, LsofNameResolverThread, Resolver, 0, &ThreadId);
+    if (Resolver->Thread == NULL) {
+        LsofFreeNameResolver(Resolver);
+        return NULL;
+    }
+
+    return Resolver;
+}
+
+/**
+ Stop the thread of a name resolver which is not currently finding a name,
+ and free it.
+
+ @param Resolver Pointer to the name resolver.
+ */
+VOID
+LsofDeleteNameResolver(
+    __in PLSOF_NAME_RESOLVER Resolver
+    )
+{
+    Resolver->Shutdown = TRUE;
+    SetEvent(Resolver->RequestEvent);
+    WaitForSingleObject(Resolver->Thread, INFINITE);
+    CloseHandle(Resolver->Thread);
+    LsofFreeNameResolver(Resolver);
+}
+
+/**
+ Find the name of an open file, giving up if this takes longer than
+ LSOF_NAME_TIMEOUT.  When the request times out, the IO that the resolver
+ thread is waiting for is cancelled, so the thread can continue with the
+ next file.  If the IO cannot be cancelled, the resolver is abandoned.
+
+ @param ResolverPtr On input, points to the name resolver to use.  If the
+        resolver is abandoned, this is set to NULL, so the caller needs to
+        create a new one for the next file.
+
+ @param FileHandle The file whose name should be found.  This function
+        takes ownership of the handle and closes it, or leaves it to the
+        abandoned resolver to close.
+
+ @param TimedOut On completion, set to TRUE if the name was not found
+        because the request timed out.
+
+ @return TRUE to indicate the name was found and is in the FileName member
+         of the resolver, FALSE if it was not.
+ */
+__success(return)
+BOOL
+LsofResolveFileName(
+    __inout PLSOF_NAME_RESOLVER *ResolverPtr,
+    __in HANDLE FileHandle,
+    __out PBOOLEAN TimedOut
+    )
+{
+    PLSOF_NAME_RESOLVER Resolver;
+    DWORD Attempt;
+
+    Resolver = *ResolverPtr;
+    *TimedOut = FALSE;
+
+    Resolver->FileHandle = FileHandle;
+    Resolver->State = LSOF_RESOLVER_BUSY;
+    SetEvent(Resolver->RequestEvent);
+
+    if (WaitForSingleObject(Resolver->CompleteEvent, LSOF_NAME_TIMEOUT) != WAIT_OBJECT_0) {
+
+        //
+        //  Cancel the IO the thread is waiting for.  The thread may issue
+        //  another request to find the name after a larger buffer is
+        //  allocated, so this is attempted more than once.  Any name found
+        //  after cancelling is not trusted.
+        //
+
+        if (DllKernel32.pCancelSynchronousIo != NULL) {
+            for (Attempt = 0; Attempt < 4; Attempt++) {
+                DllKernel32.pCancelSynchronousIo(Resolver->Thread);
+                if (WaitForSingleObject(Resolver->CompleteEvent, LSOF_NAME_TIMEOUT / 4) == WAIT_OBJECT_0) {
+                    CloseHandle(FileHandle);
+                    Resolver->FileHandle = NULL;
+                    *TimedOut = TRUE;
+                    return FALSE;
+                }
+            }
+        }
+
+        //
+        //  The IO could not be cancelled.  Leave the thread to clean up
+        //  if the IO ever completes, and let the user know a handle
+        //  remains open in this process.
+        //
+
+        if (InterlockedCompareExchange(&Resolver->State, LSOF_RESOLVER_ABANDONED, LSOF_RESOLVER_BUSY) == LSOF_RESOLVER_BUSY) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: could not cancel finding the name of a handle, leaving a thread waiting in this process\n"));
+            CloseHandle(Resolver->Thread);
+            *ResolverPtr = NULL;
+            *TimedOut = TRUE;
+            return FALSE;
+        }
+
+        //
+        //  The name was found just as the wait timed out.  The thread is
+        //  about to signal completion, so wait for that.
+        //
+
+        WaitForSingleObject(Resolver->CompleteEvent, INFINITE);
+    }
+
+    CloseHandle(FileHandle);
+    Resolver->FileHandle = NULL;
+
+    if (Resolver->FileName.LengthInChars == 0) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Find the processes using a set of files by capturing a single snapshot of
+ every handle in the system, resolving the name of each file handle, and
+ checking it against the search criteria.
+
+ @param LsofContext Pointer to the lsof context, which contains the search
+        criteria.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+LsofQueryByHandleSnapshot(
+    __in PLSOF_CONTEXT LsofContext
+    )
+{
+    PYORI_SYSTEM_HANDLE_INFORMATION_EX HandleInfo;
+    PYORI_SYSTEM_HANDLE_ENTRY_EX Entry;
+    PLSOF_NAME_RESOLVER Resolver;
+    DWORD_PTR Index;
+    DWORD_PTR CurrentProcessId;
+    DWORD_PTR OpenProcessId;
+    HANDLE ProbeHandle;
+    HANDLE ProcessHandle;
+    HANDLE LocalHandle;
+    USHORT FileTypeIndex;
+    BOOLEAN FileTypeFound;
+    BOOLEAN ProcessOpenAttempted;
+    BOOLEAN ProcessDisplayed;
+    BOOLEAN TimedOut;
+    TCHAR ProcessName[300];
+    DWORD ProcessNameSize;
+
+    LsofContext->ObjectsExamined = 0;
+    LsofContext->ResultsFound = 0;
+    LsofContext->ProcessesSkipped = 0;
+    LsofContext->HandlesTimedOut = 0;
+
+    //
+    //  The index describing file objects varies between systems, so open a
+    //  file and find its handle in the snapshot to determine the index.
+    //
+
+    ProbeHandle = CreateFile(_T("NUL"),
+                             FILE_READ_ATTRIBUTES,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             NULL,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL,
+                             NULL);
+
+    if (ProbeHandle == INVALID_HANDLE_VALUE) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: could not determine file object type\n"));
+        return FALSE;
+    }
+
+    if (!LsofGetSystemHandleSnapshot(&HandleInfo)) {
+        CloseHandle(ProbeHandle);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: could not query system handles\n"));
+        return FALSE;
+    }
+
+    CurrentProcessId = GetCurrentProcessId();
+    FileTypeIndex = 0;
+    FileTypeFound = FALSE;
+    for (Index = 0; Index < HandleInfo->NumberOfHandles; Index++) {
+        Entry = &HandleInfo->Handles[Index];
+        if (Entry->ProcessId == CurrentProcessId &&
+            Entry->HandleValue == (DWORD_PTR)ProbeHandle) {
+
+            FileTypeIndex = Entry->ObjectTypeIndex;
+            FileTypeFound = TRUE;
+            break;
+        }
+    }
+
+    CloseHandle(ProbeHandle);
+
+    if (!FileTypeFound) {
+        YoriLibFree(HandleInfo);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: could not determine file object type\n"));
+        return FALSE;
+    }
+
+    //
+    //  Handles are returned grouped by process, so each process is opened
+    //  once for all of its handles.
+    //
+
+    ProcessHandle = NULL;
+    OpenProcessId = 0;
+    ProcessOpenAttempted = FALSE;
+    ProcessDisplayed = FALSE;
+    Resolver = NULL;
+
+    for (Index = 0; Index < HandleInfo->NumberOfHandles; Index++) {
+        Entry = &HandleInfo->Handles[Index];
+        if (Entry->ObjectTypeIndex != FileTypeIndex ||
+            Entry->ProcessId == CurrentProcessId) {
+
+            continue;
+        }
+
+        if (!ProcessOpenAttempted || Entry->ProcessId != OpenProcessId) {
+            if (ProcessHandle != NULL) {
+                CloseHandle(ProcessHandle);
+            }
+
+            ProcessOpenAttempted = TRUE;
+            OpenProcessId = Entry->ProcessId;
+            ProcessDisplayed = FALSE;
+            ProcessHandle = OpenProcess(PROCESS_DUP_HANDLE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)OpenProcessId);
+            if (ProcessHandle == NULL) {
+                LsofContext->ProcessesSkipped++;
+            }
+        }
+
+        if (ProcessHandle == NULL) {
+            continue;
+        }
+
+        if (!DuplicateHandle(ProcessHandle, (HANDLE)Entry->HandleValue, GetCurrentProcess(), &LocalHandle, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+            continue;
+        }
+
+        LsofContext->ObjectsExamined++;
+
+        //
+        //  Only ask for the names of files on disk.  Querying the name of
+        //  a synchronous pipe can wait until its pending IO completes.
+        //
+
+        if (GetFileType(LocalHandle) != FILE_TYPE_DISK) {
+            CloseHandle(LocalHandle);
+            continue;
+        }
+
+        //
+        //  A disk file opened for synchronous IO can still wait, so find
+        //  the name on another thread and skip the handle if that takes
+        //  too long.
+        //
+
+        if (Resolver == NULL) {
+            Resolver = LsofCreateNameResolver();
+            if (Resolver == NULL) {
+                CloseHandle(LocalHandle);
+                break;
+            }
+        }
+
+        if (!LsofResolveFileName(&Resolver, LocalHandle, &TimedOut)) {
+            if (TimedOut) {
+                LsofContext->HandlesTimedOut++;
+            }
+            continue;
+        }
+
+        if (!LsofDoesFileMatchSearchCriteria(LsofContext, &Resolver->FileName)) {
+            continue;
+        }
+
+        LsofContext->ResultsFound++;
+        if (!ProcessDisplayed) {
+            ProcessDisplayed = TRUE;
+            if (LsofContext->DisplayResults) {
+                ProcessName[0] = '\0';
+                ProcessNameSize = sizeof(ProcessName)/sizeof(ProcessName[0]);
+                DllKernel32.pQueryFullProcessImageNameW(ProcessHandle, 0, ProcessName, &ProcessNameSize);
+                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%10i %s\n"), OpenProcessId, ProcessName);
+            }
+        }
+
+        if (LsofContext->DisplayResults) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("           %y\n"), &Resolver->FileName);
+        }
+    }
+
+    if (Resolver != NULL) {
+        LsofDeleteNameResolver(Resolver);
+    }
+
+    if (ProcessHandle != NULL) {
+        CloseHandle(ProcessHandle);
+    }
+
+    YoriLibFree(HandleInfo);
+
+    if (LsofContext->DisplayResults && LsofContext->ProcessesSkipped > 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: %i processes could not be examined\n"), LsofContext->ProcessesSkipped);
+    }
+
+    if (LsofContext->DisplayResults && LsofContext->HandlesTimedOut > 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: %i handles skipped because their names could not be found in time\n"), LsofContext->HandlesTimedOut);
+    }
+
+    return TRUE;
+}
+
+/**
+ Return the number of milliseconds elapsed between two performance counter
+ values.
+
+ @param StartTime The performance counter value at the start of the
+        operation.
+
+ @param EndTime The performance counter value at the end of the operation.
+
+ @param Frequency The frequency of the performance counter.
+
+ @return The number of milliseconds elapsed.
+ */
+LONGLONG
+LsofElapsedMs(
+    __in PLARGE_INTEGER StartTime,
+    __in PLARGE_INTEGER EndTime,
+    __in PLARGE_INTEGER Frequency
+    )
+{
+    return (EndTime->QuadPart - StartTime->QuadPart) * 1000 / Frequency->QuadPart;
+}
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the lsof builtin command.
@@ -194,8 +1083,15 @@ ENTRYPOINT(
     DWORD MatchFlags;
     BOOL Recursive = FALSE;
     BOOL BasicEnumeration = FALSE;
+    BOOL UseHandleSnapshot = FALSE;
+    BOOL CompareTiming = FALSE;
+    BOOL DebugPrivilegeWasEnabled = TRUE;
+    DWORD ExitCode;
     LSOF_CONTEXT LsofContext;
     YORI_STRING Arg;
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
 
     ZeroMemory(&LsofContext, sizeof(LsofContext));
 
@@ -215,9 +1111,15 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("b")) == 0) {
                 BasicEnumeration = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("h")) == 0) {
+                UseHandleSnapshot = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("s")) == 0) {
                 Recursive = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("t")) == 0) {
+                CompareTiming = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("-")) == 0) {
                 StartArg = i + 1;
                 ArgumentUnderstood = TRUE;
@@ -241,12 +1143,25 @@ ENTRYPOINT(
         return EXIT_FAILURE;
     }
 
-    //
-    //  Attempt to enable backup privilege so an administrator can access more
-    //  objects successfully.
-    //
+    if ((UseHandleSnapshot || CompareTiming) &&
+        (DllNtDll.pNtQuerySystemInformation == NULL ||
+         DllKernel32.pGetFinalPathNameByHandleW == NULL)) {
 
-    YoriLibEnableBackupPrivilege();
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: OS support not present\n"));
+        return EXIT_FAILURE;
+    }
+
+    if (CompareTiming) {
+        if (!QueryPerformanceFrequency(&Frequency) || Frequency.QuadPart == 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: high resolution timer not available\n"));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (StartArg == 0 || StartArg == ArgC) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: missing argument\n"));
+        return EXIT_FAILURE;
+    }
 
     LsofContext.BufferLength = 16 * 1024;
     LsofContext.Buffer = YoriLibMalloc(LsofContext.BufferLength);
@@ -255,40 +1170,100 @@ ENTRYPOINT(
     }
 
     //
-    //  If no file name is specified, use stdin; otherwise open
-    //  the file and use that
+    //  Attempt to enable backup privilege so an administrator can access more
+    //  objects successfully.  Debug privilege allows handles to be inspected
+    //  in more processes.
     //
 
-    if (StartArg == 0 || StartArg == ArgC) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: missing argument\n"));
-        return EXIT_FAILURE;
-    } else {
-        MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_RETURN_DIRECTORIES;
-        if (Recursive) {
-            MatchFlags |= YORILIB_FILEENUM_RECURSE_BEFORE_RETURN | YORILIB_FILEENUM_RECURSE_PRESERVE_WILD;
-        }
-        if (BasicEnumeration) {
-            MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
+    YoriLibEnableBackupPrivilege();
+    if (UseHandleSnapshot || CompareTiming) {
+        YoriLibEnableDebugPrivilege(&DebugPrivilegeWasEnabled);
+    }
+
+    LsofContext.Recursive = (BOOLEAN)Recursive;
+    LsofContext.DisplayResults = (BOOLEAN)(!CompareTiming);
+    ExitCode = EXIT_SUCCESS;
+
+    MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_RETURN_DIRECTORIES;
+    if (Recursive) {
+        MatchFlags |= YORILIB_FILEENUM_RECURSE_BEFORE_RETURN | YORILIB_FILEENUM_RECURSE_PRESERVE_WILD;
+    }
+    if (BasicEnumeration) {
+        MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
+    }
+
+    if (UseHandleSnapshot || CompareTiming) {
+        YoriLibInitializeListHead(&LsofContext.SearchCriteriaList);
+        LsofContext.SearchCriteriaHash = YoriLibAllocateHashTable(250);
+        if (LsofContext.SearchCriteriaHash == NULL) {
+            ExitCode = EXIT_FAILURE;
+            goto Exit;
         }
 
         for (i = StartArg; i < ArgC; i++) {
-
-            LsofContext.FilesFoundThisArg = 0;
-            YoriLibForEachStream(&ArgV[i], MatchFlags, 0, LsofFileFoundCallback, NULL, &LsofContext);
-            if (LsofContext.FilesFoundThisArg == 0) {
-                YORI_STRING FullPath;
-                YoriLibInitEmptyString(&FullPath);
-                if (YoriLibUserStringToSingleFilePath(&ArgV[i], TRUE, &FullPath)) {
-                    LsofFileFoundCallback(&FullPath, NULL, 0, &LsofContext);
-                    YoriLibFreeStringContents(&FullPath);
-                }
+            if (!LsofAddSearchCriteria(&LsofContext, &ArgV[i])) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: could not resolve %y\n"), &ArgV[i]);
+                ExitCode = EXIT_FAILURE;
+                goto Exit;
             }
         }
     }
 
+    if (CompareTiming) {
+        QueryPerformanceCounter(&StartTime);
+        LsofQueryByFile(&LsofContext, ArgC - StartArg, &ArgV[StartArg], MatchFlags);
+        QueryPerformanceCounter(&EndTime);
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                      _T("Per file:        %lli ms, %i files examined, %i matches found\n"),
+                      LsofElapsedMs(&StartTime, &EndTime, &Frequency),
+                      LsofContext.ObjectsExamined,
+                      LsofContext.ResultsFound);
+
+        QueryPerformanceCounter(&StartTime);
+        if (!LsofQueryByHandleSnapshot(&LsofContext)) {
+            ExitCode = EXIT_FAILURE;
+            goto Exit;
+        }
+        QueryPerformanceCounter(&EndTime);
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                      _T("Handle snapshot: %lli ms, %i handles examined, %i matches found, %i processes skipped, %i handles timed out\n"),
+                      LsofElapsedMs(&StartTime, &EndTime, &Frequency),
+                      LsofContext.ObjectsExamined,
+                      LsofContext.ResultsFound,
+                      LsofContext.ProcessesSkipped,
+                      LsofContext.HandlesTimedOut);
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                      _T("\nThe handle snapshot does not find files which are only mapped into memory\n")
+                      _T("or loaded as an image, so its matches may be fewer.%s\n"),
+                      BasicEnumeration?_T("  It ignores -b."):_T(""));
+
+    } else if (UseHandleSnapshot) {
+        if (!LsofQueryByHandleSnapshot(&LsofContext)) {
+            ExitCode = EXIT_FAILURE;
+        }
+    } else {
+        LsofQueryByFile(&LsofContext, ArgC - StartArg, &ArgV[StartArg], MatchFlags);
+    }
+
+Exit:
+
+    LsofFreeSearchCriteria(&LsofContext);
+
+    //
+    //  When running within the shell, leave its privileges as they were.
+    //
+
+#ifdef YORI_BUILTIN
+    if (!DebugPrivilegeWasEnabled) {
+        YoriLibDisableDebugPrivilege();
+    }
+#endif
     YoriLibFree(LsofContext.Buffer);
 
-    return EXIT_SUCCESS;
+    return ExitCode;
 }
 
 // vim:sw=4:ts=4:et:
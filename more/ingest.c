@@ -26,6 +26,167 @@
 
 #include "more.h"
 
+/**
+ Add a physical line to the line index so that it can be found from its
+ line number.  Lines must be added in order.  The caller is expected to
+ hold MORE_CONTEXT::PhysicalLineMutex .
+
+ @param MoreContext Pointer to the more context.
+
+ @param PhysicalLine Pointer to the physical line to add.  Its line number
+        must be one greater than the previous line added.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+MoreAddLineToIndex(
+    __inout PMORE_CONTEXT MoreContext,
+    __in PMORE_PHYSICAL_LINE PhysicalLine
+    )
+{
+    DWORDLONG LineIndex;
+    DWORD ChunkIndex;
+    DWORD NewChunksAllocated;
+    PMORE_LINE_INDEX_CHUNK *NewChunks;
+
+    ASSERT(PhysicalLine->LineNumber > 0);
+    LineIndex = PhysicalLine->LineNumber - 1;
+    if (LineIndex / MORE_LINES_PER_INDEX_CHUNK >= (DWORD)-1) {
+        return FALSE;
+    }
+    ChunkIndex = (DWORD)(LineIndex / MORE_LINES_PER_INDEX_CHUNK);
+
+    if (ChunkIndex >= MoreContext->LineIndexChunksAllocated) {
+        NewChunksAllocated = MoreContext->LineIndexChunksAllocated * 2;
+        if (NewChunksAllocated < 64) {
+            NewChunksAllocated = 64;
+        }
+        NewChunks = YoriLibMalloc(NewChunksAllocated * sizeof(PMORE_LINE_INDEX_CHUNK));
+        if (NewChunks == NULL) {
+            return FALSE;
+        }
+        ZeroMemory(NewChunks, NewChunksAllocated * sizeof(PMORE_LINE_INDEX_CHUNK));
+        if (MoreContext->LineIndexChunks != NULL) {
+            memcpy(NewChunks, MoreContext->LineIndexChunks, MoreContext->LineIndexChunksAllocated * sizeof(PMORE_LINE_INDEX_CHUNK));
+            YoriLibFree(MoreContext->LineIndexChunks);
+        }
+        MoreContext->LineIndexChunks = NewChunks;
+        MoreContext->LineIndexChunksAllocated = NewChunksAllocated;
+    }
+
+    if (MoreContext->LineIndexChunks[ChunkIndex] == NULL) {
+        MoreContext->LineIndexChunks[ChunkIndex] = YoriLibMalloc(sizeof(MORE_LINE_INDEX_CHUNK));
+        if (MoreContext->LineIndexChunks[ChunkIndex] == NULL) {
+            return FALSE;
+        }
+    }
+
+    MoreContext->LineIndexChunks[ChunkIndex]->Lines[LineIndex % MORE_LINES_PER_INDEX_CHUNK] = PhysicalLine;
+    return TRUE;
+}
+
+/**
+ Find a physical line from its line number.  The caller is expected to hold
+ MORE_CONTEXT::PhysicalLineMutex .
+
+ @param MoreContext Pointer to the more context.
+
+ @param LineNumber The line number to find.  The first line is one.
+
+ @return Pointer to the physical line, or NULL if no line with this number
+         has been ingested.
+ */
+PMORE_PHYSICAL_LINE
+MoreGetPhysicalLineByNumber(
+    __in PMORE_CONTEXT MoreContext,
+    __in DWORDLONG LineNumber
+    )
+{
+    DWORDLONG LineIndex;
+
+    if (LineNumber == 0 || LineNumber > MoreContext->LineCount) {
+        return NULL;
+    }
+
+    LineIndex = LineNumber - 1;
+    return MoreContext->LineIndexChunks[LineIndex / MORE_LINES_PER_INDEX_CHUNK]->Lines[LineIndex % MORE_LINES_PER_INDEX_CHUNK];
+}
+
+/**
+ Find the physical line following a specified line.  The caller is expected
+ to hold MORE_CONTEXT::PhysicalLineMutex .
+
+ @param MoreContext Pointer to the more context.
+
+ @param PhysicalLine Pointer to the physical line to find the line after.
+        If NULL, the first line is returned.
+
+ @return Pointer to the next physical line, or NULL if no further line has
+         been ingested.
+ */
+PMORE_PHYSICAL_LINE
+MoreGetNextPhysicalLine(
+    __in PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_PHYSICAL_LINE PhysicalLine
+    )
+{
+    if (PhysicalLine == NULL) {
+        return MoreGetPhysicalLineByNumber(MoreContext, 1);
+    }
+    return MoreGetPhysicalLineByNumber(MoreContext, PhysicalLine->LineNumber + 1);
+}
+
+/**
+ Find the physical line preceeding a specified line.  The caller is expected
+ to hold MORE_CONTEXT::PhysicalLineMutex .
+
+ @param MoreContext Pointer to the more context.
+
+ @param PhysicalLine Pointer to the physical line to find the line before.
+        If NULL, the last line ingested is returned.
+
+ @return Pointer to the previous physical line, or NULL if this is the first
+         line.
+ */
+PMORE_PHYSICAL_LINE
+MoreGetPreviousPhysicalLine(
+    __in PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_PHYSICAL_LINE PhysicalLine
+    )
+{
+    if (PhysicalLine == NULL) {
+        return MoreGetPhysicalLineByNumber(MoreContext, MoreContext->LineCount);
+    }
+    return MoreGetPhysicalLineByNumber(MoreContext, PhysicalLine->LineNumber - 1);
+}
+
+/**
+ Free the line index.  This does not free the physical lines it refers to.
+
+ @param MoreContext Pointer to the more context.
+ */
+VOID
+MoreFreeLineIndex(
+    __inout PMORE_CONTEXT MoreContext
+    )
+{
+    DWORD ChunkIndex;
+
+    if (MoreContext->LineIndexChunks == NULL) {
+        return;
+    }
+
+    for (ChunkIndex = 0; ChunkIndex < MoreContext->LineIndexChunksAllocated; ChunkIndex++) {
+        if (MoreContext->LineIndexChunks[ChunkIndex] != NULL) {
+            YoriLibFree(MoreContext->LineIndexChunks[ChunkIndex]);
+        }
+    }
+
+    YoriLibFree(MoreContext->LineIndexChunks);
+    MoreContext->LineIndexChunks = NULL;
+    MoreContext->LineIndexChunksAllocated = 0;
+}
+
 /**
  Process a single opened stream, enumerating through all lines and displaying
  the set requested by the user.
@@ -92,24 +253,28 @@ MoreProcessStream(
 
         //
         //  If we need a buffer, allocate a buffer that typically has space for
-        //  multiple lines
+        //  multiple lines.  The buffer is owned by the line buffer list and
+        //  freed when the program exits.
         //
 
         if (Buffer == NULL || BytesRequired > BytesRemainingInBuffer) {
-            if (Buffer != NULL) {
-                YoriLibDereference(Buffer);
-            }
             BytesRemainingInBuffer = 64 * 1024;
-            if (BytesRequired > BytesRemainingInBuffer) {
-                BytesRemainingInBuffer = BytesRequired;
+            if (BytesRequired > BytesRemainingInBuffer - sizeof(MORE_LINE_BUFFER)) {
+                BytesRemainingInBuffer = BytesRequired + sizeof(MORE_LINE_BUFFER);
             }
-            BufferOffset = 0;
 
             Buffer = YoriLibReferencedMalloc(BytesRemainingInBuffer);
             if (Buffer == NULL) {
                 MoreContext->OutOfMemory = TRUE;
                 break;
             }
+
+            WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+            YoriLibAppendList(&MoreContext->LineBufferList, &((PMORE_LINE_BUFFER)Buffer)->BufferList);
+            ReleaseMutex(MoreContext->PhysicalLineMutex);
+
+            BufferOffset = sizeof(MORE_LINE_BUFFER);
+            BytesRemainingInBuffer -= sizeof(MORE_LINE_BUFFER);
         }
 
         //
@@ -118,12 +283,9 @@ MoreProcessStream(
 
         NewLine = (PMORE_PHYSICAL_LINE)YoriLibAddToPointer(Buffer, BufferOffset);
 
-        YoriLibReference(Buffer);
-        NewLine->MemoryToFree = Buffer;
         NewLine->InitialColor = PreviousColor;
         NewLine->LineNumber = MoreContext->LineCount + 1;
-        YoriLibReference(Buffer);
-        NewLine->LineContents.MemoryToFree = Buffer;
+        NewLine->LineContents.MemoryToFree = NULL;
         NewLine->LineContents.StartOfString = (LPTSTR)(NewLine + 1);
 
         for (CharIndex = 0, DestIndex = 0; CharIndex < LineString.LengthInChars; CharIndex++) {
@@ -169,6 +331,7 @@ MoreProcessStream(
         NewLine->LineContents.StartOfString[DestIndex] = '\0';
         NewLine->LineContents.LengthInChars = DestIndex;
         NewLine->LineContents.LengthAllocated = DestIndex + 1;
+        MoreGetSearchFilter(&NewLine->LineContents, &NewLine->CharFilter, &NewLine->PairFilter);
 
         BufferOffset += BytesRequired;
         BytesRemainingInBuffer -= BytesRequired;
@@ -186,25 +349,26 @@ MoreProcessStream(
         }
 
         //
-        //  Insert the new line into the list
+        //  Insert the new line into the index
         //
 
         WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+        if (!MoreAddLineToIndex(MoreContext, NewLine)) {
+            ReleaseMutex(MoreContext->PhysicalLineMutex);
+            MoreContext->OutOfMemory = TRUE;
+            break;
+        }
         MoreContext->LineCount++;
-        YoriLibAppendList(&MoreContext->PhysicalLineList, &NewLine->LineList);
         ReleaseMutex(MoreContext->PhysicalLineMutex);
 
         SetEvent(MoreContext->PhysicalLineAvailableEvent);
+        SetEvent(MoreContext->SearchRequestEvent);
 
         if (WaitForSingleObject(MoreContext->ShutdownEvent, 0) == WAIT_OBJECT_0) {
             break;
         }
     }
 
-    if (Buffer != NULL) {
-        YoriLibDereference(Buffer);
-    }
-
     YoriLibLineReadClose(LineContext);
     YoriLibFreeStringContents(&LineString);
 
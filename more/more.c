@@ -39,7 +39,10 @@ CHAR strMoreHelpText[] =
         "   -b             Use basic search criteria for files only\n"
         "   -dd            Use the debug display\n"
         "   -l             Display until Ctrl+Q, Scroll Lock, or pause\n"
-        "   -s             Process files from all subdirectories\n";
+        "   -s             Process files from all subdirectories\n"
+        "\n"
+        "While viewing, type a number followed by g to move to that line, or\n"
+        "followed by % to move to that percentage of the input.\n";
 
 /**
  Display usage text to the user.
@@ -34,33 +34,97 @@
 typedef struct _MORE_PHYSICAL_LINE {
 
     /**
-     A list of physical lines.  Paired with MORE_CONTEXT::PhysicalLineList
-     and synchronized with MORE_CONTEXT::PhysicalLineMutex .
+     The color attribute to display at the beginning of the line.
      */
-    YORI_LIST_ENTRY LineList;
+    WORD InitialColor;
 
     /**
-     Pointer to the referenced allocation that contains this physical line.
+     The number of this physical line within the input stream.  The first
+     line is one, and this is used to find the line in the line index.
      */
-    PVOID MemoryToFree;
+    DWORDLONG LineNumber;
 
     /**
-     The color attribute to display at the beginning of the line.
+     A filter with a bit set for each character in the line, calculated
+     when the line is ingested.  Used to skip lines that cannot match a
+     search.
      */
-    WORD InitialColor;
+    DWORD CharFilter;
 
     /**
-     The number of this physical line within the input stream.  The first
-     line is zero.
+     A filter with a bit set for each pair of adjacent characters in the
+     line, calculated when the line is ingested.  Used to skip lines that
+     cannot match a search.
      */
-    DWORDLONG LineNumber;
+    DWORD PairFilter;
 
     /**
-     The contents of the physical line.
+     The contents of the physical line.  This is contained in a line buffer
+     which remains allocated until the program exits, so the string does not
+     hold a reference.
      */
     YORI_STRING LineContents;
 } MORE_PHYSICAL_LINE, *PMORE_PHYSICAL_LINE;
 
+/**
+ A header at the start of each buffer that physical lines are allocated
+ from.  Buffers are linked together so that they can be freed once at exit
+ rather than each line holding a reference.
+ */
+typedef struct _MORE_LINE_BUFFER {
+
+    /**
+     The list of line buffers.  Paired with MORE_CONTEXT::LineBufferList
+     and synchronized with MORE_CONTEXT::PhysicalLineMutex .
+     */
+    YORI_LIST_ENTRY BufferList;
+} MORE_LINE_BUFFER, *PMORE_LINE_BUFFER;
+
+/**
+ The number of physical lines described by each chunk of the line index.
+ */
+#define MORE_LINES_PER_INDEX_CHUNK (4096)
+
+/**
+ A chunk of the line index, pointing to a contiguous range of physical
+ lines.
+ */
+typedef struct _MORE_LINE_INDEX_CHUNK {
+
+    /**
+     Pointers to each physical line within the range described by this
+     chunk.
+     */
+    PMORE_PHYSICAL_LINE Lines[MORE_LINES_PER_INDEX_CHUNK];
+} MORE_LINE_INDEX_CHUNK, *PMORE_LINE_INDEX_CHUNK;
+
+/**
+ A string to search for, prepared so that it can be efficiently compared
+ against many physical lines.
+ */
+typedef struct _MORE_SEARCH {
+
+    /**
+     A copy of the string to search for.
+     */
+    YORI_STRING String;
+
+    /**
+     A compiled matcher to find String within a line.
+     */
+    PYORI_SUBSTRING_MATCHER Matcher;
+
+    /**
+     A filter with a bit set for each character in String.
+     */
+    DWORD CharFilter;
+
+    /**
+     A filter with a bit set for each pair of adjacent characters in String.
+     */
+    DWORD PairFilter;
+} MORE_SEARCH, *PMORE_SEARCH;
+
 /**
  A logical line, meaning a line rendered for display on the console.
  */
@@ -121,18 +185,30 @@ typedef struct _MORE_LOGICAL_LINE {
 typedef struct _MORE_CONTEXT {
 
     /**
-     A linked list of physical lines.
+     A linked list of the buffers containing physical lines.
      */
-    YORI_LIST_ENTRY PhysicalLineList;
+    YORI_LIST_ENTRY LineBufferList;
 
     /**
-     Synchronization around PhysicalLineList.
+     Synchronization around LineBufferList and the line index.
      */
     HANDLE PhysicalLineMutex;
 
+    /**
+     An array of pointers to chunks of the line index, allowing a physical
+     line to be found from its line number.  Synchronized with
+     PhysicalLineMutex.
+     */
+    PMORE_LINE_INDEX_CHUNK *LineIndexChunks;
+
+    /**
+     The number of elements allocated in the LineIndexChunks array.
+     */
+    DWORD LineIndexChunksAllocated;
+
     /**
      An event that is signalled when new lines are added to the
-     PhysicalLineList in case the viewport thread wants to update display
+     line index in case the viewport thread wants to update display
      when lines are added.
      */
     HANDLE PhysicalLineAvailableEvent;
@@ -163,14 +239,14 @@ typedef struct _MORE_CONTEXT {
 
     /**
      An array of size ViewportHeight of lines currently displayed.  Note these
-     refer to the strings in the PhysicalLineList.
+     refer to the strings in the physical lines.
      */
     PMORE_LOGICAL_LINE DisplayViewportLines;
 
     /**
      An array of size ViewportHeight of lines that are being constructed to
      display in future.  Note these refer to the strings in the
-     PhysicalLineList.
+     physical lines.
      */
     PMORE_LOGICAL_LINE StagingViewportLines;
 
@@ -238,6 +314,41 @@ typedef struct _MORE_CONTEXT {
      */
     YORI_STRING SearchString;
 
+    /**
+     A copy of SearchString for the background search thread to count
+     matches for.  Synchronized with MORE_CONTEXT::PhysicalLineMutex .
+     */
+    YORI_STRING SearchCountString;
+
+    /**
+     Incremented each time SearchCountString changes.  Synchronized with
+     MORE_CONTEXT::PhysicalLineMutex .
+     */
+    DWORD SearchGeneration;
+
+    /**
+     An event that is signalled when the search string changes or new lines
+     are added, so the background search thread can update its count.
+     */
+    HANDLE SearchRequestEvent;
+
+    /**
+     Handle to the thread that is counting lines matching the search
+     string.
+     */
+    HANDLE SearchThread;
+
+    /**
+     The number of physical lines found to match SearchCountString.
+     Synchronized with MORE_CONTEXT::PhysicalLineMutex .
+     */
+    DWORDLONG SearchMatchCount;
+
+    /**
+     The value of SearchMatchCount when the status line was last drawn.
+     */
+    DWORDLONG SearchMatchCountInStatus;
+
     /**
      Handle to the thread that is adding to the physical line array.
      */
@@ -275,6 +386,17 @@ typedef struct _MORE_CONTEXT {
      */
     BOOLEAN SuspendPagination;
 
+    /**
+     TRUE if SearchMatchCount includes all lines ingested so far.
+     Synchronized with MORE_CONTEXT::PhysicalLineMutex .
+     */
+    BOOLEAN SearchCountComplete;
+
+    /**
+     The value of SearchCountComplete when the status line was last drawn.
+     */
+    BOOLEAN SearchCountCompleteInStatus;
+
     /**
      Records the total number of files processed.
      */
@@ -285,6 +407,12 @@ typedef struct _MORE_CONTEXT {
      */
     DWORDLONG LineCount;
 
+    /**
+     A number typed by the user in navigation mode, to be used by a
+     following command.  Zero if no number has been typed.
+     */
+    DWORDLONG PendingNumber;
+
 } MORE_CONTEXT, *PMORE_CONTEXT;
 
 VOID
@@ -324,11 +452,64 @@ MoreGracefulExit(
     __inout PMORE_CONTEXT MoreContext
     );
 
+BOOL
+MoreAddLineToIndex(
+    __inout PMORE_CONTEXT MoreContext,
+    __in PMORE_PHYSICAL_LINE PhysicalLine
+    );
+
+PMORE_PHYSICAL_LINE
+MoreGetPhysicalLineByNumber(
+    __in PMORE_CONTEXT MoreContext,
+    __in DWORDLONG LineNumber
+    );
+
+PMORE_PHYSICAL_LINE
+MoreGetNextPhysicalLine(
+    __in PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_PHYSICAL_LINE PhysicalLine
+    );
+
+PMORE_PHYSICAL_LINE
+MoreGetPreviousPhysicalLine(
+    __in PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_PHYSICAL_LINE PhysicalLine
+    );
+
+VOID
+MoreFreeLineIndex(
+    __inout PMORE_CONTEXT MoreContext
+    );
+
 DWORD WINAPI
 MoreIngestThread(
     __in LPVOID Context
     );
 
+VOID
+MoreGetSearchFilter(
+    __in PYORI_STRING String,
+    __out PDWORD CharFilter,
+    __out PDWORD PairFilter
+    );
+
+PMORE_PHYSICAL_LINE
+MoreFindLineWithSearchMatch(
+    __in PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_PHYSICAL_LINE StartLine,
+    __in BOOLEAN Forward
+    );
+
+VOID
+MoreSearchStringChanged(
+    __inout PMORE_CONTEXT MoreContext
+    );
+
+DWORD WINAPI
+MoreSearchThread(
+    __in LPVOID Context
+    );
+
 BOOL
 MoreViewportDisplay(
     __inout PMORE_CONTEXT MoreContext
@@ -150,7 +150,7 @@ MoreInitContext(
     MoreContext->SuspendPagination = SuspendPagination;
     MoreContext->TabWidth = 4;
 
-    YoriLibInitializeListHead(&MoreContext->PhysicalLineList);
+    YoriLibInitializeListHead(&MoreContext->LineBufferList);
     MoreContext->PhysicalLineMutex = CreateMutex(NULL, FALSE, NULL);
     if (MoreContext->PhysicalLineMutex == NULL) {
         return FALSE;
@@ -161,11 +161,16 @@ MoreInitContext(
         return FALSE;
     }
 
-    MoreContext->ShutdownEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    MoreContext->ShutdownEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     if (MoreContext->ShutdownEvent == NULL) {
         return FALSE;
     }
 
+    MoreContext->SearchRequestEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (MoreContext->SearchRequestEvent == NULL) {
+        return FALSE;
+    }
+
     if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &ScreenInfo)) {
         return FALSE;
     }
@@ -194,6 +199,11 @@ MoreInitContext(
         return FALSE;
     }
 
+    MoreContext->SearchThread = CreateThread(NULL, 0, MoreSearchThread, MoreContext, 0, &ThreadId);
+    if (MoreContext->SearchThread == NULL) {
+        return FALSE;
+    }
+
     return TRUE;
 }
 
@@ -238,7 +248,19 @@ MoreCleanupContext(
         MoreContext->IngestThread = NULL;
     }
 
+    if (MoreContext->SearchThread != NULL) {
+        CloseHandle(MoreContext->SearchThread);
+        MoreContext->SearchThread = NULL;
+    }
+
+    if (MoreContext->SearchRequestEvent != NULL) {
+        CloseHandle(MoreContext->SearchRequestEvent);
+        MoreContext->SearchRequestEvent = NULL;
+    }
+
+    MoreFreeLineIndex(MoreContext);
     YoriLibFreeStringContents(&MoreContext->SearchString);
+    YoriLibFreeStringContents(&MoreContext->SearchCountString);
 }
 
 /**
@@ -254,21 +276,29 @@ MoreGracefulExit(
     )
 {
     PYORI_LIST_ENTRY ListEntry;
-    PMORE_PHYSICAL_LINE PhysicalLine;
+    PYORI_LIST_ENTRY NextEntry;
     DWORD Index;
 
     SetEvent(MoreContext->ShutdownEvent);
     WaitForSingleObject(MoreContext->IngestThread, INFINITE);
+    if (MoreContext->SearchThread != NULL) {
+        WaitForSingleObject(MoreContext->SearchThread, INFINITE);
+    }
     for (Index = 0; Index < MoreContext->ViewportHeight; Index++) {
         YoriLibFreeStringContents(&MoreContext->DisplayViewportLines[Index].Line);
     }
-    ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, NULL);
+
+    //
+    //  Physical lines are contained within the line buffers, so nothing
+    //  refers to a line once its buffer has been freed.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&MoreContext->LineBufferList, NULL);
     while (ListEntry != NULL) {
-        PhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
+        NextEntry = YoriLibGetNextListEntry(&MoreContext->LineBufferList, ListEntry);
         YoriLibRemoveListItem(ListEntry);
-        YoriLibFreeStringContents(&PhysicalLine->LineContents);
-        YoriLibDereference(PhysicalLine->MemoryToFree);
-        ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, NULL);
+        YoriLibDereference(CONTAINING_RECORD(ListEntry, MORE_LINE_BUFFER, BufferList));
+        ListEntry = NextEntry;
     }
 
     MoreCleanupContext(MoreContext);
@@ -0,0 +1,372 @@
+/**
+ * @file more/search.c
+ *
+ * Yori shell more search ingested lines for matches
+ *
+ * Copyright (c) 2020 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "more.h"
+
+/**
+ The number of physical lines to search before releasing the mutex that
+ synchronizes the line list, allowing the ingest thread to add more lines.
+ */
+#define MORE_SEARCH_LINES_PER_LOCK (4096)
+
+/**
+ Fold a character for a case insensitive search.  This must match the
+ folding performed by the substring matcher.
+ */
+#define MoreSearchFoldChar(Char) \
+    (((Char) >= 'a' && (Char) <= 'z')?(TCHAR)((Char) - 'a' + 'A'):(Char))
+
+/**
+ Generate filters describing the characters and pairs of adjacent
+ characters in a string.  Each character or pair sets one bit in the
+ corresponding filter.  If a search string's filters have a bit set that
+ a line's filters do not, the line cannot contain the search string, so
+ most lines can be skipped without comparing strings.
+
+ @param String Pointer to the string to generate filters for.
+
+ @param CharFilter On successful completion, updated to contain a bit for
+        each character in the string.
+
+ @param PairFilter On successful completion, updated to contain a bit for
+        each pair of adjacent characters in the string.
+ */
+VOID
+MoreGetSearchFilter(
+    __in PYORI_STRING String,
+    __out PDWORD CharFilter,
+    __out PDWORD PairFilter
+    )
+{
+    DWORD Index;
+    DWORD Char;
+    DWORD PreviousChar;
+    DWORD LocalCharFilter;
+    DWORD LocalPairFilter;
+
+    LocalCharFilter = 0;
+    LocalPairFilter = 0;
+    PreviousChar = 0;
+
+    for (Index = 0; Index < String->LengthInChars; Index++) {
+        Char = MoreSearchFoldChar(String->StartOfString[Index]);
+        LocalCharFilter |= ((DWORD)1 << (Char % 32));
+        if (Index > 0) {
+            LocalPairFilter |= ((DWORD)1 << ((PreviousChar * 7 + Char) % 32));
+        }
+        PreviousChar = Char;
+    }
+
+    *CharFilter = LocalCharFilter;
+    *PairFilter = LocalPairFilter;
+}
+
+/**
+ Prepare to search for a string by taking a copy of it, compiling a matcher
+ and calculating its filters.
+
+ @param Search Pointer to the search structure to initialize.
+
+ @param SearchString Pointer to the string to search for.  This must not be
+        empty.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+MoreInitializeSearch(
+    __out PMORE_SEARCH Search,
+    __in PYORI_STRING SearchString
+    )
+{
+    ZeroMemory(Search, sizeof(MORE_SEARCH));
+
+    ASSERT(SearchString->LengthInChars > 0);
+    if (!YoriLibAllocateString(&Search->String, SearchString->LengthInChars + 1)) {
+        return FALSE;
+    }
+
+    memcpy(Search->String.StartOfString, SearchString->StartOfString, SearchString->LengthInChars * sizeof(TCHAR));
+    Search->String.StartOfString[SearchString->LengthInChars] = '\0';
+    Search->String.LengthInChars = SearchString->LengthInChars;
+
+    Search->Matcher = YoriLibCompileSubstringMatcher(1, &Search->String, TRUE);
+    if (Search->Matcher == NULL) {
+        YoriLibFreeStringContents(&Search->String);
+        return FALSE;
+    }
+
+    MoreGetSearchFilter(&Search->String, &Search->CharFilter, &Search->PairFilter);
+    return TRUE;
+}
+
+/**
+ Free any allocations within a search structure.
+
+ @param Search Pointer to the search structure to clean up.
+ */
+VOID
+MoreCleanupSearch(
+    __inout PMORE_SEARCH Search
+    )
+{
+    if (Search->Matcher != NULL) {
+        YoriLibFreeSubstringMatcher(Search->Matcher);
+        Search->Matcher = NULL;
+    }
+    YoriLibFreeStringContents(&Search->String);
+}
+
+/**
+ Determine whether a physical line contains a match for a search.
+
+ @param Search Pointer to the search.
+
+ @param PhysicalLine Pointer to the physical line to check.
+
+ @return TRUE if the line contains a match, FALSE if it does not.
+ */
+BOOL
+MoreDoesLineMatchSearch(
+    __in PMORE_SEARCH Search,
+    __in PMORE_PHYSICAL_LINE PhysicalLine
+    )
+{
+    if ((PhysicalLine->CharFilter & Search->CharFilter) != Search->CharFilter ||
+        (PhysicalLine->PairFilter & Search->PairFilter) != Search->PairFilter) {
+
+        return FALSE;
+    }
+
+    if (YoriLibSubstringMatcherFindFirst(Search->Matcher, &PhysicalLine->LineContents, NULL) == NULL) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Find the next or previous physical line that contains a match for the
+ current search string.  The mutex synchronizing the line list is released
+ periodically so that the ingest thread can continue adding lines while a
+ long search is in progress.  Since physical lines are never removed until
+ the program exits, the search position remains valid across this.
+
+ @param MoreContext Pointer to the more context, containing all physical
+        lines.
+
+ @param StartLine Pointer to the physical line to start searching from.
+        This line is not itself checked for a match.  If NULL, the search
+        starts from the beginning of the list if searching forward or the
+        end of the list if searching backward.
+
+ @param Forward TRUE to search for a later line, FALSE to search for an
+        earlier line.
+
+ @return Pointer to the physical line containing a match, or NULL if no
+         such line was found.
+ */
+PMORE_PHYSICAL_LINE
+MoreFindLineWithSearchMatch(
+    __in PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_PHYSICAL_LINE StartLine,
+    __in BOOLEAN Forward
+    )
+{
+    MORE_SEARCH Search;
+    PMORE_PHYSICAL_LINE SearchLine;
+    PMORE_PHYSICAL_LINE CurrentLine;
+    DWORD LinesThisLock;
+
+    if (MoreContext->SearchString.LengthInChars == 0) {
+        return NULL;
+    }
+
+    if (!MoreInitializeSearch(&Search, &MoreContext->SearchString)) {
+        return NULL;
+    }
+
+    CurrentLine = StartLine;
+    SearchLine = NULL;
+    while (TRUE) {
+        WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+        for (LinesThisLock = 0; LinesThisLock < MORE_SEARCH_LINES_PER_LOCK; LinesThisLock++) {
+            if (Forward) {
+                CurrentLine = MoreGetNextPhysicalLine(MoreContext, CurrentLine);
+            } else {
+                CurrentLine = MoreGetPreviousPhysicalLine(MoreContext, CurrentLine);
+            }
+            if (CurrentLine == NULL) {
+                break;
+            }
+
+            if (MoreDoesLineMatchSearch(&Search, CurrentLine)) {
+                SearchLine = CurrentLine;
+                break;
+            }
+        }
+        ReleaseMutex(MoreContext->PhysicalLineMutex);
+
+        if (CurrentLine == NULL || SearchLine != NULL) {
+            break;
+        }
+    }
+
+    MoreCleanupSearch(&Search);
+    return SearchLine;
+}
+
+/**
+ Indicate that the search string has changed, so that the background search
+ thread should count matches for the new string.  This is called from the
+ viewport thread after it modifies MoreContext::SearchString .
+
+ @param MoreContext Pointer to the more context.
+ */
+VOID
+MoreSearchStringChanged(
+    __inout PMORE_CONTEXT MoreContext
+    )
+{
+    WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+
+    MoreContext->SearchCountString.LengthInChars = 0;
+    if (MoreContext->SearchString.LengthInChars > 0) {
+        if (MoreContext->SearchCountString.LengthAllocated < MoreContext->SearchString.LengthInChars) {
+            YoriLibFreeStringContents(&MoreContext->SearchCountString);
+            YoriLibAllocateString(&MoreContext->SearchCountString, MoreContext->SearchString.LengthAllocated);
+        }
+        if (MoreContext->SearchCountString.LengthAllocated >= MoreContext->SearchString.LengthInChars) {
+            memcpy(MoreContext->SearchCountString.StartOfString, MoreContext->SearchString.StartOfString, MoreContext->SearchString.LengthInChars * sizeof(TCHAR));
+            MoreContext->SearchCountString.LengthInChars = MoreContext->SearchString.LengthInChars;
+        }
+    }
+
+    MoreContext->SearchGeneration++;
+    MoreContext->SearchMatchCount = 0;
+    MoreContext->SearchCountComplete = FALSE;
+    ReleaseMutex(MoreContext->PhysicalLineMutex);
+
+    SetEvent(MoreContext->SearchRequestEvent);
+}
+
+/**
+ A background thread that counts the number of physical lines matching the
+ current search string.  The count is resumed as new lines are ingested,
+ and restarted if the search string changes.
+
+ @param Context Pointer to the MORE_CONTEXT.
+
+ @return DWORD, ignored.
+ */
+DWORD WINAPI
+MoreSearchThread(
+    __in LPVOID Context
+    )
+{
+    PMORE_CONTEXT MoreContext = (PMORE_CONTEXT)Context;
+    HANDLE ObjectsToWaitFor[2];
+    MORE_SEARCH Search;
+    BOOLEAN SearchActive;
+    DWORD Generation;
+    DWORD LinesThisLock;
+    DWORDLONG MatchCount;
+    PMORE_PHYSICAL_LINE SearchLine;
+    PMORE_PHYSICAL_LINE NextLine;
+    BOOLEAN ReachedEnd;
+
+    ObjectsToWaitFor[0] = MoreContext->ShutdownEvent;
+    ObjectsToWaitFor[1] = MoreContext->SearchRequestEvent;
+
+    ZeroMemory(&Search, sizeof(Search));
+    SearchActive = FALSE;
+    Generation = 0;
+    SearchLine = NULL;
+    MatchCount = 0;
+    ReachedEnd = FALSE;
+
+    while (WaitForMultipleObjects(2, ObjectsToWaitFor, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+
+        do {
+            WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+
+            //
+            //  If the search string has changed, start again from the
+            //  beginning.
+            //
+
+            if (MoreContext->SearchGeneration != Generation) {
+                Generation = MoreContext->SearchGeneration;
+                if (SearchActive) {
+                    MoreCleanupSearch(&Search);
+                    SearchActive = FALSE;
+                }
+                if (MoreContext->SearchCountString.LengthInChars > 0 &&
+                    MoreInitializeSearch(&Search, &MoreContext->SearchCountString)) {
+
+                    SearchActive = TRUE;
+                }
+                SearchLine = NULL;
+                MatchCount = 0;
+            }
+
+            if (!SearchActive) {
+                ReleaseMutex(MoreContext->PhysicalLineMutex);
+                break;
+            }
+
+            ReachedEnd = FALSE;
+            for (LinesThisLock = 0; LinesThisLock < MORE_SEARCH_LINES_PER_LOCK; LinesThisLock++) {
+                NextLine = MoreGetNextPhysicalLine(MoreContext, SearchLine);
+                if (NextLine == NULL) {
+                    ReachedEnd = TRUE;
+                    break;
+                }
+                SearchLine = NextLine;
+                if (MoreDoesLineMatchSearch(&Search, SearchLine)) {
+                    MatchCount++;
+                }
+            }
+
+            MoreContext->SearchMatchCount = MatchCount;
+            MoreContext->SearchCountComplete = ReachedEnd;
+            ReleaseMutex(MoreContext->PhysicalLineMutex);
+
+            if (WaitForSingleObject(MoreContext->ShutdownEvent, 0) == WAIT_OBJECT_0) {
+                break;
+            }
+
+        } while (!ReachedEnd);
+    }
+
+    if (SearchActive) {
+        MoreCleanupSearch(&Search);
+    }
+
+    return 0;
+}
+
+// vim:sw=4:ts=4:et:
@@ -525,8 +525,12 @@ MoreCopyRangeIntoLogicalLine(
         LogicalLine->Line.StartOfString = &LogicalLine->PhysicalLine->LineContents.StartOfString[LogicalLine->PhysicalLineCharacterOffset];
         LogicalLine->Line.LengthInChars = SourceCharsToConsume;
 
-        YoriLibReference(LogicalLine->PhysicalLine->MemoryToFree);
-        LogicalLine->Line.MemoryToFree = LogicalLine->PhysicalLine->MemoryToFree;
+        //
+        //  Physical lines remain allocated until the program exits, so the
+        //  logical line doesn't need a reference.
+        //
+
+        LogicalLine->Line.MemoryToFree = NULL;
     }
 
     return TRUE;
@@ -693,15 +697,15 @@ MoreGetPreviousLogicalLines(
 
     while(Result && LinesRemaining > 0) {
         PMORE_PHYSICAL_LINE PreviousPhysicalLine;
-        PYORI_LIST_ENTRY ListEntry;
         DWORD LogicalLineCount;
 
-        ListEntry = YoriLibGetPreviousListEntry(&MoreContext->PhysicalLineList, &CurrentInputLine->PhysicalLine->LineList);
-        if (ListEntry == NULL) {
+        WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+        PreviousPhysicalLine = MoreGetPreviousPhysicalLine(MoreContext, CurrentInputLine->PhysicalLine);
+        ReleaseMutex(MoreContext->PhysicalLineMutex);
+        if (PreviousPhysicalLine == NULL) {
             break;
         }
 
-        PreviousPhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
         LogicalLineCount = MoreCountLogicalLinesOnPhysicalLine(MoreContext, PreviousPhysicalLine);
 
         if (LogicalLineCount > LinesRemaining) {
@@ -823,20 +827,20 @@ MoreGetNextLogicalLines(
 
     while(Result && LinesRemaining > 0) {
         PMORE_PHYSICAL_LINE NextPhysicalLine;
-        PYORI_LIST_ENTRY ListEntry;
 
+        WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
         if (CurrentInputLine != NULL) {
             ASSERT(CurrentInputLine->PhysicalLine != NULL);
-            ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, &CurrentInputLine->PhysicalLine->LineList);
+            NextPhysicalLine = MoreGetNextPhysicalLine(MoreContext, CurrentInputLine->PhysicalLine);
         } else {
-            ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, NULL);
+            NextPhysicalLine = MoreGetNextPhysicalLine(MoreContext, NULL);
         }
-        if (ListEntry == NULL) {
+        ReleaseMutex(MoreContext->PhysicalLineMutex);
+        if (NextPhysicalLine == NULL) {
 
             break;
         }
 
-        NextPhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
         LogicalLineCount = MoreCountLogicalLinesOnPhysicalLine(MoreContext, NextPhysicalLine);
 
         LineIndexToCopy = 0;
@@ -867,54 +871,6 @@ MoreGetNextLogicalLines(
     return Result;
 }
 
-/**
- Find the next physical line that contains a match for the current search
- string.
-
- @param MoreContext Pointer to the more context, containing all physical
-        lines.
-
- @param PreviousMatchLine Pointer to the logical line which is the most
-        recent line to not look for matches within.
-
- @return Pointer to the next physical line containing a match, or NULL
-         if no further physical lines contain a match.
- */
-PMORE_PHYSICAL_LINE
-MoreFindNextLineWithSearchMatch(
-    __in PMORE_CONTEXT MoreContext,
-    __in_opt PMORE_LOGICAL_LINE PreviousMatchLine
-    )
-{
-    PMORE_PHYSICAL_LINE SearchLine;
-    PYORI_LIST_ENTRY ListEntry;
-    DWORD MatchOffset;
-
-    if (PreviousMatchLine == NULL) {
-        SearchLine = NULL;
-        ListEntry = NULL;
-    } else {
-        SearchLine = PreviousMatchLine->PhysicalLine;
-        ListEntry = &SearchLine->LineList;
-    }
-
-    WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
-
-    while (TRUE) {
-        ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, ListEntry);
-        if (ListEntry == NULL) {
-            ReleaseMutex(MoreContext->PhysicalLineMutex);
-            return NULL;
-        }
-
-        SearchLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
-        if (YoriLibFindFirstMatchingSubstringInsensitive(&SearchLine->LineContents, 1, &MoreContext->SearchString, &MatchOffset)) {
-            ReleaseMutex(MoreContext->PhysicalLineMutex);
-            return SearchLine;
-        }
-    }
-}
-
 /**
  Clear any previously drawn status line.
 
@@ -964,11 +920,10 @@ MoreDrawStatusLine(
     DWORDLONG FirstViewportLine;
     DWORDLONG LastViewportLine;
     DWORDLONG TotalLines;
-    PYORI_LIST_ENTRY ListEntry;
-    PMORE_PHYSICAL_LINE LastPhysicalLine;
     BOOL PageFull;
     BOOL ThreadActive;
     LPTSTR StringToDisplay;
+    LPTSTR CountSuffix;
     YORI_STRING LineToDisplay;
 
     //
@@ -986,10 +941,10 @@ MoreDrawStatusLine(
     LastViewportLine = MoreContext->DisplayViewportLines[MoreContext->LinesInViewport - 1].PhysicalLine->LineNumber;
 
     WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
-    ListEntry = YoriLibGetPreviousListEntry(&MoreContext->PhysicalLineList, NULL);
-    LastPhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
-    TotalLines = LastPhysicalLine->LineNumber;
+    TotalLines = MoreContext->LineCount;
     MoreContext->TotalLinesInViewportStatus = TotalLines;
+    MoreContext->SearchMatchCountInStatus = MoreContext->SearchMatchCount;
+    MoreContext->SearchCountCompleteInStatus = MoreContext->SearchCountComplete;
     ReleaseMutex(MoreContext->PhysicalLineMutex);
 
     ASSERT(MoreContext->LinesInPage <= MoreContext->LinesInViewport);
@@ -1014,7 +969,23 @@ MoreDrawStatusLine(
     }
 
     YoriLibInitEmptyString(&LineToDisplay);
-    if (MoreContext->SearchString.LengthInChars > 0 || MoreContext->SearchMode) {
+    if (MoreContext->SearchString.LengthInChars > 0) {
+        if (MoreContext->SearchCountCompleteInStatus) {
+            CountSuffix = _T("");
+        } else {
+            CountSuffix = _T("+");
+        }
+        YoriLibYPrintf(&LineToDisplay,
+                      _T(" --- %s --- (%lli-%lli of %lli, %i%%) Search: %y (%lli%s lines)"),
+                      StringToDisplay,
+                      FirstViewportLine,
+                      LastViewportLine,
+                      TotalLines,
+                      (DWORD)(LastViewportLine * 100 / TotalLines),
+                      &MoreContext->SearchString,
+                      MoreContext->SearchMatchCountInStatus,
+                      CountSuffix);
+    } else if (MoreContext->SearchMode) {
         YoriLibYPrintf(&LineToDisplay,
                       _T(" --- %s --- (%lli-%lli of %lli, %i%%) Search: %y"),
                       StringToDisplay,
@@ -1682,27 +1653,33 @@ MoreRegenerateViewport(
 }
 
 /**
- Find the next search match, meaning any match after the top logical line,
- and advance the viewport to it.  If no further match is found, no update is
- made.
+ Find the next or previous search match, meaning any match after or before
+ the physical line containing the top logical line, and move the viewport to
+ it.  If no match is found, no update is made.
 
  @param MoreContext Pointer to the more context to search for a match and use
         for the source of any display refresh.
+
+ @param Forward TRUE to find the next match, FALSE to find the previous
+        match.
  */
 VOID
-MoreMoveViewportToNextSearchMatch(
-    __inout PMORE_CONTEXT MoreContext
+MoreMoveViewportToSearchMatch(
+    __inout PMORE_CONTEXT MoreContext,
+    __in BOOLEAN Forward
     )
 {
     PMORE_PHYSICAL_LINE NextMatch;
-    PMORE_LOGICAL_LINE LineToFollow;
+    PMORE_PHYSICAL_LINE StartLine;
 
-    LineToFollow = NULL;
+    StartLine = NULL;
     if (MoreContext->LinesInViewport > 0) {
-        LineToFollow = &MoreContext->DisplayViewportLines[0];
+        StartLine = MoreContext->DisplayViewportLines[0].PhysicalLine;
+    } else if (!Forward) {
+        return;
     }
 
-    NextMatch = MoreFindNextLineWithSearchMatch(MoreContext, LineToFollow);
+    NextMatch = MoreFindLineWithSearchMatch(MoreContext, StartLine, Forward);
     if (NextMatch == NULL) {
         return;
     }
@@ -1716,6 +1693,61 @@ MoreMoveViewportToNextSearchMatch(
     MoreRegenerateViewport(MoreContext, NextMatch);
 }
 
+/**
+ Move the viewport so that a specified line is at the top.  The line is
+ found through the line index, so this does not depend on the number of
+ lines ingested.
+
+ @param MoreContext Pointer to the more context.
+
+ @param Number If Percentage is FALSE, the line number to display, where
+        the first line is one.  If Percentage is TRUE, the percentage of the
+        way through the ingested lines to display.
+
+ @param Percentage TRUE if Number refers to a percentage, FALSE if it refers
+        to a line number.
+ */
+VOID
+MoreMoveViewportToPosition(
+    __inout PMORE_CONTEXT MoreContext,
+    __in DWORDLONG Number,
+    __in BOOLEAN Percentage
+    )
+{
+    PMORE_PHYSICAL_LINE PhysicalLine;
+    DWORDLONG LineNumber;
+
+    WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+    if (Percentage) {
+        if (Number > 100) {
+            Number = 100;
+        }
+        LineNumber = MoreContext->LineCount * Number / 100;
+    } else {
+        LineNumber = Number;
+        if (LineNumber > MoreContext->LineCount) {
+            LineNumber = MoreContext->LineCount;
+        }
+    }
+    if (LineNumber == 0) {
+        LineNumber = 1;
+    }
+    PhysicalLine = MoreGetPhysicalLineByNumber(MoreContext, LineNumber);
+    ReleaseMutex(MoreContext->PhysicalLineMutex);
+
+    if (PhysicalLine == NULL) {
+        return;
+    }
+
+    MoreContext->LinesInPage = 0;
+    if (YoriLibIsSelectionActive(&MoreContext->Selection)) {
+        YoriLibClearSelection(&MoreContext->Selection);
+        YoriLibRedrawSelection(&MoreContext->Selection);
+    }
+
+    MoreRegenerateViewport(MoreContext, PhysicalLine);
+}
+
 /**
  Move the viewport left, if the buffer is wider than the window.
 
@@ -2072,8 +2104,6 @@ MoreAreMoreLinesAvailable(
 {
     DWORDLONG LastViewportLineNumber;
     DWORDLONG LastPhysicalLineNumber;
-    PYORI_LIST_ENTRY ListEntry;
-    PMORE_PHYSICAL_LINE LastPhysicalLine;
     PMORE_LOGICAL_LINE LastViewportLine;
 
     //
@@ -2106,9 +2136,7 @@ MoreAreMoreLinesAvailable(
     LastViewportLineNumber = LastViewportLine->PhysicalLine->LineNumber;
 
     WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
-    ListEntry = YoriLibGetPreviousListEntry(&MoreContext->PhysicalLineList, NULL);
-    LastPhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
-    LastPhysicalLineNumber = LastPhysicalLine->LineNumber;
+    LastPhysicalLineNumber = MoreContext->LineCount;
     ReleaseMutex(MoreContext->PhysicalLineMutex);
 
     if (LastPhysicalLineNumber > LastViewportLineNumber) {
@@ -2161,6 +2189,7 @@ MoreProcessKeyDown(
                 MoreContext->SearchMode = FALSE;
                 YoriLibFreeStringContents(&MoreContext->SearchString);
                 MoreContext->SearchDirty = TRUE;
+                MoreSearchStringChanged(MoreContext);
             } else if (Char == '\b') {
                 if (InputRecord->Event.KeyEvent.wRepeatCount > MoreContext->SearchString.LengthInChars) {
                     MoreContext->SearchString.LengthInChars = 0;
@@ -2168,11 +2197,14 @@ MoreProcessKeyDown(
                     MoreContext->SearchString.LengthInChars = MoreContext->SearchString.LengthInChars - InputRecord->Event.KeyEvent.wRepeatCount;
                 }
                 MoreContext->SearchDirty = TRUE;
+                MoreSearchStringChanged(MoreContext);
             } else if (Char == '\r') {
                 if (YoriLibIsSelectionActive(&MoreContext->Selection)) {
                     MoreCopySelectionIfPresent(MoreContext);
+                } else if (CtrlMask == SHIFT_PRESSED) {
+                    MoreMoveViewportToSearchMatch(MoreContext, FALSE);
                 } else {
-                    MoreMoveViewportToNextSearchMatch(MoreContext);
+                    MoreMoveViewportToSearchMatch(MoreContext, TRUE);
                 }
             } else if (Char != '\0' && Char != '\n') {
                 if (MoreContext->SearchString.LengthAllocated < MoreContext->SearchString.LengthInChars + InputRecord->Event.KeyEvent.wRepeatCount + 1) {
@@ -2190,6 +2222,7 @@ MoreProcessKeyDown(
                     }
                     MoreContext->SearchString.LengthInChars = MoreContext->SearchString.LengthInChars + InputRecord->Event.KeyEvent.wRepeatCount;
                     MoreContext->SearchDirty = TRUE;
+                    MoreSearchStringChanged(MoreContext);
                 }
             }
         } else {
@@ -2208,6 +2241,12 @@ MoreProcessKeyDown(
                 MoreContext->SearchMode = TRUE;
                 MoreContext->SearchDirty = TRUE;
                 *RedrawStatus = TRUE;
+            } else if (Char >= '0' && Char <= '9') {
+                MoreContext->PendingNumber = MoreContext->PendingNumber * 10 + (Char - '0');
+            } else if (Char == 'g') {
+                MoreMoveViewportToPosition(MoreContext, MoreContext->PendingNumber, FALSE);
+            } else if (Char == '%') {
+                MoreMoveViewportToPosition(MoreContext, MoreContext->PendingNumber, TRUE);
             } else if (KeyCode == VK_SCROLL) {
                 if (InputRecord->Event.KeyEvent.dwControlKeyState & SCROLLLOCK_ON) {
                     MoreContext->SuspendPagination = TRUE;
@@ -2219,6 +2258,16 @@ MoreProcessKeyDown(
                 MoreContext->SuspendPagination = FALSE;
                 *RedrawStatus = TRUE;
             }
+
+            //
+            //  A number applies to the command which follows it.  Any
+            //  keystroke which generates a character other than a digit
+            //  ends the number.
+            //
+
+            if (Char != '\0' && (Char < '0' || Char > '9')) {
+                MoreContext->PendingNumber = 0;
+            }
         }
     } else if (CtrlMask == ENHANCED_KEY) {
         ClearSelection = TRUE;
@@ -2415,7 +2464,11 @@ MoreCheckForStatusLineChange(
     __inout PMORE_CONTEXT MoreContext
     )
 {
-    if (MoreContext->TotalLinesInViewportStatus != MoreContext->LineCount || MoreContext->SearchDirty) {
+    if (MoreContext->TotalLinesInViewportStatus != MoreContext->LineCount ||
+        MoreContext->SearchMatchCountInStatus != MoreContext->SearchMatchCount ||
+        MoreContext->SearchCountCompleteInStatus != MoreContext->SearchCountComplete ||
+        MoreContext->SearchDirty) {
+
         MoreClearStatusLine(MoreContext);
         MoreDrawStatusLine(MoreContext);
     }
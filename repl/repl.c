@@ -82,6 +82,11 @@ typedef struct _REPL_CONTEXT {
      */
     PYORI_STRING MatchString;
 
+    /**
+     A compiled form of MatchString used to search each line.
+     */
+    PYORI_SUBSTRING_MATCHER Matcher;
+
     /**
      A string to replace the match with.
      */
@@ -127,7 +132,7 @@ ReplProcessStream(
 
     while (TRUE) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibMappedLineReadToString(&LineString, &LineContext, hSource)) {
             break;
         }
 
@@ -153,14 +158,8 @@ ReplProcessStream(
             //  If no match is found, the line processing is complete
             //
 
-            if (ReplContext->Insensitive) {
-                if (YoriLibFindFirstMatchingSubstringInsensitive(&SearchSubset, 1, ReplContext->MatchString, &MatchOffset) == NULL) {
-                    break;
-                }
-            } else {
-                if (YoriLibFindFirstMatchingSubstring(&SearchSubset, 1, ReplContext->MatchString, &MatchOffset) == NULL) {
-                    break;
-                }
+            if (YoriLibSubstringMatcherFindFirst(ReplContext->Matcher, &SearchSubset, &MatchOffset) == NULL) {
+                break;
             }
 
             //
@@ -209,7 +208,7 @@ ReplProcessStream(
         }
     }
 
-    YoriLibLineReadClose(LineContext);
+    YoriLibMappedLineReadClose(LineContext);
     YoriLibFreeStringContents(&LineString);
     YoriLibFreeStringContents(&AlternateStrings[0]);
     YoriLibFreeStringContents(&AlternateStrings[1]);
@@ -429,6 +428,12 @@ ENTRYPOINT(
     }
     StartArg += 2;
 
+    ReplContext.Matcher = YoriLibCompileSubstringMatcher(1, ReplContext.MatchString, (BOOLEAN)ReplContext.Insensitive);
+    if (ReplContext.Matcher == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("repl: out of memory\n"));
+        return EXIT_FAILURE;
+    }
+
 #if YORI_BUILTIN
     YoriLibCancelEnable();
 #endif
@@ -436,6 +441,7 @@ ENTRYPOINT(
     if (StartArg == 0 || StartArg >= ArgC) {
         if (YoriLibIsStdInConsole()) {
             YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("No file or pipe for input\n"));
+            YoriLibFreeSubstringMatcher(ReplContext.Matcher);
             return EXIT_FAILURE;
         }
 
@@ -460,6 +466,8 @@ ENTRYPOINT(
         }
     }
 
+    YoriLibFreeSubstringMatcher(ReplContext.Matcher);
+
     if (ReplContext.FilesFound == 0) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("repl: no matching files found\n"));
         return EXIT_FAILURE;
@@ -36,9 +36,13 @@
 //
 
 /**
- Write a specified number of characters to the output device.
+ The buffer used to accumulate output before it is written to the output
+ device.  If the output device is a console, text is written immediately.
+ */
+YORI_LIB_OUTPUT_BUFFER SdirOutputBuffer;
 
- @param hConsole Handle to the output device.
+/**
+ Write a specified number of characters to the output device.
 
  @param OutputString An array of characters to write to the output device.
 
@@ -48,7 +52,6 @@
  */
 BOOL
 SdirWriteRawStringToOutputDevice(
-    __in HANDLE hConsole,
     __in LPCTSTR OutputString,
     __in DWORD Length
     )
@@ -58,7 +61,7 @@ SdirWriteRawStringToOutputDevice(
     String.StartOfString = (LPTSTR)OutputString;
     String.LengthInChars = Length;
 
-    return YoriLibOutputString(hConsole, 0, &String);
+    return YoriLibOutputBufferWriteString(&SdirOutputBuffer, &String);
 }
 
 /**
@@ -71,18 +74,18 @@ YORILIB_COLOR_ATTRIBUTES SdirCurrentAttribute;
  Sent a VT escape sequence to the output device if the new color is
  different to the previous one.
 
- @param hConsole Handle to the output device.
-
  @param Attribute The new color to set.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 SdirSetConsoleTextAttribute(
-    __in HANDLE hConsole,
     __in YORILIB_COLOR_ATTRIBUTES Attribute
     )
 {
+    TCHAR EscapeBuffer[YORI_MAX_INTERNAL_VT_ESCAPE_CHARS];
+    YORI_STRING EscapeString;
+
     if (YoriLibAreColorsIdentical(Attribute, SdirCurrentAttribute)) {
         return TRUE;
     }
@@ -90,7 +93,15 @@ SdirSetConsoleTextAttribute(
     SdirCurrentAttribute.Ctrl = Attribute.Ctrl;
     SdirCurrentAttribute.Win32Attr = Attribute.Win32Attr;
 
-    return YoriLibVtSetConsoleTextAttributeOnDevice(hConsole, 0, 0, Attribute.Win32Attr);
+    YoriLibInitEmptyString(&EscapeString);
+    EscapeString.StartOfString = EscapeBuffer;
+    EscapeString.LengthAllocated = sizeof(EscapeBuffer)/sizeof(EscapeBuffer[0]);
+
+    if (!YoriLibVtStringForTextAttribute(&EscapeString, 0, Attribute.Win32Attr)) {
+        return FALSE;
+    }
+
+    return YoriLibOutputBufferWriteString(&SdirOutputBuffer, &EscapeString);
 }
 
 /**
@@ -109,7 +120,6 @@ SdirWrite (
     __in DWORD count
     )
 {
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
     DWORD i, j;
 
     YORILIB_COLOR_ATTRIBUTES CacheAttr;
@@ -136,8 +146,8 @@ SdirWrite (
 
         if (( i + 1 < count && !YoriLibAreColorsIdentical(str[i + 1].Attr, CacheAttr)) || (j >= sizeof(CharCache)/sizeof(CharCache[0]))) {
 
-            SdirSetConsoleTextAttribute(hConsole, CacheAttr);
-            SdirWriteRawStringToOutputDevice(hConsole, CharCache, j);
+            SdirSetConsoleTextAttribute(CacheAttr);
+            SdirWriteRawStringToOutputDevice(CharCache, j);
             j = 0;
         }
     }
@@ -148,8 +158,8 @@ SdirWrite (
 
     if (j > 0) {
 
-        SdirSetConsoleTextAttribute(hConsole, CacheAttr);
-        SdirWriteRawStringToOutputDevice(hConsole, CharCache, j);
+        SdirSetConsoleTextAttribute(CacheAttr);
+        SdirWriteRawStringToOutputDevice(CharCache, j);
     }
 
     return TRUE;
@@ -184,7 +194,7 @@ SdirWriteStringWithAttribute (
     BOOLEAN HitLineLimit = FALSE;
     CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
 
-    SdirSetConsoleTextAttribute(hConsole, DefaultAttribute);
+    SdirSetConsoleTextAttribute(DefaultAttribute);
 
     if (Opts->OutputHasAutoLineWrap) {
 
@@ -210,7 +220,7 @@ SdirWriteStringWithAttribute (
 
             SdirWriteStringLinesDisplayed += LinesInBuffer;
 
-            SdirWriteRawStringToOutputDevice(hConsole, str, TCharsInBuffer);
+            SdirWriteRawStringToOutputDevice(str, TCharsInBuffer);
 
             LinesInBuffer = 0;
             str += TCharsInBuffer;
@@ -228,15 +238,15 @@ SdirWriteStringWithAttribute (
                 if (Opts->EnablePause && !SdirPressAnyKey()) {
                     return FALSE;
                 }
-                SdirSetConsoleTextAttribute(hConsole, DefaultAttribute);
+                SdirSetConsoleTextAttribute(DefaultAttribute);
                 HitLineLimit = FALSE;
             }
         }
 
     } else {
 
-        SdirSetConsoleTextAttribute(hConsole, DefaultAttribute);
-        SdirWriteRawStringToOutputDevice(hConsole, str, (DWORD)_tcslen(str));
+        SdirSetConsoleTextAttribute(DefaultAttribute);
+        SdirWriteRawStringToOutputDevice(str, (DWORD)_tcslen(str));
     }
 
     return TRUE;
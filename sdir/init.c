@@ -77,6 +77,14 @@ SdirAppInitialize()
     }
     ZeroMemory(Summary, sizeof(SDIR_SUMMARY));
 
+    if (!YoriLibOutputBufferInitialize(&SdirOutputBuffer, YORI_LIB_OUTPUT_STDOUT)) {
+        YoriLibFree(Summary);
+        Summary = NULL;
+        YoriLibFree(Opts);
+        Opts = NULL;
+        return FALSE;
+    }
+
     //
     //  For simplicity, initialize this now.  On failure we restore to
     //  this value.  Hopefully we'll find the correct value before any
@@ -540,6 +548,28 @@ SdirParseArgs (
     return TRUE;
 }
 
+/**
+ Determine the access to each file needed by the features that will be
+ collected, so each file can be opened once with all of that access.  This
+ must be called after all features to collect have been determined.
+ */
+VOID
+SdirCalculateCollectAccess()
+{
+    DWORD i;
+    PSDIR_FEATURE Feature;
+
+    SdirGlobal.CollectAccess = 0;
+    for (i = 0; i < SdirGetNumSdirOptions(); i++) {
+        Feature = SdirFeatureByOptionNumber(i);
+        if ((Feature->Flags & SDIR_FEATURE_COLLECT) &&
+            SdirOptions[i].CollectFn) {
+
+            SdirGlobal.CollectAccess |= YoriLibGetFileCollectAccess(SdirOptions[i].CollectFn);
+        }
+    }
+}
+
 /**
  Initialize the application, parsing all arguments and configuring global
  state ready for execution.
@@ -580,6 +610,8 @@ SdirInit(
         return FALSE;
     }
 
+    SdirCalculateCollectAccess();
+
     return TRUE;
 }
 
@@ -604,6 +636,8 @@ SdirAppCleanup()
         Summary = NULL;
     }
 
+    YoriLibOutputBufferCleanup(&SdirOutputBuffer);
+
     YoriLibFileFiltFreeFilter(&SdirGlobal.FileColorCriteria);
     YoriLibFileFiltFreeFilter(&SdirGlobal.FileHideCriteria);
 
@@ -616,6 +650,11 @@ SdirAppCleanup()
         YoriLibFree(SdirDirSorted);
         SdirDirSorted = NULL;
     }
+
+    if (SdirDirSortScratch != NULL) {
+        YoriLibFree(SdirDirSortScratch);
+        SdirDirSortScratch = NULL;
+    }
 }
 
 // vim:sw=4:ts=4:et:
@@ -48,6 +48,40 @@ PYORI_FILE_INFO SdirDirCollection;
  */
 PYORI_FILE_INFO * SdirDirSorted;
 
+/**
+ Pointer to an array of pointers to directory entries, the same size as
+ SdirDirSorted, used as temporary space when merging sorted runs.
+ */
+PYORI_FILE_INFO * SdirDirSortScratch;
+
+/**
+ The number of entries which are added to the sorted array before they are
+ sorted into a run.  Sorting runs as entries arrive spreads the cost of
+ sorting across enumeration rather than performing it all before display.
+ */
+#define SDIR_SORT_RUN_LENGTH (4096)
+
+/**
+ The maximum number of sorted runs which can be pending.  Runs are merged
+ when a run is no larger than the run after it, so each pending run is at
+ least twice the size of the next, and this bounds the number of entries
+ far beyond what a DWORD can count.
+ */
+#define SDIR_MAX_SORT_RUNS (40)
+
+/**
+ The index within SdirDirSorted where each pending sorted run ends.  Run
+ zero starts at the beginning of the array, and each subsequent run starts
+ where the previous run ends.  Entries beyond the final run have not been
+ sorted yet.
+ */
+ULONG SdirDirSortRunEnd[SDIR_MAX_SORT_RUNS];
+
+/**
+ The number of pending sorted runs within SdirDirSorted.
+ */
+ULONG SdirDirSortRunCount;
+
 /**
  Specifies the number of allocated directory entries that have been
  populated with files returned from directory enumerate.
@@ -114,8 +148,10 @@ SdirCaptureFoundItemIntoDirent (
     ) 
 {
     DWORD i;
+    YORI_LIB_FILE_COLLECT_CONTEXT CollectContext;
 
     memset(CurrentEntry, 0, sizeof(*CurrentEntry));
+    YoriLibInitFileCollectContext(&CollectContext, SdirGlobal.CollectAccess);
 
 
     //
@@ -134,10 +170,12 @@ SdirCaptureFoundItemIntoDirent (
         if ((Feature->Flags & SDIR_FEATURE_COLLECT) &&
                SdirOptions[i].CollectFn) {
 
-            SdirOptions[i].CollectFn(CurrentEntry, FindData, FullPath);
+            SdirOptions[i].CollectFn(CurrentEntry, FindData, FullPath, &CollectContext);
         }
     }
 
+    YoriLibResetFileCollectContext(&CollectContext);
+
     //
     //  Determine the color to display each entry from extensions and attributes.
     //
@@ -196,6 +234,208 @@ SdirRenderAttributesFromPath (
     }
 }
 
+/**
+ Compare two directory entries using the full set of sort criteria specified
+ by the user.
+
+ @param Left Pointer to the first entry.
+
+ @param Right Pointer to the second entry.
+
+ @return YORI_LIB_GREATER_THAN if Left should be displayed after Right,
+         YORI_LIB_LESS_THAN if Left should be displayed before Right, or
+         YORI_LIB_EQUAL if the sort criteria do not distinguish them.
+ */
+DWORD
+SdirCompareForSort(
+    __in PYORI_FILE_INFO Left,
+    __in PYORI_FILE_INFO Right
+    )
+{
+    DWORD CompareResult;
+    DWORD Index;
+
+    for (Index = 0; Index < Opts->CurrentSort; Index++) {
+        CompareResult = Opts->Sort[Index].CompareFn(Left, Right);
+
+        if (CompareResult == Opts->Sort[Index].CompareBreakCondition) {
+            return YORI_LIB_GREATER_THAN;
+        }
+
+        if (CompareResult == Opts->Sort[Index].CompareInverseCondition) {
+            return YORI_LIB_LESS_THAN;
+        }
+    }
+
+    return YORI_LIB_EQUAL;
+}
+
+/**
+ Merge two adjacent sorted ranges of SdirDirSorted into a single sorted
+ range.  The merge is stable, so entries which compare equal retain the
+ order they were found in.
+
+ @param Start The index of the first entry in the first range.
+
+ @param Middle The index of the first entry in the second range.
+
+ @param End The index after the last entry in the second range.
+ */
+VOID
+SdirMergeSortedRanges(
+    __in DWORD Start,
+    __in DWORD Middle,
+    __in DWORD End
+    )
+{
+    DWORD LeftIndex;
+    DWORD RightIndex;
+    DWORD DestIndex;
+
+    if (Start == Middle || Middle == End) {
+        return;
+    }
+
+    //
+    //  If the ranges are already in order, as happens when the file system
+    //  returns entries in the requested order, there's nothing to do.
+    //
+
+    if (SdirCompareForSort(SdirDirSorted[Middle - 1], SdirDirSorted[Middle]) != YORI_LIB_GREATER_THAN) {
+        return;
+    }
+
+    //
+    //  Move the first range aside and merge back into place.  The
+    //  destination can never overtake the unread part of the second range.
+    //
+
+    memcpy(&SdirDirSortScratch[Start], &SdirDirSorted[Start], (Middle - Start) * sizeof(PYORI_FILE_INFO));
+
+    LeftIndex = Start;
+    RightIndex = Middle;
+    DestIndex = Start;
+
+    while (LeftIndex < Middle && RightIndex < End) {
+        if (SdirCompareForSort(SdirDirSortScratch[LeftIndex], SdirDirSorted[RightIndex]) == YORI_LIB_GREATER_THAN) {
+            SdirDirSorted[DestIndex] = SdirDirSorted[RightIndex];
+            RightIndex++;
+        } else {
+            SdirDirSorted[DestIndex] = SdirDirSortScratch[LeftIndex];
+            LeftIndex++;
+        }
+        DestIndex++;
+    }
+
+    while (LeftIndex < Middle) {
+        SdirDirSorted[DestIndex] = SdirDirSortScratch[LeftIndex];
+        LeftIndex++;
+        DestIndex++;
+    }
+}
+
+/**
+ Sort a range of SdirDirSorted with a stable merge sort.
+
+ @param Start The index of the first entry to sort.
+
+ @param End The index after the last entry to sort.
+ */
+VOID
+SdirMergeSortRange(
+    __in DWORD Start,
+    __in DWORD End
+    )
+{
+    DWORD Middle;
+    DWORD Index;
+    DWORD InsertIndex;
+    PYORI_FILE_INFO Entry;
+
+    //
+    //  For small ranges, an insertion sort is cheaper than recursing.
+    //
+
+    if (End - Start <= 16) {
+        for (Index = Start + 1; Index < End; Index++) {
+            Entry = SdirDirSorted[Index];
+            InsertIndex = Index;
+            while (InsertIndex > Start &&
+                   SdirCompareForSort(SdirDirSorted[InsertIndex - 1], Entry) == YORI_LIB_GREATER_THAN) {
+                SdirDirSorted[InsertIndex] = SdirDirSorted[InsertIndex - 1];
+                InsertIndex--;
+            }
+            SdirDirSorted[InsertIndex] = Entry;
+        }
+        return;
+    }
+
+    Middle = Start + (End - Start) / 2;
+    SdirMergeSortRange(Start, Middle);
+    SdirMergeSortRange(Middle, End);
+    SdirMergeSortedRanges(Start, Middle, End);
+}
+
+/**
+ Return the index within SdirDirSorted following the last sorted run.
+ Entries from this point have been found but not sorted.
+
+ @return The index following the last sorted run.
+ */
+DWORD
+SdirDirSortedRunsEnd()
+{
+    if (SdirDirSortRunCount == 0) {
+        return 0;
+    }
+    return SdirDirSortRunEnd[SdirDirSortRunCount - 1];
+}
+
+/**
+ Sort any entries which have been found but not yet sorted into a run, and
+ merge runs together.
+
+ @param Complete If TRUE, all runs are merged so that the entire array is
+        sorted.  If FALSE, runs are only merged while the latest run is at
+        least as large as the one before it, which keeps the total work
+        O(n log n) while spreading it across enumeration.
+ */
+VOID
+SdirSortPendingEntries(
+    __in BOOL Complete
+    )
+{
+    DWORD RunStart;
+    DWORD PreviousRunStart;
+
+    RunStart = SdirDirSortedRunsEnd();
+    if (SdirDirCollectionCurrent > RunStart) {
+        SdirMergeSortRange(RunStart, SdirDirCollectionCurrent);
+        SdirDirSortRunEnd[SdirDirSortRunCount] = SdirDirCollectionCurrent;
+        SdirDirSortRunCount++;
+    }
+
+    while (SdirDirSortRunCount > 1) {
+        if (SdirDirSortRunCount > 2) {
+            PreviousRunStart = SdirDirSortRunEnd[SdirDirSortRunCount - 3];
+        } else {
+            PreviousRunStart = 0;
+        }
+        RunStart = SdirDirSortRunEnd[SdirDirSortRunCount - 2];
+
+        if (!Complete &&
+            SdirDirSortRunCount < SDIR_MAX_SORT_RUNS &&
+            RunStart - PreviousRunStart > SdirDirSortRunEnd[SdirDirSortRunCount - 1] - RunStart) {
+
+            break;
+        }
+
+        SdirMergeSortedRanges(PreviousRunStart, RunStart, SdirDirSortRunEnd[SdirDirSortRunCount - 1]);
+        SdirDirSortRunEnd[SdirDirSortRunCount - 2] = SdirDirSortRunEnd[SdirDirSortRunCount - 1];
+        SdirDirSortRunCount--;
+    }
+}
+
 /**
  Add a single found object to the set of files found so far.
 
@@ -213,8 +453,6 @@ SdirAddToCollection (
     ) 
 {
     PYORI_FILE_INFO CurrentEntry;
-    DWORD i, j;
-    DWORD CompareResult = 0;
 
     if (SdirDirCollectionCurrent >= SdirAllocatedDirents) {
         if (SdirDirCollectionCurrent < UINT_MAX) {
@@ -246,46 +484,17 @@ SdirAddToCollection (
     }
 
     //
-    //  Now that our internal entry is fully poulated, insert it into the
-    //  correct sorted position.  As an optimization, check if we just need
-    //  to insert at the end (for file name sort on NTFS, this is the
-    //  common case.)
+    //  Now that our internal entry is fully populated, append it to the
+    //  sorted array.  Once enough unsorted entries have accumulated, sort
+    //  them into a run and merge it with any earlier runs.
     //
 
-    if (SdirDirCollectionCurrent > 1 &&
-        Opts->Sort[0].CompareFn(SdirDirSorted[SdirDirCollectionCurrent - 2], CurrentEntry) == Opts->Sort[0].CompareInverseCondition) {
+    SdirDirSorted[SdirDirCollectionCurrent - 1] = CurrentEntry;
 
-        SdirDirSorted[SdirDirCollectionCurrent - 1] = CurrentEntry;
-        return TRUE;
+    if (SdirDirCollectionCurrent - SdirDirSortedRunsEnd() >= SDIR_SORT_RUN_LENGTH) {
+        SdirSortPendingEntries(FALSE);
     }
 
-    //
-    //  Currently sorting is done very inefficiently by a selection sort
-    //  type algorithm.  Generally this doesn't run due to the optimization
-    //  above.  When a different sort order is requested, performance could
-    //  be improved by using a better algorithm here.
-    //
-
-    for (i = 0; i < SdirDirCollectionCurrent - 1; i++) {
-
-        for (j = 0; j < Opts->CurrentSort; j++) {
-            CompareResult = Opts->Sort[j].CompareFn(SdirDirSorted[i], CurrentEntry);
-
-            if (CompareResult == Opts->Sort[j].CompareBreakCondition ||
-                CompareResult == Opts->Sort[j].CompareInverseCondition) {
-                break;
-            }
-        }
-
-        if (CompareResult == Opts->Sort[j].CompareBreakCondition) {
-            for (j = SdirDirCollectionCurrent - 1; j > i; j--) {
-                SdirDirSorted[j] = SdirDirSorted[j - 1];
-            }
-            SdirDirSorted[i] = CurrentEntry;
-            return TRUE;
-        }
-    }
-    SdirDirSorted[SdirDirCollectionCurrent - 1] = CurrentEntry;
     return TRUE;
 }
 
@@ -556,6 +765,7 @@ SdirEnumeratePathWithDepth (
     SDIR_SUMMARY SummaryToPreserve;
     PYORI_FILE_INFO NewSdirDirCollection;
     PYORI_FILE_INFO * NewSdirDirSorted;
+    PYORI_FILE_INFO * NewSdirDirSortScratch;
     SDIR_ITEM_FOUND_CONTEXT ItemFoundContext;
     DWORD MatchFlags;
 
@@ -644,6 +854,13 @@ SdirEnumeratePathWithDepth (
     //  be able to meaningfully process it.
     //
 
+    //
+    //  Any entries from previous criteria are sorted into a single run
+    //  before enumerating more, so that they remain sorted if the
+    //  collection needs to be reallocated.
+    //
+
+    SdirSortPendingEntries(TRUE);
     DirEntsToPreserve = SdirDirCollectionCurrent;
     memcpy(&SummaryToPreserve, Summary, sizeof(SummaryToPreserve));
 
@@ -680,6 +897,15 @@ SdirEnumeratePathWithDepth (
                 return FALSE;
             }
 
+            NewSdirDirSortScratch = YoriLibMalloc(SdirAllocatedDirents * sizeof(PYORI_FILE_INFO));
+            if (NewSdirDirSortScratch == NULL) {
+                SdirAllocatedDirents = SdirDirCollectionCurrent;
+                YoriLibFree(NewSdirDirCollection);
+                YoriLibFree(NewSdirDirSorted);
+                SdirDisplayError(GetLastError(), _T("YoriLibMalloc"));
+                return FALSE;
+            }
+
             //
             //  Copy back any previous data.  This occurs when multiple
             //  criteria are specified, eg., "*.a *.b".  Apply fixups to
@@ -699,10 +925,26 @@ SdirEnumeratePathWithDepth (
             if (SdirDirSorted != NULL) {
                 YoriLibFree(SdirDirSorted);
             }
+
+            if (SdirDirSortScratch != NULL) {
+                YoriLibFree(SdirDirSortScratch);
+            }
     
             SdirDirCollection = NewSdirDirCollection;
             SdirDirSorted = NewSdirDirSorted;
+            SdirDirSortScratch = NewSdirDirSortScratch;
             SdirDirCollectionCurrent = DirEntsToPreserve;
+
+            //
+            //  Preserved entries were sorted into a single run before
+            //  enumerating, and anything found since is discarded.
+            //
+
+            SdirDirSortRunCount = 0;
+            if (DirEntsToPreserve > 0) {
+                SdirDirSortRunEnd[0] = DirEntsToPreserve;
+                SdirDirSortRunCount = 1;
+            }
             memcpy(Summary, &SummaryToPreserve, sizeof(SummaryToPreserve));
         }
 
@@ -712,7 +954,7 @@ SdirEnumeratePathWithDepth (
         //
 
         ItemFoundContext.ItemsFound = 0;
-        MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_RETURN_DIRECTORIES | YORILIB_FILEENUM_INCLUDE_DOTFILES;
+        MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_RETURN_DIRECTORIES | YORILIB_FILEENUM_INCLUDE_DOTFILES | YORILIB_FILEENUM_PARALLEL;
 
         //
         //  MSFIX This isn't really correct without a major refactor.  What
@@ -910,6 +1152,13 @@ SdirDisplayCollection()
     }
 #endif
 
+    //
+    //  Finish sorting any entries found since the last run was sorted and
+    //  merge all runs into a single sorted array.
+    //
+
+    SdirSortPendingEntries(TRUE);
+
     //
     //  If we're allowed to shorten names to make the display more
     //  legible, we won't allow a longest name greater than twice
@@ -1353,6 +1602,13 @@ SdirEnumerateAndDisplaySubtree (
     WIN32_FIND_DATA FindData;
     SDIR_SUMMARY SummaryOnEntry;
     LPTSTR szFormatStr;
+    YORI_STRING SubDirNames;
+    DWORD SubDirCount;
+    DWORD SubDirIndex;
+    DWORD ReadAheadIndex;
+    DWORD NameLength;
+    LPTSTR SubDirName;
+    LPTSTR ReadAheadName;
 
     YoriLibInitEmptyString(&ParentDirectory);
     YoriLibInitEmptyString(&SearchCriteria);
@@ -1448,6 +1704,7 @@ SdirEnumerateAndDisplaySubtree (
     //
 
     SdirDirCollectionCurrent = 0;
+    SdirDirSortRunCount = 0;
     SdirDirCollectionLongest = 0;
     SdirDirCollectionTotalNameLength = 0;
 
@@ -1487,6 +1744,15 @@ SdirEnumerateAndDisplaySubtree (
         }
     }
     
+    //
+    //  Collect the names of subdirectories to recurse into before
+    //  recursing, so that subdirectories can be read ahead of when they
+    //  are displayed.
+    //
+
+    YoriLibInitEmptyString(&SubDirNames);
+    SubDirCount = 0;
+
     do {
         if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY &&
             _tcscmp(FindData.cFileName, _T(".")) != 0 &&
@@ -1497,34 +1763,82 @@ SdirEnumerateAndDisplaySubtree (
                 (FindData.dwReserved0 != IO_REPARSE_TAG_MOUNT_POINT &&
                  FindData.dwReserved0 != IO_REPARSE_TAG_SYMLINK)) {
 
-                if (ParentDirectory.LengthInChars == 0 ||
-                    ParentDirectory.StartOfString[ParentDirectory.LengthInChars - 1] == '\\') {
-                    szFormatStr = _T("%y%s\\%y");
-                } else {
-                    szFormatStr = _T("%y\\%s\\%y");
+                NameLength = _tcslen(FindData.cFileName);
+                if (SubDirNames.LengthInChars + NameLength + 1 > SubDirNames.LengthAllocated) {
+                    if (!YoriLibReallocateString(&SubDirNames, (SubDirNames.LengthInChars + NameLength + 1) * 2 + 1024)) {
+                        SdirDisplayError(GetLastError(), _T("YoriLibReallocateString"));
+                        FindClose(hFind);
+                        YoriLibFreeStringContents(&SubDirNames);
+                        YoriLibFreeStringContents(&NextSubDir);
+                        return FALSE;
+                    }
                 }
 
-                if (YoriLibYPrintf(&NextSubDir, szFormatStr, &ParentDirectory, FindData.cFileName, &SearchCriteria) < 0 ||
-                    NextSubDir.LengthInChars == 0) {
-
-                    SdirWriteString(_T("Path exceeds allocated length\n"));
-                    YoriLibFreeStringContents(&NextSubDir);
-                    return FALSE;
-                }
-    
-                if (!SdirEnumerateAndDisplaySubtree(Depth + 1, &NextSubDir)) {
-                    FindClose(hFind);
-                    YoriLibFreeStringContents(&NextSubDir);
-                    return FALSE;
-                }
+                memcpy(&SubDirNames.StartOfString[SubDirNames.LengthInChars], FindData.cFileName, (NameLength + 1) * sizeof(TCHAR));
+                SubDirNames.LengthInChars += NameLength + 1;
+                SubDirCount++;
             }
         }
     } while (FindNextFile(hFind, &FindData) && !Opts->Cancelled);
 
-    YoriLibFreeStringContents(&NextSubDir);
-    
     FindClose(hFind);
 
+    if (ParentDirectory.LengthInChars == 0 ||
+        ParentDirectory.StartOfString[ParentDirectory.LengthInChars - 1] == '\\') {
+        szFormatStr = _T("%y%s\\%y");
+    } else {
+        szFormatStr = _T("%y\\%s\\%y");
+    }
+
+    SubDirName = SubDirNames.StartOfString;
+    ReadAheadName = SubDirName;
+    ReadAheadIndex = 0;
+
+    for (SubDirIndex = 0; SubDirIndex < SubDirCount && !Opts->Cancelled; SubDirIndex++) {
+
+        //
+        //  Queue the subdirectories after this one to be read ahead, until
+        //  the read ahead queue is full.  This resumes where it left off
+        //  each time a subdirectory is displayed.
+        //
+
+        if (ReadAheadIndex <= SubDirIndex) {
+            ReadAheadIndex = SubDirIndex + 1;
+            ReadAheadName = SubDirName + _tcslen(SubDirName) + 1;
+        }
+
+        while (ReadAheadIndex < SubDirCount) {
+            if (YoriLibYPrintf(&NextSubDir, szFormatStr, &ParentDirectory, ReadAheadName, &SearchCriteria) < 0 ||
+                NextSubDir.LengthInChars == 0 ||
+                !YoriLibFileEnumReadAhead(&NextSubDir)) {
+
+                break;
+            }
+            ReadAheadName += _tcslen(ReadAheadName) + 1;
+            ReadAheadIndex++;
+        }
+
+        if (YoriLibYPrintf(&NextSubDir, szFormatStr, &ParentDirectory, SubDirName, &SearchCriteria) < 0 ||
+            NextSubDir.LengthInChars == 0) {
+
+            SdirWriteString(_T("Path exceeds allocated length\n"));
+            YoriLibFreeStringContents(&SubDirNames);
+            YoriLibFreeStringContents(&NextSubDir);
+            return FALSE;
+        }
+
+        if (!SdirEnumerateAndDisplaySubtree(Depth + 1, &NextSubDir)) {
+            YoriLibFreeStringContents(&SubDirNames);
+            YoriLibFreeStringContents(&NextSubDir);
+            return FALSE;
+        }
+
+        SubDirName += _tcslen(SubDirName) + 1;
+    }
+
+    YoriLibFreeStringContents(&SubDirNames);
+    YoriLibFreeStringContents(&NextSubDir);
+
     return TRUE;
 }
 
@@ -1545,41 +1859,56 @@ SdirEnumerateAndDisplayRecursive (
     )
 {
     BOOLEAN EnumerateUserSpecified = FALSE;
+    BOOLEAN ReadAheadStarted;
+    BOOL Result = TRUE;
     ULONG CurrentArg;
     YORI_STRING Arg;
     YORI_STRING FindStr;
 
+    //
+    //  Read subdirectories on background threads while earlier directories
+    //  are displayed.  If this fails, enumerate serially.
+    //
+
+    ReadAheadStarted = (BOOLEAN)YoriLibFileEnumStartReadAhead();
+
     for (CurrentArg = 1; CurrentArg < ArgC; CurrentArg++) {
         if (!YoriLibIsCommandLineOption(&ArgV[CurrentArg], &Arg)) {
 
             YoriLibInitEmptyString(&FindStr);
             if (!YoriLibUserStringToSingleFilePath(&ArgV[CurrentArg], TRUE, &FindStr)) {
-                return FALSE;
+                Result = FALSE;
+                break;
             }
 
             if (!SdirEnumerateAndDisplaySubtree(0, &FindStr)) {
                 YoriLibFreeStringContents(&FindStr);
-                return FALSE;
+                Result = FALSE;
+                break;
             }
             YoriLibFreeStringContents(&FindStr);
             EnumerateUserSpecified = TRUE;
         }
     }
 
-    if (!EnumerateUserSpecified) {
+    if (Result && !EnumerateUserSpecified) {
         YoriLibConstantString(&Arg, _T("*"));
         YoriLibInitEmptyString(&FindStr);
         if (!YoriLibUserStringToSingleFilePath(&Arg, TRUE, &FindStr)) {
-            return FALSE;
-        }
-        if (!SdirEnumerateAndDisplaySubtree(0, &FindStr)) {
+            Result = FALSE;
+        } else {
+            if (!SdirEnumerateAndDisplaySubtree(0, &FindStr)) {
+                Result = FALSE;
+            }
             YoriLibFreeStringContents(&FindStr);
-            return FALSE;
         }
-        YoriLibFreeStringContents(&FindStr);
     }
 
-    return TRUE;
+    if (ReadAheadStarted) {
+        YoriLibFileEnumEndReadAhead();
+    }
+
+    return Result;
 }
 
 #ifdef YORI_BUILTIN
@@ -1612,7 +1941,9 @@ ENTRYPOINT(
     SdirAllocatedDirents = 1000;
     SdirDirCollection = NULL;
     SdirDirSorted = NULL;
+    SdirDirSortScratch = NULL;
     SdirDirCollectionCurrent = 0;
+    SdirDirSortRunCount = 0;
     SdirDirCollectionLongest = 0;
     SdirDirCollectionTotalNameLength = 0;
     SdirWriteStringLinesDisplayed = 0;
@@ -1643,7 +1974,7 @@ ENTRYPOINT(
 restore_and_exit:
 
     if (Opts != NULL) {
-        SdirSetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), Opts->PreviousAttributes);
+        SdirSetConsoleTextAttribute(Opts->PreviousAttributes);
     }
     SdirAppCleanup();
 
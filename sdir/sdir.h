@@ -115,7 +115,7 @@ typedef DWORD (* SDIR_COMPARE_FN)(PYORI_FILE_INFO, PYORI_FILE_INFO);
  Specifies a pointer to a function which can collect file information from
  the disk or file system for some particular piece of data.
  */
-typedef BOOL (* SDIR_COLLECT_FN)(PYORI_FILE_INFO, PWIN32_FIND_DATA, PYORI_STRING);
+typedef BOOL (* SDIR_COLLECT_FN)(PYORI_FILE_INFO, PWIN32_FIND_DATA, PYORI_STRING, PYORI_LIB_FILE_COLLECT_CONTEXT);
 
 /**
  Specifies a pointer to a function which can generate in memory file
@@ -662,6 +662,12 @@ typedef struct _SDIR_GLOBAL {
      which files to hide.
      */
     YORI_LIB_FILE_FILTER FileHideCriteria;
+
+    /**
+     The access to each file needed by the features being collected, so
+     that each file can be opened once for all of them.
+     */
+    DWORD CollectAccess;
 } SDIR_GLOBAL, *PSDIR_GLOBAL;
 
 extern SDIR_GLOBAL SdirGlobal;
@@ -672,7 +678,9 @@ extern const SDIR_OPT SdirOptions[];
 extern const SDIR_EXEC SdirExec[];
 extern PYORI_FILE_INFO SdirDirCollection;
 extern PYORI_FILE_INFO * SdirDirSorted;
+extern PYORI_FILE_INFO * SdirDirSortScratch;
 extern DWORD SdirWriteStringLinesDisplayed;
+extern YORI_LIB_OUTPUT_BUFFER SdirOutputBuffer;
 
 //
 //  Functions from display.c
@@ -680,14 +688,12 @@ extern DWORD SdirWriteStringLinesDisplayed;
 
 BOOL
 SdirWriteRawStringToOutputDevice(
-    __in HANDLE hConsole,
     __in LPCTSTR OutputString,
     __in DWORD Length
     );
 
 BOOL
 SdirSetConsoleTextAttribute(
-    __in HANDLE hConsole,
     __in YORILIB_COLOR_ATTRIBUTES Attribute
     );
 
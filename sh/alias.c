@@ -53,6 +53,13 @@ typedef struct _YORI_ALIAS {
      */
     YORI_STRING Value;
 
+    /**
+     The value of the alias, parsed into literal text and references to
+     arguments when the alias is defined so that it can be expanded without
+     rescanning the value.
+     */
+    YORI_LIB_FORMAT_TEMPLATE ValueTemplate;
+
     /**
      TRUE if the alias is defined internally by Yori; FALSE if it is defined
      by the user.  Internal aliases are not enumerated by default.
@@ -60,6 +67,30 @@ typedef struct _YORI_ALIAS {
     BOOL Internal;
 } YORI_ALIAS, *PYORI_ALIAS;
 
+/**
+ An alias name and value found within a set of NULL terminated alias strings,
+ used to index those strings by name when comparing two sets.
+ */
+typedef struct _YORI_SH_ALIAS_STRING {
+
+    /**
+     Hash link for efficient lookup of the alias by name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The name of the alias.  This refers to the alias strings and is not
+     referenced.
+     */
+    YORI_STRING Alias;
+
+    /**
+     The value of the alias.  This refers to the alias strings and is not
+     referenced.
+     */
+    YORI_STRING Value;
+} YORI_SH_ALIAS_STRING, *PYORI_SH_ALIAS_STRING;
+
 /**
  List of aliases currently registered with Yori.
  */
@@ -82,6 +113,29 @@ PYORI_HASH_TABLE YoriShAliasesHash;
  */
 #define ALIAS_IMPORT_APP_NAME _T("CMD.EXE")
 
+/**
+ The variable identifier used for an alias argument reference to all
+ arguments, specified as $*$.  Other references are identified by the index
+ of the argument.
+ */
+#define YORI_SH_ALIAS_ALL_ARGUMENTS ((DWORD)-1)
+
+/**
+ Free an alias which has been removed from the list and hash table.
+
+ @param Alias The alias to free.
+ */
+VOID
+YoriShFreeAlias(
+    __in PYORI_ALIAS Alias
+    )
+{
+    YoriLibFreeFormatTemplate(&Alias->ValueTemplate);
+    YoriLibFreeStringContents(&Alias->Alias);
+    YoriLibFreeStringContents(&Alias->Value);
+    YoriLibDereference(Alias);
+}
+
 /**
  Delete an existing shell alias.
 
@@ -114,12 +168,36 @@ YoriShDeleteAlias(
         DllKernel32.pAddConsoleAliasW(ExistingAlias->Alias.StartOfString, NULL, ALIAS_APP_NAME);
     }
     YoriLibRemoveListItem(&ExistingAlias->ListEntry);
-    YoriLibFreeStringContents(&ExistingAlias->Alias);
-    YoriLibFreeStringContents(&ExistingAlias->Value);
-    YoriLibDereference(ExistingAlias);
+    YoriShFreeAlias(ExistingAlias);
     return TRUE;
 }
 
+/**
+ Resolve an argument reference within an alias value into an identifier
+ when the alias is defined.
+
+ @param VariableName The name of the argument reference, without the
+        surrounding dollar signs.
+
+ @param Context Unused.
+
+ @return The identifier of the argument reference.  This is
+         YORI_SH_ALIAS_ALL_ARGUMENTS for $*$, or the index of the argument.
+ */
+DWORD
+YoriShResolveAliasVariable(
+    __in PYORI_STRING VariableName,
+    __in PVOID Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (VariableName->LengthInChars == 1 && VariableName->StartOfString[0] == '*') {
+        return YORI_SH_ALIAS_ALL_ARGUMENTS;
+    }
+
+    return YoriLibDecimalStringToInt(VariableName);
+}
 
 /**
  Add a new, or replace an existing, shell alias.
@@ -142,22 +220,33 @@ YoriShAddAlias(
     )
 {
     PYORI_ALIAS NewAlias;
+    PYORI_ALIAS ExistingAlias;
+    PYORI_HASH_ENTRY HashEntry;
     DWORD AliasNameLengthInChars;
     DWORD ValueNameLengthInChars;
 
     if (YoriShAliasesHash != NULL) {
-        if (Internal) {
-            PYORI_HASH_ENTRY HashEntry;
-            PYORI_ALIAS ExistingAlias;
-            HashEntry = YoriLibHashLookupByKey(YoriShAliasesHash, Alias);
-            if (HashEntry != NULL) {
-                ExistingAlias = HashEntry->Context;
-                if (!ExistingAlias->Internal) {
-                    return FALSE;
-                }
+        HashEntry = YoriLibHashLookupByKey(YoriShAliasesHash, Alias);
+        if (HashEntry != NULL) {
+            ExistingAlias = HashEntry->Context;
+            if (Internal && !ExistingAlias->Internal) {
+                return FALSE;
             }
+
+            //
+            //  If the alias is already defined with this value, there's
+            //  nothing to do.  This happens when aliases are imported
+            //  again from the console.
+            //
+
+            if (ExistingAlias->Internal == Internal &&
+                YoriLibCompareString(&ExistingAlias->Alias, Alias) == 0 &&
+                YoriLibCompareString(&ExistingAlias->Value, Value) == 0) {
+
+                return TRUE;
+            }
+            YoriShDeleteAlias(Alias);
         }
-        YoriShDeleteAlias(Alias);
     } else {
         YoriLibInitializeListHead(&YoriShAliasesList);
         YoriShAliasesHash = YoriLibAllocateHashTable(250);
@@ -192,13 +281,20 @@ YoriShAddAlias(
     NewAlias->Alias.StartOfString[AliasNameLengthInChars] = '\0';
     NewAlias->Value.StartOfString[ValueNameLengthInChars] = '\0';
 
+    if (!YoriLibCompileFormatTemplate(&NewAlias->ValueTemplate, &NewAlias->Value, '$', TRUE, YoriShResolveAliasVariable, NULL)) {
+        YoriLibFreeStringContents(&NewAlias->Alias);
+        YoriLibFreeStringContents(&NewAlias->Value);
+        YoriLibDereference(NewAlias);
+        return FALSE;
+    }
+
     if (!Internal && DllKernel32.pAddConsoleAliasW) {
         DllKernel32.pAddConsoleAliasW(NewAlias->Alias.StartOfString, NewAlias->Value.StartOfString, ALIAS_APP_NAME);
     }
 
     YoriLibAppendList(&YoriShAliasesList, &NewAlias->ListEntry);
     YoriLibHashInsertByKey(YoriShAliasesHash, &NewAlias->Alias, NewAlias, &NewAlias->HashEntry);
-    
+
     return TRUE;
 }
 
@@ -207,9 +303,12 @@ YoriShAddAlias(
 
  @param OutputString The buffer to output the result of variable expansion to.
 
+ @param VariableId The identifier of the argument reference, as returned from
+        @ref YoriShResolveAliasVariable .
+
  @param VariableName The name of the variable that requires expansion.
 
- @param CmdContext Pointer to the original CmdContext without the alias
+ @param Context Pointer to the original CmdContext without the alias
         present.
 
  @return The number of characters populated or the number of characters
@@ -218,14 +317,19 @@ YoriShAddAlias(
 DWORD
 YoriShExpandAliasHelper(
     __inout PYORI_STRING OutputString,
+    __in DWORD VariableId,
     __in PYORI_STRING VariableName,
-    __in PYORI_SH_CMD_CONTEXT CmdContext
+    __in PVOID Context
     )
 {
-    DWORD CmdIndex;
+    PYORI_SH_CMD_CONTEXT CmdContext;
     DWORD ArgLength;
 
-    if (VariableName->LengthInChars == 1 && VariableName->StartOfString[0] == '*') {
+    UNREFERENCED_PARAMETER(VariableName);
+
+    CmdContext = (PYORI_SH_CMD_CONTEXT)Context;
+
+    if (VariableId == YORI_SH_ALIAS_ALL_ARGUMENTS) {
         LPTSTR CmdLine;
         YORI_SH_CMD_CONTEXT ArgContext;
 
@@ -246,14 +350,11 @@ YoriShExpandAliasHelper(
             YoriLibDereference(CmdLine);
             return ArgLength;
         }
-    } else {
-        CmdIndex = YoriLibDecimalStringToInt(VariableName);
-        if (CmdIndex > 0 && CmdContext->ArgC > CmdIndex) {
-            if (CmdContext->ArgV[CmdIndex].LengthInChars < OutputString->LengthAllocated) {
-                YoriLibYPrintf(OutputString, _T("%y"), &CmdContext->ArgV[CmdIndex]);
-            }
-            return CmdContext->ArgV[CmdIndex].LengthInChars;
+    } else if (VariableId > 0 && CmdContext->ArgC > VariableId) {
+        if (CmdContext->ArgV[VariableId].LengthInChars < OutputString->LengthAllocated) {
+            YoriLibYPrintf(OutputString, _T("%y"), &CmdContext->ArgV[VariableId]);
         }
+        return CmdContext->ArgV[VariableId].LengthInChars;
     }
     return 0;
 }
@@ -293,7 +394,9 @@ YoriShExpandAlias(
     ExistingAlias = HashEntry->Context;
 
     YoriLibInitEmptyString(&NewCmdString);
-    YoriLibExpandCommandVariables(&ExistingAlias->Value, '$', TRUE, YoriShExpandAliasHelper, CmdContext, &NewCmdString);
+    if (!YoriLibExpandFormatTemplate(&ExistingAlias->ValueTemplate, YoriShExpandAliasHelper, CmdContext, &NewCmdString)) {
+        return FALSE;
+    }
     if (NewCmdString.LengthInChars > 0) {
         if (YoriShParseCmdlineToCmdContext(&NewCmdString, 0, &NewCmdContext) && NewCmdContext.ArgC > 0) {
             YoriShFreeCmdContext(CmdContext);
@@ -369,9 +472,7 @@ YoriShClearAllAliases()
         ListEntry = YoriLibGetNextListEntry(&YoriShAliasesList, ListEntry);
         YoriLibHashRemoveByEntry(&Alias->HashEntry);
         YoriLibRemoveListItem(&Alias->ListEntry);
-        YoriLibFreeStringContents(&Alias->Alias);
-        YoriLibFreeStringContents(&Alias->Value);
-        YoriLibDereference(Alias);
+        YoriShFreeAlias(Alias);
     }
 
     YoriLibFreeEmptyHashTable(YoriShAliasesHash);
@@ -625,56 +726,55 @@ YoriShGetSystemAliasStrings(
 }
 
 /**
- Find an alias with a specified name within a list of NULL terminated strings.
+ Return the next alias within a list of NULL terminated strings.
+
+ @param AliasStrings The list of strings to navigate through.
 
- @param AliasStrings The list of strings to search through.
+ @param CharsConsumed On input, the offset within the list of strings to
+        start searching from.  On output, updated to point beyond the
+        returned alias.
 
- @param AliasName The name of the alias to find.
+ @param AliasName On successful completion, updated to point to the name of
+        the alias.  Note this value is not referenced.
 
- @param AliasValue On successful completion, this is updated to point to the
-        value of the found match.  Note this value is not referenced.
+ @param AliasValue On successful completion, updated to point to the NULL
+        terminated value of the alias.  Note this value is not referenced.
 
- @return TRUE to indicate a match was found, FALSE to indicate it was not.
+ @return TRUE to indicate an alias was found, FALSE to indicate the end of
+         the list was reached.
  */
 __success(return)
 BOOL
-YoriShFindAliasWithinStrings(
+YoriShGetNextAliasWithinStrings(
     __in PYORI_STRING AliasStrings,
-    __in PYORI_STRING AliasName,
+    __inout PDWORD CharsConsumed,
+    __out PYORI_STRING AliasName,
     __out PYORI_STRING AliasValue
     )
 {
-    DWORD CharsConsumed;
-    YORI_STRING FoundAliasName;
-    YORI_STRING FoundAliasValue;
+    YoriLibInitEmptyString(AliasName);
+    YoriLibInitEmptyString(AliasValue);
 
-    YoriLibInitEmptyString(&FoundAliasName);
-    YoriLibInitEmptyString(&FoundAliasValue);
-
-    CharsConsumed = 0;
-    while (CharsConsumed < AliasStrings->LengthInChars && CharsConsumed < AliasStrings->LengthAllocated) {
-        FoundAliasName.StartOfString = &AliasStrings->StartOfString[CharsConsumed];
-        FoundAliasName.LengthInChars = 0;
-        while (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '\0' &&
-               FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '=') {
+    while (*CharsConsumed < AliasStrings->LengthInChars && *CharsConsumed < AliasStrings->LengthAllocated) {
+        AliasName->StartOfString = &AliasStrings->StartOfString[*CharsConsumed];
+        AliasName->LengthInChars = 0;
+        while (AliasName->StartOfString[AliasName->LengthInChars] != '\0' &&
+               AliasName->StartOfString[AliasName->LengthInChars] != '=') {
 
-            FoundAliasName.LengthInChars++;
+            AliasName->LengthInChars++;
         }
 
-        CharsConsumed += FoundAliasName.LengthInChars + 1;
+        *CharsConsumed += AliasName->LengthInChars + 1;
 
-        if (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] == '=') {
-            FoundAliasValue.LengthInChars = 0;
-            FoundAliasValue.StartOfString = &FoundAliasName.StartOfString[FoundAliasName.LengthInChars + 1];
-            while (FoundAliasValue.StartOfString[FoundAliasValue.LengthInChars] != '\0') {
-                FoundAliasValue.LengthInChars++;
+        if (AliasName->StartOfString[AliasName->LengthInChars] == '=') {
+            AliasValue->LengthInChars = 0;
+            AliasValue->StartOfString = &AliasName->StartOfString[AliasName->LengthInChars + 1];
+            while (AliasValue->StartOfString[AliasValue->LengthInChars] != '\0') {
+                AliasValue->LengthInChars++;
             }
+            AliasValue->LengthAllocated = AliasValue->LengthInChars + 1;
 
-            CharsConsumed += FoundAliasValue.LengthInChars + 1;
-        }
-
-        if (YoriLibCompareStringInsensitive(AliasName, &FoundAliasName) == 0) {
-            memcpy(AliasValue, &FoundAliasValue, sizeof(YORI_STRING));
+            *CharsConsumed += AliasValue->LengthInChars + 1;
             return TRUE;
         }
     }
@@ -683,9 +783,10 @@ YoriShFindAliasWithinStrings(
 }
 
 /**
- Incorporate changes into the current set of aliases.  This function scans
- two NULL terminated lists of aliases to find changes in the new set over
- the old set and incorporate those into the current environment.
+ Incorporate changes into the current set of aliases.  This function indexes
+ the old list of NULL terminated aliases by name, then scans the new list
+ once to find changes in the new set over the old set and incorporate those
+ into the current environment.
 
  @param MergeFromCmd If TRUE, these alias lists are treated as CMD format
         and need to be migrated in order to incorporate them into Yori.
@@ -705,94 +806,99 @@ YoriShMergeChangedAliasStrings(
     )
 {
     DWORD CharsConsumed;
+    DWORD OldAliasCount;
+    DWORD Index;
     YORI_STRING FoundAliasName;
     YORI_STRING FoundAliasValue;
-    YORI_STRING OldAliasValue;
-
-    YoriLibInitEmptyString(&FoundAliasName);
-    YoriLibInitEmptyString(&FoundAliasValue);
+    PYORI_HASH_TABLE OldAliasHash;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_ALIAS_STRING OldAliases;
+    PYORI_SH_ALIAS_STRING OldAlias;
 
     //
-    //  Navigate through the new alias strings.
+    //  Count the old alias strings, and index them by name.
     //
 
+    OldAliasCount = 0;
     CharsConsumed = 0;
-    while (CharsConsumed < NewStrings->LengthInChars && CharsConsumed < NewStrings->LengthAllocated) {
-        FoundAliasName.StartOfString = &NewStrings->StartOfString[CharsConsumed];
-        FoundAliasName.LengthInChars = 0;
-        while (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '\0' &&
-               FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '=') {
-
-            FoundAliasName.LengthInChars++;
-        }
+    while (YoriShGetNextAliasWithinStrings(OldStrings, &CharsConsumed, &FoundAliasName, &FoundAliasValue)) {
+        OldAliasCount++;
+    }
 
-        CharsConsumed += FoundAliasName.LengthInChars + 1;
+    OldAliasHash = NULL;
+    OldAliases = NULL;
 
-        if (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] == '=') {
-            FoundAliasValue.LengthInChars = 0;
-            FoundAliasValue.StartOfString = &FoundAliasName.StartOfString[FoundAliasName.LengthInChars + 1];
-            while (FoundAliasValue.StartOfString[FoundAliasValue.LengthInChars] != '\0') {
-                FoundAliasValue.LengthInChars++;
-            }
+    if (OldAliasCount > 0) {
+        OldAliasHash = YoriLibAllocateHashTable(250);
+        if (OldAliasHash == NULL) {
+            return FALSE;
+        }
 
-            CharsConsumed += FoundAliasValue.LengthInChars + 1;
+        OldAliases = YoriLibMalloc(OldAliasCount * sizeof(YORI_SH_ALIAS_STRING));
+        if (OldAliases == NULL) {
+            YoriLibFreeEmptyHashTable(OldAliasHash);
+            return FALSE;
+        }
 
-            //
-            //  Now we've found something, check its state in the old
-            //  alias strings.  If it's not there or changed, add it now.
-            //
+        Index = 0;
+        CharsConsumed = 0;
+        while (Index < OldAliasCount &&
+               YoriShGetNextAliasWithinStrings(OldStrings, &CharsConsumed, &OldAliases[Index].Alias, &OldAliases[Index].Value)) {
 
-            if (!YoriShFindAliasWithinStrings(OldStrings, &FoundAliasName, &OldAliasValue) ||
-                YoriLibCompareString(&FoundAliasValue, &OldAliasValue) != 0) {
-                if (MergeFromCmd) {
-                    LPTSTR MigratedAlias;
-                    YORI_STRING YsMigratedAlias;
-                    if (YoriShImportAliasValue(FoundAliasValue.StartOfString, &MigratedAlias)) {
-                        YoriLibConstantString(&YsMigratedAlias, MigratedAlias);
-                        YoriShAddAlias(&FoundAliasName, &YsMigratedAlias, FALSE);
-                        YoriLibDereference(MigratedAlias);
-                    }
-                } else {
-                    YoriShAddAlias(&FoundAliasName, &FoundAliasValue, FALSE);
-                }
-            }
+            YoriLibHashInsertByKey(OldAliasHash, &OldAliases[Index].Alias, &OldAliases[Index], &OldAliases[Index].HashEntry);
+            Index++;
         }
     }
 
     //
-    //  Navigate through the old alias strings.
+    //  Navigate through the new alias strings.  Check the state of each in
+    //  the old alias strings.  If it's not there or changed, add it now.
+    //  Anything found is removed from the index, so the index is left with
+    //  the aliases which are no longer present.
     //
 
     CharsConsumed = 0;
-    while (CharsConsumed < OldStrings->LengthInChars && CharsConsumed < OldStrings->LengthAllocated) {
-        FoundAliasName.StartOfString = &OldStrings->StartOfString[CharsConsumed];
-        FoundAliasName.LengthInChars = 0;
-        while (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '\0' &&
-               FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '=') {
-
-            FoundAliasName.LengthInChars++;
+    while (YoriShGetNextAliasWithinStrings(NewStrings, &CharsConsumed, &FoundAliasName, &FoundAliasValue)) {
+        OldAlias = NULL;
+        if (OldAliasHash != NULL) {
+            HashEntry = YoriLibHashLookupByKey(OldAliasHash, &FoundAliasName);
+            if (HashEntry != NULL) {
+                OldAlias = HashEntry->Context;
+                YoriLibHashRemoveByEntry(HashEntry);
+            }
         }
 
-        CharsConsumed += FoundAliasName.LengthInChars + 1;
-
-        if (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] == '=') {
-            FoundAliasValue.LengthInChars = 0;
-            FoundAliasValue.StartOfString = &FoundAliasName.StartOfString[FoundAliasName.LengthInChars + 1];
-            while (FoundAliasValue.StartOfString[FoundAliasValue.LengthInChars] != '\0') {
-                FoundAliasValue.LengthInChars++;
+        if (OldAlias == NULL ||
+            YoriLibCompareString(&FoundAliasValue, &OldAlias->Value) != 0) {
+            if (MergeFromCmd) {
+                LPTSTR MigratedAlias;
+                YORI_STRING YsMigratedAlias;
+                if (YoriShImportAliasValue(FoundAliasValue.StartOfString, &MigratedAlias)) {
+                    YoriLibConstantString(&YsMigratedAlias, MigratedAlias);
+                    YoriShAddAlias(&FoundAliasName, &YsMigratedAlias, FALSE);
+                    YoriLibDereference(MigratedAlias);
+                }
+            } else {
+                YoriShAddAlias(&FoundAliasName, &FoundAliasValue, FALSE);
             }
+        }
+    }
 
-            CharsConsumed += FoundAliasValue.LengthInChars + 1;
-
-            //
-            //  Now we've found something, check its state in the new
-            //  alias strings.  If it's not there, delete it.
-            //
+    //
+    //  Delete any alias that was in the old strings but not the new ones.
+    //
 
-            if (!YoriShFindAliasWithinStrings(NewStrings, &FoundAliasName, &OldAliasValue)) {
-                YoriShDeleteAlias(&FoundAliasName);
-            }
+    if (OldAliasHash != NULL) {
+        HashEntry = YoriLibHashGetNextEntry(OldAliasHash, NULL);
+        while (HashEntry != NULL) {
+            OldAlias = HashEntry->Context;
+            HashEntry = YoriLibHashGetNextEntry(OldAliasHash, HashEntry);
+            YoriLibHashRemoveByEntry(&OldAlias->HashEntry);
+            YoriShDeleteAlias(&OldAlias->Alias);
         }
+
+        YoriLibFreeEmptyHashTable(OldAliasHash);
+        YoriLibFree(OldAliases);
     }
 
     return FALSE;
@@ -800,7 +906,8 @@ YoriShMergeChangedAliasStrings(
 
 /**
  Load aliases from the console and incorporate those into the shell's internal
- alias system.  This allows aliases to be inherited across subshells.
+ alias system.  This allows aliases to be inherited across subshells.  Aliases
+ which are already defined with the same value are left unchanged.
 
  @param ImportFromCmd If TRUE, aliases are loaded for the CMD.EXE process and
         migrated to match Yori syntax.  If FALSE, aliases are loaded for the
@@ -815,39 +922,30 @@ YoriShLoadSystemAliases(
     )
 {
     YORI_STRING AliasBuffer;
-    LPTSTR ThisVar;
-    LPTSTR Value;
-    DWORD VarLen;
+    YORI_STRING AliasName;
+    YORI_STRING AliasValue;
+    YORI_STRING YsMigratedValue;
+    LPTSTR MigratedValue;
     DWORD CharsConsumed;
 
     if (!YoriShGetSystemAliasStrings(ImportFromCmd, &AliasBuffer)) {
         return FALSE;
     }
 
-    ThisVar = AliasBuffer.StartOfString;
     CharsConsumed = 0;
-    while (CharsConsumed < AliasBuffer.LengthInChars && CharsConsumed < AliasBuffer.LengthAllocated) {
-        VarLen = _tcslen(ThisVar);
-        CharsConsumed += VarLen;
-        Value = _tcschr(ThisVar, '=');
-        if (Value) {
-            *Value = '\0';
-            Value++;
-            if (ImportFromCmd) {
-                LPTSTR MigratedValue = NULL;
-
-                if (YoriShImportAliasValue(Value, &MigratedValue)) {
-                    YoriShAddAliasLiteral(ThisVar, MigratedValue, FALSE);
-                    YoriLibDereference(MigratedValue);
-                }
-
-            } else {
-                YoriShAddAliasLiteral(ThisVar, Value, FALSE);
+    while (YoriShGetNextAliasWithinStrings(&AliasBuffer, &CharsConsumed, &AliasName, &AliasValue)) {
+        if (ImportFromCmd) {
+            MigratedValue = NULL;
+
+            if (YoriShImportAliasValue(AliasValue.StartOfString, &MigratedValue)) {
+                YoriLibConstantString(&YsMigratedValue, MigratedValue);
+                YoriShAddAlias(&AliasName, &YsMigratedValue, FALSE);
+                YoriLibDereference(MigratedValue);
             }
+
+        } else {
+            YoriShAddAlias(&AliasName, &AliasValue, FALSE);
         }
-        ThisVar += VarLen;
-        ThisVar++;
-        CharsConsumed++;
     }
 
     YoriLibFreeStringContents(&AliasBuffer);
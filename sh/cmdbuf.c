@@ -26,6 +26,62 @@
 
 #include "yori.h"
 
+/**
+ The size of the first chunk allocated for a buffer.  Most processes generate
+ very little output, so this is kept small.
+ */
+#define YORI_SH_PROCESS_BUFFER_INITIAL_CHUNK (1024)
+
+/**
+ The largest chunk allocated for a buffer.  Chunks double in size from
+ @ref YORI_SH_PROCESS_BUFFER_INITIAL_CHUNK until they reach this size.
+ */
+#define YORI_SH_PROCESS_BUFFER_MAX_CHUNK (64 * 1024)
+
+/**
+ The largest amount of data written to a pipe in a single operation.
+ */
+#define YORI_SH_PROCESS_BUFFER_WRITE_SIZE (64 * 1024)
+
+/**
+ The default amount of data to retain in memory for a single stream before
+ older data is moved to a temporary file.  This can be overridden with the
+ YORIJOBBUFFERLIMIT environment variable.
+ */
+#define YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT (32 * 1024 * 1024)
+
+/**
+ A single contiguous region of data within a process buffer.
+ */
+typedef struct _YORI_SH_PROCESS_BUFFER_CHUNK {
+
+    /**
+     The link between chunks in the buffer, in stream order.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The offset within the stream of the first byte in this chunk.
+     */
+    DWORDLONG StreamOffset;
+
+    /**
+     The number of bytes allocated in this chunk.
+     */
+    DWORD BytesAllocated;
+
+    /**
+     The number of bytes populated with data in this chunk.
+     */
+    DWORD BytesPopulated;
+
+    /**
+     The data in this chunk.  This is allocated immediately following the
+     structure.
+     */
+    PUCHAR Data;
+
+} YORI_SH_PROCESS_BUFFER_CHUNK, *PYORI_SH_PROCESS_BUFFER_CHUNK;
 
 /**
  A buffer for a single data stream.  A process may have a different buffered
@@ -34,14 +90,46 @@
 typedef struct _YORI_SH_PROCESS_BUFFER {
 
     /**
-     The number of bytes currently allocated to this buffer.
+     The list of chunks containing data held in memory, in stream order.
+     Growing the buffer allocates a new chunk, so existing data is never
+     copied.
      */
-    DWORD BytesAllocated;
+    YORI_LIST_ENTRY ChunkList;
 
     /**
-     The number of bytes populated with data in this buffer.
+     The number of bytes populated with data in this buffer, including any
+     data that has been moved to the spill file.
      */
-    DWORD BytesPopulated;
+    DWORDLONG BytesPopulated;
+
+    /**
+     The number of bytes held in memory in ChunkList.
+     */
+    DWORDLONG BytesInMemory;
+
+    /**
+     The number of bytes held in memory before older chunks are moved to the
+     spill file.
+     */
+    DWORDLONG MemoryLimit;
+
+    /**
+     The number of bytes at the beginning of the stream which have been moved
+     to the spill file.  The spill file contains exactly this range.
+     */
+    DWORDLONG BytesSpilled;
+
+    /**
+     A handle to a temporary file containing the oldest data in the stream,
+     or NULL if no data has been spilled.
+     */
+    HANDLE hSpillFile;
+
+    /**
+     Set to TRUE if a spill file could not be created or written, in which
+     case data is retained in memory.
+     */
+    BOOL SpillFailed;
 
     /**
      A handle to the buffer processing thread.
@@ -67,12 +155,7 @@ typedef struct _YORI_SH_PROCESS_BUFFER {
     /**
      The number of bytes which have been sent to hMirror.
      */
-    DWORD BytesSent;
-
-    /**
-     The data buffer.
-     */
-    PCHAR Buffer;
+    DWORDLONG BytesSent;
 
 } YORI_SH_PROCESS_BUFFER, *PYORI_SH_PROCESS_BUFFER;
 
@@ -137,8 +220,20 @@ YoriShFreeProcessBuffer(
     __in PYORI_SH_PROCESS_BUFFER ThisBuffer
     )
 {
-    if (ThisBuffer->Buffer != NULL) {
-        YoriLibFree(ThisBuffer->Buffer);
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+
+    if (ThisBuffer->ChunkList.Next != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+        while (ListEntry != NULL) {
+            Chunk = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, ListEntry);
+            YoriLibRemoveListItem(&Chunk->ListEntry);
+            YoriLibFree(Chunk);
+        }
+    }
+    if (ThisBuffer->hSpillFile != NULL) {
+        CloseHandle(ThisBuffer->hSpillFile);
     }
     if (ThisBuffer->hMirror != NULL) {
         CloseHandle(ThisBuffer->hMirror);
@@ -171,48 +266,329 @@ YoriShFreeProcessBuffers(
 }
 
 /**
- Code running on a dedicated thread for the duration of an outstanding process
- to populate data into its pipe.
+ Return a chunk with space available to append data into, allocating a new
+ chunk if the final chunk is full.  This is only called by the thread
+ populating the buffer.
 
- @param Param A pointer to the process buffer set.
+ @param ThisBuffer Pointer to the buffer to append data to.
 
- @return Thread return code, which is ignored for this thread.
+ @return Pointer to a chunk with space available, or NULL on allocation
+         failure.
  */
-DWORD WINAPI
-YoriShCmdBufferPumpToNextProcess(
-    __in LPVOID Param
+PYORI_SH_PROCESS_BUFFER_CHUNK
+YoriShGetProcessBufferChunkForAppend(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer
     )
 {
-    PYORI_SH_PROCESS_BUFFER ThisBuffer = (PYORI_SH_PROCESS_BUFFER)Param;
-    DWORD BytesSent = 0;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+    DWORD BytesToAllocate;
+
+    BytesToAllocate = YORI_SH_PROCESS_BUFFER_INITIAL_CHUNK;
+    ListEntry = YoriLibGetPreviousListEntry(&ThisBuffer->ChunkList, NULL);
+    if (ListEntry != NULL) {
+        Chunk = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+        if (Chunk->BytesPopulated < Chunk->BytesAllocated) {
+            return Chunk;
+        }
+        BytesToAllocate = Chunk->BytesAllocated * 2;
+        if (BytesToAllocate > YORI_SH_PROCESS_BUFFER_MAX_CHUNK) {
+            BytesToAllocate = YORI_SH_PROCESS_BUFFER_MAX_CHUNK;
+        }
+    }
+
+    Chunk = YoriLibMalloc(sizeof(YORI_SH_PROCESS_BUFFER_CHUNK) + BytesToAllocate);
+    if (Chunk == NULL) {
+        return NULL;
+    }
+
+    Chunk->Data = (PUCHAR)(Chunk + 1);
+    Chunk->BytesAllocated = BytesToAllocate;
+    Chunk->BytesPopulated = 0;
+
+    AcquireMutex(ThisBuffer->Mutex);
+    Chunk->StreamOffset = ThisBuffer->BytesPopulated;
+    YoriLibAppendList(&ThisBuffer->ChunkList, &Chunk->ListEntry);
+    ReleaseMutex(ThisBuffer->Mutex);
+
+    return Chunk;
+}
+
+/**
+ Create a temporary file to hold data that no longer fits in memory.  The
+ file is deleted when its handle is closed.
+
+ @return Handle to the file, or NULL on failure.
+ */
+HANDLE
+YoriShCreateProcessBufferSpillFile(VOID)
+{
+    TCHAR TempPath[MAX_PATH];
+    TCHAR TempName[MAX_PATH];
+    HANDLE hFile;
+
+    if (GetTempPath(sizeof(TempPath)/sizeof(TempPath[0]), TempPath) == 0) {
+        return NULL;
+    }
+
+    if (GetTempFileName(TempPath, _T("YSH"), 0, TempName) == 0) {
+        return NULL;
+    }
+
+    hFile = CreateFile(TempName,
+                       FILE_WRITE_DATA|FILE_READ_DATA,
+                       0,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                       NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        DeleteFile(TempName);
+        return NULL;
+    }
+
+    return hFile;
+}
+
+/**
+ Move the oldest chunks of a buffer to its spill file until the amount of
+ data held in memory is within the buffer's limit.  The chunk currently
+ being populated is never moved.  This is called with the buffer's mutex
+ held.
+
+ @param ThisBuffer Pointer to the buffer to reduce the memory usage of.
+ */
+VOID
+YoriShSpillProcessBuffer(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+    LARGE_INTEGER FileOffset;
     DWORD BytesWritten;
-    DWORD BytesToWrite;
 
-    while (TRUE) {
+    while (ThisBuffer->BytesInMemory > ThisBuffer->MemoryLimit &&
+           !ThisBuffer->SpillFailed) {
 
-        BytesToWrite = 4096;
-        AcquireMutex(ThisBuffer->Mutex);
-        if (BytesSent + BytesToWrite > ThisBuffer->BytesPopulated) {
-            BytesToWrite = ThisBuffer->BytesPopulated - BytesSent;
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+        if (ListEntry == NULL ||
+            ListEntry == YoriLibGetPreviousListEntry(&ThisBuffer->ChunkList, NULL)) {
+            break;
         }
 
-        if (WriteFile(ThisBuffer->hSource,
-                      YoriLibAddToPointer(ThisBuffer->Buffer, BytesSent),
-                      BytesToWrite,
-                      &BytesWritten,
-                      NULL)) {
+        Chunk = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+        ASSERT(Chunk->StreamOffset == ThisBuffer->BytesSpilled);
+
+        if (ThisBuffer->hSpillFile == NULL) {
+            ThisBuffer->hSpillFile = YoriShCreateProcessBufferSpillFile();
+            if (ThisBuffer->hSpillFile == NULL) {
+                ThisBuffer->SpillFailed = TRUE;
+                break;
+            }
+        }
+
+        FileOffset.QuadPart = ThisBuffer->BytesSpilled;
+        if (SetFilePointer(ThisBuffer->hSpillFile, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+            GetLastError() != NO_ERROR) {
+
+            ThisBuffer->SpillFailed = TRUE;
+            break;
+        }
+
+        if (!WriteFile(ThisBuffer->hSpillFile, Chunk->Data, Chunk->BytesPopulated, &BytesWritten, NULL) ||
+            BytesWritten != Chunk->BytesPopulated) {
 
-            BytesSent += BytesWritten;
-        } else {
-            ReleaseMutex(ThisBuffer->Mutex);
+            ThisBuffer->SpillFailed = TRUE;
             break;
         }
+
+        ThisBuffer->BytesSpilled += Chunk->BytesPopulated;
+        ThisBuffer->BytesInMemory -= Chunk->BytesPopulated;
+        YoriLibRemoveListItem(&Chunk->ListEntry);
+        YoriLibFree(Chunk);
+    }
+}
+
+/**
+ Copy data from a buffer, whether it is held in memory or has been moved to
+ the spill file.  This is called with the buffer's mutex held.
+
+ @param ThisBuffer Pointer to the buffer to copy data from.
+
+ @param StreamOffset The offset within the stream to copy data from.
+
+ @param Data Pointer to a caller allocated block of memory to copy data into.
+
+ @param BytesToCopy The maximum number of bytes to copy.
+
+ @return The number of bytes copied.  This may be less than BytesToCopy if
+         the stream does not contain that much data beyond StreamOffset, and
+         is zero if an error occurs.
+ */
+DWORD
+YoriShCopyFromProcessBuffer(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer,
+    __in DWORDLONG StreamOffset,
+    __out_ecount(BytesToCopy) PUCHAR Data,
+    __in DWORD BytesToCopy
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+    LARGE_INTEGER FileOffset;
+    DWORD BytesCopied;
+    DWORD BytesThisPass;
+    DWORD OffsetInChunk;
+
+    BytesCopied = 0;
+
+    //
+    //  Copy anything that has been moved to the spill file first.
+    //
+
+    if (StreamOffset < ThisBuffer->BytesSpilled) {
+        BytesThisPass = BytesToCopy;
+        if (StreamOffset + BytesThisPass > ThisBuffer->BytesSpilled) {
+            BytesThisPass = (DWORD)(ThisBuffer->BytesSpilled - StreamOffset);
+        }
+
+        FileOffset.QuadPart = StreamOffset;
+        if (SetFilePointer(ThisBuffer->hSpillFile, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+            GetLastError() != NO_ERROR) {
+
+            return 0;
+        }
+
+        if (!ReadFile(ThisBuffer->hSpillFile, Data, BytesThisPass, &BytesThisPass, NULL) ||
+            BytesThisPass == 0) {
+
+            return 0;
+        }
+
+        BytesCopied = BytesThisPass;
+        StreamOffset += BytesThisPass;
+        if (BytesCopied == BytesToCopy || StreamOffset < ThisBuffer->BytesSpilled) {
+            return BytesCopied;
+        }
+    }
+
+    //
+    //  Then copy from any chunks in memory.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+    while (ListEntry != NULL && BytesCopied < BytesToCopy) {
+        Chunk = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, ListEntry);
+
+        if (StreamOffset >= Chunk->StreamOffset + Chunk->BytesPopulated) {
+            continue;
+        }
+
+        OffsetInChunk = (DWORD)(StreamOffset - Chunk->StreamOffset);
+        BytesThisPass = Chunk->BytesPopulated - OffsetInChunk;
+        if (BytesThisPass > BytesToCopy - BytesCopied) {
+            BytesThisPass = BytesToCopy - BytesCopied;
+        }
+
+        memcpy(&Data[BytesCopied], &Chunk->Data[OffsetInChunk], BytesThisPass);
+        BytesCopied += BytesThisPass;
+        StreamOffset += BytesThisPass;
+    }
+
+    return BytesCopied;
+}
+
+/**
+ Send data from a buffer to a pipe, starting from a specified offset and
+ continuing until all data currently in the buffer has been sent.  Data is
+ copied out of the buffer with the mutex held but written to the pipe with
+ the mutex released, so a slow reader does not prevent the buffer from
+ being populated.
+
+ @param ThisBuffer Pointer to the buffer to send data from.
+
+ @param hTarget The pipe to write data to.
+
+ @param StagingBuffer Pointer to a block of memory of
+        @ref YORI_SH_PROCESS_BUFFER_WRITE_SIZE bytes used to hold data while
+        it is being written.
+
+ @param BytesSent On input, the offset within the stream to begin sending
+        from.  On output, updated to indicate the offset of the first byte
+        that has not been sent.  This may refer to a field of the buffer
+        which is examined by other threads, so it is only read or updated
+        with the buffer mutex held.
+
+ @return TRUE if all data has been sent, FALSE if the pipe could not be
+         written to.
+ */
+BOOL
+YoriShSendProcessBufferToHandle(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer,
+    __in HANDLE hTarget,
+    __in PUCHAR StagingBuffer,
+    __inout PDWORDLONG BytesSent
+    )
+{
+    DWORD BytesToWrite;
+    DWORD BytesWritten;
+    DWORD Offset;
+    BOOL Result;
+
+    Result = TRUE;
+    while (Result) {
+        AcquireMutex(ThisBuffer->Mutex);
+        BytesToWrite = 0;
+        if (*BytesSent < ThisBuffer->BytesPopulated) {
+            BytesToWrite = YoriShCopyFromProcessBuffer(ThisBuffer, *BytesSent, StagingBuffer, YORI_SH_PROCESS_BUFFER_WRITE_SIZE);
+        }
         ReleaseMutex(ThisBuffer->Mutex);
 
-        ASSERT(BytesSent <= ThisBuffer->BytesPopulated);
-        if (BytesSent >= ThisBuffer->BytesPopulated) {
+        if (BytesToWrite == 0) {
             break;
         }
+
+        Offset = 0;
+        while (Offset < BytesToWrite) {
+            if (!WriteFile(hTarget, &StagingBuffer[Offset], BytesToWrite - Offset, &BytesWritten, NULL)) {
+                Result = FALSE;
+                break;
+            }
+            Offset += BytesWritten;
+        }
+
+        AcquireMutex(ThisBuffer->Mutex);
+        *BytesSent += Offset;
+        ReleaseMutex(ThisBuffer->Mutex);
+    }
+
+    return Result;
+}
+
+/**
+ Code running on a dedicated thread for the duration of an outstanding process
+ to populate data into its pipe.
+
+ @param Param A pointer to the process buffer set.
+
+ @return Thread return code, which is ignored for this thread.
+ */
+DWORD WINAPI
+YoriShCmdBufferPumpToNextProcess(
+    __in LPVOID Param
+    )
+{
+    PYORI_SH_PROCESS_BUFFER ThisBuffer = (PYORI_SH_PROCESS_BUFFER)Param;
+    DWORDLONG BytesSent = 0;
+    PUCHAR StagingBuffer;
+
+    StagingBuffer = YoriLibMalloc(YORI_SH_PROCESS_BUFFER_WRITE_SIZE);
+    if (StagingBuffer != NULL) {
+        YoriShSendProcessBufferToHandle(ThisBuffer, ThisBuffer->hSource, StagingBuffer, &BytesSent);
+        YoriLibFree(StagingBuffer);
     }
 
     CloseHandle(ThisBuffer->hSource);
@@ -221,6 +597,40 @@ YoriShCmdBufferPumpToNextProcess(
     return 0;
 }
 
+/**
+ Code running on a dedicated thread to send the contents of a buffer whose
+ process has already completed to a pipe (to support 'fg' on a completed
+ job.)
+
+ @param Param A pointer to the process buffer.
+
+ @return Thread return code, which is ignored for this thread.
+ */
+DWORD WINAPI
+YoriShCmdBufferReplayToMirror(
+    __in LPVOID Param
+    )
+{
+    PYORI_SH_PROCESS_BUFFER ThisBuffer = (PYORI_SH_PROCESS_BUFFER)Param;
+    PUCHAR StagingBuffer;
+    HANDLE hTemp;
+
+    StagingBuffer = YoriLibMalloc(YORI_SH_PROCESS_BUFFER_WRITE_SIZE);
+    if (StagingBuffer != NULL) {
+        YoriShSendProcessBufferToHandle(ThisBuffer, ThisBuffer->hMirror, StagingBuffer, &ThisBuffer->BytesSent);
+        YoriLibFree(StagingBuffer);
+    }
+
+    AcquireMutex(ThisBuffer->Mutex);
+    hTemp = ThisBuffer->hMirror;
+    ThisBuffer->hMirror = NULL;
+    ThisBuffer->BytesSent = 0;
+    ReleaseMutex(ThisBuffer->Mutex);
+    CloseHandle(hTemp);
+
+    return 0;
+}
+
 
 /**
  Code running on a dedicated thread for the duration of an outstanding process
@@ -236,111 +646,139 @@ YoriShCmdBufferPump(
     )
 {
     PYORI_SH_PROCESS_BUFFER ThisBuffer = (PYORI_SH_PROCESS_BUFFER)Param;
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+    PUCHAR StagingBuffer;
     DWORD BytesRead;
+    HANDLE hMirror;
     HANDLE hTemp;
 
-    while (ThisBuffer->hSource != NULL) {
-
-        if (ReadFile(ThisBuffer->hSource,
-                     YoriLibAddToPointer(ThisBuffer->Buffer, ThisBuffer->BytesPopulated),
-                     ThisBuffer->BytesAllocated - ThisBuffer->BytesPopulated,
-                     &BytesRead,
-                     NULL)) {
+    StagingBuffer = YoriLibMalloc(YORI_SH_PROCESS_BUFFER_WRITE_SIZE);
 
-            AcquireMutex(ThisBuffer->Mutex);
-
-            if (BytesRead == 0) {
-                break;
-            }
+    while (StagingBuffer != NULL) {
 
-            ThisBuffer->BytesPopulated += BytesRead;
-            ASSERT(ThisBuffer->BytesPopulated <= ThisBuffer->BytesAllocated);
-            if (ThisBuffer->BytesPopulated >= ThisBuffer->BytesAllocated) {
-                DWORD NewBytesAllocated;
-                PCHAR NewBuffer;
-
-                if (ThisBuffer->BytesAllocated >= ((DWORD)-1) / 4) {
-                    break;
-                }
-
-                NewBytesAllocated = ThisBuffer->BytesAllocated * 4;
-
-                NewBuffer = YoriLibMalloc(NewBytesAllocated);
-                if (NewBuffer == NULL) {
-                    break;
-                }
+        //
+        //  Only this thread adds data to the final chunk, so it can be
+        //  populated without holding the mutex.  Readers only look at
+        //  the populated portion, which is updated below with the mutex
+        //  held.
+        //
 
-                memcpy(NewBuffer, ThisBuffer->Buffer, ThisBuffer->BytesAllocated);
-                YoriLibFree(ThisBuffer->Buffer);
-                ThisBuffer->Buffer = NewBuffer;
-                ThisBuffer->BytesAllocated = NewBytesAllocated;
-            }
-        } else {
-            DWORD LastError = GetLastError();
+        Chunk = YoriShGetProcessBufferChunkForAppend(ThisBuffer);
+        if (Chunk == NULL) {
+            break;
+        }
 
-            AcquireMutex(ThisBuffer->Mutex);
+        if (!ReadFile(ThisBuffer->hSource,
+                      &Chunk->Data[Chunk->BytesPopulated],
+                      Chunk->BytesAllocated - Chunk->BytesPopulated,
+                      &BytesRead,
+                      NULL)) {
 
             //
-            //  Close the source but let the mirror drain if present.
+            //  ERROR_BROKEN_PIPE indicates the process has finished.  In
+            //  all cases, close the source but let the mirror drain if
+            //  present.
             //
 
-            if (LastError == ERROR_BROKEN_PIPE) {
-                hTemp = ThisBuffer->hSource;
-                ThisBuffer->hSource = NULL;
-                CloseHandle(hTemp);
-            } else {
-                break;
-            }
+            break;
         }
 
-        if (ThisBuffer->hMirror != NULL) {
-            while (ThisBuffer->BytesSent < ThisBuffer->BytesPopulated) {
-                DWORD BytesToWrite;
-                DWORD BytesWritten;
-                BytesToWrite = 4096;
-                if (ThisBuffer->BytesSent + BytesToWrite > ThisBuffer->BytesPopulated) {
-                    BytesToWrite = ThisBuffer->BytesPopulated - ThisBuffer->BytesSent;
-                }
-
-                if (WriteFile(ThisBuffer->hMirror,
-                              YoriLibAddToPointer(ThisBuffer->Buffer, ThisBuffer->BytesSent),
-                              BytesToWrite,
-                              &BytesWritten,
-                              NULL)) {
-        
-                    ThisBuffer->BytesSent += BytesWritten;
-                } else {
-                    hTemp = ThisBuffer->hMirror;
-                    ThisBuffer->hMirror = NULL;
-                    CloseHandle(hTemp);
-                    ThisBuffer->BytesSent = 0;
-                    break;
-                }
-
-                ASSERT(ThisBuffer->BytesSent <= ThisBuffer->BytesPopulated);
-            }
-
+        if (BytesRead == 0) {
+            break;
         }
+
+        AcquireMutex(ThisBuffer->Mutex);
+        Chunk->BytesPopulated += BytesRead;
+        ThisBuffer->BytesPopulated += BytesRead;
+        ThisBuffer->BytesInMemory += BytesRead;
+        YoriShSpillProcessBuffer(ThisBuffer);
+        hMirror = ThisBuffer->hMirror;
         ReleaseMutex(ThisBuffer->Mutex);
+
+        if (hMirror != NULL) {
+            if (!YoriShSendProcessBufferToHandle(ThisBuffer, hMirror, StagingBuffer, &ThisBuffer->BytesSent)) {
+                AcquireMutex(ThisBuffer->Mutex);
+                ThisBuffer->hMirror = NULL;
+                ThisBuffer->BytesSent = 0;
+                ReleaseMutex(ThisBuffer->Mutex);
+                CloseHandle(hMirror);
+            }
+        }
     }
 
-    if (ThisBuffer->hSource != NULL) {
-        hTemp = ThisBuffer->hSource;
-        ThisBuffer->hSource = NULL;
+    //
+    //  Once the source is closed, no further mirror can be attached, so
+    //  any existing mirror can be drained and closed without the mutex.
+    //
+
+    AcquireMutex(ThisBuffer->Mutex);
+    hTemp = ThisBuffer->hSource;
+    ThisBuffer->hSource = NULL;
+    hMirror = ThisBuffer->hMirror;
+    ReleaseMutex(ThisBuffer->Mutex);
+
+    if (hTemp != NULL) {
         CloseHandle(hTemp);
     }
 
-    if (ThisBuffer->hMirror != NULL) {
-        hTemp = ThisBuffer->hMirror;
+    if (hMirror != NULL) {
+        if (StagingBuffer != NULL) {
+            YoriShSendProcessBufferToHandle(ThisBuffer, hMirror, StagingBuffer, &ThisBuffer->BytesSent);
+        }
+        AcquireMutex(ThisBuffer->Mutex);
         ThisBuffer->hMirror = NULL;
-        CloseHandle(hTemp);
+        ThisBuffer->BytesSent = 0;
+        ReleaseMutex(ThisBuffer->Mutex);
+        CloseHandle(hMirror);
     }
 
-    ReleaseMutex(ThisBuffer->Mutex);
+    if (StagingBuffer != NULL) {
+        YoriLibFree(StagingBuffer);
+    }
 
     return 0;
 }
 
+/**
+ Determine the amount of data to retain in memory for a single stream before
+ spilling older data to a temporary file.  This is the value of the
+ YORIJOBBUFFERLIMIT environment variable if it is defined, or
+ @ref YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT if it is not.
+
+ @return The number of bytes to retain in memory.
+ */
+DWORDLONG
+YoriShGetProcessBufferMemoryLimit(VOID)
+{
+    YORI_STRING LimitString;
+    DWORD EnvVarLength;
+    LARGE_INTEGER Limit;
+
+    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIJOBBUFFERLIMIT"), NULL, 0, NULL);
+    if (EnvVarLength == 0) {
+        return YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT;
+    }
+
+    if (!YoriLibAllocateString(&LimitString, EnvVarLength)) {
+        return YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT;
+    }
+
+    LimitString.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIJOBBUFFERLIMIT"), LimitString.StartOfString, LimitString.LengthAllocated, NULL);
+    if (LimitString.LengthInChars == 0 || LimitString.LengthInChars >= LimitString.LengthAllocated) {
+        YoriLibFreeStringContents(&LimitString);
+        return YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT;
+    }
+
+    Limit = YoriLibStringToFileSize(&LimitString);
+    YoriLibFreeStringContents(&LimitString);
+
+    if (Limit.QuadPart <= 0) {
+        return YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT;
+    }
+
+    return (DWORDLONG)Limit.QuadPart;
+}
+
 /**
  Allocate and initialize a buffer for a single input stream.
 
@@ -354,11 +792,8 @@ YoriShAllocateSingleProcessBuffer(
     __out PYORI_SH_PROCESS_BUFFER Buffer
     )
 {
-    Buffer->BytesAllocated = 1024;
-    Buffer->Buffer = YoriLibMalloc(Buffer->BytesAllocated);
-    if (Buffer->Buffer == NULL) {
-        return FALSE;
-    }
+    YoriLibInitializeListHead(&Buffer->ChunkList);
+    Buffer->MemoryLimit = YoriShGetProcessBufferMemoryLimit();
 
     Buffer->Mutex = CreateMutex(NULL, FALSE, NULL);
     if (Buffer->Mutex == NULL) {
@@ -487,8 +922,10 @@ YoriShAppendToExistingProcessBuffer(
     YoriShWaitForProcessBufferToFinalize(ThisBuffer);
     ASSERT(WaitForSingleObject(ThisBuffer->OutputBuffer.hPumpThread, 0) == WAIT_OBJECT_0);
     CloseHandle(ThisBuffer->OutputBuffer.hPumpThread);
+    ThisBuffer->OutputBuffer.hSource = ExecContext->StdOut.Buffer.PipeFromProcess;
     ThisBuffer->OutputBuffer.hPumpThread = CreateThread(NULL, 0, YoriShCmdBufferPump, &ThisBuffer->OutputBuffer, 0, &ThreadId);
     if (ThisBuffer->OutputBuffer.hPumpThread == NULL) {
+        ThisBuffer->OutputBuffer.hSource = NULL;
         return FALSE;
     }
 
@@ -616,30 +1053,54 @@ YoriShGetProcessBuffer(
     __out PYORI_STRING String
     )
 {
-    DWORD LengthNeeded;
+    DWORD BytesPopulated;
+    PUCHAR Data;
 
-    if (ThisBuffer->Buffer == NULL) {
+    if (ThisBuffer->Mutex == NULL) {
         return FALSE;
     }
 
     AcquireMutex(ThisBuffer->Mutex);
 
-    LengthNeeded = YoriLibGetMultibyteInputSizeNeeded(ThisBuffer->Buffer, ThisBuffer->BytesPopulated);
-    if (LengthNeeded == 0 && ThisBuffer->BytesPopulated == 0) {
+    if (ThisBuffer->BytesPopulated == 0) {
         ReleaseMutex(ThisBuffer->Mutex);
         YoriLibInitEmptyString(String);
         return TRUE;
     }
 
-    if (!YoriLibAllocateString(String, LengthNeeded)) {
+    //
+    //  The result is returned as a single string, so it must fit within
+    //  a single allocation.
+    //
+
+    if (ThisBuffer->BytesPopulated >= (DWORD)-1 / sizeof(TCHAR)) {
+        ReleaseMutex(ThisBuffer->Mutex);
+        return FALSE;
+    }
+
+    BytesPopulated = (DWORD)ThisBuffer->BytesPopulated;
+    Data = YoriLibMalloc(BytesPopulated);
+    if (Data == NULL) {
+        ReleaseMutex(ThisBuffer->Mutex);
+        return FALSE;
+    }
+
+    if (YoriShCopyFromProcessBuffer(ThisBuffer, 0, Data, BytesPopulated) != BytesPopulated) {
         ReleaseMutex(ThisBuffer->Mutex);
+        YoriLibFree(Data);
         return FALSE;
     }
 
-    YoriLibMultibyteInput(ThisBuffer->Buffer, ThisBuffer->BytesPopulated, String->StartOfString, String->LengthAllocated);
-    String->LengthInChars = LengthNeeded;
     ReleaseMutex(ThisBuffer->Mutex);
 
+    YoriLibInitEmptyString(String);
+    if (!YoriLibMultibyteInputToString((LPCSTR)Data, BytesPopulated, String)) {
+        YoriLibFree(Data);
+        return FALSE;
+    }
+
+    YoriLibFree(Data);
+
     return TRUE;
 }
     
@@ -835,6 +1296,64 @@ YoriShWaitForProcessBufferToFinalize(
     return TRUE;
 }
 
+/**
+ Begin sending the contents of a single stream to a pipe.  If the process is
+ still running, the pump thread forwards existing and future output to the
+ pipe.  If the process has completed, a new thread is created to replay the
+ output, including any that has been moved to the spill file.
+
+ @param ThisBuffer Pointer to the stream to forward output from.
+
+ @param hPipe The pipe to forward output into.
+
+ @return TRUE to indicate success, FALSE to indicate error.
+ */
+__success(return)
+BOOL
+YoriShPipeSingleProcessBuffer(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer,
+    __in HANDLE hPipe
+    )
+{
+    DWORD ThreadId;
+
+    AcquireMutex(ThisBuffer->Mutex);
+    if (ThisBuffer->hMirror != NULL) {
+        ReleaseMutex(ThisBuffer->Mutex);
+        return FALSE;
+    }
+
+    ASSERT(ThisBuffer->BytesSent == 0);
+    ThisBuffer->hMirror = hPipe;
+    ThisBuffer->BytesSent = 0;
+
+    if (ThisBuffer->hSource != NULL) {
+        ReleaseMutex(ThisBuffer->Mutex);
+        return TRUE;
+    }
+    ReleaseMutex(ThisBuffer->Mutex);
+
+    //
+    //  The source has been closed, so any pump thread is about to exit
+    //  without looking at the mirror.  Wait for it and start a thread to
+    //  replay the output.
+    //
+
+    if (ThisBuffer->hPumpThread != NULL) {
+        WaitForSingleObject(ThisBuffer->hPumpThread, INFINITE);
+        CloseHandle(ThisBuffer->hPumpThread);
+        ThisBuffer->hPumpThread = NULL;
+    }
+
+    ThisBuffer->hPumpThread = CreateThread(NULL, 0, YoriShCmdBufferReplayToMirror, ThisBuffer, 0, &ThreadId);
+    if (ThisBuffer->hPumpThread == NULL) {
+        ThisBuffer->hMirror = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  Take any existing output from a set of buffers and send it to a pipe handle,
  and continue sending further output into the pipe handle.
@@ -855,94 +1374,71 @@ YoriShPipeProcessBuffers(
     __in_opt HANDLE hPipeErrors
     )
 {
-    BOOL HaveOutput;
-    BOOL HaveErrors;
-    BOOL Collision;
+    BOOL NeedReference;
+    BOOL Result;
     PYORI_SH_BUFFERED_PROCESS ThisBufferNonOpaque = (PYORI_SH_BUFFERED_PROCESS)ThisBuffer;
 
-    HaveOutput = FALSE;
-    HaveErrors = FALSE;
-
     //
     //  Check if data exists for the streams that redirection is requested
-    //  for.
+    //  for, and whether the redirection requested is already being
+    //  performed.
     //
 
     if (hPipeOutput != NULL) {
-        if (ThisBufferNonOpaque->OutputBuffer.Buffer != NULL) {
-            HaveOutput = TRUE;
-        } else {
+        if (ThisBufferNonOpaque->OutputBuffer.Mutex == NULL ||
+            ThisBufferNonOpaque->OutputBuffer.hMirror != NULL) {
             return FALSE;
         }
     }
 
     if (hPipeErrors != NULL) {
-        if (ThisBufferNonOpaque->ErrorBuffer.Buffer != NULL) {
-            HaveErrors = TRUE;
-        } else {
+        if (ThisBufferNonOpaque->ErrorBuffer.Mutex == NULL ||
+            ThisBufferNonOpaque->ErrorBuffer.hMirror != NULL) {
             return FALSE;
         }
     }
 
-    if (HaveOutput) {
-        AcquireMutex(ThisBufferNonOpaque->OutputBuffer.Mutex);
-    }
-    if (HaveErrors) {
-        AcquireMutex(ThisBufferNonOpaque->ErrorBuffer.Mutex);
-    }
-
     //
-    //  Check if the redirection requested is already being performed.
+    //  The buffer set holds a reference while any thread is operating on
+    //  it, which is released in YoriShScanProcessBuffersForTeardown.  If
+    //  all threads have already completed and that reference has been
+    //  released, any replay thread needs a new one.
     //
 
-    Collision = FALSE;
+    NeedReference = FALSE;
+    if (ThisBufferNonOpaque->OutputBuffer.hPumpThread == NULL &&
+        ThisBufferNonOpaque->ErrorBuffer.hPumpThread == NULL) {
 
-    if (HaveOutput) {
-        if (ThisBufferNonOpaque->OutputBuffer.hMirror != NULL ||
-            ThisBufferNonOpaque->OutputBuffer.hSource == NULL) {
-            Collision = TRUE;
-        }
+        NeedReference = TRUE;
+        YoriShReferenceProcessBuffer(ThisBufferNonOpaque);
     }
 
-    if (HaveErrors) {
-        if (ThisBufferNonOpaque->ErrorBuffer.hMirror != NULL ||
-            ThisBufferNonOpaque->ErrorBuffer.hSource == NULL) {
-            Collision = TRUE;
+    Result = TRUE;
+    if (hPipeOutput != NULL) {
+        if (!YoriShPipeSingleProcessBuffer(&ThisBufferNonOpaque->OutputBuffer, hPipeOutput)) {
+            Result = FALSE;
         }
     }
 
-    if (Collision) {
-        if (HaveOutput) {
-            ReleaseMutex(ThisBufferNonOpaque->OutputBuffer.Mutex);
-        }
-        if (HaveErrors) {
-            ReleaseMutex(ThisBufferNonOpaque->ErrorBuffer.Mutex);
+    if (Result && hPipeErrors != NULL) {
+        if (!YoriShPipeSingleProcessBuffer(&ThisBufferNonOpaque->ErrorBuffer, hPipeErrors)) {
+            Result = FALSE;
         }
-        return FALSE;
     }
 
     //
-    //  While locks are acquired, update the mirror handle.
+    //  If no thread is operating on the buffer set, nothing will release
+    //  the reference taken above.
     //
 
-    if (HaveOutput) {
-        ThisBufferNonOpaque->OutputBuffer.hMirror = hPipeOutput;
-        ASSERT(ThisBufferNonOpaque->OutputBuffer.BytesSent == 0);
-    }
-
-    if (HaveErrors) {
-        ThisBufferNonOpaque->ErrorBuffer.hMirror = hPipeErrors;
-        ASSERT(ThisBufferNonOpaque->ErrorBuffer.BytesSent == 0);
-    }
+    if (NeedReference &&
+        ThisBufferNonOpaque->OutputBuffer.hPumpThread == NULL &&
+        ThisBufferNonOpaque->ErrorBuffer.hPumpThread == NULL) {
 
-    if (HaveOutput) {
-        ReleaseMutex(ThisBufferNonOpaque->OutputBuffer.Mutex);
-    }
-    if (HaveErrors) {
-        ReleaseMutex(ThisBufferNonOpaque->ErrorBuffer.Mutex);
+        YoriShDereferenceProcessBuffer(ThisBufferNonOpaque);
     }
 
-    return TRUE;
+    return Result;
 }
 
 // vim:sw=4:ts=4:et:
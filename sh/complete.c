@@ -83,7 +83,9 @@ YoriShRemoveMatchFromTabContext(
 /**
  Populates the list of matches for a command history tab completion.  This
  function searches the history for matching commands in MRU order and
- populates the list with the result.
+ populates the list with the result.  Commands match if they begin with the
+ text before the first '*' in the search string, and contain any text
+ between subsequent '*' characters in order.
 
  @param TabContext Pointer to the tab completion context.  This provides
         the search criteria and has its match list populated with results
@@ -98,78 +100,51 @@ YoriShPerformHistoryTabCompletion(
     __in BOOL ExpandFullPath
     )
 {
-    LPTSTR FoundPath;
-    DWORD CompareLength;
-    PYORI_LIST_ENTRY ListEntry;
+    YORI_SH_HISTORY_SEARCH Search;
     PYORI_SH_HISTORY_ENTRY HistoryEntry;
     PYORI_SH_TAB_COMPLETE_MATCH Match;
-    PYORI_HASH_ENTRY PriorEntry;
 
     UNREFERENCED_PARAMETER(ExpandFullPath);
 
     //
-    //  Set up state necessary for different types of searching.
+    //  Search the history.  This uses the history index to examine only
+    //  commands which share the beginning of the search string.
     //
 
-    FoundPath = _tcschr(TabContext->SearchString.StartOfString, '*');
-    if (FoundPath != NULL) {
-        CompareLength = (DWORD)(FoundPath - TabContext->SearchString.StartOfString);
-    } else {
-        CompareLength = TabContext->SearchString.LengthInChars;
-    }
-    FoundPath = NULL;
-
-    //
-    //  Search the list of history.
-    //
-
-    ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, NULL);
-    while (ListEntry != NULL) {
-        HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
-
-        if (YoriLibCompareStringInsensitiveCount(&HistoryEntry->CmdLine, &TabContext->SearchString, CompareLength) == 0) {
+    YoriShInitializeHistorySearch(&TabContext->SearchString, &Search);
 
-            //
-            //  Allocate a match entry for this file.
-            //
+    HistoryEntry = YoriShGetPreviousHistoryMatch(&Search, NULL);
+    while (HistoryEntry != NULL) {
+        //
+        //  Allocate a match entry for this file.
+        //
 
-            Match = YoriLibReferencedMalloc(sizeof(YORI_SH_TAB_COMPLETE_MATCH) + (HistoryEntry->CmdLine.LengthInChars + 1) * sizeof(TCHAR));
-            if (Match == NULL) {
-                return;
-            }
+        Match = YoriLibReferencedMalloc(sizeof(YORI_SH_TAB_COMPLETE_MATCH) + (HistoryEntry->CmdLine.LengthInChars + 1) * sizeof(TCHAR));
+        if (Match == NULL) {
+            return;
+        }
 
-            //
-            //  Populate the file into the entry.
-            //
+        //
+        //  Populate the file into the entry.
+        //
 
-            YoriLibInitEmptyString(&Match->Value);
-            Match->Value.StartOfString = (LPTSTR)(Match + 1);
-            YoriLibReference(Match);
-            Match->Value.MemoryToFree = Match;
-            YoriLibSPrintf(Match->Value.StartOfString, _T("%y"), &HistoryEntry->CmdLine);
-            Match->Value.LengthInChars = HistoryEntry->CmdLine.LengthInChars;
-            Match->CursorOffset = Match->Value.LengthInChars;
+        YoriLibInitEmptyString(&Match->Value);
+        Match->Value.StartOfString = (LPTSTR)(Match + 1);
+        YoriLibReference(Match);
+        Match->Value.MemoryToFree = Match;
+        YoriLibSPrintf(Match->Value.StartOfString, _T("%y"), &HistoryEntry->CmdLine);
+        Match->Value.LengthInChars = HistoryEntry->CmdLine.LengthInChars;
+        Match->CursorOffset = Match->Value.LengthInChars;
 
-            //
-            //  If the user is requesting all matches to be enumerates for
-            //  tab completion, don't add an entry if there's a duplicate.
-            //  If the user is requesting to be able to cycle to the next
-            //  entry, keep duplicates, because they're an in-order record
-            //  of the commands the user entered.
-
-            PriorEntry = NULL;
-            if (YoriShGlobal.CompletionListAll) {
-                PriorEntry = YoriLibHashLookupByKey(TabContext->MatchHashTable, &Match->Value);
-            }
+        //
+        //  History never contains two identical commands, so every match
+        //  can be added without checking for a duplicate.  Commands which
+        //  differ only by case are distinct entries in history and are
+        //  offered separately.
+        //
 
-            if (PriorEntry == NULL) {
-                YoriShAddMatchToTabContext(TabContext, NULL, Match);
-            } else {
-                YoriLibFreeStringContents(&Match->Value);
-                YoriLibDereference(Match);
-            }
-        }
-        ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+        YoriShAddMatchToTabContext(TabContext, NULL, Match);
+        HistoryEntry = YoriShGetPreviousHistoryMatch(&Search, HistoryEntry);
     }
 }
 
@@ -451,10 +426,10 @@ YoriShPerformExecutableTabCompletion(
     //
 
     YoriLibInitEmptyString(&FoundExecutable);
-    Result = YoriLibLocateExecutableInPath(&SearchString,
-                                           YoriShAddExecutableToTabList,
-                                           &ExecTabContext,
-                                           &FoundExecutable);
+    Result = YoriShLocateExecutableInPath(&SearchString,
+                                          YoriShAddExecutableToTabList,
+                                          &ExecTabContext,
+                                          &FoundExecutable);
     ASSERT(FoundExecutable.StartOfString == NULL);
 
     //
@@ -1850,6 +1850,400 @@ YoriShExecuteExpressionAndCaptureOutput(
 }
 
 
+/**
+ The maximum number of backquote results retained in the cache.
+ */
+#define YORI_SH_BACKQUOTE_CACHE_MAX_ENTRIES 64
+
+/**
+ A single previously evaluated backquote expression and its result.
+ */
+typedef struct _YORI_SH_BACKQUOTE_CACHE_ENTRY {
+
+    /**
+     The link in the list of cached results, ordered from least recently to
+     most recently inserted.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The hash entry used to find this result by expression text.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The text of the expression that was evaluated.
+     */
+    YORI_STRING Expression;
+
+    /**
+     The current directory when the expression was evaluated.
+     */
+    YORI_STRING CurrentDirectory;
+
+    /**
+     The output of the expression, after newline processing.
+     */
+    YORI_STRING Output;
+
+    /**
+     The environment generation when the expression was evaluated.
+     */
+    DWORD EnvironmentGeneration;
+
+    /**
+     The tick count when the expression was evaluated.
+     */
+    DWORD EvaluationTime;
+
+    /**
+     The exit code of the expression, restored into YoriShGlobal.ErrorLevel
+     when the result is returned from the cache.
+     */
+    DWORD ErrorLevel;
+} YORI_SH_BACKQUOTE_CACHE_ENTRY, *PYORI_SH_BACKQUOTE_CACHE_ENTRY;
+
+/**
+ The list of cached backquote results, ordered from least recently to most
+ recently inserted.
+ */
+YORI_LIST_ENTRY YoriShBackquoteCacheList;
+
+/**
+ A hash table of cached backquote results indexed by expression text.
+ */
+PYORI_HASH_TABLE YoriShBackquoteCacheHash;
+
+/**
+ The number of entries in the backquote cache.
+ */
+DWORD YoriShBackquoteCacheCount;
+
+/**
+ The number of milliseconds that a backquote result remains valid, as
+ specified by the YORIBACKQUOTECACHE environment variable.  Zero disables
+ the cache.
+ */
+DWORD YoriShBackquoteCacheLifetime;
+
+/**
+ The environment generation when YoriShBackquoteCacheLifetime was last
+ loaded.  This is initialized to a value that cannot match so that the
+ variable is loaded on first use.
+ */
+DWORD YoriShBackquoteCacheLifetimeGeneration = (DWORD)-1;
+
+/**
+ Remove and free a single entry from the backquote cache.
+
+ @param Entry Pointer to the entry to free.
+ */
+VOID
+YoriShFreeBackquoteCacheEntry(
+    __in PYORI_SH_BACKQUOTE_CACHE_ENTRY Entry
+    )
+{
+    YoriLibRemoveListItem(&Entry->ListEntry);
+    YoriLibHashRemoveByEntry(&Entry->HashEntry);
+    YoriLibFreeStringContents(&Entry->Expression);
+    YoriLibFreeStringContents(&Entry->CurrentDirectory);
+    YoriLibFreeStringContents(&Entry->Output);
+    YoriLibFree(Entry);
+    YoriShBackquoteCacheCount--;
+}
+
+/**
+ Free all entries in the backquote cache.
+ */
+VOID
+YoriShClearBackquoteCache(VOID)
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_BACKQUOTE_CACHE_ENTRY Entry;
+
+    if (YoriShBackquoteCacheList.Next != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&YoriShBackquoteCacheList, NULL);
+        while (ListEntry != NULL) {
+            Entry = CONTAINING_RECORD(ListEntry, YORI_SH_BACKQUOTE_CACHE_ENTRY, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&YoriShBackquoteCacheList, ListEntry);
+            YoriShFreeBackquoteCacheEntry(Entry);
+        }
+    }
+
+    if (YoriShBackquoteCacheHash != NULL) {
+        YoriLibFreeEmptyHashTable(YoriShBackquoteCacheHash);
+        YoriShBackquoteCacheHash = NULL;
+    }
+
+    ASSERT(YoriShBackquoteCacheCount == 0);
+}
+
+/**
+ Return the number of milliseconds that a backquote result remains valid.
+ The cache is opt in, since the shell cannot know whether an expression
+ returns the same result each time it is evaluated.  It is enabled by
+ setting YORIBACKQUOTECACHE to a number of milliseconds.
+
+ @return The number of milliseconds a result remains valid, or zero if
+         results should not be cached.
+ */
+DWORD
+YoriShGetBackquoteCacheLifetime(VOID)
+{
+    TCHAR EnvVarBuffer[16];
+    YORI_STRING EnvVar;
+    DWORD EnvVarLength;
+    LONGLONG llTemp;
+    DWORD CharsConsumed;
+
+    if (YoriShBackquoteCacheLifetimeGeneration == YoriShGlobal.EnvironmentGeneration) {
+        return YoriShBackquoteCacheLifetime;
+    }
+
+    YoriShBackquoteCacheLifetime = 0;
+    YoriShBackquoteCacheLifetimeGeneration = YoriShGlobal.EnvironmentGeneration;
+
+    YoriLibInitEmptyString(&EnvVar);
+    EnvVar.StartOfString = EnvVarBuffer;
+    EnvVar.LengthAllocated = sizeof(EnvVarBuffer)/sizeof(EnvVarBuffer[0]);
+
+    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIBACKQUOTECACHE"), NULL, 0, NULL);
+    if (EnvVarLength > 0 && EnvVarLength <= EnvVar.LengthAllocated) {
+        EnvVar.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIBACKQUOTECACHE"), EnvVar.StartOfString, EnvVar.LengthAllocated, NULL);
+        if (YoriLibStringToNumber(&EnvVar, TRUE, &llTemp, &CharsConsumed) && CharsConsumed > 0 && llTemp > 0) {
+            YoriShBackquoteCacheLifetime = (DWORD)llTemp;
+        }
+    }
+
+    if (YoriShBackquoteCacheLifetime == 0) {
+        YoriShClearBackquoteCache();
+    }
+
+    return YoriShBackquoteCacheLifetime;
+}
+
+/**
+ Capture the current directory into a newly allocated string.
+
+ @param CurrentDirectory On successful completion, populated with the
+        current directory.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShBackquoteCacheGetCurrentDirectory(
+    __out PYORI_STRING CurrentDirectory
+    )
+{
+    DWORD LengthNeeded;
+
+    LengthNeeded = GetCurrentDirectory(0, NULL);
+    if (!YoriLibAllocateString(CurrentDirectory, LengthNeeded)) {
+        return FALSE;
+    }
+
+    CurrentDirectory->LengthInChars = GetCurrentDirectory(CurrentDirectory->LengthAllocated, CurrentDirectory->StartOfString);
+    if (CurrentDirectory->LengthInChars == 0 ||
+        CurrentDirectory->LengthInChars >= CurrentDirectory->LengthAllocated) {
+
+        YoriLibFreeStringContents(CurrentDirectory);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Look up the result of a previously evaluated backquote expression.  A
+ result is only returned if it was evaluated with the same environment and
+ current directory within the configured lifetime.
+
+ @param Expression The expression to look up.
+
+ @param CurrentDirectory The current directory.
+
+ @param ProcessOutput On successful completion, populated with a referenced
+        copy of the previous result.  The exit code of the previous
+        evaluation is restored into YoriShGlobal.ErrorLevel.
+
+ @return TRUE if a valid result was found, FALSE if the expression needs to
+         be evaluated.
+ */
+__success(return)
+BOOL
+YoriShLookupBackquoteCache(
+    __in PYORI_STRING Expression,
+    __in PYORI_STRING CurrentDirectory,
+    __out PYORI_STRING ProcessOutput
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_BACKQUOTE_CACHE_ENTRY Entry;
+
+    if (YoriShBackquoteCacheHash == NULL) {
+        return FALSE;
+    }
+
+    HashEntry = YoriLibHashLookupByKey(YoriShBackquoteCacheHash, Expression);
+    if (HashEntry == NULL) {
+        return FALSE;
+    }
+
+    Entry = HashEntry->Context;
+    if (YoriLibCompareString(&Entry->Expression, Expression) != 0 ||
+        Entry->EnvironmentGeneration != YoriShGlobal.EnvironmentGeneration ||
+        GetTickCount() - Entry->EvaluationTime >= YoriShBackquoteCacheLifetime ||
+        YoriLibCompareStringInsensitive(&Entry->CurrentDirectory, CurrentDirectory) != 0) {
+
+        YoriShFreeBackquoteCacheEntry(Entry);
+        return FALSE;
+    }
+
+    YoriLibCloneString(ProcessOutput, &Entry->Output);
+    YoriShGlobal.ErrorLevel = Entry->ErrorLevel;
+    return TRUE;
+}
+
+/**
+ Record the result of evaluating a backquote expression so that later
+ evaluations of the same expression can return it.  The exit code is taken
+ from YoriShGlobal.ErrorLevel.  Failure to record the result is not fatal
+ and is not reported.
+
+ @param Expression The expression that was evaluated.
+
+ @param CurrentDirectory The current directory when it was evaluated.
+
+ @param ProcessOutput The result of the expression.
+ */
+VOID
+YoriShAddToBackquoteCache(
+    __in PYORI_STRING Expression,
+    __in PYORI_STRING CurrentDirectory,
+    __in PYORI_STRING ProcessOutput
+    )
+{
+    PYORI_SH_BACKQUOTE_CACHE_ENTRY Entry;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_LIST_ENTRY ListEntry;
+
+    if (YoriShBackquoteCacheList.Next == NULL) {
+        YoriLibInitializeListHead(&YoriShBackquoteCacheList);
+    }
+
+    if (YoriShBackquoteCacheHash == NULL) {
+        YoriShBackquoteCacheHash = YoriLibAllocateHashTable(YORI_SH_BACKQUOTE_CACHE_MAX_ENTRIES / 2);
+        if (YoriShBackquoteCacheHash == NULL) {
+            return;
+        }
+    }
+
+    HashEntry = YoriLibHashLookupByKey(YoriShBackquoteCacheHash, Expression);
+    if (HashEntry != NULL) {
+        YoriShFreeBackquoteCacheEntry(HashEntry->Context);
+    }
+
+    //
+    //  Cloning a string only references its allocation.  If the directory
+    //  or output is not in an allocation, the entry cannot keep it, so
+    //  don't cache this result.
+    //
+
+    if ((CurrentDirectory->MemoryToFree == NULL && CurrentDirectory->LengthInChars > 0) ||
+        (ProcessOutput->MemoryToFree == NULL && ProcessOutput->LengthInChars > 0)) {
+
+        return;
+    }
+
+    if (YoriShBackquoteCacheCount >= YORI_SH_BACKQUOTE_CACHE_MAX_ENTRIES) {
+        ListEntry = YoriLibGetNextListEntry(&YoriShBackquoteCacheList, NULL);
+        YoriShFreeBackquoteCacheEntry(CONTAINING_RECORD(ListEntry, YORI_SH_BACKQUOTE_CACHE_ENTRY, ListEntry));
+    }
+
+    Entry = YoriLibMalloc(sizeof(YORI_SH_BACKQUOTE_CACHE_ENTRY));
+    if (Entry == NULL) {
+        return;
+    }
+
+    ZeroMemory(Entry, sizeof(YORI_SH_BACKQUOTE_CACHE_ENTRY));
+    if (!YoriLibAllocateString(&Entry->Expression, Expression->LengthInChars + 1)) {
+        YoriLibFree(Entry);
+        return;
+    }
+
+    memcpy(Entry->Expression.StartOfString, Expression->StartOfString, Expression->LengthInChars * sizeof(TCHAR));
+    Entry->Expression.StartOfString[Expression->LengthInChars] = '\0';
+    Entry->Expression.LengthInChars = Expression->LengthInChars;
+
+    YoriLibCloneString(&Entry->CurrentDirectory, CurrentDirectory);
+    YoriLibCloneString(&Entry->Output, ProcessOutput);
+    Entry->EnvironmentGeneration = YoriShGlobal.EnvironmentGeneration;
+    Entry->EvaluationTime = GetTickCount();
+    Entry->ErrorLevel = YoriShGlobal.ErrorLevel;
+
+    YoriLibAppendList(&YoriShBackquoteCacheList, &Entry->ListEntry);
+    YoriLibHashInsertByKey(YoriShBackquoteCacheHash, &Entry->Expression, Entry, &Entry->HashEntry);
+    YoriShBackquoteCacheCount++;
+}
+
+/**
+ Execute a backquote expression and capture its output, returning a cached
+ result if the user has enabled caching and the expression has been
+ evaluated recently with the same environment and current directory.  An
+ expression is only cached if it succeeded and did not itself change the
+ environment or current directory.
+
+ @param Expression Pointer to a string describing the expression to execute.
+
+ @param ProcessOutput On successful completion, populated with the result of
+        the expression.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShExecuteBackquoteExpression(
+    __in PYORI_STRING Expression,
+    __out PYORI_STRING ProcessOutput
+    )
+{
+    YORI_STRING CurrentDirectory;
+    YORI_STRING NewCurrentDirectory;
+    DWORD EnvironmentGeneration;
+
+    if (YoriShGetBackquoteCacheLifetime() == 0 ||
+        !YoriShBackquoteCacheGetCurrentDirectory(&CurrentDirectory)) {
+
+        return YoriShExecuteExpressionAndCaptureOutput(Expression, ProcessOutput);
+    }
+
+    if (YoriShLookupBackquoteCache(Expression, &CurrentDirectory, ProcessOutput)) {
+        YoriLibFreeStringContents(&CurrentDirectory);
+        return TRUE;
+    }
+
+    EnvironmentGeneration = YoriShGlobal.EnvironmentGeneration;
+    if (!YoriShExecuteExpressionAndCaptureOutput(Expression, ProcessOutput)) {
+        YoriLibFreeStringContents(&CurrentDirectory);
+        return FALSE;
+    }
+
+    if (YoriShGlobal.ErrorLevel == 0 &&
+        EnvironmentGeneration == YoriShGlobal.EnvironmentGeneration &&
+        YoriShBackquoteCacheGetCurrentDirectory(&NewCurrentDirectory)) {
+
+        if (YoriLibCompareStringInsensitive(&CurrentDirectory, &NewCurrentDirectory) == 0) {
+            YoriShAddToBackquoteCache(Expression, &CurrentDirectory, ProcessOutput);
+        }
+        YoriLibFreeStringContents(&NewCurrentDirectory);
+    }
+
+    YoriLibFreeStringContents(&CurrentDirectory);
+    return TRUE;
+}
+
+
 /**
  Parse and execute all backquotes in an expression, potentially resulting
  in a new expression.  This will internally perform parsing and redirection,
@@ -1897,7 +2291,7 @@ YoriShExpandBackquotes(
             break;
         }
 
-        if (!YoriShExecuteExpressionAndCaptureOutput(&CurrentExpressionSubset, &ProcessOutput)) {
+        if (!YoriShExecuteBackquoteExpression(&CurrentExpressionSubset, &ProcessOutput)) {
             break;
         }
 
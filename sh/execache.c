@@ -0,0 +1,984 @@
+/**
+ * @file sh/execache.c
+ *
+ * Yori shell cache of executables found via PATH and PATHEXT
+ *
+ * Copyright (c) 2019 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yori.h"
+
+/**
+ The number of milliseconds that a cache is trusted for if one or more of
+ the directories in PATH cannot be monitored for changes.
+ */
+#define YORI_SH_EXEC_CACHE_UNWATCHED_LIFETIME (30 * 1000)
+
+/**
+ The extensions to use if the PATHEXT variable is not defined.  This matches
+ the library's behavior when performing an uncached search.
+ */
+#define YORI_SH_EXEC_CACHE_DEFAULT_PATHEXT _T(".com;.exe;.bat;.cmd")
+
+/**
+ A single file within a PATH directory whose extension is listed in PATHEXT.
+ */
+typedef struct _YORI_SH_EXEC_CACHE_ENTRY {
+
+    /**
+     The hash entry used to find this file by base name.  Only the entry that
+     would be executed for a given base name is inserted into the hash table.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The fully qualified path to the file.  This is the string returned to
+     callers.
+     */
+    YORI_STRING FullPath;
+
+    /**
+     The file name without its extension.  This points into FullPath and is
+     not referenced.
+     */
+    YORI_STRING BaseName;
+
+    /**
+     The index of the matching extension within PATHEXT.  Lower values are
+     executed in preference to higher ones.
+     */
+    DWORD ExtensionRank;
+} YORI_SH_EXEC_CACHE_ENTRY, *PYORI_SH_EXEC_CACHE_ENTRY;
+
+/**
+ A single directory from PATH along with the executables found within it.
+ */
+typedef struct _YORI_SH_EXEC_CACHE_DIRECTORY {
+
+    /**
+     A change notification handle used to determine if the directory has been
+     modified since it was enumerated.  INVALID_HANDLE_VALUE if the directory
+     could not be monitored.
+     */
+    HANDLE ChangeNotification;
+
+    /**
+     The number of executables found within this directory.
+     */
+    DWORD EntryCount;
+
+    /**
+     The number of elements allocated in the Entries array.
+     */
+    DWORD EntriesAllocated;
+
+    /**
+     An array of executables found within this directory, sorted by base name
+     and then by extension rank so that prefix searches can be performed with
+     a binary search.
+     */
+    PYORI_SH_EXEC_CACHE_ENTRY Entries;
+} YORI_SH_EXEC_CACHE_DIRECTORY, *PYORI_SH_EXEC_CACHE_DIRECTORY;
+
+/**
+ The state of the executable cache.
+ */
+typedef struct _YORI_SH_EXEC_CACHE {
+
+    /**
+     The value of the PATH variable when the cache was populated.
+     */
+    YORI_STRING PathVariable;
+
+    /**
+     The value of the PATHEXT variable when the cache was populated.
+     */
+    YORI_STRING PathExtVariable;
+
+    /**
+     The number of directories in the Directories array.
+     */
+    DWORD DirectoryCount;
+
+    /**
+     An array of directories in PATH order.
+     */
+    PYORI_SH_EXEC_CACHE_DIRECTORY Directories;
+
+    /**
+     A hash table of base names to the entry that would be executed if that
+     base name were specified.
+     */
+    PYORI_HASH_TABLE HashTable;
+
+    /**
+     The tick count when the cache was populated.
+     */
+    DWORD PopulateTime;
+
+    /**
+     TRUE if every directory has a change notification handle, so the cache
+     is valid until a change is reported.  FALSE if the cache should be
+     discarded after @ref YORI_SH_EXEC_CACHE_UNWATCHED_LIFETIME .
+     */
+    BOOLEAN AllDirectoriesWatched;
+
+    /**
+     TRUE if the cache has been populated and can be used.
+     */
+    BOOLEAN Populated;
+} YORI_SH_EXEC_CACHE, *PYORI_SH_EXEC_CACHE;
+
+/**
+ The global executable cache.
+ */
+YORI_SH_EXEC_CACHE YoriShExecCache;
+
+/**
+ Free all state associated with the executable cache.  The cache will be
+ repopulated on next use.
+ */
+VOID
+YoriShFreeExecutableCache(VOID)
+{
+    DWORD DirIndex;
+    DWORD EntryIndex;
+    PYORI_SH_EXEC_CACHE_DIRECTORY Directory;
+    PYORI_SH_EXEC_CACHE_ENTRY Entry;
+
+    for (DirIndex = 0; DirIndex < YoriShExecCache.DirectoryCount; DirIndex++) {
+        Directory = &YoriShExecCache.Directories[DirIndex];
+        for (EntryIndex = 0; EntryIndex < Directory->EntryCount; EntryIndex++) {
+            Entry = &Directory->Entries[EntryIndex];
+            if (Entry->HashEntry.HashTable != NULL) {
+                YoriLibHashRemoveByEntry(&Entry->HashEntry);
+            }
+            YoriLibFreeStringContents(&Entry->FullPath);
+        }
+        if (Directory->Entries != NULL) {
+            YoriLibFree(Directory->Entries);
+        }
+        if (Directory->ChangeNotification != INVALID_HANDLE_VALUE) {
+            FindCloseChangeNotification(Directory->ChangeNotification);
+        }
+    }
+
+    if (YoriShExecCache.Directories != NULL) {
+        YoriLibFree(YoriShExecCache.Directories);
+    }
+
+    if (YoriShExecCache.HashTable != NULL) {
+        YoriLibFreeEmptyHashTable(YoriShExecCache.HashTable);
+    }
+
+    YoriLibFreeStringContents(&YoriShExecCache.PathVariable);
+    YoriLibFreeStringContents(&YoriShExecCache.PathExtVariable);
+    ZeroMemory(&YoriShExecCache, sizeof(YoriShExecCache));
+}
+
+/**
+ Capture the value of an environment variable into a newly allocated string.
+
+ @param VariableName The name of the variable to capture.
+
+ @param DefaultValue Optionally points to a value to return if the variable
+        is not defined.
+
+ @param Value On successful completion, populated with the value of the
+        variable.  The caller should free this with
+        @ref YoriLibFreeStringContents .
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShExecCacheCaptureVariable(
+    __in LPCTSTR VariableName,
+    __in_opt LPCTSTR DefaultValue,
+    __out PYORI_STRING Value
+    )
+{
+    DWORD LengthNeeded;
+
+    YoriLibInitEmptyString(Value);
+    LengthNeeded = GetEnvironmentVariable(VariableName, NULL, 0);
+    if (LengthNeeded == 0) {
+        if (DefaultValue == NULL) {
+            LengthNeeded = 1;
+        } else {
+            LengthNeeded = _tcslen(DefaultValue) + 1;
+        }
+        if (!YoriLibAllocateString(Value, LengthNeeded)) {
+            return FALSE;
+        }
+        if (DefaultValue == NULL) {
+            Value->StartOfString[0] = '\0';
+            Value->LengthInChars = 0;
+        } else {
+            Value->LengthInChars = YoriLibSPrintf(Value->StartOfString, _T("%s"), DefaultValue);
+        }
+        return TRUE;
+    }
+
+    if (!YoriLibAllocateString(Value, LengthNeeded)) {
+        return FALSE;
+    }
+
+    Value->LengthInChars = GetEnvironmentVariable(VariableName, Value->StartOfString, Value->LengthAllocated);
+    if (Value->LengthInChars >= Value->LengthAllocated) {
+        YoriLibFreeStringContents(Value);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Find the next semicolon delimited component within a PATH or PATHEXT
+ string, skipping any empty components.
+
+ @param String The complete string.
+
+ @param Offset On input, the offset to begin searching from.  On output,
+        updated to point beyond the returned component.
+
+ @param Component On successful completion, updated to point to the
+        component within String.
+
+ @return TRUE if a component was found, FALSE if the end of the string has
+         been reached.
+ */
+BOOL
+YoriShExecCacheGetNextComponent(
+    __in PYORI_STRING String,
+    __inout PDWORD Offset,
+    __out PYORI_STRING Component
+    )
+{
+    DWORD Index;
+
+    YoriLibInitEmptyString(Component);
+
+    for (Index = *Offset; Index < String->LengthInChars; Index++) {
+        if (String->StartOfString[Index] != ';') {
+            break;
+        }
+    }
+
+    if (Index >= String->LengthInChars) {
+        *Offset = Index;
+        return FALSE;
+    }
+
+    Component->StartOfString = &String->StartOfString[Index];
+    for (; Index < String->LengthInChars; Index++) {
+        if (String->StartOfString[Index] == ';') {
+            break;
+        }
+    }
+
+    Component->LengthInChars = (DWORD)(&String->StartOfString[Index] - Component->StartOfString);
+    *Offset = Index;
+    return TRUE;
+}
+
+/**
+ Return TRUE if every component in PATH is fully qualified.  Relative
+ components resolve against the current directory, so their contents can
+ change without any change to the directory, and these cannot be cached.
+
+ @param PathVariable The contents of the PATH variable.
+
+ @return TRUE if the PATH can be cached, FALSE if it cannot.
+ */
+BOOL
+YoriShExecCacheIsPathCacheable(
+    __in PYORI_STRING PathVariable
+    )
+{
+    DWORD Offset;
+    YORI_STRING Component;
+
+    Offset = 0;
+    while (YoriShExecCacheGetNextComponent(PathVariable, &Offset, &Component)) {
+        if (!YoriLibIsDriveLetterWithColonAndSlash(&Component) &&
+            !YoriLibIsFullPathUnc(&Component) &&
+            !YoriLibIsPathPrefixed(&Component)) {
+
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Determine whether a file name ends in one of the extensions in PATHEXT, and
+ if so, which one.
+
+ @param FileName The file name to check.
+
+ @param PathExtVariable The contents of the PATHEXT variable.
+
+ @param ExtensionRank On successful completion, updated to contain the index
+        of the first matching extension within PATHEXT.
+
+ @param BaseNameLength On successful completion, updated to contain the
+        length of the file name without the matching extension.
+
+ @return TRUE if the file name has an executable extension, FALSE if not.
+ */
+__success(return)
+BOOL
+YoriShExecCacheMatchExtension(
+    __in PYORI_STRING FileName,
+    __in PYORI_STRING PathExtVariable,
+    __out PDWORD ExtensionRank,
+    __out PDWORD BaseNameLength
+    )
+{
+    DWORD Offset;
+    DWORD Rank;
+    YORI_STRING Extension;
+    YORI_STRING FileExtension;
+
+    Offset = 0;
+    Rank = 0;
+    YoriLibInitEmptyString(&FileExtension);
+    while (YoriShExecCacheGetNextComponent(PathExtVariable, &Offset, &Extension)) {
+        if (FileName->LengthInChars > Extension.LengthInChars) {
+            FileExtension.StartOfString = &FileName->StartOfString[FileName->LengthInChars - Extension.LengthInChars];
+            FileExtension.LengthInChars = Extension.LengthInChars;
+            if (YoriLibCompareStringInsensitive(&FileExtension, &Extension) == 0) {
+                *ExtensionRank = Rank;
+                *BaseNameLength = FileName->LengthInChars - Extension.LengthInChars;
+                return TRUE;
+            }
+        }
+        Rank++;
+    }
+
+    return FALSE;
+}
+
+/**
+ Compare two cache entries for sort order, by base name and then by
+ extension rank.
+
+ @param Left The first entry to compare.
+
+ @param Right The second entry to compare.
+
+ @return Less than zero if Left should precede Right, greater than zero if
+         Right should precede Left, or zero if they are equal.
+ */
+int
+YoriShExecCacheCompareEntries(
+    __in PYORI_SH_EXEC_CACHE_ENTRY Left,
+    __in PYORI_SH_EXEC_CACHE_ENTRY Right
+    )
+{
+    int Result;
+
+    Result = YoriLibCompareStringInsensitive(&Left->BaseName, &Right->BaseName);
+    if (Result != 0) {
+        return Result;
+    }
+
+    if (Left->ExtensionRank < Right->ExtensionRank) {
+        return -1;
+    } else if (Left->ExtensionRank > Right->ExtensionRank) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ Enumerate a single directory from PATH and record all executables found
+ within it.  The directory is enumerated once in its entirety rather than
+ once per lookup.
+
+ @param DirectoryName The directory name, as found in PATH.
+
+ @param Directory Pointer to the directory structure to populate.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  Note that a
+         directory which does not exist is not a failure; it simply contains
+         no entries.
+ */
+__success(return)
+BOOL
+YoriShExecCacheLoadDirectory(
+    __in PYORI_STRING DirectoryName,
+    __inout PYORI_SH_EXEC_CACHE_DIRECTORY Directory
+    )
+{
+    YORI_STRING FullDirectory;
+    YORI_STRING SearchString;
+    YORI_STRING FileName;
+    YORI_SH_EXEC_CACHE_ENTRY NewEntry;
+    PYORI_SH_EXEC_CACHE_ENTRY NewEntries;
+    WIN32_FIND_DATA FindData;
+    HANDLE hFind;
+    DWORD ExtensionRank;
+    DWORD BaseNameLength;
+    DWORD DirectoryLength;
+    DWORD Index;
+    BOOL NeedsSeperator;
+
+    Directory->ChangeNotification = INVALID_HANDLE_VALUE;
+    Directory->EntryCount = 0;
+    Directory->EntriesAllocated = 0;
+    Directory->Entries = NULL;
+
+    YoriLibInitEmptyString(&FullDirectory);
+    if (!YoriLibGetFullPathNameReturnAllocation(DirectoryName, FALSE, &FullDirectory, NULL)) {
+        return TRUE;
+    }
+
+    DirectoryLength = FullDirectory.LengthInChars;
+    NeedsSeperator = TRUE;
+    if (DirectoryLength > 0 && YoriLibIsSep(FullDirectory.StartOfString[DirectoryLength - 1])) {
+        NeedsSeperator = FALSE;
+    }
+
+    if (!YoriLibAllocateString(&SearchString, DirectoryLength + 3)) {
+        YoriLibFreeStringContents(&FullDirectory);
+        return FALSE;
+    }
+
+    SearchString.LengthInChars = YoriLibSPrintf(SearchString.StartOfString, _T("%y%s*"), &FullDirectory, NeedsSeperator?_T("\\"):_T(""));
+
+    //
+    //  Register for change notifications before enumerating, so any change
+    //  that occurs during the enumerate is detected on the next lookup.
+    //
+
+    Directory->ChangeNotification = FindFirstChangeNotification(FullDirectory.StartOfString, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME);
+
+    hFind = FindFirstFile(SearchString.StartOfString, &FindData);
+    YoriLibFreeStringContents(&SearchString);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        YoriLibFreeStringContents(&FullDirectory);
+        return TRUE;
+    }
+
+    do {
+        YoriLibConstantString(&FileName, FindData.cFileName);
+        if (!YoriShExecCacheMatchExtension(&FileName, &YoriShExecCache.PathExtVariable, &ExtensionRank, &BaseNameLength)) {
+            continue;
+        }
+
+        ZeroMemory(&NewEntry, sizeof(NewEntry));
+        if (!YoriLibAllocateString(&NewEntry.FullPath, DirectoryLength + 1 + FileName.LengthInChars + 1)) {
+            FindClose(hFind);
+            YoriLibFreeStringContents(&FullDirectory);
+            return FALSE;
+        }
+
+        NewEntry.FullPath.LengthInChars = YoriLibSPrintf(NewEntry.FullPath.StartOfString, _T("%y%s%y"), &FullDirectory, NeedsSeperator?_T("\\"):_T(""), &FileName);
+        NewEntry.BaseName.StartOfString = &NewEntry.FullPath.StartOfString[NewEntry.FullPath.LengthInChars - FileName.LengthInChars];
+        NewEntry.BaseName.LengthInChars = BaseNameLength;
+        NewEntry.ExtensionRank = ExtensionRank;
+
+        if (Directory->EntryCount >= Directory->EntriesAllocated) {
+            DWORD NewAllocated;
+            NewAllocated = Directory->EntriesAllocated * 2;
+            if (NewAllocated < 64) {
+                NewAllocated = 64;
+            }
+            NewEntries = YoriLibMalloc(NewAllocated * sizeof(YORI_SH_EXEC_CACHE_ENTRY));
+            if (NewEntries == NULL) {
+                YoriLibFreeStringContents(&NewEntry.FullPath);
+                FindClose(hFind);
+                YoriLibFreeStringContents(&FullDirectory);
+                return FALSE;
+            }
+            if (Directory->Entries != NULL) {
+                memcpy(NewEntries, Directory->Entries, Directory->EntryCount * sizeof(YORI_SH_EXEC_CACHE_ENTRY));
+                YoriLibFree(Directory->Entries);
+            }
+            Directory->Entries = NewEntries;
+            Directory->EntriesAllocated = NewAllocated;
+        }
+
+        //
+        //  Insert in sorted order.  Most file systems return entries in
+        //  name order already, so this is typically an append.
+        //
+
+        Index = Directory->EntryCount;
+        while (Index > 0 && YoriShExecCacheCompareEntries(&Directory->Entries[Index - 1], &NewEntry) > 0) {
+            memcpy(&Directory->Entries[Index], &Directory->Entries[Index - 1], sizeof(YORI_SH_EXEC_CACHE_ENTRY));
+            Index--;
+        }
+        memcpy(&Directory->Entries[Index], &NewEntry, sizeof(YORI_SH_EXEC_CACHE_ENTRY));
+        Directory->EntryCount++;
+
+    } while (FindNextFile(hFind, &FindData));
+
+    FindClose(hFind);
+    YoriLibFreeStringContents(&FullDirectory);
+    return TRUE;
+}
+
+/**
+ Populate the executable cache from the current PATH and PATHEXT.  On
+ failure the cache is left unpopulated, and lookups fall back to searching
+ the file system directly.
+
+ @param PathVariable The contents of the PATH variable.  On success, this
+        is owned by the cache.
+
+ @param PathExtVariable The contents of the PATHEXT variable.  On success,
+        this is owned by the cache.
+
+ @return TRUE to indicate the cache was populated, FALSE if it was not.
+ */
+__success(return)
+BOOL
+YoriShExecCachePopulate(
+    __in PYORI_STRING PathVariable,
+    __in PYORI_STRING PathExtVariable
+    )
+{
+    DWORD Offset;
+    DWORD DirIndex;
+    DWORD EntryIndex;
+    DWORD TotalEntries;
+    YORI_STRING Component;
+    PYORI_SH_EXEC_CACHE_DIRECTORY Directory;
+    PYORI_SH_EXEC_CACHE_ENTRY Entry;
+
+    YoriShFreeExecutableCache();
+
+    memcpy(&YoriShExecCache.PathVariable, PathVariable, sizeof(YORI_STRING));
+    memcpy(&YoriShExecCache.PathExtVariable, PathExtVariable, sizeof(YORI_STRING));
+    YoriLibInitEmptyString(PathVariable);
+    YoriLibInitEmptyString(PathExtVariable);
+
+    Offset = 0;
+    DirIndex = 0;
+    while (YoriShExecCacheGetNextComponent(&YoriShExecCache.PathVariable, &Offset, &Component)) {
+        DirIndex++;
+    }
+
+    if (DirIndex > 0) {
+        YoriShExecCache.Directories = YoriLibMalloc(DirIndex * sizeof(YORI_SH_EXEC_CACHE_DIRECTORY));
+        if (YoriShExecCache.Directories == NULL) {
+            YoriShFreeExecutableCache();
+            return FALSE;
+        }
+    }
+
+    YoriShExecCache.AllDirectoriesWatched = TRUE;
+    TotalEntries = 0;
+    Offset = 0;
+    while (YoriShExecCacheGetNextComponent(&YoriShExecCache.PathVariable, &Offset, &Component)) {
+        YORI_STRING DirectoryName;
+
+        //
+        //  The full path routine expects a NULL terminated string, so
+        //  take a copy of the component.
+        //
+
+        if (!YoriLibAllocateString(&DirectoryName, Component.LengthInChars + 1)) {
+            YoriShFreeExecutableCache();
+            return FALSE;
+        }
+        memcpy(DirectoryName.StartOfString, Component.StartOfString, Component.LengthInChars * sizeof(TCHAR));
+        DirectoryName.StartOfString[Component.LengthInChars] = '\0';
+        DirectoryName.LengthInChars = Component.LengthInChars;
+
+        Directory = &YoriShExecCache.Directories[YoriShExecCache.DirectoryCount];
+        YoriShExecCache.DirectoryCount++;
+        if (!YoriShExecCacheLoadDirectory(&DirectoryName, Directory)) {
+            YoriLibFreeStringContents(&DirectoryName);
+            YoriShFreeExecutableCache();
+            return FALSE;
+        }
+        YoriLibFreeStringContents(&DirectoryName);
+
+        if (Directory->ChangeNotification == INVALID_HANDLE_VALUE) {
+            YoriShExecCache.AllDirectoriesWatched = FALSE;
+        }
+        TotalEntries += Directory->EntryCount;
+    }
+
+    YoriShExecCache.HashTable = YoriLibAllocateHashTable(TotalEntries / 4 + 16);
+    if (YoriShExecCache.HashTable == NULL) {
+        YoriShFreeExecutableCache();
+        return FALSE;
+    }
+
+    //
+    //  Insert the first entry found for each base name.  Since directories
+    //  are in PATH order and entries within a directory are in PATHEXT
+    //  order, this is the entry that an uncached search would return.
+    //
+
+    for (DirIndex = 0; DirIndex < YoriShExecCache.DirectoryCount; DirIndex++) {
+        Directory = &YoriShExecCache.Directories[DirIndex];
+        for (EntryIndex = 0; EntryIndex < Directory->EntryCount; EntryIndex++) {
+            Entry = &Directory->Entries[EntryIndex];
+            if (YoriLibHashLookupByKey(YoriShExecCache.HashTable, &Entry->BaseName) == NULL) {
+                YoriLibHashInsertByKey(YoriShExecCache.HashTable, &Entry->BaseName, Entry, &Entry->HashEntry);
+            }
+        }
+    }
+
+    YoriShExecCache.PopulateTime = GetTickCount();
+    YoriShExecCache.Populated = TRUE;
+    return TRUE;
+}
+
+/**
+ Return TRUE if any monitored directory has reported a change since the
+ cache was populated.
+
+ @return TRUE if a directory has changed, FALSE if none have.
+ */
+BOOL
+YoriShExecCacheHasDirectoryChanged(VOID)
+{
+    HANDLE Handles[MAXIMUM_WAIT_OBJECTS];
+    DWORD HandleCount;
+    DWORD DirIndex;
+    DWORD WaitResult;
+
+    HandleCount = 0;
+    for (DirIndex = 0; DirIndex < YoriShExecCache.DirectoryCount; DirIndex++) {
+        if (YoriShExecCache.Directories[DirIndex].ChangeNotification != INVALID_HANDLE_VALUE) {
+            Handles[HandleCount] = YoriShExecCache.Directories[DirIndex].ChangeNotification;
+            HandleCount++;
+        }
+
+        if (HandleCount == MAXIMUM_WAIT_OBJECTS ||
+            (HandleCount > 0 && DirIndex + 1 == YoriShExecCache.DirectoryCount)) {
+
+            WaitResult = WaitForMultipleObjects(HandleCount, Handles, FALSE, 0);
+            if (WaitResult != WAIT_TIMEOUT) {
+                return TRUE;
+            }
+            HandleCount = 0;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ Ensure the executable cache reflects the current PATH, PATHEXT, and the
+ contents of the directories within PATH, repopulating it if required.
+
+ @return TRUE if the cache can be used, FALSE if lookups should search the
+         file system directly.
+ */
+BOOL
+YoriShExecCacheValidate(VOID)
+{
+    YORI_STRING PathVariable;
+    YORI_STRING PathExtVariable;
+    BOOL Result;
+
+    if (!YoriShExecCacheCaptureVariable(_T("PATH"), NULL, &PathVariable)) {
+        return FALSE;
+    }
+
+    if (!YoriShExecCacheCaptureVariable(_T("PATHEXT"), YORI_SH_EXEC_CACHE_DEFAULT_PATHEXT, &PathExtVariable)) {
+        YoriLibFreeStringContents(&PathVariable);
+        return FALSE;
+    }
+
+    if (!YoriShExecCacheIsPathCacheable(&PathVariable)) {
+        YoriShFreeExecutableCache();
+        YoriLibFreeStringContents(&PathVariable);
+        YoriLibFreeStringContents(&PathExtVariable);
+        return FALSE;
+    }
+
+    if (YoriShExecCache.Populated &&
+        YoriLibCompareString(&PathVariable, &YoriShExecCache.PathVariable) == 0 &&
+        YoriLibCompareString(&PathExtVariable, &YoriShExecCache.PathExtVariable) == 0 &&
+        (YoriShExecCache.AllDirectoriesWatched ||
+         GetTickCount() - YoriShExecCache.PopulateTime < YORI_SH_EXEC_CACHE_UNWATCHED_LIFETIME) &&
+        !YoriShExecCacheHasDirectoryChanged()) {
+
+        YoriLibFreeStringContents(&PathVariable);
+        YoriLibFreeStringContents(&PathExtVariable);
+        return TRUE;
+    }
+
+    Result = YoriShExecCachePopulate(&PathVariable, &PathExtVariable);
+    YoriLibFreeStringContents(&PathVariable);
+    YoriLibFreeStringContents(&PathExtVariable);
+    return Result;
+}
+
+/**
+ Determine whether a search can be answered from the cache.  The cache can
+ answer searches for a bare name with no path and no extension, or for a
+ bare name prefix followed by a single trailing wildcard.  Anything else is
+ handled by searching the file system.
+
+ @param SearchFor The string being searched for.
+
+ @param IsPrefix On successful completion, set to TRUE if the search is for
+        a prefix, and FALSE if it is for an exact name.
+
+ @return TRUE if the cache can be used, FALSE if it cannot.
+ */
+__success(return)
+BOOL
+YoriShExecCacheIsSearchCacheable(
+    __in PYORI_STRING SearchFor,
+    __out PBOOLEAN IsPrefix
+    )
+{
+    DWORD Index;
+    DWORD Length;
+    TCHAR Char;
+
+    Length = SearchFor->LengthInChars;
+    *IsPrefix = FALSE;
+    if (Length > 0 && SearchFor->StartOfString[Length - 1] == '*') {
+        *IsPrefix = TRUE;
+        Length--;
+    }
+
+    if (Length == 0) {
+        return FALSE;
+    }
+
+    for (Index = 0; Index < Length; Index++) {
+        Char = SearchFor->StartOfString[Index];
+        if (YoriLibIsSep(Char) || Char == ':' || Char == '.' || Char == '*' || Char == '?') {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Check the current directory for an executable.  The current directory is
+ searched before PATH and changes frequently, so it is never cached.
+
+ @param SearchFor The name to search for, optionally followed by a wildcard.
+
+ @param MatchAllCallback Optional callback to invoke for every match.
+
+ @param MatchAllContext Context to pass to MatchAllCallback.
+
+ @param FoundPath On successful completion, contains the first match found,
+        or an empty string if no match was found.  The caller should free
+        this with @ref YoriLibFreeStringContents .
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShExecCacheSearchCurrentDirectory(
+    __in PYORI_STRING SearchFor,
+    __in_opt PYORI_LIB_PATH_MATCH_FN MatchAllCallback,
+    __in_opt PVOID MatchAllContext,
+    __out PYORI_STRING FoundPath
+    )
+{
+    TCHAR EmptyPathBuffer[1];
+    YORI_STRING EmptyPath;
+    DWORD CurDirLength;
+
+    CurDirLength = GetCurrentDirectory(0, NULL);
+    if (CurDirLength < MAX_PATH) {
+        CurDirLength = MAX_PATH;
+    }
+
+    if (!YoriLibAllocateString(FoundPath, CurDirLength + sizeof("\\\\?\\") + 256)) {
+        return FALSE;
+    }
+    FoundPath->StartOfString[0] = '\0';
+
+    EmptyPathBuffer[0] = '\0';
+    YoriLibInitEmptyString(&EmptyPath);
+    EmptyPath.StartOfString = EmptyPathBuffer;
+    EmptyPath.LengthAllocated = sizeof(EmptyPathBuffer)/sizeof(EmptyPathBuffer[0]);
+
+    if (!YoriLibPathLocateUnknownExtensionUnknownLocation(SearchFor, &EmptyPath, MatchAllCallback, MatchAllContext, FoundPath)) {
+        YoriLibFreeStringContents(FoundPath);
+        return FALSE;
+    }
+
+    FoundPath->LengthInChars = _tcslen(FoundPath->StartOfString);
+    return TRUE;
+}
+
+/**
+ Locate the first entry within a directory whose base name begins with the
+ specified prefix.
+
+ @param Directory The directory to search.
+
+ @param Prefix The prefix to search for.
+
+ @return The index of the first entry which is greater than or equal to the
+         prefix.  This may be equal to the number of entries if no entry
+         qualifies.
+ */
+DWORD
+YoriShExecCacheFindFirstWithPrefix(
+    __in PYORI_SH_EXEC_CACHE_DIRECTORY Directory,
+    __in PYORI_STRING Prefix
+    )
+{
+    DWORD Low;
+    DWORD High;
+    DWORD Mid;
+
+    Low = 0;
+    High = Directory->EntryCount;
+    while (Low < High) {
+        Mid = Low + (High - Low) / 2;
+        if (YoriLibCompareStringInsensitiveCount(&Directory->Entries[Mid].BaseName, Prefix, Prefix->LengthInChars) < 0) {
+            Low = Mid + 1;
+        } else {
+            High = Mid;
+        }
+    }
+
+    return Low;
+}
+
+/**
+ Locate an executable by searching the current directory, PATH and PATHEXT.
+ This has the same contract as @ref YoriLibLocateExecutableInPath , but
+ searches for bare names are answered from a cache of the contents of the
+ directories in PATH, which is refreshed when PATH, PATHEXT or any of the
+ directories change.
+
+ @param SearchFor The name to search for.
+
+ @param MatchAllCallback Optional callback to invoke for every match.  If not
+        specified, the first match is returned in PathName.
+
+ @param MatchAllContext Context to pass to MatchAllCallback.
+
+ @param PathName On successful completion, if MatchAllCallback is not
+        specified, contains the first match, or an empty string if no match
+        was found.
+
+ @return TRUE to indicate the lookup was successful, and FALSE to indicate a
+         lookup failure.  Success does not imply a match was found.
+ */
+__success(return)
+BOOL
+YoriShLocateExecutableInPath(
+    __in PYORI_STRING SearchFor,
+    __in_opt PYORI_LIB_PATH_MATCH_FN MatchAllCallback,
+    __in_opt PVOID MatchAllContext,
+    __out PYORI_STRING PathName
+    )
+{
+    BOOLEAN IsPrefix;
+    YORI_STRING FoundPath;
+    YORI_STRING Prefix;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_EXEC_CACHE_ENTRY Entry;
+    PYORI_SH_EXEC_CACHE_DIRECTORY Directory;
+    DWORD DirIndex;
+    DWORD EntryIndex;
+
+    if (!YoriShExecCacheIsSearchCacheable(SearchFor, &IsPrefix) ||
+        (IsPrefix && MatchAllCallback == NULL) ||
+        !YoriShExecCacheValidate()) {
+
+        return YoriLibLocateExecutableInPath(SearchFor, MatchAllCallback, MatchAllContext, PathName);
+    }
+
+    YoriLibInitEmptyString(PathName);
+
+    if (!YoriShExecCacheSearchCurrentDirectory(SearchFor, MatchAllCallback, MatchAllContext, &FoundPath)) {
+        return FALSE;
+    }
+
+    //
+    //  For a single match, the current directory takes precedence over
+    //  anything in PATH.  If nothing is there, the hash table contains the
+    //  entry that would be found first.
+    //
+
+    if (MatchAllCallback == NULL) {
+        if (FoundPath.LengthInChars > 0) {
+            memcpy(PathName, &FoundPath, sizeof(YORI_STRING));
+            return TRUE;
+        }
+        YoriLibFreeStringContents(&FoundPath);
+
+        HashEntry = YoriLibHashLookupByKey(YoriShExecCache.HashTable, SearchFor);
+        if (HashEntry != NULL) {
+            Entry = HashEntry->Context;
+            if (!YoriLibAllocateString(PathName, Entry->FullPath.LengthInChars + 1)) {
+                return FALSE;
+            }
+            memcpy(PathName->StartOfString, Entry->FullPath.StartOfString, (Entry->FullPath.LengthInChars + 1) * sizeof(TCHAR));
+            PathName->LengthInChars = Entry->FullPath.LengthInChars;
+        }
+        return TRUE;
+    }
+
+    YoriLibFreeStringContents(&FoundPath);
+
+    //
+    //  Report every match in every directory in PATH order.  Within each
+    //  directory, matches are found with a binary search of the sorted
+    //  entries.
+    //
+
+    YoriLibInitEmptyString(&Prefix);
+    Prefix.StartOfString = SearchFor->StartOfString;
+    Prefix.LengthInChars = SearchFor->LengthInChars;
+    if (IsPrefix) {
+        Prefix.LengthInChars--;
+    }
+
+    for (DirIndex = 0; DirIndex < YoriShExecCache.DirectoryCount; DirIndex++) {
+        Directory = &YoriShExecCache.Directories[DirIndex];
+        EntryIndex = YoriShExecCacheFindFirstWithPrefix(Directory, &Prefix);
+        for (; EntryIndex < Directory->EntryCount; EntryIndex++) {
+            Entry = &Directory->Entries[EntryIndex];
+            if (IsPrefix) {
+                if (YoriLibCompareStringInsensitiveCount(&Entry->BaseName, &Prefix, Prefix.LengthInChars) != 0) {
+                    break;
+                }
+            } else if (YoriLibCompareStringInsensitive(&Entry->BaseName, &Prefix) != 0) {
+                break;
+            }
+
+            if (!MatchAllCallback(&Entry->FullPath, MatchAllContext)) {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+// vim:sw=4:ts=4:et:
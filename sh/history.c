@@ -49,55 +49,302 @@ HANDLE YoriShHistoryLock;
 BOOL YoriShHistoryInitialized;
 
 /**
- Add an entered command into the command history buffer.
+ A hash table of every command in history, used to find an earlier copy of
+ a command which is being added again.
+ */
+PYORI_HASH_TABLE YoriShHistoryHash;
+
+/**
+ For each level of the prefix index, a hash table of the sets of history
+ entries which share a prefix.
+ */
+PYORI_HASH_TABLE YoriShHistoryPrefixHash[YORI_SH_HISTORY_INDEX_LEVELS];
+
+/**
+ For each level of the prefix index, the number of characters that entries
+ in a set share.
+ */
+CONST DWORD YoriShHistoryPrefixLength[YORI_SH_HISTORY_INDEX_LEVELS] = { 1, 4 };
+
+/**
+ A handle to a thread which is loading history from a file.  Note this may
+ be NULL if history is not being loaded from a file.  Once the thread has
+ completed, the handle remains valid until history is cleared.
+ */
+HANDLE YoriShHistoryLoadThread;
+
+/**
+ The number of lines believed to be in the history file, including lines
+ loaded from it and lines appended to it.  Since duplicates and entries
+ beyond the maximum are not retained in memory, this can grow beyond the
+ number of entries in history, at which point the file is rewritten.
+ */
+DWORD YoriShHistoryFileLines;
+
+/**
+ Wait for any background load of history from a file to complete.  This
+ must be called before examining the list of history.
+ */
+VOID
+YoriShWaitForHistoryLoad()
+{
+    if (YoriShHistoryLoadThread != NULL) {
+        WaitForSingleObject(YoriShHistoryLoadThread, INFINITE);
+    }
+}
+
+/**
+ Calculate a signature describing the pairs of adjacent characters within a
+ string.  Each pair sets one of 64 bits, so an entry can only contain a
+ substring if its signature contains every bit in the substring's
+ signature.  Pairs including a '*' are ignored, so a search string
+ consisting of several substrings separated by '*' can be described by a
+ single signature.
+
+ @param String Pointer to the string to calculate a signature for.
+
+ @return The signature of the string.
+ */
+DWORDLONG
+YoriShHistorySignature(
+    __in PYORI_STRING String
+    )
+{
+    DWORDLONG Signature;
+    DWORD Index;
+    TCHAR Char;
+    TCHAR PreviousChar;
+
+    Signature = 0;
+    PreviousChar = '*';
+    for (Index = 0; Index < String->LengthInChars; Index++) {
+        Char = YoriLibUpcaseChar(String->StartOfString[Index]);
+        if (Char != '*' && PreviousChar != '*') {
+            Signature = Signature | ((DWORDLONG)1 << ((PreviousChar * 31 + Char) & 63));
+        }
+        PreviousChar = Char;
+    }
+
+    return Signature;
+}
+
+/**
+ Return the key used to locate an entry within one level of the prefix
+ index.  This is the beginning of the command, which may be shorter than
+ the prefix length for the level if the command is short.
+
+ @param Level The level of the prefix index.
+
+ @param CmdLine Pointer to the command.
+
+ @param Key On completion, updated to refer to the beginning of the
+        command.  This does not reference the memory of the command.
+ */
+VOID
+YoriShHistoryPrefixKey(
+    __in DWORD Level,
+    __in PYORI_STRING CmdLine,
+    __out PYORI_STRING Key
+    )
+{
+    YoriLibInitEmptyString(Key);
+    Key->StartOfString = CmdLine->StartOfString;
+    Key->LengthInChars = CmdLine->LengthInChars;
+    if (Key->LengthInChars > YoriShHistoryPrefixLength[Level]) {
+        Key->LengthInChars = YoriShHistoryPrefixLength[Level];
+    }
+}
+
+/**
+ Insert a history entry into each level of the prefix index, creating sets
+ for prefixes which have not been seen before.  This is called with the
+ history lock held.
+
+ @param HistoryEntry Pointer to the entry to insert.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShInsertHistoryPrefixes(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    DWORD Level;
+    YORI_STRING Key;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_HISTORY_PREFIX PrefixSet;
+
+    for (Level = 0; Level < YORI_SH_HISTORY_INDEX_LEVELS; Level++) {
+        YoriShHistoryPrefixKey(Level, &HistoryEntry->CmdLine, &Key);
+        HashEntry = YoriLibHashLookupByKey(YoriShHistoryPrefixHash[Level], &Key);
+        if (HashEntry != NULL) {
+            PrefixSet = HashEntry->Context;
+        } else {
+            PrefixSet = YoriLibMalloc(sizeof(YORI_SH_HISTORY_PREFIX));
+            if (PrefixSet == NULL) {
+                return FALSE;
+            }
+
+            //
+            //  The key refers to the command of the first entry in the
+            //  set.  The hash table takes a reference on that memory, so
+            //  it remains valid if the entry is removed.
+            //
+
+            Key.MemoryToFree = HistoryEntry->CmdLine.MemoryToFree;
+            YoriLibInitializeListHead(&PrefixSet->EntryList);
+            YoriLibHashInsertByKey(YoriShHistoryPrefixHash[Level], &Key, PrefixSet, &PrefixSet->HashEntry);
+        }
+
+        YoriLibAppendList(&PrefixSet->EntryList, &HistoryEntry->PrefixListEntry[Level]);
+        HistoryEntry->PrefixSet[Level] = PrefixSet;
+    }
+
+    return TRUE;
+}
+
+/**
+ Remove a history entry from the list of history and every index, and free
+ it.  This is called with the history lock held.
+
+ @param HistoryEntry Pointer to the entry to remove.
+ */
+VOID
+YoriShFreeHistoryEntry(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    DWORD Level;
+    PYORI_SH_HISTORY_PREFIX PrefixSet;
+
+    for (Level = 0; Level < YORI_SH_HISTORY_INDEX_LEVELS; Level++) {
+        PrefixSet = HistoryEntry->PrefixSet[Level];
+        if (PrefixSet == NULL) {
+            continue;
+        }
+        YoriLibRemoveListItem(&HistoryEntry->PrefixListEntry[Level]);
+        if (YoriLibIsListEmpty(&PrefixSet->EntryList)) {
+            YoriLibHashRemoveByEntry(&PrefixSet->HashEntry);
+            YoriLibFree(PrefixSet);
+        }
+    }
+
+    if (HistoryEntry->HashEntry.HashTable != NULL) {
+        YoriLibHashRemoveByEntry(&HistoryEntry->HashEntry);
+    }
+
+    YoriLibRemoveListItem(&HistoryEntry->ListEntry);
+    YoriLibFreeStringContents(&HistoryEntry->CmdLine);
+    YoriLibFree(HistoryEntry);
+    YoriShCommandHistoryCount--;
+}
+
+/**
+ Add a command into the command history buffer and its indexes.  If the
+ command is already in history, the earlier copy is removed, so that the
+ command moves to the most recent position.
 
  @param NewCmd Pointer to a Yori string corresponding to the new
         entry to add to history.
- 
+
  @return TRUE to indicate an entry was successfully added, FALSE if it was
          not.
  */
 __success(return)
 BOOL
-YoriShAddToHistory(
+YoriShAddToHistoryInternal(
     __in PYORI_STRING NewCmd
     )
 {
-    DWORD LengthToAllocate;
+    DWORD Level;
     PYORI_SH_HISTORY_ENTRY NewHistoryEntry;
+    PYORI_HASH_ENTRY HashEntry;
 
     if (NewCmd->LengthInChars == 0) {
         return TRUE;
     }
 
-    LengthToAllocate = sizeof(YORI_SH_HISTORY_ENTRY);
-
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
 
-        NewHistoryEntry = YoriLibMalloc(LengthToAllocate);
+        if (YoriShHistoryHash == NULL) {
+            YoriShHistoryHash = YoriLibAllocateHashTable(1000);
+            if (YoriShHistoryHash == NULL) {
+                ReleaseMutex(YoriShHistoryLock);
+                return FALSE;
+            }
+        }
+
+        for (Level = 0; Level < YORI_SH_HISTORY_INDEX_LEVELS; Level++) {
+            if (YoriShHistoryPrefixHash[Level] == NULL) {
+                YoriShHistoryPrefixHash[Level] = YoriLibAllocateHashTable(250);
+                if (YoriShHistoryPrefixHash[Level] == NULL) {
+                    ReleaseMutex(YoriShHistoryLock);
+                    return FALSE;
+                }
+            }
+        }
+
+        if (YoriShGlobal.CommandHistory.Next == NULL) {
+            YoriLibInitializeListHead(&YoriShGlobal.CommandHistory);
+        }
+
+        //
+        //  Commands which differ only by case can have different meanings,
+        //  so only remove an earlier copy whose case matches exactly.
+        //
+
+        HashEntry = YoriLibHashLookupByKeyCaseSensitive(YoriShHistoryHash, NewCmd);
+        if (HashEntry != NULL) {
+            YoriShFreeHistoryEntry(HashEntry->Context);
+        }
+
+        NewHistoryEntry = YoriLibMalloc(sizeof(YORI_SH_HISTORY_ENTRY));
         if (NewHistoryEntry == NULL) {
             ReleaseMutex(YoriShHistoryLock);
             return FALSE;
         }
 
-        YoriLibCloneString(&NewHistoryEntry->CmdLine, NewCmd);
+        //
+        //  Cloning a string only references its allocation and cannot
+        //  fail.  If the command is not in an allocation, such as a
+        //  buffer on the caller's stack, history needs its own copy, and
+        //  allocating that can fail.
+        //
 
-        if (YoriShGlobal.CommandHistory.Next == NULL) {
-            YoriLibInitializeListHead(&YoriShGlobal.CommandHistory);
+        ZeroMemory(NewHistoryEntry, sizeof(YORI_SH_HISTORY_ENTRY));
+        if (NewCmd->MemoryToFree != NULL) {
+            YoriLibCloneString(&NewHistoryEntry->CmdLine, NewCmd);
+        } else {
+            if (!YoriLibAllocateString(&NewHistoryEntry->CmdLine, NewCmd->LengthInChars + 1)) {
+                YoriLibFree(NewHistoryEntry);
+                ReleaseMutex(YoriShHistoryLock);
+                return FALSE;
+            }
+            memcpy(NewHistoryEntry->CmdLine.StartOfString, NewCmd->StartOfString, NewCmd->LengthInChars * sizeof(TCHAR));
+            NewHistoryEntry->CmdLine.StartOfString[NewCmd->LengthInChars] = '\0';
+            NewHistoryEntry->CmdLine.LengthInChars = NewCmd->LengthInChars;
         }
+        NewHistoryEntry->Signature = YoriShHistorySignature(NewCmd);
 
         YoriLibAppendList(&YoriShGlobal.CommandHistory, &NewHistoryEntry->ListEntry);
         YoriShCommandHistoryCount++;
+
+        if (!YoriShInsertHistoryPrefixes(NewHistoryEntry)) {
+            YoriShFreeHistoryEntry(NewHistoryEntry);
+            ReleaseMutex(YoriShHistoryLock);
+            return FALSE;
+        }
+
+        YoriLibHashInsertByKey(YoriShHistoryHash, &NewHistoryEntry->CmdLine, NewHistoryEntry, &NewHistoryEntry->HashEntry);
+
         while (YoriShCommandHistoryCount > YoriShCommandHistoryMax) {
             PYORI_LIST_ENTRY ListEntry;
             PYORI_SH_HISTORY_ENTRY OldHistoryEntry;
 
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
             OldHistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
-            YoriLibRemoveListItem(ListEntry);
-            YoriLibFreeStringContents(&OldHistoryEntry->CmdLine);
-            YoriLibFree(OldHistoryEntry);
-            YoriShCommandHistoryCount--;
+            YoriShFreeHistoryEntry(OldHistoryEntry);
         }
         ReleaseMutex(YoriShHistoryLock);
     }
@@ -105,6 +352,145 @@ YoriShAddToHistory(
     return TRUE;
 }
 
+/**
+ Find the history file, if the user has requested one by setting
+ YORIHISTFILE.
+
+ @param FilePath On successful completion, populated with the full path to
+        the history file.  The caller should free this with
+        @ref YoriLibFreeStringContents .
+
+ @return TRUE to indicate a history file is configured and FilePath has been
+         populated, FALSE if no history file is configured or the path
+         could not be resolved.
+ */
+__success(return)
+BOOL
+YoriShGetHistoryFileName(
+    __out PYORI_STRING FilePath
+    )
+{
+    DWORD EnvVarLength;
+    YORI_STRING UserHistFileName;
+
+    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
+    if (EnvVarLength == 0) {
+        return FALSE;
+    }
+
+    if (!YoriLibAllocateString(&UserHistFileName, EnvVarLength)) {
+        return FALSE;
+    }
+
+    UserHistFileName.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), UserHistFileName.StartOfString, UserHistFileName.LengthAllocated, NULL);
+
+    if (UserHistFileName.LengthInChars == 0 || UserHistFileName.LengthInChars >= UserHistFileName.LengthAllocated) {
+        YoriLibFreeStringContents(&UserHistFileName);
+        return FALSE;
+    }
+
+    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, FilePath)) {
+        YoriLibFreeStringContents(&UserHistFileName);
+        return FALSE;
+    }
+
+    YoriLibFreeStringContents(&UserHistFileName);
+    return TRUE;
+}
+
+/**
+ Append a command to the end of the history file, if the user has requested
+ this behavior by setting YORIHISTFILE.  The command and its line ending
+ are written with a single call, so commands from several concurrent
+ shells are not interleaved.
+
+ @param NewCmd Pointer to the command to append.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShAppendToHistoryFile(
+    __in PYORI_STRING NewCmd
+    )
+{
+    YORI_STRING FilePath;
+    YORI_STRING Line;
+    HANDLE FileHandle;
+    BOOL Result;
+
+    if (!YoriShGetHistoryFileName(&FilePath)) {
+        return TRUE;
+    }
+
+    FileHandle = CreateFile(FilePath.StartOfString,
+                            FILE_APPEND_DATA,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+
+    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+        DWORD LastError = GetLastError();
+        LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        YoriLibFreeStringContents(&FilePath);
+        return FALSE;
+    }
+
+    YoriLibFreeStringContents(&FilePath);
+
+    if (!YoriLibAllocateString(&Line, NewCmd->LengthInChars + 3)) {
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
+
+    Line.LengthInChars = YoriLibSPrintf(Line.StartOfString, _T("%y\r\n"), NewCmd);
+    Result = YoriLibOutputTextToMultibyteDevice(FileHandle, Line.StartOfString, Line.LengthInChars);
+    if (Result) {
+        YoriShHistoryFileLines++;
+    }
+
+    YoriLibFreeStringContents(&Line);
+    CloseHandle(FileHandle);
+    return Result;
+}
+
+/**
+ Add an entered command into the command history buffer.
+
+ @param NewCmd Pointer to a Yori string corresponding to the new
+        entry to add to history.
+
+ @param SaveToFile If TRUE, the command is also appended to the history file
+        if the user has configured one.  This is FALSE for commands which
+        are being restored from a previous session.
+
+ @return TRUE to indicate an entry was successfully added, FALSE if it was
+         not.
+ */
+__success(return)
+BOOL
+YoriShAddToHistory(
+    __in PYORI_STRING NewCmd,
+    __in BOOL SaveToFile
+    )
+{
+    YoriShWaitForHistoryLoad();
+
+    if (!YoriShAddToHistoryInternal(NewCmd)) {
+        return FALSE;
+    }
+
+    if (SaveToFile && NewCmd->LengthInChars > 0) {
+        YoriShAppendToHistoryFile(NewCmd);
+    }
+
+    return TRUE;
+}
+
 /**
  Remove a single command from the history buffer.
 
@@ -116,10 +502,7 @@ YoriShRemoveOneHistoryEntry(
     )
 {
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
-        YoriLibRemoveListItem(&HistoryEntry->ListEntry);
-        YoriLibFreeStringContents(&HistoryEntry->CmdLine);
-        YoriLibFree(HistoryEntry);
-        YoriShCommandHistoryCount--;
+        YoriShFreeHistoryEntry(HistoryEntry);
         ReleaseMutex(YoriShHistoryLock);
     }
 }
@@ -132,16 +515,33 @@ YoriShClearAllHistory()
 {
     PYORI_LIST_ENTRY ListEntry = NULL;
     PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    DWORD Level;
+
+    YoriShWaitForHistoryLoad();
 
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
         ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
         while (ListEntry != NULL) {
             HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
-            YoriLibRemoveListItem(&HistoryEntry->ListEntry);
-            YoriLibFreeStringContents(&HistoryEntry->CmdLine);
-            YoriLibFree(HistoryEntry);
-            YoriShCommandHistoryCount--;
+            YoriShFreeHistoryEntry(HistoryEntry);
+        }
+
+        if (YoriShHistoryHash != NULL) {
+            YoriLibFreeEmptyHashTable(YoriShHistoryHash);
+            YoriShHistoryHash = NULL;
+        }
+
+        for (Level = 0; Level < YORI_SH_HISTORY_INDEX_LEVELS; Level++) {
+            if (YoriShHistoryPrefixHash[Level] != NULL) {
+                YoriLibFreeEmptyHashTable(YoriShHistoryPrefixHash[Level]);
+                YoriShHistoryPrefixHash[Level] = NULL;
+            }
+        }
+
+        if (YoriShHistoryLoadThread != NULL) {
+            CloseHandle(YoriShHistoryLoadThread);
+            YoriShHistoryLoadThread = NULL;
         }
         ReleaseMutex(YoriShHistoryLock);
     }
@@ -172,10 +572,12 @@ YoriShInitHistory()
     }
 
     //
-    //  Default the history buffer size to something sane.
+    //  Default the history buffer size to something sane.  Searches use
+    //  the history index rather than examining every entry, so this can
+    //  be large.
     //
 
-    YoriShCommandHistoryMax = 250;
+    YoriShCommandHistoryMax = 100000;
 
     if (YoriShGlobal.CommandHistory.Next == NULL) {
         YoriLibInitializeListHead(&YoriShGlobal.CommandHistory);
@@ -212,57 +614,73 @@ YoriShInitHistory()
 }
 
 /**
- Load history from a file if the user has requested this behavior by
- setting YORIHISTFILE.  Configure the maximum amount of history to retain
- if the user has requested this behavior by setting YORIHISTSIZE.
+ Add each line of a history file into the command history buffer.  A line
+ which is already in history moves to the most recent position.
 
- @return TRUE to indicate success, FALSE to indicate failure.
+ @param FileHandle Handle to the history file, opened for read.
+
+ @return The number of lines read from the file.
  */
-__success(return)
-BOOL
-YoriShLoadHistoryFromFile()
+DWORD
+YoriShReadHistoryFromHandle(
+    __in HANDLE FileHandle
+    )
 {
-    DWORD EnvVarLength;
-    YORI_STRING UserHistFileName;
-    YORI_STRING FilePath;
-    HANDLE FileHandle;
     PVOID LineContext = NULL;
     YORI_STRING LineString;
+    DWORD LinesRead;
 
-    if (YoriShHistoryInitialized) {
-        return TRUE;
-    }
+    YoriLibInitEmptyString(&LineString);
+    LinesRead = 0;
 
-    YoriShInitHistory();
+    while (TRUE) {
 
-    //
-    //  Check if there's a file to load saved history from.
-    //
+        if (!YoriLibMappedLineReadToString(&LineString, &LineContext, FileHandle)) {
+            break;
+        }
 
-    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
-    if (EnvVarLength == 0) {
-        return TRUE;
-    }
+        LinesRead++;
 
-    if (!YoriLibAllocateString(&UserHistFileName, EnvVarLength)) {
-        return FALSE;
-    }
+        //
+        //  If we fail to add to history, stop.  If it is added to history,
+        //  that string is now owned by the history buffer, so reinitialize
+        //  between lines.  The free below is really just a dereference.
+        //
 
-    UserHistFileName.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), UserHistFileName.StartOfString, UserHistFileName.LengthAllocated, NULL);
+        if (!YoriShAddToHistoryInternal(&LineString)) {
+            break;
+        }
 
-    if (UserHistFileName.LengthInChars == 0 || UserHistFileName.LengthInChars >= UserHistFileName.LengthAllocated) {
-        YoriLibFreeStringContents(&UserHistFileName);
-        return FALSE;
+        YoriLibFreeStringContents(&LineString);
+        YoriLibInitEmptyString(&LineString);
     }
 
-    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, &FilePath)) {
-        YoriLibFreeStringContents(&UserHistFileName);
-        return FALSE;
-    }
+    YoriLibMappedLineReadClose(LineContext);
+    YoriLibFreeStringContents(&LineString);
+    return LinesRead;
+}
 
-    YoriLibFreeStringContents(&UserHistFileName);
+/**
+ Load history from a file.  This is invoked on a background thread so that
+ the time taken to start the shell does not depend on the size of history.
 
-    FileHandle = CreateFile(FilePath.StartOfString,
+ @param Context Pointer to a Yori string containing the path to the history
+        file.  This is allocated with YoriLibMalloc and is freed by this
+        function.
+
+ @return Zero.
+ */
+DWORD WINAPI
+YoriShLoadHistoryThread(
+    __in LPVOID Context
+    )
+{
+    PYORI_STRING FilePath;
+    HANDLE FileHandle;
+
+    FilePath = (PYORI_STRING)Context;
+
+    FileHandle = CreateFile(FilePath->StartOfString,
                             GENERIC_READ,
                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
                             NULL,
@@ -274,46 +692,80 @@ YoriShLoadHistoryFromFile()
         DWORD LastError = GetLastError();
         if (LastError != ERROR_FILE_NOT_FOUND) {
             LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), FilePath, ErrText);
             YoriLibFreeWinErrorText(ErrText);
-            YoriLibFreeStringContents(&FilePath);
         }
-        return FALSE;
+        YoriLibFreeStringContents(FilePath);
+        YoriLibFree(FilePath);
+        return 0;
     }
 
-    YoriLibFreeStringContents(&FilePath);
+    YoriLibFreeStringContents(FilePath);
+    YoriLibFree(FilePath);
 
-    YoriLibInitEmptyString(&LineString);
+    YoriShHistoryFileLines = YoriShReadHistoryFromHandle(FileHandle);
 
-    while (TRUE) {
+    CloseHandle(FileHandle);
+    return 0;
+}
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, FileHandle)) {
-            break;
-        }
+/**
+ Load history from a file if the user has requested this behavior by
+ setting YORIHISTFILE.  Configure the maximum amount of history to retain
+ if the user has requested this behavior by setting YORIHISTSIZE.  The file
+ is loaded on a background thread; anything which examines history waits
+ for this to complete.
 
-        //
-        //  If we fail to add to history, stop.  If it is added to history,
-        //  that string is now owned by the history buffer, so reinitialize
-        //  between lines.  The free below is really just a dereference.
-        //
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShLoadHistoryFromFile()
+{
+    PYORI_STRING FilePath;
+    DWORD ThreadId;
 
-        if (!YoriShAddToHistory(&LineString)) {
-            break;
-        }
+    if (YoriShHistoryInitialized) {
+        return TRUE;
+    }
 
-        YoriLibFreeStringContents(&LineString);
-        YoriLibInitEmptyString(&LineString);
+    YoriShInitHistory();
+
+    //
+    //  Check if there's a file to load saved history from.
+    //
+
+    FilePath = YoriLibMalloc(sizeof(YORI_STRING));
+    if (FilePath == NULL) {
+        return FALSE;
+    }
+
+    if (!YoriShGetHistoryFileName(FilePath)) {
+        YoriLibFree(FilePath);
+        return TRUE;
+    }
+
+    YoriShHistoryLoadThread = CreateThread(NULL, 0, YoriShLoadHistoryThread, FilePath, 0, &ThreadId);
+    if (YoriShHistoryLoadThread == NULL) {
+        YoriShLoadHistoryThread(FilePath);
     }
 
-    YoriLibLineReadClose(LineContext);
-    YoriLibFreeStringContents(&LineString);
-    CloseHandle(FileHandle);
     return TRUE;
 }
 
 /**
- Write the current command history buffer to a file, if the user has requested
- this behavior by configuring the YORIHISTFILE environment variable.
+ Rewrite the history file to contain the current command history buffer,
+ if the user has requested this behavior by configuring the YORIHISTFILE
+ environment variable.  Since each command is appended to the file as it is
+ entered, this is only necessary once the file contains many lines which
+ are no longer in history, either because they are duplicates or because
+ they are older than the maximum amount of history to retain.
+
+ Other shells may have appended commands since this shell loaded the file,
+ so the file is read again first, which adds those commands to history.
+ The new file is written alongside the existing one and renamed over it.
+ A command appended by another shell between reading the file and renaming
+ the new one is lost.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
@@ -321,39 +773,47 @@ __success(return)
 BOOL
 YoriShSaveHistoryToFile()
 {
-    DWORD FileNameLength;
-    YORI_STRING UserHistFileName;
     YORI_STRING FilePath;
+    YORI_STRING TempPath;
     HANDLE FileHandle;
     PYORI_LIST_ENTRY ListEntry;
     PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    DWORD LinesWritten;
+    BOOL Result;
 
-    FileNameLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
-    if (FileNameLength == 0) {
+    YoriShWaitForHistoryLoad();
+
+    if (YoriShHistoryFileLines / 2 <= YoriShCommandHistoryCount) {
         return TRUE;
     }
 
-    if (!YoriLibAllocateString(&UserHistFileName, FileNameLength)) {
-        return FALSE;
+    if (!YoriShGetHistoryFileName(&FilePath)) {
+        return TRUE;
     }
 
-    UserHistFileName.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), UserHistFileName.StartOfString, UserHistFileName.LengthAllocated, NULL);
+    FileHandle = CreateFile(FilePath.StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
 
-    if (UserHistFileName.LengthInChars == 0 || UserHistFileName.LengthInChars >= UserHistFileName.LengthAllocated) {
-        YoriLibFreeStringContents(&UserHistFileName);
-        return FALSE;
+    if (FileHandle != NULL && FileHandle != INVALID_HANDLE_VALUE) {
+        YoriShReadHistoryFromHandle(FileHandle);
+        CloseHandle(FileHandle);
     }
 
-    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, &FilePath)) {
-        YoriLibFreeStringContents(&UserHistFileName);
+    if (!YoriLibAllocateString(&TempPath, FilePath.LengthInChars + sizeof(".new"))) {
+        YoriLibFreeStringContents(&FilePath);
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&UserHistFileName);
+    TempPath.LengthInChars = YoriLibSPrintf(TempPath.StartOfString, _T("%y.new"), &FilePath);
 
-    FileHandle = CreateFile(FilePath.StartOfString,
+    FileHandle = CreateFile(TempPath.StartOfString,
                             GENERIC_WRITE,
-                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            0,
                             NULL,
                             CREATE_ALWAYS,
                             FILE_ATTRIBUTE_NORMAL,
@@ -362,24 +822,30 @@ YoriShSaveHistoryToFile()
     if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
         DWORD LastError = GetLastError();
         LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &TempPath, ErrText);
         YoriLibFreeWinErrorText(ErrText);
+        YoriLibFreeStringContents(&TempPath);
         YoriLibFreeStringContents(&FilePath);
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&FilePath);
-
     //
     //  Search the list of history.
     //
 
+    Result = FALSE;
+    LinesWritten = 0;
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
+        Result = TRUE;
         ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
         while (ListEntry != NULL) {
             HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
 
-            YoriLibOutputToDevice(FileHandle, 0, _T("%y\n"), &HistoryEntry->CmdLine);
+            if (!YoriLibOutputToDevice(FileHandle, 0, _T("%y\n"), &HistoryEntry->CmdLine)) {
+                Result = FALSE;
+                break;
+            }
+            LinesWritten++;
 
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
         }
@@ -387,9 +853,216 @@ YoriShSaveHistoryToFile()
     }
 
     CloseHandle(FileHandle);
+
+    if (Result) {
+        Result = MoveFileEx(TempPath.StartOfString, FilePath.StartOfString, MOVEFILE_REPLACE_EXISTING);
+    }
+
+    if (Result) {
+        YoriShHistoryFileLines = LinesWritten;
+    } else {
+        DeleteFile(TempPath.StartOfString);
+    }
+
+    YoriLibFreeStringContents(&TempPath);
+    YoriLibFreeStringContents(&FilePath);
+    return Result;
+}
+
+/**
+ Prepare to search command history.  The search string consists of a prefix
+ which matching commands must begin with, optionally followed by a '*' and
+ one or more substrings separated by '*' which must be found in order after
+ the prefix.  A trailing '*' is permitted and has no effect.  Comparisons
+ are case insensitive.
+
+ @param SearchString Pointer to the search string.  This must remain valid
+        for as long as the search is in use.
+
+ @param Search On successful completion, populated with the state of the
+        search.
+ */
+VOID
+YoriShInitializeHistorySearch(
+    __in PYORI_STRING SearchString,
+    __out PYORI_SH_HISTORY_SEARCH Search
+    )
+{
+    DWORD Index;
+    DWORD Level;
+    YORI_STRING Key;
+    PYORI_HASH_ENTRY HashEntry;
+
+    YoriShWaitForHistoryLoad();
+
+    ZeroMemory(Search, sizeof(YORI_SH_HISTORY_SEARCH));
+
+    for (Index = 0; Index < SearchString->LengthInChars; Index++) {
+        if (SearchString->StartOfString[Index] == '*') {
+            break;
+        }
+    }
+
+    Search->Prefix.StartOfString = SearchString->StartOfString;
+    Search->Prefix.LengthInChars = Index;
+    if (Index < SearchString->LengthInChars) {
+        Search->Remainder.StartOfString = &SearchString->StartOfString[Index + 1];
+        Search->Remainder.LengthInChars = SearchString->LengthInChars - Index - 1;
+    }
+    Search->Signature = YoriShHistorySignature(&Search->Remainder);
+
+    //
+    //  Find the deepest level of the prefix index which the prefix is long
+    //  enough to use.  If there's no prefix, every entry must be examined.
+    //
+
+    Search->IndexLevel = YORI_SH_HISTORY_INDEX_LEVELS;
+    for (Level = 0; Level < YORI_SH_HISTORY_INDEX_LEVELS; Level++) {
+        if (Search->Prefix.LengthInChars >= YoriShHistoryPrefixLength[Level]) {
+            Search->IndexLevel = Level;
+        }
+    }
+
+    if (Search->IndexLevel < YORI_SH_HISTORY_INDEX_LEVELS &&
+        YoriShHistoryPrefixHash[Search->IndexLevel] != NULL) {
+
+        YoriShHistoryPrefixKey(Search->IndexLevel, &Search->Prefix, &Key);
+        HashEntry = YoriLibHashLookupByKey(YoriShHistoryPrefixHash[Search->IndexLevel], &Key);
+        if (HashEntry != NULL) {
+            Search->PrefixSet = HashEntry->Context;
+        }
+    }
+}
+
+/**
+ Check whether a history entry matches a search.
+
+ @param Search Pointer to the search.
+
+ @param HistoryEntry Pointer to the history entry to check.
+
+ @return TRUE if the entry matches, FALSE if it does not.
+ */
+BOOL
+YoriShHistoryEntryMatchesSearch(
+    __in PYORI_SH_HISTORY_SEARCH Search,
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    YORI_STRING Remaining;
+    YORI_STRING Substring;
+    DWORD Index;
+    DWORD MatchOffset;
+
+    if ((HistoryEntry->Signature & Search->Signature) != Search->Signature) {
+        return FALSE;
+    }
+
+    if (YoriLibCompareStringInsensitiveCount(&HistoryEntry->CmdLine, &Search->Prefix, Search->Prefix.LengthInChars) != 0) {
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&Remaining);
+    Remaining.StartOfString = &HistoryEntry->CmdLine.StartOfString[Search->Prefix.LengthInChars];
+    Remaining.LengthInChars = HistoryEntry->CmdLine.LengthInChars - Search->Prefix.LengthInChars;
+
+    YoriLibInitEmptyString(&Substring);
+    Substring.StartOfString = Search->Remainder.StartOfString;
+    for (Index = 0; Index <= Search->Remainder.LengthInChars; Index++) {
+        if (Index < Search->Remainder.LengthInChars &&
+            Search->Remainder.StartOfString[Index] != '*') {
+
+            continue;
+        }
+
+        Substring.LengthInChars = (DWORD)(&Search->Remainder.StartOfString[Index] - Substring.StartOfString);
+        if (Substring.LengthInChars > 0) {
+            if (YoriLibFindFirstMatchingSubstringInsensitive(&Remaining, 1, &Substring, &MatchOffset) == NULL) {
+                return FALSE;
+            }
+            Remaining.StartOfString += MatchOffset + Substring.LengthInChars;
+            Remaining.LengthInChars -= MatchOffset + Substring.LengthInChars;
+        }
+        Substring.StartOfString = &Search->Remainder.StartOfString[Index + 1];
+    }
+
     return TRUE;
 }
 
+/**
+ Return the next command in history which matches a search, starting from
+ the most recent command.  If the search has a prefix, only the set of
+ entries which share the beginning of the prefix is examined.
+
+ @param Search Pointer to the search, which has been prepared with
+        @ref YoriShInitializeHistorySearch .  History should not be modified
+        while a search is in progress.
+
+ @param PreviousMatch If specified, the previously returned entry.  If NULL,
+        the most recent matching entry is returned.
+
+ @return Pointer to the next matching entry, or NULL if there are no more
+         matching entries.
+ */
+PYORI_SH_HISTORY_ENTRY
+YoriShGetPreviousHistoryMatch(
+    __in PYORI_SH_HISTORY_SEARCH Search,
+    __in_opt PYORI_SH_HISTORY_ENTRY PreviousMatch
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    DWORD Level;
+
+    Level = Search->IndexLevel;
+
+    if (Level < YORI_SH_HISTORY_INDEX_LEVELS) {
+        if (Search->PrefixSet == NULL) {
+            return NULL;
+        }
+
+        ListEntry = NULL;
+        if (PreviousMatch != NULL) {
+            ListEntry = &PreviousMatch->PrefixListEntry[Level];
+        }
+
+        while (TRUE) {
+            ListEntry = YoriLibGetPreviousListEntry(&Search->PrefixSet->EntryList, ListEntry);
+            if (ListEntry == NULL) {
+                break;
+            }
+            HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, PrefixListEntry[Level]);
+            if (YoriShHistoryEntryMatchesSearch(Search, HistoryEntry)) {
+                return HistoryEntry;
+            }
+        }
+
+        return NULL;
+    }
+
+    if (YoriShGlobal.CommandHistory.Next == NULL) {
+        return NULL;
+    }
+
+    ListEntry = NULL;
+    if (PreviousMatch != NULL) {
+        ListEntry = &PreviousMatch->ListEntry;
+    }
+
+    while (TRUE) {
+        ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+        if (ListEntry == NULL) {
+            break;
+        }
+        HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
+        if (YoriShHistoryEntryMatchesSearch(Search, HistoryEntry)) {
+            return HistoryEntry;
+        }
+    }
+
+    return NULL;
+}
+
 /**
  Build history into an array of NULL terminated strings terminated by an
  additional NULL terminator.  The result must be freed with a subsequent
@@ -417,6 +1090,8 @@ YoriShGetHistoryStrings(
     PYORI_SH_HISTORY_ENTRY HistoryEntry;
     PYORI_LIST_ENTRY StartReturningFrom = NULL;
 
+    YoriShWaitForHistoryLoad();
+
     if (YoriShGlobal.CommandHistory.Next != NULL) {
         DWORD EntriesToSkip = 0;
         if (YoriShCommandHistoryCount > MaximumNumber && MaximumNumber > 0) {
@@ -471,7 +1146,7 @@ YoriShGetHistoryStrings(
 
  @param NewCmd Pointer to a Yori string corresponding to the new
         entry to add to history.
- 
+
  @return TRUE to indicate an entry was successfully added, FALSE if it was
          not.
  */
@@ -499,7 +1174,7 @@ YoriShAddToHistoryAndReallocate(
     //  function can unconditionally dereference the string
     //
 
-    if (!YoriShAddToHistory(&NewString)) {
+    if (!YoriShAddToHistory(&NewString, TRUE)) {
         YoriLibFreeStringContents(&NewString);
         return FALSE;
     }
@@ -510,4 +1185,3 @@ YoriShAddToHistoryAndReallocate(
 
 
 // vim:sw=4:ts=4:et:
-
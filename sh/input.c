@@ -1791,6 +1791,7 @@ YoriShProcessEnhancedKeyDown(
     KeyCode = InputRecord->Event.KeyEvent.wVirtualKeyCode;
 
     if (KeyCode == VK_UP) {
+        YoriShWaitForHistoryLoad();
         NewEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, Buffer->HistoryEntryToUse);
         if (NewEntry != NULL) {
             Buffer->HistoryEntryToUse = NewEntry;
@@ -2788,7 +2789,7 @@ YoriShGetExpressionFromConsole(
                 YoriShTerminateInput(&Buffer);
                 ReadConsoleInput(InputHandle, InputRecords, CurrentRecordIndex + 1, &ActuallyRead);
                 if (Buffer.String.LengthInChars > 0) {
-                    YoriShAddToHistory(&Buffer.String);
+                    YoriShAddToHistory(&Buffer.String, TRUE);
                 }
                 memcpy(Expression, &Buffer.String, sizeof(YORI_STRING));
                 return TRUE;
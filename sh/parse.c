@@ -1854,7 +1854,7 @@ YoriShResolveCommandToExecutable(
 
     YoriShExpandAlias(CmdContext);
 
-    if (YoriLibLocateExecutableInPath(&CmdContext->ArgV[0], NULL, NULL, &FoundExecutable) && FoundExecutable.LengthInChars > 0) {
+    if (YoriShLocateExecutableInPath(&CmdContext->ArgV[0], NULL, NULL, &FoundExecutable) && FoundExecutable.LengthInChars > 0) {
         YoriLibFreeStringContents(&CmdContext->ArgV[0]);
         memcpy(&CmdContext->ArgV[0], &FoundExecutable, sizeof(YORI_STRING));
         *ExecutableFound = TRUE;
@@ -38,6 +38,40 @@ BOOL YoriShPromptAdminDetermined;
  */
 BOOL YoriShPromptAdminPresent;
 
+/**
+ A prompt or title string compiled into a template, along with the string it
+ was compiled from, so that it is only compiled again when the string
+ changes.
+ */
+typedef struct _YORI_SH_PROMPT_TEMPLATE {
+
+    /**
+     A copy of the string that the template was compiled from.
+     */
+    YORI_STRING Source;
+
+    /**
+     The compiled template.
+     */
+    YORI_LIB_FORMAT_TEMPLATE Template;
+} YORI_SH_PROMPT_TEMPLATE, *PYORI_SH_PROMPT_TEMPLATE;
+
+/**
+ The most recently compiled prompt string.
+ */
+YORI_SH_PROMPT_TEMPLATE YoriShPromptTemplate;
+
+/**
+ The most recently compiled title string.
+ */
+YORI_SH_PROMPT_TEMPLATE YoriShTitleTemplate;
+
+/**
+ A buffer to expand the prompt and title into, which is reused each time
+ the prompt is displayed.
+ */
+YORI_STRING YoriShPromptDisplayString;
+
 /**
  Return TRUE if the process is running as part of the administrator group,
  FALSE if not.
@@ -65,6 +99,8 @@ YoriShPromptIsAdmin()
 
  @param OutputString The string to output the result of variable expansion to.
 
+ @param VariableId Ignored.
+
  @param VariableName The name of the variable that requires expansion.
 
  @param Context Ignored.
@@ -75,12 +111,14 @@ YoriShPromptIsAdmin()
 DWORD
 YoriShExpandPrompt(
     __inout PYORI_STRING OutputString,
+    __in DWORD VariableId,
     __in PYORI_STRING VariableName,
     __in PVOID Context
     )
 {
     DWORD CharsNeeded = 0;
 
+    UNREFERENCED_PARAMETER(VariableId);
     UNREFERENCED_PARAMETER(Context);
 
     if (YoriLibCompareStringWithLiteralInsensitive(VariableName, _T("A")) == 0) {
@@ -170,6 +208,62 @@ YoriShExpandPrompt(
     return CharsNeeded;
 }
 
+/**
+ Expand variables in a prompt or title string, compiling the string into a
+ template only if it differs from the string previously compiled.
+
+ @param Cache Pointer to the template most recently compiled for this use.
+
+ @param String The string to expand.
+
+ @param DisplayString On successful completion, populated with the expanded
+        string.  Any existing buffer is reused if it is large enough.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShExpandPromptTemplate(
+    __inout PYORI_SH_PROMPT_TEMPLATE Cache,
+    __in PYORI_STRING String,
+    __inout PYORI_STRING DisplayString
+    )
+{
+    if (Cache->Source.StartOfString == NULL ||
+        YoriLibCompareString(&Cache->Source, String) != 0) {
+
+        YoriLibFreeFormatTemplate(&Cache->Template);
+        YoriLibFreeStringContents(&Cache->Source);
+
+        if (!YoriLibAllocateString(&Cache->Source, String->LengthInChars + 1)) {
+            return FALSE;
+        }
+
+        if (!YoriLibCompileFormatTemplate(&Cache->Template, String, '$', FALSE, NULL, NULL)) {
+            YoriLibFreeStringContents(&Cache->Source);
+            return FALSE;
+        }
+
+        memcpy(Cache->Source.StartOfString, String->StartOfString, String->LengthInChars * sizeof(TCHAR));
+        Cache->Source.LengthInChars = String->LengthInChars;
+    }
+
+    return YoriLibExpandFormatTemplate(&Cache->Template, YoriShExpandPrompt, NULL, DisplayString);
+}
+
+/**
+ Free the compiled prompt and title strings on process termination.
+ */
+VOID
+YoriShCleanupPrompt(VOID)
+{
+    YoriLibFreeFormatTemplate(&YoriShPromptTemplate.Template);
+    YoriLibFreeStringContents(&YoriShPromptTemplate.Source);
+    YoriLibFreeFormatTemplate(&YoriShTitleTemplate.Template);
+    YoriLibFreeStringContents(&YoriShTitleTemplate.Source);
+    YoriLibFreeStringContents(&YoriShPromptDisplayString);
+}
+
 /**
  Displays the current prompt string on the console.
 
@@ -182,7 +276,6 @@ YoriShDisplayPrompt()
     YORI_STRING PromptVar;
     YORI_STRING PromptAfterBackquoteExpansion;
     YORI_STRING PromptAfterEnvExpansion;
-    YORI_STRING DisplayString;
     PYORI_STRING StringToUse;
     DWORD SavedErrorLevel = YoriShGlobal.ErrorLevel;
 
@@ -247,7 +340,6 @@ YoriShDisplayPrompt()
 
         YoriLibInitEmptyString(&PromptAfterBackquoteExpansion);
         YoriLibInitEmptyString(&PromptAfterEnvExpansion);
-        YoriLibInitEmptyString(&DisplayString);
 
         //
         //  Get the raw prompt expression.
@@ -278,15 +370,13 @@ YoriShDisplayPrompt()
         //  Expand any prompt command variables.
         //
 
-        YoriLibExpandCommandVariables(StringToUse, '$', FALSE, YoriShExpandPrompt, NULL, &DisplayString);
+        if (YoriShExpandPromptTemplate(&YoriShPromptTemplate, StringToUse, &YoriShPromptDisplayString)) {
 
-        //
-        //  Display the result.
-        //
+            //
+            //  Display the result.
+            //
 
-        if (DisplayString.StartOfString != NULL) {
-            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &DisplayString);
-            YoriLibFreeStringContents(&DisplayString);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &YoriShPromptDisplayString);
         }
 
         //
@@ -345,7 +435,6 @@ YoriShDisplayPrompt()
 
         YoriLibInitEmptyString(&PromptAfterBackquoteExpansion);
         YoriLibInitEmptyString(&PromptAfterEnvExpansion);
-        YoriLibInitEmptyString(&DisplayString);
 
         //
         //  Get the raw title expression.
@@ -376,15 +465,13 @@ YoriShDisplayPrompt()
         //  Expand any prompt command variables.
         //
 
-        YoriLibExpandCommandVariables(StringToUse, '$', FALSE, YoriShExpandPrompt, NULL, &DisplayString);
+        if (YoriShExpandPromptTemplate(&YoriShTitleTemplate, StringToUse, &YoriShPromptDisplayString)) {
 
-        //
-        //  Display the result.
-        //
+            //
+            //  Display the result.
+            //
 
-        if (DisplayString.StartOfString != NULL) {
-            SetConsoleTitle(DisplayString.StartOfString);
-            YoriLibFreeStringContents(&DisplayString);
+            SetConsoleTitle(YoriShPromptDisplayString.StartOfString);
         }
 
         //
@@ -330,6 +330,20 @@ YoriShSetEnvironmentStrings(
     __in PYORI_STRING NewEnv
     );
 
+// *** EXECACHE.C ***
+
+VOID
+YoriShFreeExecutableCache(VOID);
+
+__success(return)
+BOOL
+YoriShLocateExecutableInPath(
+    __in PYORI_STRING SearchFor,
+    __in_opt PYORI_LIB_PATH_MATCH_FN MatchAllCallback,
+    __in_opt PVOID MatchAllContext,
+    __out PYORI_STRING PathName
+    );
+
 // *** EXEC.C ***
 
 DWORD
@@ -356,6 +370,9 @@ YoriShExecuteExpressionAndCaptureOutput(
     __out PYORI_STRING ProcessOutput
     );
 
+VOID
+YoriShClearBackquoteCache(VOID);
+
 __success(return)
 BOOL
 YoriShExpandBackquotes(
@@ -374,7 +391,8 @@ YoriShExecuteExpression(
 __success(return)
 BOOL
 YoriShAddToHistory(
-    __in PYORI_STRING NewCmd
+    __in PYORI_STRING NewCmd,
+    __in BOOL SaveToFile
     );
 
 __success(return)
@@ -410,6 +428,21 @@ YoriShGetHistoryStrings(
     __inout PYORI_STRING HistoryStrings
     );
 
+VOID
+YoriShWaitForHistoryLoad();
+
+VOID
+YoriShInitializeHistorySearch(
+    __in PYORI_STRING SearchString,
+    __out PYORI_SH_HISTORY_SEARCH Search
+    );
+
+PYORI_SH_HISTORY_ENTRY
+YoriShGetPreviousHistoryMatch(
+    __in PYORI_SH_HISTORY_SEARCH Search,
+    __in_opt PYORI_SH_HISTORY_ENTRY PreviousMatch
+    );
+
 // *** INPUT.C ***
 
 __success(return)
@@ -606,6 +639,9 @@ YoriShFindBestBackquoteSubstringAtOffset(
     );
 
 // *** PROMPT.C ***
+VOID
+YoriShCleanupPrompt(VOID);
+
 BOOL
 YoriShDisplayPrompt();
 
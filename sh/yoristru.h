@@ -417,6 +417,31 @@ typedef struct _YORI_SH_EXEC_PLAN {
 
 } YORI_SH_EXEC_PLAN, *PYORI_SH_EXEC_PLAN;
 
+/**
+ The number of levels in the index of history by prefix.  Each level groups
+ commands by a longer prefix.
+ */
+#define YORI_SH_HISTORY_INDEX_LEVELS 2
+
+/**
+ A set of previous commands which begin with the same characters, compared
+ case insensitively.  A search for commands beginning with a prefix only
+ needs to examine the set that shares the beginning of the prefix.
+ */
+typedef struct _YORI_SH_HISTORY_PREFIX {
+
+    /**
+     The entry for this set within the hash table of sets for its level of
+     the index.  The key is the prefix shared by the commands in the set.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The list of history entries in this set, in the order they were added.
+     */
+    YORI_LIST_ENTRY EntryList;
+} YORI_SH_HISTORY_PREFIX, *PYORI_SH_HISTORY_PREFIX;
+
 /**
  Information about a previous command executed by the user.
  */
@@ -431,8 +456,68 @@ typedef struct _YORI_SH_HISTORY_ENTRY {
      The command that was executed by the user.
      */
     YORI_STRING CmdLine;
+
+    /**
+     The entry for this command within the hash table of history, used to
+     find an earlier copy of a command which is being added again.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     For each level of the prefix index, the links of this entry within the
+     set of entries sharing its prefix.
+     */
+    YORI_LIST_ENTRY PrefixListEntry[YORI_SH_HISTORY_INDEX_LEVELS];
+
+    /**
+     For each level of the prefix index, the set of entries sharing its
+     prefix.
+     */
+    PYORI_SH_HISTORY_PREFIX PrefixSet[YORI_SH_HISTORY_INDEX_LEVELS];
+
+    /**
+     A bit for each pair of adjacent characters in the command, used to skip
+     entries which cannot contain a substring being searched for.
+     */
+    DWORDLONG Signature;
 } YORI_SH_HISTORY_ENTRY, *PYORI_SH_HISTORY_ENTRY;
 
+/**
+ The state of a search through command history.
+ */
+typedef struct _YORI_SH_HISTORY_SEARCH {
+
+    /**
+     The characters which matching commands must begin with.
+     */
+    YORI_STRING Prefix;
+
+    /**
+     Text which must follow the prefix, consisting of substrings separated
+     by '*' which must be found in order.
+     */
+    YORI_STRING Remainder;
+
+    /**
+     The signature of the substrings in Remainder.  Entries whose signature
+     does not contain every bit in this signature cannot match.
+     */
+    DWORDLONG Signature;
+
+    /**
+     The level of the prefix index used to find candidate entries, or
+     YORI_SH_HISTORY_INDEX_LEVELS if the prefix is too short to use the
+     index and every entry must be examined.
+     */
+    DWORD IndexLevel;
+
+    /**
+     If IndexLevel refers to a level of the index, the set of entries which
+     share the beginning of the prefix.  NULL if no entries do.
+     */
+    PYORI_SH_HISTORY_PREFIX PrefixSet;
+} YORI_SH_HISTORY_SEARCH, *PYORI_SH_HISTORY_SEARCH;
+
 /**
  Information about a single tab complete match.
  */
@@ -56,6 +56,16 @@ SplitHelp()
     return TRUE;
 }
 
+/**
+ The size of each buffer used when copying data, in bytes.
+ */
+#define SPLIT_BUFFER_SIZE (1024 * 1024)
+
+/**
+ The maximum number of parts to write at the same time.
+ */
+#define SPLIT_MAX_THREADS (4)
+
 /**
  Context passed to the callback which is invoked for each file found.
  */
@@ -89,28 +99,88 @@ typedef struct _SPLIT_CONTEXT {
      */
     YORI_STRING Prefix;
 
+    /**
+     The source stream.  This is only used when the source is split by
+     multiple threads.
+     */
+    HANDLE hSource;
+
+    /**
+     A mutex which serializes access to CurrentPartNumber when the source
+     is split by multiple threads.
+     */
+    HANDLE Mutex;
+
+    /**
+     When the source is split by multiple threads, the total number of
+     parts to write.
+     */
+    LONGLONG NumberOfParts;
+
+    /**
+     TRUE if hSource was opened for overlapped IO, meaning that any thread
+     can read from any offset.
+     */
+    BOOLEAN SourceOverlapped;
+
+    /**
+     Set to TRUE if any thread splitting the source encountered an error.
+     */
+    BOOLEAN WorkerFailed;
+
 } SPLIT_CONTEXT, *PSPLIT_CONTEXT;
 
+/**
+ A pair of buffers used to copy data, so that one can be read into while
+ the other is being written, along with the events used to wait for each.
+ */
+typedef struct _SPLIT_COPY_BUFFERS {
+
+    /**
+     The buffers, each of SPLIT_BUFFER_SIZE bytes.
+     */
+    PUCHAR Buffer[2];
+
+    /**
+     An event signalled when a read completes.
+     */
+    HANDLE ReadEvent;
+
+    /**
+     An event signalled when a write completes.
+     */
+    HANDLE WriteEvent;
+
+} SPLIT_COPY_BUFFERS, *PSPLIT_COPY_BUFFERS;
+
 /**
  Open a file in which to output the result of a fragment of the split
  operation.
 
- @param SplitContext Pointer to a context describing the split operation
-        and its current state.
+ @param SplitContext Pointer to a context describing the split operation.
+
+ @param PartNumber The number of the part to open.  This is appended to the
+        prefix to form the file name.
+
+ @param Overlapped TRUE if the file should be opened for overlapped IO,
+        FALSE if it should be opened for synchronous IO.
 
  @return Handle to the opened object, or NULL on failure.
  */
 HANDLE
-SplitOpenTargetForCurrentPart(
-    __in PSPLIT_CONTEXT SplitContext
+SplitOpenTargetForPart(
+    __in PSPLIT_CONTEXT SplitContext,
+    __in LONGLONG PartNumber,
+    __in BOOLEAN Overlapped
     )
 {
     LPTSTR NewFileName;
     YORI_STRING NumberString;
     HANDLE hDestFile;
+    DWORD FlagsAndAttributes;
 
     YoriLibInitEmptyString(&NumberString);
-    if (!YoriLibNumberToString(&NumberString, SplitContext->CurrentPartNumber, 10, 0, '\0')) {
+    if (!YoriLibNumberToString(&NumberString, PartNumber, 10, 0, '\0')) {
         return NULL;
     }
 
@@ -123,12 +193,17 @@ SplitOpenTargetForCurrentPart(
     YoriLibSPrintf(NewFileName, _T("%y%y"), &SplitContext->Prefix, &NumberString);
     YoriLibFreeStringContents(&NumberString);
 
+    FlagsAndAttributes = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS;
+    if (Overlapped) {
+        FlagsAndAttributes |= FILE_FLAG_OVERLAPPED;
+    }
+
     hDestFile = CreateFile(NewFileName,
                            GENERIC_WRITE,
                            FILE_SHARE_READ|FILE_SHARE_DELETE,
                            NULL,
                            CREATE_ALWAYS,
-                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
+                           FlagsAndAttributes,
                            NULL);
     if (hDestFile == INVALID_HANDLE_VALUE) {
         DWORD LastError = GetLastError();
@@ -143,6 +218,427 @@ SplitOpenTargetForCurrentPart(
     return hDestFile;
 }
 
+/**
+ Free the buffers and events used to copy data.
+
+ @param Buffers Pointer to the buffers to free.
+ */
+VOID
+SplitCleanupBuffers(
+    __inout PSPLIT_COPY_BUFFERS Buffers
+    )
+{
+    DWORD Index;
+
+    for (Index = 0; Index < sizeof(Buffers->Buffer)/sizeof(Buffers->Buffer[0]); Index++) {
+        if (Buffers->Buffer[Index] != NULL) {
+            YoriLibFree(Buffers->Buffer[Index]);
+            Buffers->Buffer[Index] = NULL;
+        }
+    }
+
+    if (Buffers->ReadEvent != NULL) {
+        CloseHandle(Buffers->ReadEvent);
+        Buffers->ReadEvent = NULL;
+    }
+
+    if (Buffers->WriteEvent != NULL) {
+        CloseHandle(Buffers->WriteEvent);
+        Buffers->WriteEvent = NULL;
+    }
+}
+
+/**
+ Allocate the buffers and events used to copy data.
+
+ @param Buffers Pointer to the buffers to initialize.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+SplitInitializeBuffers(
+    __out PSPLIT_COPY_BUFFERS Buffers
+    )
+{
+    DWORD Index;
+
+    ZeroMemory(Buffers, sizeof(SPLIT_COPY_BUFFERS));
+
+    for (Index = 0; Index < sizeof(Buffers->Buffer)/sizeof(Buffers->Buffer[0]); Index++) {
+        Buffers->Buffer[Index] = YoriLibMalloc(SPLIT_BUFFER_SIZE);
+        if (Buffers->Buffer[Index] == NULL) {
+            SplitCleanupBuffers(Buffers);
+            return FALSE;
+        }
+    }
+
+    Buffers->ReadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    Buffers->WriteEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (Buffers->ReadEvent == NULL || Buffers->WriteEvent == NULL) {
+        SplitCleanupBuffers(Buffers);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Display an error encountered when reading or writing data.
+
+ @param Operation Pointer to a string describing the operation that failed.
+
+ @param LastError The Win32 error code describing the failure.
+ */
+VOID
+SplitDisplayIoError(
+    __in LPCTSTR Operation,
+    __in DWORD LastError
+    )
+{
+    LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: %s failed: %s"), Operation, ErrText);
+    YoriLibFreeWinErrorText(ErrText);
+}
+
+/**
+ Wait for an overlapped write to complete and check that all of the data
+ was written.
+
+ @param hTarget Handle to the target file.
+
+ @param WriteOverlapped Pointer to the overlapped structure describing the
+        write.
+
+ @param BytesExpected The number of bytes that the write was issued for.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  On failure,
+         an error has been displayed.
+ */
+BOOL
+SplitCompleteWrite(
+    __in HANDLE hTarget,
+    __in LPOVERLAPPED WriteOverlapped,
+    __in DWORD BytesExpected
+    )
+{
+    DWORD BytesWritten;
+
+    if (!GetOverlappedResult(hTarget, WriteOverlapped, &BytesWritten, TRUE)) {
+        SplitDisplayIoError(_T("write"), GetLastError());
+        return FALSE;
+    }
+
+    if (BytesWritten != BytesExpected) {
+        SplitDisplayIoError(_T("write"), ERROR_DISK_FULL);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Copy data from a source stream to a target file.  Two buffers are used so
+ that the next block is read while the previous block is being written,
+ and memory usage does not depend on the amount of data copied.
+
+ @param hSource Handle to the source stream.
+
+ @param SourceOverlapped TRUE if hSource was opened for overlapped IO, in
+        which case reads are issued at SourceOffset.  If FALSE, reads are
+        synchronous from the current position of the stream.
+
+ @param SourceOffset If SourceOverlapped is TRUE, the offset within the
+        source to begin copying from.
+
+ @param hTarget Handle to the target file, which must be opened for
+        overlapped IO.
+
+ @param TargetOffset The offset within the target to begin writing to.
+
+ @param BytesToCopy The maximum number of bytes to copy.  Fewer bytes are
+        copied if the end of the source is reached.
+
+ @param Buffers Pointer to the buffers and events to use for the copy.
+
+ @param InitialBytes The number of bytes that the caller has already read
+        into the first buffer, which are written before any further data is
+        read.  These count towards BytesToCopy.
+
+ @param BytesCopied On completion, set to the number of bytes written to
+        the target.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  On failure,
+         an error has been displayed.
+ */
+BOOL
+SplitCopyRange(
+    __in HANDLE hSource,
+    __in BOOLEAN SourceOverlapped,
+    __in LONGLONG SourceOffset,
+    __in HANDLE hTarget,
+    __in LONGLONG TargetOffset,
+    __in LONGLONG BytesToCopy,
+    __in PSPLIT_COPY_BUFFERS Buffers,
+    __in DWORD InitialBytes,
+    __out PLONGLONG BytesCopied
+    )
+{
+    OVERLAPPED ReadOverlapped;
+    OVERLAPPED WriteOverlapped;
+    LARGE_INTEGER Offset;
+    LONGLONG Remaining;
+    DWORD BytesToRead;
+    DWORD BytesRead;
+    DWORD BytesPending;
+    DWORD CurrentBuffer;
+    DWORD LastError;
+    BOOL WritePending;
+    BOOL Result;
+
+    ZeroMemory(&ReadOverlapped, sizeof(ReadOverlapped));
+    ReadOverlapped.hEvent = Buffers->ReadEvent;
+    ZeroMemory(&WriteOverlapped, sizeof(WriteOverlapped));
+    WriteOverlapped.hEvent = Buffers->WriteEvent;
+
+    *BytesCopied = 0;
+    Remaining = BytesToCopy;
+    CurrentBuffer = 0;
+    BytesRead = InitialBytes;
+    BytesPending = 0;
+    WritePending = FALSE;
+    Result = TRUE;
+
+    while (TRUE) {
+
+        //
+        //  Read the next block, unless the caller has already supplied it.
+        //  Any previous block is being written while this happens.
+        //
+
+        if (BytesRead == 0) {
+            BytesToRead = SPLIT_BUFFER_SIZE;
+            if ((LONGLONG)BytesToRead > Remaining) {
+                BytesToRead = (DWORD)Remaining;
+            }
+            if (BytesToRead == 0) {
+                break;
+            }
+
+            if (SourceOverlapped) {
+                Offset.QuadPart = SourceOffset;
+                ReadOverlapped.Offset = Offset.LowPart;
+                ReadOverlapped.OffsetHigh = Offset.HighPart;
+                if (!ReadFile(hSource, Buffers->Buffer[CurrentBuffer], BytesToRead, NULL, &ReadOverlapped) &&
+                    GetLastError() != ERROR_IO_PENDING) {
+
+                    LastError = GetLastError();
+                } else if (!GetOverlappedResult(hSource, &ReadOverlapped, &BytesRead, TRUE)) {
+                    LastError = GetLastError();
+                } else {
+                    LastError = ERROR_SUCCESS;
+                }
+            } else {
+                if (!ReadFile(hSource, Buffers->Buffer[CurrentBuffer], BytesToRead, &BytesRead, NULL)) {
+                    LastError = GetLastError();
+                } else {
+                    LastError = ERROR_SUCCESS;
+                }
+            }
+
+            if (LastError != ERROR_SUCCESS) {
+                BytesRead = 0;
+                if (LastError != ERROR_HANDLE_EOF && LastError != ERROR_BROKEN_PIPE) {
+                    SplitDisplayIoError(_T("read"), LastError);
+                    Result = FALSE;
+                }
+            }
+
+            if (BytesRead == 0) {
+                break;
+            }
+        }
+
+        if (WritePending) {
+            WritePending = FALSE;
+            if (!SplitCompleteWrite(hTarget, &WriteOverlapped, BytesPending)) {
+                Result = FALSE;
+                break;
+            }
+        }
+
+        Offset.QuadPart = TargetOffset;
+        WriteOverlapped.Offset = Offset.LowPart;
+        WriteOverlapped.OffsetHigh = Offset.HighPart;
+        if (!WriteFile(hTarget, Buffers->Buffer[CurrentBuffer], BytesRead, NULL, &WriteOverlapped) &&
+            GetLastError() != ERROR_IO_PENDING) {
+
+            SplitDisplayIoError(_T("write"), GetLastError());
+            Result = FALSE;
+            break;
+        }
+
+        WritePending = TRUE;
+        BytesPending = BytesRead;
+        SourceOffset += BytesRead;
+        TargetOffset += BytesRead;
+        Remaining -= BytesRead;
+        *BytesCopied += BytesRead;
+        CurrentBuffer = 1 - CurrentBuffer;
+        BytesRead = 0;
+    }
+
+    if (WritePending) {
+        if (!SplitCompleteWrite(hTarget, &WriteOverlapped, BytesPending)) {
+            Result = FALSE;
+        }
+    }
+
+    return Result;
+}
+
+/**
+ A worker thread which writes parts of a seekable source.  Each thread
+ takes the next part that has not been written, and copies its range of the
+ source into the part file, until all parts have been written or an error
+ occurs.
+
+ @param Context Pointer to the split context.
+
+ @return Zero.  Failure is indicated via the WorkerFailed member of the
+         split context.
+ */
+DWORD WINAPI
+SplitWorkerThread(
+    __in LPVOID Context
+    )
+{
+    PSPLIT_CONTEXT SplitContext = (PSPLIT_CONTEXT)Context;
+    SPLIT_COPY_BUFFERS Buffers;
+    LONGLONG PartNumber;
+    LONGLONG BytesCopied;
+    HANDLE hDestFile;
+
+    if (!SplitInitializeBuffers(&Buffers)) {
+        SplitContext->WorkerFailed = TRUE;
+        return 0;
+    }
+
+    while (!SplitContext->WorkerFailed) {
+
+        WaitForSingleObject(SplitContext->Mutex, INFINITE);
+        PartNumber = SplitContext->CurrentPartNumber;
+        if (PartNumber < SplitContext->NumberOfParts) {
+            SplitContext->CurrentPartNumber++;
+        }
+        ReleaseMutex(SplitContext->Mutex);
+
+        if (PartNumber >= SplitContext->NumberOfParts) {
+            break;
+        }
+
+        hDestFile = SplitOpenTargetForPart(SplitContext, PartNumber, TRUE);
+        if (hDestFile == NULL) {
+            SplitContext->WorkerFailed = TRUE;
+            break;
+        }
+
+        if (!SplitCopyRange(SplitContext->hSource,
+                            TRUE,
+                            PartNumber * SplitContext->BytesPerPart,
+                            hDestFile,
+                            0,
+                            SplitContext->BytesPerPart,
+                            &Buffers,
+                            0,
+                            &BytesCopied)) {
+
+            SplitContext->WorkerFailed = TRUE;
+        }
+
+        CloseHandle(hDestFile);
+    }
+
+    SplitCleanupBuffers(&Buffers);
+    return 0;
+}
+
+/**
+ Split a source which was opened for overlapped IO and whose size is known
+ by writing several parts at the same time.
+
+ @param SplitContext Pointer to a context describing the actions to perform.
+
+ @param FileSize The size of the source, in bytes.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SplitProcessSeekableStream(
+    __in PSPLIT_CONTEXT SplitContext,
+    __in LONGLONG FileSize
+    )
+{
+    SYSTEM_INFO SystemInfo;
+    HANDLE Threads[SPLIT_MAX_THREADS];
+    DWORD ThreadCount;
+    DWORD ThreadsCreated;
+    DWORD ThreadId;
+
+    SplitContext->NumberOfParts = (FileSize + SplitContext->BytesPerPart - 1) / SplitContext->BytesPerPart;
+    if (SplitContext->NumberOfParts == 0) {
+        return TRUE;
+    }
+
+    GetSystemInfo(&SystemInfo);
+    ThreadCount = SystemInfo.dwNumberOfProcessors;
+    if (ThreadCount > SPLIT_MAX_THREADS) {
+        ThreadCount = SPLIT_MAX_THREADS;
+    }
+    if ((LONGLONG)ThreadCount > SplitContext->NumberOfParts) {
+        ThreadCount = (DWORD)SplitContext->NumberOfParts;
+    }
+    if (ThreadCount < 1) {
+        ThreadCount = 1;
+    }
+
+    SplitContext->Mutex = CreateMutex(NULL, FALSE, NULL);
+    if (SplitContext->Mutex == NULL) {
+        return FALSE;
+    }
+
+    //
+    //  This thread acts as one of the workers, so create one fewer.  If a
+    //  thread can't be created, the remaining workers write its parts.
+    //
+
+    for (ThreadsCreated = 0; ThreadsCreated < ThreadCount - 1; ThreadsCreated++) {
+        Threads[ThreadsCreated] = CreateThread(NULL, 0, SplitWorkerThread, SplitContext, 0, &ThreadId);
+        if (Threads[ThreadsCreated] == NULL) {
+            break;
+        }
+    }
+
+    SplitWorkerThread(SplitContext);
+
+    if (ThreadsCreated > 0) {
+        WaitForMultipleObjects(ThreadsCreated, Threads, TRUE, INFINITE);
+        while (ThreadsCreated > 0) {
+            ThreadsCreated--;
+            CloseHandle(Threads[ThreadsCreated]);
+        }
+    }
+
+    CloseHandle(SplitContext->Mutex);
+    SplitContext->Mutex = NULL;
+
+    if (SplitContext->WorkerFailed) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  Take a single incoming stream and break it into pieces.
 
@@ -181,7 +677,7 @@ SplitProcessStream(
             }
 
             if (hDestFile == NULL) {
-                hDestFile = SplitOpenTargetForCurrentPart(SplitContext);
+                hDestFile = SplitOpenTargetForPart(SplitContext, SplitContext->CurrentPartNumber, FALSE);
                 if (hDestFile == NULL) {
                     YoriLibLineReadClose(LineContext);
                     YoriLibFreeStringContents(&LineString);
@@ -197,16 +693,44 @@ SplitProcessStream(
         YoriLibLineReadClose(LineContext);
         YoriLibFreeStringContents(&LineString);
     } else {
-        PVOID Buffer;
-        ULONG BytesRead;
+        SPLIT_COPY_BUFFERS Buffers;
+        DWORD BytesToRead;
+        DWORD BytesRead;
+        LONGLONG BytesCopied;
+        LARGE_INTEGER FileSize;
+
+        //
+        //  If the source is a file opened for overlapped IO, each part
+        //  can be read from its own offset, so write several at once.
+        //
+
+        if (SplitContext->SourceOverlapped) {
+            FileSize.LowPart = GetFileSize(hSource, (LPDWORD)&FileSize.HighPart);
+            if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+                SplitDisplayIoError(_T("query of file size"), GetLastError());
+                return FALSE;
+            }
+            SplitContext->hSource = hSource;
+            return SplitProcessSeekableStream(SplitContext, FileSize.QuadPart);
+        }
 
-        Buffer = YoriLibMalloc((DWORD)SplitContext->BytesPerPart);
-        if (Buffer == NULL) {
+        if (!SplitInitializeBuffers(&Buffers)) {
             return FALSE;
         }
 
+        BytesToRead = SPLIT_BUFFER_SIZE;
+        if ((LONGLONG)BytesToRead > SplitContext->BytesPerPart) {
+            BytesToRead = (DWORD)SplitContext->BytesPerPart;
+        }
+
         while (TRUE) {
-            if (!ReadFile(hSource, Buffer, (DWORD)SplitContext->BytesPerPart, &BytesRead, NULL)) {
+
+            //
+            //  Read the first block of each part before creating it, so
+            //  that no empty part is created when the stream ends.
+            //
+
+            if (!ReadFile(hSource, Buffers.Buffer[0], BytesToRead, &BytesRead, NULL)) {
                 break;
             }
 
@@ -214,27 +738,27 @@ SplitProcessStream(
                 break;
             }
 
-            hDestFile = SplitOpenTargetForCurrentPart(SplitContext);
+            hDestFile = SplitOpenTargetForPart(SplitContext, SplitContext->CurrentPartNumber, TRUE);
             if (hDestFile == NULL) {
-                YoriLibFree(Buffer);
+                SplitCleanupBuffers(&Buffers);
                 return FALSE;
             }
             SplitContext->CurrentPartNumber++;
 
-            if (!WriteFile(hDestFile, Buffer, BytesRead, &BytesRead, NULL)) {
-                DWORD LastError = GetLastError();
-                LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: write failed: %s"), ErrText);
-                YoriLibFreeWinErrorText(ErrText);
+            if (!SplitCopyRange(hSource, FALSE, 0, hDestFile, 0, SplitContext->BytesPerPart, &Buffers, BytesRead, &BytesCopied)) {
                 CloseHandle(hDestFile);
-                YoriLibFree(Buffer);
+                SplitCleanupBuffers(&Buffers);
                 return FALSE;
             }
 
             CloseHandle(hDestFile);
+
+            if (BytesCopied < SplitContext->BytesPerPart) {
+                break;
+            }
         }
 
-        YoriLibFree(Buffer);
+        SplitCleanupBuffers(&Buffers);
     }
 
     return TRUE;
@@ -260,10 +784,11 @@ SplitJoin(
 {
     HANDLE SourceHandle;
     HANDLE TargetHandle;
-    PUCHAR Buffer;
-    DWORD BytesRead;
-    DWORD BytesAllocated;
+    SPLIT_COPY_BUFFERS Buffers;
     LONGLONG CurrentFragment;
+    LONGLONG TargetOffset;
+    LONGLONG BytesCopied;
+    LARGE_INTEGER FragmentSize;
     LPTSTR FragmentFileName;
     YORI_STRING NumberString;
     DWORD LastError;
@@ -271,10 +796,7 @@ SplitJoin(
 
     ASSERT(YoriLibIsStringNullTerminated(OutputFile));
 
-    BytesAllocated = 256 * 1024;
-
-    Buffer = YoriLibMalloc(BytesAllocated);
-    if (Buffer == NULL) {
+    if (!SplitInitializeBuffers(&Buffers)) {
         return FALSE;
     }
 
@@ -283,7 +805,7 @@ SplitJoin(
                               FILE_SHARE_READ | FILE_SHARE_DELETE,
                               NULL,
                               CREATE_ALWAYS,
-                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
                               NULL);
 
     if (TargetHandle == NULL || TargetHandle == INVALID_HANDLE_VALUE) {
@@ -291,18 +813,19 @@ SplitJoin(
         ErrText = YoriLibGetWinErrorText(LastError);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: open of %y failed: %s"), OutputFile, ErrText);
         YoriLibFreeWinErrorText(ErrText);
-        YoriLibFree(Buffer);
+        SplitCleanupBuffers(&Buffers);
         return FALSE;
     }
 
     CurrentFragment = 0;
+    TargetOffset = 0;
 
     while(TRUE) {
 
         YoriLibInitEmptyString(&NumberString);
         if (!YoriLibNumberToString(&NumberString, CurrentFragment, 10, 0, '\0')) {
             CloseHandle(TargetHandle);
-            YoriLibFree(Buffer);
+            SplitCleanupBuffers(&Buffers);
             return FALSE;
         }
 
@@ -310,7 +833,7 @@ SplitJoin(
         if (FragmentFileName == NULL) {
             YoriLibFreeStringContents(&NumberString);
             CloseHandle(TargetHandle);
-            YoriLibFree(Buffer);
+            SplitCleanupBuffers(&Buffers);
             return FALSE;
         }
 
@@ -322,7 +845,7 @@ SplitJoin(
                                   FILE_SHARE_READ|FILE_SHARE_DELETE,
                                   NULL,
                                   OPEN_EXISTING,
-                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
                                   NULL);
         if (SourceHandle == INVALID_HANDLE_VALUE) {
             LastError = GetLastError();
@@ -335,50 +858,35 @@ SplitJoin(
             YoriLibFreeWinErrorText(ErrText);
             YoriLibFree(FragmentFileName);
             CloseHandle(TargetHandle);
-            YoriLibFree(Buffer);
+            SplitCleanupBuffers(&Buffers);
             return FALSE;
         }
 
-        while(TRUE) {
-
-            if (!ReadFile(SourceHandle, Buffer, BytesAllocated, &BytesRead, NULL)) {
-                LastError = GetLastError();
-                if (LastError == ERROR_HANDLE_EOF) {
-                    break;
-                }
-                ErrText = YoriLibGetWinErrorText(LastError);
-                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: read of %s failed: %s"), FragmentFileName, ErrText);
-                YoriLibFreeWinErrorText(ErrText);
-                YoriLibFree(FragmentFileName);
-                CloseHandle(TargetHandle);
-                CloseHandle(SourceHandle);
-                YoriLibFree(Buffer);
-                return FALSE;
-            }
-
-            if (BytesRead == 0) {
-                break;
-            }
+        FragmentSize.LowPart = GetFileSize(SourceHandle, (LPDWORD)&FragmentSize.HighPart);
+        if (FragmentSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+            SplitDisplayIoError(_T("read"), GetLastError());
+            YoriLibFree(FragmentFileName);
+            CloseHandle(TargetHandle);
+            CloseHandle(SourceHandle);
+            SplitCleanupBuffers(&Buffers);
+            return FALSE;
+        }
 
-            if (!WriteFile(TargetHandle, Buffer, BytesRead, &BytesRead, NULL)) {
-                LastError = GetLastError();
-                ErrText = YoriLibGetWinErrorText(LastError);
-                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: write to %y failed: %s"), OutputFile, ErrText);
-                YoriLibFreeWinErrorText(ErrText);
-                YoriLibFree(FragmentFileName);
-                CloseHandle(TargetHandle);
-                CloseHandle(SourceHandle);
-                YoriLibFree(Buffer);
-                return FALSE;
-            }
+        if (!SplitCopyRange(SourceHandle, TRUE, 0, TargetHandle, TargetOffset, FragmentSize.QuadPart, &Buffers, 0, &BytesCopied)) {
+            YoriLibFree(FragmentFileName);
+            CloseHandle(TargetHandle);
+            CloseHandle(SourceHandle);
+            SplitCleanupBuffers(&Buffers);
+            return FALSE;
         }
 
+        TargetOffset += BytesCopied;
         CloseHandle(SourceHandle);
         YoriLibFree(FragmentFileName);
         CurrentFragment++;
     }
 
-    YoriLibFree(Buffer);
+    SplitCleanupBuffers(&Buffers);
     CloseHandle(TargetHandle);
     return TRUE;
 }
@@ -514,7 +1022,7 @@ ENTRYPOINT(
                 return EXIT_FAILURE;
             }
         } else {
-            if (SplitContext.BytesPerPart == 0 || SplitContext.BytesPerPart >= (DWORD)-1) {
+            if (SplitContext.BytesPerPart <= 0) {
                 YoriLibFreeStringContents(&SplitContext.Prefix);
                 YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: invalid bytes per part\n"));
                 return EXIT_FAILURE;
@@ -547,16 +1055,29 @@ ENTRYPOINT(
         } else {
             HANDLE FileHandle;
             YORI_STRING FilePath;
+            DWORD FlagsAndAttributes;
 
             if (!YoriLibUserStringToSingleFilePath(&ArgV[StartArg], TRUE, &FilePath)) {
                 return EXIT_FAILURE;
             }
+
+            //
+            //  When splitting by bytes, open the file for overlapped IO so
+            //  that several parts can be read and written at once.
+            //
+
+            FlagsAndAttributes = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS;
+            if (!SplitContext.LinesMode) {
+                FlagsAndAttributes |= FILE_FLAG_OVERLAPPED;
+                SplitContext.SourceOverlapped = TRUE;
+            }
+
             FileHandle = CreateFile(FilePath.StartOfString,
                                     GENERIC_READ,
                                     FILE_SHARE_READ | FILE_SHARE_DELETE,
                                     NULL,
                                     OPEN_EXISTING,
-                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
+                                    FlagsAndAttributes,
                                     NULL);
 
             if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
@@ -117,14 +117,276 @@ typedef struct _TAIL_CONTEXT {
      */
     BOOLEAN Recursive;
 
+    /**
+     The buffer to accumulate output into before it is written to standard
+     output.
+     */
+    YORI_LIB_OUTPUT_BUFFER OutputBuffer;
+
 } TAIL_CONTEXT, *PTAIL_CONTEXT;
 
+/**
+ The number of bytes to read at a time when scanning backwards from the end
+ of a file looking for the start of the final lines.
+ */
+#define TAIL_SCAN_CHUNK_SIZE (64 * 1024)
+
+/**
+ The number of milliseconds to wait for a file being followed to change
+ before checking it anyway.  Change notifications are registered against the
+ parent directory and some file systems defer reporting size changes, so
+ this ensures that new data is eventually found.
+ */
+#define TAIL_FOLLOW_RECHECK_INTERVAL (1000)
+
+/**
+ The number of milliseconds to wait for a stream being followed to change
+ when no change notification is available.
+ */
+#define TAIL_FOLLOW_POLL_INTERVAL (200)
+
+/**
+ Scan backwards from the end of a file to find the offset of the first of
+ the final lines in the file.  This reads the file in fixed size chunks from
+ the end, counting line ends, so the amount of data examined is proportional
+ to the size of the lines being displayed rather than the size of the file
+ or any guess about average line length.
+
+ @param hSource Handle to the file, which must support seeking.
+
+ @param LinesToDisplay The number of lines to find from the end of the file.
+
+ @param StartOffset On successful completion, updated to contain the offset
+        of the first line to display.  This is zero if the file contains
+        no more than LinesToDisplay lines.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  On failure the
+         caller is expected to read the stream from the beginning.
+ */
+__success(return)
+BOOL
+TailFindStartOfFinalLines(
+    __in HANDLE hSource,
+    __in DWORD LinesToDisplay,
+    __out PDWORDLONG StartOffset
+    )
+{
+    PUCHAR Buffer;
+    DWORD FileSizeLow;
+    DWORD FileSizeHigh;
+    DWORDLONG FileSize;
+    DWORDLONG ChunkOffset;
+    DWORD ChunkLength;
+    DWORD BytesRead;
+    DWORD Index;
+    DWORDLONG LineEndsNeeded;
+    DWORDLONG LineEndsFound;
+    UCHAR FollowingChar;
+    UCHAR ThisChar;
+    LONG SeekHigh;
+
+    //
+    //  Line ends are found by looking for single byte carriage returns and
+    //  line feeds.  If the input is UTF-16, let the caller read it from the
+    //  beginning.
+    //
+
+    if (YoriLibGetMultibyteInputEncoding() == CP_UTF16) {
+        return FALSE;
+    }
+
+    FileSizeLow = GetFileSize(hSource, &FileSizeHigh);
+    if (FileSizeLow == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        return FALSE;
+    }
+    FileSize = ((DWORDLONG)FileSizeHigh << 32) | FileSizeLow;
+
+    Buffer = YoriLibMalloc(TAIL_SCAN_CHUNK_SIZE);
+    if (Buffer == NULL) {
+        return FALSE;
+    }
+
+    //
+    //  A file containing N lines normally has N line ends, because the
+    //  final line is terminated.  The first line to display follows the
+    //  Nth line end from the end, not counting any line end on the final
+    //  line.
+    //
+
+    LineEndsNeeded = LinesToDisplay;
+    LineEndsFound = 0;
+    FollowingChar = '\0';
+    ChunkOffset = FileSize;
+
+    while (ChunkOffset > 0) {
+
+        if (ChunkOffset > TAIL_SCAN_CHUNK_SIZE) {
+            ChunkLength = TAIL_SCAN_CHUNK_SIZE;
+        } else {
+            ChunkLength = (DWORD)ChunkOffset;
+        }
+        ChunkOffset = ChunkOffset - ChunkLength;
+
+        SeekHigh = (LONG)(ChunkOffset >> 32);
+        if (SetFilePointer(hSource, (LONG)ChunkOffset, &SeekHigh, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+            GetLastError() != NO_ERROR) {
+
+            YoriLibFree(Buffer);
+            return FALSE;
+        }
+
+        if (!ReadFile(hSource, Buffer, ChunkLength, &BytesRead, NULL) ||
+            BytesRead != ChunkLength) {
+
+            YoriLibFree(Buffer);
+            return FALSE;
+        }
+
+        for (Index = ChunkLength; Index > 0; Index--) {
+            ThisChar = Buffer[Index - 1];
+
+            //
+            //  A carriage return followed by a line feed is a single line
+            //  end, which is counted when the line feed is found.
+            //
+
+            if (ThisChar == '\n' || (ThisChar == '\r' && FollowingChar != '\n')) {
+                if (ChunkOffset + Index == FileSize) {
+                    LineEndsNeeded++;
+                }
+                LineEndsFound++;
+                if (LineEndsFound == LineEndsNeeded) {
+                    *StartOffset = ChunkOffset + Index;
+                    YoriLibFree(Buffer);
+                    return TRUE;
+                }
+            }
+            FollowingChar = ThisChar;
+        }
+    }
+
+    YoriLibFree(Buffer);
+    *StartOffset = 0;
+    return TRUE;
+}
+
+/**
+ Register for notification when a file that is being followed is changed.
+ Notifications are registered against the directory containing the file.
+
+ @param FilePath Pointer to the full path to the file.
+
+ @return Handle to a change notification, or NULL if one could not be
+         created.
+ */
+HANDLE
+TailCreateChangeNotification(
+    __in PYORI_STRING FilePath
+    )
+{
+    YORI_STRING ParentDirectory;
+    LPTSTR FinalSeperator;
+    HANDLE ChangeNotification;
+
+    FinalSeperator = YoriLibFindRightMostCharacter(FilePath, '\\');
+    if (FinalSeperator == NULL) {
+        return NULL;
+    }
+
+    if (!YoriLibAllocateString(&ParentDirectory, FilePath->LengthInChars + 1)) {
+        return NULL;
+    }
+
+    //
+    //  If the file is in the root of a drive, keep the seperator so the
+    //  root directory is watched rather than the current directory on the
+    //  drive.
+    //
+
+    ParentDirectory.LengthInChars = (DWORD)(FinalSeperator - FilePath->StartOfString);
+    if (ParentDirectory.LengthInChars > 0 &&
+        FilePath->StartOfString[ParentDirectory.LengthInChars - 1] == ':') {
+
+        ParentDirectory.LengthInChars++;
+    }
+
+    memcpy(ParentDirectory.StartOfString, FilePath->StartOfString, ParentDirectory.LengthInChars * sizeof(TCHAR));
+    ParentDirectory.StartOfString[ParentDirectory.LengthInChars] = '\0';
+
+    ChangeNotification = FindFirstChangeNotification(ParentDirectory.StartOfString, FALSE, FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    YoriLibFreeStringContents(&ParentDirectory);
+
+    if (ChangeNotification == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    return ChangeNotification;
+}
+
+/**
+ Wait for more data to become available on a stream being followed.  This
+ returns when the stream may have changed, when a recheck interval has
+ elapsed, or when the user has cancelled the operation.
+
+ @param ChangeNotification Optionally points to a change notification handle
+        which is signalled when the file being followed changes.
+
+ @return TRUE to indicate the stream should be checked for more data, FALSE
+         if the operation has been cancelled.
+ */
+BOOL
+TailWaitForMore(
+    __in_opt HANDLE ChangeNotification
+    )
+{
+    HANDLE WaitHandles[2];
+    DWORD HandleCount;
+    DWORD Timeout;
+    DWORD WaitResult;
+    HANDLE CancelEvent;
+
+    HandleCount = 0;
+    Timeout = TAIL_FOLLOW_POLL_INTERVAL;
+
+    if (ChangeNotification != NULL) {
+        WaitHandles[HandleCount] = ChangeNotification;
+        HandleCount++;
+        Timeout = TAIL_FOLLOW_RECHECK_INTERVAL;
+    }
+
+    CancelEvent = YoriLibCancelGetEvent();
+    if (CancelEvent != NULL) {
+        WaitHandles[HandleCount] = CancelEvent;
+        HandleCount++;
+    }
+
+    if (HandleCount == 0) {
+        Sleep(Timeout);
+        return TRUE;
+    }
+
+    WaitResult = WaitForMultipleObjects(HandleCount, WaitHandles, FALSE, Timeout);
+    if (YoriLibIsOperationCancelled()) {
+        return FALSE;
+    }
+
+    if (ChangeNotification != NULL && WaitResult == WAIT_OBJECT_0) {
+        FindNextChangeNotification(ChangeNotification);
+    }
+
+    return TRUE;
+}
+
 /**
  Process a single opened stream, enumerating through all lines and displaying
  the set requested by the user.
 
  @param hSource The opened source stream.
 
+ @param FilePath Optionally points to the full path of the file being
+        displayed.  This is used to detect changes to the file when waiting
+        for more data, and is NULL when processing standard input.
+
  @param TailContext Pointer to context information specifying which lines to
         display.
  
@@ -133,40 +395,61 @@ typedef struct _TAIL_CONTEXT {
 BOOL
 TailProcessStream(
     __in HANDLE hSource,
+    __in_opt PYORI_STRING FilePath,
     __in PTAIL_CONTEXT TailContext
     )
 {
     PVOID LineContext = NULL;
     DWORDLONG StartLine = 0;
     DWORDLONG CurrentLine;
+    DWORDLONG StartOffset;
     PYORI_STRING LineString;
     BOOL LineTerminated;
     BOOL TimeoutReached;
-    DWORD SeekToEndOffset = 0;
+    BOOL StartFound;
+    LONG SeekHigh;
+    HANDLE ChangeNotification;
 
     DWORD FileType = GetFileType(hSource);
     FileType = FileType & ~(FILE_TYPE_REMOTE);
 
+    TailContext->FilesFound++;
+    TailContext->FilesFoundThisArg++;
+
     //
-    //  If it's a file and we want the final few lines, start searching
-    //  from the end, assuming an average line size of 256 bytes.
+    //  If it's a file and we want the final few lines, scan backwards from
+    //  the end to find where those lines begin, and output everything from
+    //  that point.
     //
 
+    StartFound = FALSE;
     if (FileType == FILE_TYPE_DISK && TailContext->FinalLine == 0) {
-        SeekToEndOffset = 256 * TailContext->LinesToDisplay;
-    }
+        if (TailFindStartOfFinalLines(hSource, TailContext->LinesToDisplay, &StartOffset)) {
+            SeekHigh = (LONG)(StartOffset >> 32);
+            if (SetFilePointer(hSource, (LONG)StartOffset, &SeekHigh, FILE_BEGIN) != INVALID_SET_FILE_POINTER ||
+                GetLastError() == NO_ERROR) {
 
-    TailContext->FilesFound++;
-    TailContext->FilesFoundThisArg++;
+                StartFound = TRUE;
+            }
+        }
 
-    while (TRUE) {
+        if (!StartFound) {
+            SetFilePointer(hSource, 0, NULL, FILE_BEGIN);
+        }
+    }
 
-        if (SeekToEndOffset != 0) {
-            if (!SetFilePointer(hSource, -1 * SeekToEndOffset, NULL, FILE_END)) {
-                SeekToEndOffset = 0;
-                SetFilePointer(hSource, 0, NULL, FILE_BEGIN);
-            }
+    if (StartFound) {
+        while (YoriLibReadLineToStringEx(&TailContext->LinesArray[0], &LineContext, !TailContext->WaitForMore, INFINITE, hSource, &LineTerminated, &TimeoutReached)) {
+            YoriLibOutputBufferWrite(&TailContext->OutputBuffer, _T("%y\n"), &TailContext->LinesArray[0]);
         }
+    } else {
+
+        //
+        //  For streams that cannot seek, or when looking for a region in the
+        //  middle of the file, read from the beginning and retain the most
+        //  recent lines.
+        //
+
         TailContext->LinesFound = 0;
 
         while (TRUE) {
@@ -184,47 +467,47 @@ TailProcessStream(
 
         if (TailContext->LinesFound > TailContext->LinesToDisplay) {
             StartLine = TailContext->LinesFound - TailContext->LinesToDisplay;
-            break;
-        } else if (SeekToEndOffset != 0) {
-
-            //
-            //  If we didn't get enough lines and we have a file that
-            //  supports arbitrary seeks, try to grab more data.  If
-            //  we've already hit our arbitrary maximum (a 4Kb average
-            //  line size) start scanning from the top.
-            //
-
-            if (SeekToEndOffset < 4096 * TailContext->LinesToDisplay) {
-                SeekToEndOffset = 4096 * TailContext->LinesToDisplay;
-            } else {
-                SeekToEndOffset = 0;
-                SetFilePointer(hSource, 0, NULL, FILE_BEGIN);
-            }
-            YoriLibLineReadClose(LineContext);
-            LineContext = NULL;
-            continue;
-        } else {
-            StartLine = 0;
-            break;
         }
-    }
 
-    for (CurrentLine = StartLine; CurrentLine < TailContext->LinesFound; CurrentLine++) {
-        LineString = &TailContext->LinesArray[CurrentLine % TailContext->LinesToDisplay];
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), LineString);
+        for (CurrentLine = StartLine; CurrentLine < TailContext->LinesFound; CurrentLine++) {
+            LineString = &TailContext->LinesArray[CurrentLine % TailContext->LinesToDisplay];
+            YoriLibOutputBufferWrite(&TailContext->OutputBuffer, _T("%y\n"), LineString);
+        }
     }
 
     if (TailContext->WaitForMore) {
+
+        //
+        //  When following a stream, each line is written as it arrives
+        //  so that a consumer of a file or pipe sees it promptly.  A read
+        //  from a pipe waits for data to arrive, so failure indicates the
+        //  writer has gone away.  For files, wait for the file to change
+        //  before attempting to read again.
+        //
+
+        ChangeNotification = NULL;
+        if (FileType == FILE_TYPE_DISK && FilePath != NULL) {
+            ChangeNotification = TailCreateChangeNotification(FilePath);
+        }
+
+        YoriLibOutputBufferFlush(&TailContext->OutputBuffer);
         while (TRUE) {
 
             if (!YoriLibReadLineToStringEx(&TailContext->LinesArray[0], &LineContext, FALSE, INFINITE, hSource, &LineTerminated, &TimeoutReached)) {
-                if (YoriLibIsOperationCancelled()) {
+                if (YoriLibIsOperationCancelled() || FileType == FILE_TYPE_PIPE) {
+                    break;
+                }
+                if (!TailWaitForMore(ChangeNotification)) {
                     break;
                 }
-                Sleep(200);
                 continue;
             }
-            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &TailContext->LinesArray[0]);
+            YoriLibOutputBufferWrite(&TailContext->OutputBuffer, _T("%y\n"), &TailContext->LinesArray[0]);
+            YoriLibOutputBufferFlush(&TailContext->OutputBuffer);
+        }
+
+        if (ChangeNotification != NULL) {
+            FindCloseChangeNotification(ChangeNotification);
         }
     }
 
@@ -278,6 +561,7 @@ TailFileFoundCallback(
             if (TailContext->SavedErrorThisArg == ERROR_SUCCESS) {
                 DWORD LastError = GetLastError();
                 LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+                YoriLibOutputBufferFlush(&TailContext->OutputBuffer);
                 YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("tail: open of %y failed: %s"), FilePath, ErrText);
                 YoriLibFreeWinErrorText(ErrText);
             }
@@ -285,7 +569,7 @@ TailFileFoundCallback(
         }
 
         TailContext->SavedErrorThisArg = ERROR_SUCCESS;
-        TailProcessStream(FileHandle, TailContext);
+        TailProcessStream(FileHandle, FilePath, TailContext);
 
         CloseHandle(FileHandle);
     }
@@ -346,6 +630,7 @@ TailFileEnumerateErrorCallback(
         } else {
             DirName.LengthInChars = UnescapedFilePath.LengthInChars;
         }
+        YoriLibOutputBufferFlush(&TailContext->OutputBuffer);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Enumerate of %y failed: %s"), &DirName, ErrText);
         YoriLibFreeWinErrorText(ErrText);
     }
@@ -476,6 +761,12 @@ ENTRYPOINT(
         YoriLibInitEmptyString(&TailContext.LinesArray[Count]);
     }
 
+    if (!YoriLibOutputBufferInitialize(&TailContext.OutputBuffer, YORI_LIB_OUTPUT_STDOUT)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("tail: out of memory\n"));
+        YoriLibFree(TailContext.LinesArray);
+        return EXIT_FAILURE;
+    }
+
     //
     //  If no file name is specified, use stdin; otherwise open
     //  the file and use that
@@ -483,12 +774,13 @@ ENTRYPOINT(
 
     if (StartArg == 0 || StartArg == ArgC) {
         if (YoriLibIsStdInConsole()) {
+            YoriLibOutputBufferCleanup(&TailContext.OutputBuffer);
             YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("No file or pipe for input\n"));
             YoriLibFree(TailContext.LinesArray);
             return EXIT_FAILURE;
         }
 
-        TailProcessStream(GetStdHandle(STD_INPUT_HANDLE), &TailContext);
+        TailProcessStream(GetStdHandle(STD_INPUT_HANDLE), NULL, &TailContext);
     } else {
         MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_DIRECTORY_CONTENTS;
         if (TailContext.Recursive) {
@@ -519,12 +811,15 @@ ENTRYPOINT(
                 }
 
                 if (TailContext.SavedErrorThisArg != ERROR_SUCCESS) {
+                    YoriLibOutputBufferFlush(&TailContext.OutputBuffer);
                     YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("File or directory not found: %y\n"), &ArgV[i]);
                 }
             }
         }
     }
 
+    YoriLibOutputBufferCleanup(&TailContext.OutputBuffer);
+
     for (Count = 0; Count < TailContext.LinesToDisplay; Count++) {
         YoriLibFreeStringContents(&TailContext.LinesArray[Count]);
     }
@@ -100,6 +100,12 @@ typedef struct _TYPE_CONTEXT {
      */
     DWORDLONG FileLinesFound;
 
+    /**
+     The buffer to accumulate output into before it is written to standard
+     output.
+     */
+    YORI_LIB_OUTPUT_BUFFER OutputBuffer;
+
 } TYPE_CONTEXT, *PTYPE_CONTEXT;
 
 /**
@@ -122,8 +128,6 @@ TypeProcessStream(
     PVOID LineContext = NULL;
     CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
     YORI_STRING LineString;
-    BOOL OutputIsConsole;
-    DWORD dwMode;
     DWORD CharactersDisplayed;
     HANDLE OutputHandle;
 
@@ -135,14 +139,9 @@ TypeProcessStream(
     TypeContext->FilesFoundThisArg++;
     TypeContext->FileLinesFound = 0;
 
-    OutputIsConsole = FALSE;
-    if (GetConsoleMode(OutputHandle, &dwMode)) {
-        OutputIsConsole = TRUE;
-    }
-
     while (TRUE) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibMappedLineReadToString(&LineString, &LineContext, hSource)) {
             break;
         }
 
@@ -150,25 +149,25 @@ TypeProcessStream(
 
         if ((TypeContext->HeadLines == 0 || TypeContext->FileLinesFound <= TypeContext->HeadLines)) {
             if (TypeContext->DisplayLineNumbers) {
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%8lli: %y"), TypeContext->FileLinesFound, &LineString);
+                YoriLibOutputBufferWrite(&TypeContext->OutputBuffer, _T("%8lli: %y"), TypeContext->FileLinesFound, &LineString);
                 CharactersDisplayed = LineString.LengthInChars + 10;
             } else {
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &LineString);
+                YoriLibOutputBufferWriteString(&TypeContext->OutputBuffer, &LineString);
                 CharactersDisplayed = LineString.LengthInChars;
             }
             if (CharactersDisplayed == 0 ||
-                !OutputIsConsole ||
+                !TypeContext->OutputBuffer.OutputIsConsole ||
                 !GetConsoleScreenBufferInfo(OutputHandle, &ScreenInfo) ||
                 ScreenInfo.dwCursorPosition.X != 0) {
 
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\n"));
+                YoriLibOutputBufferWrite(&TypeContext->OutputBuffer, _T("\n"));
             }
         } else {
             break;
         }
     }
 
-    YoriLibLineReadClose(LineContext);
+    YoriLibMappedLineReadClose(LineContext);
     YoriLibFreeStringContents(&LineString);
 
     return TRUE;
@@ -220,6 +219,7 @@ TypeFileFoundCallback(
             if (TypeContext->SavedErrorThisArg == ERROR_SUCCESS) {
                 DWORD LastError = GetLastError();
                 LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+                YoriLibOutputBufferFlush(&TypeContext->OutputBuffer);
                 YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("type: open of %y failed: %s"), FilePath, ErrText);
                 YoriLibFreeWinErrorText(ErrText);
             }
@@ -288,6 +288,7 @@ TypeFileEnumerateErrorCallback(
         } else {
             DirName.LengthInChars = UnescapedFilePath.LengthInChars;
         }
+        YoriLibOutputBufferFlush(&TypeContext->OutputBuffer);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Enumerate of %y failed: %s"), &DirName, ErrText);
         YoriLibFreeWinErrorText(ErrText);
     }
@@ -412,6 +413,11 @@ ENTRYPOINT(
 
     YoriLibEnableBackupPrivilege();
 
+    if (!YoriLibOutputBufferInitialize(&TypeContext.OutputBuffer, YORI_LIB_OUTPUT_STDOUT)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("type: out of memory\n"));
+        return EXIT_FAILURE;
+    }
+
     //
     //  If no file name is specified, use stdin; otherwise open
     //  the file and use that
@@ -419,6 +425,7 @@ ENTRYPOINT(
 
     if (StartArg == 0 || StartArg == ArgC) {
         if (YoriLibIsStdInConsole()) {
+            YoriLibOutputBufferCleanup(&TypeContext.OutputBuffer);
             YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("No file or pipe for input\n"));
             return EXIT_FAILURE;
         }
@@ -453,12 +460,15 @@ ENTRYPOINT(
                     YoriLibFreeStringContents(&FullPath);
                 }
                 if (TypeContext.SavedErrorThisArg != ERROR_SUCCESS) {
+                    YoriLibOutputBufferFlush(&TypeContext.OutputBuffer);
                     YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("File or directory not found: %y\n"), &ArgV[i]);
                 }
             }
         }
     }
 
+    YoriLibOutputBufferCleanup(&TypeContext.OutputBuffer);
+
     if (TypeContext.FilesFound == 0) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("type: no matching files found\n"));
         return EXIT_FAILURE;